@@ -145,8 +145,13 @@ static const char *parse_quote(const char *s, char *token, size_t *tokenlen, siz
 {
   while (*s)
   {
+    /* Copy everything up to the next backslash or quote at once */
+    size_t len = strcspn(s, "\\\"");
     if (*tokenlen < tokenmax)
-      token[*tokenlen] = *s;
+      memcpy(token + *tokenlen, s, MIN(len, tokenmax - *tokenlen));
+    *tokenlen += len;
+    s += len;
+
     if (*s == '\\')
     {
       if (!*++s)
@@ -154,11 +159,11 @@ static const char *parse_quote(const char *s, char *token, size_t *tokenlen, siz
 
       if (*tokenlen < tokenmax)
         token[*tokenlen] = *s;
+      (*tokenlen)++;
+      s++;
     }
     else if (*s == '"')
       return (s + 1);
-    (*tokenlen)++;
-    s++;
   }
   AddressError = ERR_MISMATCH_QUOTE;
   return NULL;
@@ -184,15 +189,16 @@ static const char *next_token(const char *s, char *token, size_t *tokenlen, size
       token[(*tokenlen)++] = *s;
     return (s + 1);
   }
-  while (*s)
+
+  /* Copy the whole word at once, rather than testing it a char at a time */
+  size_t len = strcspn(s, EMAIL_WSP "@.,:;<>[]\\\"()");
+  if (*tokenlen < tokenmax)
   {
-    if (mutt_str_is_email_wsp(*s) || is_special(*s))
-      break;
-    if (*tokenlen < tokenmax)
-      token[(*tokenlen)++] = *s;
-    s++;
+    size_t n = MIN(len, tokenmax - *tokenlen);
+    memcpy(token + *tokenlen, s, n);
+    *tokenlen += n;
   }
-  return s;
+  return s + len;
 }
 
 /**
@@ -0,0 +1,238 @@
+/**
+ * @file
+ * Find the messages an address appears in
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page address_index Find the messages an address appears in
+ *
+ * In a mailing list folder, the same few thousand addresses appear in every
+ * message.  Matching ~f or ~L against each message's addresses runs the
+ * regex over the same strings again and again.
+ *
+ * The index holds each distinct mailbox and personal name of a mailbox once,
+ * with a posting list of the messages (and the fields) it appears in.  A
+ * pattern matches each string once, then marks its messages.
+ *
+ * The index is built the first time it's needed and is rebuilt if the
+ * messages have been re-sorted, added or removed since.
+ *
+ * | Function                  | Description
+ * | :------------------------ | :-------------------------------------------
+ * | mutt_addr_index_free()    | Free an AddressIndex
+ * | mutt_addr_index_get()     | Get the address index of a mailbox
+ * | mutt_addr_index_match()   | Find the messages with a matching address
+ */
+
+#include "config.h"
+#include <stdbool.h>
+#include <string.h>
+#include "mutt/mutt.h"
+#include "address_index.h"
+#include "address.h"
+#include "context.h"
+#include "envelope.h"
+#include "header.h"
+
+/**
+ * struct AddrEntry - A distinct mailbox or personal name
+ */
+struct AddrEntry
+{
+  const char *str;      /**< The string, owned by the hash */
+  int fields;           /**< All the fields it appears in, e.g. #MUTT_AI_FROM */
+  int count;            /**< Number of postings */
+  int max;              /**< Size of the posting arrays */
+  int *rows;            /**< Messages it appears in, index into Context.hdrs */
+  unsigned char *where; /**< Fields it appears in, for each message */
+};
+
+/**
+ * struct AddressIndex - The distinct addresses of a mailbox
+ */
+struct AddressIndex
+{
+  struct Hash *hash;         /**< String -> AddrEntry */
+  struct AddrEntry **entries; /**< Every AddrEntry, in the order they were found */
+  int count;                  /**< Number of entries */
+  int max;                    /**< Size of entries */
+  struct Header **hdrs;       /**< Messages the index was built from */
+  int msgcount;               /**< Number of messages */
+};
+
+/**
+ * addr_entry_free - Free an AddrEntry - Implements ::hash_destructor
+ */
+static void addr_entry_free(int type, void *obj, intptr_t data)
+{
+  struct AddrEntry *e = obj;
+
+  FREE(&e->rows);
+  FREE(&e->where);
+  FREE(&e);
+}
+
+/**
+ * addr_index_add - Record that a string appears in a message
+ * @param ai    Index
+ * @param str   Mailbox or personal name
+ * @param row   Message, index into Context.hdrs
+ * @param field Field, e.g. #MUTT_AI_FROM
+ */
+static void addr_index_add(struct AddressIndex *ai, const char *str, int row, int field)
+{
+  struct AddrEntry *e = mutt_hash_find(ai->hash, str);
+
+  if (!e)
+  {
+    e = mutt_mem_calloc(1, sizeof(struct AddrEntry));
+    e->str = mutt_hash_insert(ai->hash, str, e)->key.strkey;
+    if (ai->count == ai->max)
+    {
+      ai->max = MAX(64, 2 * ai->max);
+      mutt_mem_realloc(&ai->entries, ai->max * sizeof(struct AddrEntry *));
+    }
+    ai->entries[ai->count++] = e;
+  }
+
+  e->fields |= field;
+
+  /* the rows are added in order, so a repeat is always the last posting */
+  if ((e->count > 0) && (e->rows[e->count - 1] == row))
+  {
+    e->where[e->count - 1] |= field;
+    return;
+  }
+
+  if (e->count == e->max)
+  {
+    e->max = MAX(4, 2 * e->max);
+    mutt_mem_realloc(&e->rows, e->max * sizeof(int));
+    mutt_mem_realloc(&e->where, e->max);
+  }
+  e->rows[e->count] = row;
+  e->where[e->count] = field;
+  e->count++;
+}
+
+/**
+ * addr_index_add_list - Record the strings of an address list
+ * @param ai    Index
+ * @param a     Address list
+ * @param row   Message, index into Context.hdrs
+ * @param field Field, e.g. #MUTT_AI_FROM
+ */
+static void addr_index_add_list(struct AddressIndex *ai, const struct Address *a,
+                                int row, int field)
+{
+  for (; a; a = a->next)
+  {
+    if (a->mailbox)
+      addr_index_add(ai, a->mailbox, row, field);
+    if (a->personal)
+      addr_index_add(ai, a->personal, row, field);
+  }
+}
+
+/**
+ * mutt_addr_index_free - Free an AddressIndex
+ * @param ai Index to free
+ */
+void mutt_addr_index_free(struct AddressIndex **ai)
+{
+  if (!ai || !*ai)
+    return;
+
+  mutt_hash_destroy(&(*ai)->hash);
+  FREE(&(*ai)->entries);
+  FREE(&(*ai)->hdrs);
+  FREE(ai);
+}
+
+/**
+ * mutt_addr_index_get - Get the address index of a mailbox
+ * @param ctx Mailbox
+ * @retval ptr  Index
+ * @retval NULL A message has no envelope
+ *
+ * The index is built, or rebuilt if the messages have changed since.
+ */
+struct AddressIndex *mutt_addr_index_get(struct Context *ctx)
+{
+  struct AddressIndex *ai = ctx->addr_index;
+
+  if (ai && (ai->msgcount == ctx->msgcount) &&
+      (memcmp(ai->hdrs, ctx->hdrs, ctx->msgcount * sizeof(struct Header *)) == 0))
+  {
+    return ai;
+  }
+
+  mutt_addr_index_free(&ctx->addr_index);
+
+  ai = mutt_mem_calloc(1, sizeof(struct AddressIndex));
+  ai->hash = mutt_hash_create(MAX(ctx->msgcount, 64), MUTT_HASH_STRDUP_KEYS);
+  mutt_hash_set_destructor(ai->hash, addr_entry_free, 0);
+  ai->msgcount = ctx->msgcount;
+  ai->hdrs = mutt_mem_malloc(MAX(ctx->msgcount, 1) * sizeof(struct Header *));
+  memcpy(ai->hdrs, ctx->hdrs, ctx->msgcount * sizeof(struct Header *));
+
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    const struct Envelope *env = ctx->hdrs[i]->env;
+    if (!env)
+    {
+      mutt_addr_index_free(&ai);
+      return NULL;
+    }
+
+    addr_index_add_list(ai, env->from, i, MUTT_AI_FROM);
+    addr_index_add_list(ai, env->sender, i, MUTT_AI_SENDER);
+    addr_index_add_list(ai, env->to, i, MUTT_AI_TO);
+    addr_index_add_list(ai, env->cc, i, MUTT_AI_CC);
+  }
+
+  mutt_debug(2, "%d distinct addresses in %d messages\n", ai->count, ai->msgcount);
+  ctx->addr_index = ai;
+  return ai;
+}
+
+/**
+ * mutt_addr_index_match - Find the messages with a matching address
+ * @param[in]  ai     Index
+ * @param[in]  fields Fields to look in, e.g. #MUTT_AI_FROM | #MUTT_AI_SENDER
+ * @param[in]  match  Test for each string
+ * @param[in]  data   Private data for @a match
+ * @param[out] hits   One byte per message, set to 1 if it has a match
+ *
+ * Each distinct string in the fields is tested once.
+ */
+void mutt_addr_index_match(struct AddressIndex *ai, int fields,
+                           addr_index_match_t match, void *data, unsigned char *hits)
+{
+  memset(hits, 0, ai->msgcount);
+
+  for (int i = 0; i < ai->count; i++)
+  {
+    const struct AddrEntry *e = ai->entries[i];
+    if (!(e->fields & fields) || !match(e->str, data))
+      continue;
+
+    for (int j = 0; j < e->count; j++)
+      if (e->where[j] & fields)
+        hits[e->rows[j]] = 1;
+  }
+}
@@ -0,0 +1,46 @@
+/**
+ * @file
+ * Find the messages an address appears in
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_ADDRESS_INDEX_H
+#define _MUTT_ADDRESS_INDEX_H
+
+#include <stdbool.h>
+
+struct AddressIndex;
+struct Context;
+
+/* Address fields of an Envelope */
+#define MUTT_AI_FROM   (1 << 0) /**< Envelope.from */
+#define MUTT_AI_SENDER (1 << 1) /**< Envelope.sender */
+#define MUTT_AI_TO     (1 << 2) /**< Envelope.to */
+#define MUTT_AI_CC     (1 << 3) /**< Envelope.cc */
+
+/**
+ * typedef addr_index_match_t - Test a mailbox or personal name
+ * @param str  String from an Address
+ * @param data Private data
+ * @retval true The string matches
+ */
+typedef bool (*addr_index_match_t)(const char *str, void *data);
+
+void                 mutt_addr_index_free(struct AddressIndex **ai);
+struct AddressIndex *mutt_addr_index_get(struct Context *ctx);
+void                 mutt_addr_index_match(struct AddressIndex *ai, int fields, addr_index_match_t match, void *data, unsigned char *hits);
+
+#endif /* _MUTT_ADDRESS_INDEX_H */
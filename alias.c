@@ -35,18 +35,143 @@
 #include "address.h"
 #include "envelope.h"
 #include "globals.h"
+#include "group.h"
 #include "mutt_curses.h"
 #include "options.h"
 #include "protos.h"
 
+static struct Alias *AliasTail = NULL; /**< Last entry in Aliases, if known */
+
+/**
+ * struct AliasIndexEntry - An alias in the completion index
+ */
+struct AliasIndexEntry
+{
+  struct Alias *alias; /**< Alias */
+  size_t pos;          /**< Position in the Aliases list */
+};
+
+static struct AliasIndexEntry *AliasIndex = NULL; /**< Aliases sorted by name */
+static size_t AliasIndexCount = 0;                /**< Number of entries in AliasIndex */
+static bool AliasIndexValid = false;              /**< AliasIndex matches Aliases */
+
 struct Address *mutt_lookup_alias(const char *s)
 {
-  struct Alias *t = Aliases;
+  struct Alias *t = NULL;
+
+  if (s)
+    t = mutt_hash_find(AliasNames, s);
+  return t ? t->addr : NULL;
+}
+
+/**
+ * mutt_alias_append - Add an alias to the end of the Aliases list
+ * @param a Alias to add
+ *
+ * The alias is also added to the name lookup table.
+ */
+void mutt_alias_append(struct Alias *a)
+{
+  if (!a)
+    return;
+
+  if (Aliases)
+  {
+    struct Alias *t = AliasTail ? AliasTail : Aliases;
+    while (t->next)
+      t = t->next;
+    t->next = a;
+  }
+  else
+    Aliases = a;
+
+  AliasTail = a;
+  mutt_hash_insert(AliasNames, a->name, a);
+  AliasIndexValid = false;
+}
+
+/**
+ * alias_index_cmp - Compare two aliases by name, for qsort()
+ */
+static int alias_index_cmp(const void *a, const void *b)
+{
+  const struct AliasIndexEntry *x = a;
+  const struct AliasIndexEntry *y = b;
 
-  for (; t; t = t->next)
-    if (mutt_str_strcasecmp(s, t->name) == 0)
-      return t->addr;
-  return NULL; /* no such alias */
+  return strcmp(x->alias->name, y->alias->name);
+}
+
+/**
+ * alias_pos_cmp - Compare two aliases by list position, for qsort()
+ */
+static int alias_pos_cmp(const void *a, const void *b)
+{
+  const struct AliasIndexEntry *x = a;
+  const struct AliasIndexEntry *y = b;
+
+  return (x->pos > y->pos) - (x->pos < y->pos);
+}
+
+/**
+ * alias_index_build - Sort the aliases by name, if they've changed
+ */
+static void alias_index_build(void)
+{
+  size_t n = 0;
+
+  if (AliasIndexValid)
+    return;
+
+  for (struct Alias *a = Aliases; a; a = a->next)
+    n++;
+
+  FREE(&AliasIndex);
+  AliasIndex = mutt_mem_calloc(n ? n : 1, sizeof(struct AliasIndexEntry));
+  AliasIndexCount = 0;
+
+  n = 0;
+  for (struct Alias *a = Aliases; a; a = a->next, n++)
+  {
+    if (!a->name)
+      continue;
+    AliasIndex[AliasIndexCount].alias = a;
+    AliasIndex[AliasIndexCount].pos = n;
+    AliasIndexCount++;
+  }
+
+  qsort(AliasIndex, AliasIndexCount, sizeof(struct AliasIndexEntry), alias_index_cmp);
+  AliasIndexValid = true;
+}
+
+/**
+ * alias_prefix_range - Find the aliases whose names start with a string
+ * @param[in]  s     Prefix
+ * @param[out] first First matching entry of AliasIndex
+ * @retval num Number of matching entries
+ */
+static size_t alias_prefix_range(const char *s, size_t *first)
+{
+  alias_index_build();
+
+  size_t len = mutt_str_strlen(s);
+  size_t lo = 0, hi = AliasIndexCount;
+
+  /* first name that isn't less than the prefix */
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (strcmp(AliasIndex[mid].alias->name, s) < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  *first = lo;
+  hi = lo;
+  while ((hi < AliasIndexCount) && (strncmp(AliasIndex[hi].alias->name, s, len) == 0))
+    hi++;
+
+  return hi - lo;
 }
 
 static struct Address *expand_aliases_r(struct Address *a, struct ListHead *expn)
@@ -278,7 +403,7 @@ int check_alias_name(const char *s, char *dest, size_t destlen)
 
 void mutt_create_alias(struct Envelope *cur, struct Address *iaddr)
 {
-  struct Alias *new = NULL, *t = NULL;
+  struct Alias *new = NULL;
   char buf[LONG_STRING], tmp[LONG_STRING], prompt[SHORT_STRING], *pc = NULL;
   char *err = NULL;
   char fixed[LONG_STRING];
@@ -384,16 +509,7 @@ retry_name:
   }
 
   mutt_alias_add_reverse(new);
-
-  t = Aliases;
-  if (t)
-  {
-    while (t->next)
-      t = t->next;
-    t->next = new;
-  }
-  else
-    Aliases = new;
+  mutt_alias_append(new);
 
   mutt_str_strfcpy(buf, NONULL(AliasFile), sizeof(buf));
   if (mutt_get_field(_("Save to file: "), buf, sizeof(buf), MUTT_FILE) != 0)
@@ -503,30 +619,27 @@ void mutt_alias_delete_reverse(struct Alias *t)
  */
 int mutt_alias_complete(char *s, size_t buflen)
 {
-  struct Alias *a = Aliases;
   struct Alias *a_list = NULL, *a_cur = NULL;
   char bestname[HUGE_STRING];
+  size_t first = 0, count = 0;
   int i;
 
   if (s[0] != 0) /* avoid empty string as strstr argument */
   {
     memset(bestname, 0, sizeof(bestname));
 
-    while (a)
+    /* The matches are adjacent in the sorted index, so the prefix they all
+     * share is the one shared by the first and the last. */
+    count = alias_prefix_range(s, &first);
+    if (count > 0)
     {
-      if (a->name && strstr(a->name, s) == a->name)
-      {
-        if (!bestname[0]) /* init */
-          mutt_str_strfcpy(bestname, a->name,
-                           MIN(mutt_str_strlen(a->name) + 1, sizeof(bestname)));
-        else
-        {
-          for (i = 0; a->name[i] && a->name[i] == bestname[i]; i++)
-            ;
-          bestname[i] = '\0';
-        }
-      }
-      a = a->next;
+      const char *lo = AliasIndex[first].alias->name;
+      const char *hi = AliasIndex[first + count - 1].alias->name;
+
+      mutt_str_strfcpy(bestname, lo, MIN(mutt_str_strlen(lo) + 1, sizeof(bestname)));
+      for (i = 0; hi[i] && hi[i] == bestname[i]; i++)
+        ;
+      bestname[i] = '\0';
     }
 
     if (bestname[0] != 0)
@@ -538,25 +651,24 @@ int mutt_alias_complete(char *s, size_t buflen)
         return 1;
       }
 
-      /* build alias list and show it */
+      /* build alias list, in the original order, and show it */
+      struct AliasIndexEntry *matches = mutt_mem_calloc(count, sizeof(struct AliasIndexEntry));
+      memcpy(matches, AliasIndex + first, count * sizeof(struct AliasIndexEntry));
+      qsort(matches, count, sizeof(struct AliasIndexEntry), alias_pos_cmp);
 
-      a = Aliases;
-      while (a)
+      for (size_t j = 0; j < count; j++)
       {
-        if (a->name && (strstr(a->name, s) == a->name))
+        if (!a_list) /* init */
+          a_cur = a_list = mutt_mem_malloc(sizeof(struct Alias));
+        else
         {
-          if (!a_list) /* init */
-            a_cur = a_list = mutt_mem_malloc(sizeof(struct Alias));
-          else
-          {
-            a_cur->next = mutt_mem_malloc(sizeof(struct Alias));
-            a_cur = a_cur->next;
-          }
-          memcpy(a_cur, a, sizeof(struct Alias));
-          a_cur->next = NULL;
+          a_cur->next = mutt_mem_malloc(sizeof(struct Alias));
+          a_cur = a_cur->next;
         }
-        a = a->next;
+        memcpy(a_cur, matches[j].alias, sizeof(struct Alias));
+        a_cur->next = NULL;
       }
+      FREE(&matches);
     }
   }
 
@@ -613,6 +725,20 @@ static bool string_is_address(const char *str, const char *u, const char *d)
   return false;
 }
 
+static struct AddrLookup *AlternatesLookup = NULL;
+static struct AddrLookup *UnAlternatesLookup = NULL;
+
+/**
+ * mutt_alternates_reset - Forget the lookups of the alternates
+ *
+ * This must be called when the alternates or unalternates change.
+ */
+void mutt_alternates_reset(void)
+{
+  mutt_addrlookup_free(&AlternatesLookup);
+  mutt_addrlookup_free(&UnAlternatesLookup);
+}
+
 /**
  * mutt_addr_is_user - Does the address belong to the user
  * @retval true if the given address belongs to the user
@@ -662,10 +788,10 @@ bool mutt_addr_is_user(struct Address *addr)
     return true;
   }
 
-  if (mutt_regexlist_match(Alternates, addr->mailbox))
+  if (mutt_addrlookup_match(&AlternatesLookup, NULL, Alternates, addr->mailbox))
   {
     mutt_debug(5, "yes, %s matched by alternates.\n", addr->mailbox);
-    if (mutt_regexlist_match(UnAlternates, addr->mailbox))
+    if (mutt_addrlookup_match(&UnAlternatesLookup, NULL, UnAlternates, addr->mailbox))
       mutt_debug(5, "but, %s matched by unalternates.\n", addr->mailbox);
     else
       return true;
@@ -684,6 +810,11 @@ void mutt_free_alias(struct Alias **p)
     t = *p;
     *p = (*p)->next;
     mutt_alias_delete_reverse(t);
+    if (t->name)
+      mutt_hash_delete(AliasNames, t->name, t);
+    if (t == AliasTail)
+      AliasTail = NULL;
+    AliasIndexValid = false;
     FREE(&t->name);
     mutt_addr_free(&t->addr);
     FREE(&t);
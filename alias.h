@@ -47,5 +47,6 @@ void mutt_expand_aliases_env(struct Envelope *env);
 struct Address *mutt_get_address(struct Envelope *env, char **pfxp);
 void mutt_create_alias(struct Envelope *cur, struct Address *iaddr);
 void mutt_free_alias(struct Alias **p);
+void mutt_alias_append(struct Alias *a);
 
 #endif /* _MUTT_ALIAS_H */
@@ -28,9 +28,10 @@
 #include <stdbool.h>
 #include <stdio.h>
 
-struct Menu;
-struct Header;
 struct Body;
+struct Context;
+struct Header;
+struct Menu;
 
 /**
  * struct AttachPtr - An email to which things will be attached
@@ -100,4 +101,6 @@ void mutt_actx_add_body(struct AttachCtx *actx, struct Body *new_body);
 void mutt_actx_free_entries(struct AttachCtx *actx);
 void mutt_free_attach_context(struct AttachCtx **pactx);
 
+void mutt_attach_cache_forget(struct Context *ctx, struct Header *hdr);
+
 #endif /* _MUTT_ATTACH_H */
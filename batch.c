@@ -0,0 +1,284 @@
+/**
+ * @file
+ * Run a script of mailbox commands without a screen
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page batch Batch scripts
+ *
+ * `neomutt -X script` runs the commands in the script, one per line, without
+ * starting curses.  Jobs that expire, archive or tag mail don't need `push`,
+ * or a terminal, to drive the index.
+ *
+ * | Command             | Description
+ * | :------------------ | :---------------------------------------------------
+ * | open MAILBOX        | Open a mailbox, closing the current one
+ * | limit PATTERN       | Only let the following commands see matching messages
+ * | tag PATTERN         | Tag the matching messages
+ * | untag PATTERN       | Untag the matching messages
+ * | delete PATTERN      | Delete the matching messages
+ * | undelete PATTERN    | Undelete the matching messages
+ * | save MAILBOX        | Save the tagged messages, deleting them here
+ * | copy MAILBOX        | Copy the tagged messages
+ * | sync                | Write the changes to the mailbox
+ * | close               | Write the changes and close the mailbox
+ *
+ * Any other line is a config command, e.g. `set delete=yes`.  Questions get
+ * their default answer.  Progress is written to stderr, and the script stops
+ * at the first command that fails.
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mutt/mutt.h"
+#include "mutt.h"
+#include "batch.h"
+#include "context.h"
+#include "globals.h"
+#include "header.h"
+#include "mailbox.h"
+#include "options.h"
+#include "pattern.h"
+#include "protos.h"
+
+/**
+ * count_tagged - Count the visible, tagged messages
+ * @retval num Number of messages
+ */
+static int count_tagged(void)
+{
+  int n = 0;
+
+  for (int i = 0; i < Context->msgcount; i++)
+    if (message_is_tagged(Context, i))
+      n++;
+  return n;
+}
+
+/**
+ * batch_close - Close the current mailbox, writing its changes
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int batch_close(void)
+{
+  if (!Context)
+    return 0;
+
+  if (mx_close_mailbox(Context, NULL) != 0)
+    return -1;
+  FREE(&Context);
+  return 0;
+}
+
+/**
+ * batch_open - Open a mailbox
+ * @param path Mailbox
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int batch_open(const char *path)
+{
+  char buf[_POSIX_PATH_MAX];
+
+  if (batch_close() != 0)
+    return -1;
+
+  mutt_str_strfcpy(buf, path, sizeof(buf));
+  mutt_expand_path(buf, sizeof(buf));
+  Context = mx_open_mailbox(buf, ReadOnly ? MUTT_READONLY : 0, NULL);
+  if (!Context)
+    return -1;
+
+  mutt_message(_("%s: %d messages"), buf, Context->msgcount);
+  return 0;
+}
+
+/**
+ * batch_save - Save or copy the tagged messages
+ * @param path   Mailbox
+ * @param delete If true, delete the originals
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int batch_save(const char *path, bool delete)
+{
+  char buf[_POSIX_PATH_MAX];
+  struct stat st;
+
+  int n = count_tagged();
+  if (n == 0)
+  {
+    mutt_message(_("No tagged messages."));
+    return 0;
+  }
+
+  mutt_str_strfcpy(buf, path, sizeof(buf));
+  mutt_expand_path(buf, sizeof(buf));
+  if (mutt_save_confirm(buf, &st) != 0)
+    return -1;
+  if (mutt_save_message_to(NULL, buf, &st, delete, 0, 0) != 0)
+    return -1;
+
+  mutt_message(delete ? _("Saved %d messages to %s") : _("Copied %d messages to %s"), n, buf);
+  return 0;
+}
+
+/**
+ * batch_command - Run a batch command
+ * @param cmd  Name of the command
+ * @param args Rest of the line
+ * @retval  0 Success
+ * @retval -1 Error
+ * @retval  1 Not a batch command
+ */
+static int batch_command(const char *cmd, char *args)
+{
+  static const struct Mapping PatternOps[] = {
+    { "limit", MUTT_LIMIT },     { "tag", MUTT_TAG },
+    { "untag", MUTT_UNTAG },     { "delete", MUTT_DELETE },
+    { "undelete", MUTT_UNDELETE }, { NULL, 0 },
+  };
+
+  if (mutt_str_strcmp(cmd, "open") == 0)
+  {
+    if (!*args)
+    {
+      mutt_error(_("open: no mailbox"));
+      return -1;
+    }
+    return batch_open(args);
+  }
+
+  int op = mutt_map_get_value(cmd, PatternOps);
+  bool is_save = (mutt_str_strcmp(cmd, "save") == 0) || (mutt_str_strcmp(cmd, "copy") == 0);
+  bool is_sync = (mutt_str_strcmp(cmd, "sync") == 0);
+  bool is_close = (mutt_str_strcmp(cmd, "close") == 0);
+  if ((op == -1) && !is_save && !is_sync && !is_close)
+    return 1;
+
+  if (!Context)
+  {
+    mutt_error(_("%s: no mailbox is open"), cmd);
+    return -1;
+  }
+
+  if (is_close)
+    return batch_close();
+  if (is_sync)
+    return (mx_sync_mailbox(Context, NULL) == 0) ? 0 : -1;
+
+  if (!*args)
+  {
+    mutt_error(is_save ? _("%s: no mailbox") : _("%s: no pattern"), cmd);
+    return -1;
+  }
+
+  if (is_save)
+    return batch_save(args, (cmd[0] == 's'));
+
+  if (mutt_pattern_apply(op, args) != 0)
+    return -1;
+
+  if (op == MUTT_LIMIT)
+    mutt_message(_("%s: %d of %d messages"), cmd, Context->vcount, Context->msgcount);
+  else if ((op == MUTT_TAG) || (op == MUTT_UNTAG))
+    mutt_message(_("%s: %d messages tagged"), cmd, count_tagged());
+  else
+    mutt_message(_("%s: %d messages deleted"), cmd, Context->deleted);
+  return 0;
+}
+
+/**
+ * mutt_batch_run - Run a batch script
+ * @param file Script, or "-" for stdin
+ * @retval 0 Success
+ * @retval 1 Error, the script was stopped
+ *
+ * The open mailbox is closed, and its changes written, at the end.
+ */
+int mutt_batch_run(const char *file)
+{
+  struct Buffer token, err;
+  char *line = NULL;
+  size_t linelen = 0;
+  int lineno = 0;
+  int rc = 0;
+
+  FILE *fp = (mutt_str_strcmp(file, "-") == 0) ? stdin : fopen(file, "r");
+  if (!fp)
+  {
+    mutt_error("%s: %s", file, strerror(errno));
+    return 1;
+  }
+
+  mutt_buffer_init(&token);
+  mutt_buffer_init(&err);
+  err.dsize = STRING;
+  err.data = mutt_mem_malloc(err.dsize);
+
+  while ((rc == 0) && (line = mutt_file_read_line(line, &linelen, fp, &lineno, MUTT_CONT)))
+  {
+    char *p = mutt_str_skip_whitespace(line);
+    if (!*p || (*p == '#'))
+      continue;
+
+    char cmd[SHORT_STRING];
+    const char *end = mutt_str_find_word(p);
+    mutt_str_strfcpy(cmd, p, MIN(sizeof(cmd), (size_t)(end - p) + 1));
+    char *args = mutt_str_skip_whitespace((char *) end);
+    mutt_str_remove_trailing_ws(args);
+
+    int r = batch_command(cmd, args);
+    if (r == 1)
+    {
+      err.data[0] = '\0';
+      r = mutt_parse_rc_line(p, &token, &err);
+      if (r == 1)
+        break; /* "finish" */
+      if (r == -2)
+      {
+        mutt_error(_("Warning in %s, line %d: %s"), file, lineno, err.data);
+        r = 0;
+      }
+      else if (r != 0)
+        mutt_error(_("Error in %s, line %d: %s"), file, lineno, err.data);
+    }
+    else if (r != 0)
+      mutt_error(_("Error in %s, line %d: %s"), file, lineno, cmd);
+
+    if (r != 0)
+      rc = 1;
+  }
+
+  if ((batch_close() != 0) && (rc == 0))
+  {
+    mutt_error(_("Error in %s: can't close the mailbox"), file);
+    rc = 1;
+  }
+
+  FREE(&line);
+  FREE(&token.data);
+  FREE(&err.data);
+  if (fp != stdin)
+    mutt_file_fclose(&fp);
+  return rc;
+}
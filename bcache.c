@@ -24,26 +24,73 @@
 #include "config.h"
 #include <dirent.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
 #include "mutt/mutt.h"
 #include "conn/conn.h"
 #include "bcache.h"
 #include "globals.h"
 #include "mutt_account.h"
+#include "options.h"
 #include "protos.h"
 #include "url.h"
 
+#define PACK_FILE "bodies.pack"
+#define PACK_INDEX "bodies.idx"
+#define PACK_MAGIC "neomutt-bcache 2"
+/* Compressed records have a fixed-width length, written after the body */
+#define PACK_ZHEADER "%s %012" PRId64 " z\n"
+
+/**
+ * struct PackEntry - A body stored in the pack
+ */
+struct PackEntry
+{
+  char *id;
+  LOFF_T offset;   /**< Start of the record, i.e. its "id length" line */
+  LOFF_T length;   /**< Length of the body, as stored */
+  LOFF_T size;     /**< Length of the whole record */
+  time_t used;     /**< When the body was last read, for $message_cache_limit */
+  bool compressed; /**< The body is deflated, see $message_cache_compress */
+  size_t slot;     /**< Index into BodyCache.entries */
+};
+
 /**
  * struct BodyCache - Local cache of email bodies
+ *
+ * With $message_cache_pack, the bodies are appended to one file, PACK_FILE,
+ * as records of an "id length" line followed by the body.  A record of
+ * "id -" deletes a body, and "id length z" holds a deflated body.  The
+ * offsets of the live bodies, and when they were last read, are saved in
+ * PACK_INDEX, so the pack is only read from where the index stops.
+ *
+ * New bodies are committed as separate files, as without the pack, and
+ * appended to the pack when the cache is closed.
  */
 struct BodyCache
 {
   char path[_POSIX_PATH_MAX];
   size_t pathlen;
+  bool pack;                  /**< Bodies are kept in PACK_FILE */
+  bool loaded;                /**< The pack has been indexed */
+  bool dirty;                 /**< PACK_INDEX is out of date */
+  struct Hash *index;         /**< Bodies in the pack: id -> PackEntry */
+  struct PackEntry **entries; /**< Bodies in the order they were packed, NULL if deleted */
+  size_t num_entries;
+  size_t max_entries;
+  ino_t ino;       /**< Inode of the pack that was indexed */
+  LOFF_T packsize; /**< Length of the pack that was indexed */
+  LOFF_T dead;     /**< Bytes of the pack taken by deleted bodies */
 };
 
 static int bcache_path(struct Account *account, const char *mailbox, char *dst, size_t dstlen)
@@ -89,6 +136,777 @@ static int bcache_path(struct Account *account, const char *mailbox, char *dst,
   return 0;
 }
 
+/**
+ * pack_path - Get the path of a file in the cache's directory
+ * @param bcache Body Cache
+ * @param name   File name, e.g. PACK_FILE
+ * @param buf    Buffer for the result
+ * @param buflen Length of the buffer
+ * @retval  0 Success
+ * @retval -1 The path is too long
+ */
+static int pack_path(struct BodyCache *bcache, const char *name, char *buf, size_t buflen)
+{
+  int len = snprintf(buf, buflen, "%s%s", bcache->path, name);
+  if ((len < 0) || ((size_t) len >= buflen))
+  {
+    mutt_debug(1, "bcache: path too long: %s%s\n", bcache->path, name);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * pack_is_own_file - Is a file in the cache's directory part of the pack?
+ * @param name File name
+ * @retval true The file isn't a body
+ */
+static bool pack_is_own_file(const char *name)
+{
+  return (mutt_str_strncmp(name, PACK_FILE, sizeof(PACK_FILE) - 1) == 0) ||
+         (mutt_str_strncmp(name, PACK_INDEX, sizeof(PACK_INDEX) - 1) == 0);
+}
+
+/**
+ * pack_remove - Forget a body of the pack
+ * @param bcache Body Cache
+ * @param e      Entry of the body
+ */
+static void pack_remove(struct BodyCache *bcache, struct PackEntry *e)
+{
+  bcache->dead += e->size;
+  bcache->entries[e->slot] = NULL;
+  mutt_hash_delete(bcache->index, e->id, e);
+  mutt_mem_account(MEM_BCACHE, -(long long) (strlen(e->id) + 1));
+  FREE(&e->id);
+  mutt_mem_tag_free(MEM_BCACHE, &e, sizeof(struct PackEntry));
+  bcache->dirty = true;
+}
+
+/**
+ * pack_add - Remember a body of the pack
+ * @param bcache Body Cache
+ * @param id     Id of the body
+ * @param offset Start of its record
+ * @param length Length of the body, as stored
+ * @param size   Length of the record
+ * @param used   When the body was last read
+ * @param z      The body is compressed
+ * @retval ptr Entry of the body
+ *
+ * A body that was packed before is replaced.
+ */
+static struct PackEntry *pack_add(struct BodyCache *bcache, const char *id, LOFF_T offset,
+                                  LOFF_T length, LOFF_T size, time_t used, bool z)
+{
+  struct PackEntry *old = mutt_hash_find(bcache->index, id);
+  if (old)
+    pack_remove(bcache, old);
+
+  if (bcache->num_entries == bcache->max_entries)
+  {
+    size_t max = bcache->max_entries ? 2 * bcache->max_entries : 256;
+    mutt_mem_tag_realloc(MEM_BCACHE, &bcache->entries,
+                         bcache->max_entries * sizeof(struct PackEntry *),
+                         max * sizeof(struct PackEntry *));
+    bcache->max_entries = max;
+  }
+
+  struct PackEntry *e = mutt_mem_tag_calloc(MEM_BCACHE, 1, sizeof(struct PackEntry));
+  e->id = mutt_str_strdup(id);
+  mutt_mem_account(MEM_BCACHE, strlen(id) + 1);
+  e->offset = offset;
+  e->length = length;
+  e->size = size;
+  e->used = used;
+  e->compressed = z;
+  e->slot = bcache->num_entries;
+  bcache->entries[bcache->num_entries++] = e;
+  mutt_hash_insert(bcache->index, e->id, e);
+  bcache->dirty = true;
+  return e;
+}
+
+/**
+ * pack_reset - Forget every body of the pack
+ * @param bcache Body Cache
+ */
+static void pack_reset(struct BodyCache *bcache)
+{
+  for (size_t i = 0; i < bcache->num_entries; i++)
+  {
+    if (!bcache->entries[i])
+      continue;
+    mutt_mem_account(MEM_BCACHE, -(long long) (strlen(bcache->entries[i]->id) + 1));
+    FREE(&bcache->entries[i]->id);
+    mutt_mem_tag_free(MEM_BCACHE, &bcache->entries[i], sizeof(struct PackEntry));
+  }
+  mutt_mem_tag_free(MEM_BCACHE, &bcache->entries, bcache->max_entries * sizeof(struct PackEntry *));
+  bcache->num_entries = 0;
+  bcache->max_entries = 0;
+  mutt_hash_destroy(&bcache->index);
+  bcache->index = mutt_hash_create(1031, 0);
+  bcache->packsize = 0;
+  bcache->dead = 0;
+  bcache->dirty = true;
+}
+
+/**
+ * pack_scan - Index the records of the pack
+ * @param bcache Body Cache
+ * @param fp     Pack, positioned at the first record to read
+ *
+ * Reading stops at the end of the pack or at a record that was cut short,
+ * e.g. by a crash.
+ */
+static void pack_scan(struct BodyCache *bcache, FILE *fp)
+{
+  char line[_POSIX_PATH_MAX + 32];
+  LOFF_T offset = ftello(fp);
+
+  while ((offset >= 0) && fgets(line, sizeof(line), fp))
+  {
+    const LOFF_T hdrlen = strlen(line);
+    if ((hdrlen < 2) || (line[hdrlen - 1] != '\n'))
+      break;
+    line[hdrlen - 1] = '\0';
+
+    bool z = false;
+    char *sp = strrchr(line, ' ');
+    if (sp && (strcmp(sp, " z") == 0))
+    {
+      z = true;
+      *sp = '\0';
+      sp = strrchr(line, ' ');
+    }
+    if (!sp || (sp == line))
+      break;
+    *sp++ = '\0';
+
+    if (strcmp(sp, "-") == 0)
+    {
+      struct PackEntry *e = mutt_hash_find(bcache->index, line);
+      if (e)
+        pack_remove(bcache, e);
+      bcache->dead += hdrlen;
+      offset += hdrlen;
+      continue;
+    }
+
+    char *end = NULL;
+    const LOFF_T length = strtoll(sp, &end, 10);
+    if ((length < 0) || (*end != '\0') || (fseeko(fp, length, SEEK_CUR) != 0))
+      break;
+
+    pack_add(bcache, line, offset, length, hdrlen + length, 0, z);
+    offset += hdrlen + length;
+  }
+
+  /* a record that was cut short is dropped; the next append follows it */
+  if (offset > bcache->packsize)
+    bcache->packsize = offset;
+}
+
+/**
+ * pack_sync - Catch up with the changes to the pack
+ * @param bcache Body Cache
+ * @param fp     Pack
+ *
+ * Other instances of NeoMutt may have appended records, or compacted the
+ * pack into a new file since it was indexed.
+ */
+static void pack_sync(struct BodyCache *bcache, FILE *fp)
+{
+  struct stat st;
+
+  if (fstat(fileno(fp), &st) < 0)
+    return;
+
+  if ((st.st_ino != bcache->ino) || (st.st_size < bcache->packsize))
+  {
+    pack_reset(bcache);
+    bcache->ino = st.st_ino;
+  }
+
+  if (st.st_size > bcache->packsize)
+  {
+    if (fseeko(fp, bcache->packsize, SEEK_SET) == 0)
+      pack_scan(bcache, fp);
+  }
+}
+
+/**
+ * pack_load - Index the pack, if it hasn't been yet
+ * @param bcache Body Cache
+ */
+static void pack_load(struct BodyCache *bcache)
+{
+  char path[_POSIX_PATH_MAX];
+  char *line = NULL;
+  size_t linelen = 0;
+  FILE *fp = NULL;
+
+  if (bcache->loaded)
+    return;
+  bcache->loaded = true;
+  bcache->index = mutt_hash_create(1031, 0);
+
+  if (pack_path(bcache, PACK_INDEX, path, sizeof(path)) != 0)
+    return;
+  fp = fopen(path, "r");
+  if (fp)
+  {
+    unsigned long long ino = 0;
+    long long packsize = 0, dead = 0;
+
+    line = mutt_file_read_line(line, &linelen, fp, NULL, 0);
+    if (line && (mutt_str_strncmp(line, PACK_MAGIC " ", sizeof(PACK_MAGIC)) == 0) &&
+        (sscanf(line + sizeof(PACK_MAGIC), "%llu %lld %lld", &ino, &packsize, &dead) == 3))
+    {
+      while ((line = mutt_file_read_line(line, &linelen, fp, NULL, 0)))
+      {
+        long long offset, length, size, used;
+        int z = 0, n = 0;
+        if (sscanf(line, "%lld %lld %lld %lld %d %n", &offset, &length, &size,
+                   &used, &z, &n) < 5)
+        {
+          break;
+        }
+        pack_add(bcache, line + n, offset, length, size, used, z);
+      }
+      bcache->ino = ino;
+      bcache->packsize = packsize;
+      bcache->dead = dead;
+    }
+    FREE(&line);
+    mutt_file_fclose(&fp);
+  }
+  bcache->dirty = false;
+
+  if (pack_path(bcache, PACK_FILE, path, sizeof(path)) != 0)
+    return;
+  fp = fopen(path, "r");
+  if (fp)
+  {
+    pack_sync(bcache, fp);
+    mutt_file_fclose(&fp);
+  }
+  else if (bcache->num_entries != 0)
+    pack_reset(bcache);
+}
+
+/**
+ * pack_save - Write the index of the pack
+ * @param bcache Body Cache
+ */
+static void pack_save(struct BodyCache *bcache)
+{
+  char path[_POSIX_PATH_MAX];
+  char tmp[_POSIX_PATH_MAX];
+  FILE *fp = NULL;
+
+  if (!bcache->loaded || !bcache->dirty)
+    return;
+
+  if ((pack_path(bcache, PACK_INDEX, path, sizeof(path)) != 0) ||
+      (pack_path(bcache, PACK_INDEX ".tmp", tmp, sizeof(tmp)) != 0))
+  {
+    return;
+  }
+  fp = mutt_file_fopen(tmp, "w");
+  if (!fp)
+    return;
+
+  fprintf(fp, PACK_MAGIC " %llu " OFF_T_FMT " " OFF_T_FMT "\n",
+          (unsigned long long) bcache->ino, bcache->packsize, bcache->dead);
+  for (size_t i = 0; i < bcache->num_entries; i++)
+  {
+    struct PackEntry *e = bcache->entries[i];
+    if (e)
+      fprintf(fp, OFF_T_FMT " " OFF_T_FMT " " OFF_T_FMT " %lld %d %s\n", e->offset,
+              e->length, e->size, (long long) e->used, e->compressed, e->id);
+  }
+
+  if ((mutt_file_fclose(&fp) == 0) && (rename(tmp, path) == 0))
+    bcache->dirty = false;
+  else
+    unlink(tmp);
+}
+
+/**
+ * pack_open - Open the pack for writing, and lock it
+ * @param bcache Body Cache
+ * @retval ptr  Pack, positioned at its end
+ * @retval NULL Error
+ */
+static FILE *pack_open(struct BodyCache *bcache)
+{
+  char path[_POSIX_PATH_MAX];
+
+  struct stat st_fd, st_path;
+  FILE *fp = NULL;
+
+  pack_load(bcache);
+  if (pack_path(bcache, PACK_FILE, path, sizeof(path)) != 0)
+    return NULL;
+  while (true)
+  {
+    fp = fopen(path, "r+");
+    if (!fp)
+      fp = mutt_file_fopen(path, "w+");
+    if (!fp)
+      return NULL;
+
+    if (mutt_file_lock(fileno(fp), 1, 1) < 0)
+    {
+      mutt_file_fclose(&fp);
+      return NULL;
+    }
+
+    /* the pack may have been compacted while we waited for the lock */
+    if ((fstat(fileno(fp), &st_fd) == 0) && (stat(path, &st_path) == 0) &&
+        (st_fd.st_ino != st_path.st_ino))
+    {
+      mutt_file_unlock(fileno(fp));
+      mutt_file_fclose(&fp);
+      continue;
+    }
+    break;
+  }
+
+  pack_sync(bcache, fp);
+  if (fseeko(fp, bcache->packsize, SEEK_SET) != 0)
+  {
+    mutt_file_unlock(fileno(fp));
+    mutt_file_fclose(&fp);
+    return NULL;
+  }
+  return fp;
+}
+
+/**
+ * pack_close - Unlock and close the pack
+ * @param bcache Body Cache
+ * @param fp     Pack from pack_open()
+ */
+static void pack_close(struct BodyCache *bcache, FILE **fp)
+{
+  fflush(*fp);
+  bcache->packsize = ftello(*fp);
+  mutt_file_unlock(fileno(*fp));
+  mutt_file_fclose(fp);
+}
+
+#ifdef USE_ZLIB
+/**
+ * pack_deflate - Compress a body into the pack
+ * @param[in]  in  Body
+ * @param[in]  out Pack
+ * @param[out] len Length of the compressed body
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+static int pack_deflate(FILE *in, FILE *out, LOFF_T *len)
+{
+  unsigned char ibuf[8192], obuf[8192];
+  z_stream zs;
+  int flush, rc = 0;
+
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit(&zs, Z_DEFAULT_COMPRESSION) != Z_OK)
+    return -1;
+
+  *len = 0;
+  do
+  {
+    zs.avail_in = fread(ibuf, 1, sizeof(ibuf), in);
+    zs.next_in = ibuf;
+    if (ferror(in))
+    {
+      rc = -1;
+      break;
+    }
+    flush = feof(in) ? Z_FINISH : Z_NO_FLUSH;
+
+    do
+    {
+      zs.avail_out = sizeof(obuf);
+      zs.next_out = obuf;
+      deflate(&zs, flush);
+      const size_t have = sizeof(obuf) - zs.avail_out;
+      if (fwrite(obuf, 1, have, out) != have)
+      {
+        rc = -1;
+        break;
+      }
+      *len += have;
+    } while (zs.avail_out == 0);
+  } while ((rc == 0) && (flush != Z_FINISH));
+
+  deflateEnd(&zs);
+  return rc;
+}
+
+/**
+ * pack_inflate - Decompress a body out of the pack
+ * @param in  Pack, positioned at the body
+ * @param out File for the body
+ * @param len Length of the compressed body
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+static int pack_inflate(FILE *in, FILE *out, LOFF_T len)
+{
+  unsigned char ibuf[8192], obuf[8192];
+  z_stream zs;
+  int rc = Z_OK;
+
+  memset(&zs, 0, sizeof(zs));
+  if (inflateInit(&zs) != Z_OK)
+    return -1;
+
+  while ((rc == Z_OK) && (len > 0))
+  {
+    zs.avail_in = fread(ibuf, 1, (len > sizeof(ibuf)) ? sizeof(ibuf) : len, in);
+    zs.next_in = ibuf;
+    if (zs.avail_in == 0)
+      break;
+    len -= zs.avail_in;
+
+    do
+    {
+      zs.avail_out = sizeof(obuf);
+      zs.next_out = obuf;
+      rc = inflate(&zs, Z_NO_FLUSH);
+      if ((rc != Z_OK) && (rc != Z_STREAM_END))
+        break;
+      const size_t have = sizeof(obuf) - zs.avail_out;
+      if (fwrite(obuf, 1, have, out) != have)
+      {
+        rc = Z_ERRNO;
+        break;
+      }
+    } while ((zs.avail_out == 0) && (rc == Z_OK));
+  }
+
+  inflateEnd(&zs);
+  return (rc == Z_STREAM_END) ? 0 : -1;
+}
+#endif
+
+/**
+ * pack_append - Append a body to the pack
+ * @param bcache Body Cache
+ * @param pack   Pack from pack_open()
+ * @param id     Id of the body
+ * @param fp     Body
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * With $message_cache_compress, the body is deflated on the way in.
+ */
+static int pack_append(struct BodyCache *bcache, FILE *pack, const char *id, FILE *fp)
+{
+  struct stat st;
+  LOFF_T length = 0;
+  int hdrlen = -1;
+  bool z = false;
+
+  if (fstat(fileno(fp), &st) < 0)
+    return -1;
+
+  const LOFF_T offset = bcache->packsize;
+#ifdef USE_ZLIB
+  if (MessageCacheCompress)
+  {
+    z = true;
+    hdrlen = fprintf(pack, PACK_ZHEADER, id, (LOFF_T) 0);
+    if ((hdrlen < 0) || (pack_deflate(fp, pack, &length) < 0) ||
+        (fseeko(pack, offset, SEEK_SET) != 0) ||
+        (fprintf(pack, PACK_ZHEADER, id, length) != hdrlen) ||
+        (fseeko(pack, offset + hdrlen + length, SEEK_SET) != 0))
+    {
+      hdrlen = -1;
+    }
+  }
+  else
+#endif
+  {
+    length = st.st_size;
+    hdrlen = fprintf(pack, "%s " OFF_T_FMT "\n", id, length);
+    if ((hdrlen >= 0) && (mutt_file_copy_bytes(fp, pack, length) < 0))
+      hdrlen = -1;
+  }
+
+  if ((hdrlen < 0) || (fflush(pack) != 0) || (ftello(pack) != offset + hdrlen + length))
+  {
+    /* drop the partial record, so the pack can still be read through */
+    fflush(pack);
+    if ((ftruncate(fileno(pack), offset) == 0) && (fseeko(pack, offset, SEEK_SET) == 0))
+      bcache->packsize = offset;
+    else
+      bcache->packsize = ftello(pack);
+    return -1;
+  }
+
+  bcache->packsize = offset + hdrlen + length;
+  pack_add(bcache, id, offset, length, hdrlen + length, time(NULL), z);
+  return 0;
+}
+
+/**
+ * pack_delete - Delete a body from the pack
+ * @param bcache Body Cache
+ * @param pack   Pack from pack_open()
+ * @param e      Entry of the body
+ */
+static void pack_delete(struct BodyCache *bcache, FILE *pack, struct PackEntry *e)
+{
+  const int hdrlen = fprintf(pack, "%s -\n", e->id);
+  if (hdrlen > 0)
+  {
+    bcache->packsize += hdrlen;
+    bcache->dead += hdrlen;
+  }
+  pack_remove(bcache, e);
+}
+
+/**
+ * pack_get - Copy a body out of the pack
+ * @param bcache Body Cache
+ * @param id     Id of the body
+ * @retval ptr  Temporary file holding the body
+ * @retval NULL The body isn't in the pack
+ */
+static FILE *pack_get(struct BodyCache *bcache, const char *id)
+{
+  char path[_POSIX_PATH_MAX];
+  char line[_POSIX_PATH_MAX + 32];
+  char expect[_POSIX_PATH_MAX + 32];
+  FILE *pack = NULL, *fp = NULL;
+
+  pack_load(bcache);
+  struct PackEntry *e = mutt_hash_find(bcache->index, id);
+  if (!e)
+    return NULL;
+
+  if (pack_path(bcache, PACK_FILE, path, sizeof(path)) != 0)
+    return NULL;
+  pack = fopen(path, "r");
+  if (!pack)
+    return NULL;
+
+  /* check the record is still there, in case the pack was compacted */
+  if (e->compressed)
+    snprintf(expect, sizeof(expect), PACK_ZHEADER, id, e->length);
+  else
+    snprintf(expect, sizeof(expect), "%s " OFF_T_FMT "\n", id, e->length);
+  if ((fseeko(pack, e->offset, SEEK_SET) != 0) || !fgets(line, sizeof(line), pack) ||
+      (strcmp(line, expect) != 0))
+  {
+    mutt_debug(1, "bcache: pack: stale entry for '%s'\n", id);
+    goto out;
+  }
+
+  mutt_mktemp(path, sizeof(path));
+  fp = mutt_file_fopen(path, "w+");
+  if (!fp)
+    goto out;
+  unlink(path);
+
+  int rc;
+  if (e->compressed)
+  {
+#ifdef USE_ZLIB
+    rc = pack_inflate(pack, fp, e->length);
+    if ((rc == 0) && (fflush(fp) != 0))
+      rc = -1;
+#else
+    mutt_debug(1, "bcache: pack: can't read compressed '%s'\n", id);
+    rc = -1;
+#endif
+  }
+  else
+  {
+    rc = mutt_file_copy_bytes(pack, fp, e->length);
+    if ((rc == 0) && (ftello(fp) != e->length))
+      rc = -1;
+  }
+
+  if (rc < 0)
+    mutt_file_fclose(&fp);
+  else
+  {
+    rewind(fp);
+    e->used = time(NULL);
+    bcache->dirty = true;
+  }
+
+out:
+  mutt_file_fclose(&pack);
+  return fp;
+}
+
+/**
+ * pack_compact - Rewrite the pack without its deleted bodies
+ * @param bcache Body Cache
+ */
+static void pack_compact(struct BodyCache *bcache)
+{
+  char path[_POSIX_PATH_MAX];
+  char tmp[_POSIX_PATH_MAX];
+  char line[_POSIX_PATH_MAX + 32];
+  struct stat st;
+
+  FILE *pack = pack_open(bcache);
+  if (!pack)
+    return;
+
+  FILE *fp = NULL;
+  if ((pack_path(bcache, PACK_FILE, path, sizeof(path)) == 0) &&
+      (pack_path(bcache, PACK_FILE ".tmp", tmp, sizeof(tmp)) == 0))
+  {
+    fp = mutt_file_fopen(tmp, "w");
+  }
+  if (!fp)
+  {
+    pack_close(bcache, &pack);
+    return;
+  }
+
+  mutt_debug(2, "bcache: pack: compacting '%s', " OFF_T_FMT " of " OFF_T_FMT " bytes unused\n",
+             path, bcache->dead, bcache->packsize);
+
+  bool ok = true;
+  LOFF_T offset = 0;
+  for (size_t i = 0; ok && (i < bcache->num_entries); i++)
+  {
+    struct PackEntry *e = bcache->entries[i];
+    if (!e)
+      continue;
+    ok = (fseeko(pack, e->offset, SEEK_SET) == 0) && fgets(line, sizeof(line), pack) &&
+         (fputs(line, fp) != EOF) && (mutt_file_copy_bytes(pack, fp, e->length) == 0);
+    e->offset = offset;
+    offset += e->size;
+  }
+
+  if (mutt_file_fclose(&fp) != 0)
+    ok = false;
+  if (ok && (ftello(pack) >= 0) && (stat(tmp, &st) == 0) && (st.st_size == offset) &&
+      (rename(tmp, path) == 0))
+  {
+    /* the old pack is unlinked, so unlocking it is all that's left */
+    mutt_file_unlock(fileno(pack));
+    mutt_file_fclose(&pack);
+    bcache->ino = st.st_ino;
+    bcache->packsize = offset;
+    bcache->dead = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < bcache->num_entries; i++)
+    {
+      if (!bcache->entries[i])
+        continue;
+      bcache->entries[i]->slot = n;
+      bcache->entries[n++] = bcache->entries[i];
+    }
+    bcache->num_entries = n;
+    bcache->dirty = true;
+    return;
+  }
+
+  /* the offsets were overwritten, so index the pack again */
+  unlink(tmp);
+  pack_reset(bcache);
+  pack_sync(bcache, pack);
+  pack_close(bcache, &pack);
+}
+
+/**
+ * pack_lru_cmp - Compare two bodies by when they were last read
+ * @param a First PackEntry
+ * @param b Second PackEntry
+ * @retval <0 a was read before b, or packed before it
+ * @retval >0 b was read before a
+ */
+static int pack_lru_cmp(const void *a, const void *b)
+{
+  const struct PackEntry *ea = *(struct PackEntry *const *) a;
+  const struct PackEntry *eb = *(struct PackEntry *const *) b;
+
+  if (ea->used != eb->used)
+    return (ea->used < eb->used) ? -1 : 1;
+  return (ea->slot < eb->slot) ? -1 : (ea->slot > eb->slot);
+}
+
+/**
+ * pack_flush - Move the committed bodies into the pack
+ * @param bcache Body Cache
+ *
+ * If the pack was used, the bodies that haven't been read for longest are
+ * then deleted to keep it within $message_cache_limit, and it's compacted
+ * when more than half of it is unused.
+ */
+static void pack_flush(struct BodyCache *bcache)
+{
+  char path[_POSIX_PATH_MAX];
+  struct dirent *de = NULL;
+  DIR *d = opendir(bcache->path);
+  if (!d)
+    return;
+
+  FILE *pack = NULL;
+  while ((de = readdir(d)))
+  {
+    const size_t len = strlen(de->d_name);
+    if ((de->d_name[0] == '.') || pack_is_own_file(de->d_name) ||
+        ((len > 4) && (strcmp(de->d_name + len - 4, ".tmp") == 0)))
+    {
+      continue;
+    }
+
+    if (!pack && !(pack = pack_open(bcache)))
+      break;
+
+    if (pack_path(bcache, de->d_name, path, sizeof(path)) != 0)
+      continue;
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+      continue;
+    if (pack_append(bcache, pack, de->d_name, fp) == 0)
+      unlink(path);
+    mutt_file_fclose(&fp);
+  }
+  closedir(d);
+
+  if (!bcache->loaded)
+    return;
+
+  const LOFF_T limit = (LOFF_T) MessageCacheLimit * 1024 * 1024;
+  if ((MessageCacheLimit > 0) && (bcache->packsize - bcache->dead > limit))
+  {
+    if (pack || (pack = pack_open(bcache)))
+    {
+      size_t num = 0;
+      struct PackEntry **lru = mutt_mem_calloc(bcache->num_entries + 1, sizeof(struct PackEntry *));
+      for (size_t i = 0; i < bcache->num_entries; i++)
+        if (bcache->entries[i])
+          lru[num++] = bcache->entries[i];
+      qsort(lru, num, sizeof(struct PackEntry *), pack_lru_cmp);
+
+      for (size_t i = 0; (i < num) && (bcache->packsize - bcache->dead > limit); i++)
+        pack_delete(bcache, pack, lru[i]);
+      FREE(&lru);
+    }
+  }
+
+  if (pack)
+    pack_close(bcache, &pack);
+
+  if ((bcache->dead > 0) && (2 * bcache->dead > bcache->packsize))
+    pack_compact(bcache);
+}
+
 static int mutt_bcache_move(struct BodyCache *bcache, const char *id, const char *newid)
 {
   char path[_POSIX_PATH_MAX];
@@ -116,6 +934,7 @@ struct BodyCache *mutt_bcache_open(struct Account *account, const char *mailbox)
   if (bcache_path(account, mailbox, bcache->path, sizeof(bcache->path)) < 0)
     goto bail;
   bcache->pathlen = mutt_str_strlen(bcache->path);
+  bcache->pack = MessageCachePack;
 
   return bcache;
 
@@ -129,6 +948,17 @@ void mutt_bcache_close(struct BodyCache **bcache)
 {
   if (!bcache || !*bcache)
     return;
+
+  if ((*bcache)->pack)
+  {
+    pack_flush(*bcache);
+    if ((*bcache)->loaded)
+    {
+      pack_save(*bcache);
+      pack_reset(*bcache);
+      mutt_hash_destroy(&(*bcache)->index);
+    }
+  }
   FREE(bcache);
 }
 
@@ -145,6 +975,8 @@ FILE *mutt_bcache_get(struct BodyCache *bcache, const char *id)
   mutt_str_strncat(path, sizeof(path), id, mutt_str_strlen(id));
 
   fp = mutt_file_fopen(path, "r");
+  if (!fp && bcache->pack)
+    fp = pack_get(bcache, id);
 
   mutt_debug(3, "bcache: get: '%s': %s\n", path, fp == NULL ? "no" : "yes");
 
@@ -209,7 +1041,25 @@ int mutt_bcache_del(struct BodyCache *bcache, const char *id)
 
   mutt_debug(3, "bcache: del: '%s'\n", path);
 
-  return unlink(path);
+  int rc = unlink(path);
+  if (bcache->pack)
+  {
+    pack_load(bcache);
+    struct PackEntry *e = mutt_hash_find(bcache->index, id);
+    FILE *pack = NULL;
+    if (e && (pack = pack_open(bcache)))
+    {
+      /* the pack was synced, so look again */
+      e = mutt_hash_find(bcache->index, id);
+      if (e)
+      {
+        pack_delete(bcache, pack, e);
+        rc = 0;
+      }
+      pack_close(bcache, &pack);
+    }
+  }
+  return rc;
 }
 
 int mutt_bcache_exists(struct BodyCache *bcache, const char *id)
@@ -230,6 +1080,13 @@ int mutt_bcache_exists(struct BodyCache *bcache, const char *id)
   else
     rc = S_ISREG(st.st_mode) && st.st_size != 0 ? 0 : -1;
 
+  if ((rc < 0) && bcache->pack)
+  {
+    pack_load(bcache);
+    struct PackEntry *e = mutt_hash_find(bcache->index, id);
+    rc = (e && (e->length != 0)) ? 0 : -1;
+  }
+
   mutt_debug(3, "bcache: exists: '%s': %s\n", path, rc == 0 ? "yes" : "no");
 
   return rc;
@@ -243,10 +1100,47 @@ int mutt_bcache_list(struct BodyCache *bcache,
   struct dirent *de = NULL;
   int rc = -1;
 
-  if (!bcache || !(d = opendir(bcache->path)))
+  if (!bcache)
     goto out;
 
-  rc = 0;
+  if (bcache->pack)
+  {
+    /* the callback may delete bodies, so work from a copy of the ids */
+    pack_load(bcache);
+    size_t num = 0;
+    char **ids = mutt_mem_calloc(bcache->num_entries + 1, sizeof(char *));
+    for (size_t i = 0; i < bcache->num_entries; i++)
+      if (bcache->entries[i])
+        ids[num++] = mutt_str_strdup(bcache->entries[i]->id);
+
+    rc = 0;
+    bool stop = false;
+    for (size_t i = 0; i < num; i++)
+    {
+      if (!stop)
+      {
+        mutt_debug(3, "bcache: list: pack: '%s', id :'%s'\n", bcache->path, ids[i]);
+        if (want_id && want_id(ids[i], bcache, data) != 0)
+          stop = true;
+        else
+          rc++;
+      }
+      FREE(&ids[i]);
+    }
+    FREE(&ids);
+    if (stop)
+      goto out;
+  }
+
+  if (!(d = opendir(bcache->path)))
+  {
+    if (!bcache->pack)
+      rc = -1;
+    goto out;
+  }
+
+  if (!bcache->pack)
+    rc = 0;
 
   mutt_debug(3, "bcache: list: dir: '%s'\n", bcache->path);
 
@@ -258,6 +1152,12 @@ int mutt_bcache_list(struct BodyCache *bcache,
       continue;
     }
 
+    if (bcache->pack && (pack_is_own_file(de->d_name) ||
+                         mutt_hash_find(bcache->index, de->d_name)))
+    {
+      continue;
+    }
+
     mutt_debug(3, "bcache: list: dir: '%s', id :'%s'\n", bcache->path, de->d_name);
 
     if (want_id && want_id(de->d_name, bcache, data) != 0)
@@ -31,7 +31,7 @@
 
 struct Body *mutt_new_body(void)
 {
-  struct Body *p = mutt_mem_calloc(1, sizeof(struct Body));
+  struct Body *p = mutt_mem_tag_calloc(MEM_BODY, 1, sizeof(struct Body));
 
   p->disposition = DISPATTACH;
   p->use_disp = true;
@@ -74,6 +74,7 @@ int mutt_copy_body(FILE *fp, struct Body **tgt, struct Body *src)
   TAILQ_INIT(&b->parameter);
   b->parts = NULL;
   b->next = NULL;
+  b->verified = NULL;
 
   b->filename = mutt_str_strdup(tmp);
   b->use_disp = use_disp;
@@ -140,6 +141,9 @@ void mutt_free_body(struct Body **p)
     FREE(&b->subtype);
     FREE(&b->description);
     FREE(&b->form_name);
+    if (b->verified)
+      FREE(&b->verified->output);
+    FREE(&b->verified);
 
     if (b->hdr)
     {
@@ -151,7 +155,7 @@ void mutt_free_body(struct Body **p)
     if (b->parts)
       mutt_free_body(&b->parts);
 
-    FREE(&b);
+    mutt_mem_tag_free(MEM_BODY, &b, sizeof(struct Body));
   }
 
   *p = 0;
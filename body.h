@@ -25,10 +25,30 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <sys/types.h>
 #include <time.h>
 
 #include "mutt/parameter.h"
 
+/**
+ * struct SigVerified - A remembered verification of a signature
+ *
+ * It's kept with the signature's Body, so it's only used again for the same
+ * part of the same message.
+ */
+struct SigVerified
+{
+  dev_t dev;          /**< Device of the message's file */
+  ino_t ino;          /**< Inode of the message's file */
+  off_t size;         /**< Size of the message's file */
+  time_t mtime;       /**< Modification time of the message's file */
+  time_t when;        /**< When it was verified */
+  unsigned int stamp; /**< Keyring stamp when it was verified */
+  int rc;             /**< Result of the verification */
+  char *output;       /**< What the verification displayed */
+  size_t outlen;      /**< Length of output */
+};
+
 /**
  * struct Body - The body of an email
  */
@@ -66,6 +86,8 @@ struct Body
 
   time_t stamp;                 /**< time stamp of last encoding update.  */
 
+  struct SigVerified *verified; /**< remembered verification of this signature */
+
   unsigned int type : 4;        /**< content-type primary type */
   unsigned int encoding : 3;    /**< content-transfer-encoding */
   unsigned int disposition : 2; /**< content-disposition */
@@ -23,6 +23,7 @@
 #include "config.h"
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <grp.h>
 #include <limits.h>
 #include <locale.h>
@@ -35,6 +36,9 @@
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#endif
 #include "mutt/mutt.h"
 #include "conn/conn.h"
 #include "mutt.h"
@@ -698,6 +702,93 @@ static void add_folder(struct Menu *m, struct BrowserState *state, const char *n
   (state->entrylen)++;
 }
 
+/**
+ * struct BrowserStat - A directory entry to be stat'd
+ */
+struct BrowserStat
+{
+  char *name;     /**< Name of the entry */
+  struct stat st; /**< Its lstat(2) information */
+  bool ok;        /**< true if the lstat(2) succeeded */
+};
+
+#ifdef HAVE_PTHREAD_CREATE
+/**
+ * struct BrowserStatPool - Threads stat'ing the entries of a directory
+ */
+struct BrowserStatPool
+{
+  pthread_mutex_t lock;
+  struct BrowserStat *entries; /**< Directory entries */
+  size_t count;                /**< Number of entries */
+  size_t next;                 /**< Next entry for a thread */
+  int dirfd;                   /**< The directory */
+};
+
+/**
+ * browser_stat_thread - Stat directory entries until there are none left
+ * @param arg Pool of threads
+ * @retval NULL Always
+ */
+static void *browser_stat_thread(void *arg)
+{
+  struct BrowserStatPool *pool = arg;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->next < pool->count)
+  {
+    struct BrowserStat *e = &pool->entries[pool->next++];
+    pthread_mutex_unlock(&pool->lock);
+
+    e->ok = (fstatat(pool->dirfd, e->name, &e->st, AT_SYMLINK_NOFOLLOW) == 0);
+
+    pthread_mutex_lock(&pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+#endif
+
+/**
+ * browser_stat_entries - Stat the entries of a directory
+ * @param dirfd   The directory
+ * @param entries Directory entries
+ * @param count   Number of entries
+ *
+ * With $browser_stat_threads, threads from the shared pool share the work,
+ * which hides the latency of slow file systems, e.g. NFS.
+ */
+static void browser_stat_entries(int dirfd, struct BrowserStat *entries, size_t count)
+{
+#ifdef HAVE_PTHREAD_CREATE
+  if ((BrowserStatThreads > 1) && (count > 1))
+  {
+    struct BrowserStatPool pool;
+    struct WorkerGroup group;
+
+    memset(&pool, 0, sizeof(pool));
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.entries = entries;
+    pool.count = count;
+    pool.dirfd = dirfd;
+
+    /* This thread is one of the pool */
+    int nthreads = mutt_worker_group_start(&group, BrowserStatThreads - 1,
+                                           browser_stat_thread, &pool);
+    mutt_debug(2, "stat'ing %zu entries with %d threads\n", count, nthreads + 1);
+    browser_stat_thread(&pool);
+    if (nthreads)
+      mutt_worker_group_wait(&group);
+    pthread_mutex_destroy(&pool.lock);
+    return;
+  }
+#endif
+
+  for (size_t i = 0; i < count; i++)
+    entries[i].ok = (fstatat(dirfd, entries[i].name, &entries[i].st, AT_SYMLINK_NOFOLLOW) == 0);
+}
+
 static void init_state(struct BrowserState *state, struct Menu *menu)
 {
   state->entrylen = 0;
@@ -743,6 +834,8 @@ static int examine_directory(struct Menu *menu, struct BrowserState *state,
     struct dirent *de = NULL;
     char buffer[_POSIX_PATH_MAX + SHORT_STRING];
     struct Buffy *tmp = NULL;
+    struct BrowserStat *entries = NULL;
+    size_t count = 0, max = 0;
 
     while (stat(d, &s) == -1)
     {
@@ -778,6 +871,7 @@ static int examine_directory(struct Menu *menu, struct BrowserState *state,
 
     init_state(state, menu);
 
+    /* Read the whole directory first, then stat the entries together */
     while ((de = readdir(dp)) != NULL)
     {
       if (mutt_str_strcmp(de->d_name, ".") == 0)
@@ -791,27 +885,59 @@ static int examine_directory(struct Menu *menu, struct BrowserState *state,
       if (Mask && Mask->regex && !((regexec(Mask->regex, de->d_name, 0, NULL, 0) == 0) ^ Mask->not))
         continue;
 
-      mutt_file_concat_path(buffer, d, de->d_name, sizeof(buffer));
-      if (lstat(buffer, &s) == -1)
-        continue;
+      if (count == max)
+      {
+        max += 256;
+        mutt_mem_realloc(&entries, max * sizeof(struct BrowserStat));
+      }
+      entries[count].name = mutt_str_strdup(de->d_name);
+      entries[count].ok = false;
+      count++;
+    }
+
+    browser_stat_entries(dirfd(dp), entries, count);
+    closedir(dp);
+
+    /* Find the mailboxes by name, not by walking the list for every entry */
+    struct Hash *boxes = NULL;
+    if (Incoming)
+    {
+      boxes = mutt_hash_create(1024, 0);
+      for (tmp = Incoming; tmp; tmp = tmp->next)
+        mutt_hash_insert(boxes, tmp->path, tmp);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+      struct BrowserStat *e = &entries[i];
+      if (!e->ok)
+        goto next;
 
       /* No size for directories or symlinks */
-      if (S_ISDIR(s.st_mode) || S_ISLNK(s.st_mode))
-        s.st_size = 0;
-      else if (!S_ISREG(s.st_mode))
-        continue;
+      if (S_ISDIR(e->st.st_mode) || S_ISLNK(e->st.st_mode))
+        e->st.st_size = 0;
+      else if (!S_ISREG(e->st.st_mode))
+        goto next;
 
-      tmp = Incoming;
-      while (tmp && (mutt_str_strcmp(buffer, tmp->path) != 0))
-        tmp = tmp->next;
+      tmp = NULL;
+      if (boxes)
+      {
+        mutt_file_concat_path(buffer, d, e->name, sizeof(buffer));
+        tmp = mutt_hash_find(boxes, buffer);
+      }
       if (tmp && Context && (mutt_str_strcmp(tmp->realpath, Context->realpath) == 0))
       {
         tmp->msg_count = Context->msgcount;
         tmp->msg_unread = Context->unread;
       }
-      add_folder(menu, state, de->d_name, NULL, &s, tmp, NULL);
+      add_folder(menu, state, e->name, NULL, &e->st, tmp, NULL);
+
+    next:
+      FREE(&e->name);
     }
-    closedir(dp);
+
+    mutt_hash_destroy(&boxes);
+    FREE(&entries);
   }
   browser_sort(state);
   return 0;
@@ -1821,9 +1947,10 @@ void mutt_select_file(char *f, size_t flen, int flags, char ***files, int *numfi
             }
             else
             {
-              Mask = mutt_mem_calloc(1, sizeof(struct Regex *));
+              Mask = mutt_mem_calloc(1, sizeof(struct Regex));
             }
             mutt_str_replace(&Mask->pattern, buf);
+            FREE(&Mask->literal);
             Mask->regex = rx;
             Mask->not = not;
 
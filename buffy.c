@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <utime.h>
 #include "mutt/mutt.h"
 #include "conn/conn.h"
@@ -41,6 +42,7 @@
 #include "mutt_menu.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #ifdef USE_SIDEBAR
 #include "sidebar.h"
@@ -51,6 +53,9 @@
 #ifdef USE_NOTMUCH
 #include "mutt_notmuch.h"
 #endif
+#ifdef USE_INOTIFY
+#include "monitor.h"
+#endif
 
 static time_t BuffyTime = 0; /**< last time we started checking for mail */
 static time_t BuffyStatsTime = 0; /**< last time we check performed mail_check_stats */
@@ -58,6 +63,12 @@ time_t BuffyDoneTime = 0; /**< last time we knew for sure how much mail there wa
 static short BuffyCount = 0;  /**< how many boxes with new mail */
 static short BuffyNotify = 0; /**< # of unnotified new boxes */
 
+/* Scheduling of the regular checks */
+#define BUFFY_CHEAP_USEC 2000  /**< Checks quicker than this are never put off */
+#define BUFFY_PASS_USEC 50000  /**< Time a pass may spend on costly checks */
+#define BUFFY_QUIET_STEP 4     /**< Quiet checks before the interval doubles */
+#define BUFFY_MAX_BACKOFF 3    /**< Costly, quiet mailboxes wait up to 8 * $mail_check */
+
 /**
  * fseek_last_message - Find the last message in the file
  * @retval 0 on success
@@ -175,7 +186,12 @@ static struct Buffy *buffy_new(const char *path)
 static void buffy_free(struct Buffy **mailbox)
 {
   if (mailbox && *mailbox)
+  {
+#ifdef USE_INOTIFY
+    mutt_monitor_remove(*mailbox);
+#endif
     FREE(&(*mailbox)->desc);
+  }
   FREE(mailbox);
 }
 
@@ -183,14 +199,17 @@ static void buffy_free(struct Buffy **mailbox)
  * buffy_maildir_check_dir - Check for new mail / mail counts
  * @param mailbox     Mailbox to check
  * @param dir_name    Path to mailbox
+ * @param scan        Cached results of the last scan of the dir
  * @param check_new   if true, check for new mail
  * @param check_stats if true, count total, new, and flagged messages
  * @retval 1 if the dir has new mail
  *
  * Checks the specified maildir subdir (cur or new) for new mail or mail counts.
+ * The dir is only read if its mtime has changed since the last scan.
  */
 static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
-                                   bool check_new, bool check_stats)
+                                   struct BuffyDirScan *scan, bool check_new,
+                                   bool check_stats)
 {
   char path[LONG_STRING];
   char msgpath[LONG_STRING];
@@ -198,16 +217,20 @@ static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
   struct dirent *de = NULL;
   char *p = NULL;
   int rc = 0;
+  int count = 0, unread = 0, flagged = 0;
+  bool dir_ok;
+  struct stat dirsb;
   struct stat sb;
 
   snprintf(path, sizeof(path), "%s/%s", mailbox->path, dir_name);
+  dir_ok = (stat(path, &dirsb) == 0);
 
   /* when $mail_check_recent is set, if the new/ directory hasn't been modified since
    * the user last exited the mailbox, then we know there is no recent mail.
    */
   if (check_new && MailCheckRecent)
   {
-    if (stat(path, &sb) == 0 && sb.st_mtime < mailbox->last_visited)
+    if (dir_ok && dirsb.st_mtime < mailbox->last_visited)
     {
       rc = 0;
       check_new = false;
@@ -217,6 +240,29 @@ static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
   if (!(check_new || check_stats))
     return rc;
 
+  /* The dir hasn't changed since the last scan.  A scan in the same second
+   * as the mtime might have missed a later change, so it isn't trusted. */
+  if (dir_ok && scan->valid && (scan->mtime == dirsb.st_mtime) &&
+      (scan->scanned > scan->mtime) && (scan->stats || !check_stats) &&
+      (scan->check_new || !check_new) && (scan->recent == MailCheckRecent) &&
+      (scan->last_visited == mailbox->last_visited))
+  {
+    if (check_stats)
+    {
+      mailbox->msg_count += scan->msg_count;
+      mailbox->msg_unread += scan->msg_unread;
+      mailbox->msg_flagged += scan->msg_flagged;
+    }
+    if (check_new && scan->has_new)
+    {
+      mailbox->new = true;
+      rc = 1;
+    }
+    return rc;
+  }
+
+  scan->valid = false;
+
   dirp = opendir(path);
   if (!dirp)
   {
@@ -224,6 +270,8 @@ static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
     return 0;
   }
 
+  const bool want_new = check_new;
+
   while ((de = readdir(dirp)) != NULL)
   {
     if (*de->d_name == '.')
@@ -235,14 +283,14 @@ static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
 
     if (check_stats)
     {
-      mailbox->msg_count++;
+      count++;
       if (p && strchr(p + 3, 'F'))
-        mailbox->msg_flagged++;
+        flagged++;
     }
     if (!p || !strchr(p + 3, 'S'))
     {
       if (check_stats)
-        mailbox->msg_unread++;
+        unread++;
       if (check_new)
       {
         if (MailCheckRecent)
@@ -263,6 +311,28 @@ static int buffy_maildir_check_dir(struct Buffy *mailbox, const char *dir_name,
 
   closedir(dirp);
 
+  if (check_stats)
+  {
+    mailbox->msg_count += count;
+    mailbox->msg_unread += unread;
+    mailbox->msg_flagged += flagged;
+  }
+
+  if (dir_ok)
+  {
+    scan->valid = true;
+    scan->stats = check_stats;
+    scan->check_new = want_new;
+    scan->recent = MailCheckRecent;
+    scan->has_new = (rc == 1);
+    scan->mtime = dirsb.st_mtime;
+    scan->scanned = time(NULL);
+    scan->last_visited = mailbox->last_visited;
+    scan->msg_count = count;
+    scan->msg_unread = unread;
+    scan->msg_flagged = flagged;
+  }
+
   return rc;
 }
 
@@ -284,16 +354,108 @@ static int buffy_maildir_check(struct Buffy *mailbox, bool check_stats)
     mailbox->msg_flagged = 0;
   }
 
-  rc = buffy_maildir_check_dir(mailbox, "new", check_new, check_stats);
+  rc = buffy_maildir_check_dir(mailbox, "new", &mailbox->scan[0], check_new, check_stats);
 
   check_new = !rc && MaildirCheckCur;
   if (check_new || check_stats)
-    if (buffy_maildir_check_dir(mailbox, "cur", check_new, check_stats))
+    if (buffy_maildir_check_dir(mailbox, "cur", &mailbox->scan[1], check_new, check_stats))
       rc = 1;
 
   return rc;
 }
 
+/**
+ * buffy_mbox_hash_end - Fingerprint the end of an mbox mailbox
+ * @param f      Mailbox file
+ * @param offset Where the end is
+ * @param hash   Hash of up to 4KiB before offset
+ * @retval  0 Success, f is positioned at offset
+ * @retval -1 Error
+ *
+ * Rewriting the mailbox, e.g. to save flags, moves the messages, so the bytes
+ * before an old offset no longer match.
+ */
+static int buffy_mbox_hash_end(FILE *f, off_t offset, unsigned int *hash)
+{
+  unsigned char buf[4096];
+  size_t len = (offset < (off_t) sizeof(buf)) ? (size_t) offset : sizeof(buf);
+
+  if ((fseeko(f, offset - len, SEEK_SET) != 0) || (fread(buf, 1, len, f) != len))
+    return -1;
+
+  /* FNV-1a */
+  *hash = 2166136261U;
+  for (size_t i = 0; i < len; i++)
+    *hash = (*hash ^ buf[i]) * 16777619U;
+
+  return 0;
+}
+
+/**
+ * buffy_mbox_count_tail - Count the messages appended to an mbox mailbox
+ * @param mailbox Mailbox to update
+ * @param offset  Size of the mailbox when it was last counted
+ * @retval  0 Success, the counts include the new messages
+ * @retval -1 The mailbox wasn't only appended to, it must be counted again
+ */
+static int buffy_mbox_count_tail(struct Buffy *mailbox, off_t offset)
+{
+  char buf[LONG_STRING];
+  char return_path[STRING];
+  time_t t;
+  int count = 0, unread = 0, flagged = 0;
+  bool bol = true;
+  int rc = -1;
+
+  FILE *f = fopen(mailbox->path, "r");
+  if (!f)
+    return -1;
+
+  /* The mailbox must be unchanged up to its old end */
+  unsigned int hash;
+  if ((buffy_mbox_hash_end(f, offset, &hash) != 0) || (hash != mailbox->stats_hash))
+    goto done;
+
+  while (fgets(buf, sizeof(buf), f))
+  {
+    const bool from = bol && is_from(buf, return_path, sizeof(return_path), &t);
+    bol = (strchr(buf, '\n') != NULL);
+    if (!from)
+    {
+      if (count == 0)
+        goto done;
+      continue;
+    }
+
+    struct Header *hdr = mutt_new_header();
+    struct Envelope *env = mutt_read_rfc822_header(f, hdr, 0, 0);
+    count++;
+    if (!hdr->read)
+      unread++;
+    if (hdr->flagged)
+      flagged++;
+    mutt_env_free(&env);
+    mutt_free_header(&hdr);
+    bol = true;
+  }
+
+  off_t end = ftello(f);
+  if ((end < 0) || (buffy_mbox_hash_end(f, end, &hash) != 0))
+    goto done;
+
+  mailbox->msg_count += count;
+  mailbox->msg_unread += unread;
+  mailbox->msg_flagged += flagged;
+  mailbox->stats_size = end;
+  mailbox->stats_hash = hash;
+  mutt_debug(3, "%s: counted %d appended messages\n", mailbox->path, count);
+  rc = 0;
+
+done:
+  mutt_file_fclose(&f);
+  return rc;
+}
+
 /**
  * buffy_mbox_check - Check for new mail for an mbox mailbox
  * @param mailbox     Mailbox to check
@@ -333,13 +495,26 @@ static int buffy_mbox_check(struct Buffy *mailbox, struct stat *sb, bool check_s
 
   if (check_stats && (mailbox->stats_last_checked < sb->st_mtime))
   {
-    if (mx_open_mailbox(mailbox->path, MUTT_READONLY | MUTT_QUIET | MUTT_NOSORT | MUTT_PEEK,
-                        &ctx) != NULL)
+    /* Mail is usually appended, so only the new messages need reading */
+    if ((mailbox->magic == MUTT_MBOX) && (mailbox->stats_size > 0) &&
+        (sb->st_size > mailbox->stats_size) &&
+        (buffy_mbox_count_tail(mailbox, mailbox->stats_size) == 0))
+    {
+      mailbox->stats_last_checked = sb->st_mtime;
+    }
+    else if (mx_open_mailbox(mailbox->path, MUTT_READONLY | MUTT_QUIET | MUTT_NOSORT | MUTT_PEEK,
+                             &ctx) != NULL)
     {
       mailbox->msg_count = ctx.msgcount;
       mailbox->msg_unread = ctx.unread;
       mailbox->msg_flagged = ctx.flagged;
       mailbox->stats_last_checked = ctx.mtime;
+      mailbox->stats_size = 0;
+      if ((ctx.magic == MUTT_MBOX) && ctx.fp &&
+          (buffy_mbox_hash_end(ctx.fp, ctx.size, &mailbox->stats_hash) == 0))
+      {
+        mailbox->stats_size = ctx.size;
+      }
       mx_close_mailbox(&ctx, 0);
     }
   }
@@ -347,6 +522,54 @@ static int buffy_mbox_check(struct Buffy *mailbox, struct stat *sb, bool check_s
   return rc;
 }
 
+/**
+ * buffy_mbox_count - Count the messages in an mbox or mmdf mailbox
+ * @param mailbox Mailbox to count
+ * @param sb      stat(2) information about the mailbox
+ * @retval  0 Success, msg_count is set
+ * @retval -1 Error
+ *
+ * Only the message separators are read, not the headers.  The count is kept
+ * until the mailbox changes.
+ */
+static int buffy_mbox_count(struct Buffy *mailbox, struct stat *sb)
+{
+  char buf[LONG_STRING];
+  char return_path[STRING];
+  time_t t;
+  int count = 0;
+  bool bol = true;
+
+  if ((mailbox->stats_last_checked == sb->st_mtime) && (mailbox->size == sb->st_size))
+    return 0;
+
+  FILE *f = fopen(mailbox->path, "r");
+  if (!f)
+    return -1;
+
+  while (fgets(buf, sizeof(buf), f))
+  {
+    if (bol)
+    {
+      if (mailbox->magic == MUTT_MMDF)
+      {
+        if (mutt_str_strcmp(buf, MMDF_SEP) == 0)
+          count++;
+      }
+      else if (is_from(buf, return_path, sizeof(return_path), &t))
+        count++;
+    }
+    bol = (strchr(buf, '\n') != NULL);
+  }
+  mutt_file_fclose(&f);
+
+  /* Each MMDF message is both started and ended by a separator */
+  mailbox->msg_count = (mailbox->magic == MUTT_MMDF) ? count / 2 : count;
+  mailbox->stats_last_checked = sb->st_mtime;
+  mailbox->size = sb->st_size;
+  return 0;
+}
+
 static void buffy_check(struct Buffy *tmp, struct stat *contex_sb, bool check_stats)
 {
   struct stat sb;
@@ -354,6 +577,9 @@ static void buffy_check(struct Buffy *tmp, struct stat *contex_sb, bool check_st
   short orig_new;
   int orig_count, orig_unread, orig_flagged;
 #endif
+#ifdef USE_INOTIFY
+  bool was_new = tmp->new;
+#endif
 
   sb.st_size = 0;
 
@@ -411,18 +637,23 @@ static void buffy_check(struct Buffy *tmp, struct stat *contex_sb, bool check_st
     {
       case MUTT_MBOX:
       case MUTT_MMDF:
-        if (buffy_mbox_check(tmp, &sb, check_stats) > 0)
-          BuffyCount++;
+        buffy_mbox_check(tmp, &sb, check_stats);
         break;
 
       case MUTT_MAILDIR:
-        if (buffy_maildir_check(tmp, check_stats) > 0)
-          BuffyCount++;
+#ifdef USE_INOTIFY
+        /* nothing has changed since the last scan */
+        if (!mutt_monitor_check(tmp, check_stats))
+        {
+          tmp->new = was_new;
+          break;
+        }
+#endif
+        buffy_maildir_check(tmp, check_stats);
         break;
 
       case MUTT_MH:
-        if (mh_buffy(tmp, check_stats))
-          BuffyCount++;
+        mh_buffy(tmp, check_stats);
         break;
 #ifdef USE_NOTMUCH
       case MUTT_NOTMUCH:
@@ -431,10 +662,7 @@ static void buffy_check(struct Buffy *tmp, struct stat *contex_sb, bool check_st
         tmp->msg_flagged = 0;
         nm_nonctx_get_count(tmp->path, &tmp->msg_count, &tmp->msg_unread);
         if (tmp->msg_unread > 0)
-        {
-          BuffyCount++;
           tmp->new = true;
-        }
         break;
 #endif
     }
@@ -452,8 +680,6 @@ static void buffy_check(struct Buffy *tmp, struct stat *contex_sb, bool check_st
 
   if (!tmp->new)
     tmp->notified = false;
-  else if (!tmp->notified)
-    BuffyNotify++;
 }
 
 /**
@@ -485,6 +711,61 @@ static struct Buffy *buffy_get(const char *path)
   return NULL;
 }
 
+/**
+ * mutt_buffy_count - Count the messages in a local mailbox, without opening it
+ * @param path Mailbox
+ * @retval num Number of messages
+ * @retval -1  Error, or the mailbox isn't a local one
+ *
+ * The mailbox's headers aren't parsed.  The results of the last count are
+ * kept, so an unchanged mailbox isn't read again.  This is for mailboxes that
+ * aren't in the `mailboxes` list, like $postponed.
+ */
+int mutt_buffy_count(const char *path)
+{
+  static struct Buffy *Counted = NULL;
+  struct stat sb;
+
+  if (!path || (stat(path, &sb) != 0))
+    return -1;
+
+  if (!Counted || (mutt_str_strcmp(Counted->path, path) != 0))
+  {
+    buffy_free(&Counted);
+    Counted = buffy_new(path);
+  }
+
+  if (Counted->magic <= 0)
+    Counted->magic = mx_get_magic(path);
+
+  switch (Counted->magic)
+  {
+    case MUTT_MBOX:
+    case MUTT_MMDF:
+      if (buffy_mbox_count(Counted, &sb) != 0)
+        return -1;
+      break;
+
+    case MUTT_MAILDIR:
+      buffy_maildir_check(Counted, true);
+      break;
+
+    case MUTT_MH:
+      mh_buffy(Counted, true);
+      break;
+
+    default:
+      Counted->magic = 0;
+      return -1;
+  }
+
+  /* The mailbox vanished, or changed type, while it was being read */
+  if (Counted->magic <= 0)
+    return -1;
+
+  return Counted->msg_count;
+}
+
 void mutt_buffy_cleanup(const char *buf, struct stat *st)
 {
   struct utimbuf ut;
@@ -687,15 +968,86 @@ int mutt_parse_unmailboxes(struct Buffer *path, struct Buffer *s,
   return 0;
 }
 
+/**
+ * buffy_visible - Is a mailbox on screen?
+ * @param b Mailbox
+ * @retval true It's shown in the sidebar
+ */
+static bool buffy_visible(const struct Buffy *b)
+{
+#ifdef USE_SIDEBAR
+  return mutt_sb_is_visible(b);
+#else
+  return false;
+#endif
+}
+
+/**
+ * buffy_check_timed - Check a mailbox and decide when it's next due
+ * @param b           Mailbox
+ * @param contex_sb   stat() of the open mailbox
+ * @param check_stats If true, count the messages too
+ * @param now         Start of this pass
+ * @retval num Time the check took, in microseconds
+ *
+ * A mailbox whose checks are costly and keep finding nothing is checked less
+ * often: its interval doubles after every #BUFFY_QUIET_STEP quiet checks, up
+ * to #BUFFY_MAX_BACKOFF times.  Any change brings it back to $mail_check.
+ */
+static long buffy_check_timed(struct Buffy *b, struct stat *contex_sb,
+                              bool check_stats, time_t now)
+{
+  struct timeval start, end;
+  bool was_new = b->new;
+  int count = b->msg_count;
+  int unread = b->msg_unread;
+  int flagged = b->msg_flagged;
+  off_t size = b->size;
+
+  gettimeofday(&start, NULL);
+  buffy_check(b, contex_sb, check_stats);
+  gettimeofday(&end, NULL);
+
+  long usec = (end.tv_sec - start.tv_sec) * 1000000L + (end.tv_usec - start.tv_usec);
+  if (usec < 0)
+    usec = 0;
+
+  /* one slow check, e.g. with a cold cache, shouldn't count for much */
+  b->check_usec = b->check_usec ? (3 * b->check_usec + usec) / 4 : usec;
+
+  if ((was_new != b->new) || (count != b->msg_count) || (unread != b->msg_unread) ||
+      (flagged != b->msg_flagged) || (size != b->size))
+  {
+    b->quiet_checks = 0;
+  }
+  else if (b->quiet_checks < (BUFFY_QUIET_STEP * BUFFY_MAX_BACKOFF))
+    b->quiet_checks++;
+
+  int backoff = 0;
+  if (b->check_usec >= BUFFY_CHEAP_USEC)
+    backoff = b->quiet_checks / BUFFY_QUIET_STEP;
+  b->next_check = now + ((time_t) MailCheck << backoff);
+
+  return usec;
+}
+
 /**
  * mutt_buffy_check - Check all Incoming for new mail
+ * @param force If true, ignore MailCheck and check every mailbox
+ * @retval num Number of mailboxes with new mail
  *
- * Check all Incoming for new mail and total/new/flagged messages
- * force: if true, ignore MailCheck and check for new mail anyway
+ * Check Incoming for new mail and total/new/flagged messages.
+ *
+ * A regular pass only checks the mailboxes that are due, see
+ * buffy_check_timed().  Mailboxes visible in the sidebar are always checked,
+ * first.  Once the pass has spent #BUFFY_PASS_USEC, the remaining costly
+ * checks are put off until the next pass, so that one pass never keeps the
+ * user waiting for long.  Mailboxes that aren't checked keep their results.
  */
 int mutt_buffy_check(bool force)
 {
   struct stat contex_sb;
+  struct PerfTimer perf;
   time_t t;
   bool check_stats = false;
   contex_sb.st_dev = 0;
@@ -722,11 +1074,10 @@ int mutt_buffy_check(bool force)
   }
 
   BuffyTime = t;
-  BuffyCount = 0;
-  BuffyNotify = 0;
+  mutt_perf_start(&perf, PERF_BUFFY_CHECK);
 
 #ifdef USE_IMAP
-  BuffyCount += imap_buffy_check(check_stats);
+  imap_buffy_check(check_stats);
 #endif
 
   /* check device ID and serial number instead of comparing paths */
@@ -740,10 +1091,47 @@ int mutt_buffy_check(bool force)
     contex_sb.st_ino = 0;
   }
 
+#ifdef USE_INOTIFY
+  mutt_monitor_poll(force);
+#endif
+
+  long budget = BUFFY_PASS_USEC;
+  for (int visible = 1; visible >= 0; visible--)
+  {
+    for (struct Buffy *b = Incoming; b; b = b->next)
+    {
+      if (buffy_visible(b) != visible)
+        continue;
+
+      /* The open mailbox is cheap: it's never scanned here */
+      bool open = Context && (mutt_str_strcmp(b->realpath, Context->realpath) == 0);
+
+      if (!force && !visible && !open)
+      {
+        if (t < b->next_check)
+          continue;
+        /* still due next time */
+        if ((budget <= 0) && (b->check_usec >= BUFFY_CHEAP_USEC))
+          continue;
+      }
+
+      budget -= buffy_check_timed(b, &contex_sb, check_stats, t);
+    }
+  }
+
+  BuffyCount = 0;
+  BuffyNotify = 0;
   for (struct Buffy *b = Incoming; b; b = b->next)
-    buffy_check(b, &contex_sb, check_stats);
+  {
+    if (!b->new)
+      continue;
+    BuffyCount++;
+    if (!b->notified)
+      BuffyNotify++;
+  }
 
   BuffyDoneTime = BuffyTime;
+  mutt_perf_stop(&perf);
   return BuffyCount;
 }
 
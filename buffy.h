@@ -35,6 +35,27 @@ struct stat;
 #define MUTT_NAMED   1
 #define MUTT_VIRTUAL 2
 
+/**
+ * struct BuffyDirScan - The last scan of a maildir's new/ or cur/
+ *
+ * The results hold as long as the directory's mtime is unchanged, since
+ * delivering, deleting or flagging a message all rename it.
+ */
+struct BuffyDirScan
+{
+  bool valid;          /**< a scan has been recorded */
+  bool stats;          /**< the scan counted every message */
+  bool check_new;      /**< the scan looked for new mail */
+  bool recent;         /**< $mail_check_recent at the time */
+  bool has_new;        /**< the scan found new mail */
+  time_t mtime;        /**< mtime of the directory */
+  time_t scanned;      /**< time of the scan */
+  time_t last_visited; /**< Buffy's last_visited at the time */
+  int msg_count;       /**< total number of messages */
+  int msg_unread;      /**< number of unread messages */
+  int msg_flagged;     /**< number of flagged messages */
+};
+
 /**
  * struct Buffy - A mailbox
  */
@@ -58,6 +79,14 @@ struct Buffy
   bool newly_created;        /**< mbox or mmdf just popped into existence */
   time_t last_visited;       /**< time of last exit from this mailbox */
   time_t stats_last_checked; /**< mtime of mailbox the last time stats where checked. */
+  off_t stats_size;          /**< size of an mbox mailbox when its stats were counted */
+  unsigned int stats_hash;   /**< hash of the data just before stats_size */
+  struct BuffyDirScan scan[2]; /**< last scans of a maildir's new/ and cur/ */
+
+  /* Scheduling of the regular checks, see mutt_buffy_check() */
+  time_t next_check;         /**< when the mailbox is next due to be checked */
+  long check_usec;           /**< smoothed time a check takes, in microseconds */
+  short quiet_checks;        /**< checks in a row that found no change */
 };
 
 WHERE struct Buffy *Incoming;
@@ -70,6 +99,7 @@ extern time_t BuffyDoneTime; /**< last time we knew for sure how much mail there
 
 struct Buffy *mutt_find_mailbox(const char *path);
 void mutt_update_mailbox(struct Buffy *b);
+int mutt_buffy_count(const char *path);
 
 /** fixes up atime + mtime after mbox/mmdf mailbox was modified
  * according to stat() info taken before a modification */
@@ -51,7 +51,9 @@
 #include "ncrypt/ncrypt.h"
 #include "options.h"
 #include "pager.h"
+#include "perf.h"
 #include "protos.h"
+#include "rfc3676.h"
 #include "sort.h"
 #ifdef USE_IMAP
 #include "imap/imap.h"
@@ -118,6 +120,9 @@ int mutt_display_message(struct Header *cur)
       crypt_invoke_message(APPLICATION_SMIME);
   }
 
+  /* the clock stops when the pager has drawn the message */
+  mutt_perf_arm(PERF_PAGER_OPEN);
+
   mutt_mktemp(tempfile, sizeof(tempfile));
   fpout = mutt_file_fopen(tempfile, "w");
   if (!fpout)
@@ -160,7 +165,16 @@ int mutt_display_message(struct Header *cur)
   if (Context->magic == MUTT_NOTMUCH)
     chflags |= CH_VIRTUAL;
 #endif
+  /* the builtin pager can use the quoting that the flowed handler knows about,
+   * unless a filter might have changed the text */
+  struct FlowedLines flowed = { 0 };
+  if (builtin && !fpfilterout)
+  {
+    flowed.fp = fpout;
+    rfc3676_lines_record(&flowed);
+  }
   res = mutt_copy_message_ctx(fpout, Context, cur, cmflags, chflags);
+  rfc3676_lines_record(NULL);
 
   if ((mutt_file_fclose(&fpout) != 0 && errno != EPIPE) || res < 0)
   {
@@ -171,6 +185,7 @@ int mutt_display_message(struct Header *cur)
       mutt_file_fclose(&fpfilterout);
     }
     mutt_file_unlink(tempfile);
+    rfc3676_lines_free(&flowed);
     return 0;
   }
 
@@ -223,12 +238,15 @@ int mutt_display_message(struct Header *cur)
     memset(&info, 0, sizeof(struct Pager));
     info.hdr = cur;
     info.ctx = Context;
+    info.flowed = &flowed;
     rc = mutt_pager(NULL, tempfile, MUTT_PAGER_MESSAGE, &info);
+    rfc3676_lines_free(&flowed);
   }
   else
   {
     int r;
 
+    mutt_perf_fire(PERF_PAGER_OPEN);
     mutt_endwin(NULL);
     snprintf(buf, sizeof(buf), "%s %s", NONULL(Pager), tempfile);
     r = mutt_system(buf);
@@ -758,10 +776,8 @@ int mutt_save_message_ctx(struct Header *h, int delete, int decode, int decrypt,
  */
 int mutt_save_message(struct Header *h, int delete, int decode, int decrypt)
 {
-  int need_buffy_cleanup;
   int need_passphrase = 0, app = 0;
   char prompt[SHORT_STRING], buf[_POSIX_PATH_MAX];
-  struct Context ctx;
   struct stat st;
 
   snprintf(prompt, sizeof(prompt),
@@ -837,12 +853,32 @@ int mutt_save_message(struct Header *h, int delete, int decode, int decrypt)
   if (WithCrypto && need_passphrase && (decode || decrypt) && !crypt_valid_passphrase(app))
     return -1;
 
-  mutt_message(_("Copying to %s..."), buf);
+  return mutt_save_message_to(h, buf, &st, delete, decode, decrypt);
+}
+
+/**
+ * mutt_save_message_to - Save emails to a mailbox, without asking
+ * @param h       Email, NULL for all the tagged ones
+ * @param path    Mailbox, already expanded and confirmed
+ * @param st      Status of the mailbox, from mutt_save_confirm()
+ * @param delete  If true, delete the originals
+ * @param decode  If true, decode the messages
+ * @param decrypt If true, decrypt the messages
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+int mutt_save_message_to(struct Header *h, char *path, struct stat *st,
+                         int delete, int decode, int decrypt)
+{
+  int need_buffy_cleanup;
+  struct Context ctx;
+
+  mutt_message(_("Copying to %s..."), path);
 
 #ifdef USE_IMAP
-  if (Context->magic == MUTT_IMAP && !(decode || decrypt) && mx_is_imap(buf))
+  if (Context->magic == MUTT_IMAP && !(decode || decrypt) && mx_is_imap(path))
   {
-    switch (imap_copy_messages(Context, h, buf, delete))
+    switch (imap_copy_messages(Context, h, path, delete))
     {
       /* success */
       case 0:
@@ -858,7 +894,7 @@ int mutt_save_message(struct Header *h, int delete, int decode, int decrypt)
   }
 #endif
 
-  if (mx_open_mailbox(buf, MUTT_APPEND, &ctx) != NULL)
+  if (mx_open_mailbox(path, MUTT_APPEND, &ctx) != NULL)
   {
 #ifdef USE_COMPRESSED
     /* If we're saving to a compressed mailbox, the stats won't be updated
@@ -933,7 +969,7 @@ int mutt_save_message(struct Header *h, int delete, int decode, int decrypt)
     mx_close_mailbox(&ctx, NULL);
 
     if (need_buffy_cleanup)
-      mutt_buffy_cleanup(buf, &st);
+      mutt_buffy_cleanup(path, st);
 
     mutt_clear_error();
     return 0;
@@ -26,12 +26,14 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include "mutt/mutt.h"
 #include "mutt.h"
 #include "compress.h"
 #include "context.h"
 #include "format_flags.h"
+#include "globals.h"
 #include "mailbox.h"
 #include "mutt_curses.h"
 #include "mx.h"
@@ -57,6 +59,9 @@ struct CompressInfo
   const char *close;       /**< close-hook  command */
   const char *open;        /**< open-hook   command */
   off_t size;              /**< size of the compressed file */
+  time_t mtime;            /**< modification time of the compressed file */
+  ino_t ino;               /**< inode of the compressed file */
+  bool stale;              /**< the tmp file has changes that weren't compressed */
   struct MxOps *child_ops; /**< callbacks of de-compressed file */
   int locked;              /**< if realpath is locked */
   FILE *lockfp;            /**< fp used for locking */
@@ -200,7 +205,166 @@ static void store_size(const struct Context *ctx)
   if (!ci)
     return;
 
-  ci->size = get_size(ctx->realpath);
+  struct stat sb;
+  if (stat(ctx->realpath, &sb) == 0)
+  {
+    ci->size = sb.st_size;
+    ci->mtime = sb.st_mtime;
+    ci->ino = sb.st_ino;
+  }
+  else
+  {
+    ci->size = 0;
+    ci->mtime = 0;
+    ci->ino = 0;
+  }
+}
+
+/**
+ * struct CompressCache - A decompressed mailbox, kept to be reopened
+ */
+struct CompressCache
+{
+  char *realpath;    /**< Compressed file */
+  char *path;        /**< Its decompressed copy */
+  off_t size;        /**< Size of the compressed file, when it was decompressed */
+  time_t mtime;      /**< Modification time of the compressed file, ditto */
+  ino_t ino;         /**< Inode of the compressed file, ditto */
+  unsigned int used; /**< When the copy was last closed, for eviction */
+};
+
+#define COMP_CACHE_MAX 16
+static struct CompressCache CompCache[COMP_CACHE_MAX];
+static unsigned int CompCacheClock;
+
+/**
+ * comp_cache_free - Delete a kept decompressed copy
+ * @param cc Cache entry
+ */
+static void comp_cache_free(struct CompressCache *cc)
+{
+  if (cc->path)
+    remove(cc->path);
+  FREE(&cc->path);
+  FREE(&cc->realpath);
+}
+
+/**
+ * comp_cache_take - Reuse the decompressed copy of a mailbox
+ * @param ctx Mailbox, after setup_paths()
+ * @retval true  ctx->path is now the kept copy, which is up to date
+ * @retval false The mailbox has to be decompressed
+ *
+ * A copy is only used if the compressed file hasn't changed since it was
+ * decompressed.  Otherwise it's deleted.
+ */
+static bool comp_cache_take(struct Context *ctx)
+{
+  struct CompressInfo *ci = ctx->compress_info;
+
+  for (int i = 0; i < COMP_CACHE_MAX; i++)
+  {
+    struct CompressCache *cc = &CompCache[i];
+    if (!cc->realpath || (mutt_str_strcmp(cc->realpath, ctx->realpath) != 0))
+      continue;
+
+    if ((cc->size != ci->size) || (cc->mtime != ci->mtime) || (cc->ino != ci->ino) ||
+        (access(cc->path, F_OK) != 0))
+    {
+      comp_cache_free(cc);
+      return false;
+    }
+
+    remove(ctx->path);
+    FREE(&ctx->path);
+    ctx->path = cc->path;
+    cc->path = NULL;
+    FREE(&cc->realpath);
+    return true;
+  }
+
+  return false;
+}
+
+/**
+ * comp_cache_put - Keep the decompressed copy of a mailbox
+ * @param ctx Mailbox being closed
+ *
+ * The copy is kept if $compress_cache allows, and it still matches the
+ * compressed file.  Otherwise, or to make room, a copy is deleted.
+ */
+static void comp_cache_put(struct Context *ctx)
+{
+  struct CompressInfo *ci = ctx->compress_info;
+  struct stat sb;
+  const int max = MIN(CompressCache, COMP_CACHE_MAX);
+
+  if ((max <= 0) || ci->stale || (stat(ctx->realpath, &sb) != 0) ||
+      (sb.st_size != ci->size) || (sb.st_mtime != ci->mtime) || (sb.st_ino != ci->ino))
+  {
+    remove(ctx->path);
+    return;
+  }
+
+  /* drop any older copy of this mailbox, and the copies beyond the limit */
+  for (int i = 0; i < COMP_CACHE_MAX; i++)
+  {
+    struct CompressCache *c = &CompCache[i];
+    if (c->realpath && ((i >= max) || (mutt_str_strcmp(c->realpath, ctx->realpath) == 0)))
+      comp_cache_free(c);
+  }
+
+  /* use a free slot, or else the least recently used */
+  struct CompressCache *cc = &CompCache[0];
+  for (int i = 1; (i < max) && cc->realpath; i++)
+  {
+    if (!CompCache[i].realpath || (CompCache[i].used < cc->used))
+      cc = &CompCache[i];
+  }
+
+  comp_cache_free(cc);
+  cc->realpath = mutt_str_strdup(ctx->realpath);
+  cc->path = mutt_str_strdup(ctx->path);
+  cc->size = ci->size;
+  cc->mtime = ci->mtime;
+  cc->ino = ci->ino;
+  cc->used = ++CompCacheClock;
+}
+
+/**
+ * mutt_comp_source - Identify the compressed file of a mailbox
+ * @param ctx    Mailbox
+ * @param buf    Buffer for the identity
+ * @param buflen Length of the buffer
+ * @retval true  buf holds the size, mtime and inode of the compressed file
+ * @retval false Not a compressed mailbox, or the copy has unsaved changes
+ *
+ * As long as the identity doesn't change, neither does the decompressed copy,
+ * so anything derived from it, like the header cache, can be trusted.
+ */
+bool mutt_comp_source(const struct Context *ctx, char *buf, size_t buflen)
+{
+  if (!ctx || !ctx->compress_info)
+    return false;
+
+  const struct CompressInfo *ci = ctx->compress_info;
+  if (ci->stale || (ci->ino == 0))
+    return false;
+
+  snprintf(buf, buflen, "%lld %lld %llu", (long long) ci->size,
+           (long long) ci->mtime, (unsigned long long) ci->ino);
+  return true;
+}
+
+/**
+ * mutt_comp_cleanup - Delete the kept decompressed mailboxes
+ *
+ * See $compress_cache.
+ */
+void mutt_comp_cleanup(void)
+{
+  for (int i = 0; i < COMP_CACHE_MAX; i++)
+    comp_cache_free(&CompCache[i]);
 }
 
 /**
@@ -465,17 +629,20 @@ static int comp_open_mailbox(struct Context *ctx)
     goto or_fail;
   store_size(ctx);
 
-  if (!lock_realpath(ctx, 0))
+  if (!comp_cache_take(ctx))
   {
-    mutt_error(_("Unable to lock mailbox!"));
-    goto or_fail;
-  }
+    if (!lock_realpath(ctx, 0))
+    {
+      mutt_error(_("Unable to lock mailbox!"));
+      goto or_fail;
+    }
 
-  int rc = execute_command(ctx, ci->open, _("Decompressing %s"));
-  if (rc == 0)
-    goto or_fail;
+    int rc = execute_command(ctx, ci->open, _("Decompressing %s"));
+    if (rc == 0)
+      goto or_fail;
 
-  unlock_realpath(ctx);
+    unlock_realpath(ctx);
+  }
 
   ctx->magic = mx_get_magic(ctx->path);
   if (ctx->magic == 0)
@@ -618,7 +785,7 @@ static int comp_close_mailbox(struct Context *ctx)
     }
     else
     {
-      remove(ctx->path);
+      comp_cache_put(ctx);
     }
   }
   else
@@ -698,6 +865,7 @@ static int comp_check_mailbox(struct Context *ctx, int *index_hint)
   unlock_realpath(ctx);
   if (rc == 0)
     return -1;
+  ci->stale = false;
 
   return ops->check(ctx, index_hint);
 }
@@ -872,6 +1040,8 @@ static int comp_sync_mailbox(struct Context *ctx, int *index_hint)
   if (rc != 0)
     goto sync_cleanup;
 
+  /* until it's compressed, the tmp file doesn't match the compressed file */
+  ci->stale = true;
   rc = ops->sync(ctx, index_hint);
   if (rc != 0)
     goto sync_cleanup;
@@ -883,6 +1053,7 @@ static int comp_sync_mailbox(struct Context *ctx, int *index_hint)
     goto sync_cleanup;
   }
 
+  ci->stale = false;
   rc = 0;
 
 sync_cleanup:
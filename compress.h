@@ -32,6 +32,8 @@ struct Context;
 bool mutt_comp_can_append(struct Context *ctx);
 bool mutt_comp_can_read(const char *path);
 int mutt_comp_valid_command(const char *cmd);
+void mutt_comp_cleanup(void);
+bool mutt_comp_source(const struct Context *ctx, char *buf, size_t buflen);
 
 extern struct MxOps mx_comp_ops;
 
@@ -35,6 +35,7 @@
  * | conn/ssl.c          | @subpage conn_ssl        |
  * | conn/ssl_gnutls.c   | @subpage conn_ssl_gnutls |
  * | conn/tunnel.c       | @subpage conn_tunnel     |
+ * | conn/zstrm.c        | @subpage conn_zstrm      |
  */
 
 #ifndef _CONN_CONN_H
@@ -52,5 +53,8 @@
 #ifdef USE_SSL
 #include "ssl.h"
 #endif
+#ifdef USE_ZLIB
+#include "zstrm.h"
+#endif
 
 #endif /* _CONN_CONN_H */
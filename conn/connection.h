@@ -24,12 +24,45 @@
 #ifndef _CONN_CONNECTION_H
 #define _CONN_CONNECTION_H
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <time.h>
 #include "mutt/queue.h"
 #include "account.h"
 
 #define LONG_STRING 1024
+#define CONN_INBUF_SIZE  8192   /**< Initial size of the input buffer */
+#define CONN_INBUF_MAX   262144 /**< Largest size of the input buffer */
+#define CONN_OUTBUF_SIZE 16384  /**< Send corked data once this much is waiting */
+#define CONN_STATS_CMDS  16     /**< Number of command names tracked per connection */
+
+struct Buffer;
+
+/**
+ * struct ConnCmdStats - Traffic of one kind of command, e.g. "UID FETCH"
+ */
+struct ConnCmdStats
+{
+  char name[16];       /**< Command name, empty if the slot is unused */
+  unsigned long count; /**< Number of commands completed */
+  long long usecs;     /**< Total time from sending to completion */
+  long long max;       /**< Longest time from sending to completion */
+};
+
+/**
+ * struct ConnStats - Traffic on a connection, since it was opened
+ */
+struct ConnStats
+{
+  unsigned long long bytes_in;  /**< Bytes read, after TLS and compression */
+  unsigned long long bytes_out; /**< Bytes written, before TLS and compression */
+  unsigned long commands;       /**< Commands completed */
+  unsigned long round_trips;    /**< Reads which had to wait for a reply to a write */
+  long long wait_usecs;         /**< Time blocked reading or polling */
+  long long handshake_usecs;    /**< Time spent in the TLS handshake */
+  bool written;                 /**< Written to since the last read */
+  struct ConnCmdStats cmds[CONN_STATS_CMDS]; /**< Breakdown by command */
+};
 
 /**
  * struct Connection - An open network connection (socket)
@@ -40,8 +73,11 @@ struct Connection
   unsigned int ssf; /**< security strength factor, in bits */
   void *data;
 
-  char inbuf[LONG_STRING];
+  char *inbuf;      /**< data read from the server, not yet consumed */
+  size_t inbuflen;  /**< size of inbuf, it grows during bulk transfers */
   int bufpos;
+  struct Buffer *outbuf; /**< data waiting to be sent, while corked */
+  struct ConnStats stats;
 
   int fd;
   int available;
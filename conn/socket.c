@@ -27,20 +27,26 @@
  *
  * Low-level socket handling
  *
- * | Function               | Description
- * | :--------------------- | :-----------------------------------
- * | mutt_socket_close()    | Close a socket
- * | mutt_socket_open()     | Simple wrapper
- * | mutt_socket_poll()     | Checks whether reads would block
- * | mutt_socket_readchar() | simple read buffering to speed things up
- * | mutt_socket_readln_d() | Read a line from a socket
- * | mutt_socket_write_d()  | Write data to a socket
- * | raw_socket_close()     | Close a socket
- * | raw_socket_open()      | Open a socket
- * | raw_socket_poll()      | Checks whether reads would block
- * | raw_socket_read()      | Read data from a socket
- * | raw_socket_write()     | Write data to a socket
- * | socket_new_conn()      | allocate and initialise a new connection
+ * | Function                | Description
+ * | :---------------------- | :----------------------------------
+ * | mutt_socket_close()     | Close a socket
+ * | mutt_socket_cork()      | Hold back writes, to send them together
+ * | mutt_socket_elapsed()   | Measure the time since a moment
+ * | mutt_socket_open()      | Simple wrapper
+ * | mutt_socket_poll()      | Checks whether reads would block
+ * | mutt_socket_read()      | Read a block of data from a socket
+ * | mutt_socket_readchar()  | simple read buffering to speed things up
+ * | mutt_socket_readln_d()  | Read a line from a socket
+ * | mutt_socket_stats_cmd() | Count a completed command
+ * | mutt_socket_uncork()    | Send the writes that were held back
+ * | mutt_socket_wait()      | Wait for several connections and the keyboard
+ * | mutt_socket_write_d()   | Write data to a socket
+ * | raw_socket_close()      | Close a socket
+ * | raw_socket_open()       | Open a socket
+ * | raw_socket_poll()       | Checks whether reads would block
+ * | raw_socket_read()       | Read data from a socket
+ * | raw_socket_write()      | Write data to a socket
+ * | socket_new_conn()       | allocate and initialise a new connection
  */
 
 #include "config.h"
@@ -52,7 +58,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/select.h>
+#include <poll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <time.h>
@@ -64,6 +70,7 @@
 #include "globals.h"
 #include "options.h"
 #include "protos.h"
+#include "socket.h"
 #ifdef USE_SSL
 #include "ssl.h"
 #endif
@@ -96,6 +103,432 @@ static int socket_preconnect(void)
   return 0;
 }
 
+#ifdef HAVE_GETADDRINFO
+/* RFC8305 "Connection Attempt Delay": how long to let an address try on its
+ * own, before starting the next one alongside it. */
+#define CONNECT_ATTEMPT_DELAY 250
+
+/**
+ * socket_now_ms - Get the current time in milliseconds
+ * @retval num Milliseconds since the epoch
+ */
+static long long socket_now_ms(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (long long) tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+/**
+ * mutt_socket_elapsed - Measure the time since a moment
+ * @param start When it started
+ * @retval num Microseconds since then
+ */
+long long mutt_socket_elapsed(const struct timeval *start)
+{
+  struct timeval now;
+
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start->tv_sec) * 1000000LL + (now.tv_usec - start->tv_usec);
+}
+
+/* getaddrinfo() doesn't tell us the TTL of its answers */
+#define DNS_CACHE_TTL 300
+
+/**
+ * struct DnsEntry - A cached DNS lookup
+ *
+ * The cache is shared by all the connections, so reconnecting, or opening
+ * another connection to the same server, doesn't ask the resolver again.
+ */
+struct DnsEntry
+{
+  char *host;               /**< Host name, in ASCII */
+  char port[6];             /**< Port, as a string, e.g. "143" */
+  int family;               /**< Address family asked for, e.g. AF_UNSPEC */
+  struct addrinfo hints;    /**< Hints for the lookup */
+  struct addrinfo *res;     /**< Addresses found */
+#ifdef HAVE_GETADDRINFO_A
+  struct gaicb req;         /**< Lookup which may still be in progress */
+#endif
+  time_t expires;           /**< When the answer goes stale, 0 while in progress */
+  struct DnsEntry *next;
+};
+
+static struct DnsEntry *DnsCache = NULL;
+static bool DnsForked = false; /**< The background lookups can't be used */
+
+/**
+ * dns_entry_free - Free a cached DNS lookup
+ * @param de DNS entry to free
+ */
+static void dns_entry_free(struct DnsEntry *de)
+{
+  if (de->res)
+    freeaddrinfo(de->res);
+  FREE(&de->host);
+  FREE(&de);
+}
+
+/**
+ * dns_entry_done - Has a DNS lookup finished?
+ * @param de DNS entry
+ * @retval 0              The lookup succeeded
+ * @retval EAI_INPROGRESS The lookup is still in progress
+ * @retval num            The lookup failed, e.g. EAI_NONAME
+ */
+static int dns_entry_done(struct DnsEntry *de)
+{
+  if (de->expires)
+    return 0;
+
+#ifdef HAVE_GETADDRINFO_A
+  int rc = gai_error(&de->req);
+  if (rc == 0)
+  {
+    de->res = de->req.ar_result;
+    de->expires = time(NULL) + DNS_CACHE_TTL;
+  }
+  return rc;
+#else
+  return EAI_FAIL;
+#endif
+}
+
+/**
+ * dns_cache_sweep - Forget the stale and the failed DNS lookups
+ * @param drop Also forget the lookup with these addresses, may be NULL
+ */
+static void dns_cache_sweep(struct addrinfo *drop)
+{
+  time_t now = time(NULL);
+
+  for (struct DnsEntry **pde = &DnsCache; *pde;)
+  {
+    struct DnsEntry *de = *pde;
+    int rc = dns_entry_done(de);
+
+#ifdef HAVE_GETADDRINFO_A
+    if (rc == EAI_INPROGRESS)
+      pde = &de->next;
+    else
+#endif
+    if ((rc != 0) || (de->res == drop) || (now >= de->expires))
+    {
+      *pde = de->next;
+      dns_entry_free(de);
+    }
+    else
+      pde = &de->next;
+  }
+}
+
+/**
+ * mutt_socket_forked - Forget the parent's DNS lookups in a child process
+ *
+ * The threads running the parent's background lookups don't exist after a
+ * fork(), so the child makes its lookups with a plain getaddrinfo().
+ */
+void mutt_socket_forked(void)
+{
+  while (DnsCache)
+  {
+    struct DnsEntry *de = DnsCache;
+    DnsCache = de->next;
+    dns_entry_free(de);
+  }
+  DnsForked = true;
+}
+
+/**
+ * socket_resolve - Look up the addresses of a server
+ * @param[in]  host   Host name, in ASCII
+ * @param[in]  port   Port, as a string
+ * @param[in]  family Address family, e.g. AF_UNSPEC
+ * @param[out] err    getaddrinfo() error, e.g. EAI_NONAME
+ * @retval ptr Addresses, owned by the cache
+ * @retval NULL Error, see @a err
+ *
+ * Answers are kept for #DNS_CACHE_TTL seconds.  If getaddrinfo_a() is
+ * available, the lookup runs in the background: the wait is limited by
+ * $connect_timeout and can be interrupted.  A lookup which is given up on is
+ * left running, so that a later attempt can use its answer.
+ */
+static struct addrinfo *socket_resolve(const char *host, const char *port,
+                                       int family, int *err)
+{
+  struct DnsEntry *de = NULL;
+
+  dns_cache_sweep(NULL);
+
+  for (de = DnsCache; de; de = de->next)
+  {
+    if ((de->family == family) && (strcmp(de->port, port) == 0) &&
+        (mutt_str_strcasecmp(de->host, host) == 0))
+    {
+      break;
+    }
+  }
+
+  if (!de)
+  {
+    de = mutt_mem_calloc(1, sizeof(struct DnsEntry));
+    de->host = mutt_str_strdup(host);
+    mutt_str_strfcpy(de->port, port, sizeof(de->port));
+    de->family = family;
+    de->hints.ai_family = family;
+    de->hints.ai_socktype = SOCK_STREAM;
+
+#ifdef HAVE_GETADDRINFO_A
+    if (!DnsForked)
+    {
+      de->req.ar_name = de->host;
+      de->req.ar_service = de->port;
+      de->req.ar_request = &de->hints;
+      struct gaicb *reqs[1] = { &de->req };
+      *err = getaddrinfo_a(GAI_NOWAIT, reqs, 1, NULL);
+    }
+    else
+#endif
+    {
+      *err = getaddrinfo(host, port, &de->hints, &de->res);
+      if (*err == 0)
+        de->expires = time(NULL) + DNS_CACHE_TTL;
+    }
+    if (*err != 0)
+    {
+      dns_entry_free(de);
+      return NULL;
+    }
+
+    de->next = DnsCache;
+    DnsCache = de;
+  }
+  else
+    mutt_debug(3, "DNS answer for %s is cached\n", host);
+
+#ifdef HAVE_GETADDRINFO_A
+  long long deadline = (ConnectTimeout > 0) ? socket_now_ms() + ConnectTimeout * 1000LL : 0;
+  const struct gaicb *reqs[1] = { &de->req };
+
+  mutt_sig_allow_interrupt(1);
+  while ((*err = dns_entry_done(de)) == EAI_INPROGRESS)
+  {
+    long long wait = 1000;
+    if (deadline)
+      wait = MIN(wait, deadline - socket_now_ms());
+    if (wait <= 0)
+      break;
+
+    struct timespec ts = { wait / 1000, (wait % 1000) * 1000000 };
+    gai_suspend(reqs, 1, &ts);
+    if (SigInt)
+    {
+      SigInt = 0;
+      break;
+    }
+  }
+  mutt_sig_allow_interrupt(0);
+
+  if (*err == EAI_INPROGRESS)
+  {
+    /* the lookup stays in the cache, to be picked up next time */
+    mutt_debug(1, "DNS lookup of %s: gave up waiting\n", host);
+    return NULL;
+  }
+#else
+  *err = dns_entry_done(de);
+#endif
+
+  if (*err != 0)
+  {
+    mutt_debug(1, "DNS lookup of %s: %s\n", host, gai_strerror(*err));
+    dns_cache_sweep(NULL);
+    return NULL;
+  }
+
+  return de->res;
+}
+
+/**
+ * socket_sort_addrs - Interleave the address families
+ * @param[in]  res   Addresses from getaddrinfo()
+ * @param[out] addrs Addresses, in the order they should be tried
+ * @param[in]  n     Number of addresses
+ *
+ * getaddrinfo() puts the preferred family first (RFC6724), but a host with
+ * several IPv6 addresses would then try them all before any IPv4 one.  RFC8305
+ * wants the families to alternate, starting with the preferred one.
+ */
+static void socket_sort_addrs(struct addrinfo *res, struct addrinfo **addrs, size_t n)
+{
+  struct addrinfo *first = res;
+  struct addrinfo *other = res;
+  size_t i = 0;
+
+  while (i < n)
+  {
+    for (; first && (first->ai_family != res->ai_family); first = first->ai_next)
+      ;
+    if (first)
+    {
+      addrs[i++] = first;
+      first = first->ai_next;
+    }
+
+    for (; other && (other->ai_family == res->ai_family); other = other->ai_next)
+      ;
+    if (other)
+    {
+      addrs[i++] = other;
+      other = other->ai_next;
+    }
+  }
+}
+
+/**
+ * socket_connect_any - Connect to the first address that answers
+ * @param[in]  res Addresses from getaddrinfo()
+ * @param[out] err An errno, if no address could be connected to
+ * @retval >=0 Connected socket
+ * @retval -1  Error, see @a err
+ *
+ * This is "Happy Eyeballs" (RFC8305).  The addresses are tried in turn, but
+ * each one only gets #CONNECT_ATTEMPT_DELAY milliseconds on its own before the
+ * next one is started alongside it.  The first connection to be established
+ * wins, so a broken address family costs a fraction of a second, not all of
+ * $connect_timeout.  The timeout applies to the attempt as a whole.
+ */
+static int socket_connect_any(struct addrinfo *res, int *err)
+{
+  size_t n = 0;
+  for (struct addrinfo *cur = res; cur; cur = cur->ai_next)
+    n++;
+
+  struct addrinfo *addrs[n];
+  struct pollfd pfds[n];
+  size_t started = 0;
+  size_t pending = 0;
+  int fd = -1;
+  int rc = ECONNREFUSED;
+
+  socket_sort_addrs(res, addrs, n);
+
+  long long now = socket_now_ms();
+  long long deadline = (ConnectTimeout > 0) ? now + ConnectTimeout * 1000LL : 0;
+  long long next_attempt = now;
+
+  mutt_sig_allow_interrupt(1);
+
+  while (fd < 0)
+  {
+    now = socket_now_ms();
+    if (deadline && (now >= deadline))
+    {
+      rc = ETIMEDOUT;
+      break;
+    }
+
+    if ((started < n) && ((pending == 0) || (now >= next_attempt)))
+    {
+      struct addrinfo *ai = addrs[started++];
+      int s = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+      if (s < 0)
+      {
+        rc = errno;
+        continue;
+      }
+
+      fcntl(s, F_SETFL, fcntl(s, F_GETFL) | O_NONBLOCK);
+      if (connect(s, ai->ai_addr, ai->ai_addrlen) == 0)
+      {
+        fd = s;
+        break;
+      }
+      if (errno != EINPROGRESS)
+      {
+        rc = errno;
+        mutt_debug(2, "Connection failed. errno: %d...\n", errno);
+        close(s);
+        continue;
+      }
+
+      pfds[pending].fd = s;
+      pfds[pending].events = POLLOUT;
+      pending++;
+      next_attempt = now + CONNECT_ATTEMPT_DELAY;
+    }
+
+    if (pending == 0)
+    {
+      if (started == n)
+        break;
+      continue;
+    }
+
+    int wait = -1;
+    if (started < n)
+      wait = MAX(next_attempt - now, 0);
+    if (deadline && ((wait < 0) || (deadline - now < wait)))
+      wait = deadline - now;
+
+    int ready = poll(pfds, pending, wait);
+    if (ready < 0)
+    {
+      if (errno != EINTR)
+      {
+        rc = errno;
+        break;
+      }
+      if (SigInt)
+      {
+        rc = EINTR;
+        SigInt = 0;
+        break;
+      }
+      continue;
+    }
+
+    for (size_t i = 0; (ready > 0) && (i < pending); i++)
+    {
+      if (pfds[i].revents == 0)
+        continue;
+
+      int so_err = 0;
+      socklen_t len = sizeof(so_err);
+      if (getsockopt(pfds[i].fd, SOL_SOCKET, SO_ERROR, &so_err, &len) < 0)
+        so_err = errno;
+
+      if (so_err == 0)
+      {
+        fd = pfds[i].fd;
+        pfds[i] = pfds[--pending];
+        break;
+      }
+
+      rc = so_err;
+      mutt_debug(2, "Connection failed. errno: %d...\n", so_err);
+      close(pfds[i].fd);
+      pfds[i--] = pfds[--pending];
+      ready--;
+    }
+  }
+
+  mutt_sig_allow_interrupt(0);
+
+  /* the losers of the race */
+  for (size_t i = 0; i < pending; i++)
+    close(pfds[i].fd);
+
+  if (fd >= 0)
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+  else
+    *err = rc;
+
+  return fd;
+}
+#else
 /**
  * socket_connect - set up to connect to a socket fd
  * @param fd File descriptor to connect with
@@ -112,10 +545,6 @@ static int socket_connect(int fd, struct sockaddr *sa)
 
   if (sa->sa_family == AF_INET)
     sa_size = sizeof(struct sockaddr_in);
-#ifdef HAVE_GETADDRINFO
-  else if (sa->sa_family == AF_INET6)
-    sa_size = sizeof(struct sockaddr_in6);
-#endif
   else
   {
     mutt_debug(1, "Unknown address family!\n");
@@ -149,6 +578,7 @@ static int socket_connect(int fd, struct sockaddr *sa)
 
   return save_errno;
 }
+#endif
 
 /**
  * mutt_socket_open - Simple wrapper
@@ -163,6 +593,7 @@ int mutt_socket_open(struct Connection *conn)
   if (socket_preconnect())
     return -1;
 
+  memset(&conn->stats, 0, sizeof(conn->stats));
   rc = conn->conn_open(conn);
 
   mutt_debug(2, "Connected to %s:%d on fd=%d\n", conn->account.host,
@@ -171,6 +602,27 @@ int mutt_socket_open(struct Connection *conn)
   return rc;
 }
 
+/**
+ * socket_log_stats - Write the traffic of a connection to the debug log
+ * @param conn Connection to a server
+ */
+static void socket_log_stats(struct Connection *conn)
+{
+  const struct ConnStats *st = &conn->stats;
+
+  mutt_debug(1, "%s: %llu bytes in, %llu bytes out, %lu commands, %lu round "
+                "trips, %lldms waiting, %lldms TLS handshake\n",
+             conn->account.host, st->bytes_in, st->bytes_out, st->commands,
+             st->round_trips, st->wait_usecs / 1000, st->handshake_usecs / 1000);
+
+  for (int i = 0; (i < CONN_STATS_CMDS) && st->cmds[i].name[0]; i++)
+  {
+    const struct ConnCmdStats *cs = &st->cmds[i];
+    mutt_debug(1, "%s: %-12s %6lu, mean %lldms, max %lldms\n", conn->account.host,
+               cs->name, cs->count, cs->usecs / cs->count / 1000, cs->max / 1000);
+  }
+}
+
 /**
  * mutt_socket_close - Close a socket
  * @param conn Connection to a server
@@ -184,11 +636,97 @@ int mutt_socket_close(struct Connection *conn)
   if (conn->fd < 0)
     mutt_debug(1, "Attempt to close closed connection.\n");
   else
+  {
+    socket_log_stats(conn);
     rc = conn->conn_close(conn);
+  }
 
   conn->fd = -1;
   conn->ssf = 0;
+  mutt_buffer_free(&conn->outbuf);
+
+  return rc;
+}
+
+/**
+ * socket_send - Write a block of data to a socket
+ * @param conn Connection to a server
+ * @param buf  Data to write
+ * @param len  Length of data
+ * @retval >=0 Number of bytes written
+ * @retval -1  Error, the connection has been closed
+ */
+static int socket_send(struct Connection *conn, const char *buf, size_t len)
+{
+  int rc;
+  size_t sent = 0;
+
+  while (sent < len)
+  {
+    rc = conn->conn_write(conn, buf + sent, len - sent);
+    if (rc < 0)
+    {
+      mutt_debug(1, "error writing (%s), closing socket\n", strerror(errno));
+      mutt_socket_close(conn);
+
+      return -1;
+    }
+
+    if (rc < len - sent)
+      mutt_debug(3, "short write (%d of %zu bytes)\n", rc, len - sent);
+
+    sent += rc;
+  }
+
+  conn->stats.bytes_out += sent;
+  conn->stats.written = true;
+
+  return sent;
+}
+
+/**
+ * socket_flush - Send the corked data
+ * @param conn Connection to a server
+ * @retval  0 Success
+ * @retval -1 Error, the connection has been closed
+ */
+static int socket_flush(struct Connection *conn)
+{
+  if (!conn->outbuf || (conn->outbuf->dptr == conn->outbuf->data))
+    return 0;
+
+  int rc = socket_send(conn, conn->outbuf->data, conn->outbuf->dptr - conn->outbuf->data);
+  if (conn->outbuf)
+    mutt_buffer_reset(conn->outbuf);
 
+  return (rc < 0) ? -1 : 0;
+}
+
+/**
+ * mutt_socket_cork - Hold back writes, to send them together
+ * @param conn Connection to a server
+ *
+ * Until mutt_socket_uncork() is called, writes are collected and sent in
+ * blocks of #CONN_OUTBUF_SIZE, e.g. as one TLS record instead of one per
+ * line.  Anything waiting is sent before reading from the server, so a
+ * corked connection can't wait for the answer to a command it hasn't sent.
+ */
+void mutt_socket_cork(struct Connection *conn)
+{
+  if (!conn->outbuf)
+    conn->outbuf = mutt_buffer_alloc(CONN_OUTBUF_SIZE);
+}
+
+/**
+ * mutt_socket_uncork - Send the writes that were held back
+ * @param conn Connection to a server
+ * @retval  0 Success
+ * @retval -1 Error, the connection has been closed
+ */
+int mutt_socket_uncork(struct Connection *conn)
+{
+  int rc = socket_flush(conn);
+  mutt_buffer_free(&conn->outbuf);
   return rc;
 }
 
@@ -203,9 +741,6 @@ int mutt_socket_close(struct Connection *conn)
  */
 int mutt_socket_write_d(struct Connection *conn, const char *buf, int len, int dbg)
 {
-  int rc;
-  int sent = 0;
-
   mutt_debug(dbg, "%d> %s", conn->fd, buf);
 
   if (conn->fd < 0)
@@ -217,24 +752,17 @@ int mutt_socket_write_d(struct Connection *conn, const char *buf, int len, int d
   if (len < 0)
     len = mutt_str_strlen(buf);
 
-  while (sent < len)
-  {
-    rc = conn->conn_write(conn, buf + sent, len - sent);
-    if (rc < 0)
-    {
-      mutt_debug(1, "error writing (%s), closing socket\n", strerror(errno));
-      mutt_socket_close(conn);
+  if (!conn->outbuf)
+    return socket_send(conn, buf, len);
 
+  mutt_buffer_add(conn->outbuf, buf, len);
+  if ((conn->outbuf->dptr - conn->outbuf->data) >= CONN_OUTBUF_SIZE)
+  {
+    if (socket_flush(conn) < 0)
       return -1;
-    }
-
-    if (rc < len - sent)
-      mutt_debug(3, "short write (%d of %d bytes)\n", rc, len - sent);
-
-    sent += rc;
   }
 
-  return sent;
+  return len;
 }
 
 /**
@@ -250,10 +778,100 @@ int mutt_socket_poll(struct Connection *conn, time_t wait_secs)
   if (conn->bufpos < conn->available)
     return conn->available - conn->bufpos;
 
-  if (conn->conn_poll)
-    return conn->conn_poll(conn, wait_secs);
+  /* the server can't answer what we haven't sent */
+  if (socket_flush(conn) < 0)
+    return -1;
 
-  return -1;
+  if (!conn->conn_poll)
+    return -1;
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  int rc = conn->conn_poll(conn, wait_secs);
+  conn->stats.wait_usecs += mutt_socket_elapsed(&start);
+
+  return rc;
+}
+
+/**
+ * socket_fill - Refill the input buffer, if it's empty
+ * @param conn Connection to a server
+ * @retval  1 Success, there is data in conn->inbuf
+ * @retval -1 Error, the connection has been closed
+ */
+static int socket_fill(struct Connection *conn)
+{
+  if (conn->bufpos < conn->available)
+    return 1;
+
+  if (conn->fd < 0)
+  {
+    mutt_debug(1, "attempt to read from closed connection.\n");
+    return -1;
+  }
+
+  if (socket_flush(conn) < 0)
+    return -1;
+
+  /* the last read filled the buffer, so we're in a bulk transfer */
+  if (!conn->inbuf || (((size_t) conn->available == conn->inbuflen) && (conn->inbuflen < CONN_INBUF_MAX)))
+  {
+    conn->inbuflen = conn->inbuf ? conn->inbuflen * 2 : CONN_INBUF_SIZE;
+    FREE(&conn->inbuf);
+    conn->inbuf = mutt_mem_malloc(conn->inbuflen);
+  }
+
+  /* a read straight after a write waits for the server to reply */
+  if (conn->stats.written)
+  {
+    conn->stats.round_trips++;
+    conn->stats.written = false;
+  }
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
+  conn->available = conn->conn_read(conn, conn->inbuf, conn->inbuflen);
+  conn->stats.wait_usecs += mutt_socket_elapsed(&start);
+  conn->bufpos = 0;
+  if (conn->available == 0)
+  {
+    mutt_error(_("Connection to %s closed"), conn->account.host);
+    mutt_sleep(2);
+  }
+  if (conn->available <= 0)
+  {
+    mutt_socket_close(conn);
+    return -1;
+  }
+  conn->stats.bytes_in += conn->available;
+  return 1;
+}
+
+/**
+ * mutt_socket_read - Read a block of data from a socket
+ * @param conn Connection to a server
+ * @param buf  Buffer for the data
+ * @param len  Maximum number of bytes to read
+ * @retval >0 Number of bytes read
+ * @retval -1 Error
+ *
+ * This copies whatever is buffered, up to len bytes, and only reads from the
+ * server if the buffer is empty.  It may return fewer bytes than asked for.
+ */
+int mutt_socket_read(struct Connection *conn, char *buf, size_t len)
+{
+  if (len == 0)
+    return 0;
+
+  if (socket_fill(conn) < 0)
+    return -1;
+
+  size_t n = conn->available - conn->bufpos;
+  if (n > len)
+    n = len;
+  memcpy(buf, conn->inbuf + conn->bufpos, n);
+  conn->bufpos += n;
+  return n;
 }
 
 /**
@@ -265,27 +883,9 @@ int mutt_socket_poll(struct Connection *conn, time_t wait_secs)
  */
 int mutt_socket_readchar(struct Connection *conn, char *c)
 {
-  if (conn->bufpos >= conn->available)
-  {
-    if (conn->fd >= 0)
-      conn->available = conn->conn_read(conn, conn->inbuf, sizeof(conn->inbuf));
-    else
-    {
-      mutt_debug(1, "attempt to read from closed connection.\n");
-      return -1;
-    }
-    conn->bufpos = 0;
-    if (conn->available == 0)
-    {
-      mutt_error(_("Connection to %s closed"), conn->account.host);
-      mutt_sleep(2);
-    }
-    if (conn->available <= 0)
-    {
-      mutt_socket_close(conn);
-      return -1;
-    }
-  }
+  if (socket_fill(conn) < 0)
+    return -1;
+
   *c = conn->inbuf[conn->bufpos];
   conn->bufpos++;
   return 1;
@@ -302,20 +902,33 @@ int mutt_socket_readchar(struct Connection *conn, char *c)
  */
 int mutt_socket_readln_d(char *buf, size_t buflen, struct Connection *conn, int dbg)
 {
-  char ch;
-  int i;
+  size_t i = 0;
+  bool eol = false;
 
-  for (i = 0; i < buflen - 1; i++)
+  /* copy straight from the input buffer, up to the newline */
+  while (!eol && (i < buflen - 1))
   {
-    if (mutt_socket_readchar(conn, &ch) != 1)
+    if (socket_fill(conn) < 0)
     {
       buf[i] = '\0';
       return -1;
     }
 
-    if (ch == '\n')
-      break;
-    buf[i] = ch;
+    const char *src = conn->inbuf + conn->bufpos;
+    size_t n = conn->available - conn->bufpos;
+    if (n > buflen - 1 - i)
+      n = buflen - 1 - i;
+
+    const char *nl = memchr(src, '\n', n);
+    if (nl)
+    {
+      n = nl - src;
+      eol = true;
+    }
+
+    memcpy(buf + i, src, n);
+    i += n;
+    conn->bufpos += n + eol;
   }
 
   /* strip \r from \r\n termination */
@@ -329,6 +942,39 @@ int mutt_socket_readln_d(char *buf, size_t buflen, struct Connection *conn, int
   return i + 1;
 }
 
+/**
+ * mutt_socket_stats_cmd - Count a completed command
+ * @param conn  Connection to a server
+ * @param name  Command name, e.g. "UID FETCH"
+ * @param usecs Time from sending the command to its completion
+ *
+ * The first #CONN_STATS_CMDS names get their own counts, the rest are
+ * counted together as "other".
+ */
+void mutt_socket_stats_cmd(struct Connection *conn, const char *name, long long usecs)
+{
+  struct ConnStats *st = &conn->stats;
+  struct ConnCmdStats *cs = NULL;
+
+  st->commands++;
+
+  for (int i = 0; i < CONN_STATS_CMDS; i++)
+  {
+    cs = &st->cmds[i];
+    if (i == CONN_STATS_CMDS - 1)
+      name = "other";
+    if (!cs->name[0])
+      mutt_str_strfcpy(cs->name, name, sizeof(cs->name));
+    if (mutt_str_strcmp(cs->name, name) == 0)
+      break;
+  }
+
+  cs->count++;
+  cs->usecs += usecs;
+  if (usecs > cs->max)
+    cs->max = usecs;
+}
+
 /**
  * socket_new_conn - allocate and initialise a new connection
  * @retval ptr New Connection
@@ -421,35 +1067,30 @@ int raw_socket_write(struct Connection *conn, const char *buf, size_t count)
 }
 
 /**
- * raw_socket_poll - Checks whether reads would block
- * @param conn Connection to a server
- * @param wait_secs How long to wait for a response
- * @retval >0 There is data to read
- * @retval  0 Read would block
- * @retval -1 Connection doesn't support polling
+ * socket_poll_fds - Wait for some file descriptors to become readable
+ * @param pfds      File descriptors to watch
+ * @param nfds      Number of file descriptors
+ * @param wait_secs How long to wait
+ * @param intr      If true, a signal ends the wait
+ * @retval >0 Number of readable descriptors
+ * @retval  0 Time's up, or a signal arrived
+ * @retval -1 Error, see errno
+ *
+ * Unlike select(), poll() isn't limited to descriptors below FD_SETSIZE,
+ * which matters once several connections are open.
  */
-int raw_socket_poll(struct Connection *conn, time_t wait_secs)
+static int socket_poll_fds(struct pollfd *pfds, nfds_t nfds, time_t wait_secs, bool intr)
 {
-  fd_set rfds;
   unsigned long wait_millis, post_t_millis;
-  struct timeval tv, pre_t, post_t;
+  struct timeval pre_t, post_t;
   int rc;
 
-  if (conn->fd < 0)
-    return -1;
-
   wait_millis = wait_secs * 1000UL;
 
   while (true)
   {
-    tv.tv_sec = wait_millis / 1000;
-    tv.tv_usec = (wait_millis % 1000) * 1000;
-
-    FD_ZERO(&rfds);
-    FD_SET(conn->fd, &rfds);
-
     gettimeofday(&pre_t, NULL);
-    rc = select(conn->fd + 1, &rfds, NULL, NULL, &tv);
+    rc = poll(pfds, nfds, wait_millis);
     gettimeofday(&post_t, NULL);
 
     if (rc > 0 || (rc < 0 && errno != EINTR))
@@ -458,6 +1099,9 @@ int raw_socket_poll(struct Connection *conn, time_t wait_secs)
     if (SigInt)
       mutt_query_exit();
 
+    if (rc < 0 && intr)
+      return 0;
+
     wait_millis += (pre_t.tv_sec * 1000UL) + (pre_t.tv_usec / 1000);
     post_t_millis = (post_t.tv_sec * 1000UL) + (post_t.tv_usec / 1000);
     if (wait_millis <= post_t_millis)
@@ -466,6 +1110,79 @@ int raw_socket_poll(struct Connection *conn, time_t wait_secs)
   }
 }
 
+/**
+ * raw_socket_poll - Checks whether reads would block
+ * @param conn Connection to a server
+ * @param wait_secs How long to wait for a response
+ * @retval >0 There is data to read
+ * @retval  0 Read would block
+ * @retval -1 Connection doesn't support polling
+ */
+int raw_socket_poll(struct Connection *conn, time_t wait_secs)
+{
+  if (conn->fd < 0)
+    return -1;
+
+  struct pollfd pfd = { .fd = conn->fd, .events = POLLIN };
+
+  return socket_poll_fds(&pfd, 1, wait_secs, false);
+}
+
+/**
+ * mutt_socket_wait - Wait for several connections and the keyboard
+ * @param conns     Connections to watch
+ * @param nconns    Number of connections
+ * @param keyboard  If true, watch the keyboard (stdin) too
+ * @param wait_secs Longest time to wait, in seconds
+ * @retval >=0                 Index of a connection with data to read
+ * @retval SOCKET_WAIT_KEYBOARD There is keyboard input
+ * @retval SOCKET_WAIT_TIMEOUT  Time's up, a signal arrived, or an error
+ *
+ * Data already held in a connection's buffers (including those of the
+ * compression and SASL layers) is reported without waiting.  A signal, e.g.
+ * SIGWINCH, ends the wait so that the caller can deal with it.
+ *
+ * Connections which are closed, or which can't be polled, are ignored.
+ */
+int mutt_socket_wait(struct Connection **conns, size_t nconns, bool keyboard, time_t wait_secs)
+{
+  struct pollfd pfds[nconns + 1];
+  int idx[nconns + 1];
+  nfds_t nfds = 0;
+
+  for (size_t i = 0; i < nconns; i++)
+  {
+    struct Connection *conn = conns[i];
+    if (!conn || (conn->fd < 0))
+      continue;
+
+    /* the data may be waiting in our buffers already */
+    if (mutt_socket_poll(conn, 0) > 0)
+      return i;
+
+    pfds[nfds].fd = conn->fd;
+    pfds[nfds].events = POLLIN;
+    idx[nfds++] = i;
+  }
+
+  if (keyboard)
+  {
+    pfds[nfds].fd = 0;
+    pfds[nfds].events = POLLIN;
+    idx[nfds++] = SOCKET_WAIT_KEYBOARD;
+  }
+
+  if ((nfds == 0) || (socket_poll_fds(pfds, nfds, wait_secs, true) <= 0))
+    return SOCKET_WAIT_TIMEOUT;
+
+  /* the connections come first: the keyboard can wait for the news */
+  for (nfds_t i = 0; i < nfds; i++)
+    if (pfds[i].revents)
+      return idx[i];
+
+  return SOCKET_WAIT_TIMEOUT;
+}
+
 /**
  * raw_socket_open - Open a socket
  * @param conn Connection to a server
@@ -484,19 +1201,7 @@ int raw_socket_open(struct Connection *conn)
 
   /* "65536\0" */
   char port[6];
-  struct addrinfo hints;
   struct addrinfo *res = NULL;
-  struct addrinfo *cur = NULL;
-
-  /* we accept v4 or v6 STREAM sockets */
-  memset(&hints, 0, sizeof(hints));
-
-  if (UseIpv6)
-    hints.ai_family = AF_UNSPEC;
-  else
-    hints.ai_family = AF_INET;
-
-  hints.ai_socktype = SOCK_STREAM;
 
   snprintf(port, sizeof(port), "%d", conn->account.port);
 
@@ -513,13 +1218,14 @@ int raw_socket_open(struct Connection *conn)
   if (!OPT_NO_CURSES)
     mutt_message(_("Looking up %s..."), conn->account.host);
 
-  rc = getaddrinfo(host_idna, port, &hints, &res);
+  /* we accept v4 or v6 STREAM sockets */
+  res = socket_resolve(host_idna, port, UseIpv6 ? AF_UNSPEC : AF_INET, &rc);
 
 #ifdef HAVE_LIBIDN
   FREE(&host_idna);
 #endif
 
-  if (rc)
+  if (!res)
   {
     mutt_error(_("Could not find the host \"%s\""), conn->account.host);
     mutt_sleep(2);
@@ -529,25 +1235,18 @@ int raw_socket_open(struct Connection *conn)
   if (!OPT_NO_CURSES)
     mutt_message(_("Connecting to %s..."), conn->account.host);
 
-  rc = -1;
-  for (cur = res; cur != NULL; cur = cur->ai_next)
+  rc = 0;
+  fd = socket_connect_any(res, &rc);
+  if (fd >= 0)
   {
-    fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
-    if (fd >= 0)
-    {
-      rc = socket_connect(fd, cur->ai_addr);
-      if (rc == 0)
-      {
-        fcntl(fd, F_SETFD, FD_CLOEXEC);
-        conn->fd = fd;
-        break;
-      }
-      else
-        close(fd);
-    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    conn->fd = fd;
+  }
+  else
+  {
+    /* the server may have moved */
+    dns_cache_sweep(res);
   }
-
-  freeaddrinfo(res);
 
 #else
   /* --- IPv4 only --- */
@@ -24,19 +24,32 @@
 #ifndef _CONN_SOCKET_H
 #define _CONN_SOCKET_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <time.h>
 
 struct Connection;
+struct timeval;
+
+/* mutt_socket_wait() results, besides the index of a connection */
+#define SOCKET_WAIT_TIMEOUT  -1 /**< Time's up, or a signal arrived */
+#define SOCKET_WAIT_KEYBOARD -2 /**< There is keyboard input */
 
 struct Connection *socket_new_conn(void);
 
 int mutt_socket_open(struct Connection *conn);
 int mutt_socket_close(struct Connection *conn);
+void mutt_socket_cork(struct Connection *conn);
+int mutt_socket_uncork(struct Connection *conn);
 int mutt_socket_poll(struct Connection *conn, time_t wait_secs);
+int mutt_socket_read(struct Connection *conn, char *buf, size_t len);
 int mutt_socket_readchar(struct Connection *conn, char *c);
 int mutt_socket_readln_d(char *buf, size_t buflen, struct Connection *conn, int dbg);
 int mutt_socket_write_d(struct Connection *conn, const char *buf, int len, int dbg);
+void mutt_socket_stats_cmd(struct Connection *conn, const char *name, long long usecs);
+long long mutt_socket_elapsed(const struct timeval *start);
+int mutt_socket_wait(struct Connection **conns, size_t nconns, bool keyboard, time_t wait_secs);
+void mutt_socket_forked(void);
 
 int raw_socket_read(struct Connection *conn, char *buf, size_t len);
 int raw_socket_write(struct Connection *conn, const char *buf, size_t count);
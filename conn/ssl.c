@@ -51,6 +51,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include "mutt/debug.h"
 #include "mutt/file.h"
@@ -96,6 +97,24 @@ static int HostExDataIndex = -1;
  * non-null. */
 static int SkipModeExDataIndex = -1;
 
+/* index for storing the account as application specific data in SSL structure */
+static int AccountExDataIndex = -1;
+
+/**
+ * struct SslSession - A TLS session that a new connection can resume
+ */
+struct SslSession
+{
+  char host[128];
+  unsigned short port;
+  SSL_SESSION *session;
+  struct SslSession *next;
+};
+
+/* sessions of the servers we've connected to, so reconnecting, or
+ * opening another connection, can skip the full handshake */
+static struct SslSession *SslSessions = NULL;
+
 /* keep a handle on accepted certificates in case we want to
  * open up another connection to the same server in this session */
 static STACK_OF(X509) *SslSessionCerts = NULL;
@@ -963,11 +982,16 @@ static int interactive_check_cert(X509 *cert, int idx, size_t len, SSL *ssl, int
   char helpstr[LONG_STRING];
   char buf[STRING];
   char title[STRING];
-  struct Menu *menu = mutt_new_menu(MENU_GENERIC);
+  struct Menu *menu = NULL;
   int done, row;
   FILE *fp = NULL;
   int ALLOW_SKIP = 0; /**< All caps tells Coverity that this is effectively a preproc condition */
 
+  /* nobody can be asked, e.g. when delivering the send queue */
+  if (OPT_NO_CURSES)
+    return 0;
+
+  menu = mutt_new_menu(MENU_GENERIC);
   mutt_push_current_menu(menu);
 
   menu->max = mutt_array_size(part) * 2 + 10;
@@ -1232,6 +1256,54 @@ static int ssl_verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
   return 1;
 }
 
+/**
+ * ssl_session_find - Find the cached TLS session of a server
+ * @param account Account of the server
+ * @retval ptr  Cache entry
+ * @retval NULL None
+ */
+static struct SslSession *ssl_session_find(const struct Account *account)
+{
+  for (struct SslSession *s = SslSessions; s; s = s->next)
+    if ((s->port == account->port) && (mutt_str_strcasecmp(s->host, account->host) == 0))
+      return s;
+
+  return NULL;
+}
+
+/**
+ * ssl_new_session - Remember a TLS session for later connections
+ * @param ssl     SSL connection
+ * @param session New session
+ * @retval 1 The session is kept
+ * @retval 0 The session isn't wanted
+ *
+ * This is called by OpenSSL when the server sends a session, which, with
+ * TLSv1.3, may be after the handshake.
+ */
+static int ssl_new_session(SSL *ssl, SSL_SESSION *session)
+{
+  const struct Account *account = SSL_get_ex_data(ssl, AccountExDataIndex);
+  if (!account)
+    return 0;
+
+  struct SslSession *s = ssl_session_find(account);
+  if (s)
+    SSL_SESSION_free(s->session);
+  else
+  {
+    s = mutt_mem_calloc(1, sizeof(struct SslSession));
+    mutt_str_strfcpy(s->host, account->host, sizeof(s->host));
+    s->port = account->port;
+    s->next = SslSessions;
+    SslSessions = s;
+  }
+
+  s->session = session;
+  mutt_debug(2, "Saved TLS session for %s:%d\n", s->host, s->port);
+  return 1;
+}
+
 /**
  * ssl_negotiate - Attempt to negotiate SSL over the wire
  * @param conn    Connection to a server
@@ -1273,6 +1345,20 @@ static int ssl_negotiate(struct Connection *conn, struct SslSockData *ssldata)
     return -1;
   }
 
+  if (AccountExDataIndex == -1)
+    AccountExDataIndex = SSL_get_ex_new_index(0, "account", NULL, NULL, NULL);
+  if ((AccountExDataIndex != -1) &&
+      SSL_set_ex_data(ssldata->ssl, AccountExDataIndex, &conn->account))
+  {
+    /* try to resume the last session with this server */
+    struct SslSession *s = ssl_session_find(&conn->account);
+    SSL_CTX_set_session_cache_mode(ssldata->ctx, SSL_SESS_CACHE_CLIENT |
+                                                     SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(ssldata->ctx, ssl_new_session);
+    if (s)
+      SSL_set_session(ssldata->ssl, s->session);
+  }
+
   SSL_set_verify(ssldata->ssl, SSL_VERIFY_PEER, ssl_verify_callback);
   SSL_set_mode(ssldata->ssl, SSL_MODE_AUTO_RETRY);
 
@@ -1287,7 +1373,10 @@ static int ssl_negotiate(struct Connection *conn, struct SslSockData *ssldata)
 
   ERR_clear_error();
 
+  struct timeval start;
+  gettimeofday(&start, NULL);
   err = SSL_connect(ssldata->ssl);
+  conn->stats.handshake_usecs += mutt_socket_elapsed(&start);
   if (err != 1)
   {
     switch (SSL_get_error(ssldata->ssl, err))
@@ -1308,6 +1397,7 @@ static int ssl_negotiate(struct Connection *conn, struct SslSockData *ssldata)
     return -1;
   }
 
+  mutt_debug(2, "TLS session %s\n", SSL_session_reused(ssldata->ssl) ? "resumed" : "negotiated");
   return 0;
 }
 
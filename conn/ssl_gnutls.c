@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <time.h>
 #include "mutt/mutt.h"
 #include "mutt.h"
@@ -75,6 +76,67 @@ struct TlsSockData
   gnutls_certificate_credentials_t xcred;
 };
 
+/**
+ * struct TlsSession - A TLS session that a new connection can resume
+ */
+struct TlsSession
+{
+  char host[128];
+  unsigned short port;
+  gnutls_datum_t data;
+  struct TlsSession *next;
+};
+
+/* sessions of the servers we've connected to, so reconnecting, or
+ * opening another connection, can skip the full handshake */
+static struct TlsSession *TlsSessions = NULL;
+
+/**
+ * tls_session_find - Find the cached TLS session of a server
+ * @param account Account of the server
+ * @retval ptr  Cache entry
+ * @retval NULL None
+ */
+static struct TlsSession *tls_session_find(const struct Account *account)
+{
+  for (struct TlsSession *s = TlsSessions; s; s = s->next)
+    if ((s->port == account->port) && (mutt_str_strcasecmp(s->host, account->host) == 0))
+      return s;
+
+  return NULL;
+}
+
+/**
+ * tls_session_save - Remember a TLS session for later connections
+ * @param conn Connection to a server
+ *
+ * With TLSv1.3, the server sends the session after the handshake, so this is
+ * done again when the connection is closed.
+ */
+static void tls_session_save(struct Connection *conn)
+{
+  struct TlsSockData *data = conn->sockdata;
+  gnutls_datum_t d;
+
+  if (gnutls_session_get_data2(data->state, &d) < 0)
+    return;
+
+  struct TlsSession *s = tls_session_find(&conn->account);
+  if (s)
+    gnutls_free(s->data.data);
+  else
+  {
+    s = mutt_mem_calloc(1, sizeof(struct TlsSession));
+    mutt_str_strfcpy(s->host, conn->account.host, sizeof(s->host));
+    s->port = conn->account.port;
+    s->next = TlsSessions;
+    TlsSessions = s;
+  }
+
+  s->data = d;
+  mutt_debug(2, "Saved TLS session for %s:%d\n", s->host, s->port);
+}
+
 /**
  * tls_init - Set up Gnu TLS
  * @retval  0 Success
@@ -195,6 +257,7 @@ static int tls_socket_close(struct Connection *conn)
      */
     gnutls_bye(data->state, GNUTLS_SHUT_WR);
 
+    tls_session_save(conn);
     gnutls_certificate_free_credentials(data->xcred);
     gnutls_deinit(data->state);
     FREE(&conn->sockdata);
@@ -605,6 +668,10 @@ static int tls_check_one_certificate(const gnutls_datum_t *certdata,
     return 0;
   }
 
+  /* nobody can be asked, e.g. when delivering the send queue */
+  if (OPT_NO_CURSES)
+    return 0;
+
   /* interactive check from user */
   if (gnutls_x509_crt_init(&cert) < 0)
   {
@@ -1206,12 +1273,20 @@ static int tls_negotiate(struct Connection *conn)
 
   gnutls_credentials_set(data->state, GNUTLS_CRD_CERTIFICATE, data->xcred);
 
+  /* try to resume the last session with this server */
+  struct TlsSession *s = tls_session_find(&conn->account);
+  if (s)
+    gnutls_session_set_data(data->state, s->data.data, s->data.size);
+
+  struct timeval start;
+  gettimeofday(&start, NULL);
   err = gnutls_handshake(data->state);
 
   while (err == GNUTLS_E_AGAIN)
   {
     err = gnutls_handshake(data->state);
   }
+  conn->stats.handshake_usecs += mutt_socket_elapsed(&start);
   if (err < 0)
   {
     if (err == GNUTLS_E_FATAL_ALERT_RECEIVED)
@@ -1230,6 +1305,10 @@ static int tls_negotiate(struct Connection *conn)
   if (!tls_check_certificate(conn))
     goto fail;
 
+  mutt_debug(2, "TLS session %s\n",
+             gnutls_session_is_resumed(data->state) ? "resumed" : "negotiated");
+  tls_session_save(conn);
+
   /* set Security Strength Factor (SSF) for SASL */
   /* NB: gnutls_cipher_get_key_size() returns key length in bytes */
   conn->ssf = gnutls_cipher_get_key_size(gnutls_cipher_get(data->state)) * 8;
@@ -0,0 +1,308 @@
+/**
+ * @file
+ * Zlib compression of network traffic
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page conn_zstrm Zlib compression of network traffic
+ *
+ * A raw deflate stream (RFC1951) in each direction, as used by IMAP's
+ * COMPRESS=DEFLATE (RFC4978) and NNTP's COMPRESS DEFLATE (RFC8054).  It sits on top of whatever the Connection was
+ * using, e.g. a plain socket or TLS, and is removed again when the connection
+ * is closed.
+ *
+ * | Function               | Description
+ * | :--------------------- | :-------------------------------------------
+ * | mutt_zstrm_wrap_conn() | Compress a Connection's traffic
+ */
+
+#include "config.h"
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#include "mutt/mutt.h"
+#include "zstrm.h"
+#include "connection.h"
+
+#define ZSTRM_BUFSIZE 8192
+
+/**
+ * struct ZstrmDirection - One direction of a compressed stream
+ */
+struct ZstrmDirection
+{
+  z_stream z;      /**< zlib state */
+  char *buf;       /**< Compressed data */
+  bool pending;    /**< The last inflate() filled its output, so there may be more */
+  bool conn_eof;   /**< The connection below has been closed */
+  bool stream_eof; /**< The deflate stream has ended */
+};
+
+/**
+ * struct ZstrmContext - Compressed stream wrapped around a Connection
+ */
+struct ZstrmContext
+{
+  struct ZstrmDirection read;  /**< Data from the server */
+  struct ZstrmDirection write; /**< Data to the server */
+
+  /* the layer below, e.g. a plain socket, or TLS */
+  void *sockdata;
+  int (*conn_read)(struct Connection *conn, char *buf, size_t len);
+  int (*conn_write)(struct Connection *conn, const char *buf, size_t count);
+  int (*conn_open)(struct Connection *conn);
+  int (*conn_close)(struct Connection *conn);
+  int (*conn_poll)(struct Connection *conn, time_t wait_secs);
+};
+
+/**
+ * zstrm_open - Refuse to reopen a compressed connection
+ * @param conn Connection to a server
+ * @retval -1 Always
+ *
+ * Closing the connection removes the compression, so this can't be called on
+ * a connection that was closed first.
+ */
+static int zstrm_open(struct Connection *conn)
+{
+  return -1;
+}
+
+/**
+ * zstrm_close - Close a compressed connection
+ * @param conn Connection to a server
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * The layer below is restored and closed, so the Connection can be reopened
+ * uncompressed.
+ */
+static int zstrm_close(struct Connection *conn)
+{
+  struct ZstrmContext *zctx = conn->sockdata;
+
+  conn->sockdata = zctx->sockdata;
+  conn->conn_read = zctx->conn_read;
+  conn->conn_write = zctx->conn_write;
+  conn->conn_open = zctx->conn_open;
+  conn->conn_close = zctx->conn_close;
+  conn->conn_poll = zctx->conn_poll;
+
+  int rc = conn->conn_close(conn);
+
+  inflateEnd(&zctx->read.z);
+  deflateEnd(&zctx->write.z);
+  FREE(&zctx->read.buf);
+  FREE(&zctx->write.buf);
+  FREE(&zctx);
+
+  return rc;
+}
+
+/**
+ * zstrm_read - Read and uncompress data from a connection
+ * @param conn Connection to a server
+ * @param buf  Buffer to store the data
+ * @param len  Size of the buffer
+ * @retval >0 Number of bytes read
+ * @retval  0 End of stream
+ * @retval -1 Error
+ */
+static int zstrm_read(struct Connection *conn, char *buf, size_t len)
+{
+  struct ZstrmContext *zctx = conn->sockdata;
+  int rc;
+
+  while (true)
+  {
+    if (zctx->read.stream_eof)
+      return 0;
+
+    /* only read more compressed data if there isn't more output waiting */
+    if ((zctx->read.z.avail_in == 0) && !zctx->read.pending)
+    {
+      if (zctx->read.conn_eof)
+        return 0;
+
+      conn->sockdata = zctx->sockdata;
+      rc = zctx->conn_read(conn, zctx->read.buf, ZSTRM_BUFSIZE);
+      conn->sockdata = zctx;
+      if (rc < 0)
+        return rc;
+      if (rc == 0)
+        zctx->read.conn_eof = true;
+
+      zctx->read.z.next_in = (Bytef *) zctx->read.buf;
+      zctx->read.z.avail_in = rc;
+    }
+
+    zctx->read.z.next_out = (Bytef *) buf;
+    zctx->read.z.avail_out = len;
+
+    int zrc = inflate(&zctx->read.z, Z_SYNC_FLUSH);
+    if ((zrc != Z_OK) && (zrc != Z_BUF_ERROR) && (zrc != Z_STREAM_END))
+    {
+      mutt_debug(1, "inflate failed: %d\n", zrc);
+      return -1;
+    }
+
+    zctx->read.pending = (zctx->read.z.avail_out == 0);
+    if (zrc == Z_STREAM_END)
+      zctx->read.stream_eof = true;
+
+    rc = len - zctx->read.z.avail_out;
+    if (rc > 0)
+      return rc;
+
+    /* no output: inflate() needs more input */
+    if (zctx->read.conn_eof && (zctx->read.z.avail_in == 0))
+      return 0;
+  }
+}
+
+/**
+ * zstrm_poll - Check whether a read would block
+ * @param conn      Connection to a server
+ * @param wait_secs How long to wait for data
+ * @retval >0 There is data to read
+ * @retval  0 Read would block
+ * @retval -1 Connection doesn't support polling
+ */
+static int zstrm_poll(struct Connection *conn, time_t wait_secs)
+{
+  struct ZstrmContext *zctx = conn->sockdata;
+  int rc;
+
+  /* data that's already been received may inflate to something */
+  if ((zctx->read.z.avail_in > 0) || zctx->read.pending)
+    return 1;
+
+  if (!zctx->conn_poll)
+    return -1;
+
+  conn->sockdata = zctx->sockdata;
+  rc = zctx->conn_poll(conn, wait_secs);
+  conn->sockdata = zctx;
+
+  return rc;
+}
+
+/**
+ * zstrm_write - Compress and write data to a connection
+ * @param conn  Connection to a server
+ * @param buf   Data to write
+ * @param count Number of bytes to write
+ * @retval >0 Number of bytes written
+ * @retval -1 Error
+ *
+ * The stream is flushed after every write: each one is a complete command.
+ */
+static int zstrm_write(struct Connection *conn, const char *buf, size_t count)
+{
+  struct ZstrmContext *zctx = conn->sockdata;
+  int rc = 0;
+
+  zctx->write.z.next_in = (Bytef *) buf;
+  zctx->write.z.avail_in = count;
+
+  do
+  {
+    zctx->write.z.next_out = (Bytef *) zctx->write.buf;
+    zctx->write.z.avail_out = ZSTRM_BUFSIZE;
+
+    if (deflate(&zctx->write.z, Z_PARTIAL_FLUSH) == Z_STREAM_ERROR)
+    {
+      mutt_debug(1, "deflate failed\n");
+      return -1;
+    }
+
+    size_t len = ZSTRM_BUFSIZE - zctx->write.z.avail_out;
+    conn->sockdata = zctx->sockdata;
+    for (size_t sent = 0; sent < len; sent += rc)
+    {
+      rc = zctx->conn_write(conn, zctx->write.buf + sent, len - sent);
+      if (rc < 0)
+        break;
+    }
+    conn->sockdata = zctx;
+    if (rc < 0)
+      return -1;
+  } while ((zctx->write.z.avail_in > 0) || (zctx->write.z.avail_out == 0));
+
+  return count;
+}
+
+/**
+ * mutt_zstrm_wrap_conn - Compress a Connection's traffic
+ * @param conn Connection to a server
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * Call this as soon as both ends have agreed to compress.  Anything already
+ * read, but not yet consumed, is assumed to be compressed.
+ */
+int mutt_zstrm_wrap_conn(struct Connection *conn)
+{
+  struct ZstrmContext *zctx = mutt_mem_calloc(1, sizeof(struct ZstrmContext));
+
+  /* negative window bits: a raw deflate stream, without a zlib header */
+  if (inflateInit2(&zctx->read.z, -15) != Z_OK)
+  {
+    FREE(&zctx);
+    return -1;
+  }
+  if (deflateInit2(&zctx->write.z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8,
+                   Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    inflateEnd(&zctx->read.z);
+    FREE(&zctx);
+    return -1;
+  }
+
+  /* compressed data may already be waiting in the input buffer */
+  size_t left = 0;
+  if (conn->bufpos < conn->available)
+    left = conn->available - conn->bufpos;
+
+  zctx->read.buf = mutt_mem_malloc(MAX(left, ZSTRM_BUFSIZE));
+  zctx->write.buf = mutt_mem_malloc(ZSTRM_BUFSIZE);
+
+  if (left)
+  {
+    memcpy(zctx->read.buf, conn->inbuf + conn->bufpos, left);
+    zctx->read.z.next_in = (Bytef *) zctx->read.buf;
+    zctx->read.z.avail_in = left;
+    conn->bufpos = conn->available = 0;
+  }
+
+  zctx->sockdata = conn->sockdata;
+  zctx->conn_read = conn->conn_read;
+  zctx->conn_write = conn->conn_write;
+  zctx->conn_open = conn->conn_open;
+  zctx->conn_close = conn->conn_close;
+  zctx->conn_poll = conn->conn_poll;
+
+  conn->sockdata = zctx;
+  conn->conn_read = zstrm_read;
+  conn->conn_write = zstrm_write;
+  conn->conn_open = zstrm_open;
+  conn->conn_close = zstrm_close;
+  conn->conn_poll = zstrm_poll;
+
+  return 0;
+}
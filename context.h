@@ -48,6 +48,24 @@ enum AclRights
   RIGHTSMAX
 };
 
+/**
+ * struct MsgColumns - The scalar fields of the messages, stored by column
+ *
+ * Row i belongs to the Header at Context.hdrs[i], recorded in hdr[], so a row
+ * left behind by a re-sort or expunge is spotted without reading the Header.
+ * Patterns over dates, sizes and scores scan these arrays instead of chasing
+ * every Header.
+ */
+struct MsgColumns
+{
+  struct Header **hdr; /**< Header each row was copied from */
+  time_t *date_sent;   /**< Header.date_sent */
+  time_t *received;    /**< Header.received */
+  LOFF_T *size;        /**< Header.content->length */
+  int *score;          /**< Header.score */
+  int max;             /**< Number of rows allocated */
+};
+
 /**
  * struct Context - The "current" mailbox
  */
@@ -62,6 +80,7 @@ struct Context
   off_t vsize;
   char *pattern;                 /**< limit pattern string */
   struct Pattern *limit_pattern; /**< compiled limit pattern */
+  int limit_deps;                /**< what the limit depends on, e.g. #MUTT_PAT_DEP_FLAGS */
   struct Header **hdrs;
   struct Header *last_tag;  /**< last tagged msg. used to link threads */
   struct MuttThread *tree;  /**< top of thread tree */
@@ -80,6 +99,9 @@ struct Context
   int flagged;              /**< how many flagged messages */
   int msgnotreadyet;        /**< which msg "new" in pager, -1 if none */
 
+  struct MsgColumns cols; /**< scalar fields of hdrs, for pattern scans */
+  struct AddressIndex *addr_index; /**< distinct addresses of hdrs, for pattern scans */
+
   struct Menu *menu; /**< needed for pattern compilation */
 
   short magic; /**< mailbox type */
@@ -95,11 +117,16 @@ struct Context
   bool collapsed : 1; /**< are all threads collapsed? */
   bool closing : 1;   /**< mailbox is being closed */
   bool peekonly : 1;  /**< just taking a glance, revert atime */
+  bool loading : 1;   /**< not all the messages have been read, see mx_open_more() */
 
 #ifdef USE_COMPRESSED
   void *compress_info; /**< compressed mbox module private data */
 #endif                 /**< USE_COMPRESSED */
 
+#ifdef USE_HCACHE
+  struct SearchIndex *search_index; /**< signatures of the messages' text */
+#endif
+
   /* driver hooks */
   void *data; /**< driver specific data */
   struct MxOps *mx_ops;
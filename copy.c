@@ -773,6 +773,36 @@ int mutt_copy_message_ctx(FILE *fpout, struct Context *src, struct Header *hdr,
   return r;
 }
 
+/**
+ * can_copy_raw - Can a message be copied without rewriting it?
+ * @param dest    destination mailbox
+ * @param src     source mailbox
+ * @param hdr     message being copied
+ * @param flags   mutt_open_copy_message() flags
+ * @param chflags mutt_copy_header() flags
+ * @retval true if the message's bytes can be copied as they are
+ *
+ * Between two maildirs the flags are in the file name, and between two mbox
+ * files the stored Status: is still right, if nothing has changed.  The
+ * header would only be rewritten to end up saying the same thing.
+ */
+static bool can_copy_raw(struct Context *dest, struct Context *src,
+                         struct Header *hdr, int flags, int chflags)
+{
+  if (flags || (chflags & ~CH_UPDATE_LEN))
+    return false;
+  if ((src->magic != dest->magic) ||
+      ((dest->magic != MUTT_MAILDIR) && (dest->magic != MUTT_MBOX)))
+    return false;
+  if ((dest->magic == MUTT_MBOX) && hdr->changed)
+    return false;
+  if (hdr->attach_del || hdr->xlabel_changed || !driver_tags_empty(&hdr->tags))
+    return false;
+  if (hdr->env && (hdr->env->irt_changed || hdr->env->refs_changed))
+    return false;
+  return true;
+}
+
 /**
  * append_message - appends a copy of the given message to a mailbox
  * @param dest    destination mailbox
@@ -789,20 +819,33 @@ static int append_message(struct Context *dest, FILE *fpin, struct Context *src,
 {
   char buf[STRING];
   struct Message *msg = NULL;
+  bool has_from;
   int r;
 
   if (fseeko(fpin, hdr->offset, SEEK_SET) < 0)
     return -1;
   if (fgets(buf, sizeof(buf), fpin) == NULL)
     return -1;
+  has_from = is_from(buf, NULL, 0, NULL);
 
-  msg = mx_open_new_message(dest, hdr, is_from(buf, NULL, 0, NULL) ? 0 : MUTT_ADD_FROM);
+  msg = mx_open_new_message(dest, hdr, has_from ? 0 : MUTT_ADD_FROM);
   if (!msg)
     return -1;
-  if (dest->magic == MUTT_MBOX || dest->magic == MUTT_MMDF)
-    chflags |= CH_FROM | CH_FORCE_FROM;
-  chflags |= (dest->magic == MUTT_MAILDIR ? CH_NOSTATUS : CH_UPDATE);
-  r = mutt_copy_message_fp(msg->fp, fpin, hdr, flags, chflags);
+
+  if (can_copy_raw(dest, src, hdr, flags, chflags) &&
+      ((dest->magic != MUTT_MBOX) || has_from))
+  {
+    /* the whole message, From_ line and all, goes across as it is */
+    r = mutt_file_copy_range(fpin, hdr->offset, msg->fp,
+                             hdr->content->offset + hdr->content->length - hdr->offset);
+  }
+  else
+  {
+    if (dest->magic == MUTT_MBOX || dest->magic == MUTT_MMDF)
+      chflags |= CH_FROM | CH_FORCE_FROM;
+    chflags |= (dest->magic == MUTT_MAILDIR ? CH_NOSTATUS : CH_UPDATE);
+    r = mutt_copy_message_fp(msg->fp, fpin, hdr, flags, chflags);
+  }
   if (mx_commit_message(msg, dest) != 0)
     r = -1;
 
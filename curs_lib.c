@@ -34,6 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/select.h>
 #include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
@@ -127,6 +128,11 @@ struct Event mutt_getch(void)
   if (!OPT_IGNORE_MACRO_EVENTS && MacroBufferCount)
     return MacroEvents[--MacroBufferCount];
 
+#ifdef HAVE_PTHREAD_CREATE
+  /* deliver the results of any jobs before waiting */
+  mutt_worker_complete();
+#endif
+
   SigInt = 0;
 
   mutt_sig_allow_interrupt(1);
@@ -171,6 +177,36 @@ struct Event mutt_getch(void)
   return (ch == ctrl('G') ? err : ret);
 }
 
+/**
+ * mutt_getch_pending - Are there keystrokes waiting to be read?
+ * @retval true mutt_getch() will return an event from a macro or push
+ *
+ * The terminal itself isn't checked.
+ */
+bool mutt_getch_pending(void)
+{
+  return UngetCount || (!OPT_IGNORE_MACRO_EVENTS && MacroBufferCount);
+}
+
+/**
+ * mutt_key_pending - Has the user pressed a key?
+ * @retval true There is keyboard input, or a macro or push, waiting
+ *
+ * Unlike mutt_getch_pending(), the terminal is checked, without blocking.
+ */
+bool mutt_key_pending(void)
+{
+  fd_set rfds;
+  struct timeval tv = { 0, 0 };
+
+  if (mutt_getch_pending())
+    return true;
+
+  FD_ZERO(&rfds);
+  FD_SET(0, &rfds);
+  return select(1, &rfds, NULL, NULL, &tv) > 0;
+}
+
 int mutt_get_field_full(const char *field, char *buf, size_t buflen,
                         int complete, int multiple, char ***files, int *numfiles)
 {
@@ -255,6 +291,10 @@ int mutt_yesorno(const char *msg, int def)
   int reno_ok;
   char answer[2];
 
+  /* Without a screen, there's nobody to answer, so take the default */
+  if (OPT_NO_CURSES)
+    return def;
+
   answer[1] = '\0';
 
   reyes_ok = (expr = nl_langinfo(YESEXPR)) && (expr[0] == '^') &&
@@ -1173,8 +1213,25 @@ void mutt_simple_format(char *buf, size_t buflen, int min_width, int max_width,
   memset(&mbstate2, 0, sizeof(mbstate2));
   buflen--;
   p = buf;
-  for (; n && (k = mbrtowc(&wc, s, n, &mbstate1)); s += k, n -= k)
+  for (; n; s += k, n -= k)
   {
+    /* printable ASCII is copied as it is, one column per byte */
+    if (!escaped && mbsinit(&mbstate1) && mbsinit(&mbstate2) &&
+        (k = mutt_mb_ascii_run(s, n)))
+    {
+      size_t m = (max_width > 0) ? MIN(k, (size_t) max_width) : 0;
+      m = MIN(m, buflen);
+      memcpy(p, s, m);
+      p += m;
+      buflen -= m;
+      min_width -= m;
+      max_width -= m;
+      continue;
+    }
+
+    k = mbrtowc(&wc, s, n, &mbstate1);
+    if (k == 0)
+      break;
     if (k == (size_t)(-1) || k == (size_t)(-2))
     {
       if (k == (size_t)(-1) && errno == EILSEQ)
@@ -1340,8 +1397,22 @@ void mutt_paddstr(int n, const char *s)
   mbstate_t mbstate;
 
   memset(&mbstate, 0, sizeof(mbstate));
-  for (; len && (k = mbrtowc(&wc, s, len, &mbstate)); s += k, len -= k)
+  for (; len; s += k, len -= k)
   {
+    if (mbsinit(&mbstate) && (k = mutt_mb_ascii_run(s, len)))
+    {
+      size_t m = MIN(k, (size_t) MAX(n, 0));
+      if (m > 0)
+        addnstr((char *) s, m);
+      n -= m;
+      if (m < k)
+        break;
+      continue;
+    }
+
+    k = mbrtowc(&wc, s, len, &mbstate);
+    if (k == 0)
+      break;
     if (k == (size_t)(-1) || k == (size_t)(-2))
     {
       if (k == (size_t)(-1))
@@ -1388,8 +1459,25 @@ size_t mutt_wstr_trunc(const char *src, size_t maxlen, size_t maxwid, size_t *wi
   n = mutt_str_strlen(src);
 
   memset(&mbstate, 0, sizeof(mbstate));
-  for (w = 0; n && (cl = mbrtowc(&wc, src, n, &mbstate)); src += cl, n -= cl)
+  for (w = 0; n; src += cl, n -= cl)
   {
+    if (mbsinit(&mbstate) && (cl = mutt_mb_ascii_run(src, n)))
+    {
+      size_t room = MIN(maxlen - l, maxwid - w);
+      if (cl > room)
+      {
+        l += room;
+        w += room;
+        break;
+      }
+      l += cl;
+      w += cl;
+      continue;
+    }
+
+    cl = mbrtowc(&wc, src, n, &mbstate);
+    if (cl == 0)
+      break;
     if (cl == (size_t)(-1) || cl == (size_t)(-2))
     {
       if (cl == (size_t)(-1))
@@ -1438,8 +1526,17 @@ int mutt_strwidth(const char *s)
   n = mutt_str_strlen(s);
 
   memset(&mbstate, 0, sizeof(mbstate));
-  for (w = 0; n && (k = mbrtowc(&wc, s, n, &mbstate)); s += k, n -= k)
+  for (w = 0; n; s += k, n -= k)
   {
+    if (mbsinit(&mbstate) && (k = mutt_mb_ascii_run(s, n)))
+    {
+      w += k;
+      continue;
+    }
+
+    k = mbrtowc(&wc, s, n, &mbstate);
+    if (k == 0)
+      break;
     if (*s == MUTT_SPECIAL_INDEX)
     {
       s += 2; /* skip the index coloring sequence */
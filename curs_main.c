@@ -39,6 +39,7 @@
 #include "format_flags.h"
 #include "globals.h"
 #include "header.h"
+#include "history.h"
 #include "keymap.h"
 #include "mailbox.h"
 #include "mutt_curses.h"
@@ -48,6 +49,7 @@
 #include "opcodes.h"
 #include "options.h"
 #include "pattern.h"
+#include "perf.h"
 #include "protos.h"
 #include "sort.h"
 #include "tags.h"
@@ -148,6 +150,9 @@ static const char *NoVisible = N_("No visible messages.");
 static char *tsl = "\033]0;";
 static char *fsl = "\007";
 
+static bool DeferCounts = false;    /**< Index entries are being drawn while keys are queued */
+static bool CountsDeferred = false; /**< Some entries may show placeholder attachment counts */
+
 /**
  * collapse/uncollapse all threads
  * @param menu   current menu
@@ -305,6 +310,15 @@ static void resort_index(struct Menu *menu)
 {
   struct Header *current = CURHDR;
 
+#ifdef USE_IMAP
+  /* threads are built from every message in the folder */
+  if (((Sort & SORT_MASK) == SORT_THREADS) && (Context->magic == MUTT_IMAP))
+  {
+    imap_window_grow(Context, true);
+    imap_headers_upgrade(Context, true);
+  }
+#endif
+
   menu->current = -1;
   mutt_sort_headers(Context, 0);
   /* Restore the current message */
@@ -327,6 +341,115 @@ static void resort_index(struct Menu *menu)
   menu->redraw |= REDRAW_INDEX | REDRAW_STATUS;
 }
 
+#ifdef USE_IMAP
+/**
+ * index_window_page_in - Read older IMAP headers as they scroll into view
+ * @param menu Index menu
+ *
+ * When the mailbox was opened with $imap_fetch_window, read the next batch of
+ * headers once the oldest message read so far is on the screen.
+ */
+static void index_window_page_in(struct Menu *menu)
+{
+  struct Header *edge = NULL;
+
+  while ((edge = imap_window_edge(Context)) && (edge->virtual >= 0))
+  {
+    menu_check_recenter(menu);
+    if ((edge->virtual < menu->top) || (edge->virtual >= (menu->top + menu->pagelen)))
+      break;
+    if (imap_window_grow(Context, false) < 0)
+      break;
+  }
+}
+#endif
+
+/**
+ * index_open_more - Read more of a mailbox opened with #MUTT_PROGRESSIVE
+ * @param menu Index menu
+ * @param all  If true, read the rest of it; otherwise just the next batch
+ * @retval  0 Success
+ * @retval -1 Failure, the messages read so far are left read-only
+ * @retval -2 Interrupted, the mailbox is still being read
+ * @retval #MUTT_REOPENED The mailbox changed, so it has been read again
+ *
+ * The cursor stays on the same message when the finished mailbox is sorted.
+ * If the last batch is read in the background, and the cursor is still where
+ * the mailbox was opened, it moves to the first new message of the whole
+ * mailbox instead.
+ */
+static int index_open_more(struct Menu *menu, bool all)
+{
+  struct Header *current = NULL;
+
+  if (!Context || !Context->loading)
+    return 0;
+
+  const bool first = (menu->current == ci_first_message());
+  if ((menu->current >= 0) && (menu->current < Context->vcount))
+    current = CURHDR;
+
+  int rc = mx_open_more(Context, all);
+  if (rc == -2)
+    mutt_error(_("Reading from %s interrupted..."), Context->path);
+  else if (rc == MUTT_REOPENED)
+  {
+    /* The old messages are gone */
+    current = NULL;
+    mutt_message(_("Mailbox was externally modified."));
+  }
+
+  menu->max = Context->vcount;
+  if (!Context->loading)
+  {
+    if ((first && !all) || !current || (current->virtual < 0))
+      menu->current = ci_first_message();
+    else
+      menu->current = current->virtual;
+
+    if (((Sort & SORT_MASK) == SORT_THREADS) && CollapseAll)
+      collapse_all(menu, 0);
+  }
+
+  menu->redraw |= REDRAW_INDEX | REDRAW_STATUS;
+  return rc;
+}
+
+/**
+ * index_op_moves - Does a function just move around the index?
+ * @param op Operation, e.g. OP_NEXT_PAGE
+ * @retval true The function can be used while the mailbox is being read
+ */
+static bool index_op_moves(int op)
+{
+  switch (op)
+  {
+    case OP_NULL:
+    case OP_BOTTOM_PAGE:
+    case OP_CURRENT_BOTTOM:
+    case OP_CURRENT_MIDDLE:
+    case OP_CURRENT_TOP:
+    case OP_FIRST_ENTRY:
+    case OP_HALF_DOWN:
+    case OP_HALF_UP:
+    case OP_LAST_ENTRY:
+    case OP_MAIN_NEXT_UNDELETED:
+    case OP_MAIN_PREV_UNDELETED:
+    case OP_MIDDLE_PAGE:
+    case OP_NEXT_ENTRY:
+    case OP_NEXT_LINE:
+    case OP_NEXT_PAGE:
+    case OP_PREV_ENTRY:
+    case OP_PREV_LINE:
+    case OP_PREV_PAGE:
+    case OP_REDRAW:
+    case OP_TOP_PAGE:
+      return true;
+    default:
+      return false;
+  }
+}
+
 void update_index(struct Menu *menu, struct Context *ctx, int check, int oldcount, int index_hint)
 {
   /* store pointers to the newly added messages */
@@ -352,15 +475,17 @@ void update_index(struct Menu *menu, struct Context *ctx, int check, int oldcoun
     for (int i = (check == MUTT_REOPENED) ? 0 : oldcount; i < ctx->msgcount; i++)
     {
       if (!i)
+      {
         ctx->vcount = 0;
+        ctx->vsize = 0;
+      }
 
-      if (mutt_pattern_exec(ctx->limit_pattern, MUTT_MATCH_FULL_ADDRESS, ctx,
-                            ctx->hdrs[i], NULL))
+      /* only the new or changed messages are matched again */
+      if (mutt_limit_match(ctx, ctx->hdrs[i]))
       {
         assert(ctx->vcount < ctx->msgcount);
         ctx->hdrs[i]->virtual = ctx->vcount;
         ctx->v2r[ctx->vcount] = i;
-        ctx->hdrs[i]->limited = true;
         ctx->vcount++;
         struct Body *b = ctx->hdrs[i]->content;
         ctx->vsize += b->length + b->offset - b->hdr_offset;
@@ -400,12 +525,9 @@ void update_index(struct Menu *menu, struct Context *ctx, int check, int oldcoun
     {
       for (int i = 0; i < ctx->msgcount - oldcount; i++)
       {
-        for (int k = 0; k < ctx->msgcount; k++)
-        {
-          struct Header *h = ctx->hdrs[k];
-          if (h == save_new[i] && (!ctx->pattern || h->limited))
-            mutt_uncollapse_thread(ctx, h);
-        }
+        struct Header *h = save_new[i];
+        if (!ctx->pattern || h->limited)
+          mutt_uncollapse_thread(ctx, h);
       }
       FREE(&save_new);
       mutt_set_virtual(ctx);
@@ -495,7 +617,10 @@ static int main_change_folder(struct Menu *menu, int op, char *buf,
   mutt_folder_hook(buf);
 
   Context = mx_open_mailbox(
-      buf, (ReadOnly || (op == OP_MAIN_CHANGE_FOLDER_READONLY)) ? MUTT_READONLY : 0, NULL);
+      buf,
+      MUTT_PROGRESSIVE |
+          ((ReadOnly || (op == OP_MAIN_CHANGE_FOLDER_READONLY)) ? MUTT_READONLY : 0),
+      NULL);
   if (Context)
   {
     menu->current = ci_first_message();
@@ -503,7 +628,8 @@ static int main_change_folder(struct Menu *menu, int op, char *buf,
   else
     menu->current = 0;
 
-  if (((Sort & SORT_MASK) == SORT_THREADS) && CollapseAll)
+  /* The threads are collapsed once they've all been read */
+  if (((Sort & SORT_MASK) == SORT_THREADS) && CollapseAll && Context && !Context->loading)
     collapse_all(menu, 0);
 
 #ifdef USE_SIDEBAR
@@ -606,6 +732,8 @@ void index_make_entry(char *buf, size_t buflen, struct Menu *menu, int num)
     return;
 
   enum FormatFlag flag = MUTT_FORMAT_MAKEPRINT | MUTT_FORMAT_ARROWCURSOR | MUTT_FORMAT_INDEX;
+  if (DeferCounts)
+    flag |= MUTT_FORMAT_NOCOUNT;
   int edgemsgno, reverse = Sort & SORT_REVERSE;
   struct MuttThread *tmp = NULL;
 
@@ -893,6 +1021,11 @@ static void index_menu_redraw(struct Menu *menu)
   }
 
   menu->redraw = 0;
+
+  /* a mailbox that has just been opened is now on screen */
+  if (Context)
+    mutt_perf_fire(PERF_FIRST_DRAW);
+  mutt_perf_fire(PERF_STARTUP);
 }
 
 /**
@@ -935,7 +1068,7 @@ int mutt_index_menu(void)
   if (!attach_msg)
     mutt_buffy_check(true); /* force the buffy check after we enter the folder */
 
-  if (((Sort & SORT_MASK) == SORT_THREADS) && CollapseAll)
+  if (((Sort & SORT_MASK) == SORT_THREADS) && CollapseAll && !(Context && Context->loading))
   {
     collapse_all(menu, 0);
     menu->redraw = REDRAW_FULL;
@@ -951,9 +1084,11 @@ int mutt_index_menu(void)
 
     /* check if we need to resort the index because just about
      * any 'op' below could do mutt_enter_command(), either here or
-     * from any new menu launched, and change $sort/$sort_aux
+     * from any new menu launched, and change $sort/$sort_aux.  A mailbox
+     * that's still being read is sorted once it's finished.
      */
-    if (OPT_NEED_RESORT && Context && Context->msgcount && menu->current >= 0)
+    if (OPT_NEED_RESORT && Context && Context->msgcount && !Context->loading &&
+        menu->current >= 0)
       resort_index(menu);
 
     menu->max = Context ? Context->vcount : 0;
@@ -1068,9 +1203,27 @@ int mutt_index_menu(void)
     if (op >= 0)
       mutt_curs_set(0);
 
+#ifdef USE_IMAP
+    if (Context && (Context->magic == MUTT_IMAP) && (menu->menu == MENU_MAIN))
+      index_window_page_in(menu);
+#endif
+
     if (menu->menu == MENU_MAIN)
     {
+      /* While keys are queued, e.g. the user is holding down <next-entry>,
+       * don't read messages to count their attachments.  Once the keys have
+       * been handled, redraw the index to fill in the counts. */
+      DeferCounts = mutt_key_pending();
+      if (CountsDeferred && !DeferCounts)
+      {
+        menu->redraw |= REDRAW_INDEX;
+        CountsDeferred = false;
+      }
+      if (DeferCounts && menu->redraw)
+        CountsDeferred = true;
+
       index_menu_redraw(menu);
+      DeferCounts = false;
 
       /* give visual indication that the next command is a tag- command */
       if (tag)
@@ -1107,6 +1260,20 @@ int mutt_index_menu(void)
         continue;
       }
 
+#ifdef USE_IMAP
+      /* read the rest of the $imap_index_headers messages' headers while
+       * the user isn't typing */
+      if (Context && (Context->magic == MUTT_IMAP))
+        imap_headers_upgrade(Context, false);
+#endif
+
+      /* read the next batch of a mailbox being opened, between key presses */
+      if (Context && Context->loading && !mutt_key_pending())
+      {
+        index_open_more(menu, false);
+        continue;
+      }
+
       op = km_dokey(MENU_MAIN);
 
       mutt_debug(4, "[%d]: Got op %d\n", __LINE__, op);
@@ -1115,6 +1282,7 @@ int mutt_index_menu(void)
       if (op < 0)
       {
         mutt_timeout_hook();
+        mutt_hist_compact();
         if (tag)
           mutt_window_clearline(MuttMessageWindow, 0);
         continue;
@@ -1179,6 +1347,10 @@ int mutt_index_menu(void)
       nm_debug_check(Context);
 #endif
 
+    /* Anything but moving around needs the whole mailbox */
+    if (Context && Context->loading && !index_op_moves(op) && (index_open_more(menu, true) == -2))
+      continue;
+
     switch (op)
     {
       /* ----------------------------------------------------------------------
@@ -48,7 +48,7 @@
  */
 struct Envelope *mutt_env_new(void)
 {
-  struct Envelope *e = mutt_mem_calloc(1, sizeof(struct Envelope));
+  struct Envelope *e = mutt_mem_tag_calloc(MEM_ENVELOPE, 1, sizeof(struct Envelope));
   STAILQ_INIT(&e->references);
   STAILQ_INIT(&e->in_reply_to);
   STAILQ_INIT(&e->userhdrs);
@@ -93,7 +93,7 @@ void mutt_env_free(struct Envelope **p)
   mutt_list_free(&(*p)->references);
   mutt_list_free(&(*p)->in_reply_to);
   mutt_list_free(&(*p)->userhdrs);
-  FREE(p);
+  mutt_mem_tag_free(MEM_ENVELOPE, p, sizeof(struct Envelope));
 }
 
 /**
@@ -37,7 +37,8 @@ enum FormatFlag
   MUTT_FORMAT_STAT_FILE   = (1 << 4), /**< used by attach_format_str */
   MUTT_FORMAT_ARROWCURSOR = (1 << 5), /**< reserve space for arrow_cursor */
   MUTT_FORMAT_INDEX       = (1 << 6), /**< this is a main index entry */
-  MUTT_FORMAT_NOFILTER    = (1 << 7)  /**< do not allow filtering on this pass */
+  MUTT_FORMAT_NOFILTER    = (1 << 7), /**< do not allow filtering on this pass */
+  MUTT_FORMAT_NOCOUNT     = (1 << 8)  /**< don't read messages to count attachments */
 };
 
 typedef const char *format_t(char *buf, size_t buflen, size_t col, int cols,
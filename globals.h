@@ -55,6 +55,7 @@ WHERE const char *GitVer;
 
 WHERE struct Hash *Groups;
 WHERE struct Hash *ReverseAliases;
+WHERE struct Hash *AliasNames;
 WHERE struct Hash *TagTransforms;
 WHERE struct Hash *TagFormats;
 
@@ -132,6 +133,7 @@ WHERE char *IndexFormat;
 WHERE char *ImapAuthenticators;
 WHERE char *ImapDelimChars;
 WHERE char *ImapHeaders;
+WHERE char *ImapIndexHeaders;
 WHERE char *ImapLogin;
 WHERE char *ImapPass;
 WHERE char *ImapUser;
@@ -142,6 +144,7 @@ WHERE char *MailcapPath;
 WHERE char *Folder;
 #if defined(USE_IMAP) || defined(USE_POP) || defined(USE_NNTP)
 WHERE char *MessageCachedir;
+WHERE short MessageCacheLimit;
 #endif
 #ifdef USE_HCACHE
 WHERE char *HeaderCache;
@@ -199,6 +202,7 @@ WHERE char *QueryFormat;
 WHERE char *RealName;
 WHERE short SearchContext;
 WHERE char *SendCharset;
+WHERE char *SendQueue;
 WHERE char *Sendmail;
 WHERE char *Shell;
 WHERE char *ShowMultipartAlternative;
@@ -232,16 +236,24 @@ WHERE char *HiddenTags;
 #ifdef USE_NNTP
 WHERE short NntpPoll;
 WHERE short NntpContext;
+WHERE short NntpPrefetch;
+WHERE short NntpPrefetchSize;
 #endif
 
 WHERE short DebugLevel;
 WHERE char *DebugFile;
 
+#ifdef USE_COMPRESSED
+WHERE short CompressCache;
+#endif
+
 WHERE short MenuContext;
 WHERE short PagerContext;
 WHERE short PagerIndexLines;
+WHERE short ReadBatch;
 WHERE short ReadInc;
 WHERE short ReflowWrap;
+WHERE short SendQueueRetry;
 WHERE short SendmailWait;
 WHERE short SleepTime;
 WHERE short SkipQuotedOffset;
@@ -259,10 +271,23 @@ WHERE short ScoreThresholdFlag;
 WHERE short SidebarComponentDepth;
 WHERE short SidebarWidth;
 #endif
+#ifdef USE_HCACHE
+WHERE short HeaderCachePrefetch;
+#endif
+WHERE short BrowserStatThreads;
+WHERE short MaildirReadThreads;
+WHERE short SearchReadThreads;
 #ifdef USE_IMAP
+WHERE short ImapFetchConnections;
+WHERE short ImapFetchWindow;
 WHERE short ImapKeepalive;
 WHERE short ImapPipelineDepth;
 WHERE short ImapPollTimeout;
+WHERE short ImapPrefetch;
+WHERE short ImapPrefetchSize;
+#endif
+#ifdef USE_SMTP
+WHERE short SmtpKeepalive;
 #endif
 
 /* -- formerly in pgp.h -- */
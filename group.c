@@ -22,13 +22,165 @@
  */
 
 #include "config.h"
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "mutt/mutt.h"
 #include "group.h"
 #include "address.h"
 #include "globals.h"
 #include "protos.h"
 
+/* Forget the remembered results when there are this many */
+#define ADDRLOOKUP_MEMO_MAX 4096
+
+#define ADDRLOOKUP_NO  ((void *) (intptr_t) 1)
+#define ADDRLOOKUP_YES ((void *) (intptr_t) 2)
+
+/**
+ * struct AddrLookup - Quick lookups in a list of addresses and regexes
+ *
+ * Most groups and alternates are plain addresses.  Those, and regexes that
+ * only match one address, like `^john@example\.com$`, are looked up in a hash.
+ * Only the genuine patterns are run, and the answer for each address is
+ * remembered until the lists change.
+ */
+struct AddrLookup
+{
+  struct Hash *literals;  /**< Addresses that match, ignoring case */
+  struct Regex **regexes; /**< The other patterns, owned by the RegexList */
+  int num_regexes;        /**< Number of regexes */
+  struct Hash *memo;      /**< Results of earlier lookups */
+};
+
+/**
+ * regex_address - Get the address that a regex matches
+ * @param r Regex
+ * @retval ptr  The only address the regex matches, must be freed
+ * @retval NULL The regex is a genuine pattern
+ */
+static char *regex_address(const struct Regex *r)
+{
+  const char *pat = r->pattern;
+  size_t len = mutt_str_strlen(pat);
+
+  /* The hash ignores case, so the regex must too */
+  if (!r->icase || r->not || (len < 3) || (pat[0] != '^') ||
+      (pat[len - 1] != '$') || (pat[len - 2] == '\\'))
+    return NULL;
+
+  bool exact = false;
+  char *middle = mutt_str_substr_dup(pat + 1, pat + len - 1);
+  char *lit = mutt_regex_literal(middle, &exact);
+  FREE(&middle);
+  if (!exact)
+    FREE(&lit);
+  return lit;
+}
+
+/**
+ * addrlookup_new - Build the lookup table for some addresses and regexes
+ * @param as Addresses
+ * @param rs Regexes
+ * @retval ptr New AddrLookup
+ */
+static struct AddrLookup *addrlookup_new(struct Address *as, struct RegexList *rs)
+{
+  struct AddrLookup *idx = mutt_mem_calloc(1, sizeof(struct AddrLookup));
+  idx->literals = mutt_hash_create(32, MUTT_HASH_STRCASECMP | MUTT_HASH_STRDUP_KEYS);
+  idx->memo = mutt_hash_create(256, MUTT_HASH_STRDUP_KEYS);
+
+  for (; as; as = as->next)
+    if (as->mailbox && *as->mailbox && !mutt_hash_find(idx->literals, as->mailbox))
+      mutt_hash_insert(idx->literals, as->mailbox, ADDRLOOKUP_YES);
+
+  int n = 0;
+  for (struct RegexList *rl = rs; rl; rl = rl->next)
+    n++;
+  idx->regexes = mutt_mem_calloc(n ? n : 1, sizeof(struct Regex *));
+
+  for (; rs; rs = rs->next)
+  {
+    if (!rs->regex || !rs->regex->regex)
+      continue;
+    char *lit = regex_address(rs->regex);
+    if (lit)
+    {
+      if (!mutt_hash_find(idx->literals, lit))
+        mutt_hash_insert(idx->literals, lit, ADDRLOOKUP_YES);
+      FREE(&lit);
+    }
+    else
+      idx->regexes[idx->num_regexes++] = rs->regex;
+  }
+
+  return idx;
+}
+
+/**
+ * mutt_addrlookup_free - Free an AddrLookup
+ * @param idx AddrLookup to free
+ *
+ * This must be called whenever the lists it was built from change.
+ */
+void mutt_addrlookup_free(struct AddrLookup **idx)
+{
+  if (!idx || !*idx)
+    return;
+
+  mutt_hash_destroy(&(*idx)->literals);
+  mutt_hash_destroy(&(*idx)->memo);
+  FREE(&(*idx)->regexes);
+  FREE(idx);
+}
+
+/**
+ * mutt_addrlookup_match - Does an address match a list of addresses or regexes?
+ * @param idx Lookup table of the lists, built if it's NULL
+ * @param as  Addresses, compared ignoring case
+ * @param rs  Regexes
+ * @param s   Address to look for
+ * @retval true The address matches
+ */
+bool mutt_addrlookup_match(struct AddrLookup **idx, struct Address *as,
+                           struct RegexList *rs, const char *s)
+{
+  if (!s || (!as && !rs))
+    return false;
+
+  if (!*idx)
+    *idx = addrlookup_new(as, rs);
+  struct AddrLookup *ai = *idx;
+
+  if (!*s)
+    return mutt_regexlist_match(rs, s);
+
+  void *memo = mutt_hash_find(ai->memo, s);
+  if (memo)
+    return (memo == ADDRLOOKUP_YES);
+
+  bool match = mutt_hash_find(ai->literals, s);
+  for (int i = 0; !match && (i < ai->num_regexes); i++)
+  {
+    const struct Regex *r = ai->regexes[i];
+    if (r->literal && !(r->icase ? strcasestr(s, r->literal) : strstr(s, r->literal)))
+      continue;
+    if (regexec(r->regex, s, 0, NULL, 0) == 0)
+    {
+      mutt_debug(5, "%s matches %s\n", s, r->pattern);
+      match = true;
+    }
+  }
+
+  if (ai->memo->count >= ADDRLOOKUP_MEMO_MAX)
+  {
+    mutt_hash_destroy(&ai->memo);
+    ai->memo = mutt_hash_create(256, MUTT_HASH_STRDUP_KEYS);
+  }
+  mutt_hash_insert(ai->memo, s, match ? ADDRLOOKUP_YES : ADDRLOOKUP_NO);
+  return match;
+}
+
 struct Group *mutt_pattern_group(const char *k)
 {
   struct Group *p = NULL;
@@ -53,6 +205,7 @@ static void group_remove(struct Group *g)
   if (!g)
     return;
   mutt_hash_delete(Groups, g->name, g);
+  mutt_addrlookup_free(&g->lookup);
   mutt_addr_free(&g->as);
   mutt_regexlist_free(&g->rs);
   FREE(&g->name);
@@ -112,6 +265,7 @@ static void group_add_addrlist(struct Group *g, struct Address *a)
   for (p = &g->as; *p; p = &((*p)->next))
     ;
 
+  mutt_addrlookup_free(&g->lookup);
   q = mutt_addr_copy_list(a, false);
   q = mutt_remove_xrefs(g->as, q);
   *p = q;
@@ -126,6 +280,7 @@ static int group_remove_addrlist(struct Group *g, struct Address *a)
   if (!a)
     return -1;
 
+  mutt_addrlookup_free(&g->lookup);
   for (p = a; p; p = p->next)
     mutt_addr_remove_from_list(&g->as, p->mailbox);
 
@@ -134,11 +289,13 @@ static int group_remove_addrlist(struct Group *g, struct Address *a)
 
 static int group_add_regex(struct Group *g, const char *s, int flags, struct Buffer *err)
 {
+  mutt_addrlookup_free(&g->lookup);
   return mutt_regexlist_add(&g->rs, s, flags, err);
 }
 
 static int group_remove_regex(struct Group *g, const char *s)
 {
+  mutt_addrlookup_free(&g->lookup);
   return mutt_regexlist_remove(&g->rs, s);
 }
 
@@ -189,15 +346,7 @@ int mutt_group_context_remove_regex(struct GroupContext *ctx, const char *s)
 
 bool mutt_group_match(struct Group *g, const char *s)
 {
-  struct Address *ap = NULL;
-
-  if (s && g)
-  {
-    if (mutt_regexlist_match(g->rs, s))
-      return true;
-    for (ap = g->as; ap; ap = ap->next)
-      if (ap->mailbox && (mutt_str_strcasecmp(s, ap->mailbox) == 0))
-        return true;
-  }
-  return false;
+  if (!s || !g)
+    return false;
+  return mutt_addrlookup_match(&g->lookup, g->as, g->rs, s);
 }
@@ -27,7 +27,9 @@
 #include <stdbool.h>
 
 struct Address;
+struct AddrLookup;
 struct Buffer;
+struct RegexList;
 
 #define MUTT_GROUP   0
 #define MUTT_UNGROUP 1
@@ -40,6 +42,7 @@ struct Group
   struct Address *as;
   struct RegexList *rs;
   char *name;
+  struct AddrLookup *lookup; /**< Lookup table, built when first matched */
 };
 
 /**
@@ -58,6 +61,10 @@ int mutt_group_context_add_regex(struct GroupContext *ctx, const char *s, int fl
 
 bool mutt_group_match(struct Group *g, const char *s);
 
+void mutt_addrlookup_free(struct AddrLookup **idx);
+bool mutt_addrlookup_match(struct AddrLookup **idx, struct Address *as,
+                           struct RegexList *rs, const char *s);
+
 int mutt_group_context_clear(struct GroupContext **ctx);
 int mutt_group_context_remove_regex(struct GroupContext *ctx, const char *s);
 int mutt_group_context_remove_addrlist(struct GroupContext *ctx, struct Address *a);
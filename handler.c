@@ -45,6 +45,7 @@
 #include "ncrypt/ncrypt.h"
 #include "opcodes.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "rfc1524.h"
 #include "rfc3676.h"
@@ -1603,7 +1604,7 @@ void mutt_decode_attachment(struct Body *b, struct State *s)
   }
 
   if (cd != (iconv_t)(-1))
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
 }
 
 /**
@@ -1806,6 +1807,8 @@ int mutt_body_handler(struct Body *b, struct State *s)
   if (!b || !s)
     return -1;
 
+  mutt_trace_begin("mutt_body_handler");
+
   bool plaintext = false;
   handler_t handler = NULL;
   int rc = 0;
@@ -1940,5 +1943,6 @@ int mutt_body_handler(struct Body *b, struct State *s)
     mutt_debug(1, "Bailing on attachment of type %s/%s.\n", TYPE(b), NONULL(b->subtype));
   }
 
+  mutt_trace_end("mutt_body_handler");
   return rc;
 }
@@ -72,6 +72,70 @@ typedef void (*hcache_free_t)(void *ctx, void **data);
 typedef int (*hcache_store_t)(void *ctx, const char *key, size_t keylen,
                               void *data, size_t datalen);
 
+/**
+ * hcache_fetch_many_t - backend-specific routine to fetch several messages' headers
+ * @param ctx     The backend-specific context retrieved via hcache_open
+ * @param keys    Array of message identification strings
+ * @param keylens Lengths of the strings pointed to by keys
+ * @param count   Number of entries in keys, keylens and data
+ * @param data    Array filled with pointers to the messages' headers (or NULL)
+ *
+ * Backends implementing this routine should look up all the keys under a
+ * single transaction or cursor.  Each non-NULL entry of @a data must be
+ * released with hcache_free.
+ */
+typedef void (*hcache_fetch_many_t)(void *ctx, const char **keys,
+                                    const size_t *keylens, size_t count, void **data);
+
+/**
+ * hcache_store_many_t - backend-specific routine to store several messages' headers
+ * @param ctx     The backend-specific context retrieved via hcache_open
+ * @param keys    Array of message identification strings
+ * @param keylens Lengths of the strings pointed to by keys
+ * @param count   Number of entries in keys, keylens, data and dlens
+ * @param data    Array of message headers data
+ * @param dlens   Lengths of the buffers pointed to by data
+ * @retval 0 on success
+ * @retval a backend-specific error code otherwise
+ *
+ * Backends implementing this routine should store all the records under a
+ * single transaction.
+ */
+typedef int (*hcache_store_many_t)(void *ctx, const char **keys, const size_t *keylens,
+                                   size_t count, void **data, const size_t *dlens);
+
+/**
+ * hcache_foreach_cb_t - callback for hcache_foreach
+ * @param key    A message identification string (not NUL-terminated)
+ * @param keylen The length of the string pointed to by key
+ * @param data   Private data passed to hcache_foreach
+ * @retval 0 to continue, non-zero to stop the walk
+ */
+typedef int (*hcache_foreach_cb_t)(const char *key, size_t keylen, void *data);
+
+/**
+ * hcache_foreach_t - backend-specific routine to walk all the keys
+ * @param ctx  The backend-specific context retrieved via hcache_open
+ * @param cb   Function to call for each key
+ * @param data Private data passed to the callback
+ * @retval 0 on success
+ * @retval a backend-specific error code otherwise
+ *
+ * The callback must not modify the database.
+ */
+typedef int (*hcache_foreach_t)(void *ctx, hcache_foreach_cb_t cb, void *data);
+
+/**
+ * hcache_compact_t - backend-specific routine to shrink the database file
+ * @param ctx  The backend-specific context retrieved via hcache_open
+ * @param path The path to the database file
+ * @retval 0 on success
+ * @retval a backend-specific error code otherwise
+ *
+ * This is called just before hcache_close, after records have been deleted.
+ */
+typedef int (*hcache_compact_t)(void *ctx, const char *path);
+
 /**
  * hcache_delete_t - backend-specific routine to delete a message's headers
  * @param ctx    The backend-specific context retrieved via hcache_open
@@ -101,17 +165,26 @@ typedef const char *(*hcache_backend_t)(void);
 
 /**
  * struct HcacheOps - Header Cache API
+ *
+ * The fetch_many and store_many routines are optional.  If a backend doesn't
+ * provide them, the header cache falls back to calling fetch and store for
+ * each key.  The foreach and compact routines are optional too; without
+ * foreach, stale records can't be pruned.
  */
 struct HcacheOps
 {
-  const char       *name;
-  hcache_open_t    open;
-  hcache_fetch_t   fetch;
-  hcache_free_t    free;
-  hcache_store_t   store;
-  hcache_delete_t  delete;
-  hcache_close_t   close;
-  hcache_backend_t backend;
+  const char          *name;
+  hcache_open_t       open;
+  hcache_fetch_t      fetch;
+  hcache_free_t       free;
+  hcache_store_t      store;
+  hcache_delete_t     delete;
+  hcache_close_t      close;
+  hcache_backend_t    backend;
+  hcache_fetch_many_t fetch_many;
+  hcache_store_many_t store_many;
+  hcache_foreach_t    foreach;
+  hcache_compact_t    compact;
 };
 
 #define HCACHE_BACKEND_LIST                                                    \
@@ -122,8 +195,7 @@ struct HcacheOps
   HCACHE_BACKEND(qdbm)                                                         \
   HCACHE_BACKEND(tokyocabinet)
 
-#define HCACHE_BACKEND_OPS(_name)                                              \
-  const struct HcacheOps hcache_##_name##_ops = {                              \
+#define HCACHE_BACKEND_OPS_FIELDS(_name)                                       \
     .name = #_name,                                                            \
     .open = hcache_##_name##_open,                                             \
     .fetch = hcache_##_name##_fetch,                                           \
@@ -131,7 +203,26 @@ struct HcacheOps
     .store = hcache_##_name##_store,                                           \
     .delete = hcache_##_name##_delete,                                         \
     .close = hcache_##_name##_close,                                           \
-    .backend = hcache_##_name##_backend,                                       \
+    .backend = hcache_##_name##_backend,
+
+#define HCACHE_BACKEND_OPS(_name)                                              \
+  const struct HcacheOps hcache_##_name##_ops = {                              \
+    HCACHE_BACKEND_OPS_FIELDS(_name)                                           \
+  };
+
+#define HCACHE_BACKEND_OPS_BATCH(_name, _fetch_many, _store_many)              \
+  const struct HcacheOps hcache_##_name##_ops = {                              \
+    HCACHE_BACKEND_OPS_FIELDS(_name)                                           \
+    .fetch_many = _fetch_many,                                                 \
+    .store_many = _store_many,                                                 \
+  };
+
+#define HCACHE_BACKEND_OPS_FOREACH(_name, _fetch_many, _store_many, _foreach)  \
+  const struct HcacheOps hcache_##_name##_ops = {                              \
+    HCACHE_BACKEND_OPS_FIELDS(_name)                                           \
+    .fetch_many = _fetch_many,                                                 \
+    .store_many = _store_many,                                                 \
+    .foreach = _foreach,                                                       \
   };
 
 #endif /* _MUTT_HCACHE_BACKEND_H */
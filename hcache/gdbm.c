@@ -106,6 +106,39 @@ static int hcache_gdbm_delete(void *ctx, const char *key, size_t keylen)
   return gdbm_delete(db, dkey);
 }
 
+static int hcache_gdbm_foreach(void *ctx, hcache_foreach_cb_t cb, void *data)
+{
+  datum dkey;
+  datum next;
+
+  if (!ctx)
+    return -1;
+
+  GDBM_FILE db = ctx;
+
+  for (dkey = gdbm_firstkey(db); dkey.dptr; dkey = next)
+  {
+    if (cb(dkey.dptr, dkey.dsize, data) != 0)
+    {
+      FREE(&dkey.dptr);
+      break;
+    }
+    next = gdbm_nextkey(db, dkey);
+    FREE(&dkey.dptr);
+  }
+
+  return 0;
+}
+
+static int hcache_gdbm_compact(void *ctx, const char *path)
+{
+  if (!ctx)
+    return -1;
+
+  /* Only possible if we're the writer */
+  return gdbm_reorganize(ctx);
+}
+
 static void hcache_gdbm_close(void **ctx)
 {
   if (!ctx)
@@ -120,4 +153,8 @@ static const char *hcache_gdbm_backend(void)
   return gdbm_version;
 }
 
-HCACHE_BACKEND_OPS(gdbm)
+const struct HcacheOps hcache_gdbm_ops = {
+  HCACHE_BACKEND_OPS_FIELDS(gdbm)
+  .foreach = hcache_gdbm_foreach,
+  .compact = hcache_gdbm_compact,
+};
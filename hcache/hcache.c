@@ -39,6 +39,7 @@
 #endif
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -56,10 +57,48 @@
 #include "hcache.h"
 #include "hcache/hcversion.h"
 #include "header.h"
+#include "mutt.h"
+#include "perf.h"
 #include "protos.h"
 #include "tags.h"
 
 static unsigned int hcachever = 0x0;
+static unsigned int attachver = 0x0; /**< see attach_version() */
+
+/* Maximum number of records handed to the backend in one batch */
+#define HCACHE_BATCH_SIZE 256
+
+/**
+ * struct HcacheBatch - Scratch space for a batch of backend keys and records
+ */
+struct HcacheBatch
+{
+  char path[HCACHE_BATCH_SIZE][_POSIX_PATH_MAX];
+  const char *keys[HCACHE_BATCH_SIZE];
+  size_t keylens[HCACHE_BATCH_SIZE];
+  void *data[HCACHE_BATCH_SIZE];
+  size_t dlens[HCACHE_BATCH_SIZE];
+};
+
+/**
+ * struct HcacheStats - Header cache usage counters
+ */
+struct HcacheStats
+{
+  unsigned long fetches;       /**< Header records looked up */
+  unsigned long hits;          /**< Lookups that found a valid record */
+  unsigned long stale;         /**< Records rejected by crc_matches() */
+  unsigned long stores;        /**< Header records stored */
+  unsigned long long bytes_in; /**< Bytes serialised by hcache_dump() */
+};
+
+/* Counters of all the header caches closed so far */
+static struct HcacheStats HcacheTotals;
+
+/* Restores aren't tied to a header cache, so they're only counted globally */
+static unsigned long HcacheRestores = 0;
+static unsigned long long HcacheBytesRestored = 0;
+static unsigned long long HcacheRestoreUsecs = 0;
 
 /**
  * struct HeaderCache - header cache structure
@@ -74,6 +113,12 @@ struct HeaderCache
   char *folder;
   unsigned int crc;
   void *ctx;
+  struct HcacheBatch *queue; /**< Records waiting to be written */
+  size_t queued;             /**< Number of records in the queue */
+  struct HcacheStats stats;  /**< Usage counters */
+  char *path;                /**< Database file */
+  bool shared;               /**< The file holds other folders too */
+  bool compact;              /**< Many records were pruned, shrink the file */
 };
 
 /**
@@ -148,25 +193,70 @@ static void lazy_realloc(void *ptr, size_t siz)
   mutt_mem_realloc(ptr, siz);
 }
 
+/**
+ * dump_int - Serialise an unsigned int
+ * @param i   Number to store
+ * @param d   Record buffer
+ * @param off Offset into the record buffer
+ * @retval ptr (Possibly reallocated) record buffer
+ *
+ * The number is stored as a LEB128 varint: seven bits per byte, least
+ * significant group first, with the top bit set on all but the last byte.
+ * Most of the lengths and counters in a record fit in a single byte.
+ */
 static unsigned char *dump_int(unsigned int i, unsigned char *d, int *off)
 {
-  lazy_realloc(&d, *off + sizeof(int));
-  memcpy(d + *off, &i, sizeof(int));
-  (*off) += sizeof(int);
+  lazy_realloc(&d, *off + 5);
+  do
+  {
+    unsigned char c = i & 0x7f;
+    i >>= 7;
+    if (i)
+      c |= 0x80;
+    d[(*off)++] = c;
+  } while (i);
 
   return d;
 }
 
+/**
+ * restore_int - Read an unsigned int written by dump_int()
+ * @param i   Number to restore
+ * @param d   Record buffer
+ * @param off Offset into the record buffer
+ */
 static void restore_int(unsigned int *i, const unsigned char *d, int *off)
 {
-  memcpy(i, d + *off, sizeof(int));
-  (*off) += sizeof(int);
+  unsigned int val = 0;
+  unsigned char c;
+  int shift = 0;
+
+  do
+  {
+    c = d[(*off)++];
+    val |= (unsigned int) (c & 0x7f) << shift;
+    shift += 7;
+  } while ((c & 0x80) && (shift < 35));
+
+  *i = val;
 }
 
+/**
+ * dump_char_size - Serialise a string
+ * @param c       String to store
+ * @param d       Record buffer
+ * @param off     Offset into the record buffer
+ * @param size    Size of the string, including the terminating NUL
+ * @param convert If true, convert the string to UTF-8
+ * @retval ptr (Possibly reallocated) record buffer
+ *
+ * The size is stored first (0 for a NULL string), followed by the string
+ * without its terminating NUL, which restore_char() adds back.
+ */
 static unsigned char *dump_char_size(char *c, unsigned char *d, int *off,
                                      ssize_t size, bool convert)
 {
-  char *p = c;
+  char *p = NULL;
 
   if (!c)
   {
@@ -187,11 +277,10 @@ static unsigned char *dump_char_size(char *c, unsigned char *d, int *off,
 
   d = dump_int(size, d, off);
   lazy_realloc(&d, *off + size);
-  memcpy(d + *off, p, size);
-  *off += size;
+  memcpy(d + *off, c, size - 1);
+  *off += size - 1;
 
-  if (p != c)
-    FREE(&p);
+  FREE(&p);
 
   return d;
 }
@@ -212,29 +301,25 @@ static void restore_char(char **c, const unsigned char *d, int *off, bool conver
     return;
   }
 
+  /* The string is copied straight out of the backend's record (for LMDB, the
+   * mapped page).  If it needs converting, mutt_ch_convert_string() replaces
+   * the copy in place; on failure the unconverted copy is kept. */
   *c = mutt_mem_malloc(size);
-  memcpy(*c, d + *off, size);
-  if (convert && !mutt_str_is_ascii(*c, size))
-  {
-    char *tmp = mutt_str_strdup(*c);
-    if (mutt_ch_convert_string(&tmp, "utf-8", Charset, 0) == 0)
-    {
-      mutt_str_replace(c, tmp);
-    }
-    else
-    {
-      FREE(&tmp);
-    }
-  }
-  *off += size;
+  memcpy(*c, d + *off, size - 1);
+  (*c)[size - 1] = '\0';
+  if (convert && !mutt_str_is_ascii((const char *) d + *off, size - 1))
+    mutt_ch_convert_string(c, "utf-8", Charset, 0);
+  *off += size - 1;
 }
 
 static unsigned char *dump_address(struct Address *a, unsigned char *d, int *off, bool convert)
 {
   unsigned int counter = 0;
-  unsigned int start_off = *off;
 
-  d = dump_int(0xdeadbeef, d, off);
+  for (struct Address *p = a; p; p = p->next)
+    counter++;
+
+  d = dump_int(counter, d, off);
 
   while (a)
   {
@@ -242,11 +327,8 @@ static unsigned char *dump_address(struct Address *a, unsigned char *d, int *off
     d = dump_char(a->mailbox, d, off, false);
     d = dump_int(a->group, d, off);
     a = a->next;
-    counter++;
   }
 
-  memcpy(d + start_off, &counter, sizeof(int));
-
   return d;
 }
 
@@ -272,18 +354,19 @@ static void restore_address(struct Address **a, const unsigned char *d, int *off
 static unsigned char *dump_stailq(struct ListHead *l, unsigned char *d, int *off, bool convert)
 {
   unsigned int counter = 0;
-  unsigned int start_off = *off;
-
-  d = dump_int(0xdeadbeef, d, off);
 
   struct ListNode *np;
   STAILQ_FOREACH(np, l, entries)
   {
-    d = dump_char(np->data, d, off, convert);
     counter++;
   }
 
-  memcpy(d + start_off, &counter, sizeof(int));
+  d = dump_int(counter, d, off);
+
+  STAILQ_FOREACH(np, l, entries)
+  {
+    d = dump_char(np->data, d, off, convert);
+  }
 
   return d;
 }
@@ -346,19 +429,20 @@ static unsigned char *dump_parameter(struct ParameterList *p, unsigned char *d,
                                      int *off, bool convert)
 {
   unsigned int counter = 0;
-  unsigned int start_off = *off;
-
-  d = dump_int(0xdeadbeef, d, off);
 
   struct Parameter *np;
   TAILQ_FOREACH(np, p, entries)
   {
-    d = dump_char(np->attribute, d, off, false);
-    d = dump_char(np->value, d, off, convert);
     counter++;
   }
 
-  memcpy(d + start_off, &counter, sizeof(int));
+  d = dump_int(counter, d, off);
+
+  TAILQ_FOREACH(np, p, entries)
+  {
+    d = dump_char(np->attribute, d, off, false);
+    d = dump_char(np->value, d, off, convert);
+  }
 
   return d;
 }
@@ -394,6 +478,7 @@ static unsigned char *dump_body(struct Body *c, unsigned char *d, int *off, bool
   nb.parts = NULL;
   nb.hdr = NULL;
   nb.aptr = NULL;
+  nb.verified = NULL;
 
   lazy_realloc(&d, *off + sizeof(struct Body));
   memcpy(d + *off, &nb, sizeof(struct Body));
@@ -510,13 +595,13 @@ static void restore_envelope(struct Envelope *e, const unsigned char *d, int *of
 
 static int crc_matches(const char *d, unsigned int crc)
 {
-  int off = sizeof(union Validate);
   unsigned int mycrc = 0;
 
   if (!d)
     return 0;
 
-  restore_int(&mycrc, (unsigned char *) d, &off);
+  /* The crc is kept at a fixed offset, so it can be checked cheaply */
+  memcpy(&mycrc, d + sizeof(union Validate), sizeof(unsigned int));
 
   return (crc == mycrc);
 }
@@ -617,6 +702,40 @@ static const char *hcache_per_folder(const char *path, const char *folder, hcach
   return hcpath;
 }
 
+/**
+ * attach_version - Fingerprint the attachment counting rules
+ * @retval num Hash of the `attachments` lists
+ *
+ * A cached attachment count is only trusted if it was counted under the same
+ * rules.
+ */
+static unsigned int attach_version(void)
+{
+  struct ListHead *lists[] = { &AttachAllow, &AttachExclude, &InlineAllow, &InlineExclude };
+  union {
+    unsigned char charval[16];
+    unsigned int intval;
+  } digest;
+  struct Md5Ctx ctx;
+  struct ListNode *np = NULL;
+
+  mutt_md5_init_ctx(&ctx);
+  for (size_t i = 0; i < mutt_array_size(lists); i++)
+  {
+    STAILQ_FOREACH(np, lists[i], entries)
+    {
+      struct AttachMatch *a = (struct AttachMatch *) np->data;
+      mutt_md5_process(NONULL(a->major), &ctx);
+      mutt_md5_process_bytes("/", 1, &ctx);
+      mutt_md5_process(NONULL(a->minor), &ctx);
+      mutt_md5_process_bytes("\n", 1, &ctx);
+    }
+    mutt_md5_process_bytes("|", 1, &ctx);
+  }
+  mutt_md5_finish_ctx(&ctx, digest.charval);
+  return digest.intval;
+}
+
 /**
  * hcache_dump - Serialise a Header object
  *
@@ -643,7 +762,9 @@ static void *hcache_dump(header_cache_t *h, struct Header *header, int *off,
     memcpy(d, &uidvalidity, sizeof(uidvalidity));
   *off += sizeof(union Validate);
 
-  d = dump_int(h->crc, d, off);
+  lazy_realloc(&d, *off + sizeof(unsigned int));
+  memcpy(d + *off, &h->crc, sizeof(unsigned int));
+  *off += sizeof(unsigned int);
 
   lazy_realloc(&d, *off + sizeof(struct Header));
   memcpy(&nh, header, sizeof(struct Header));
@@ -657,14 +778,15 @@ static void *hcache_dump(header_cache_t *h, struct Header *header, int *off,
   nh.matched = false;
   nh.collapsed = false;
   nh.limited = false;
+  nh.limit_valid = false;
   nh.num_hidden = 0;
   nh.recipient = 0;
   nh.pair = 0;
-  nh.attach_valid = false;
+  nh.attach_new = false;
   nh.path = NULL;
   nh.tree = NULL;
   nh.thread = NULL;
-  STAILQ_INIT(&nh.tags);
+  driver_tags_init(&nh.tags);
 #ifdef MIXMASTER
   STAILQ_INIT(&nh.chain);
 #endif
@@ -678,6 +800,8 @@ static void *hcache_dump(header_cache_t *h, struct Header *header, int *off,
   d = dump_envelope(nh.env, d, off, convert);
   d = dump_body(nh.content, d, off, convert);
   d = dump_char(nh.maildir_flags, d, off, convert);
+  /* The attachment count is kept, together with the rules it was counted by */
+  d = dump_int(nh.attach_valid ? attachver : 0, d, off);
 
   return d;
 }
@@ -687,6 +811,9 @@ struct Header *mutt_hcache_restore(const unsigned char *d)
   int off = 0;
   struct Header *h = mutt_new_header();
   bool convert = !Charset_is_utf8;
+  struct PerfTimer perf;
+
+  mutt_perf_start(&perf, PERF_HCACHE_RESTORE);
 
   /* skip validate */
   off += sizeof(union Validate);
@@ -705,9 +832,41 @@ struct Header *mutt_hcache_restore(const unsigned char *d)
 
   restore_char(&h->maildir_flags, d, &off, convert);
 
+  unsigned int ver = 0;
+  restore_int(&ver, d, &off);
+  if (ver != attachver)
+    h->attach_valid = false;
+
+  HcacheRestores++;
+  HcacheBytesRestored += off;
+  HcacheRestoreUsecs += mutt_perf_stop(&perf);
+
   return h;
 }
 
+void mutt_hcache_restore_summary(const unsigned char *d, struct Header *h)
+{
+  /* skip validate and crc */
+  memcpy(h, d + sizeof(union Validate) + sizeof(unsigned int), sizeof(struct Header));
+
+  /* The pointers are only meaningful to the process which stored the record */
+  h->env = NULL;
+  h->content = NULL;
+  h->path = NULL;
+  h->tree = NULL;
+  h->thread = NULL;
+  h->maildir_flags = NULL;
+  h->attach_valid = false;
+  driver_tags_init(&h->tags);
+#ifdef MIXMASTER
+  STAILQ_INIT(&h->chain);
+#endif
+#if defined(USE_POP) || defined(USE_IMAP) || defined(USE_NNTP) || defined(USE_NOTMUCH)
+  h->data = NULL;
+  h->free_cb = NULL;
+#endif
+}
+
 static char *get_foldername(const char *folder)
 {
   char *p = NULL;
@@ -724,6 +883,39 @@ static char *get_foldername(const char *folder)
   return p;
 }
 
+void mutt_hcache_prefetch(const char *path, const char *folder, hcache_namer_t namer)
+{
+#ifdef POSIX_FADV_WILLNEED
+  struct stat sb;
+
+  if ((HeaderCachePrefetch <= 0) || !path || (path[0] == '\0') || !hcache_get_ops())
+    return;
+
+  char *name = get_foldername(folder);
+  const char *hcpath = hcache_per_folder(path, name, namer);
+
+  if ((stat(hcpath, &sb) != 0) || !S_ISREG(sb.st_mode) ||
+      (sb.st_size < (off_t) HeaderCachePrefetch * 1024 * 1024))
+  {
+    FREE(&name);
+    return;
+  }
+
+  int fd = open(hcpath, O_RDONLY);
+  if (fd >= 0)
+  {
+    /* The kernel reads the file in the background; this doesn't block */
+    int rc = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+    if (rc != 0)
+      mutt_debug(1, "posix_fadvise %s: %s\n", hcpath, strerror(rc));
+    else
+      mutt_debug(2, "prefetching %s, %lld bytes\n", hcpath, (long long) sb.st_size);
+    close(fd);
+  }
+  FREE(&name);
+#endif
+}
+
 header_cache_t *mutt_hcache_open(const char *path, const char *folder, hcache_namer_t namer)
 {
   const struct HcacheOps *ops = hcache_get_ops();
@@ -768,6 +960,9 @@ header_cache_t *mutt_hcache_open(const char *path, const char *folder, hcache_na
     hcachever = digest.intval;
   }
 
+  /* The attachments command may have changed the rules since the last open */
+  attachver = attach_version();
+
   h->folder = get_foldername(folder);
   h->crc = hcachever;
 
@@ -778,20 +973,33 @@ header_cache_t *mutt_hcache_open(const char *path, const char *folder, hcache_na
     return NULL;
   }
 
-  path = hcache_per_folder(path, h->folder, namer);
+  const char *hcpath = hcache_per_folder(path, h->folder, namer);
+  /* A single file holds the records of all the folders */
+  h->shared = (mutt_str_strcmp(hcpath, path) == 0);
+  path = hcpath;
+  h->path = mutt_str_strdup(path);
 
+  errno = 0;
   h->ctx = ops->open(path);
   if (h->ctx)
     return h;
   else
   {
+    /* The file may be locked by another instance of NeoMutt.
+     * Don't destroy a cache that's in use. */
+    bool busy = (errno == EAGAIN) || (errno == EWOULDBLOCK) ||
+                (errno == EBUSY) || (errno == EACCES);
+    if (busy)
+      mutt_debug(1, "hcache %s is busy: %s\n", path, strerror(errno));
+
     /* remove a possibly incompatible version */
-    if (unlink(path) == 0)
+    if (!busy && (unlink(path) == 0))
     {
       h->ctx = ops->open(path);
       if (h->ctx)
         return h;
     }
+    FREE(&h->path);
     FREE(&h->folder);
     FREE(&h);
 
@@ -799,13 +1007,86 @@ header_cache_t *mutt_hcache_open(const char *path, const char *folder, hcache_na
   }
 }
 
+/**
+ * hcache_flush - Write the queued records to the backend
+ * @param h Header cache
+ * @retval 0 Success
+ * @retval num A generic or backend-specific error code
+ *
+ * The whole queue is handed over at once, so that backends which support it
+ * can store it under a single transaction.
+ */
+static int hcache_flush(header_cache_t *h)
+{
+  const struct HcacheOps *ops = hcache_get_ops();
+  struct HcacheBatch *q = h->queue;
+  int rc = 0;
+
+  if (!q)
+    return 0;
+
+  if (ops->store_many)
+    rc = ops->store_many(h->ctx, q->keys, q->keylens, h->queued, q->data, q->dlens);
+  else
+  {
+    for (size_t i = 0; i < h->queued; i++)
+    {
+      int r = ops->store(h->ctx, q->keys[i], q->keylens[i], q->data[i], q->dlens[i]);
+      if (r && !rc)
+        rc = r;
+    }
+  }
+
+  if (rc)
+    mutt_debug(1, "hcache: storing %zu queued records failed: %d\n", h->queued, rc);
+
+  for (size_t i = 0; i < h->queued; i++)
+  {
+    mutt_mem_account(MEM_HCACHE, -(long long) q->dlens[i]);
+    FREE(&q->data[i]);
+  }
+  mutt_mem_tag_free(MEM_HCACHE, &h->queue, sizeof(struct HcacheBatch));
+  h->queued = 0;
+
+  return rc;
+}
+
+/**
+ * hcache_is_queued - Is a record waiting to be written?
+ * @param h   Header cache
+ * @param key Backend key (including the folder)
+ * @retval true The key is in the write queue
+ */
+static bool hcache_is_queued(header_cache_t *h, const char *key)
+{
+  for (size_t i = 0; h->queue && (i < h->queued); i++)
+    if (strcmp(h->queue->keys[i], key) == 0)
+      return true;
+
+  return false;
+}
+
 void mutt_hcache_close(header_cache_t *h)
 {
   const struct HcacheOps *ops = hcache_get_ops();
   if (!h || !ops)
     return;
 
+  hcache_flush(h);
+  if (h->compact && ops->compact && (ops->compact(h->ctx, h->path) == 0))
+    mutt_debug(2, "hcache %s: compacted\n", h->path);
   ops->close(&h->ctx);
+
+  mutt_debug(2, "hcache %s: %lu fetches, %lu hits, %lu stale, %lu stores, %llu bytes stored\n",
+             h->folder, h->stats.fetches, h->stats.hits, h->stats.stale,
+             h->stats.stores, h->stats.bytes_in);
+  HcacheTotals.fetches += h->stats.fetches;
+  HcacheTotals.hits += h->stats.hits;
+  HcacheTotals.stale += h->stats.stale;
+  HcacheTotals.stores += h->stats.stores;
+  HcacheTotals.bytes_in += h->stats.bytes_in;
+
+  FREE(&h->path);
   FREE(&h->folder);
   FREE(&h);
 }
@@ -814,6 +1095,10 @@ void *mutt_hcache_fetch(header_cache_t *h, const char *key, size_t keylen)
 {
   void *data = NULL;
 
+  if (!h)
+    return NULL;
+
+  h->stats.fetches++;
   data = mutt_hcache_fetch_raw(h, key, keylen);
   if (!data)
   {
@@ -822,13 +1107,82 @@ void *mutt_hcache_fetch(header_cache_t *h, const char *key, size_t keylen)
 
   if (!crc_matches(data, h->crc))
   {
+    h->stats.stale++;
     mutt_hcache_free(h, &data);
     return NULL;
   }
 
+  h->stats.hits++;
   return data;
 }
 
+/**
+ * batch_keys - Prefix a batch of keys with the folder name
+ * @param h     Header cache
+ * @param b     Batch to fill
+ * @param keys  Message identification strings
+ * @param count Number of keys (at most HCACHE_BATCH_SIZE)
+ */
+static void batch_keys(header_cache_t *h, struct HcacheBatch *b, const char **keys, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    b->keylens[i] = snprintf(b->path[i], sizeof(b->path[i]), "%s%s", h->folder, keys[i]);
+    b->keys[i] = b->path[i];
+  }
+}
+
+size_t mutt_hcache_fetch_many(header_cache_t *h, const char **keys, size_t count, void **data)
+{
+  const struct HcacheOps *ops = hcache_get_ops();
+  size_t found = 0;
+
+  if (!h || !ops)
+  {
+    memset(data, 0, count * sizeof(void *));
+    return 0;
+  }
+
+  /* Make sure the queued records can be found */
+  hcache_flush(h);
+
+  struct HcacheBatch *b = mutt_mem_tag_calloc(MEM_HCACHE, 1, sizeof(struct HcacheBatch));
+
+  for (size_t start = 0; start < count; start += HCACHE_BATCH_SIZE)
+  {
+    size_t n = MIN(count - start, HCACHE_BATCH_SIZE);
+    void **d = data + start;
+
+    batch_keys(h, b, keys + start, n);
+
+    if (ops->fetch_many)
+      ops->fetch_many(h->ctx, b->keys, b->keylens, n, d);
+    else
+    {
+      for (size_t i = 0; i < n; i++)
+        d[i] = ops->fetch(h->ctx, b->keys[i], b->keylens[i]);
+    }
+
+    for (size_t i = 0; i < n; i++)
+    {
+      if (!d[i])
+        continue;
+      if (crc_matches(d[i], h->crc))
+        found++;
+      else
+      {
+        h->stats.stale++;
+        mutt_hcache_free(h, &d[i]);
+      }
+    }
+  }
+
+  mutt_mem_tag_free(MEM_HCACHE, &b, sizeof(struct HcacheBatch));
+  h->stats.fetches += count;
+  h->stats.hits += found;
+  return found;
+}
+
 void *mutt_hcache_fetch_raw(header_cache_t *h, const char *key, size_t keylen)
 {
   char path[_POSIX_PATH_MAX];
@@ -839,6 +1193,9 @@ void *mutt_hcache_fetch_raw(header_cache_t *h, const char *key, size_t keylen)
 
   keylen = snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
+  if (hcache_is_queued(h, path))
+    hcache_flush(h);
+
   return ops->fetch(h->ctx, path, keylen);
 }
 
@@ -855,19 +1212,36 @@ void mutt_hcache_free(header_cache_t *h, void **data)
 int mutt_hcache_store(header_cache_t *h, const char *key, size_t keylen,
                       struct Header *header, unsigned int uidvalidity)
 {
-  char *data = NULL;
+  char path[_POSIX_PATH_MAX];
   int dlen;
-  int ret;
 
-  if (!h)
+  if (!h || !hcache_get_ops())
     return -1;
 
-  data = hcache_dump(h, header, &dlen, uidvalidity);
-  ret = mutt_hcache_store_raw(h, key, keylen, data, dlen);
+  snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
-  FREE(&data);
+  /* A newer version replaces the queued one */
+  if (hcache_is_queued(h, path))
+    hcache_flush(h);
 
-  return ret;
+  /* Defer the write, so that many records share one transaction */
+  if (!h->queue)
+    h->queue = mutt_mem_tag_calloc(MEM_HCACHE, 1, sizeof(struct HcacheBatch));
+
+  struct HcacheBatch *q = h->queue;
+  size_t n = h->queued++;
+  q->keylens[n] = mutt_str_strfcpy(q->path[n], path, sizeof(q->path[n]));
+  q->keys[n] = q->path[n];
+  q->data[n] = hcache_dump(h, header, &dlen, uidvalidity);
+  q->dlens[n] = dlen;
+  mutt_mem_account(MEM_HCACHE, dlen);
+  h->stats.stores++;
+  h->stats.bytes_in += dlen;
+
+  if (h->queued == HCACHE_BATCH_SIZE)
+    return hcache_flush(h);
+
+  return 0;
 }
 
 int mutt_hcache_store_raw(header_cache_t *h, const char *key, size_t keylen,
@@ -881,9 +1255,63 @@ int mutt_hcache_store_raw(header_cache_t *h, const char *key, size_t keylen,
 
   keylen = snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
+  if (hcache_is_queued(h, path))
+    hcache_flush(h);
+
   return ops->store(h->ctx, path, keylen, data, dlen);
 }
 
+int mutt_hcache_store_many(header_cache_t *h, const char **keys, size_t count,
+                           struct Header **headers, unsigned int uidvalidity)
+{
+  const struct HcacheOps *ops = hcache_get_ops();
+  int ret = 0;
+
+  if (!h || !ops)
+    return -1;
+
+  hcache_flush(h);
+
+  struct HcacheBatch *b = mutt_mem_tag_calloc(MEM_HCACHE, 1, sizeof(struct HcacheBatch));
+
+  for (size_t start = 0; start < count; start += HCACHE_BATCH_SIZE)
+  {
+    size_t n = MIN(count - start, HCACHE_BATCH_SIZE);
+    int rc = 0;
+
+    batch_keys(h, b, keys + start, n);
+    for (size_t i = 0; i < n; i++)
+    {
+      int dlen;
+      b->data[i] = hcache_dump(h, headers[start + i], &dlen, uidvalidity);
+      b->dlens[i] = dlen;
+      h->stats.bytes_in += dlen;
+    }
+    h->stats.stores += n;
+
+    if (ops->store_many)
+      rc = ops->store_many(h->ctx, b->keys, b->keylens, n, b->data, b->dlens);
+    else
+    {
+      for (size_t i = 0; i < n; i++)
+      {
+        int r = ops->store(h->ctx, b->keys[i], b->keylens[i], b->data[i], b->dlens[i]);
+        if (r && !rc)
+          rc = r;
+      }
+    }
+
+    if (rc && !ret)
+      ret = rc;
+
+    for (size_t i = 0; i < n; i++)
+      FREE(&b->data[i]);
+  }
+
+  mutt_mem_tag_free(MEM_HCACHE, &b, sizeof(struct HcacheBatch));
+  return ret;
+}
+
 int mutt_hcache_delete(header_cache_t *h, const char *key, size_t keylen)
 {
   char path[_POSIX_PATH_MAX];
@@ -894,9 +1322,102 @@ int mutt_hcache_delete(header_cache_t *h, const char *key, size_t keylen)
 
   keylen = snprintf(path, sizeof(path), "%s%s", h->folder, key);
 
+  if (hcache_is_queued(h, path))
+    hcache_flush(h);
+
   return ops->delete (h->ctx, path, keylen);
 }
 
+/**
+ * struct HcachePrune - Keys collected by mutt_hcache_prune()
+ */
+struct HcachePrune
+{
+  header_cache_t *h;
+  hcache_keep_t keep;    /**< Caller's predicate */
+  void *data;            /**< Caller's private data */
+  size_t folderlen;      /**< Length of the folder prefix */
+  size_t total;          /**< Number of keys in the file */
+  struct ListHead stale; /**< Backend keys to delete */
+};
+
+/* Compact the file once at least 1/HCACHE_COMPACT_DIVISOR of its records
+ * have been pruned at once.  The backends reuse the space of a few. */
+#define HCACHE_COMPACT_DIVISOR 4
+
+/**
+ * prune_collect - Remember a key if the caller doesn't want it any more
+ * @param key    Backend key
+ * @param keylen Length of the key
+ * @param data   Pruning state
+ * @retval 0 Always, to walk all the keys
+ */
+static int prune_collect(const char *key, size_t keylen, void *data)
+{
+  struct HcachePrune *p = data;
+  char buf[_POSIX_PATH_MAX];
+
+  p->total++;
+  if ((keylen < p->folderlen) || (keylen - p->folderlen >= sizeof(buf)) ||
+      (memcmp(key, p->h->folder, p->folderlen) != 0))
+  {
+    return 0;
+  }
+
+  size_t len = keylen - p->folderlen;
+  memcpy(buf, key + p->folderlen, len);
+  buf[len] = '\0';
+
+  if (!p->keep(buf, len, p->data))
+    mutt_list_insert_tail(&p->stale, mutt_str_substr_dup(key, key + keylen));
+
+  return 0;
+}
+
+int mutt_hcache_prune(header_cache_t *h, hcache_keep_t keep, void *data)
+{
+  const struct HcacheOps *ops = hcache_get_ops();
+  struct HcachePrune p = { h, keep, data, 0, 0, STAILQ_HEAD_INITIALIZER(p.stale) };
+  struct ListNode *np = NULL;
+  int count = 0;
+
+  if (!h || !ops || !keep || !ops->foreach)
+    return -1;
+
+  /* Other folders' keys may start with our folder name */
+  if (h->shared)
+  {
+    mutt_debug(2, "hcache %s is shared by several folders, not pruning\n", h->path);
+    return -1;
+  }
+
+  hcache_flush(h);
+
+  /* Collect first: backends don't like being modified during a walk */
+  p.folderlen = mutt_str_strlen(h->folder);
+  if (ops->foreach(h->ctx, prune_collect, &p) != 0)
+  {
+    mutt_list_free(&p.stale);
+    return -1;
+  }
+
+  STAILQ_FOREACH(np, &p.stale, entries)
+  {
+    if (ops->delete (h->ctx, np->data, mutt_str_strlen(np->data)) == 0)
+      count++;
+  }
+  mutt_list_free(&p.stale);
+
+  if (count > 0)
+  {
+    mutt_debug(2, "hcache %s: pruned %d of %zu records\n", h->folder, count, p.total);
+    if ((size_t) count * HCACHE_COMPACT_DIVISOR >= p.total)
+      h->compact = true;
+  }
+
+  return count;
+}
+
 const char *mutt_hcache_backend_list(void)
 {
   char tmp[STRING] = { 0 };
@@ -915,6 +1436,17 @@ const char *mutt_hcache_backend_list(void)
   return mutt_str_strdup(tmp);
 }
 
+void mutt_hcache_stats(char *buf, size_t buflen)
+{
+  const struct HcacheStats *t = &HcacheTotals;
+
+  snprintf(buf, buflen,
+           "hcache: %lu fetches, %lu hits, %lu stale, %lu stores (%llu bytes), "
+           "%lu restores (%llu bytes, %llu ms)",
+           t->fetches, t->hits, t->stale, t->stores, t->bytes_in, HcacheRestores,
+           HcacheBytesRestored, HcacheRestoreUsecs / 1000);
+}
+
 int mutt_hcache_is_valid_backend(const char *s)
 {
   return hcache_get_backend_ops(s) != NULL;
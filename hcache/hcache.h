@@ -46,6 +46,7 @@
 #ifndef _MUTT_HCACHE_H
 #define _MUTT_HCACHE_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 struct Header;
@@ -64,9 +65,24 @@ typedef int (*hcache_namer_t)(const char *path, char *dest, size_t dlen);
  */
 header_cache_t *mutt_hcache_open(const char *path, const char *folder, hcache_namer_t namer);
 
+/**
+ * mutt_hcache_prefetch - start reading a large header cache into memory
+ * @param path   Location of the header cache (often as specified by the user)
+ * @param folder Name of the folder containing the messages
+ * @param namer  Optional (might be NULL) client-specific function to form the
+ *               final name of the hcache database file.
+ *
+ * If the folder's database file is at least $header_cache_prefetch megabytes,
+ * ask the kernel to read it ahead.  This returns at once, so callers can do it
+ * before other slow work, e.g. selecting the mailbox, and the first fetches
+ * won't fault in the file one random page at a time.
+ */
+void mutt_hcache_prefetch(const char *path, const char *folder, hcache_namer_t namer);
+
 /**
  * mutt_hcache_close - close the connection to the header cache
  * @param h Pointer to the header_cache_t structure got by mutt_hcache_open
+ * @note Any queued records are written before the database is closed.
  */
 void mutt_hcache_close(header_cache_t *h);
 
@@ -98,6 +114,21 @@ void *mutt_hcache_fetch(header_cache_t *h, const char *key, size_t keylen);
  */
 void *mutt_hcache_fetch_raw(header_cache_t *h, const char *key, size_t keylen);
 
+/**
+ * mutt_hcache_fetch_many - fetch and validate several messages' headers
+ * @param h     Pointer to the header_cache_t structure got by mutt_hcache_open
+ * @param keys  Array of message identification strings
+ * @param count Number of entries in @a keys and @a data
+ * @param data  Array filled with a pointer to the data of each key, or NULL if
+ *              the key wasn't found or its data isn't valid
+ * @retval num Number of valid entries found
+ * @note The lookups are handed to the backend in batches, so that backends
+ *       which support it can run them under a single transaction.
+ * @note Each non-NULL entry of @a data must be freed by calling
+ *       mutt_hcache_free.
+ */
+size_t mutt_hcache_fetch_many(header_cache_t *h, const char **keys, size_t count, void **data);
+
 /**
  * mutt_hcache_free - free previously fetched data
  * @param h    Pointer to the header_cache_t structure got by mutt_hcache_open
@@ -111,9 +142,23 @@ void mutt_hcache_free(header_cache_t *h, void **data);
  * @retval Pointer to the restored header (cannot be NULL)
  * @note The returned Header must be free'd by caller code with
  *       mutt_free_header().
+ * @note The Header is decoded directly from @a d, which may point into the
+ *       backend's own storage, so it must be called before mutt_hcache_free()
+ *       and before any further store or delete on the same cache.
  */
 struct Header *mutt_hcache_restore(const unsigned char *d);
 
+/**
+ * mutt_hcache_restore_summary - restore only the fixed fields of a Header
+ * @param d Data retrieved using mutt_hcache_fetch or mutt_hcache_fetch_raw
+ * @param h Header to fill in
+ * @note Only the fields held in the Header itself (flags, dates, score, ...)
+ *       are restored, the Envelope, Body and other pointers are set to NULL.
+ *       Nothing is allocated, so this is a cheap way to check the cached
+ *       flags before deciding whether to call mutt_hcache_restore().
+ */
+void mutt_hcache_restore_summary(const unsigned char *d, struct Header *h);
+
 /**
  * mutt_hcache_store - store a Header along with a validity datum
  * @param h           Pointer to the header_cache_t structure got by mutt_hcache_open
@@ -123,10 +168,28 @@ struct Header *mutt_hcache_restore(const unsigned char *d);
  * @param uidvalidity IMAP-specific UIDVALIDITY value, or 0 to use the current time
  * @retval 0 on success
  * @return A generic or backend-specific error code otherwise
+ * @note The record is queued and written, together with the others in the
+ *       queue, when the queue is full, the key is used again, or the header
+ *       cache is closed.  Errors from a deferred write are only logged.
  */
 int mutt_hcache_store(header_cache_t *h, const char *key, size_t keylen,
                       struct Header *header, unsigned int uidvalidity);
 
+/**
+ * mutt_hcache_store_many - store several Headers along with a validity datum
+ * @param h           Pointer to the header_cache_t structure got by mutt_hcache_open
+ * @param keys        Array of message identification strings
+ * @param count       Number of entries in @a keys and @a headers
+ * @param headers     Array of message headers to store
+ * @param uidvalidity IMAP-specific UIDVALIDITY value, or 0 to use the current time
+ * @retval 0 on success
+ * @return A generic or backend-specific error code otherwise
+ * @note The records are handed to the backend in batches, so that backends
+ *       which support it can store them under a single transaction.
+ */
+int mutt_hcache_store_many(header_cache_t *h, const char **keys, size_t count,
+                           struct Header **headers, unsigned int uidvalidity);
+
 /**
  * mutt_hcache_store_raw - store a key / data pair
  * @param h      Pointer to the header_cache_t structure got by mutt_hcache_open
@@ -150,6 +213,29 @@ int mutt_hcache_store_raw(header_cache_t *h, const char *key, size_t keylen,
  */
 int mutt_hcache_delete(header_cache_t *h, const char *key, size_t keylen);
 
+/**
+ * typedef hcache_keep_t - Is a cached record still wanted?
+ * @param key    Message identification string, as given to mutt_hcache_store
+ * @param keylen Length of the string pointed to by key
+ * @param data   Private data passed to mutt_hcache_prune
+ * @retval true Keep the record
+ */
+typedef bool (*hcache_keep_t)(const char *key, size_t keylen, void *data);
+
+/**
+ * mutt_hcache_prune - delete the records the mailbox doesn't need any more
+ * @param h    Pointer to the header_cache_t structure got by mutt_hcache_open
+ * @param keep Function deciding which records to keep
+ * @param data Private data passed to @a keep
+ * @retval num Number of records deleted
+ * @retval -1  The backend can't list its keys, or the file holds several folders
+ *
+ * Every record of this folder is offered to @a keep.  If a quarter or more of
+ * the file's records are deleted, the backend may compact the file when the
+ * header cache is closed.
+ */
+int mutt_hcache_prune(header_cache_t *h, hcache_keep_t keep, void *data);
+
 /**
  * mutt_hcache_backend_list - get a list of backend identification strings
  * @retval Comma separated string describing the compiled-in backends
@@ -157,6 +243,15 @@ int mutt_hcache_delete(header_cache_t *h, const char *key, size_t keylen);
  */
 const char *mutt_hcache_backend_list(void);
 
+/**
+ * mutt_hcache_stats - describe how well the header cache has been doing
+ * @param buf    Buffer for the result
+ * @param buflen Length of the buffer
+ *
+ * The counters cover all the header caches closed so far in this session.
+ */
+void mutt_hcache_stats(char *buf, size_t buflen);
+
 /**
  * mutt_hcache_is_valid_backend - Is the string a valid hcache backend
  * @param s String identifying a backend
@@ -1,6 +1,6 @@
 #!/bin/sh
 
-BASEVERSION=2
+BASEVERSION=3
 
 cleanstruct () {
   echo "$1" | sed -e 's/.* //'
@@ -46,7 +46,7 @@ getstruct () {
   done
 
   case $STRUCT in
-    Address|ListNode|Buffer|Parameter|Body|Envelope|Header)
+    Address|ListNode|Buffer|Parameter|Body|Envelope|Header|TagHead)
       BODY=`cleanbody "$BODY"`
       echo "$STRUCT: $BODY"
     ;;
@@ -97,6 +97,41 @@ static int hcache_kyotocabinet_store(void *ctx, const char *key, size_t keylen,
   return 0;
 }
 
+static int hcache_kyotocabinet_store_many(void *ctx, const char **keys,
+                                          const size_t *keylens, size_t count,
+                                          void **data, const size_t *dlens)
+{
+  int rc = 0;
+
+  if (!ctx)
+    return -1;
+
+  KCDB *db = ctx;
+  if (!kcdbbegintran(db, 0))
+  {
+    int ecode = kcdbecode(db);
+    return ecode ? ecode : -1;
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!kcdbset(db, keys[i], keylens[i], data[i], dlens[i]))
+    {
+      int ecode = kcdbecode(db);
+      rc = ecode ? ecode : -1;
+      break;
+    }
+  }
+
+  /* Keep whatever was stored before a failure */
+  if (!kcdbendtran(db, 1) && !rc)
+  {
+    int ecode = kcdbecode(db);
+    rc = ecode ? ecode : -1;
+  }
+  return rc;
+}
+
 static int hcache_kyotocabinet_delete(void *ctx, const char *key, size_t keylen)
 {
   if (!ctx)
@@ -111,6 +146,30 @@ static int hcache_kyotocabinet_delete(void *ctx, const char *key, size_t keylen)
   return 0;
 }
 
+static int hcache_kyotocabinet_foreach(void *ctx, hcache_foreach_cb_t cb, void *data)
+{
+  if (!ctx)
+    return -1;
+
+  KCDB *db = ctx;
+  KCCUR *cur = kcdbcursor(db);
+  if (!cur)
+    return -1;
+
+  char *key = NULL;
+  size_t keylen;
+  kccurjump(cur);
+  while ((key = kccurgetkey(cur, &keylen, 1)))
+  {
+    int stop = cb(key, keylen, data);
+    kcfree(key);
+    if (stop)
+      break;
+  }
+  kccurdel(cur);
+  return 0;
+}
+
 static void hcache_kyotocabinet_close(void **ctx)
 {
   if (!ctx || !*ctx)
@@ -135,4 +194,5 @@ static const char *hcache_kyotocabinet_backend(void)
   return version_cache;
 }
 
-HCACHE_BACKEND_OPS(kyotocabinet)
+HCACHE_BACKEND_OPS_FOREACH(kyotocabinet, NULL, hcache_kyotocabinet_store_many,
+                           hcache_kyotocabinet_foreach)
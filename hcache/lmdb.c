@@ -30,15 +30,29 @@
  */
 
 #include "config.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
 #include <lmdb.h>
 #include "mutt/mutt.h"
 #include "backend.h"
 
-/** The maximum size of the database file (2GiB).
- * The file is mmap(2)'d into memory. */
+/** The initial maximum size of the database file (2GiB).
+ * The file is mmap(2)'d into memory.  The map grows when it fills up. */
 const size_t LMDB_DB_SIZE = 2147483648;
 
+/** Commit the stores after this many of them */
+#define LMDB_BATCH_STORES 1000
+/** ... or after this long (ms), so other processes see them */
+#define LMDB_BATCH_MS 1000
+
 /**
  * enum MdbTxnMode - LMDB transaction state
  */
@@ -58,8 +72,109 @@ struct HcacheLmdbCtx
   MDB_txn *txn;
   MDB_dbi db;
   enum MdbTxnMode txn_mode;
+  int pending;            /**< Fetched records that haven't been freed yet */
+  int stored;             /**< Stores in the write transaction */
+  struct timeval started; /**< When the write transaction began */
 };
 
+/**
+ * mdb_resized - Adopt the map size set by another process
+ * @param ctx LMDB context
+ * @param rc  Result of beginning a transaction
+ * @retval bool true if the map was resized and the transaction may be retried
+ */
+static bool mdb_resized(struct HcacheLmdbCtx *ctx, int rc)
+{
+  if (rc != MDB_MAP_RESIZED)
+    return false;
+
+  mutt_debug(2, "map resized by another process\n");
+  return mdb_env_set_mapsize(ctx->env, 0) == MDB_SUCCESS;
+}
+
+/**
+ * mdb_grow - Double the size of the map
+ * @param ctx LMDB context
+ * @retval 0 Success, or an LMDB error
+ *
+ * There must be no transaction open.
+ */
+static int mdb_grow(struct HcacheLmdbCtx *ctx)
+{
+  MDB_envinfo info;
+
+  int rc = mdb_env_info(ctx->env, &info);
+  if (rc != MDB_SUCCESS)
+    return rc;
+
+  rc = mdb_env_set_mapsize(ctx->env, info.me_mapsize * 2);
+  if (rc == MDB_SUCCESS)
+    mutt_debug(2, "map grown to %zu bytes\n", info.me_mapsize * 2);
+  else
+    mutt_debug(2, "mdb_env_set_mapsize: %s\n", mdb_strerror(rc));
+  return rc;
+}
+
+/**
+ * mdb_nearly_full - Is the map nearly full?
+ * @param ctx LMDB context
+ * @retval bool true if more than 3/4 of the map is used
+ */
+static bool mdb_nearly_full(struct HcacheLmdbCtx *ctx)
+{
+  MDB_envinfo info;
+  MDB_stat st;
+
+  if ((mdb_env_info(ctx->env, &info) != MDB_SUCCESS) ||
+      (mdb_env_stat(ctx->env, &st) != MDB_SUCCESS))
+  {
+    return false;
+  }
+
+  size_t used = (info.me_last_pgno + 1) * (size_t) st.ms_psize;
+  return used > (info.me_mapsize / 4) * 3;
+}
+
+/**
+ * mdb_commit - Commit the write transaction
+ * @param ctx LMDB context
+ * @retval 0 Success, or an LMDB error
+ */
+static int mdb_commit(struct HcacheLmdbCtx *ctx)
+{
+  int rc = mdb_txn_commit(ctx->txn);
+  if (rc != MDB_SUCCESS)
+    mutt_debug(2, "mdb_txn_commit: %s\n", mdb_strerror(rc));
+  ctx->txn_mode = TXN_UNINITIALIZED;
+  ctx->txn = NULL;
+  ctx->pending = 0;
+  ctx->stored = 0;
+  return rc;
+}
+
+/**
+ * mdb_batch_due - Should the write transaction be committed?
+ * @param ctx LMDB context
+ * @retval bool true if enough stores, or time, have gone by
+ *
+ * Records fetched through the transaction point into it, so it's kept open
+ * while any of them are in use.
+ */
+static bool mdb_batch_due(struct HcacheLmdbCtx *ctx)
+{
+  if ((ctx->txn_mode != TXN_WRITE) || (ctx->pending > 0))
+    return false;
+
+  if (ctx->stored >= LMDB_BATCH_STORES)
+    return true;
+
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  long ms = (now.tv_sec - ctx->started.tv_sec) * 1000 +
+            (now.tv_usec - ctx->started.tv_usec) / 1000;
+  return ms >= LMDB_BATCH_MS;
+}
+
 static int mdb_get_r_txn(struct HcacheLmdbCtx *ctx)
 {
   int rc;
@@ -70,7 +185,11 @@ static int mdb_get_r_txn(struct HcacheLmdbCtx *ctx)
   if (ctx->txn)
     rc = mdb_txn_renew(ctx->txn);
   else
+  {
     rc = mdb_txn_begin(ctx->env, NULL, MDB_RDONLY, &ctx->txn);
+    if (mdb_resized(ctx, rc))
+      rc = mdb_txn_begin(ctx->env, NULL, MDB_RDONLY, &ctx->txn);
+  }
 
   if (rc == MDB_SUCCESS)
     ctx->txn_mode = TXN_READ;
@@ -92,11 +211,24 @@ static int mdb_get_w_txn(struct HcacheLmdbCtx *ctx)
 
     /* Free up the memory for readonly or reset transactions */
     mdb_txn_abort(ctx->txn);
+    ctx->txn = NULL;
+    ctx->txn_mode = TXN_UNINITIALIZED;
+    ctx->pending = 0;
   }
 
+  /* Grow the map between transactions, before a store can fill it */
+  if (mdb_nearly_full(ctx))
+    mdb_grow(ctx);
+
   rc = mdb_txn_begin(ctx->env, NULL, 0, &ctx->txn);
+  if (mdb_resized(ctx, rc))
+    rc = mdb_txn_begin(ctx->env, NULL, 0, &ctx->txn);
   if (rc == MDB_SUCCESS)
+  {
     ctx->txn_mode = TXN_WRITE;
+    ctx->stored = 0;
+    gettimeofday(&ctx->started, NULL);
+  }
   else
     mutt_debug(2, "mdb_txn_begin: %s\n", mdb_strerror(rc));
 
@@ -126,6 +258,12 @@ static void *hcache_lmdb_open(const char *path)
     goto fail_env;
   }
 
+  /* Other instances of NeoMutt may share this file.  Release the reader
+   * slots of any that died without closing it. */
+  int dead = 0;
+  if ((mdb_reader_check(ctx->env, &dead) == MDB_SUCCESS) && (dead > 0))
+    mutt_debug(2, "mdb_reader_check: cleared %d stale readers\n", dead);
+
   rc = mdb_get_r_txn(ctx);
   if (rc != MDB_SUCCESS)
   {
@@ -152,6 +290,9 @@ fail_dbi:
 fail_env:
   mdb_env_close(ctx->env);
   FREE(&ctx);
+  /* Let the caller tell a locked database from a broken one */
+  if (rc > 0)
+    errno = rc;
   return NULL;
 }
 
@@ -188,12 +329,68 @@ static void *hcache_lmdb_fetch(void *vctx, const char *key, size_t keylen)
     return NULL;
   }
 
+  ctx->pending++;
   return data.mv_data;
 }
 
+static void hcache_lmdb_fetch_many(void *vctx, const char **keys,
+                                   const size_t *keylens, size_t count, void **data)
+{
+  MDB_val dkey;
+  MDB_val dval;
+  int rc;
+
+  for (size_t i = 0; i < count; i++)
+    data[i] = NULL;
+
+  if (!vctx)
+    return;
+
+  struct HcacheLmdbCtx *ctx = vctx;
+
+  rc = mdb_get_r_txn(ctx);
+  if (rc != MDB_SUCCESS)
+  {
+    ctx->txn = NULL;
+    mutt_debug(2, "txn_renew: %s\n", mdb_strerror(rc));
+    return;
+  }
+
+  /* All the lookups share the same read transaction */
+  for (size_t i = 0; i < count; i++)
+  {
+    dkey.mv_data = (void *) keys[i];
+    dkey.mv_size = keylens[i];
+    rc = mdb_get(ctx->txn, ctx->db, &dkey, &dval);
+    if (rc == MDB_SUCCESS)
+    {
+      data[i] = dval.mv_data;
+      ctx->pending++;
+    }
+    else if (rc != MDB_NOTFOUND)
+      mutt_debug(2, "mdb_get: %s\n", mdb_strerror(rc));
+  }
+}
+
 static void hcache_lmdb_free(void *vctx, void **data)
 {
   /* LMDB data is owned by the database */
+  if (!vctx || !data || !*data)
+    return;
+
+  struct HcacheLmdbCtx *ctx = vctx;
+
+  *data = NULL;
+  if (ctx->pending > 0)
+    ctx->pending--;
+
+  /* Once no record points into the read snapshot, let it go.  The next fetch
+   * renews it and sees what other processes have committed since. */
+  if ((ctx->pending == 0) && ctx->txn && (ctx->txn_mode == TXN_READ))
+  {
+    mdb_txn_reset(ctx->txn);
+    ctx->txn_mode = TXN_UNINITIALIZED;
+  }
 }
 
 static int hcache_lmdb_store(void *vctx, const char *key, size_t keylen, void *data, size_t dlen)
@@ -218,16 +415,87 @@ static int hcache_lmdb_store(void *vctx, const char *key, size_t keylen, void *d
     return rc;
   }
   rc = mdb_put(ctx->txn, ctx->db, &dkey, &databuf, 0);
+  if (rc == MDB_MAP_FULL)
+  {
+    /* The transaction can't be used any more.  Only the stores since the last
+     * commit are lost; grow the map and try this one again. */
+    mutt_debug(2, "mdb_put: map full after %d stores\n", ctx->stored);
+    mdb_txn_abort(ctx->txn);
+    ctx->txn_mode = TXN_UNINITIALIZED;
+    ctx->txn = NULL;
+    ctx->pending = 0;
+    if ((mdb_grow(ctx) == MDB_SUCCESS) && (mdb_get_w_txn(ctx) == MDB_SUCCESS))
+      rc = mdb_put(ctx->txn, ctx->db, &dkey, &databuf, 0);
+  }
   if (rc != MDB_SUCCESS)
   {
     mutt_debug(2, "mdb_put: %s\n", mdb_strerror(rc));
-    mdb_txn_abort(ctx->txn);
+    if (ctx->txn)
+      mdb_txn_abort(ctx->txn);
     ctx->txn_mode = TXN_UNINITIALIZED;
     ctx->txn = NULL;
+    return rc;
   }
+
+  ctx->stored++;
+  if (mdb_batch_due(ctx))
+    rc = mdb_commit(ctx);
   return rc;
 }
 
+static int hcache_lmdb_store_many(void *vctx, const char **keys, const size_t *keylens,
+                                  size_t count, void **data, const size_t *dlens)
+{
+  MDB_val dkey;
+  MDB_val databuf;
+  int rc;
+
+  if (!vctx)
+    return -1;
+
+  struct HcacheLmdbCtx *ctx = vctx;
+
+retry:
+  rc = mdb_get_w_txn(ctx);
+  if (rc != MDB_SUCCESS)
+  {
+    mutt_debug(2, "mdb_get_w_txn: %s\n", mdb_strerror(rc));
+    return rc;
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    dkey.mv_data = (void *) keys[i];
+    dkey.mv_size = keylens[i];
+    databuf.mv_data = data[i];
+    databuf.mv_size = dlens[i];
+    rc = mdb_put(ctx->txn, ctx->db, &dkey, &databuf, 0);
+    if (rc == MDB_MAP_FULL)
+    {
+      /* The caller still has the whole batch, so store it again */
+      mutt_debug(2, "mdb_put: map full, growing it\n");
+      mdb_txn_abort(ctx->txn);
+      ctx->txn_mode = TXN_UNINITIALIZED;
+      ctx->txn = NULL;
+      ctx->pending = 0;
+      if (mdb_grow(ctx) == MDB_SUCCESS)
+        goto retry;
+    }
+    if (rc != MDB_SUCCESS)
+    {
+      mutt_debug(2, "mdb_put: %s\n", mdb_strerror(rc));
+      if (ctx->txn)
+        mdb_txn_abort(ctx->txn);
+      ctx->txn_mode = TXN_UNINITIALIZED;
+      ctx->txn = NULL;
+      return rc;
+    }
+  }
+
+  /* Commit the whole batch, so it survives a later failure */
+  return mdb_commit(ctx);
+}
+
 static int hcache_lmdb_delete(void *vctx, const char *key, size_t keylen)
 {
   MDB_val dkey;
@@ -258,6 +526,119 @@ static int hcache_lmdb_delete(void *vctx, const char *key, size_t keylen)
   return rc;
 }
 
+static int hcache_lmdb_foreach(void *vctx, hcache_foreach_cb_t cb, void *data)
+{
+  MDB_cursor *cursor = NULL;
+  MDB_val dkey;
+  MDB_val dval;
+  int rc;
+
+  if (!vctx)
+    return -1;
+
+  struct HcacheLmdbCtx *ctx = vctx;
+
+  rc = mdb_get_r_txn(ctx);
+  if (rc != MDB_SUCCESS)
+  {
+    ctx->txn = NULL;
+    mutt_debug(2, "txn_renew: %s\n", mdb_strerror(rc));
+    return rc;
+  }
+
+  rc = mdb_cursor_open(ctx->txn, ctx->db, &cursor);
+  if (rc != MDB_SUCCESS)
+  {
+    mutt_debug(2, "mdb_cursor_open: %s\n", mdb_strerror(rc));
+    return rc;
+  }
+
+  for (rc = mdb_cursor_get(cursor, &dkey, &dval, MDB_FIRST); rc == MDB_SUCCESS;
+       rc = mdb_cursor_get(cursor, &dkey, &dval, MDB_NEXT))
+  {
+    if (cb(dkey.mv_data, dkey.mv_size, data) != 0)
+      break;
+  }
+  mdb_cursor_close(cursor);
+
+  return ((rc == MDB_SUCCESS) || (rc == MDB_NOTFOUND)) ? 0 : rc;
+}
+
+static int hcache_lmdb_compact(void *vctx, const char *path)
+{
+  char tmp[_POSIX_PATH_MAX];
+  char lockfile[_POSIX_PATH_MAX];
+  struct flock lock = { 0 };
+  int rc;
+
+  if (!vctx)
+    return -1;
+
+  struct HcacheLmdbCtx *ctx = vctx;
+
+  lock.l_type = F_WRLCK;
+  lock.l_whence = SEEK_SET;
+
+  if (ctx->txn)
+  {
+    if (ctx->txn_mode == TXN_WRITE)
+      mdb_txn_commit(ctx->txn);
+    else
+      mdb_txn_abort(ctx->txn);
+    ctx->txn_mode = TXN_UNINITIALIZED;
+    ctx->txn = NULL;
+    ctx->pending = 0;
+  }
+
+  /* Replacing the file under another instance would lose its changes.  Every
+   * instance holds a shared lock on the lock file while it has the database
+   * open, and waits for that lock before opening it.  An exclusive lock is
+   * only granted if nobody else has it open, and holding it across the copy
+   * and the rename keeps new instances off the old file until the lock file
+   * describes the new one. */
+  snprintf(lockfile, sizeof(lockfile), "%s-lock", path);
+  int fd = open(lockfile, O_RDWR);
+  if ((fd < 0) || (fcntl(fd, F_SETLK, &lock) == -1))
+  {
+    mutt_debug(2, "%s is in use, not compacting\n", path);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+
+  snprintf(tmp, sizeof(tmp), "%s.compact", path);
+  rc = mdb_env_copy2(ctx->env, tmp, MDB_CP_COMPACT);
+  if (rc != MDB_SUCCESS)
+  {
+    mutt_debug(2, "mdb_env_copy2: %s\n", mdb_strerror(rc));
+    unlink(tmp);
+  }
+  else if (rename(tmp, path) != 0)
+  {
+    mutt_debug(2, "rename %s: %s\n", tmp, strerror(errno));
+    unlink(tmp);
+    rc = -1;
+  }
+  else
+  {
+    /* The lock file still describes the old file.  We hold the lock, so a new
+     * environment counts as the first one, and sets it up afresh. */
+    MDB_env *env = NULL;
+    if (mdb_env_create(&env) == MDB_SUCCESS)
+    {
+      mdb_env_set_mapsize(env, LMDB_DB_SIZE);
+      if (mdb_env_open(env, path, MDB_NOSUBDIR, 0644) != MDB_SUCCESS)
+        mutt_debug(2, "can't set up the lock file of %s\n", path);
+      mdb_env_close(env);
+    }
+  }
+
+  /* This drops all of our locks on the file, but the environment is about to
+   * be closed anyway */
+  close(fd);
+  return rc;
+}
+
 static void hcache_lmdb_close(void **vctx)
 {
   if (!vctx || !*vctx)
@@ -281,4 +662,10 @@ static const char *hcache_lmdb_backend(void)
   return "lmdb " MDB_VERSION_STRING;
 }
 
-HCACHE_BACKEND_OPS(lmdb)
+const struct HcacheOps hcache_lmdb_ops = {
+  HCACHE_BACKEND_OPS_FIELDS(lmdb)
+  .fetch_many = hcache_lmdb_fetch_many,
+  .store_many = hcache_lmdb_store_many,
+  .foreach = hcache_lmdb_foreach,
+  .compact = hcache_lmdb_compact,
+};
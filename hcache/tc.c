@@ -87,6 +87,41 @@ static int hcache_tokyocabinet_store(void *ctx, const char *key, size_t keylen,
   return 0;
 }
 
+static int hcache_tokyocabinet_store_many(void *ctx, const char **keys,
+                                          const size_t *keylens, size_t count,
+                                          void **data, const size_t *dlens)
+{
+  int rc = 0;
+
+  if (!ctx)
+    return -1;
+
+  TCBDB *db = ctx;
+  if (!tcbdbtranbegin(db))
+  {
+    int ecode = tcbdbecode(db);
+    return ecode ? ecode : -1;
+  }
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!tcbdbput(db, keys[i], keylens[i], data[i], dlens[i]))
+    {
+      int ecode = tcbdbecode(db);
+      rc = ecode ? ecode : -1;
+      break;
+    }
+  }
+
+  /* Keep whatever was stored before a failure */
+  if (!tcbdbtrancommit(db) && !rc)
+  {
+    int ecode = tcbdbecode(db);
+    rc = ecode ? ecode : -1;
+  }
+  return rc;
+}
+
 static int hcache_tokyocabinet_delete(void *ctx, const char *key, size_t keylen)
 {
   if (!ctx)
@@ -101,6 +136,34 @@ static int hcache_tokyocabinet_delete(void *ctx, const char *key, size_t keylen)
   return 0;
 }
 
+static int hcache_tokyocabinet_foreach(void *ctx, hcache_foreach_cb_t cb, void *data)
+{
+  if (!ctx)
+    return -1;
+
+  TCBDB *db = ctx;
+  BDBCUR *cur = tcbdbcurnew(db);
+  if (!cur)
+    return -1;
+
+  if (tcbdbcurfirst(cur))
+  {
+    do
+    {
+      int keylen;
+      char *key = tcbdbcurkey(cur, &keylen);
+      if (!key)
+        break;
+      int stop = cb(key, keylen, data);
+      FREE(&key);
+      if (stop)
+        break;
+    } while (tcbdbcurnext(cur));
+  }
+  tcbdbcurdel(cur);
+  return 0;
+}
+
 static void hcache_tokyocabinet_close(void **ctx)
 {
   if (!ctx || !*ctx)
@@ -120,4 +183,5 @@ static const char *hcache_tokyocabinet_backend(void)
   return "tokyocabinet " _TC_VERSION;
 }
 
-HCACHE_BACKEND_OPS(tokyocabinet)
+HCACHE_BACKEND_OPS_FOREACH(tokyocabinet, NULL, hcache_tokyocabinet_store_many,
+                           hcache_tokyocabinet_foreach)
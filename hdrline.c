@@ -1157,6 +1157,17 @@ static const char *index_format_str(char *buf, size_t buflen, size_t col, int co
 
     case 'X':
     {
+      if ((flags & MUTT_FORMAT_NOCOUNT) && !hdr->attach_valid)
+      {
+        /* Counting means reading the message; show a placeholder for now */
+        if (optional)
+          optional = 0;
+
+        snprintf(fmt, sizeof(fmt), "%%%ss", prec);
+        snprintf(buf, buflen, fmt, "?");
+        break;
+      }
+
       int count = mutt_count_body_parts(ctx, hdr);
 
       /* The recursion allows messages without depth to return 0. */
@@ -31,6 +31,7 @@
 #include "mutt.h"
 #include "header.h"
 #include "alias.h"
+#include "attach.h"
 #include "body.h"
 #include "context.h"
 #include "envelope.h"
@@ -359,6 +360,7 @@ void mutt_free_header(struct Header **h)
 {
   if (!h || !*h)
     return;
+  mutt_attach_cache_forget(NULL, *h);
   mutt_env_free(&(*h)->env);
   mutt_free_body(&(*h)->content);
   FREE(&(*h)->maildir_flags);
@@ -373,15 +375,15 @@ void mutt_free_header(struct Header **h)
     (*h)->free_cb(*h);
   FREE(&(*h)->data);
 #endif
-  FREE(h);
+  mutt_mem_tag_free(MEM_HEADER, h, sizeof(struct Header));
 }
 
 struct Header *mutt_new_header(void)
 {
-  struct Header *h = mutt_mem_calloc(1, sizeof(struct Header));
+  struct Header *h = mutt_mem_tag_calloc(MEM_HEADER, 1, sizeof(struct Header));
 #ifdef MIXMASTER
   STAILQ_INIT(&h->chain);
 #endif
-  STAILQ_INIT(&h->tags);
+  driver_tags_init(&h->tags);
   return h;
 }
@@ -72,33 +72,39 @@ struct Header
 
   /* tells whether the attachment count is valid */
   bool attach_valid : 1;
+  bool attach_new : 1; /**< attach_total isn't in the header cache yet */
 
   /* the following are used to support collapsing threads  */
   bool collapsed : 1; /**< is this message part of a collapsed thread? */
   bool limited : 1;   /**< is this message in a limited view?  */
-  size_t num_hidden;  /**< number of hidden messages in this view */
-
-  short recipient;    /**< user_is_recipient()'s return value, cached */
-
-  int pair;           /**< color-pair to use when displaying in the index */
-
+  bool limit_valid : 1; /**< limited is the verdict of the current limit */
+  /* Everything up to here, and the fields below up to num_hidden, is what
+   * sorting, limiting and drawing the index look at for every message.
+   * Keep them together at the front of the struct, so that a scan touches
+   * one cache line per message.  Fields only needed when a single message
+   * is opened or synced go after them. */
   time_t date_sent;   /**< time when the message was sent (UTC) */
   time_t received;    /**< time when the message was placed in the mailbox */
-  LOFF_T offset;      /**< where in the stream does this message begin? */
-  int lines;          /**< how many lines in the body of this message? */
   int index;          /**< the absolute (unsorted) message number */
   int msgno;          /**< number displayed to the user */
   int virtual;        /**< virtual message number */
   int score;
+  int pair;           /**< color-pair to use when displaying in the index */
+  unsigned int limit_flags; /**< flags the limit's verdict was reached with */
+  struct MuttThread *thread;
+  size_t num_hidden;  /**< number of hidden messages in this view */
+
+  short recipient;    /**< user_is_recipient()'s return value, cached */
+  /* Number of qualifying attachments in message, if attach_valid */
+  short attach_total;
+  int lines;          /**< how many lines in the body of this message? */
+  int sort_pos;       /**< position in the sorted mailbox, see mx_save_order() */
+  LOFF_T offset;      /**< where in the stream does this message begin? */
   struct Envelope *env;      /**< envelope information */
   struct Body *content;      /**< list of MIME parts */
   char *path;
 
   char *tree; /**< character string to print thread tree */
-  struct MuttThread *thread;
-
-  /* Number of qualifying attachments in message, if attach_valid */
-  short attach_total;
 
 #ifdef MIXMASTER
   struct ListHead chain;
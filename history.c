@@ -36,6 +36,7 @@
  * | :----------------------- | :---------------------------------------------------------
  * | mutt_hist_add()          | Add a string to a history
  * | mutt_hist_at_scratch()   | Is the current History position at the 'scratch' place?
+ * | mutt_hist_compact()      | Shrink the history file, if it has grown enough
  * | mutt_hist_init()         | Create a set of empty History ring buffers
  * | mutt_hist_next()         | Get the next string in a History
  * | mutt_hist_prev()         | Get the previous string in a History
@@ -68,7 +69,8 @@
  *         History  entry
  * ```
  * When $history_remove_dups is set, duplicate entries are scanned and removed
- * each time a new entry is added.  In order to preserve the history ring size,
+ * each time a new entry is added.  A count of each string in the ring is kept,
+ * so the ring is only scanned if the entry really is a duplicate.  In order to preserve the history ring size,
  * entries 0..last are compacted up.  Entries last+1..History are
  * compacted down:
  * ```
@@ -84,6 +86,10 @@
  *                  next oldest entry
  *         History  entry
  * ```
+ *
+ * New entries are appended to the #HistoryFile.  The file is only rewritten,
+ * dropping old entries and duplicates, when NeoMutt starts, when it's idle
+ * and when it exits, never while the user is typing.
  */
 
 #include "config.h"
@@ -114,6 +120,7 @@ struct History
   char **hist;
   short cur;
   short last;
+  struct Hash *counts; /**< Number of times each string is in the ring */
 };
 
 static const struct Mapping HistoryHelp[] = {
@@ -133,6 +140,7 @@ short SaveHistory; /**< Number of history entries, per category, stored on disk
 
 static struct History Histories[HC_LAST];
 static int OldSize = 0;
+static int Appended = 0; /**< Lines appended to the history file since it was shrunk */
 
 /**
  * get_history - Get a particular history
@@ -165,8 +173,12 @@ static void init_history(struct History *h)
     }
   }
 
+  mutt_hash_destroy(&h->counts);
   if (History != 0)
+  {
     h->hist = mutt_mem_calloc(History + 1, sizeof(char *));
+    h->counts = mutt_hash_create(MAX(10, History * 2), MUTT_HASH_STRDUP_KEYS);
+  }
 
   h->cur = 0;
   h->last = 0;
@@ -343,7 +355,6 @@ cleanup:
  */
 static void save_history(enum HistoryClass hclass, const char *str)
 {
-  static int n = 0;
   FILE *f = NULL;
   char *tmp = NULL;
 
@@ -375,12 +386,7 @@ static void save_history(enum HistoryClass hclass, const char *str)
 
   mutt_file_fclose(&f);
   FREE(&tmp);
-
-  if (--n < 0)
-  {
-    n = SaveHistory;
-    shrink_histfile();
-  }
+  Appended++;
 }
 
 /**
@@ -401,6 +407,11 @@ static void remove_history_dups(enum HistoryClass hclass, const char *str)
   if ((History == 0) || !h)
     return; /* disabled */
 
+  /* Not in the ring, so nothing to move */
+  if (!mutt_hash_find_elem(h->counts, str))
+    return;
+  mutt_hash_delete(h->counts, str, NULL);
+
   /* Remove dups from 0..last-1 compacting up. */
   source = dest = 0;
   while (source < h->last)
@@ -482,8 +493,12 @@ void mutt_hist_add(enum HistoryClass hclass, const char *str, bool save)
       if (save && (SaveHistory != 0))
         save_history(hclass, str);
       mutt_str_replace(&h->hist[h->last++], str);
+      dup_hash_inc(h->counts, h->hist[h->last - 1]);
       if (h->last > History)
         h->last = 0;
+      /* The oldest entry becomes the scratch space */
+      if (h->hist[h->last])
+        dup_hash_dec(h->counts, h->hist[h->last]);
     }
   }
   h->cur = h->last; /* reset to the last entry */
@@ -570,6 +585,7 @@ void mutt_hist_reset_state(enum HistoryClass hclass)
 void mutt_hist_read_file(void)
 {
   FILE *f = NULL;
+  int n[HC_LAST] = { 0 };
   int line = 0, hclass, read;
   char *linebuf = NULL, *p = NULL;
   size_t buflen;
@@ -591,6 +607,7 @@ void mutt_hist_read_file(void)
     if (hclass >= HC_LAST)
       continue;
     *p = '\0';
+    n[hclass]++;
     p = mutt_str_strdup(linebuf + read);
     if (p)
     {
@@ -602,6 +619,34 @@ void mutt_hist_read_file(void)
 
   mutt_file_fclose(&f);
   FREE(&linebuf);
+
+  if (SaveHistory == 0)
+    return;
+
+  /* Let the file grow to twice $save_history before rewriting it */
+  for (hclass = HC_FIRST; hclass < HC_LAST; hclass++)
+  {
+    if (n[hclass] > 2 * SaveHistory)
+    {
+      shrink_histfile();
+      break;
+    }
+  }
+}
+
+/**
+ * mutt_hist_compact - Shrink the history file, if it has grown enough
+ *
+ * This is called when NeoMutt is idle, and when it exits.  The file is
+ * rewritten once $save_history new entries have been appended to it.
+ */
+void mutt_hist_compact(void)
+{
+  if (!HistoryFile || (SaveHistory == 0) || (Appended < MAX(SaveHistory, 1)))
+    return;
+
+  Appended = 0;
+  shrink_histfile();
 }
 
 /**
@@ -56,6 +56,80 @@ struct Hook
   TAILQ_ENTRY(Hook) entries;
 };
 static TAILQ_HEAD(HookHead, Hook) Hooks = TAILQ_HEAD_INITIALIZER(Hooks);
+static struct Hash *HookPatterns = NULL; /**< Non-global Hooks, by pattern */
+
+#define HOOK_TYPES 18 /**< Hook type bits, up to MUTT_SHUTDOWNHOOK */
+
+/**
+ * struct HookList - The Hooks of one type, in the order they were defined
+ */
+struct HookList
+{
+  struct Hook **hooks; /**< Array of Hooks */
+  size_t count;        /**< Number of Hooks */
+  size_t size;         /**< Allocated size of the array */
+};
+
+static struct HookList HooksByType[HOOK_TYPES];
+
+/**
+ * hooks_of - Get the Hooks of one type
+ * @param type Hook type, e.g. #MUTT_FOLDERHOOK
+ * @retval ptr List of Hooks
+ */
+static struct HookList *hooks_of(int type)
+{
+  int i = 0;
+
+  while ((i < (HOOK_TYPES - 1)) && !(type & (1 << i)))
+    i++;
+  return &HooksByType[i];
+}
+
+/**
+ * hook_index_add - Add a Hook to the lists of its types
+ * @param h Hook
+ */
+static void hook_index_add(struct Hook *h)
+{
+  for (int i = 0; i < HOOK_TYPES; i++)
+  {
+    if (!(h->type & (1 << i)))
+      continue;
+
+    struct HookList *hl = &HooksByType[i];
+    if (hl->count == hl->size)
+    {
+      hl->size += 16;
+      mutt_mem_realloc(&hl->hooks, hl->size * sizeof(struct Hook *));
+    }
+    hl->hooks[hl->count++] = h;
+  }
+}
+
+/**
+ * hook_index_remove - Remove a Hook from the lists of its types
+ * @param h Hook
+ */
+static void hook_index_remove(struct Hook *h)
+{
+  for (int i = 0; i < HOOK_TYPES; i++)
+  {
+    if (!(h->type & (1 << i)))
+      continue;
+
+    struct HookList *hl = &HooksByType[i];
+    for (size_t j = 0; j < hl->count; j++)
+    {
+      if (hl->hooks[j] != h)
+        continue;
+
+      hl->count--;
+      memmove(hl->hooks + j, hl->hooks + j + 1, (hl->count - j) * sizeof(struct Hook *));
+      break;
+    }
+  }
+}
 
 static int current_hook_type = 0;
 
@@ -170,10 +244,13 @@ int mutt_parse_hook(struct Buffer *buf, struct Buffer *s, unsigned long data,
     command.data = mutt_str_strdup(path);
   }
 
+  if (!HookPatterns)
+    HookPatterns = mutt_hash_create(1031, MUTT_HASH_ALLOW_DUPS);
+
   /* check to make sure that a matching hook doesn't already exist */
-  TAILQ_FOREACH(ptr, &Hooks, entries)
+  if (data & MUTT_GLOBALHOOK)
   {
-    if (data & MUTT_GLOBALHOOK)
+    TAILQ_FOREACH(ptr, &Hooks, entries)
     {
       /* Ignore duplicate global hooks */
       if (mutt_str_strcmp(ptr->command, command.data) == 0)
@@ -182,9 +259,20 @@ int mutt_parse_hook(struct Buffer *buf, struct Buffer *s, unsigned long data,
         return 0;
       }
     }
-    else if (ptr->type == data &&
-             ptr->regex.not == not&&(mutt_str_strcmp(pattern.data, ptr->regex.pattern) == 0))
+  }
+  else
+  {
+    /* only hooks with the same pattern can match */
+    for (struct HashElem *he = mutt_hash_find_bucket(HookPatterns, NONULL(pattern.data));
+         he; he = he->next)
     {
+      ptr = he->data;
+      if ((ptr->type != data) || (ptr->regex.not != not) ||
+          (mutt_str_strcmp(pattern.data, ptr->regex.pattern) != 0))
+      {
+        continue;
+      }
+
       if (data & (MUTT_FOLDERHOOK | MUTT_SENDHOOK | MUTT_SEND2HOOK | MUTT_MESSAGEHOOK |
                   MUTT_ACCOUNTHOOK | MUTT_REPLYHOOK | MUTT_CRYPTHOOK |
                   MUTT_TIMEOUTHOOK | MUTT_STARTUPHOOK | MUTT_SHUTDOWNHOOK))
@@ -254,6 +342,9 @@ int mutt_parse_hook(struct Buffer *buf, struct Buffer *s, unsigned long data,
   ptr->regex.regex = rx;
   ptr->regex.not = not;
   TAILQ_INSERT_TAIL(&Hooks, ptr, entries);
+  hook_index_add(ptr);
+  if (ptr->regex.pattern)
+    mutt_hash_insert(HookPatterns, ptr->regex.pattern, ptr);
   return 0;
 
 error:
@@ -294,6 +385,9 @@ static void delete_hooks(int type)
     if (type == 0 || type == h->type)
     {
       TAILQ_REMOVE(&Hooks, h, entries);
+      hook_index_remove(h);
+      if (h->regex.pattern)
+        mutt_hash_delete(HookPatterns, h->regex.pattern, h);
       delete_hook(h);
     }
   }
@@ -345,6 +439,7 @@ int mutt_parse_unhook(struct Buffer *buf, struct Buffer *s, unsigned long data,
 void mutt_folder_hook(const char *path)
 {
   struct Hook *tmp = NULL;
+  struct HookList *hl = hooks_of(MUTT_FOLDERHOOK);
   struct Buffer err, token;
 
   current_hook_type = MUTT_FOLDERHOOK;
@@ -353,25 +448,24 @@ void mutt_folder_hook(const char *path)
   err.dsize = STRING;
   err.data = mutt_mem_malloc(err.dsize);
   mutt_buffer_init(&token);
-  TAILQ_FOREACH(tmp, &Hooks, entries)
+  /* The commands may define more hooks, so the list is re-read every time */
+  for (size_t i = 0; i < hl->count; i++)
   {
+    tmp = hl->hooks[i];
     if (!tmp->command)
       continue;
 
-    if (tmp->type & MUTT_FOLDERHOOK)
+    if ((regexec(tmp->regex.regex, path, 0, NULL, 0) == 0) ^ tmp->regex.not)
     {
-      if ((regexec(tmp->regex.regex, path, 0, NULL, 0) == 0) ^ tmp->regex.not)
+      if (mutt_parse_rc_line(tmp->command, &token, &err) == -1)
       {
-        if (mutt_parse_rc_line(tmp->command, &token, &err) == -1)
-        {
-          mutt_error("%s", err.data);
-          FREE(&token.data);
-          mutt_sleep(1); /* pause a moment to let the user see the error */
-          current_hook_type = 0;
-          FREE(&err.data);
+        mutt_error("%s", err.data);
+        FREE(&token.data);
+        mutt_sleep(1); /* pause a moment to let the user see the error */
+        current_hook_type = 0;
+        FREE(&err.data);
 
-          return;
-        }
+        return;
       }
     }
   }
@@ -386,15 +480,12 @@ void mutt_folder_hook(const char *path)
  */
 char *mutt_find_hook(int type, const char *pat)
 {
-  struct Hook *tmp = NULL;
+  struct HookList *hl = hooks_of(type);
 
-  TAILQ_FOREACH(tmp, &Hooks, entries)
+  for (size_t i = 0; i < hl->count; i++)
   {
-    if (tmp->type & type)
-    {
-      if (regexec(tmp->regex.regex, pat, 0, NULL, 0) == 0)
-        return tmp->command;
-    }
+    if (regexec(hl->hooks[i]->regex.regex, pat, 0, NULL, 0) == 0)
+      return hl->hooks[i]->command;
   }
   return NULL;
 }
@@ -403,6 +494,7 @@ void mutt_message_hook(struct Context *ctx, struct Header *hdr, int type)
 {
   struct Buffer err, token;
   struct Hook *hook = NULL;
+  struct HookList *hl = hooks_of(type);
   struct PatternCache cache;
 
   current_hook_type = type;
@@ -412,30 +504,27 @@ void mutt_message_hook(struct Context *ctx, struct Header *hdr, int type)
   err.data = mutt_mem_malloc(err.dsize);
   mutt_buffer_init(&token);
   memset(&cache, 0, sizeof(cache));
-  TAILQ_FOREACH(hook, &Hooks, entries)
+  for (size_t i = 0; i < hl->count; i++)
   {
+    hook = hl->hooks[i];
     if (!hook->command)
       continue;
 
-    if (hook->type & type)
+    if ((mutt_pattern_exec(hook->pattern, 0, ctx, hdr, &cache) > 0) ^ hook->regex.not)
     {
-      if ((mutt_pattern_exec(hook->pattern, 0, ctx, hdr, &cache) > 0) ^
-          hook->regex.not)
+      if (mutt_parse_rc_line(hook->command, &token, &err) == -1)
       {
-        if (mutt_parse_rc_line(hook->command, &token, &err) == -1)
-        {
-          FREE(&token.data);
-          mutt_error("%s", err.data);
-          mutt_sleep(1);
-          current_hook_type = 0;
-          FREE(&err.data);
+        FREE(&token.data);
+        mutt_error("%s", err.data);
+        mutt_sleep(1);
+        current_hook_type = 0;
+        FREE(&err.data);
 
-          return;
-        }
-        /* Executing arbitrary commands could affect the pattern results,
-         * so the cache has to be wiped */
-        memset(&cache, 0, sizeof(cache));
+        return;
       }
+      /* Executing arbitrary commands could affect the pattern results,
+       * so the cache has to be wiped */
+      memset(&cache, 0, sizeof(cache));
     }
   }
   FREE(&token.data);
@@ -448,23 +537,21 @@ static int addr_hook(char *path, size_t pathlen, int type, struct Context *ctx,
                      struct Header *hdr)
 {
   struct Hook *hook = NULL;
+  struct HookList *hl = hooks_of(type);
   struct PatternCache cache;
 
   memset(&cache, 0, sizeof(cache));
   /* determine if a matching hook exists */
-  TAILQ_FOREACH(hook, &Hooks, entries)
+  for (size_t i = 0; i < hl->count; i++)
   {
+    hook = hl->hooks[i];
     if (!hook->command)
       continue;
 
-    if (hook->type & type)
+    if ((mutt_pattern_exec(hook->pattern, 0, ctx, hdr, &cache) > 0) ^ hook->regex.not)
     {
-      if ((mutt_pattern_exec(hook->pattern, 0, ctx, hdr, &cache) > 0) ^
-          hook->regex.not)
-      {
-        mutt_make_string(path, pathlen, hook->command, ctx, hdr);
-        return 0;
-      }
+      mutt_make_string(path, pathlen, hook->command, ctx, hdr);
+      return 0;
     }
   }
 
@@ -524,11 +611,12 @@ void mutt_select_fcc(char *path, size_t pathlen, struct Header *hdr)
 static void list_hook(struct ListHead *matches, const char *match, int hook)
 {
   struct Hook *tmp = NULL;
+  struct HookList *hl = hooks_of(hook);
 
-  TAILQ_FOREACH(tmp, &Hooks, entries)
+  for (size_t i = 0; i < hl->count; i++)
   {
-    if ((tmp->type & hook) && ((match && regexec(tmp->regex.regex, match, 0, NULL, 0) == 0) ^
-                               tmp->regex.not))
+    tmp = hl->hooks[i];
+    if ((match && regexec(tmp->regex.regex, match, 0, NULL, 0) == 0) ^ tmp->regex.not)
     {
       mutt_list_insert_tail(matches, mutt_str_strdup(tmp->command));
     }
@@ -549,6 +637,7 @@ void mutt_account_hook(const char *url)
   static bool inhook = false;
 
   struct Hook *hook = NULL;
+  struct HookList *hl = hooks_of(MUTT_ACCOUNTHOOK);
   struct Buffer token;
   struct Buffer err;
 
@@ -560,9 +649,10 @@ void mutt_account_hook(const char *url)
   err.data = mutt_mem_malloc(err.dsize);
   mutt_buffer_init(&token);
 
-  TAILQ_FOREACH(hook, &Hooks, entries)
+  for (size_t i = 0; i < hl->count; i++)
   {
-    if (!(hook->command && (hook->type & MUTT_ACCOUNTHOOK)))
+    hook = hl->hooks[i];
+    if (!hook->command)
       continue;
 
     if ((regexec(hook->regex.regex, url, 0, NULL, 0) == 0) ^ hook->regex.not)
@@ -600,9 +690,11 @@ void mutt_timeout_hook(void)
   err.dsize = sizeof(buf);
   mutt_buffer_init(&token);
 
-  TAILQ_FOREACH(hook, &Hooks, entries)
+  struct HookList *hl = hooks_of(MUTT_TIMEOUTHOOK);
+  for (size_t i = 0; i < hl->count; i++)
   {
-    if (!(hook->command && (hook->type & MUTT_TIMEOUTHOOK)))
+    hook = hl->hooks[i];
+    if (!hook->command)
       continue;
 
     if (mutt_parse_rc_line(hook->command, &token, &err) == -1)
@@ -635,9 +727,11 @@ void mutt_startup_shutdown_hook(int type)
   err.dsize = sizeof(buf);
   mutt_buffer_init(&token);
 
-  TAILQ_FOREACH(hook, &Hooks, entries)
+  struct HookList *hl = hooks_of(type);
+  for (size_t i = 0; i < hl->count; i++)
   {
-    if (!(hook->command && (hook->type & type)))
+    hook = hl->hooks[i];
+    if (!hook->command)
       continue;
 
     if (mutt_parse_rc_line(hook->command, &token, &err) == -1)
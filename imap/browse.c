@@ -185,6 +185,43 @@ static int browse_add_list_result(struct ImapData *idata, const char *cmd,
   return rc == IMAP_CMD_OK ? 0 : -1;
 }
 
+/**
+ * browse_add_status - Fill in the message counts from LIST-STATUS
+ * @param idata Server data
+ * @param state Browser state
+ * @param first Index of the first entry the LIST added
+ *
+ * With LIST-STATUS (RFC5819), the server follows each selectable mailbox's
+ * LIST response with its STATUS, which went into the mailbox cache.  This
+ * saves the browser asking for each folder separately.
+ */
+static void browse_add_status(struct ImapData *idata, struct BrowserState *state, int first)
+{
+  struct ImapMbox mx;
+  struct ImapStatus *status = NULL;
+
+  for (int i = first; i < state->entrylen; i++)
+  {
+    struct FolderFile *ff = &state->entry[i];
+
+    if (!ff->selectable || imap_parse_path(ff->name, &mx) < 0)
+      continue;
+
+    /* The selected mailbox's counts come from the Context */
+    if (mx.mbox && *mx.mbox && !(idata->mailbox && (imap_mxcmp(mx.mbox, idata->mailbox) == 0)))
+    {
+      status = imap_mboxcache_get(idata, mx.mbox, false);
+      if (status)
+      {
+        ff->has_buffy = true;
+        ff->msg_count = status->messages;
+        ff->msg_unread = status->unseen;
+      }
+    }
+    FREE(&mx.mbox);
+  }
+}
+
 /**
  * imap_browse - IMAP hook into the folder browser
  * @param path  Current folder
@@ -206,6 +243,8 @@ int imap_browse(char *path, struct BrowserState *state)
   char ctmp;
   bool showparents = false;
   bool save_lsub;
+  bool list_status;
+  int first;
   struct ImapMbox mx;
 
   if (imap_parse_path(path, &mx))
@@ -333,9 +372,15 @@ int imap_browse(char *path, struct BrowserState *state)
   snprintf(buf, sizeof(buf), "%s%%", mbox);
   imap_munge_mbox_name(idata, munged_mbox, sizeof(munged_mbox), buf);
   mutt_debug(3, "%s\n", munged_mbox);
-  snprintf(buf, sizeof(buf), "%s \"\" %s", list_cmd, munged_mbox);
+  /* LSUB can't return STATUS */
+  list_status = !ImapListSubscribed && mutt_bit_isset(idata->capabilities, LIST_STATUS);
+  snprintf(buf, sizeof(buf), "%s \"\" %s%s", list_cmd, munged_mbox,
+           list_status ? " RETURN (STATUS (MESSAGES UNSEEN RECENT))" : "");
+  first = state->entrylen;
   if (browse_add_list_result(idata, buf, state, 0))
     goto fail;
+  if (list_status)
+    browse_add_status(idata, state, first);
 
   if (!state->entrylen)
   {
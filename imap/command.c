@@ -45,6 +45,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
 #include <time.h>
 #include "imap_private.h"
 #include "mutt/mutt.h"
@@ -61,6 +62,7 @@
 #include "mutt_socket.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "url.h"
 
@@ -74,12 +76,26 @@
  * @note Gmail documents one string but use another, so we support both.
  */
 static const char *const Capabilities[] = {
-  "IMAP4",     "IMAP4rev1",     "STATUS",      "ACL",
-  "NAMESPACE", "AUTH=CRAM-MD5", "AUTH=GSSAPI", "AUTH=ANONYMOUS",
-  "STARTTLS",  "LOGINDISABLED", "IDLE",        "SASL-IR",
-  "ENABLE",    "X-GM-EXT-1",    "X-GM-EXT1",   NULL,
+  "IMAP4",      "IMAP4rev1",     "STATUS",      "ACL",
+  "NAMESPACE",  "AUTH=CRAM-MD5", "AUTH=GSSAPI", "AUTH=ANONYMOUS",
+  "STARTTLS",   "LOGINDISABLED", "IDLE",        "SASL-IR",
+  "ENABLE",     "CONDSTORE",     "QRESYNC",     "COMPRESS=DEFLATE",
+  "ESEARCH",    "NOTIFY",        "MOVE",        "LIST-STATUS",
+  "LITERAL+",   "X-GM-EXT-1",    "X-GM-EXT1",   NULL,
 };
 
+/**
+ * now_us - Get the current time in microseconds
+ * @retval num Microseconds since the epoch
+ */
+static long long now_us(void)
+{
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (long long) tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
 /**
  * cmd_queue_full - Is the IMAP command queue full?
  * @param idata Server data
@@ -87,10 +103,25 @@ static const char *const Capabilities[] = {
  */
 static bool cmd_queue_full(struct ImapData *idata)
 {
-  if ((idata->nextcmd + 1) % idata->cmdslots == idata->lastcmd)
-    return true;
+  int queued = (idata->nextcmd - idata->lastcmd + idata->cmdslots) % idata->cmdslots;
 
-  return false;
+  return queued > idata->pipeline;
+}
+
+/**
+ * cmd_running - Count the commands still waiting for a response
+ * @param idata Server data
+ * @retval num Number of commands
+ */
+static int cmd_running(struct ImapData *idata)
+{
+  int running = 0;
+
+  for (int c = idata->lastcmd; c != idata->nextcmd; c = (c + 1) % idata->cmdslots)
+    if (idata->cmds[c].state == IMAP_CMD_NEW)
+      running++;
+
+  return running;
 }
 
 /**
@@ -117,10 +148,13 @@ static struct ImapCommand *cmd_new(struct ImapData *idata)
     idata->seqno = 0;
 
   cmd->state = IMAP_CMD_NEW;
+  cmd->sent = 0;
 
   return cmd;
 }
 
+static int cmd_drain(struct ImapData *idata, int flags);
+
 /**
  * cmd_queue - Add a IMAP command to the queue
  * @param idata  Server data
@@ -140,9 +174,8 @@ static int cmd_queue(struct ImapData *idata, const char *cmdstr, int flags)
   {
     mutt_debug(3, "Draining IMAP command pipeline\n");
 
-    rc = imap_exec(idata, NULL, IMAP_CMD_FAIL_OK | (flags & IMAP_CMD_POLL));
-
-    if (rc < 0 && rc != -2)
+    rc = cmd_drain(idata, flags);
+    if (rc < 0)
       return rc;
   }
 
@@ -150,6 +183,12 @@ static int cmd_queue(struct ImapData *idata, const char *cmdstr, int flags)
   if (!cmd)
     return IMAP_CMD_BAD;
 
+  /* the name is the first word, or two for UID commands */
+  size_t len = strcspn(cmdstr, " ");
+  if ((len == 3) && (mutt_str_strncasecmp(cmdstr, "UID ", 4) == 0))
+    len += 1 + strcspn(cmdstr + 4, " ");
+  mutt_str_strnfcpy(cmd->name, cmdstr, len, sizeof(cmd->name));
+
   if (mutt_buffer_printf(idata->cmdbuf, "%s %s\r\n", cmd->seq, cmdstr) < 0)
     return IMAP_CMD_BAD;
 
@@ -166,6 +205,11 @@ static void cmd_handle_fatal(struct ImapData *idata)
 
   if ((idata->state >= IMAP_SELECTED) && (idata->reopen & IMAP_REOPEN_ALLOW))
   {
+#ifdef USE_HCACHE
+    /* keep the flag changes the server never got, for the next open */
+    if (idata->ctx->changed)
+      imap_journal_save(idata);
+#endif
     mx_fastclose_mailbox(idata->ctx);
     mutt_socket_close(idata->conn);
     mutt_error(_("Mailbox %s@%s closed"), idata->conn->account.login,
@@ -215,6 +259,12 @@ static int cmd_start(struct ImapData *idata, const char *cmdstr, int flags)
                            flags & IMAP_CMD_PASS ? IMAP_LOG_PASS : IMAP_LOG_CMD);
   idata->cmdbuf->dptr = idata->cmdbuf->data;
 
+  /* note when the commands went, to measure the round trip */
+  long long now = now_us();
+  for (int c = idata->lastcmd; c != idata->nextcmd; c = (c + 1) % idata->cmdslots)
+    if ((idata->cmds[c].state == IMAP_CMD_NEW) && !idata->cmds[c].sent)
+      idata->cmds[c].sent = now;
+
   /* unidle when command queue is flushed */
   if (idata->state == IMAP_IDLE)
     idata->state = IMAP_SELECTED;
@@ -241,48 +291,166 @@ static int cmd_status(const char *s)
 }
 
 /**
- * cmd_parse_expunge - Parse expunge command
+ * cmd_drain - Make room in a full command pipeline
  * @param idata Server data
- * @param s     String containing MSN of message to expunge
+ * @param flags Flags, e.g. #IMAP_CMD_POLL
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * Send the queued commands, then wait until only half of the pipeline is still
+ * running, so the server keeps working while more commands are queued.
  *
- * cmd_parse_expunge: mark headers with new sequence ID and mark idata to be
- * reopened at our earliest convenience
+ * If that meant waiting for the network, the pipeline is too shallow for the
+ * round trip time, so it's made deeper, up to #IMAP_PIPELINE_MAX.  If the
+ * server rejected a command as BAD, it may not cope with pipelining that deep,
+ * so it's made shallower.  $imap_pipeline_depth is where it starts.
  */
-static void cmd_parse_expunge(struct ImapData *idata, const char *s)
+static int cmd_drain(struct ImapData *idata, int flags)
 {
-  unsigned int exp_msn;
-  struct Header *h = NULL;
+  long long start;
+  bool bad = false;
+  int rc;
 
-  mutt_debug(2, "Handling EXPUNGE\n");
+  if ((idata->cmdbuf->dptr != idata->cmdbuf->data) && (cmd_start(idata, NULL, 0) < 0))
+  {
+    cmd_handle_fatal(idata);
+    return -1;
+  }
+
+  if ((flags & IMAP_CMD_POLL) && (ImapPollTimeout > 0) &&
+      (mutt_socket_poll(idata->conn, ImapPollTimeout)) == 0)
+  {
+    mutt_error(_("Connection to %s timed out"), idata->conn->account.host);
+    mutt_sleep(2);
+    cmd_handle_fatal(idata);
+    return -1;
+  }
 
-  if (mutt_str_atoui(s, &exp_msn) < 0 || exp_msn < 1 || exp_msn > idata->max_msn)
+  start = now_us();
+  mutt_sig_allow_interrupt(1);
+  while (cmd_running(idata) > idata->pipeline / 2)
+  {
+    rc = imap_cmd_step(idata);
+    if (idata->status == IMAP_FATAL)
+      break;
+    if ((rc != IMAP_CMD_RESPOND) && (idata->buf[0] != '*') &&
+        (cmd_status(idata->buf) == IMAP_CMD_BAD))
+    {
+      bad = true;
+    }
+  }
+  mutt_sig_allow_interrupt(0);
+
+  if (idata->status == IMAP_FATAL)
+    return -1;
+
+  /* skip any commands that finished out of order */
+  while ((idata->lastcmd != idata->nextcmd) &&
+         (idata->cmds[idata->lastcmd].state != IMAP_CMD_NEW))
+  {
+    idata->lastcmd = (idata->lastcmd + 1) % idata->cmdslots;
+  }
+
+  if (idata->pipeline == 0)
+    return 0;
+
+  if (bad && (idata->pipeline > 1))
+  {
+    idata->pipeline /= 2;
+    mutt_debug(2, "IMAP pipeline depth down to %d\n", idata->pipeline);
+  }
+  else if (!bad && (idata->pipeline < idata->cmdslots - 2) &&
+           (4 * (now_us() - start) / 1000 > idata->rtt))
+  {
+    idata->pipeline = MIN(2 * idata->pipeline, idata->cmdslots - 2);
+    mutt_debug(2, "IMAP pipeline depth up to %d (rtt %lldms)\n", idata->pipeline,
+               idata->rtt);
+  }
+
+  return 0;
+}
+
+/**
+ * cmd_expunge_msn - Remove a message from the MSN index
+ * @param idata   Server data
+ * @param exp_msn MSN of the expunged message
+ *
+ * Mark the header as expunged and mark idata to be reopened at our earliest
+ * convenience
+ */
+static void cmd_expunge_msn(struct ImapData *idata, unsigned int exp_msn)
+{
+  struct Header *h = NULL;
+
+  if (exp_msn < 1 || exp_msn > idata->max_msn)
     return;
 
-  h = idata->msn_index[exp_msn - 1];
+  h = imap_msn_get(idata, exp_msn);
   if (h)
   {
     /* imap_expunge_mailbox() will rewrite h->index.
      * It needs to resort using SORT_ORDER anyway, so setting to INT_MAX
      * makes the code simpler and possibly more efficient. */
     h->index = INT_MAX;
-    HEADER_DATA(h)->msn = 0;
   }
 
-  /* decrement seqno of those above. */
-  for (unsigned int cur = exp_msn; cur < idata->max_msn; cur++)
-  {
-    h = idata->msn_index[cur];
-    if (h)
-      HEADER_DATA(h)->msn--;
-    idata->msn_index[cur - 1] = h;
-  }
+  /* one of the messages not read yet, see $imap_fetch_window */
+  if (exp_msn <= idata->msn_unread)
+    idata->msn_unread--;
 
-  idata->msn_index[idata->max_msn - 1] = NULL;
-  idata->max_msn--;
+  /* the later messages move down, see imap_msn_remove() */
+  imap_msn_remove(idata, exp_msn);
 
   idata->reopen |= IMAP_EXPUNGE_PENDING;
 }
 
+/**
+ * cmd_parse_expunge - Parse expunge command
+ * @param idata Server data
+ * @param s     String containing MSN of message to expunge
+ */
+static void cmd_parse_expunge(struct ImapData *idata, const char *s)
+{
+  unsigned int exp_msn;
+
+  mutt_debug(2, "Handling EXPUNGE\n");
+
+  if (mutt_str_atoui(s, &exp_msn) < 0)
+    return;
+
+  cmd_expunge_msn(idata, exp_msn);
+}
+
+/**
+ * cmd_parse_vanished - Parse a VANISHED response
+ * @param idata Server data
+ * @param s     String containing the UIDs of the expunged messages
+ *
+ * Once QRESYNC is enabled, the server reports expunged messages by UID, with
+ * VANISHED, rather than with EXPUNGE.  "VANISHED (EARLIER)" only answers a
+ * UID FETCH (VANISHED), which imap_read_headers() handles itself.
+ */
+static void cmd_parse_vanished(struct ImapData *idata, const char *s)
+{
+  unsigned int first, last;
+  struct Header *h = NULL;
+
+  mutt_debug(2, "Handling VANISHED\n");
+
+  if (mutt_str_strncasecmp("(EARLIER)", s, 9) == 0)
+    return;
+
+  while (imap_seqset_next(&s, &first, &last) == 0)
+  {
+    for (unsigned int uid = first; uid && (uid <= last); uid++)
+    {
+      h = imap_uid_hash_find(idata->uid_hash, uid);
+      if (h && HEADER_DATA(h)->slot)
+        cmd_expunge_msn(idata, imap_msn_of(idata, h));
+    }
+  }
+}
+
 /**
  * cmd_parse_fetch - Load fetch response into ImapData
  * @param idata Server data
@@ -306,7 +474,7 @@ static void cmd_parse_fetch(struct ImapData *idata, char *s)
     return;
   }
 
-  h = idata->msn_index[msn - 1];
+  h = imap_msn_get(idata, msn);
   if (!h || !h->active)
   {
     mutt_debug(3, "#2 FETCH response ignored for this message\n");
@@ -358,6 +526,17 @@ static void cmd_parse_fetch(struct ImapData *idata, char *s)
       }
       s = imap_next_word(s);
     }
+    else if (mutt_str_strncasecmp("MODSEQ", s, 6) == 0)
+    {
+      /* RFC7162: we only track the mailbox's HIGHESTMODSEQ */
+      s = strchr(s, ')');
+      if (!s)
+      {
+        mutt_debug(1, "Malformed FETCH response\n");
+        return;
+      }
+      s++;
+    }
     else if (*s == ')')
       s++; /* end of request */
     else if (*s)
@@ -616,12 +795,65 @@ static void cmd_parse_search(struct ImapData *idata, const char *s)
   {
     if (mutt_str_atoui(s, &uid) < 0)
       continue;
-    h = (struct Header *) mutt_hash_int_find(idata->uid_hash, uid);
+    h = imap_uid_hash_find(idata->uid_hash, uid);
     if (h)
       h->matched = true;
   }
 }
 
+/**
+ * cmd_parse_esearch - Store ESEARCH response for later use
+ * @param idata Server data
+ * @param s     Command string with search results
+ *
+ * Only the ALL result is used, e.g. `ESEARCH (TAG "a3") UID ALL 4:9,12`
+ */
+static void cmd_parse_esearch(struct ImapData *idata, char *s)
+{
+  unsigned int first, last;
+  struct Header *h = NULL;
+
+  mutt_debug(2, "Handling ESEARCH\n");
+
+  s = imap_next_word(s);
+  if (*s == '(')
+  {
+    s = strchr(s, ')');
+    if (!s)
+      return;
+    s++;
+    SKIPWS(s);
+  }
+
+  while (*s && !((mutt_str_strncasecmp("ALL", s, 3) == 0) && ISSPACE(s[3])))
+    s = imap_next_word(s);
+  if (!*s)
+    return;
+
+  const char *set = imap_next_word(s);
+  while (imap_seqset_next(&set, &first, &last) == 0)
+  {
+    if (idata->ctx && ((last - first) > (unsigned int) idata->ctx->msgcount))
+    {
+      /* a sparse range, check the messages we know about instead */
+      for (int i = 0; i < idata->ctx->msgcount; i++)
+      {
+        h = idata->ctx->hdrs[i];
+        if ((HEADER_DATA(h)->uid >= first) && (HEADER_DATA(h)->uid <= last))
+          h->matched = true;
+      }
+      continue;
+    }
+
+    for (unsigned int uid = first; uid && (uid <= last); uid++)
+    {
+      h = imap_uid_hash_find(idata->uid_hash, uid);
+      if (h)
+        h->matched = true;
+    }
+  }
+}
+
 /**
  * cmd_parse_status - Parse status from server
  * @param idata Server data
@@ -639,8 +871,9 @@ static void cmd_parse_status(struct ImapData *idata, char *s)
   unsigned long ulcount;
   unsigned int count;
   struct ImapStatus *status = NULL;
-  unsigned int olduv, oldun;
+  unsigned int olduv, oldun, oldmsgs;
   unsigned int litlen;
+  bool got_unseen = false;
   short new = 0;
   short new_msg_count = 0;
 
@@ -670,6 +903,7 @@ static void cmd_parse_status(struct ImapData *idata, char *s)
   status = imap_mboxcache_get(idata, mailbox, 1);
   olduv = status->uidvalidity;
   oldun = status->uidnext;
+  oldmsgs = status->messages;
 
   if (*s++ != '(')
   {
@@ -701,7 +935,10 @@ static void cmd_parse_status(struct ImapData *idata, char *s)
     else if (mutt_str_strncmp("UIDVALIDITY", s, 11) == 0)
       status->uidvalidity = count;
     else if (mutt_str_strncmp("UNSEEN", s, 6) == 0)
+    {
       status->unseen = count;
+      got_unseen = true;
+    }
 
     s = value;
     if (*s && *s != ')')
@@ -720,6 +957,18 @@ static void cmd_parse_status(struct ImapData *idata, char *s)
     return;
   }
 
+  /* Under NOTIFY the server pushes this when the mailbox changes.  If it
+   * doesn't say how many messages are unseen, only take it as a hint and
+   * have the next imap_buffy_check() ask for the full status. */
+  if (idata->notify && olduv && !got_unseen &&
+      ((status->uidnext != oldun) || (status->messages != oldmsgs)))
+  {
+    status->notified = false;
+    status->uidnext = oldun;
+    status->messages = oldmsgs;
+    return;
+  }
+
   mutt_debug(3, "Running default STATUS handler\n");
 
   /* should perhaps move this code back to imap_buffy_check */
@@ -812,6 +1061,66 @@ static void cmd_parse_enabled(struct ImapData *idata, const char *s)
     {
       idata->unicode = 1;
     }
+    if (mutt_str_strncasecmp(s, "QRESYNC", 7) == 0)
+      idata->qresync = true;
+  }
+}
+
+/**
+ * cmd_parse_copyuid - Record where COPY or MOVE put the messages
+ * @param idata Server data
+ * @param s     String after "OK [COPYUID", e.g. " 38505 304,319:320 3956:3958]"
+ *
+ * RFC4315: the source and destination UIDs are listed in the same order.  The
+ * pairs are added to idata->copyuid, since a long message set may have been
+ * split over several commands.
+ */
+static void cmd_parse_copyuid(struct ImapData *idata, const char *s)
+{
+  struct ImapCopyUid *cu = &idata->copyuid;
+  unsigned int uidvalidity, first, last;
+  char dst[LONG_STRING];
+  const char *p = NULL;
+
+  mutt_debug(2, "Handling COPYUID\n");
+
+  SKIPWS(s);
+  if (mutt_str_atoui(s, &uidvalidity) < 0 || !uidvalidity)
+    return;
+  s = imap_next_word((char *) s);
+  p = imap_next_word((char *) s);
+  mutt_str_strfcpy(dst, p, MIN(sizeof(dst), strcspn(p, "] ") + 1));
+
+  if (cu->count && (cu->uidvalidity != uidvalidity))
+    cu->count = 0;
+  cu->uidvalidity = uidvalidity;
+
+  size_t start = cu->count;
+  while (imap_seqset_next(&s, &first, &last) == 0)
+  {
+    for (unsigned int uid = first; uid && (uid <= last); uid++)
+    {
+      if (cu->count == cu->size)
+      {
+        cu->size += 256;
+        mutt_mem_realloc(&cu->uids, cu->size * 2 * sizeof(unsigned int));
+      }
+      cu->uids[2 * cu->count] = uid;
+      cu->uids[2 * cu->count + 1] = 0;
+      cu->count++;
+    }
+  }
+
+  size_t i = start;
+  p = dst;
+  while (imap_seqset_next(&p, &first, &last) == 0)
+    for (unsigned int uid = first; uid && (uid <= last) && (i < cu->count); uid++)
+      cu->uids[2 * i++ + 1] = uid;
+
+  if ((i != cu->count) || *p)
+  {
+    mutt_debug(1, "Malformed COPYUID\n");
+    cu->count = start;
   }
 }
 
@@ -875,12 +1184,17 @@ static int cmd_handle_untagged(struct ImapData *idata)
     else if (mutt_str_strncasecmp("FETCH", s, 5) == 0)
       cmd_parse_fetch(idata, pn);
   }
+  else if ((idata->state >= IMAP_SELECTED) &&
+           (mutt_str_strncasecmp("VANISHED", s, 8) == 0))
+    cmd_parse_vanished(idata, pn);
   else if (mutt_str_strncasecmp("CAPABILITY", s, 10) == 0)
     cmd_parse_capability(idata, s);
   else if (mutt_str_strncasecmp("OK [CAPABILITY", s, 14) == 0)
     cmd_parse_capability(idata, pn);
   else if (mutt_str_strncasecmp("OK [CAPABILITY", pn, 14) == 0)
     cmd_parse_capability(idata, imap_next_word(pn));
+  else if (mutt_str_strncasecmp("OK [COPYUID", s, 11) == 0)
+    cmd_parse_copyuid(idata, s + 11);
   else if (mutt_str_strncasecmp("LIST", s, 4) == 0)
     cmd_parse_list(idata, s);
   else if (mutt_str_strncasecmp("LSUB", s, 4) == 0)
@@ -889,6 +1203,8 @@ static int cmd_handle_untagged(struct ImapData *idata)
     cmd_parse_myrights(idata, s);
   else if (mutt_str_strncasecmp("SEARCH", s, 6) == 0)
     cmd_parse_search(idata, s);
+  else if (mutt_str_strncasecmp("ESEARCH", s, 7) == 0)
+    cmd_parse_esearch(idata, s);
   else if (mutt_str_strncasecmp("STATUS", s, 6) == 0)
     cmd_parse_status(idata, s);
   else if (mutt_str_strncasecmp("ENABLED", s, 7) == 0)
@@ -937,15 +1253,14 @@ int imap_cmd_start(struct ImapData *idata, const char *cmdstr)
 }
 
 /**
- * imap_cmd_step - Reads server responses from an IMAP command
+ * cmd_step - Read and handle one server response
  * @param idata Server data
  * @retval  0 Success
  * @retval <0 Failure, e.g. #IMAP_CMD_BAD
  *
- * detects tagged completion response, handles untagged messages, can read
- * arbitrarily large strings (using malloc, so don't make it _too_ large!).
+ * See imap_cmd_step()
  */
-int imap_cmd_step(struct ImapData *idata)
+static int cmd_step(struct ImapData *idata)
 {
   size_t len = 0;
   int c;
@@ -965,7 +1280,7 @@ int imap_cmd_step(struct ImapData *idata)
   {
     if (len == idata->blen)
     {
-      mutt_mem_realloc(&idata->buf, idata->blen + IMAP_CMD_BUFSIZE);
+      mutt_mem_tag_realloc(MEM_IMAP, &idata->buf, idata->blen, idata->blen + IMAP_CMD_BUFSIZE);
       idata->blen = idata->blen + IMAP_CMD_BUFSIZE;
       mutt_debug(3, "grew buffer to %u bytes\n", idata->blen);
     }
@@ -991,7 +1306,7 @@ int imap_cmd_step(struct ImapData *idata)
   /* don't let one large string make cmd->buf hog memory forever */
   if ((idata->blen > IMAP_CMD_BUFSIZE) && (len <= IMAP_CMD_BUFSIZE))
   {
-    mutt_mem_realloc(&idata->buf, IMAP_CMD_BUFSIZE);
+    mutt_mem_tag_realloc(MEM_IMAP, &idata->buf, idata->blen, IMAP_CMD_BUFSIZE);
     idata->blen = IMAP_CMD_BUFSIZE;
     mutt_debug(3, "shrank buffer to %u bytes\n", idata->blen);
   }
@@ -1027,10 +1342,21 @@ int imap_cmd_step(struct ImapData *idata)
     {
       if (mutt_str_strncmp(idata->buf, cmd->seq, SEQLEN) == 0)
       {
+        long long elapsed = cmd->sent ? now_us() - cmd->sent : 0;
+        if (cmd->sent)
+          mutt_socket_stats_cmd(idata->conn, cmd->name, elapsed);
+
         if (!stillrunning)
         {
           /* first command in queue has finished - move queue pointer up */
           idata->lastcmd = (idata->lastcmd + 1) % idata->cmdslots;
+
+          /* it wasn't waiting behind another command, so time it */
+          if (cmd->sent)
+          {
+            long long rtt = elapsed / 1000;
+            idata->rtt = idata->rtt ? (7 * idata->rtt + rtt) / 8 : rtt;
+          }
         }
         cmd->state = cmd_status(idata->buf);
         /* bogus - we don't know which command result to return here. Caller
@@ -1055,6 +1381,23 @@ int imap_cmd_step(struct ImapData *idata)
   return rc;
 }
 
+/**
+ * imap_cmd_step - Reads server responses from an IMAP command
+ * @param idata Server data
+ * @retval  0 Success
+ * @retval <0 Failure, e.g. #IMAP_CMD_BAD
+ *
+ * detects tagged completion response, handles untagged messages, can read
+ * arbitrarily large strings (using malloc, so don't make it _too_ large!).
+ */
+int imap_cmd_step(struct ImapData *idata)
+{
+  mutt_trace_begin("imap_cmd_step");
+  int rc = cmd_step(idata);
+  mutt_trace_end("imap_cmd_step");
+  return rc;
+}
+
 /**
  * imap_code - Was the command successful
  * @param s IMAP command status
@@ -41,7 +41,9 @@
  * | imap_exec_msgset()           | Prepare commands for all messages matching conditions
  * | imap_expunge_mailbox()       | Purge messages from the server
  * | imap_fast_trash()            | Use server COPY command to copy deleted messages to trash
+ * | imap_flag_delta()            | Find the flags a message needs added and removed
  * | imap_has_flag()              | Does the flag exist in the list
+ * | imap_keyword_diff()          | List the keywords of one list that aren't in another
  * | imap_logout()                | Gracefully log out of server
  * | imap_logout_all()            | close all open connections
  * | imap_mboxcache_free()        | Free the cached ImapStatus
@@ -50,9 +52,13 @@
  * | imap_read_literal()          | Read bytes bytes from server into file
  * | imap_rename_mailbox()        | Rename a mailbox
  * | imap_search()                | Find a matching mailbox
+ * | imap_search_matched()        | Did the server match a message?
  * | imap_status()                | Get the status of a mailbox
  * | imap_subscribe()             | Subscribe to a mailbox
+ * | imap_sync_flags()            | Queue the flag changes of the mailbox for the server
  * | imap_sync_message_for_copy() | Update server to reflect the flags of a single message
+ * | imap_window_edge()           | Find the oldest message read so far
+ * | imap_window_grow()           | Read more of the headers left out by $imap_fetch_window
  *
  * | Data               | Description
  * | :----------------- | :--------------------------------------------------
@@ -96,10 +102,12 @@
 #include "message.h"
 #include "mutt_account.h"
 #include "mutt_curses.h"
+#include "mutt_menu.h"
 #include "mutt_socket.h"
 #include "mx.h"
 #include "options.h"
 #include "pattern.h"
+#include "perf.h"
 #include "protos.h"
 #include "sort.h"
 #include "tags.h"
@@ -330,42 +338,304 @@ static bool compare_flags_for_copy(struct Header *h)
 }
 
 /**
- * sync_helper - Sync flag changes to the server
+ * struct FlagDelta - Messages that need the same flags added and removed
+ */
+struct FlagDelta
+{
+  char *add;    /**< Flags to add, space-separated, or NULL */
+  char *remove; /**< Flags to remove, space-separated, or NULL */
+  int *msgs;    /**< Positions in ctx->hdrs, in ascending order */
+  int count;    /**< Number of messages */
+  int size;     /**< Size of the msgs array */
+};
+
+/**
+ * has_keyword - Is a keyword in a list?
+ * @param list Space-separated keywords
+ * @param kw   Keyword
+ * @param len  Length of the keyword
+ * @retval true The keyword is in the list
+ */
+static bool has_keyword(const char *list, const char *kw, size_t len)
+{
+  while (list && *list)
+  {
+    SKIPWS(list);
+    size_t wlen = strcspn(list, " ");
+    if ((wlen == len) && (mutt_str_strncasecmp(list, kw, len) == 0))
+      return true;
+    list += wlen;
+  }
+
+  return false;
+}
+
+/**
+ * imap_keyword_diff - List the keywords of one list that aren't in another
+ * @param out Buffer for the result, appended to
+ * @param a   Space-separated keywords
+ * @param b   Space-separated keywords
+ */
+void imap_keyword_diff(struct Buffer *out, const char *a, const char *b)
+{
+  while (a && *a)
+  {
+    SKIPWS(a);
+    size_t len = strcspn(a, " ");
+    if (len && !has_keyword(b, a, len))
+    {
+      if (out->dptr != out->data)
+        mutt_buffer_addch(out, ' ');
+      mutt_buffer_add(out, a, len);
+    }
+    a += len;
+  }
+}
+
+/**
+ * flag_change - Add a flag to the delta of a message, if it has changed
+ * @param idata  Server data
+ * @param right  ACL, e.g. #MUTT_ACL_DELETE
+ * @param local  Is the flag set locally?
+ * @param server Is the flag set on the server?
+ * @param name   Name of server flag
+ * @param add    Buffer for the flags to add
+ * @param remove Buffer for the flags to remove
+ */
+static void flag_change(struct ImapData *idata, int right, bool local, bool server,
+                        const char *name, struct Buffer *add, struct Buffer *remove)
+{
+  if (local == server)
+    return;
+
+  if (!mutt_bit_isset(idata->ctx->rights, right))
+    return;
+
+  if (right == MUTT_ACL_WRITE && !imap_has_flag(&idata->flags, name))
+    return;
+
+  struct Buffer *b = local ? add : remove;
+  if (b->dptr != b->data)
+    mutt_buffer_addch(b, ' ');
+  mutt_buffer_addstr(b, name);
+}
+
+/**
+ * imap_flag_delta - Find the flags a message needs added and removed
+ * @param idata  Server data
+ * @param h      Email
+ * @param copy   Leave \Deleted alone (before a COPY)
+ * @param add    Buffer for the flags to add, space-separated
+ * @param remove Buffer for the flags to remove, space-separated
+ *
+ * The local flags, and keywords, are compared with the last ones seen on the
+ * server.  Flags the mailbox doesn't allow are left out.
+ */
+void imap_flag_delta(struct ImapData *idata, struct Header *h, bool copy,
+                     struct Buffer *add, struct Buffer *remove)
+{
+  struct ImapHeaderData *hd = HEADER_DATA(h);
+
+  mutt_buffer_reset(add);
+  mutt_buffer_reset(remove);
+
+  if (!copy)
+    flag_change(idata, MUTT_ACL_DELETE, h->deleted, hd->deleted, "\\Deleted", add, remove);
+  flag_change(idata, MUTT_ACL_WRITE, h->flagged, hd->flagged, "\\Flagged", add, remove);
+  flag_change(idata, MUTT_ACL_WRITE, h->old, hd->old, "Old", add, remove);
+  flag_change(idata, MUTT_ACL_SEEN, h->read, hd->read, "\\Seen", add, remove);
+  flag_change(idata, MUTT_ACL_WRITE, h->replied, hd->replied, "\\Answered", add, remove);
+
+  if (mutt_bit_isset(idata->ctx->rights, MUTT_ACL_WRITE))
+  {
+    char *tags = driver_tags_get_with_hidden(&h->tags);
+    imap_keyword_diff(add, tags, hd->flags_remote);
+    imap_keyword_diff(remove, hd->flags_remote, tags);
+    FREE(&tags);
+  }
+}
+
+/**
+ * store_group - Queue the UID STOREs for a group of messages
  * @param idata Server data
- * @param right ACL, e.g. #MUTT_ACL_DELETE
- * @param flag  Mutt flag, e.g. MUTT_DELETED
- * @param name  Name of server flag
- * @retval >=0 Success, number of messages
+ * @param g     Group of messages
+ * @param sign  '+' to add the flags, '-' to remove them
+ * @param flags Flags, space-separated
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * Runs of adjacent messages are sent as UID ranges.
+ */
+static int store_group(struct ImapData *idata, struct FlagDelta *g, char sign,
+                       const char *flags)
+{
+  struct Header **hdrs = idata->ctx->hdrs;
+  struct Buffer *cmd = mutt_buffer_new();
+  int rc = 0;
+
+  for (int i = 0; i < g->count;)
+  {
+    cmd->dptr = cmd->data;
+    mutt_buffer_addstr(cmd, "UID STORE ");
+    for (bool first = true; (i < g->count) && (cmd->dptr - cmd->data < IMAP_MAX_CMDLEN); i++)
+    {
+      unsigned int uid = HEADER_DATA(hdrs[g->msgs[i]])->uid;
+      while ((i + 1 < g->count) && (g->msgs[i + 1] == g->msgs[i] + 1))
+        i++;
+
+      mutt_buffer_printf(cmd, first ? "%u" : ",%u", uid);
+      if (HEADER_DATA(hdrs[g->msgs[i]])->uid != uid)
+        mutt_buffer_printf(cmd, ":%u", HEADER_DATA(hdrs[g->msgs[i]])->uid);
+      first = false;
+    }
+    mutt_buffer_printf(cmd, " %cFLAGS.SILENT (%s)", sign, flags);
+
+    if (imap_exec(idata, cmd->data, IMAP_CMD_QUEUE) != 0)
+    {
+      rc = -1;
+      break;
+    }
+  }
+
+  mutt_buffer_free(&cmd);
+  return rc;
+}
+
+/**
+ * imap_sync_flags - Queue the flag changes of the mailbox for the server
+ * @param idata Server data
+ * @param copy  Only the tagged messages, leaving \Deleted alone (before a COPY)
+ * @retval >=0 Number of messages changed
  * @retval  -1 Failure
+ *
+ * Changed messages are grouped by the exact flags, and keywords, that have to
+ * be added and removed.  Each group needs one UID STORE for each of those,
+ * however many messages it has.
+ *
+ * For a copy, the messages are then marked as synced: the STOREs are
+ * pipelined with the COPY.
  */
-static int sync_helper(struct ImapData *idata, int right, int flag, const char *name)
+int imap_sync_flags(struct ImapData *idata, bool copy)
 {
+  struct Context *ctx = idata->ctx;
+  struct Header **hdrs = NULL;
+  struct FlagDelta **groups = NULL;
+  int ngroups = 0, gsize = 0;
   int count = 0;
-  int rc;
-  char buf[LONG_STRING];
+  int rc = 0;
 
-  if (!idata->ctx)
-    return -1;
+  /* see imap_exec_msgset() */
+  short oldsort = Sort;
+  if (Sort != SORT_ORDER)
+  {
+    hdrs = ctx->hdrs;
+    ctx->hdrs = mutt_mem_malloc(ctx->msgcount * sizeof(struct Header *));
+    memcpy(ctx->hdrs, hdrs, ctx->msgcount * sizeof(struct Header *));
 
-  if (!mutt_bit_isset(idata->ctx->rights, right))
-    return 0;
+    Sort = SORT_ORDER;
+    qsort(ctx->hdrs, ctx->msgcount, sizeof(struct Header *), mutt_get_sort_func(SORT_ORDER));
+  }
 
-  if (right == MUTT_ACL_WRITE && !imap_has_flag(&idata->flags, name))
-    return 0;
+  struct Hash *hash = mutt_hash_create(64, MUTT_HASH_STRDUP_KEYS);
+  struct Buffer *add = mutt_buffer_new();
+  struct Buffer *remove = mutt_buffer_new();
+  struct Buffer *key = mutt_buffer_new();
 
-  snprintf(buf, sizeof(buf), "+FLAGS.SILENT (%s)", name);
-  rc = imap_exec_msgset(idata, "UID STORE", buf, flag, 1, 0);
-  if (rc < 0)
-    return rc;
-  count += rc;
+  for (int n = 0; n < ctx->msgcount; n++)
+  {
+    struct Header *h = ctx->hdrs[n];
 
-  buf[0] = '-';
-  rc = imap_exec_msgset(idata, "UID STORE", buf, flag, 1, 1);
-  if (rc < 0)
-    return rc;
-  count += rc;
+    /* don't include pending expunged messages */
+    if (!h->active || !h->changed || (copy && !h->tagged))
+      continue;
 
-  return count;
+    imap_flag_delta(idata, h, copy, add, remove);
+    if ((add->dptr == add->data) && (remove->dptr == remove->data))
+      continue;
+
+    mutt_buffer_reset(key);
+    mutt_buffer_printf(key, "%s\n%s", NONULL(add->data), NONULL(remove->data));
+
+    struct FlagDelta *g = mutt_hash_find(hash, key->data);
+    if (!g)
+    {
+      g = mutt_mem_calloc(1, sizeof(struct FlagDelta));
+      g->add = mutt_str_strdup(add->data);
+      g->remove = mutt_str_strdup(remove->data);
+      mutt_hash_insert(hash, key->data, g);
+
+      if (ngroups == gsize)
+      {
+        gsize += 16;
+        mutt_mem_realloc(&groups, gsize * sizeof(struct FlagDelta *));
+      }
+      groups[ngroups++] = g;
+    }
+
+    if (g->count == g->size)
+    {
+      g->size += 64;
+      mutt_mem_realloc(&g->msgs, g->size * sizeof(int));
+    }
+    g->msgs[g->count++] = n;
+  }
+
+  for (int i = 0; i < ngroups; i++)
+  {
+    struct FlagDelta *g = groups[i];
+
+    mutt_debug(3, "%d messages: +(%s) -(%s)\n", g->count, NONULL(g->add), NONULL(g->remove));
+    if (rc == 0)
+    {
+      if ((g->add && (store_group(idata, g, '+', g->add) < 0)) ||
+          (g->remove && (store_group(idata, g, '-', g->remove) < 0)))
+      {
+        rc = -1;
+      }
+      count += g->count;
+    }
+
+    FREE(&g->add);
+    FREE(&g->remove);
+    FREE(&g->msgs);
+    FREE(&g);
+  }
+  FREE(&groups);
+
+  if ((rc == 0) && copy)
+  {
+    for (int n = 0; n < ctx->msgcount; n++)
+    {
+      struct Header *h = ctx->hdrs[n];
+      struct ImapHeaderData *hd = HEADER_DATA(h);
+
+      if (!h->active || !h->changed || !h->tagged)
+        continue;
+
+      hd->flagged = h->flagged;
+      hd->old = h->old;
+      hd->read = h->read;
+      hd->replied = h->replied;
+      FREE(&hd->flags_remote);
+      hd->flags_remote = driver_tags_get_with_hidden(&h->tags);
+      if (h->deleted == hd->deleted)
+        h->changed = false;
+    }
+  }
+
+  mutt_hash_destroy(&hash);
+  mutt_buffer_free(&add);
+  mutt_buffer_free(&remove);
+  mutt_buffer_free(&key);
+
+  if (oldsort != Sort)
+  {
+    Sort = oldsort;
+    FREE(&ctx->hdrs);
+    ctx->hdrs = hdrs;
+  }
+
+  return (rc < 0) ? rc : count;
 }
 
 /**
@@ -405,41 +675,79 @@ static int get_mailbox(const char *path, struct ImapData **hidata, char *buf, si
 }
 
 /**
- * do_search - Perform a search of messages
- * @param search  List of pattern to match
- * @param allpats Must all patterns match?
- * @retval num Number of patterns search that should be done server-side
+ * search_fulltext - Does a pattern contain a full-text term?
+ * @param pat Pattern to check
+ * @retval true At least one term needs the message to be downloaded
  *
- * Count the number of patterns that can be done by the server (are full-text).
+ * These are the terms worth sending to the server: matching them locally
+ * would mean fetching the headers or bodies of every message.
  */
-static int do_search(const struct Pattern *search, int allpats)
+static bool search_fulltext(const struct Pattern *pat)
 {
-  int rc = 0;
-  const struct Pattern *pat = NULL;
-
-  for (pat = search; pat; pat = pat->next)
+  switch (pat->op)
   {
-    switch (pat->op)
-    {
-      case MUTT_BODY:
-      case MUTT_HEADER:
-      case MUTT_WHOLE_MSG:
-        if (pat->stringmatch)
-          rc++;
-        break;
-      case MUTT_SERVERSEARCH:
-        rc++;
-        break;
-      default:
-        if (pat->child && do_search(pat->child, 1))
-          rc++;
-    }
-
-    if (!allpats)
-      break;
+    case MUTT_BODY:
+    case MUTT_HEADER:
+    case MUTT_WHOLE_MSG:
+    case MUTT_SERVERSEARCH:
+      return pat->stringmatch;
   }
 
-  return rc;
+  for (const struct Pattern *clause = pat->child; clause; clause = clause->next)
+    if (search_fulltext(clause))
+      return true;
+
+  return false;
+}
+
+/**
+ * search_expressible - Can a pattern be converted to an IMAP search?
+ * @param ctx Context
+ * @param pat Pattern to check
+ * @retval true The server will give the same answer as NeoMutt would
+ *
+ * Only terms whose semantics match are converted.  The server's search is
+ * case-insensitive substring matching, so regexes and case-sensitive string
+ * matches stay local.  Dates and sizes don't match either: SENTBEFORE and
+ * friends ignore the time and the timezone, and LARGER counts the headers.
+ * Flags are only sent while none of them have been changed locally.
+ */
+static bool search_expressible(const struct Context *ctx, const struct Pattern *pat)
+{
+  switch (pat->op)
+  {
+    case MUTT_AND:
+    case MUTT_OR:
+      for (const struct Pattern *clause = pat->child; clause; clause = clause->next)
+        if (!search_expressible(ctx, clause))
+          return false;
+      return true;
+    case MUTT_BODY:
+    case MUTT_WHOLE_MSG:
+    case MUTT_SERVERSEARCH:
+      return pat->stringmatch;
+    case MUTT_HEADER:
+      return pat->stringmatch && strchr(pat->p.str, ':');
+    case MUTT_SUBJECT:
+      return pat->stringmatch && pat->ign_case;
+    case MUTT_FROM:
+    case MUTT_TO:
+    case MUTT_CC:
+      /* NeoMutt matches each name and address separately, the server matches
+       * the whole header: only a string that can't span two of them is safe */
+      return pat->stringmatch && pat->ign_case && !pat->alladdr &&
+             !strpbrk(pat->p.str, "<>\",");
+    case MUTT_FLAG:
+    case MUTT_REPLIED:
+    case MUTT_READ:
+    case MUTT_UNREAD:
+    case MUTT_DELETED:
+      return !ctx->changed;
+    case MUTT_ALL:
+      return true;
+    default:
+      return false;
+  }
 }
 
 /**
@@ -450,48 +758,30 @@ static int do_search(const struct Pattern *search, int allpats)
  * @retval  0 Success
  * @retval -1 Failure
  *
- * Convert neomutt Pattern to IMAP SEARCH command containing only elements
- * that require full-text search (neomutt already has what it needs for most
- * match types, and does a better job (eg server doesn't support regexes).
+ * The pattern must have passed search_expressible().
  */
 static int compile_search(struct Context *ctx, const struct Pattern *pat, struct Buffer *buf)
 {
-  if (!do_search(pat, 0))
-    return 0;
-
   if (pat->not)
     mutt_buffer_addstr(buf, "NOT ");
 
-  if (pat->child)
+  if ((pat->op == MUTT_AND) || (pat->op == MUTT_OR))
   {
-    int clauses;
+    mutt_buffer_addch(buf, '(');
 
-    clauses = do_search(pat->child, 1);
-    if (clauses > 0)
+    for (const struct Pattern *clause = pat->child; clause; clause = clause->next)
     {
-      const struct Pattern *clause = pat->child;
-
-      mutt_buffer_addch(buf, '(');
+      if ((pat->op == MUTT_OR) && clause->next)
+        mutt_buffer_addstr(buf, "OR ");
 
-      while (clauses)
-      {
-        if (do_search(clause, 0))
-        {
-          if (pat->op == MUTT_OR && clauses > 1)
-            mutt_buffer_addstr(buf, "OR ");
-          clauses--;
-
-          if (compile_search(ctx, clause, buf) < 0)
-            return -1;
-
-          if (clauses)
-            mutt_buffer_addch(buf, ' ');
-        }
-        clause = clause->next;
-      }
+      if (compile_search(ctx, clause, buf) < 0)
+        return -1;
 
-      mutt_buffer_addch(buf, ')');
+      if (clause->next)
+        mutt_buffer_addch(buf, ' ');
     }
+
+    mutt_buffer_addch(buf, ')');
   }
   else
   {
@@ -532,6 +822,44 @@ static int compile_search(struct Context *ctx, const struct Pattern *pat, struct
         imap_quote_string(term, sizeof(term), pat->p.str);
         mutt_buffer_addstr(buf, term);
         break;
+      case MUTT_SUBJECT:
+        mutt_buffer_addstr(buf, "SUBJECT ");
+        imap_quote_string(term, sizeof(term), pat->p.str);
+        mutt_buffer_addstr(buf, term);
+        break;
+      case MUTT_FROM:
+        mutt_buffer_addstr(buf, "FROM ");
+        imap_quote_string(term, sizeof(term), pat->p.str);
+        mutt_buffer_addstr(buf, term);
+        break;
+      case MUTT_TO:
+        mutt_buffer_addstr(buf, "TO ");
+        imap_quote_string(term, sizeof(term), pat->p.str);
+        mutt_buffer_addstr(buf, term);
+        break;
+      case MUTT_CC:
+        mutt_buffer_addstr(buf, "CC ");
+        imap_quote_string(term, sizeof(term), pat->p.str);
+        mutt_buffer_addstr(buf, term);
+        break;
+      case MUTT_FLAG:
+        mutt_buffer_addstr(buf, "FLAGGED");
+        break;
+      case MUTT_REPLIED:
+        mutt_buffer_addstr(buf, "ANSWERED");
+        break;
+      case MUTT_READ:
+        mutt_buffer_addstr(buf, "SEEN");
+        break;
+      case MUTT_UNREAD:
+        mutt_buffer_addstr(buf, "UNSEEN");
+        break;
+      case MUTT_DELETED:
+        mutt_buffer_addstr(buf, "DELETED");
+        break;
+      case MUTT_ALL:
+        mutt_buffer_addstr(buf, "ALL");
+        break;
       case MUTT_SERVERSEARCH:
       {
         struct ImapData *idata = ctx->data;
@@ -551,6 +879,79 @@ static int compile_search(struct Context *ctx, const struct Pattern *pat, struct
   return 0;
 }
 
+/**
+ * search_run - Evaluate part of a pattern on the server
+ * @param ctx Context
+ * @param pat Pattern to evaluate, must pass search_expressible()
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * The UIDs of the matching messages are saved in the Pattern, for
+ * imap_search_matched().
+ */
+static int search_run(struct Context *ctx, struct Pattern *pat)
+{
+  struct ImapData *idata = ctx->data;
+  struct Buffer buf;
+  int rc;
+
+  for (int i = 0; i < ctx->msgcount; i++)
+    ctx->hdrs[i]->matched = false;
+
+  mutt_buffer_init(&buf);
+  mutt_buffer_addstr(&buf, "UID SEARCH ");
+  /* a range list is much shorter than one UID per match */
+  if (mutt_bit_isset(idata->capabilities, ESEARCH))
+    mutt_buffer_addstr(&buf, "RETURN (ALL) ");
+  rc = compile_search(ctx, pat, &buf);
+  if (rc == 0)
+    rc = imap_exec(idata, buf.data, 0);
+  FREE(&buf.data);
+  if (rc < 0)
+    return -1;
+
+  pat->imap_matches = mutt_hash_int_create(MAX(6 * ctx->msgcount / 5, 30), 0);
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+    if (!h->matched)
+      continue;
+    mutt_hash_int_insert(pat->imap_matches, HEADER_DATA(h)->uid, h);
+    h->matched = false;
+  }
+
+  return 0;
+}
+
+/**
+ * search_tree - Send the largest possible parts of a pattern to the server
+ * @param ctx Context
+ * @param pat List of patterns
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * Each subtree that contains a full-text term, and can be expressed entirely
+ * as an IMAP search, becomes one SEARCH command.  Everything else is left for
+ * mutt_pattern_exec() to evaluate locally.
+ */
+static int search_tree(struct Context *ctx, struct Pattern *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    mutt_hash_destroy(&pat->imap_matches);
+
+    if (search_fulltext(pat) && search_expressible(ctx, pat))
+    {
+      if (search_run(ctx, pat) < 0)
+        return -1;
+    }
+    else if (pat->child && (search_tree(ctx, pat->child) < 0))
+      return -1;
+  }
+
+  return 0;
+}
+
 /**
  * longest_common_prefix - Find longest prefix common to two strings
  * @param dest  Destination buffer
@@ -819,14 +1220,16 @@ void imap_logout_all(void)
 int imap_read_literal(FILE *fp, struct ImapData *idata, unsigned long bytes,
                       struct Progress *pbar)
 {
-  char c;
+  char buf[CONN_INBUF_SIZE];
   bool r = false;
+  int n;
 
   mutt_debug(2, "reading %ld bytes\n", bytes);
 
-  for (unsigned long pos = 0; pos < bytes; pos++)
+  for (unsigned long pos = 0; pos < bytes; pos += n)
   {
-    if (mutt_socket_readchar(idata->conn, &c) != 1)
+    n = mutt_socket_read(idata->conn, buf, MIN(sizeof(buf), bytes - pos));
+    if (n <= 0)
     {
       mutt_debug(1, "error during read, %ld bytes read\n", pos);
       idata->status = IMAP_FATAL;
@@ -834,23 +1237,31 @@ int imap_read_literal(FILE *fp, struct ImapData *idata, unsigned long bytes,
       return -1;
     }
 
-    if (r && c != '\n')
-      fputc('\r', fp);
-
-    if (c == '\r')
+    /* convert CRLF to LF, a lone CR is kept */
+    for (const char *p = buf, *end = buf + n; p < end;)
     {
-      r = true;
-      continue;
-    }
-    else
-      r = false;
+      if (r)
+      {
+        r = false;
+        if (*p != '\n')
+          fputc('\r', fp);
+      }
 
-    fputc(c, fp);
+      const char *cr = memchr(p, '\r', end - p);
+      size_t len = (cr ? cr : end) - p;
+      fwrite(p, 1, len, fp);
+      if (debuglevel >= IMAP_LOG_LTRL)
+        fwrite(p, 1, len, debugfile);
+      p += len;
+      if (cr)
+      {
+        r = true;
+        p++;
+      }
+    }
 
-    if (pbar && !(pos % 1024))
-      mutt_progress_update(pbar, pos, -1);
-    if (debuglevel >= IMAP_LOG_LTRL)
-      fputc(c, debugfile);
+    if (pbar)
+      mutt_progress_update(pbar, pos + n, -1);
   }
 
   return 0;
@@ -867,13 +1278,14 @@ int imap_read_literal(FILE *fp, struct ImapData *idata, unsigned long bytes,
 void imap_expunge_mailbox(struct ImapData *idata)
 {
   struct Header *h = NULL;
-  int cacheno;
+  int cacheno, sorted;
   short old_sort;
 
 #ifdef USE_HCACHE
   idata->hcache = imap_hcache_open(idata, NULL);
 #endif
 
+  sorted = mx_save_order(idata->ctx);
   old_sort = Sort;
   Sort = SORT_ORDER;
   mutt_sort_headers(idata->ctx, 0);
@@ -903,13 +1315,13 @@ void imap_expunge_mailbox(struct ImapData *idata)
         FREE(&idata->cache[cacheno].path);
       }
 
-      mutt_hash_int_delete(idata->uid_hash, HEADER_DATA(h)->uid, h);
+      imap_uid_hash_delete(idata->uid_hash, HEADER_DATA(h)->uid, h);
 
       imap_free_header_data((struct ImapHeaderData **) &h->data);
     }
     else
     {
-      h->index = i;
+      h->index = i + idata->msn_unread;
       /* Mutt has several places where it turns off h->active as a
        * hack.  For example to avoid FLAG updates, or to exclude from
        * imap_exec_msgset.
@@ -930,7 +1342,11 @@ void imap_expunge_mailbox(struct ImapData *idata)
     }
   }
 
+  imap_msn_compact(idata);
+
 #ifdef USE_HCACHE
+  if (idata->qresync)
+    imap_hcache_store_uid_seqset(idata);
   imap_hcache_close(idata);
 #endif
 
@@ -938,7 +1354,8 @@ void imap_expunge_mailbox(struct ImapData *idata)
    * to always know to rethread */
   mx_update_tables(idata->ctx, false);
   Sort = old_sort;
-  mutt_sort_headers(idata->ctx, 1);
+  if (!mx_restore_order(idata->ctx, sorted))
+    mutt_sort_headers(idata->ctx, 1);
 }
 
 /**
@@ -1023,6 +1440,14 @@ struct ImapData *imap_conn_find(const struct Account *account, int flags)
     /* enable RFC6855, if the server supports that */
     if (mutt_bit_isset(idata->capabilities, ENABLE))
       imap_exec(idata, "ENABLE UTF8=ACCEPT", IMAP_CMD_QUEUE);
+#ifdef USE_HCACHE
+    /* enable RFC7162, to resync mailboxes from the header cache */
+    if (ImapQresync && mutt_bit_isset(idata->capabilities, ENABLE) &&
+        mutt_bit_isset(idata->capabilities, QRESYNC))
+    {
+      imap_exec(idata, "ENABLE QRESYNC", IMAP_CMD_QUEUE);
+    }
+#endif
     /* get root delimiter, '/' as default */
     idata->delim = '/';
     imap_exec(idata, "LIST \"\" \"\"", IMAP_CMD_QUEUE);
@@ -1030,6 +1455,16 @@ struct ImapData *imap_conn_find(const struct Account *account, int flags)
       imap_exec(idata, "LSUB \"\" \"*\"", IMAP_CMD_QUEUE);
     /* we may need the root delimiter before we open a mailbox */
     imap_exec(idata, NULL, IMAP_CMD_FAIL_OK);
+#ifdef USE_ZLIB
+    /* RFC4978: everything after the tagged OK is compressed */
+    if (ImapDeflate && mutt_bit_isset(idata->capabilities, COMPRESS_DEFLATE) &&
+        (imap_exec(idata, "COMPRESS DEFLATE", IMAP_CMD_FAIL_OK) == 0))
+    {
+      mutt_debug(2, "IMAP compression is enabled on connection to %s\n",
+                 idata->conn->account.host);
+      mutt_zstrm_wrap_conn(idata->conn);
+    }
+#endif
   }
 
   return idata;
@@ -1144,6 +1579,7 @@ void imap_close_connection(struct ImapData *idata)
   }
   idata->seqno = idata->nextcmd = idata->lastcmd = idata->status = false;
   memset(idata->cmds, 0, sizeof(struct ImapCommand) * idata->cmdslots);
+  FREE(&idata->notify);
 }
 
 /**
@@ -1275,20 +1711,23 @@ out:
 
 /**
  * imap_sync_message_for_copy - Update server to reflect the flags of a single message
- * @param[in]  idata        Server data
- * @param[in]  hdr          Header of the email
- * @param[in]  cmd          Buffer for the command string
- * @param[out] err_continue Did the user force a continue?
+ * @param idata Server data
+ * @param hdr   Header of the email
+ * @param cmd   Buffer for the command string
  * @retval  0 Success
  * @retval -1 Failure
  *
  * Update the IMAP server to reflect the flags for a single message before
  * performing a "UID COPY".
+ *
+ * The STORE is only queued, so it is pipelined with the COPY that follows.
+ * A STORE that the server refuses is ignored: the copy keeps the server's
+ * old flags, and only the COPY's own failure is reported.
  * NOTE: This does not sync the "deleted" flag state, because it is not
  *       desirable to propagate that flag into the copy.
  */
 int imap_sync_message_for_copy(struct ImapData *idata, struct Header *hdr,
-                               struct Buffer *cmd, int *err_continue)
+                               struct Buffer *cmd)
 {
   char flags[LONG_STRING];
   char *tags;
@@ -1361,15 +1800,10 @@ int imap_sync_message_for_copy(struct ImapData *idata, struct Header *hdr,
 
   /* after all this it's still possible to have no flags, if you
    * have no ACL rights */
-  if (*flags && (imap_exec(idata, cmd->data, 0) != 0) && err_continue &&
-      (*err_continue != MUTT_YES))
+  if (*flags && (imap_exec(idata, cmd->data, IMAP_CMD_QUEUE) != 0))
   {
-    *err_continue = imap_continue("imap_sync_message: STORE failed", idata->buf);
-    if (*err_continue != MUTT_YES)
-    {
-      hdr->active = true;
-      return -1;
-    }
+    hdr->active = true;
+    return -1;
   }
 
   /* server have now the updated flags */
@@ -1453,9 +1887,101 @@ int imap_check(struct ImapData *idata, int force)
 
   idata->check_status = 0;
 
+  /* Fetching the changes ended the IDLE.  Go straight back, so that we hear
+   * about the next change as soon as it happens. */
+  if (!force && ImapIdle && mutt_bit_isset(idata->capabilities, IDLE) &&
+      (idata->state == IMAP_SELECTED) && (imap_cmd_idle(idata) < 0))
+  {
+    return -1;
+  }
+
   return result;
 }
 
+/**
+ * notify_update - Ask the server to tell us when the mailboxes change
+ * @param idata Server data
+ * @retval true  NOTIFY is in effect, only changed mailboxes need a STATUS
+ * @retval false Check every mailbox with STATUS
+ *
+ * Keep a NOTIFY SET (RFC5465) covering all the connection's mailboxes in the
+ * buffy list, and read anything the server has pushed to us since the last
+ * check.  The selected mailbox is reported the usual way, as EXISTS, EXPUNGE
+ * and FETCH.
+ */
+static bool notify_update(struct ImapData *idata)
+{
+  struct ImapMbox mx;
+  char name[LONG_STRING];
+  char munged[LONG_STRING];
+  int count = 0;
+
+  if (!mutt_bit_isset(idata->capabilities, NOTIFY))
+    return false;
+
+  struct Buffer *cmd = mutt_buffer_new();
+  mutt_buffer_addstr(cmd, "NOTIFY SET (selected (MessageNew MessageExpunge "
+                          "FlagChange)) (mailboxes (");
+  for (struct Buffy *b = Incoming; b; b = b->next)
+  {
+    if (!mx_is_imap(b->path) || (imap_parse_path(b->path, &mx) < 0))
+      continue;
+
+    if (imap_account_match(&idata->conn->account, &mx.account))
+    {
+      imap_fix_path(idata, mx.mbox, name, sizeof(name));
+      if (!*name)
+        mutt_str_strfcpy(name, "INBOX", sizeof(name));
+      imap_munge_mbox_name(idata, munged, sizeof(munged), name);
+      if (count++)
+        mutt_buffer_addch(cmd, ' ');
+      mutt_buffer_addstr(cmd, munged);
+    }
+    FREE(&mx.mbox);
+  }
+  mutt_buffer_addstr(cmd, ") (MessageNew MessageExpunge FlagChange))");
+
+  if (count && (mutt_str_strcmp(cmd->data, idata->notify) != 0))
+  {
+    int rc = imap_exec(idata, cmd->data, IMAP_CMD_FAIL_OK);
+    if (rc < 0)
+    {
+      if (rc == -2)
+      {
+        mutt_debug(1, "NOTIFY failed, using STATUS\n");
+        mutt_bit_unset(idata->capabilities, NOTIFY);
+      }
+      FREE(&idata->notify);
+      mutt_buffer_free(&cmd);
+      return false;
+    }
+    mutt_str_replace(&idata->notify, cmd->data);
+
+    /* anything may have changed while we weren't being told */
+    struct ListNode *np = NULL;
+    STAILQ_FOREACH(np, &idata->mboxcache, entries)
+    {
+      ((struct ImapStatus *) np->data)->notified = false;
+    }
+  }
+  mutt_buffer_free(&cmd);
+
+  if (!idata->notify)
+    return false;
+
+  /* The selected connection's pushes are read by imap_check() */
+  if (idata->state == IMAP_AUTHENTICATED)
+  {
+    while (mutt_socket_poll(idata->conn, 0) > 0)
+    {
+      if (imap_cmd_step(idata) == IMAP_CMD_BAD)
+        return false;
+    }
+  }
+
+  return true;
+}
+
 /**
  * imap_buffy_check - Check for new mail in subscribed folders
  * @param check_stats Check for message stats too
@@ -1471,10 +1997,13 @@ int imap_buffy_check(int check_stats)
 {
   struct ImapData *idata = NULL;
   struct ImapData *lastdata = NULL;
+  struct ImapData *notifydata = NULL;
+  struct ImapStatus *status = NULL;
   struct Buffy *mailbox = NULL;
   char name[LONG_STRING];
   char command[LONG_STRING];
   char munged[LONG_STRING];
+  bool notify = false;
   int buffies = 0;
 
   for (mailbox = Incoming; mailbox; mailbox = mailbox->next)
@@ -1512,6 +2041,21 @@ int imap_buffy_check(int check_stats)
       continue;
     }
 
+    if (idata != notifydata)
+    {
+      notifydata = idata;
+      notify = notify_update(idata);
+    }
+
+    /* The server will have told us about any changes */
+    if (notify)
+    {
+      status = imap_mboxcache_get(idata, name, true);
+      if (status->notified)
+        continue;
+      status->notified = true;
+    }
+
     if (lastdata && idata != lastdata)
     {
       /* Send commands to previous server. Sorting the buffy list
@@ -1526,7 +2070,7 @@ int imap_buffy_check(int check_stats)
       lastdata = idata;
 
     imap_munge_mbox_name(idata, munged, sizeof(munged), name);
-    if (check_stats)
+    if (check_stats || notify)
       snprintf(command, sizeof(command),
                "STATUS %s (UIDNEXT UIDVALIDITY UNSEEN RECENT MESSAGES)", munged);
     else
@@ -1706,31 +2250,104 @@ void imap_mboxcache_free(struct ImapData *idata)
  * @param pat Pattern to match
  * @retval  0 Success
  * @retval -1 Failure
+ *
+ * Evaluate as much of the pattern as possible on the server.  The results are
+ * used by mutt_pattern_exec(), through imap_search_matched().
  */
-int imap_search(struct Context *ctx, const struct Pattern *pat)
+int imap_search(struct Context *ctx, struct Pattern *pat)
+{
+  return search_tree(ctx, pat);
+}
+
+/**
+ * imap_search_matched - Did the server match a message?
+ * @param pat Pattern evaluated by imap_search()
+ * @param h   Email Header
+ * @retval true The message matches the whole subtree, including any negation
+ */
+bool imap_search_matched(const struct Pattern *pat, const struct Header *h)
+{
+  return HEADER_DATA(h) && mutt_hash_int_find(pat->imap_matches, HEADER_DATA(h)->uid);
+}
+
+/**
+ * imap_window_edge - Find the oldest message read so far
+ * @param ctx Context
+ * @retval ptr  Header of the oldest message
+ * @retval NULL All the headers have been read
+ *
+ * When the mailbox was opened with $imap_fetch_window, the index can use this
+ * to tell when the user is about to scroll past the messages it knows about.
+ */
+struct Header *imap_window_edge(struct Context *ctx)
 {
-  struct Buffer buf;
   struct ImapData *idata = ctx->data;
-  for (int i = 0; i < ctx->msgcount; i++)
-    ctx->hdrs[i]->matched = false;
 
-  if (!do_search(pat, 1))
+  if (!idata || !idata->msn_unread || (idata->msn_unread >= idata->max_msn))
+    return NULL;
+
+  return imap_msn_get(idata, idata->msn_unread + 1);
+}
+
+/**
+ * imap_window_grow - Read more of the headers left out by $imap_fetch_window
+ * @param ctx Context
+ * @param all If true, read all the remaining headers
+ * @retval  0 Success, or every header has already been read
+ * @retval -1 Failure
+ *
+ * Otherwise, the next $imap_fetch_window older headers are read.  The new
+ * messages are sorted into the index; the existing ones keep their h->index
+ * and the index menu stays on the same message.
+ */
+int imap_window_grow(struct Context *ctx, bool all)
+{
+  struct ImapData *idata = ctx->data;
+  struct Header *current = NULL;
+  unsigned int msn_begin, msn_end;
+  int oldmsgcount;
+
+  if ((ctx->magic != MUTT_IMAP) || !idata || !idata->msn_unread)
     return 0;
 
-  mutt_buffer_init(&buf);
-  mutt_buffer_addstr(&buf, "UID SEARCH ");
-  if (compile_search(ctx, pat, &buf) < 0)
+  /* The MSNs aren't settled until imap_check_mailbox() has caught up */
+  if (idata->reopen & (IMAP_EXPUNGE_PENDING | IMAP_NEWMAIL_PENDING))
   {
-    FREE(&buf.data);
+    mutt_error(_("Mailbox is being updated, please try again."));
     return -1;
   }
-  if (imap_exec(idata, buf.data, 0) < 0)
+
+  msn_end = idata->msn_unread;
+  if (all || (msn_end <= ImapFetchWindow))
+    msn_begin = 1;
+  else
+    msn_begin = msn_end - ImapFetchWindow + 1;
+
+  if (ctx->menu && (ctx->menu->current >= 0) && (ctx->menu->current < ctx->vcount))
+    current = ctx->hdrs[ctx->v2r[ctx->menu->current]];
+
+  mutt_debug(2, "Reading headers %u to %u\n", msn_begin, msn_end);
+  oldmsgcount = ctx->msgcount;
+  idata->msn_unread = msn_begin - 1;
+  if (imap_read_headers(idata, msn_begin, msn_end) < 0)
   {
-    FREE(&buf.data);
+    /* whatever was read is in the context, retry the lot */
+    idata->msn_unread = msn_end;
     return -1;
   }
 
-  FREE(&buf.data);
+  if (ctx->msgcount > oldmsgcount)
+  {
+    mutt_sort_headers(ctx, 0);
+    if (current && (current->virtual >= 0))
+      ctx->menu->current = current->virtual;
+    if (ctx->menu)
+    {
+      ctx->menu->max = ctx->vcount;
+      ctx->menu->redraw |= REDRAW_INDEX | REDRAW_STATUS;
+    }
+  }
+
   return 0;
 }
 
@@ -1916,10 +2533,13 @@ int imap_fast_trash(struct Context *ctx, char *dest)
   struct ImapMbox mx;
   bool triedcreate = false;
   struct Buffer *sync_cmd = NULL;
-  int err_continue = MUTT_NO;
+  unsigned char reopen;
 
   idata = ctx->data;
 
+  /* RFC6851: the messages are about to be expunged anyway */
+  bool move = mutt_bit_isset(idata->capabilities, MOVE);
+
   if (imap_parse_path(dest, &mx))
   {
     mutt_debug(1, "bad destination %s\n", dest);
@@ -1944,7 +2564,7 @@ int imap_fast_trash(struct Context *ctx, char *dest)
     if (ctx->hdrs[i]->active && ctx->hdrs[i]->changed &&
         ctx->hdrs[i]->deleted && !ctx->hdrs[i]->purge)
     {
-      rc = imap_sync_message_for_copy(idata, ctx->hdrs[i], sync_cmd, &err_continue);
+      rc = imap_sync_message_for_copy(idata, ctx->hdrs[i], sync_cmd);
       if (rc < 0)
       {
         mutt_debug(1, "could not sync\n");
@@ -1956,7 +2576,7 @@ int imap_fast_trash(struct Context *ctx, char *dest)
   /* loop in case of TRYCREATE */
   do
   {
-    rc = imap_exec_msgset(idata, "UID COPY", mmbox, MUTT_TRASH, 0, 0);
+    rc = imap_exec_msgset(idata, move ? "UID MOVE" : "UID COPY", mmbox, MUTT_TRASH, 0, 0);
     if (!rc)
     {
       mutt_debug(1, "No messages to trash\n");
@@ -1968,11 +2588,18 @@ int imap_fast_trash(struct Context *ctx, char *dest)
       mutt_debug(1, "could not queue copy\n");
       goto out;
     }
+    else if (move)
+      mutt_message(_("Moving %d messages to %s..."), rc, mbox);
     else
       mutt_message(_("Copying %d messages to %s..."), rc, mbox);
 
-    /* let's get it on */
+    /* let's get it on.  The moved messages must outlive the EXPUNGEs, until
+     * the COPYUID has been used. */
+    idata->copyuid.count = 0;
+    reopen = idata->reopen & IMAP_REOPEN_ALLOW;
+    idata->reopen &= ~IMAP_REOPEN_ALLOW;
     rc = imap_exec(idata, NULL, IMAP_CMD_FAIL_OK);
+    idata->reopen |= reopen;
     if (rc == -2)
     {
       if (triedcreate)
@@ -2002,6 +2629,17 @@ int imap_fast_trash(struct Context *ctx, char *dest)
     goto out;
   }
 
+#ifdef USE_HCACHE
+  imap_hcache_copyuid(idata, mbox);
+#endif
+
+  /* Keep the sync from flagging the moved messages \Deleted; they go with
+   * the next expunge. */
+  if (move)
+    for (int i = 0; i < ctx->msgcount; i++)
+      if (ctx->hdrs[i]->index == INT_MAX)
+        ctx->hdrs[i]->active = false;
+
   rc = 0;
 
 out:
@@ -2025,6 +2663,7 @@ static int imap_open_mailbox(struct Context *ctx)
   char bufout[LONG_STRING];
   int count = 0;
   struct ImapMbox mx, pmx;
+  struct PerfTimer perf;
   int rc;
 
   if (imap_parse_path(ctx->path, &mx))
@@ -2034,7 +2673,9 @@ static int imap_open_mailbox(struct Context *ctx)
   }
 
   /* we require a connection which isn't currently in IMAP_SELECTED state */
+  mutt_perf_start(&perf, PERF_CONNECT);
   idata = imap_conn_find(&(mx.account), MUTT_IMAP_CONN_NOSELECT);
+  mutt_perf_stop(&perf);
   if (!idata)
     goto fail_noidata;
   if (idata->state < IMAP_AUTHENTICATED)
@@ -2058,11 +2699,19 @@ static int imap_open_mailbox(struct Context *ctx)
 
   idata->ctx = ctx;
 
+#ifdef USE_HCACHE
+  imap_hcache_prefetch(idata);
+#endif
+
   /* clear mailbox status */
   idata->status = false;
   memset(idata->ctx->rights, 0, sizeof(idata->ctx->rights));
   idata->new_mail_count = 0;
-  idata->max_msn = 0;
+  imap_msn_free(idata);
+  idata->msn_unread = 0;
+  idata->window = false;
+  idata->partial = false;
+  idata->modseq = 0;
 
   mutt_message(_("Selecting %s..."), idata->mailbox);
   imap_munge_mbox_name(idata, buf, sizeof(buf), idata->mailbox);
@@ -2157,6 +2806,20 @@ static int imap_open_mailbox(struct Context *ctx)
         goto fail;
       status->uidnext = idata->uidnext;
     }
+    /* RFC7162: the state of the mailbox, for the next resync */
+    else if (mutt_str_strncasecmp("OK [HIGHESTMODSEQ", pc, 17) == 0)
+    {
+      mutt_debug(3, "Getting mailbox HIGHESTMODSEQ\n");
+      pc += 3;
+      pc = imap_next_word(pc);
+      if (mutt_str_atoull(pc, &idata->modseq) < 0)
+        idata->modseq = 0;
+    }
+    else if (mutt_str_strncasecmp("OK [NOMODSEQ", pc, 12) == 0)
+    {
+      mutt_debug(3, "Mailbox has no MODSEQ\n");
+      idata->modseq = 0;
+    }
     else
     {
       pc = imap_next_word(pc);
@@ -2220,12 +2883,19 @@ static int imap_open_mailbox(struct Context *ctx)
   ctx->v2r = mutt_mem_calloc(count, sizeof(int));
   ctx->msgcount = 0;
 
+  mutt_perf_start(&perf, PERF_FETCH_HEADERS);
   if (count && (imap_read_headers(idata, 1, count) < 0))
   {
     mutt_error(_("Error opening mailbox"));
     mutt_sleep(1);
     goto fail;
   }
+  mutt_perf_stop(&perf);
+
+#ifdef USE_HCACHE
+  if (imap_journal_replay(idata) < 0)
+    goto fail;
+#endif
 
   mutt_debug(2, "msgcount is %d\n", ctx->msgcount);
   FREE(&mx.mbox);
@@ -2315,6 +2985,22 @@ static int imap_close_mailbox(struct Context *ctx)
    */
   if (ctx == idata->ctx)
   {
+#ifdef USE_HCACHE
+    /* Keep the attachment counts, so that the messages needn't be downloaded
+     * again just to count them */
+    bool opened = !idata->hcache;
+    if (opened)
+      idata->hcache = imap_hcache_open(idata, NULL);
+    for (int i = 0; idata->hcache && (i < ctx->msgcount); i++)
+    {
+      struct Header *h = ctx->hdrs[i];
+      if (h->active && h->attach_valid && h->attach_new)
+        imap_hcache_put(idata, h);
+    }
+    if (opened)
+      imap_hcache_close(idata);
+#endif
+
     if (idata->status != IMAP_FATAL && idata->state >= IMAP_SELECTED)
     {
       /* mx_close_mailbox won't sync if there are no deleted messages
@@ -2329,10 +3015,11 @@ static int imap_close_mailbox(struct Context *ctx)
     mutt_list_free(&idata->flags);
     idata->ctx = NULL;
 
-    mutt_hash_destroy(&idata->uid_hash);
-    FREE(&idata->msn_index);
-    idata->msn_index_size = 0;
-    idata->max_msn = 0;
+    imap_uid_hash_free(&idata->uid_hash);
+    imap_msn_free(idata);
+    idata->msn_unread = 0;
+    idata->window = false;
+    idata->partial = false;
 
     for (int i = 0; i < IMAP_CACHE_LEN; i++)
     {
@@ -2498,7 +3185,7 @@ int imap_sync_mailbox(struct Context *ctx, int expunge)
   imap_hcache_close(idata);
 #endif
 
-  /* presort here to avoid doing 10 resorts in imap_exec_msgset */
+  /* presort here to avoid doing several resorts in imap_exec_msgset */
   oldsort = Sort;
   if (Sort != SORT_ORDER)
   {
@@ -2510,15 +3197,11 @@ int imap_sync_mailbox(struct Context *ctx, int expunge)
     qsort(ctx->hdrs, ctx->msgcount, sizeof(struct Header *), mutt_get_sort_func(SORT_ORDER));
   }
 
-  rc = sync_helper(idata, MUTT_ACL_DELETE, MUTT_DELETED, "\\Deleted");
-  if (rc >= 0)
-    rc |= sync_helper(idata, MUTT_ACL_WRITE, MUTT_FLAG, "\\Flagged");
-  if (rc >= 0)
-    rc |= sync_helper(idata, MUTT_ACL_WRITE, MUTT_OLD, "Old");
-  if (rc >= 0)
-    rc |= sync_helper(idata, MUTT_ACL_SEEN, MUTT_READ, "\\Seen");
-  if (rc >= 0)
-    rc |= sync_helper(idata, MUTT_ACL_WRITE, MUTT_REPLIED, "\\Answered");
+#ifdef USE_HCACHE
+  /* If the connection is lost, the changes will be sent next time */
+  imap_journal_save(idata);
+#endif
+  rc = imap_sync_flags(idata, false);
 
   if (oldsort != Sort)
   {
@@ -2527,13 +3210,23 @@ int imap_sync_mailbox(struct Context *ctx, int expunge)
     ctx->hdrs = hdrs;
   }
 
-  /* Flush the queued flags if any were changed in sync_helper. */
+  /* Flush the queued flags if any were changed in imap_sync_flags. */
   if (rc > 0)
     if (imap_exec(idata, NULL, 0) != IMAP_CMD_OK)
       rc = -1;
 
   if (rc < 0)
   {
+#ifdef USE_HCACHE
+    /* The cached flags may not match the server's now: resync them all */
+    if (idata->qresync)
+    {
+      idata->hcache = imap_hcache_open(idata, NULL);
+      if (idata->hcache)
+        mutt_hcache_delete(idata->hcache, "/MODSEQ", 7);
+      imap_hcache_close(idata);
+    }
+#endif
     if (ctx->closing)
     {
       if (mutt_yesorno(_("Error saving flags. Close anyway?"), 0) == MUTT_YES)
@@ -2551,7 +3244,8 @@ int imap_sync_mailbox(struct Context *ctx, int expunge)
 
   /* Update local record of server state to reflect the synchronization just
    * completed.  imap_read_headers always overwrites hcache-origin flags, so
-   * there is no need to mutate the hcache after flag-only changes. */
+   * there is no need to mutate the hcache after flag-only changes.  (A QRESYNC
+   * reopen trusts the cached flags, but the changed headers were stored above.) */
   for (int i = 0; i < ctx->msgcount; i++)
   {
     HEADER_DATA(ctx->hdrs[i])->deleted = ctx->hdrs[i]->deleted;
@@ -2559,9 +3253,18 @@ int imap_sync_mailbox(struct Context *ctx, int expunge)
     HEADER_DATA(ctx->hdrs[i])->old = ctx->hdrs[i]->old;
     HEADER_DATA(ctx->hdrs[i])->read = ctx->hdrs[i]->read;
     HEADER_DATA(ctx->hdrs[i])->replied = ctx->hdrs[i]->replied;
+    if (ctx->hdrs[i]->changed && mutt_bit_isset(ctx->rights, MUTT_ACL_WRITE))
+    {
+      FREE(&HEADER_DATA(ctx->hdrs[i])->flags_remote);
+      HEADER_DATA(ctx->hdrs[i])->flags_remote =
+          driver_tags_get_with_hidden(&ctx->hdrs[i]->tags);
+    }
     ctx->hdrs[i]->changed = false;
   }
   ctx->changed = false;
+#ifdef USE_HCACHE
+  imap_journal_clear(idata);
+#endif
 
   /* We must send an EXPUNGE command if we're not closing. */
   if (expunge && !(ctx->closing) && mutt_bit_isset(ctx->rights, MUTT_ACL_DELETE))
@@ -2691,91 +3394,23 @@ static int imap_edit_message_tags(struct Context *ctx, const char *tags, char *b
  * @retval  0 Success
  * @retval -1 Error
  *
- * This method update the server flags on the server by
- * removing the last know custom flags of a header
- * and adds the local flags
- *
- * If everything success we push the local flags to the
- * last know custom flags (flags_remote).
- *
- * Also this method check that each flags is support by the server
- * first and remove unsupported one.
+ * The new tags are only set locally and the message is marked as changed.
+ * imap_sync_flags() sends the difference from the last known custom flags
+ * (flags_remote) at the next sync.
  */
 static int imap_commit_message_tags(struct Context *ctx, struct Header *h, char *tags)
 {
-  struct ImapData *idata = NULL;
-  struct Buffer *cmd = NULL;
-  char uid[11];
-
-  idata = ctx->data;
-
   if (*tags == '\0')
     tags = NULL;
 
-  if (!mutt_bit_isset(idata->ctx->rights, MUTT_ACL_WRITE))
+  if (!mutt_bit_isset(ctx->rights, MUTT_ACL_WRITE))
     return 0;
 
-  snprintf(uid, sizeof(uid), "%u", HEADER_DATA(h)->uid);
-
-  /* Remove old custom flags */
-  if (HEADER_DATA(h)->flags_remote)
-  {
-    cmd = mutt_buffer_new();
-    if (!cmd)
-    {
-      mutt_debug(1, "unable to allocate buffer\n");
-      return -1;
-    }
-    cmd->dptr = cmd->data;
-    mutt_buffer_addstr(cmd, "UID STORE ");
-    mutt_buffer_addstr(cmd, uid);
-    mutt_buffer_addstr(cmd, " -FLAGS.SILENT (");
-    mutt_buffer_addstr(cmd, HEADER_DATA(h)->flags_remote);
-    mutt_buffer_addstr(cmd, ")");
-
-    /* Should we return here, or we are fine and we could
-     * continue to add new flags *
-     */
-    if (imap_exec(idata, cmd->data, 0) != 0)
-    {
-      mutt_buffer_free(&cmd);
-      return -1;
-    }
-
-    mutt_buffer_free(&cmd);
-  }
-
-  /* Add new custom flags */
-  if (tags)
-  {
-    cmd = mutt_buffer_new();
-    if (!cmd)
-    {
-      mutt_debug(1, "fail to remove old flags\n");
-      return -1;
-    }
-    cmd->dptr = cmd->data;
-    mutt_buffer_addstr(cmd, "UID STORE ");
-    mutt_buffer_addstr(cmd, uid);
-    mutt_buffer_addstr(cmd, " +FLAGS.SILENT (");
-    mutt_buffer_addstr(cmd, tags);
-    mutt_buffer_addstr(cmd, ")");
-
-    if (imap_exec(idata, cmd->data, 0) != 0)
-    {
-      mutt_debug(1, "fail to add new flags\n");
-      mutt_buffer_free(&cmd);
-      return -1;
-    }
-
-    mutt_buffer_free(&cmd);
-  }
-
-  /* We are good sync them */
-  mutt_debug(1, "NEW TAGS: %d\n", tags);
+  /* The server is told at the next sync, with the other flag changes, so
+   * that editing the tags of many messages doesn't cost a round trip each. */
   driver_tags_replace(&h->tags, tags);
-  FREE(&HEADER_DATA(h)->flags_remote);
-  HEADER_DATA(h)->flags_remote = driver_tags_get_with_hidden(&h->tags);
+  h->changed = true;
+  ctx->changed = true;
   return 0;
 }
 
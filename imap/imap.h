@@ -38,6 +38,7 @@
  * | imap/auth_sasl.c  | @subpage imap_auth_sasl  |
  * | imap/browse.c     | @subpage imap_browse     |
  * | imap/command.c    | @subpage imap_command    |
+ * | imap/journal.c    | @subpage imap_journal    |
  * | imap/message.c    | @subpage imap_message    |
  * | imap/utf7.c       | @subpage imap_utf7       |
  * | imap/util.c       | @subpage imap_util       |
@@ -49,7 +50,9 @@
 #include "conn/conn.h"
 #include "mutt_account.h"
 #include <stddef.h>
+#include <stdio.h>
 #include <sys/types.h>
+#include <time.h>
 
 struct BrowserState;
 struct Context;
@@ -73,7 +76,10 @@ int imap_delete_mailbox(struct Context *ctx, struct ImapMbox *mx);
 int imap_sync_mailbox(struct Context *ctx, int expunge);
 int imap_buffy_check(int check_stats);
 int imap_status(char *path, int queue);
-int imap_search(struct Context *ctx, const struct Pattern *pat);
+int imap_search(struct Context *ctx, struct Pattern *pat);
+bool imap_search_matched(const struct Pattern *pat, const struct Header *h);
+struct Header *imap_window_edge(struct Context *ctx);
+int imap_window_grow(struct Context *ctx, bool all);
 int imap_subscribe(char *path, bool subscribe);
 int imap_complete(char *dest, size_t dlen, char *path);
 int imap_fast_trash(struct Context *ctx, char *dest);
@@ -86,7 +92,11 @@ int imap_mailbox_create(const char *folder);
 int imap_mailbox_rename(const char *mailbox);
 
 /* message.c */
+int imap_append_fcc(char **paths, int *results, int num, FILE *fp, bool post, time_t received);
 int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int delete);
+void imap_prefetch(struct Context *ctx, struct Header *cur);
+bool imap_headers_missing(struct Context *ctx, const char *field);
+int imap_headers_upgrade(struct Context *ctx, bool all);
 
 /* socket.c */
 void imap_logout_all(void);
@@ -96,6 +106,7 @@ int imap_expand_path(char *path, size_t len);
 int imap_parse_path(const char *path, struct ImapMbox *mx);
 void imap_pretty_mailbox(char *path);
 
+int imap_wait_idle(struct Context *ctx, int secs);
 int imap_wait_keepalive(pid_t pid);
 void imap_keepalive(void);
 
@@ -36,6 +36,7 @@ struct Account;
 struct Buffer;
 struct Context;
 struct Header;
+struct ImapHeader;
 struct ImapHeaderData;
 struct ImapMbox;
 struct Message;
@@ -66,6 +67,13 @@ struct Progress;
  * lazy servers) */
 #define IMAP_MAX_CMDLEN 1024
 
+/* deepest the command pipeline may grow, see cmd_drain() */
+#define IMAP_PIPELINE_MAX 128
+
+/* limits on downloading headers over several connections */
+#define IMAP_FETCH_CONN_MAX   8    /**< Most connections used at once */
+#define IMAP_FETCH_CHUNK_MIN  1000 /**< Fewest messages worth a connection */
+
 #define IMAP_REOPEN_ALLOW     (1 << 0)
 #define IMAP_EXPUNGE_EXPECTED (1 << 1)
 #define IMAP_EXPUNGE_PENDING  (1 << 2)
@@ -135,6 +143,14 @@ enum ImapCaps
   IDLE,          /**< RFC2177: IDLE */
   SASL_IR,       /**< SASL initial response draft */
   ENABLE,        /**< RFC5161 */
+  CONDSTORE,     /**< RFC7162: Conditional STORE */
+  QRESYNC,       /**< RFC7162: Quick Mailbox Resynchronisation */
+  COMPRESS_DEFLATE, /**< RFC4978: COMPRESS=DEFLATE */
+  ESEARCH,       /**< RFC4731: Extended SEARCH results */
+  NOTIFY,        /**< RFC5465: Mailbox change notifications */
+  MOVE,          /**< RFC6851: MOVE */
+  LIST_STATUS,   /**< RFC5819: Return STATUS in LIST responses */
+  LITERALPLUS,   /**< RFC7888: Non-synchronizing literals */
   X_GM_EXT1,     /**< https://developers.google.com/gmail/imap/imap-extensions */
   X_GM_ALT1 = X_GM_EXT1, /**< Alternative capability string */
 
@@ -166,6 +182,8 @@ struct ImapStatus
   unsigned int uidnext;
   unsigned int uidvalidity;
   unsigned int unseen;
+
+  bool notified; /**< NOTIFY will tell us if this changes, no need to ask */
 };
 
 /**
@@ -186,6 +204,8 @@ struct ImapCommand
 {
   char seq[SEQLEN + 1];
   int state;
+  long long sent; /**< When the command was sent, in microseconds */
+  char name[16];  /**< Command name, e.g. "UID FETCH", for the statistics */
 };
 
 /**
@@ -198,6 +218,28 @@ enum ImapCommandType
   IMAP_CT_STATUS
 };
 
+/**
+ * struct ImapCopyUid - Where COPY or MOVE put the messages (RFC4315)
+ */
+struct ImapCopyUid
+{
+  unsigned int uidvalidity; /**< UIDVALIDITY of the destination mailbox */
+  unsigned int *uids;       /**< Pairs of source and destination UIDs */
+  size_t count;             /**< Number of pairs */
+  size_t size;              /**< Number of pairs allocated */
+};
+
+/**
+ * struct ImapUidHash - Map UIDs to Headers
+ */
+struct ImapUidHash
+{
+  unsigned int *uids;    /**< UID in each bucket, 0 if it's empty */
+  struct Header **hdrs;  /**< Header in each bucket */
+  size_t size;           /**< Number of buckets, a power of two */
+  size_t count;          /**< Number of buckets in use */
+};
+
 /**
  * struct ImapData - IMAP-specific server data
  *
@@ -228,6 +270,15 @@ struct ImapData
    * than mUTF7 */
   int unicode;
 
+  /* If set, the server has enabled QRESYNC (RFC7162) for us */
+  bool qresync;
+
+  /* If set, the NOTIFY SET command (RFC5465) in effect on this connection */
+  char *notify;
+
+  /* COPYUID of the last COPY or MOVE, if the server supports UIDPLUS */
+  struct ImapCopyUid copyuid;
+
   /* if set, the response parser will store results for complicated commands
    * here. */
   enum ImapCommandType cmdtype;
@@ -239,6 +290,8 @@ struct ImapData
   int nextcmd;
   int lastcmd;
   struct Buffer *cmdbuf;
+  int pipeline;  /**< Commands that may be outstanding, adapted to the server */
+  long long rtt; /**< Smoothed round trip time, in milliseconds */
 
   /* cache ImapStatus of visited mailboxes */
   struct ListHead mboxcache;
@@ -251,13 +304,21 @@ struct ImapData
   unsigned char reopen;
   unsigned int new_mail_count; /**< Set when EXISTS notifies of new mail */
   struct ImapCache cache[IMAP_CACHE_LEN];
-  struct Hash *uid_hash;
+  struct ImapUidHash *uid_hash;
   unsigned int uid_validity;
   unsigned int uidnext;
-  struct Header **msn_index;   /**< look up headers by (MSN-1) */
+  unsigned long long modseq;   /**< HIGHESTMODSEQ when the mailbox was selected */
+  struct Header **msn_index;   /**< look up headers by slot, see imap_msn_get() */
+  unsigned int *msn_tree;      /**< Fenwick tree of the slots in use */
   size_t msn_index_size;       /**< allocation size */
+  size_t msn_slots;            /**< slots used, including expunged ones */
   unsigned int max_msn;        /**< the largest MSN fetched so far */
+  unsigned int msn_unread;     /**< MSNs 1 to msn_unread haven't been fetched, see $imap_fetch_window */
+  bool window;                 /**< the mailbox was opened with $imap_fetch_window: h->index is MSN-1 */
+  bool index_headers;          /**< headers are being read with just $imap_index_headers */
+  bool partial;                /**< some headers only have $imap_index_headers, see imap_headers_upgrade() */
   struct BodyCache *bcache;
+  bool journal;                /**< the header cache has a journal of flag changes, see imap_journal_save() */
 
   /* all folder flags - system AND custom flags */
   struct ListHead flags;
@@ -282,7 +343,11 @@ struct ImapData *imap_conn_find(const struct Account *account, int flags);
 int imap_read_literal(FILE *fp, struct ImapData *idata, unsigned long bytes, struct Progress *pbar);
 void imap_expunge_mailbox(struct ImapData *idata);
 void imap_logout(struct ImapData **idata);
-int imap_sync_message_for_copy(struct ImapData *idata, struct Header *hdr, struct Buffer *cmd, int *err_continue);
+int imap_sync_flags(struct ImapData *idata, bool copy);
+void imap_flag_delta(struct ImapData *idata, struct Header *h, bool copy,
+                     struct Buffer *add, struct Buffer *remove);
+void imap_keyword_diff(struct Buffer *out, const char *a, const char *b);
+int imap_sync_message_for_copy(struct ImapData *idata, struct Header *hdr, struct Buffer *cmd);
 bool imap_has_flag(struct ListHead *flag_list, const char *flag);
 
 /* auth.c */
@@ -297,10 +362,18 @@ const char *imap_cmd_trailer(struct ImapData *idata);
 int imap_exec(struct ImapData *idata, const char *cmd, int flags);
 int imap_cmd_idle(struct ImapData *idata);
 
+/* journal.c */
+#ifdef USE_HCACHE
+void imap_journal_clear(struct ImapData *idata);
+int imap_journal_replay(struct ImapData *idata);
+void imap_journal_save(struct ImapData *idata);
+#endif
+
 /* message.c */
 void imap_free_header_data(struct ImapHeaderData **data);
 int imap_read_headers(struct ImapData *idata, unsigned int msn_begin, unsigned int msn_end);
 char *imap_set_flags(struct ImapData *idata, struct Header *h, char *s, int *server_changes);
+int imap_parse_fetch(struct ImapHeader *h, char *s);
 int imap_cache_del(struct ImapData *idata, struct Header *h);
 int imap_cache_clean(struct ImapData *idata);
 int imap_append_message(struct Context *ctx, struct Message *msg);
@@ -309,13 +382,33 @@ int imap_fetch_message(struct Context *ctx, struct Message *msg, int msgno);
 int imap_close_message(struct Context *ctx, struct Message *msg);
 int imap_commit_message(struct Context *ctx, struct Message *msg);
 
+/* msn.c */
+struct Header *imap_msn_get(struct ImapData *idata, unsigned int msn);
+unsigned int imap_msn_of(struct ImapData *idata, struct Header *h);
+void imap_msn_set(struct ImapData *idata, unsigned int msn, struct Header *h);
+void imap_msn_remove(struct ImapData *idata, unsigned int msn);
+void imap_msn_compact(struct ImapData *idata);
+void imap_msn_free(struct ImapData *idata);
+
+/* uid_hash.c */
+struct ImapUidHash *imap_uid_hash_new(size_t count);
+void imap_uid_hash_free(struct ImapUidHash **table);
+struct Header *imap_uid_hash_find(const struct ImapUidHash *table, unsigned int uid);
+void imap_uid_hash_insert(struct ImapUidHash *table, unsigned int uid, struct Header *h);
+void imap_uid_hash_delete(struct ImapUidHash *table, unsigned int uid, struct Header *h);
+
 /* util.c */
 #ifdef USE_HCACHE
 header_cache_t *imap_hcache_open(struct ImapData *idata, const char *path);
 void imap_hcache_close(struct ImapData *idata);
 struct Header *imap_hcache_get(struct ImapData *idata, unsigned int uid);
 int imap_hcache_put(struct ImapData *idata, struct Header *h);
+int imap_hcache_put_many(struct ImapData *idata, struct Header **hdrs, size_t count);
 int imap_hcache_del(struct ImapData *idata, unsigned int uid);
+int imap_hcache_prune(struct ImapData *idata);
+void imap_hcache_prefetch(struct ImapData *idata);
+int imap_hcache_store_uid_seqset(struct ImapData *idata);
+int imap_hcache_copyuid(struct ImapData *idata, const char *mbox);
 #endif
 
 int imap_continue(const char *msg, const char *resp);
@@ -330,6 +423,7 @@ int imap_mxcmp(const char *mx1, const char *mx2);
 char *imap_next_word(char *s);
 void imap_qualify_path(char *dest, size_t len, struct ImapMbox *mx, char *path);
 void imap_quote_string(char *dest, size_t slen, const char *src);
+int imap_seqset_next(const char **s, unsigned int *first, unsigned int *last);
 void imap_unquote_string(char *s);
 void imap_munge_mbox_name(struct ImapData *idata, char *dest, size_t dlen, const char *src);
 void imap_unmunge_mbox_name(struct ImapData *idata, char *s);
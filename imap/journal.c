@@ -0,0 +1,470 @@
+/**
+ * @file
+ * Journal of the flag changes the server hasn't got
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page imap_journal Journal of the flag changes the server hasn't got
+ *
+ * Flags are changed locally and sent to the server when the mailbox is
+ * synced.  If the connection is lost before the server has acknowledged them,
+ * the changes used to be lost with the mailbox.  Now they're written to a
+ * journal first, kept in the mailbox's header cache as "/JOURNAL".
+ *
+ * The journal is written just before a sync sends its STOREs, and when a lost
+ * connection closes a mailbox with unsynced changes.  It's cleared once the
+ * server has the changes.  When the mailbox is next opened, the journal is
+ * replayed: the STOREs are pipelined, grouped by their flags, and the messages
+ * are updated to match.
+ *
+ * Only flags are journaled.  A STORE of +FLAGS or -FLAGS can safely be sent
+ * twice; a COPY or an EXPUNGE can't.
+ *
+ * The journal is text: the UIDVALIDITY of the mailbox, then a line for each
+ * message: "UID<tab>flags to add<tab>flags to remove".
+ *
+ * | Function              | Description
+ * | :-------------------- | :-----------------------------------------------
+ * | imap_journal_clear()  | Forget the journal, the server has the changes
+ * | imap_journal_replay() | Send the changes in the journal to the server
+ * | imap_journal_save()   | Record the changes the server hasn't got
+ */
+
+#include "config.h"
+#ifdef USE_HCACHE
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "imap_private.h"
+#include "mutt/mutt.h"
+#include "mutt.h"
+#include "context.h"
+#include "header.h"
+#include "message.h"
+#include "protos.h"
+#include "tags.h"
+
+/**
+ * struct JournalEntry - The flag changes of one message
+ */
+struct JournalEntry
+{
+  unsigned int uid;
+  const char *add;    /**< Flags to add, space-separated */
+  const char *remove; /**< Flags to remove, space-separated */
+};
+
+/**
+ * journal_open - Open the header cache of the selected mailbox
+ * @param idata  Server data
+ * @param opened Set to true if the caller must close it
+ * @retval ptr  Header cache
+ * @retval NULL No header cache
+ */
+static header_cache_t *journal_open(struct ImapData *idata, bool *opened)
+{
+  *opened = false;
+  if (idata->hcache)
+    return idata->hcache;
+
+  idata->hcache = imap_hcache_open(idata, NULL);
+  *opened = (idata->hcache != NULL);
+  return idata->hcache;
+}
+
+/**
+ * journal_close - Close the header cache, if journal_open() opened it
+ * @param idata  Server data
+ * @param opened From journal_open()
+ */
+static void journal_close(struct ImapData *idata, bool opened)
+{
+  if (opened)
+    imap_hcache_close(idata);
+}
+
+/**
+ * imap_journal_save - Record the changes the server hasn't got
+ * @param idata Server data
+ *
+ * The journal is replaced by the flag changes of every changed message.
+ */
+void imap_journal_save(struct ImapData *idata)
+{
+  struct Context *ctx = idata->ctx;
+  int count = 0;
+
+  if (!ctx || ctx->readonly)
+    return;
+
+  struct Buffer *journal = mutt_buffer_new();
+  struct Buffer *add = mutt_buffer_new();
+  struct Buffer *remove = mutt_buffer_new();
+
+  mutt_buffer_printf(journal, "%u\n", idata->uid_validity);
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+
+    if (!h->active || !h->changed || !h->data)
+      continue;
+
+    imap_flag_delta(idata, h, false, add, remove);
+    if ((add->dptr == add->data) && (remove->dptr == remove->data))
+      continue;
+
+    mutt_buffer_printf(journal, "%u\t%s\t%s\n", HEADER_DATA(h)->uid,
+                       NONULL(add->data), NONULL(remove->data));
+    count++;
+  }
+
+  if (count || idata->journal)
+  {
+    bool opened;
+    header_cache_t *hc = journal_open(idata, &opened);
+    if (hc)
+    {
+      if (count)
+        mutt_hcache_store_raw(hc, "/JOURNAL", 8, journal->data, mutt_str_strlen(journal->data) + 1);
+      else
+        mutt_hcache_delete(hc, "/JOURNAL", 8);
+      idata->journal = (count > 0);
+      mutt_debug(2, "journal: %d messages\n", count);
+    }
+    journal_close(idata, opened);
+  }
+
+  mutt_buffer_free(&journal);
+  mutt_buffer_free(&add);
+  mutt_buffer_free(&remove);
+}
+
+/**
+ * imap_journal_clear - Forget the journal, the server has the changes
+ * @param idata Server data
+ */
+void imap_journal_clear(struct ImapData *idata)
+{
+  if (!idata->journal)
+    return;
+
+  bool opened;
+  header_cache_t *hc = journal_open(idata, &opened);
+  if (hc)
+    mutt_hcache_delete(hc, "/JOURNAL", 8);
+  journal_close(idata, opened);
+  idata->journal = false;
+}
+
+/**
+ * journal_cmp - Sort journal entries by their flags, then UID
+ * @param a First entry
+ * @param b Second entry
+ * @retval <0 a sorts first
+ * @retval  0 Same
+ * @retval >0 b sorts first
+ */
+static int journal_cmp(const void *a, const void *b)
+{
+  const struct JournalEntry *ea = a;
+  const struct JournalEntry *eb = b;
+
+  int rc = strcmp(ea->add, eb->add);
+  if (rc == 0)
+    rc = strcmp(ea->remove, eb->remove);
+  if (rc == 0)
+    rc = (ea->uid > eb->uid) - (ea->uid < eb->uid);
+  return rc;
+}
+
+/**
+ * journal_store - Queue the UID STOREs for a group of messages
+ * @param idata Server data
+ * @param e     Journal entries, in UID order
+ * @param count Number of entries
+ * @param sign  '+' to add the flags, '-' to remove them
+ * @param flags Flags, space-separated
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+static int journal_store(struct ImapData *idata, struct JournalEntry *e,
+                         int count, char sign, const char *flags)
+{
+  struct Buffer *cmd = mutt_buffer_new();
+  int rc = 0;
+
+  for (int i = 0; i < count;)
+  {
+    cmd->dptr = cmd->data;
+    mutt_buffer_addstr(cmd, "UID STORE ");
+    for (bool first = true; (i < count) && (cmd->dptr - cmd->data < IMAP_MAX_CMDLEN); i++)
+    {
+      unsigned int uid = e[i].uid;
+      while ((i + 1 < count) && (e[i + 1].uid == e[i].uid + 1))
+        i++;
+
+      mutt_buffer_printf(cmd, first ? "%u" : ",%u", uid);
+      if (e[i].uid != uid)
+        mutt_buffer_printf(cmd, ":%u", e[i].uid);
+      first = false;
+    }
+    mutt_buffer_printf(cmd, " %cFLAGS.SILENT (%s)", sign, flags);
+
+    if (imap_exec(idata, cmd->data, IMAP_CMD_QUEUE) != 0)
+    {
+      rc = -1;
+      break;
+    }
+  }
+
+  mutt_buffer_free(&cmd);
+  return rc;
+}
+
+/**
+ * journal_apply - Update a message to match the server
+ * @param ctx   Mailbox
+ * @param h     Email
+ * @param flags Flags, space-separated
+ * @param set   true if the flags were added, false if they were removed
+ * @param kw    Buffer for the keywords among the flags
+ */
+static void journal_apply(struct Context *ctx, struct Header *h,
+                          const char *flags, bool set, struct Buffer *kw)
+{
+  static const struct
+  {
+    const char *name;
+    int flag;
+  } SystemFlags[] = {
+    { "\\Seen", MUTT_READ },       { "\\Flagged", MUTT_FLAG },
+    { "\\Answered", MUTT_REPLIED }, { "\\Deleted", MUTT_DELETE },
+    { "Old", MUTT_OLD },
+  };
+  struct ImapHeaderData *hd = HEADER_DATA(h);
+
+  mutt_buffer_reset(kw);
+  while (*flags)
+  {
+    SKIPWS(flags);
+    size_t len = strcspn(flags, " ");
+    size_t i;
+
+    for (i = 0; i < mutt_array_size(SystemFlags); i++)
+    {
+      if ((mutt_str_strlen(SystemFlags[i].name) == len) &&
+          (mutt_str_strncasecmp(flags, SystemFlags[i].name, len) == 0))
+      {
+        break;
+      }
+    }
+
+    if (i < mutt_array_size(SystemFlags))
+    {
+      mutt_set_flag(ctx, h, SystemFlags[i].flag, set);
+      switch (SystemFlags[i].flag)
+      {
+        case MUTT_READ:
+          hd->read = set;
+          break;
+        case MUTT_FLAG:
+          hd->flagged = set;
+          break;
+        case MUTT_REPLIED:
+          hd->replied = set;
+          break;
+        case MUTT_DELETE:
+          hd->deleted = set;
+          break;
+        case MUTT_OLD:
+          hd->old = set;
+          break;
+      }
+    }
+    else if (len)
+    {
+      if (kw->dptr != kw->data)
+        mutt_buffer_addch(kw, ' ');
+      mutt_buffer_add(kw, flags, len);
+    }
+    flags += len;
+  }
+}
+
+/**
+ * journal_apply_keywords - Update the keywords of a message to match the server
+ * @param h      Email
+ * @param add    Keywords added, space-separated
+ * @param remove Keywords removed, space-separated
+ */
+static void journal_apply_keywords(struct Header *h, const char *add, const char *remove)
+{
+  struct ImapHeaderData *hd = HEADER_DATA(h);
+  struct Buffer *tags = mutt_buffer_new();
+
+  char *old = driver_tags_get_with_hidden(&h->tags);
+  imap_keyword_diff(tags, old, remove);
+  imap_keyword_diff(tags, add, old);
+  FREE(&old);
+
+  driver_tags_replace(&h->tags, NONULL(tags->data));
+  FREE(&hd->flags_remote);
+  hd->flags_remote = driver_tags_get_with_hidden(&h->tags);
+  mutt_buffer_free(&tags);
+}
+
+/**
+ * imap_journal_replay - Send the changes in the journal to the server
+ * @param idata Server data
+ * @retval  0 Success, or there was no journal
+ * @retval -1 The connection was lost, the journal is kept
+ *
+ * This is called when a mailbox has been opened.  The messages which have
+ * been read are updated to match.  A journal from before the mailbox's
+ * UIDVALIDITY changed is thrown away, as is one the server refuses.
+ */
+int imap_journal_replay(struct ImapData *idata)
+{
+  struct Context *ctx = idata->ctx;
+  struct JournalEntry *entries = NULL;
+  char *journal = NULL;
+  int count = 0;
+  int rc = 0;
+  bool opened;
+
+  idata->journal = false;
+  header_cache_t *hc = journal_open(idata, &opened);
+  if (!hc)
+    return 0;
+  void *data = mutt_hcache_fetch_raw(hc, "/JOURNAL", 8);
+  if (data)
+    journal = mutt_str_strdup(data);
+  mutt_hcache_free(hc, &data);
+  journal_close(idata, opened);
+
+  if (!journal)
+    return 0;
+  idata->journal = true;
+
+  unsigned int uid_validity = 0;
+  char *line = journal;
+  char *next = strchr(line, '\n');
+  if (next)
+    *next++ = '\0';
+  if ((mutt_str_atoui(line, &uid_validity) < 0) || (uid_validity != idata->uid_validity))
+  {
+    mutt_debug(1, "journal: UIDVALIDITY %u, not %u\n", uid_validity, idata->uid_validity);
+    imap_journal_clear(idata);
+    FREE(&journal);
+    return 0;
+  }
+
+  /* Wait until the mailbox can be written to */
+  if (ctx->readonly)
+  {
+    FREE(&journal);
+    return 0;
+  }
+
+  for (line = next; line && *line; line = next)
+  {
+    next = strchr(line, '\n');
+    if (next)
+      *next++ = '\0';
+
+    char *add = strchr(line, '\t');
+    char *remove = add ? strchr(add + 1, '\t') : NULL;
+    if (!remove)
+      continue;
+    *add++ = '\0';
+    *remove++ = '\0';
+
+    struct JournalEntry e = { 0, add, remove };
+    if ((mutt_str_atoui(line, &e.uid) < 0) || (e.uid == 0) || (!*add && !*remove))
+      continue;
+
+    if ((count % 256) == 0)
+      mutt_mem_realloc(&entries, (count + 256) * sizeof(struct JournalEntry));
+    entries[count++] = e;
+  }
+
+  if (count)
+    qsort(entries, count, sizeof(struct JournalEntry), journal_cmp);
+
+  /* Runs of entries with the same flags share the STOREs */
+  int queued = 0;
+  for (int i = 0, j; (i < count) && (rc == 0); i = j)
+  {
+    for (j = i + 1; (j < count) && (strcmp(entries[i].add, entries[j].add) == 0) &&
+                    (strcmp(entries[i].remove, entries[j].remove) == 0);
+         j++)
+      ;
+
+    if ((*entries[i].add && (journal_store(idata, entries + i, j - i, '+', entries[i].add) < 0)) ||
+        (*entries[i].remove &&
+         (journal_store(idata, entries + i, j - i, '-', entries[i].remove) < 0)))
+    {
+      rc = -1;
+    }
+    queued++;
+  }
+
+  mutt_debug(2, "journal: replaying %d messages in %d groups\n", count, queued);
+  if ((rc == 0) && queued)
+    rc = imap_exec(idata, NULL, 0);
+
+  if (rc == 0)
+  {
+    struct Buffer *kw_add = mutt_buffer_new();
+    struct Buffer *kw_remove = mutt_buffer_new();
+    bool changed = ctx->changed;
+
+    for (int i = 0; i < count; i++)
+    {
+      struct Header *h = imap_uid_hash_find(idata->uid_hash, entries[i].uid);
+      if (!h || !h->data)
+        continue;
+
+      bool hchanged = h->changed;
+      journal_apply(ctx, h, entries[i].add, true, kw_add);
+      journal_apply(ctx, h, entries[i].remove, false, kw_remove);
+      if ((kw_add->dptr != kw_add->data) || (kw_remove->dptr != kw_remove->data))
+        journal_apply_keywords(h, NONULL(kw_add->data), NONULL(kw_remove->data));
+      h->changed = hchanged;
+    }
+    ctx->changed = changed;
+
+    mutt_buffer_free(&kw_add);
+    mutt_buffer_free(&kw_remove);
+
+    imap_journal_clear(idata);
+    if (count)
+      mutt_message(_("Saved the flag changes of %d messages"), count);
+  }
+  else if (idata->status != IMAP_FATAL)
+  {
+    imap_journal_clear(idata);
+    mutt_error(_("The server refused the saved flag changes"));
+    mutt_sleep(1);
+    rc = 0;
+  }
+
+  FREE(&entries);
+  FREE(&journal);
+  return rc;
+}
+#endif
@@ -28,6 +28,7 @@
  *
  * | Function                | Description
  * | :---------------------- | :-------------------------------------------------
+ * | imap_append_fcc()       | Append one email to several mailboxes
  * | imap_append_message()   | Write an email back to the server
  * | imap_cache_clean()      | Delete all the entries in the message cache
  * | imap_cache_del()        | Delete an email from the body cache
@@ -36,6 +37,10 @@
  * | imap_copy_messages()    | Server COPY messages to another folder
  * | imap_fetch_message()    | Fetch an email from an IMAP server
  * | imap_free_header_data() | free ImapHeader structure
+ * | imap_headers_missing()  | Does a header field still need to be read?
+ * | imap_headers_upgrade()  | Read the rest of the headers left out by $imap_index_headers
+ * | imap_parse_fetch()      | handle headers returned from header fetch
+ * | imap_prefetch()         | Download the messages that are likely to be read next
  * | imap_read_headers()     | Read headers from the server
  * | imap_set_flags()        | fill the message header according to the server flags
  */
@@ -62,10 +67,13 @@
 #include "mailbox.h"
 #include "mutt_account.h"
 #include "mutt_curses.h"
+#include "mutt_menu.h"
 #include "mutt_socket.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
+#include "sort.h"
 #include "tags.h"
 #ifdef USE_HCACHE
 #include "hcache/hcache.h"
@@ -73,6 +81,12 @@
 
 struct BodyCache;
 
+/* The header fields read for every message, plus $imap_headers */
+static const char *const want_headers =
+    "DATE FROM SUBJECT TO CC MESSAGE-ID REFERENCES CONTENT-TYPE "
+    "CONTENT-DESCRIPTION IN-REPLY-TO REPLY-TO LINES LIST-POST X-LABEL "
+    "X-ORIGINAL-TO";
+
 /**
  * new_header_data - Create a new ImapHeaderData
  * @retval ptr New ImapHeaderData
@@ -94,13 +108,15 @@ static void update_context(struct ImapData *idata, int oldmsgcount)
   struct Header *h = NULL;
 
   ctx = idata->ctx;
+  /* Size it for the whole mailbox, as EXISTS told us, not just the headers
+   * we've read so far */
   if (!idata->uid_hash)
-    idata->uid_hash = mutt_hash_int_create(MAX(6 * ctx->msgcount / 5, 30), 0);
+    idata->uid_hash = imap_uid_hash_new(MAX(idata->max_msn, ctx->msgcount));
 
   for (int msgno = oldmsgcount; msgno < ctx->msgcount; msgno++)
   {
     h = ctx->hdrs[msgno];
-    mutt_hash_int_insert(idata->uid_hash, HEADER_DATA(h)->uid, h);
+    imap_uid_hash_insert(idata->uid_hash, HEADER_DATA(h)->uid, h);
   }
 }
 
@@ -197,7 +213,7 @@ static int msg_cache_clean_cb(const char *id, struct BodyCache *bcache, void *da
     return 0;
 
   /* bad UID */
-  if (uv != idata->uid_validity || !mutt_hash_int_find(idata->uid_hash, uid))
+  if (uv != idata->uid_validity || !imap_uid_hash_find(idata->uid_hash, uid))
     mutt_bcache_del(bcache, id);
 
   return 0;
@@ -301,14 +317,14 @@ static char *msg_parse_flags(struct ImapHeader *h, char *s)
 }
 
 /**
- * msg_parse_fetch - handle headers returned from header fetch
+ * imap_parse_fetch - handle headers returned from header fetch
  * @param h IMAP Header
  * @param s Command string
  * @retval  0 Success
  * @retval -1 String is corrupted
  * @retval -2 Fetch contains a body or header lines that still need to be parsed
  */
-static int msg_parse_fetch(struct ImapHeader *h, char *s)
+int imap_parse_fetch(struct ImapHeader *h, char *s)
 {
   char tmp[SHORT_STRING];
   char *ptmp = NULL;
@@ -346,7 +362,7 @@ static int msg_parse_fetch(struct ImapHeader *h, char *s)
       }
       s++;
       ptmp = tmp;
-      while (*s && *s != '\"')
+      while (*s && (*s != '\"') && (ptmp < tmp + sizeof(tmp) - 1))
         *ptmp++ = *s++;
       if (*s != '\"')
         return -1;
@@ -359,12 +375,20 @@ static int msg_parse_fetch(struct ImapHeader *h, char *s)
       s += 11;
       SKIPWS(s);
       ptmp = tmp;
-      while (isdigit((unsigned char) *s))
+      while (isdigit((unsigned char) *s) && (ptmp < tmp + sizeof(tmp) - 1))
         *ptmp++ = *s++;
       *ptmp = '\0';
       if (mutt_str_atol(tmp, &h->content_length) < 0)
         return -1;
     }
+    else if (mutt_str_strncasecmp("MODSEQ", s, 6) == 0)
+    {
+      /* RFC7162: we only track the mailbox's HIGHESTMODSEQ */
+      s = strchr(s, ')');
+      if (!s)
+        return -1;
+      s++;
+    }
     else if ((mutt_str_strncasecmp("BODY", s, 4) == 0) ||
              (mutt_str_strncasecmp("RFC822.HEADER", s, 13) == 0))
     {
@@ -376,7 +400,7 @@ static int msg_parse_fetch(struct ImapHeader *h, char *s)
     else if (*s)
     {
       /* got something i don't understand */
-      imap_error("msg_parse_fetch", s);
+      imap_error("imap_parse_fetch", s);
       return -1;
     }
   }
@@ -386,25 +410,23 @@ static int msg_parse_fetch(struct ImapHeader *h, char *s)
 
 /**
  * msg_fetch_header - import IMAP FETCH response into an ImapHeader
- * @param ctx Context
- * @param h   ImapHeader
- * @param buf Server string containing FETCH response
- * @param fp  Connection to server
+ * @param idata Server data the response came from
+ * @param h     ImapHeader
+ * @param buf   Server string containing FETCH response
+ * @param fp    Connection to server
  * @retval  0 Success
  * @retval -1 String is not a fetch response
  * @retval -2 String is a corrupt fetch response
  *
  * Expects string beginning with * n FETCH.
  */
-static int msg_fetch_header(struct Context *ctx, struct ImapHeader *h, char *buf, FILE *fp)
+static int msg_fetch_header(struct ImapData *idata, struct ImapHeader *h,
+                            char *buf, FILE *fp)
 {
-  struct ImapData *idata = NULL;
   unsigned int bytes;
   int rc = -1; /* default now is that string isn't FETCH response */
   int parse_rc;
 
-  idata = ctx->data;
-
   if (buf[0] != '*')
     return rc;
 
@@ -424,9 +446,9 @@ static int msg_fetch_header(struct Context *ctx, struct ImapHeader *h, char *buf
     return rc;
   buf++;
 
-  /* FIXME: current implementation - call msg_parse_fetch - if it returns -2,
+  /* FIXME: current implementation - call imap_parse_fetch - if it returns -2,
    *   read header lines and call it again. Silly. */
-  parse_rc = msg_parse_fetch(h, buf);
+  parse_rc = imap_parse_fetch(h, buf);
   if (!parse_rc)
     return 0;
   if (parse_rc != -2 || !fp)
@@ -443,7 +465,7 @@ static int msg_fetch_header(struct Context *ctx, struct ImapHeader *h, char *buf
     if (imap_cmd_step(idata) != IMAP_CMD_CONTINUE)
       return rc;
 
-    if (msg_parse_fetch(h, idata->buf) == -1)
+    if (imap_parse_fetch(h, idata->buf) == -1)
       return rc;
   }
 
@@ -469,45 +491,6 @@ static void flush_buffer(char *buf, size_t *len, struct Connection *conn)
   *len = 0;
 }
 
-/**
- * alloc_msn_index - Create lookup table of MSN to Header
- * @param idata     Server data
- * @param msn_count Number of MSNs in use
- *
- * Mapping from Message Sequence Number to Header
- */
-static void alloc_msn_index(struct ImapData *idata, size_t msn_count)
-{
-  size_t new_size;
-
-  if (msn_count <= idata->msn_index_size)
-    return;
-
-  /* This is a conservative check to protect against a malicious imap
-   * server.  Most likely size_t is bigger than an unsigned int, but
-   * if msn_count is this big, we have a serious problem. */
-  if (msn_count >= (UINT_MAX / sizeof(struct Header *)))
-  {
-    mutt_error(_("Integer overflow -- can't allocate memory."));
-    sleep(1);
-    mutt_exit(1);
-  }
-
-  /* Add a little padding, like mx_allloc_memory() */
-  new_size = msn_count + 25;
-
-  if (!idata->msn_index)
-    idata->msn_index = mutt_mem_calloc(new_size, sizeof(struct Header *));
-  else
-  {
-    mutt_mem_realloc(&idata->msn_index, sizeof(struct Header *) * new_size);
-    memset(idata->msn_index + idata->msn_index_size, 0,
-           sizeof(struct Header *) * (new_size - idata->msn_index_size));
-  }
-
-  idata->msn_index_size = new_size;
-}
-
 /**
  * generate_seqset - Generate a sequence set
  * @param b         Buffer for the result
@@ -531,7 +514,7 @@ static void generate_seqset(struct Buffer *b, struct ImapData *idata,
 
   for (msn = msn_begin; msn <= msn_end + 1; msn++)
   {
-    if (msn <= msn_end && !idata->msn_index[msn - 1])
+    if (msn <= msn_end && !imap_msn_get(idata, msn))
     {
       switch (state)
       {
@@ -608,327 +591,962 @@ static void set_changed_flag(struct Context *ctx, struct Header *h,
   }
 }
 
+#ifdef USE_HCACHE
 /**
- * imap_read_headers - Read headers from the server
- * @param idata     Server data
- * @param msn_begin First Message Sequence Number
- * @param msn_end   Last Message Sequence Number
- * @retval num Last MSN
- * @retval -1  Failure
- *
- * Changed to read many headers instead of just one. It will return the msn of
- * the last message read. It will return a value other than msn_end if mail
- * comes in while downloading headers (in theory).
+ * find_uid - Find a header by its UID
+ * @param hdrs  Headers, sorted by UID
+ * @param count Number of headers
+ * @param uid   UID to find
+ * @retval ptr  Header
+ * @retval NULL Not found
  */
-int imap_read_headers(struct ImapData *idata, unsigned int msn_begin, unsigned int msn_end)
+static struct Header *find_uid(struct Header **hdrs, int count, unsigned int uid)
 {
-  struct Context *ctx = NULL;
-  char *hdrreq = NULL;
-  FILE *fp = NULL;
-  char tempfile[_POSIX_PATH_MAX];
-  int msgno, idx;
-  struct ImapHeader h;
-  struct ImapStatus *status = NULL;
-  int rc, mfhrc = 0, oldmsgcount;
-  int fetch_msn_end = 0;
-  unsigned int maxuid = 0;
-  static const char *const want_headers =
-      "DATE FROM SUBJECT TO CC MESSAGE-ID REFERENCES CONTENT-TYPE "
-      "CONTENT-DESCRIPTION IN-REPLY-TO REPLY-TO LINES LIST-POST X-LABEL "
-      "X-ORIGINAL-TO";
-  struct Progress progress;
-  int retval = -1;
-  bool evalhc = false;
-
-#ifdef USE_HCACHE
-  char buf[LONG_STRING];
-  void *uid_validity = NULL;
-  void *puidnext = NULL;
-  unsigned int uidnext = 0;
-#endif /* USE_HCACHE */
-
-  ctx = idata->ctx;
-
-  if (mutt_bit_isset(idata->capabilities, IMAP4REV1))
-  {
-    safe_asprintf(&hdrreq, "BODY.PEEK[HEADER.FIELDS (%s%s%s)]", want_headers,
-                  ImapHeaders ? " " : "", NONULL(ImapHeaders));
-  }
-  else if (mutt_bit_isset(idata->capabilities, IMAP4))
-  {
-    safe_asprintf(&hdrreq, "RFC822.HEADER.LINES (%s%s%s)", want_headers,
-                  ImapHeaders ? " " : "", NONULL(ImapHeaders));
-  }
-  else
-  { /* Unable to fetch headers for lower versions */
-    mutt_error(_("Unable to fetch headers from this IMAP server version."));
-    mutt_sleep(2); /* pause a moment to let the user see the error */
-    goto error_out_0;
-  }
+  int lo = 0, hi = count - 1;
 
-  /* instead of downloading all headers and then parsing them, we parse them
-   * as they come in. */
-  mutt_mktemp(tempfile, sizeof(tempfile));
-  fp = mutt_file_fopen(tempfile, "w+");
-  if (!fp)
+  while (lo <= hi)
   {
-    mutt_error(_("Could not create temporary file %s"), tempfile);
-    mutt_sleep(2);
-    goto error_out_0;
+    int mid = lo + (hi - lo) / 2;
+    unsigned int muid = HEADER_DATA(hdrs[mid])->uid;
+    if (muid == uid)
+      return hdrs[mid];
+    if (muid < uid)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
   }
-  unlink(tempfile);
 
-  /* make sure context has room to hold the mailbox */
-  while (msn_end > ctx->hdrmax)
-    mx_alloc_memory(ctx);
-  alloc_msn_index(idata, msn_end);
+  return NULL;
+}
 
-  idx = ctx->msgcount;
-  oldmsgcount = ctx->msgcount;
-  idata->reopen &= ~(IMAP_REOPEN_ALLOW | IMAP_NEWMAIL_PENDING);
-  idata->new_mail_count = 0;
+/**
+ * cached_flags_differ - Do the server's flags differ from the cached ones?
+ * @param h  Header, restored from the cache
+ * @param hd Server flags
+ * @retval true The cached record needs updating
+ */
+static bool cached_flags_differ(struct Header *h, struct ImapHeaderData *hd)
+{
+  return (h->read != hd->read) || (h->old != hd->old) || (h->deleted != hd->deleted) ||
+         (h->flagged != hd->flagged) || (h->replied != hd->replied);
+}
 
-#ifdef USE_HCACHE
-  idata->hcache = imap_hcache_open(idata, NULL);
+/**
+ * set_cached_flags - Set the keywords and other system flags of a message
+ * @param hd    IMAP header data
+ * @param words Flags, separated by spaces, as stored in "/FLAGS"
+ * @param len   Length of words
+ */
+static void set_cached_flags(struct ImapHeaderData *hd, const char *words, size_t len)
+{
+  char *copy = mutt_str_substr_dup(words, words + len);
 
-  if (idata->hcache && (msn_begin == 1))
+  for (char *w = strtok(copy, " "); w; w = strtok(NULL, " "))
   {
-    uid_validity = mutt_hcache_fetch_raw(idata->hcache, "/UIDVALIDITY", 12);
-    puidnext = mutt_hcache_fetch_raw(idata->hcache, "/UIDNEXT", 8);
-    if (puidnext)
-    {
-      uidnext = *(unsigned int *) puidnext;
-      mutt_hcache_free(idata->hcache, &puidnext);
-    }
-    if (uid_validity && uidnext && *(unsigned int *) uid_validity == idata->uid_validity)
-      evalhc = true;
-    mutt_hcache_free(idata->hcache, &uid_validity);
+    if (*w == '\\')
+      mutt_str_append_item(&hd->flags_system, w, ' ');
+    else
+      mutt_str_append_item(&hd->flags_remote, w, ' ');
   }
-  if (evalhc)
-  {
-    /* L10N:
-       Comparing the cached data with the IMAP server's data */
-    mutt_progress_init(&progress, _("Evaluating cache..."), MUTT_PROGRESS_MSG,
-                       ReadInc, msn_end);
+  FREE(&copy);
+}
 
-    snprintf(buf, sizeof(buf), "UID FETCH 1:%u (UID FLAGS)", uidnext - 1);
+/**
+ * read_headers_qresync - Resynchronise the mailbox using QRESYNC
+ * @param idata    Server data
+ * @param msn_end  Number of messages in the mailbox
+ * @param uidnext  UIDNEXT stored in the header cache
+ * @param modseq   HIGHESTMODSEQ stored in the header cache
+ * @param progress Progress bar
+ * @retval num Number of messages restored from the cache
+ * @retval -1  The cache can't be used; nothing was restored
+ * @retval -2  Fatal error
+ *
+ * Restore the messages listed in "/UIDSEQSET" from the cache, then ask the
+ * server (RFC7162) for the flags that have changed and the messages that have
+ * been expunged since the cache was written.
+ */
+static int read_headers_qresync(struct ImapData *idata, unsigned int msn_end,
+                                unsigned int uidnext, unsigned long long modseq,
+                                struct Progress *progress)
+{
+  struct Context *ctx = idata->ctx;
+  int first = ctx->msgcount;
+  int idx = first;
+  int rc = IMAP_CMD_OK;
+  unsigned int lo, hi;
+  char buf[LONG_STRING];
+  const char *s = NULL;
+  bool ok = false;
 
-    imap_cmd_start(idata, buf);
+  char *seqset = mutt_hcache_fetch_raw(idata->hcache, "/UIDSEQSET", 10);
+  if (!seqset)
+    return -1;
+  char *flags = mutt_hcache_fetch_raw(idata->hcache, "/FLAGS", 6);
+  const char *fp = flags;
 
-    rc = IMAP_CMD_CONTINUE;
-    for (msgno = 1; rc == IMAP_CMD_CONTINUE; msgno++)
+  /* Restore every message the mailbox had, in UID order */
+  s = seqset;
+  while ((rc = imap_seqset_next(&s, &lo, &hi)) == 0)
+  {
+    for (unsigned int uid = lo; uid && (uid <= hi); uid++)
     {
-      mutt_progress_update(&progress, msgno, -1);
-
-      memset(&h, 0, sizeof(h));
-      h.data = new_header_data();
-      do
+      struct Header *h = imap_hcache_get(idata, uid);
+      if (!h)
       {
-        rc = imap_cmd_step(idata);
-        if (rc != IMAP_CMD_CONTINUE)
-          break;
-
-        mfhrc = msg_fetch_header(ctx, &h, idata->buf, NULL);
-        if (mfhrc < 0)
-          continue;
-
-        if (!h.data->uid)
-        {
-          mutt_debug(2, "skipping hcache FETCH response for message number %d "
-                        "missing a UID\n",
-                     h.data->msn);
-          continue;
-        }
-
-        if (h.data->msn < 1 || h.data->msn > msn_end)
-        {
-          mutt_debug(
-              1,
-              "skipping hcache FETCH response for unknown message number %d\n",
-              h.data->msn);
-          continue;
-        }
-
-        if (idata->msn_index[h.data->msn - 1])
+        mutt_debug(2, "UID %u isn't in the header cache\n", uid);
+        goto bail;
+      }
+      mutt_progress_update(progress, idx - first + 1, -1);
+
+      struct ImapHeaderData *hd = new_header_data();
+      hd->uid = uid;
+      hd->read = h->read;
+      hd->old = h->old;
+      hd->deleted = h->deleted;
+      hd->flagged = h->flagged;
+      hd->replied = h->replied;
+
+      /* "/FLAGS" is sorted by UID, too */
+      while (fp && *fp)
+      {
+        unsigned int fuid = strtoul(fp, NULL, 10);
+        const char *eol = strchr(fp, '\n');
+        if (!eol)
+          eol = fp + strlen(fp);
+        if (fuid == uid)
         {
-          mutt_debug(2, "skipping hcache FETCH for duplicate message %d\n",
-                     h.data->msn);
-          continue;
+          const char *words = strchr(fp, ' ');
+          if (words && (words < eol))
+            set_cached_flags(hd, words + 1, eol - words - 1);
         }
+        if (fuid > uid)
+          break;
+        fp = *eol ? eol + 1 : eol;
+      }
 
-        ctx->hdrs[idx] = imap_hcache_get(idata, h.data->uid);
-        if (ctx->hdrs[idx])
-        {
-          idata->max_msn = MAX(idata->max_msn, h.data->msn);
-          idata->msn_index[h.data->msn - 1] = ctx->hdrs[idx];
+      if (idx >= ctx->hdrmax)
+        mx_alloc_memory(ctx);
+      ctx->hdrs[idx] = h;
+      h->index = idx;
+      h->active = true;
+      h->changed = false;
+      h->data = (void *) hd;
+      driver_tags_init(&h->tags);
+      driver_tags_replace(&h->tags, hd->flags_remote);
+      idx++;
+    }
+  }
+  if (rc < 0)
+  {
+    mutt_debug(1, "Corrupt UID sequence set in the header cache\n");
+    goto bail;
+  }
 
-          ctx->hdrs[idx]->index = idx;
-          /* messages which have not been expunged are ACTIVE (borrowed from mh
-           * folders) */
-          ctx->hdrs[idx]->active = true;
-          ctx->hdrs[idx]->read = h.data->read;
-          ctx->hdrs[idx]->old = h.data->old;
-          ctx->hdrs[idx]->deleted = h.data->deleted;
-          ctx->hdrs[idx]->flagged = h.data->flagged;
-          ctx->hdrs[idx]->replied = h.data->replied;
-          ctx->hdrs[idx]->changed = h.data->changed;
-          /*  ctx->hdrs[msgno]->received is restored from mutt_hcache_restore */
-          ctx->hdrs[idx]->data = (void *) (h.data);
-          STAILQ_INIT(&ctx->hdrs[idx]->tags);
-          driver_tags_replace(&ctx->hdrs[idx]->tags, mutt_str_strdup(h.data->flags_remote));
+  /* Which flags changed, and which messages went, since the cache was written.
+   * Until the MSNs are known, untagged FETCH and EXPUNGE are ignored. */
+  snprintf(buf, sizeof(buf), "UID FETCH 1:%u (UID FLAGS) (CHANGEDSINCE %llu VANISHED)",
+           uidnext - 1, modseq);
+  imap_cmd_start(idata, buf);
 
-          ctx->msgcount++;
-          ctx->size += ctx->hdrs[idx]->content->length;
+  do
+  {
+    rc = imap_cmd_step(idata);
+    if (rc != IMAP_CMD_CONTINUE)
+      break;
 
-          h.data = NULL;
-          idx++;
+    s = imap_next_word(idata->buf);
+    if (mutt_str_strncasecmp("VANISHED", s, 8) == 0)
+    {
+      s = imap_next_word((char *) s);
+      if (mutt_str_strncasecmp("(EARLIER)", s, 9) == 0)
+        s = imap_next_word((char *) s);
+      while (imap_seqset_next(&s, &lo, &hi) == 0)
+      {
+        for (unsigned int uid = lo; uid && (uid <= hi); uid++)
+        {
+          struct Header *h = find_uid(&ctx->hdrs[first], idx - first, uid);
+          if (h)
+            h->active = false;
         }
-      } while (mfhrc == -1);
-
-      imap_free_header_data(&h.data);
+      }
+      continue;
+    }
 
-      if ((mfhrc < -1) || ((rc != IMAP_CMD_CONTINUE) && (rc != IMAP_CMD_OK)))
+    struct ImapHeader ih;
+    memset(&ih, 0, sizeof(ih));
+    ih.data = new_header_data();
+    if ((msg_fetch_header(idata, &ih, idata->buf, NULL) == 0) && ih.data->uid)
+    {
+      struct Header *h = find_uid(&ctx->hdrs[first], idx - first, ih.data->uid);
+      if (!h)
       {
-        imap_hcache_close(idata);
-        goto error_out_1;
+        /* The seqset missed a message; the MSNs can't be trusted */
+        mutt_debug(2, "UID %u isn't in the UID sequence set\n", ih.data->uid);
+        imap_free_header_data(&ih.data);
+        goto drain;
       }
+
+      struct ImapHeaderData *hd = HEADER_DATA(h);
+      ih.data->msn = hd->msn;
+      imap_free_header_data(&hd);
+      h->data = (void *) ih.data;
+      h->read = ih.data->read;
+      h->old = ih.data->old;
+      h->deleted = ih.data->deleted;
+      h->flagged = ih.data->flagged;
+      h->replied = ih.data->replied;
+      driver_tags_replace(&h->tags, ih.data->flags_remote);
+      ih.data = NULL;
+
+      /* The cached record must match the server before MODSEQ is stored */
+      imap_hcache_put(idata, h);
     }
+    imap_free_header_data(&ih.data);
+  } while (rc == IMAP_CMD_CONTINUE);
 
-    /* Look for the first empty MSN and start there */
-    while (msn_begin <= msn_end)
+drain:
+  while (rc == IMAP_CMD_CONTINUE)
+    rc = imap_cmd_step(idata);
+
+  if (rc != IMAP_CMD_OK)
+    goto bail;
+
+  /* Drop the expunged messages and number the rest */
+  int count = first;
+  for (int i = first; i < idx; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+    if (!h->active)
     {
-      if (!idata->msn_index[msn_begin - 1])
-        break;
-      msn_begin++;
+      imap_free_header_data((struct ImapHeaderData **) &h->data);
+      mutt_free_header(&h);
+      continue;
     }
+    ctx->hdrs[count] = h;
+    h->index = count;
+    count++;
   }
-#endif /* USE_HCACHE */
+  for (int i = count; i < idx; i++)
+    ctx->hdrs[i] = NULL;
+  idx = count;
 
-  mutt_progress_init(&progress, _("Fetching message headers..."),
-                     MUTT_PROGRESS_MSG, ReadInc, msn_end);
+  if ((unsigned int) (idx - first) > msn_end)
+  {
+    mutt_debug(1, "The cache has %d messages, but the mailbox only %u\n",
+               idx - first, msn_end);
+    goto bail;
+  }
 
-  while (msn_begin <= msn_end && fetch_msn_end < msn_end)
+  for (int i = first; i < idx; i++)
   {
-    char *cmd = NULL;
-    struct Buffer *b = NULL;
+    struct Header *h = ctx->hdrs[i];
+    imap_msn_set(idata, i - first + 1, h);
+    ctx->size += h->content->length;
+  }
+  ctx->msgcount = idx;
+  ok = true;
 
-    b = mutt_buffer_new();
-    if (evalhc)
+bail:
+  if (!ok)
+  {
+    for (int i = first; i < idx; i++)
     {
-      /* In case there are holes in the header cache. */
-      evalhc = false;
-      generate_seqset(b, idata, msn_begin, msn_end);
+      imap_free_header_data((struct ImapHeaderData **) &ctx->hdrs[i]->data);
+      mutt_free_header(&ctx->hdrs[i]);
     }
-    else
-      mutt_buffer_printf(b, "%u:%u", msn_begin, msn_end);
+  }
+  mutt_hcache_free(idata->hcache, (void **) &seqset);
+  mutt_hcache_free(idata->hcache, (void **) &flags);
 
-    fetch_msn_end = msn_end;
-    safe_asprintf(&cmd, "FETCH %s (UID FLAGS INTERNALDATE RFC822.SIZE %s)", b->data, hdrreq);
-    imap_cmd_start(idata, cmd);
-    FREE(&cmd);
-    mutt_buffer_free(&b);
+  if (!ok)
+    return (idata->status == IMAP_FATAL) ? -2 : -1;
 
-    rc = IMAP_CMD_CONTINUE;
-    for (msgno = msn_begin; rc == IMAP_CMD_CONTINUE; msgno++)
-    {
-      mutt_progress_update(&progress, msgno, -1);
+  mutt_debug(2, "QRESYNC restored %d messages\n", idx - first);
+  return idx - first;
+}
+#endif /* USE_HCACHE */
 
-      rewind(fp);
-      memset(&h, 0, sizeof(h));
-      h.data = new_header_data();
+/**
+ * uid_to_msn - Find the MSN of a message by its UID
+ * @param uids      UIDs, in MSN order
+ * @param msn_begin MSN of the first UID
+ * @param msn_end   MSN of the last UID
+ * @param uid       UID to find
+ * @retval num MSN of the message
+ * @retval 0   Not found
+ */
+static unsigned int uid_to_msn(const unsigned int *uids, unsigned int msn_begin,
+                               unsigned int msn_end, unsigned int uid)
+{
+  unsigned int lo = msn_begin, hi = msn_end;
 
-      /* this DO loop does two things:
-       * 1. handles untagged messages, so we can try again on the same msg
-       * 2. fetches the tagged response at the end of the last message.
-       */
+  while (lo <= hi)
+  {
+    unsigned int mid = lo + (hi - lo) / 2;
+    unsigned int muid = uids[mid - msn_begin];
+    if (muid == uid)
+      return mid;
+    if (muid < uid)
+      lo = mid + 1;
+    else
+      hi = mid - 1;
+  }
+
+  return 0;
+}
+
+/**
+ * read_headers_fetch - Read the responses to a header FETCH
+ * @param idata     Server data of the selected mailbox
+ * @param cdata     Connection the FETCH was sent on
+ * @param fp        Temporary file for the headers
+ * @param uids      UIDs of the messages fetched, in MSN order, or NULL
+ * @param msn_begin First MSN fetched
+ * @param msn_end   Last MSN fetched
+ * @param idx       Next free slot in ctx->hdrs
+ * @param maxuid    Largest UID seen
+ * @param progress  Progress bar
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * If uids is given, the messages are placed by UID, not by the MSN in the
+ * response: another connection may number the messages differently.
+ */
+static int read_headers_fetch(struct ImapData *idata, struct ImapData *cdata,
+                              FILE *fp, const unsigned int *uids,
+                              unsigned int msn_begin, unsigned int msn_end,
+                              int *idx, unsigned int *maxuid, struct Progress *progress)
+{
+  struct Context *ctx = idata->ctx;
+  struct ImapHeader h;
+  int rc = IMAP_CMD_CONTINUE;
+  int mfhrc = 0;
+
+  for (unsigned int msgno = msn_begin; rc == IMAP_CMD_CONTINUE; msgno++)
+  {
+    mutt_progress_update(progress, msgno, -1);
+
+    rewind(fp);
+    memset(&h, 0, sizeof(h));
+    h.data = new_header_data();
+
+    /* this DO loop does two things:
+     * 1. handles untagged messages, so we can try again on the same msg
+     * 2. fetches the tagged response at the end of the last message.
+     */
+    do
+    {
+      rc = imap_cmd_step(cdata);
+      if (rc != IMAP_CMD_CONTINUE)
+        break;
+
+      mfhrc = msg_fetch_header(cdata, &h, cdata->buf, fp);
+      if (mfhrc < 0)
+        continue;
+
+      if (!ftello(fp))
+      {
+        mutt_debug(2, "msg_fetch_header: ignoring fetch response with no body\n");
+        continue;
+      }
+
+      /* make sure we don't get remnants from older larger message headers */
+      fputs("\n\n", fp);
+
+      if (uids)
+      {
+        h.data->msn = uid_to_msn(uids, msn_begin, msn_end, h.data->uid);
+        if (!h.data->msn)
+        {
+          mutt_debug(1, "skipping FETCH response for unknown UID %u\n", h.data->uid);
+          continue;
+        }
+      }
+
+      if (h.data->msn < 1 || h.data->msn > msn_end)
+      {
+        mutt_debug(1, "skipping FETCH response for unknown message number %d\n",
+                   h.data->msn);
+        continue;
+      }
+
+      /* May receive FLAGS updates in a separate untagged response (#2935) */
+      if (imap_msn_get(idata, h.data->msn))
+      {
+        mutt_debug(2, "skipping FETCH response for duplicate message %d\n",
+                   h.data->msn);
+        continue;
+      }
+
+      ctx->hdrs[*idx] = mutt_new_header();
+
+      /* with a window, messages are also read from the oldest end */
+      ctx->hdrs[*idx]->index = idata->window ? (int) h.data->msn - 1 : *idx;
+      /* messages which have not been expunged are ACTIVE (borrowed from mh
+       * folders) */
+      ctx->hdrs[*idx]->active = true;
+      ctx->hdrs[*idx]->read = h.data->read;
+      ctx->hdrs[*idx]->old = h.data->old;
+      ctx->hdrs[*idx]->deleted = h.data->deleted;
+      ctx->hdrs[*idx]->flagged = h.data->flagged;
+      ctx->hdrs[*idx]->replied = h.data->replied;
+      ctx->hdrs[*idx]->changed = h.data->changed;
+      ctx->hdrs[*idx]->received = h.received;
+      if (idata->index_headers)
+      {
+        h.data->partial = true;
+        idata->partial = true;
+      }
+      ctx->hdrs[*idx]->data = (void *) (h.data);
+      imap_msn_set(idata, h.data->msn, ctx->hdrs[*idx]);
+      driver_tags_init(&ctx->hdrs[*idx]->tags);
+      driver_tags_replace(&ctx->hdrs[*idx]->tags, h.data->flags_remote);
+
+      if (*maxuid < h.data->uid)
+        *maxuid = h.data->uid;
+
+      rewind(fp);
+      /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
+       *   on h.received being set */
+      ctx->hdrs[*idx]->env = mutt_read_rfc822_header(fp, ctx->hdrs[*idx], 0, 0);
+      /* content built as a side-effect of mutt_read_rfc822_header */
+      ctx->hdrs[*idx]->content->length = h.content_length;
+      ctx->size += h.content_length;
+
+      ctx->msgcount++;
+
+      h.data = NULL;
+      (*idx)++;
+    } while (mfhrc == -1);
+
+    imap_free_header_data(&h.data);
+
+    if ((mfhrc < -1) || ((rc != IMAP_CMD_CONTINUE) && (rc != IMAP_CMD_OK)))
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * fetch_conn_open - Open another connection to the selected mailbox
+ * @param idata Server data of the selected mailbox
+ * @retval ptr  Connection, with the mailbox EXAMINEd
+ * @retval NULL Failure
+ */
+static struct ImapData *fetch_conn_open(struct ImapData *idata)
+{
+  char buf[LONG_STRING * 2];
+  char mbox[LONG_STRING];
+  unsigned int uid_validity = 0;
+  int rc;
+
+  struct ImapData *cdata = imap_conn_find(&idata->conn->account, MUTT_IMAP_CONN_NOSELECT);
+  if (!cdata || (cdata->state < IMAP_AUTHENTICATED))
+    return NULL;
+
+  /* The connection never gets IMAP_REOPEN_ALLOW, so it leaves ctx alone */
+  cdata->ctx = idata->ctx;
+  cdata->mailbox = mutt_str_strdup(idata->mailbox);
+  cdata->reopen = 0;
+  cdata->new_mail_count = 0;
+  cdata->max_msn = 0;
+  cdata->state = IMAP_SELECTED;
+
+  /* EXAMINE leaves \Recent alone and CLOSE won't expunge */
+  imap_munge_mbox_name(cdata, mbox, sizeof(mbox), idata->mailbox);
+  snprintf(buf, sizeof(buf), "EXAMINE %s", mbox);
+  imap_cmd_start(cdata, buf);
+  do
+  {
+    rc = imap_cmd_step(cdata);
+    if (rc != IMAP_CMD_CONTINUE)
+      break;
+
+    char *pc = cdata->buf + 2;
+    if (mutt_str_strncasecmp("OK [UIDVALIDITY", pc, 14) == 0)
+    {
+      pc += 3;
+      pc = imap_next_word(pc);
+      mutt_str_atoui(pc, &uid_validity);
+    }
+  } while (rc == IMAP_CMD_CONTINUE);
+
+  if ((rc == IMAP_CMD_OK) && (uid_validity == idata->uid_validity))
+    return cdata;
+
+  mutt_debug(1, "Can't EXAMINE %s on another connection\n", idata->mailbox);
+  imap_close_connection(cdata);
+  cdata->ctx = NULL;
+  FREE(&cdata->mailbox);
+  return NULL;
+}
+
+/**
+ * fetch_conn_close - Release a connection opened by fetch_conn_open()
+ * @param cdata Connection
+ * @param idle  true if no command is outstanding, so it can be reused
+ */
+static void fetch_conn_close(struct ImapData *cdata, bool idle)
+{
+  if (idle && (cdata->state == IMAP_SELECTED))
+    imap_exec(cdata, "CLOSE", IMAP_CMD_FAIL_OK);
+  else
+    imap_close_connection(cdata);
+
+  if (cdata->state == IMAP_SELECTED)
+    cdata->state = IMAP_AUTHENTICATED;
+  cdata->ctx = NULL;
+  FREE(&cdata->mailbox);
+}
+
+/**
+ * read_headers_parallel - Download headers over several connections at once
+ * @param idata     Server data
+ * @param msn_begin First MSN
+ * @param msn_end   Last MSN
+ * @param hdrreq    Header fields to fetch
+ * @param fp        Temporary file for the headers
+ * @param idx       Next free slot in ctx->hdrs
+ * @param maxuid    Largest UID seen
+ * @param progress  Progress bar
+ * @retval  0 Headers read, though some may be missing
+ * @retval  1 Not worth it, nothing was read
+ * @retval -1 Failure
+ *
+ * Learn the UIDs of the range, then split it into one chunk per connection.
+ * Every chunk is asked for by UID, so that the numbering of the extra
+ * connections doesn't matter, and all the commands are sent before any reply
+ * is read.  NeoMutt reads the replies one connection after another, but the
+ * server can stream them all at once, into the sockets' buffers.
+ */
+static int read_headers_parallel(struct ImapData *idata, unsigned int msn_begin,
+                                 unsigned int msn_end, const char *hdrreq, FILE *fp,
+                                 int *idx, unsigned int *maxuid, struct Progress *progress)
+{
+  struct ImapData *conns[IMAP_FETCH_CONN_MAX] = { 0 };
+  bool started[IMAP_FETCH_CONN_MAX] = { 0 };
+  bool idle[IMAP_FETCH_CONN_MAX] = { 0 };
+  unsigned int count = msn_end - msn_begin + 1;
+  unsigned int *uids = NULL;
+  unsigned int chunk;
+  char buf[LONG_STRING];
+  int nconn, rc;
+  int retval = 1;
+
+  nconn = MIN(ImapFetchConnections, IMAP_FETCH_CONN_MAX);
+  nconn = MIN(nconn, count / IMAP_FETCH_CHUNK_MIN);
+  if (nconn < 2)
+    return 1;
+
+  /* The UIDs are a tiny fraction of the size of the headers */
+  uids = mutt_mem_calloc(count, sizeof(unsigned int));
+  snprintf(buf, sizeof(buf), "FETCH %u:%u (UID)", msn_begin, msn_end);
+  imap_cmd_start(idata, buf);
+  do
+  {
+    rc = imap_cmd_step(idata);
+    if (rc != IMAP_CMD_CONTINUE)
+      break;
+
+    struct ImapHeader ih;
+    memset(&ih, 0, sizeof(ih));
+    ih.data = new_header_data();
+    if ((msg_fetch_header(idata, &ih, idata->buf, NULL) == 0) && ih.data->uid &&
+        (ih.data->msn >= msn_begin) && (ih.data->msn <= msn_end))
+    {
+      uids[ih.data->msn - msn_begin] = ih.data->uid;
+    }
+    imap_free_header_data(&ih.data);
+  } while (rc == IMAP_CMD_CONTINUE);
+
+  if (rc != IMAP_CMD_OK)
+  {
+    if (idata->status == IMAP_FATAL)
+      retval = -1;
+    goto out;
+  }
+
+  for (unsigned int i = 0; i < count; i++)
+  {
+    if (!uids[i] || ((i > 0) && (uids[i] <= uids[i - 1])))
+    {
+      mutt_debug(1, "UIDs of %s are missing or out of order\n", idata->mailbox);
+      goto out;
+    }
+  }
+
+  conns[0] = idata;
+  for (rc = 1; rc < nconn; rc++)
+  {
+    conns[rc] = fetch_conn_open(idata);
+    if (!conns[rc])
+      break;
+  }
+  nconn = rc;
+  if (nconn < 2)
+    goto out;
+
+  mutt_debug(2, "Fetching %u headers over %d connections\n", count, nconn);
+  chunk = (count + nconn - 1) / nconn;
+  for (int i = 0; i < nconn; i++)
+  {
+    char *cmd = NULL;
+    unsigned int first = i * chunk;
+    unsigned int last = MIN(first + chunk, count) - 1;
+
+    safe_asprintf(&cmd, "UID FETCH %u:%u (UID FLAGS INTERNALDATE RFC822.SIZE %s)",
+                  uids[first], uids[last], hdrreq);
+    started[i] = (imap_cmd_start(conns[i], cmd) == 0);
+    FREE(&cmd);
+  }
+
+  retval = 0;
+  for (int i = 0; i < nconn; i++)
+  {
+    unsigned int first = i * chunk;
+    unsigned int last = MIN(first + chunk, count) - 1;
+#ifdef USE_HCACHE
+    int hc_begin = *idx;
+#endif
+
+    /* The mailbox's own connection must succeed; the others leave holes */
+    if (started[i])
+    {
+      rc = read_headers_fetch(idata, conns[i], fp, &uids[first], msn_begin + first,
+                              msn_begin + last, idx, maxuid, progress);
+      idle[i] = (rc == 0);
+    }
+#ifdef USE_HCACHE
+    imap_hcache_put_many(idata, &idata->ctx->hdrs[hc_begin], *idx - hc_begin);
+#endif
+    if ((i == 0) && !idle[i])
+    {
+      retval = -1;
+      break;
+    }
+  }
+
+  for (int i = 1; i < nconn; i++)
+    fetch_conn_close(conns[i], idle[i]);
+
+out:
+  FREE(&uids);
+  return retval;
+}
+
+/**
+ * imap_read_headers - Read headers from the server
+ * @param idata     Server data
+ * @param msn_begin First Message Sequence Number
+ * @param msn_end   Last Message Sequence Number
+ * @retval num Last MSN
+ * @retval -1  Failure
+ *
+ * Changed to read many headers instead of just one. It will return the msn of
+ * the last message read. It will return a value other than msn_end if mail
+ * comes in while downloading headers (in theory).
+ */
+int imap_read_headers(struct ImapData *idata, unsigned int msn_begin, unsigned int msn_end)
+{
+  struct Context *ctx = NULL;
+  char *hdrreq = NULL;
+  FILE *fp = NULL;
+  char tempfile[_POSIX_PATH_MAX];
+  int idx;
+  struct ImapStatus *status = NULL;
+  int rc, oldmsgcount;
+  int fetch_msn_end = 0;
+  unsigned int maxuid = 0;
+  struct Progress progress;
+  int retval = -1;
+  bool evalhc = false;
+
+#ifdef USE_HCACHE
+  char buf[LONG_STRING];
+  int msgno, mfhrc = 0;
+  struct ImapHeader h;
+  void *uid_validity = NULL;
+  void *puidnext = NULL;
+  unsigned int uidnext = 0;
+  unsigned long long modseq = 0;
+  /* Reading the whole mailbox: afterwards, any other records are stale */
+  bool prune = (msn_begin == 1) && (msn_end >= idata->max_msn);
+#endif /* USE_HCACHE */
+
+  mutt_trace_begin("imap_read_headers");
+  ctx = idata->ctx;
+
+  /* Just enough for the index, the rest is read by imap_headers_upgrade() */
+  idata->index_headers = ImapIndexHeaders && *ImapIndexHeaders &&
+                         ((Sort & SORT_MASK) != SORT_THREADS);
+
+  if (mutt_bit_isset(idata->capabilities, IMAP4REV1))
+  {
+    if (idata->index_headers)
+      safe_asprintf(&hdrreq, "BODY.PEEK[HEADER.FIELDS (%s)]", ImapIndexHeaders);
+    else
+      safe_asprintf(&hdrreq, "BODY.PEEK[HEADER.FIELDS (%s%s%s)]", want_headers,
+                    ImapHeaders ? " " : "", NONULL(ImapHeaders));
+  }
+  else if (mutt_bit_isset(idata->capabilities, IMAP4))
+  {
+    if (idata->index_headers)
+      safe_asprintf(&hdrreq, "RFC822.HEADER.LINES (%s)", ImapIndexHeaders);
+    else
+      safe_asprintf(&hdrreq, "RFC822.HEADER.LINES (%s%s%s)", want_headers,
+                    ImapHeaders ? " " : "", NONULL(ImapHeaders));
+  }
+  else
+  { /* Unable to fetch headers for lower versions */
+    mutt_error(_("Unable to fetch headers from this IMAP server version."));
+    mutt_sleep(2); /* pause a moment to let the user see the error */
+    goto error_out_0;
+  }
+
+  /* instead of downloading all headers and then parsing them, we parse them
+   * as they come in. */
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  fp = mutt_file_fopen(tempfile, "w+");
+  if (!fp)
+  {
+    mutt_error(_("Could not create temporary file %s"), tempfile);
+    mutt_sleep(2);
+    goto error_out_0;
+  }
+  unlink(tempfile);
+
+  /* make sure context has room to hold the mailbox */
+  while (msn_end > ctx->hdrmax)
+    mx_alloc_memory(ctx);
+
+  idx = ctx->msgcount;
+  oldmsgcount = ctx->msgcount;
+  idata->reopen &= ~(IMAP_REOPEN_ALLOW | IMAP_NEWMAIL_PENDING);
+  idata->new_mail_count = 0;
+
+#ifdef USE_HCACHE
+  idata->hcache = imap_hcache_open(idata, NULL);
+
+  if (idata->hcache && prune)
+  {
+    uid_validity = mutt_hcache_fetch_raw(idata->hcache, "/UIDVALIDITY", 12);
+    puidnext = mutt_hcache_fetch_raw(idata->hcache, "/UIDNEXT", 8);
+    if (puidnext)
+    {
+      uidnext = *(unsigned int *) puidnext;
+      mutt_hcache_free(idata->hcache, &puidnext);
+    }
+    if (uid_validity && uidnext && *(unsigned int *) uid_validity == idata->uid_validity)
+      evalhc = true;
+    mutt_hcache_free(idata->hcache, &uid_validity);
+
+    if (evalhc && idata->qresync && idata->modseq)
+    {
+      void *pmodseq = mutt_hcache_fetch_raw(idata->hcache, "/MODSEQ", 7);
+      if (pmodseq)
+      {
+        modseq = *(unsigned long long *) pmodseq;
+        mutt_hcache_free(idata->hcache, &pmodseq);
+      }
+    }
+  }
+  if (modseq)
+  {
+    mutt_progress_init(&progress, _("Evaluating cache..."), MUTT_PROGRESS_MSG,
+                       ReadInc, msn_end);
+
+    rc = read_headers_qresync(idata, msn_end, uidnext, modseq, &progress);
+    if (rc == -2)
+    {
+      imap_hcache_close(idata);
+      goto error_out_1;
+    }
+    if (rc >= 0)
+    {
+      /* Only the new messages are left to fetch */
+      evalhc = false;
+      idx = ctx->msgcount;
+      msn_begin = rc + 1;
+    }
+  }
+  if (evalhc)
+  {
+    /* L10N:
+       Comparing the cached data with the IMAP server's data */
+    mutt_progress_init(&progress, _("Evaluating cache..."), MUTT_PROGRESS_MSG,
+                       ReadInc, msn_end);
+
+    snprintf(buf, sizeof(buf), "UID FETCH 1:%u (UID FLAGS)", uidnext - 1);
+
+    imap_cmd_start(idata, buf);
+
+    rc = IMAP_CMD_CONTINUE;
+    for (msgno = 1; rc == IMAP_CMD_CONTINUE; msgno++)
+    {
+      mutt_progress_update(&progress, msgno, -1);
+
+      memset(&h, 0, sizeof(h));
+      h.data = new_header_data();
       do
       {
         rc = imap_cmd_step(idata);
         if (rc != IMAP_CMD_CONTINUE)
           break;
 
-        mfhrc = msg_fetch_header(ctx, &h, idata->buf, fp);
+        mfhrc = msg_fetch_header(idata, &h, idata->buf, NULL);
         if (mfhrc < 0)
           continue;
 
-        if (!ftello(fp))
+        if (!h.data->uid)
         {
-          mutt_debug(
-              2, "msg_fetch_header: ignoring fetch response with no body\n");
-          continue;
-        }
-
-        /* make sure we don't get remnants from older larger message headers */
-        fputs("\n\n", fp);
+          mutt_debug(2, "skipping hcache FETCH response for message number %d "
+                        "missing a UID\n",
+                     h.data->msn);
+          continue;
+        }
 
-        if (h.data->msn < 1 || h.data->msn > fetch_msn_end)
+        if (h.data->msn < 1 || h.data->msn > msn_end)
         {
-          mutt_debug(1,
-                     "skipping FETCH response for unknown message number %d\n",
-                     h.data->msn);
+          mutt_debug(
+              1,
+              "skipping hcache FETCH response for unknown message number %d\n",
+              h.data->msn);
           continue;
         }
 
-        /* May receive FLAGS updates in a separate untagged response (#2935) */
-        if (idata->msn_index[h.data->msn - 1])
+        if (imap_msn_get(idata, h.data->msn))
         {
-          mutt_debug(2, "skipping FETCH response for duplicate message %d\n",
+          mutt_debug(2, "skipping hcache FETCH for duplicate message %d\n",
                      h.data->msn);
           continue;
         }
 
-        ctx->hdrs[idx] = mutt_new_header();
-
-        idata->max_msn = MAX(idata->max_msn, h.data->msn);
-        idata->msn_index[h.data->msn - 1] = ctx->hdrs[idx];
-
-        ctx->hdrs[idx]->index = idx;
-        /* messages which have not been expunged are ACTIVE (borrowed from mh
-         * folders) */
-        ctx->hdrs[idx]->active = true;
-        ctx->hdrs[idx]->read = h.data->read;
-        ctx->hdrs[idx]->old = h.data->old;
-        ctx->hdrs[idx]->deleted = h.data->deleted;
-        ctx->hdrs[idx]->flagged = h.data->flagged;
-        ctx->hdrs[idx]->replied = h.data->replied;
-        ctx->hdrs[idx]->changed = h.data->changed;
-        ctx->hdrs[idx]->received = h.received;
-        ctx->hdrs[idx]->data = (void *) (h.data);
-        STAILQ_INIT(&ctx->hdrs[idx]->tags);
-        driver_tags_replace(&ctx->hdrs[idx]->tags, mutt_str_strdup(h.data->flags_remote));
-
-        if (maxuid < h.data->uid)
-          maxuid = h.data->uid;
-
-        rewind(fp);
-        /* NOTE: if Date: header is missing, mutt_read_rfc822_header depends
-         *   on h.received being set */
-        ctx->hdrs[idx]->env = mutt_read_rfc822_header(fp, ctx->hdrs[idx], 0, 0);
-        /* content built as a side-effect of mutt_read_rfc822_header */
-        ctx->hdrs[idx]->content->length = h.content_length;
-        ctx->size += h.content_length;
+        ctx->hdrs[idx] = imap_hcache_get(idata, h.data->uid);
+        if (ctx->hdrs[idx])
+        {
+          /* A later QRESYNC reopen will trust the cached flags */
+          bool stale = idata->qresync && cached_flags_differ(ctx->hdrs[idx], h.data);
 
-#ifdef USE_HCACHE
-        imap_hcache_put(idata, ctx->hdrs[idx]);
-#endif /* USE_HCACHE */
+          ctx->hdrs[idx]->index = idx;
+          /* messages which have not been expunged are ACTIVE (borrowed from mh
+           * folders) */
+          ctx->hdrs[idx]->active = true;
+          ctx->hdrs[idx]->read = h.data->read;
+          ctx->hdrs[idx]->old = h.data->old;
+          ctx->hdrs[idx]->deleted = h.data->deleted;
+          ctx->hdrs[idx]->flagged = h.data->flagged;
+          ctx->hdrs[idx]->replied = h.data->replied;
+          ctx->hdrs[idx]->changed = h.data->changed;
+          /*  ctx->hdrs[msgno]->received is restored from mutt_hcache_restore */
+          ctx->hdrs[idx]->data = (void *) (h.data);
+          imap_msn_set(idata, h.data->msn, ctx->hdrs[idx]);
+          driver_tags_init(&ctx->hdrs[idx]->tags);
+          driver_tags_replace(&ctx->hdrs[idx]->tags, h.data->flags_remote);
+          if (stale)
+            imap_hcache_put(idata, ctx->hdrs[idx]);
 
-        ctx->msgcount++;
+          ctx->msgcount++;
+          ctx->size += ctx->hdrs[idx]->content->length;
 
-        h.data = NULL;
-        idx++;
+          h.data = NULL;
+          idx++;
+        }
       } while (mfhrc == -1);
 
       imap_free_header_data(&h.data);
 
       if ((mfhrc < -1) || ((rc != IMAP_CMD_CONTINUE) && (rc != IMAP_CMD_OK)))
       {
-#ifdef USE_HCACHE
         imap_hcache_close(idata);
-#endif
         goto error_out_1;
       }
     }
 
+    /* Look for the first empty MSN and start there */
+    while (msn_begin <= msn_end)
+    {
+      if (!imap_msn_get(idata, msn_begin))
+        break;
+      msn_begin++;
+    }
+  }
+#endif /* USE_HCACHE */
+
+  /* Only read the most recent headers, the rest is paged in later */
+  if (!evalhc && (msn_begin == 1) && (msn_end >= idata->max_msn) &&
+      (ImapFetchWindow > 0) && (msn_end > ImapFetchWindow) &&
+      ((Sort & SORT_MASK) != SORT_THREADS))
+  {
+    mutt_debug(2, "Reading the last %d of %u headers\n", ImapFetchWindow, msn_end);
+    idata->window = true;
+    idata->msn_unread = msn_end - ImapFetchWindow;
+    msn_begin = idata->msn_unread + 1;
+  }
+
+  mutt_progress_init(&progress, _("Fetching message headers..."),
+                     MUTT_PROGRESS_MSG, ReadInc, msn_end);
+
+  if (!evalhc && (ImapFetchConnections > 1))
+  {
+    rc = read_headers_parallel(idata, msn_begin, msn_end, hdrreq, fp, &idx,
+                               &maxuid, &progress);
+    if (rc < 0)
+    {
+#ifdef USE_HCACHE
+      imap_hcache_close(idata);
+#endif
+      goto error_out_1;
+    }
+    if (rc == 0)
+    {
+      /* Fetch whatever the other connections didn't deliver */
+      while ((msn_begin <= msn_end) && imap_msn_get(idata, msn_begin))
+        msn_begin++;
+      evalhc = true;
+    }
+  }
+
+  while (msn_begin <= msn_end && fetch_msn_end < msn_end)
+  {
+    char *cmd = NULL;
+    struct Buffer *b = NULL;
+#ifdef USE_HCACHE
+    /* headers fetched by this command are cached in one batch */
+    int hc_begin = idx;
+#endif
+
+    b = mutt_buffer_new();
+    if (evalhc)
+    {
+      /* In case there are holes in the header cache, or in what the other
+       * connections fetched. */
+      evalhc = false;
+      generate_seqset(b, idata, msn_begin, msn_end);
+    }
+    else
+      mutt_buffer_printf(b, "%u:%u", msn_begin, msn_end);
+
+    fetch_msn_end = msn_end;
+    safe_asprintf(&cmd, "FETCH %s (UID FLAGS INTERNALDATE RFC822.SIZE %s)", b->data, hdrreq);
+    imap_cmd_start(idata, cmd);
+    FREE(&cmd);
+    mutt_buffer_free(&b);
+
+    rc = read_headers_fetch(idata, idata, fp, NULL, msn_begin, fetch_msn_end,
+                            &idx, &maxuid, &progress);
+#ifdef USE_HCACHE
+    imap_hcache_put_many(idata, &ctx->hdrs[hc_begin], idx - hc_begin);
+#endif
+    if (rc < 0)
+    {
+#ifdef USE_HCACHE
+      imap_hcache_close(idata);
+#endif
+      goto error_out_1;
+    }
+
     /* In case we get new mail while fetching the headers.
      *
      * Note: The RFC says we shouldn't get any EXPUNGE responses in the
@@ -943,7 +1561,6 @@ int imap_read_headers(struct ImapData *idata, unsigned int msn_begin, unsigned i
       msn_end = idata->new_mail_count;
       while (msn_end > ctx->hdrmax)
         mx_alloc_memory(ctx);
-      alloc_msn_index(idata, msn_end);
       idata->reopen &= ~IMAP_NEWMAIL_PENDING;
       idata->new_mail_count = 0;
     }
@@ -967,6 +1584,24 @@ int imap_read_headers(struct ImapData *idata, unsigned int msn_begin, unsigned i
     mutt_hcache_store_raw(idata->hcache, "/UIDNEXT", 8, &idata->uidnext,
                           sizeof(idata->uidnext));
 
+  if (idata->qresync)
+    imap_hcache_store_uid_seqset(idata);
+  if (prune && idata->msn_unread)
+  {
+    /* Part of the mailbox is unknown: the next open must check every message */
+    mutt_hcache_delete(idata->hcache, "/MODSEQ", 7);
+  }
+  else if (prune)
+  {
+    /* Every cached record now matches the server at HIGHESTMODSEQ */
+    if (idata->qresync && idata->modseq)
+      mutt_hcache_store_raw(idata->hcache, "/MODSEQ", 7, &idata->modseq,
+                            sizeof(idata->modseq));
+    else
+      mutt_hcache_delete(idata->hcache, "/MODSEQ", 7);
+    imap_hcache_prune(idata);
+  }
+
   imap_hcache_close(idata);
 #endif /* USE_HCACHE */
 
@@ -988,7 +1623,9 @@ error_out_1:
 
 error_out_0:
   FREE(&hdrreq);
+  idata->index_headers = false;
 
+  mutt_trace_end("imap_read_headers");
   return retval;
 }
 
@@ -1148,72 +1785,441 @@ int imap_fetch_message(struct Context *ctx, struct Message *msg, int msgno)
     }
   } while (rc == IMAP_CMD_CONTINUE);
 
-  /* see comment before command start. */
-  h->active = true;
+  /* see comment before command start. */
+  h->active = true;
+
+  fflush(msg->fp);
+  if (ferror(msg->fp))
+  {
+    mutt_perror(cache->path);
+    goto bail;
+  }
+
+  if (rc != IMAP_CMD_OK)
+    goto bail;
+
+  if (!fetched || !imap_code(idata->buf))
+    goto bail;
+
+  msg_cache_commit(idata, h);
+
+parsemsg:
+  /* Update the header information.  Previously, we only downloaded a
+   * portion of the headers, those required for the main display.
+   */
+  rewind(msg->fp);
+  /* It may be that the Status header indicates a message is read, but the
+   * IMAP server doesn't know the message has been \Seen. So we capture
+   * the server's notion of 'read' and if it differs from the message info
+   * picked up in mutt_read_rfc822_header, we mark the message (and context
+   * changed). Another possibility: ignore Status on IMAP? */
+  read = h->read;
+  newenv = mutt_read_rfc822_header(msg->fp, h, 0, 0);
+  mutt_env_merge(h->env, &newenv);
+
+  /* see above. We want the new status in h->read, so we unset it manually
+   * and let mutt_set_flag set it correctly, updating context. */
+  if (read != h->read)
+  {
+    h->read = read;
+    mutt_set_flag(ctx, h, MUTT_NEW, read);
+  }
+
+  h->lines = 0;
+  fgets(buf, sizeof(buf), msg->fp);
+  while (!feof(msg->fp))
+  {
+    h->lines++;
+    fgets(buf, sizeof(buf), msg->fp);
+  }
+
+  h->content->length = ftell(msg->fp) - h->content->offset;
+
+  mutt_clear_error();
+  rewind(msg->fp);
+  HEADER_DATA(h)->parsed = true;
+  HEADER_DATA(h)->partial = false;
+
+  return 0;
+
+bail:
+  mutt_file_fclose(&msg->fp);
+  imap_cache_del(idata, h);
+  if (cache->path)
+  {
+    unlink(cache->path);
+    FREE(&cache->path);
+  }
+
+  return -1;
+}
+
+/**
+ * struct PrefetchSlot - A message being downloaded ahead of time
+ */
+struct PrefetchSlot
+{
+  struct Header *h;
+  FILE *fp;                /**< Temporary file in the body cache */
+  char seq[SEQLEN + 1];    /**< Tag of the UID FETCH command */
+  bool fetched;            /**< The body has been read */
+};
+
+/**
+ * prefetch_finish - Put a prefetched message into the body cache
+ * @param idata Server data
+ * @param slot  Prefetched message
+ * @param ok    The UID FETCH succeeded
+ */
+static void prefetch_finish(struct ImapData *idata, struct PrefetchSlot *slot, bool ok)
+{
+  char id[_POSIX_PATH_MAX];
+
+  slot->h->active = true;
+  snprintf(id, sizeof(id), "%u-%u.tmp", idata->uid_validity, HEADER_DATA(slot->h)->uid);
+
+  if (mutt_file_fclose(&slot->fp) || !ok || !slot->fetched)
+    mutt_bcache_del(idata->bcache, id);
+  else
+    msg_cache_commit(idata, slot->h);
+}
+
+/**
+ * imap_prefetch - Download the messages that are likely to be read next
+ * @param ctx Mailbox
+ * @param cur Message being displayed
+ *
+ * Pipeline UID FETCHes for the messages that follow cur in the index, in the
+ * current sort order, and store them in the body cache.  Two commands are
+ * kept in flight, so that a key press stops the downloads quickly.
+ */
+void imap_prefetch(struct Context *ctx, struct Header *cur)
+{
+  struct PrefetchSlot slots[32];
+  char buf[LONG_STRING];
+  char *pc = NULL;
+  unsigned int msn, bytes;
+  int count = 0, sent = 0, running = 0;
+  int rc;
+
+  if ((ImapPrefetch <= 0) || !ctx || (ctx->magic != MUTT_IMAP) || !cur || (cur->virtual < 0))
+    return;
+
+  struct ImapData *idata = ctx->data;
+  if ((idata->state < IMAP_SELECTED) || !mutt_bit_isset(idata->capabilities, IMAP4REV1))
+    return;
+
+  idata->bcache = msg_cache_open(idata);
+  if (!idata->bcache)
+    return;
+
+  int last = MIN(cur->virtual + MIN(ImapPrefetch, (int) mutt_array_size(slots)), ctx->vcount - 1);
+  for (int v = cur->virtual + 1; v <= last; v++)
+  {
+    struct Header *h = ctx->hdrs[ctx->v2r[v]];
+    if (!h->active || (h->content->length > ImapPrefetchSize * 1024L))
+      continue;
+
+    snprintf(buf, sizeof(buf), "%u-%u", idata->uid_validity, HEADER_DATA(h)->uid);
+    if (mutt_bcache_exists(idata->bcache, buf) == 0)
+      continue;
+
+    memset(&slots[count], 0, sizeof(struct PrefetchSlot));
+    slots[count++].h = h;
+  }
+
+  if (count)
+    mutt_debug(2, "prefetching %d messages\n", count);
+
+  while (true)
+  {
+    /* keep the pipeline busy, but don't start anything new on a key press */
+    while ((sent < count) && (running < 2) && !mutt_key_pending())
+    {
+      struct PrefetchSlot *slot = &slots[sent++];
+      slot->fp = msg_cache_put(idata, slot->h);
+      if (!slot->fp)
+        continue;
+
+      snprintf(buf, sizeof(buf), "UID FETCH %u BODY.PEEK[]", HEADER_DATA(slot->h)->uid);
+      if (imap_cmd_start(idata, buf) < 0)
+      {
+        prefetch_finish(idata, slot, false);
+        break;
+      }
+      mutt_str_strfcpy(slot->seq,
+                       idata->cmds[(idata->nextcmd + idata->cmdslots - 1) % idata->cmdslots].seq,
+                       sizeof(slot->seq));
+      /* keep the FETCH handler away from this message, see imap_fetch_message() */
+      slot->h->active = false;
+      running++;
+    }
+
+    if (!running)
+      break;
+
+    /* a NO or BAD only fails its own command, see below */
+    rc = imap_cmd_step(idata);
+    if ((rc == IMAP_CMD_RESPOND) || (idata->state < IMAP_SELECTED))
+      break;
+
+    if (mutt_str_strncmp(idata->buf, "* ", 2) == 0)
+    {
+      pc = imap_next_word(idata->buf);
+      if ((mutt_str_atoui(pc, &msn) < 0) || (msn < 1) || (msn > idata->max_msn))
+        continue;
+      pc = imap_next_word(pc);
+      if (mutt_str_strncasecmp("FETCH", pc, 5) != 0)
+        continue;
+
+      struct PrefetchSlot *slot = NULL;
+      for (int i = 0; i < sent; i++)
+        if (slots[i].fp && !slots[i].fetched && (slots[i].h == imap_msn_get(idata, msn)))
+          slot = &slots[i];
+      if (!slot)
+        continue;
+
+      while (*pc)
+      {
+        pc = imap_next_word(pc);
+        if (pc[0] == '(')
+          pc++;
+        if (mutt_str_strncasecmp("BODY[]", pc, 6) != 0)
+          continue;
+
+        pc = imap_next_word(pc);
+        if ((imap_get_literal_count(pc, &bytes) < 0) ||
+            (imap_read_literal(slot->fp, idata, bytes, NULL) < 0))
+        {
+          goto bail;
+        }
+        slot->fetched = true;
+        /* pick up trailing line */
+        imap_cmd_step(idata);
+        if (idata->state < IMAP_SELECTED)
+          goto bail;
+        break;
+      }
+    }
+    else
+    {
+      for (int i = 0; i < sent; i++)
+      {
+        if (slots[i].fp && (mutt_str_strncmp(idata->buf, slots[i].seq, SEQLEN) == 0))
+        {
+          prefetch_finish(idata, &slots[i], imap_code(idata->buf));
+          running--;
+        }
+      }
+    }
+  }
+
+bail:
+  for (int i = 0; i < sent; i++)
+    if (slots[i].fp)
+      prefetch_finish(idata, &slots[i], false);
+}
+
+/**
+ * imap_headers_missing - Does a header field still need to be read?
+ * @param ctx   Context
+ * @param field Header field, e.g. "SUBJECT", or NULL for any field
+ * @retval true Some messages only have $imap_index_headers, without this field
+ */
+bool imap_headers_missing(struct Context *ctx, const char *field)
+{
+  struct ImapData *idata = NULL;
+  size_t len;
+
+  if (!ctx || (ctx->magic != MUTT_IMAP))
+    return false;
+
+  idata = ctx->data;
+  if (!idata || !idata->partial)
+    return false;
+
+  if (!field)
+    return true;
+
+  len = mutt_str_strlen(field);
+  for (const char *p = NONULL(ImapIndexHeaders); *p;)
+  {
+    SKIPWS(p);
+    if ((mutt_str_strncasecmp(p, field, len) == 0) && (!p[len] || isspace((unsigned char) p[len])))
+      return false;
+    while (*p && !isspace((unsigned char) *p))
+      p++;
+  }
+
+  return true;
+}
+
+/**
+ * upgrade_header - Merge the rest of a message's header fields
+ * @param idata Server data
+ * @param h     Header, with just $imap_index_headers
+ * @param fp    Header fields from the server
+ */
+static void upgrade_header(struct ImapData *idata, struct Header *h, FILE *fp)
+{
+  struct Context *ctx = idata->ctx;
+  struct Envelope *newenv = NULL;
+  bool had_id = h->env->message_id;
+  bool had_label = h->env->x_label;
+  LOFF_T length = h->content->length;
+
+  rewind(fp);
+  newenv = mutt_read_rfc822_header(fp, h, 0, 0);
+  mutt_env_merge(h->env, &newenv);
+  /* RFC822.SIZE is still the best we know */
+  h->content->length = length;
 
-  fflush(msg->fp);
-  if (ferror(msg->fp))
-  {
-    mutt_perror(cache->path);
-    goto bail;
-  }
+  if (!had_id && h->env->message_id && ctx->id_hash)
+    mutt_hash_insert(ctx->id_hash, h->env->message_id, h);
+  if (!had_label)
+    mutt_label_hash_add(ctx, h);
+  if (Score)
+    mutt_score_message(ctx, h, 1);
 
-  if (rc != IMAP_CMD_OK)
-    goto bail;
+  HEADER_DATA(h)->partial = false;
+#ifdef USE_HCACHE
+  imap_hcache_put(idata, h);
+#endif
+}
 
-  if (!fetched || !imap_code(idata->buf))
-    goto bail;
+/**
+ * imap_headers_upgrade - Read the rest of the headers left out by $imap_index_headers
+ * @param ctx Context
+ * @param all If true, read them all; otherwise stop when a key is pressed
+ * @retval  0 Success, or the user pressed a key
+ * @retval -1 Failure
+ *
+ * The headers are read in batches, by UID, and merged into the envelopes.
+ * Once they're complete, they're also put in the header cache.
+ */
+int imap_headers_upgrade(struct Context *ctx, bool all)
+{
+  /* Messages per command: few enough that a key press is noticed soon, and
+   * that even scattered UIDs fit in IMAP_MAX_CMDLEN */
+  enum { batch = 64 };
 
-  msg_cache_commit(idata, h);
+  struct Header *hdrs[batch];
+  struct ImapData *idata = NULL;
+  struct ImapHeader ih;
+  struct Header *h = NULL;
+  struct Buffer *cmd = NULL;
+  char tempfile[_POSIX_PATH_MAX];
+  FILE *fp = NULL;
+  unsigned int count;
+  int rc = IMAP_CMD_OK;
+  int retval = -1;
 
-parsemsg:
-  /* Update the header information.  Previously, we only downloaded a
-   * portion of the headers, those required for the main display.
-   */
-  rewind(msg->fp);
-  /* It may be that the Status header indicates a message is read, but the
-   * IMAP server doesn't know the message has been \Seen. So we capture
-   * the server's notion of 'read' and if it differs from the message info
-   * picked up in mutt_read_rfc822_header, we mark the message (and context
-   * changed). Another possibility: ignore Status on IMAP? */
-  read = h->read;
-  newenv = mutt_read_rfc822_header(msg->fp, h, 0, 0);
-  mutt_env_merge(h->env, &newenv);
+  if (!ctx || (ctx->magic != MUTT_IMAP))
+    return 0;
 
-  /* see above. We want the new status in h->read, so we unset it manually
-   * and let mutt_set_flag set it correctly, updating context. */
-  if (read != h->read)
+  idata = ctx->data;
+  if (!idata || !idata->partial || (idata->state < IMAP_SELECTED))
+    return 0;
+
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  fp = mutt_file_fopen(tempfile, "w+");
+  if (!fp)
   {
-    h->read = read;
-    mutt_set_flag(ctx, h, MUTT_NEW, read);
+    mutt_error(_("Could not create temporary file %s"), tempfile);
+    return -1;
   }
+  unlink(tempfile);
 
-  h->lines = 0;
-  fgets(buf, sizeof(buf), msg->fp);
-  while (!feof(msg->fp))
+  if (all)
+    mutt_message(_("Fetching message headers..."));
+
+#ifdef USE_HCACHE
+  idata->hcache = imap_hcache_open(idata, NULL);
+#endif
+
+  cmd = mutt_buffer_new();
+  while (retval < 0)
   {
-    h->lines++;
-    fgets(buf, sizeof(buf), msg->fp);
-  }
+    if (!all && mutt_key_pending())
+    {
+      retval = 0;
+      break;
+    }
 
-  h->content->length = ftell(msg->fp) - h->content->offset;
+    count = 0;
+    for (unsigned int msn = 1; (msn <= idata->max_msn) && (count < batch); msn++)
+    {
+      h = imap_msn_get(idata, msn);
+      if (h && h->active && HEADER_DATA(h)->partial)
+        hdrs[count++] = h;
+    }
 
-  mutt_clear_error();
-  rewind(msg->fp);
-  HEADER_DATA(h)->parsed = true;
+    /* MSN order is UID order, so the UIDs make ranges */
+    mutt_buffer_reset(cmd);
+    mutt_buffer_addstr(cmd, "UID FETCH ");
+    for (unsigned int i = 0, j; i < count; i = j)
+    {
+      for (j = i + 1; (j < count) && (HEADER_DATA(hdrs[j])->uid ==
+                                      HEADER_DATA(hdrs[j - 1])->uid + 1);
+           j++)
+        ;
+      mutt_buffer_printf(cmd, i ? ",%u" : "%u", HEADER_DATA(hdrs[i])->uid);
+      if (j - i > 1)
+        mutt_buffer_printf(cmd, ":%u", HEADER_DATA(hdrs[j - 1])->uid);
+    }
 
-  return 0;
+    if (!count)
+    {
+      idata->partial = false;
+      retval = 0;
+      break;
+    }
 
-bail:
-  mutt_file_fclose(&msg->fp);
-  imap_cache_del(idata, h);
-  if (cache->path)
-  {
-    unlink(cache->path);
-    FREE(&cache->path);
+    mutt_buffer_printf(cmd, " (UID BODY.PEEK[HEADER.FIELDS (%s%s%s)])", want_headers,
+                       ImapHeaders ? " " : "", NONULL(ImapHeaders));
+
+    imap_cmd_start(idata, cmd->data);
+    do
+    {
+      rc = imap_cmd_step(idata);
+      if (rc != IMAP_CMD_CONTINUE)
+        break;
+
+      rewind(fp);
+      memset(&ih, 0, sizeof(ih));
+      ih.data = new_header_data();
+      if ((msg_fetch_header(idata, &ih, idata->buf, fp) == 0) && ftello(fp))
+      {
+        /* make sure we don't get remnants from older larger message headers */
+        fputs("\n\n", fp);
+        h = imap_uid_hash_find(idata->uid_hash, ih.data->uid);
+        if (h && h->data && HEADER_DATA(h)->partial)
+          upgrade_header(idata, h, fp);
+      }
+      imap_free_header_data(&ih.data);
+    } while (rc == IMAP_CMD_CONTINUE);
+
+    if (rc != IMAP_CMD_OK)
+      break;
+
+    /* Don't ask again for anything the server didn't return */
+    for (unsigned int i = 0; i < count; i++)
+      if (hdrs[i]->data)
+        HEADER_DATA(hdrs[i])->partial = false;
   }
 
-  return -1;
+#ifdef USE_HCACHE
+  imap_hcache_close(idata);
+#endif
+  mutt_buffer_free(&cmd);
+  mutt_file_fclose(&fp);
+
+  if (ctx->menu)
+    ctx->menu->redraw |= REDRAW_INDEX;
+  if (all)
+    mutt_clear_error();
+
+  return retval;
 }
 
 /**
@@ -1246,6 +2252,63 @@ int imap_commit_message(struct Context *ctx, struct Message *msg)
   return imap_append_message(ctx, msg);
 }
 
+/**
+ * append_length - Measure an email as it will be sent
+ * @param fp Email
+ * @retval num Length in bytes, with CRLF line endings
+ */
+static size_t append_length(FILE *fp)
+{
+  size_t len;
+  int c, last;
+
+  for (last = EOF, len = 0; (c = fgetc(fp)) != EOF; last = c)
+  {
+    if (c == '\n' && last != '\r')
+      len++;
+
+    len++;
+  }
+  rewind(fp);
+
+  return len;
+}
+
+/**
+ * append_send - Send an email as the literal of an APPEND
+ * @param idata       Server data
+ * @param fp          Email
+ * @param progressbar Progress bar, may be NULL
+ */
+static void append_send(struct ImapData *idata, FILE *fp, struct Progress *progressbar)
+{
+  char buf[LONG_STRING];
+  size_t len, sent;
+  int c, last;
+
+  rewind(fp);
+  for (last = EOF, sent = len = 0; (c = fgetc(fp)) != EOF; last = c)
+  {
+    if (c == '\n' && last != '\r')
+      buf[len++] = '\r';
+
+    buf[len++] = c;
+
+    if (len > sizeof(buf) - 3)
+    {
+      sent += len;
+      flush_buffer(buf, &len, idata->conn);
+      if (progressbar)
+        mutt_progress_update(progressbar, sent, -1);
+    }
+  }
+
+  if (len)
+    flush_buffer(buf, &len, idata->conn);
+
+  mutt_socket_write(idata->conn, "\r\n");
+}
+
 /**
  * imap_append_message - Write an email back to the server
  * @param ctx Context
@@ -1264,8 +2327,6 @@ int imap_append_message(struct Context *ctx, struct Message *msg)
   char imap_flags[SHORT_STRING];
   size_t len;
   struct Progress progressbar;
-  size_t sent;
-  int c, last;
   struct ImapMbox mx;
   int rc;
 
@@ -1291,14 +2352,7 @@ int imap_append_message(struct Context *ctx, struct Message *msg)
    * expensive (it'd be nice if we had the file size passed in already
    * by the code that writes the file, but that's a lot of changes.
    * Ideally we'd have a Header structure with flag info here... */
-  for (last = EOF, len = 0; (c = fgetc(fp)) != EOF; last = c)
-  {
-    if (c == '\n' && last != '\r')
-      len++;
-
-    len++;
-  }
-  rewind(fp);
+  len = append_length(fp);
 
   mutt_progress_init(&progressbar, _("Uploading message..."),
                      MUTT_PROGRESS_SIZE, NetInc, len);
@@ -1340,25 +2394,7 @@ int imap_append_message(struct Context *ctx, struct Message *msg)
     goto fail;
   }
 
-  for (last = EOF, sent = len = 0; (c = fgetc(fp)) != EOF; last = c)
-  {
-    if (c == '\n' && last != '\r')
-      buf[len++] = '\r';
-
-    buf[len++] = c;
-
-    if (len > sizeof(buf) - 3)
-    {
-      sent += len;
-      flush_buffer(buf, &len, idata->conn);
-      mutt_progress_update(&progressbar, sent, -1);
-    }
-  }
-
-  if (len)
-    flush_buffer(buf, &len, idata->conn);
-
-  mutt_socket_write(idata->conn, "\r\n");
+  append_send(idata, fp, &progressbar);
   mutt_file_fclose(&fp);
 
   do
@@ -1386,6 +2422,164 @@ fail:
   return -1;
 }
 
+/**
+ * append_fcc_finish - Wait for a batch of APPENDs to complete
+ * @param idata   Server data
+ * @param cmds    Command of each mailbox, NULL if it isn't in the batch
+ * @param results Result of each mailbox, set to 0 if it took the email
+ * @param num     Number of mailboxes
+ * @retval  0 Success
+ * @retval -1 The connection failed
+ */
+static int append_fcc_finish(struct ImapData *idata, struct ImapCommand **cmds,
+                             int *results, int num)
+{
+  for (int i = 0; i < num; i++)
+  {
+    if (!cmds[i])
+      continue;
+
+    while (cmds[i]->state == IMAP_CMD_NEW)
+    {
+      imap_cmd_step(idata);
+      if (idata->status == IMAP_FATAL)
+        return -1;
+    }
+
+    if (cmds[i]->state == IMAP_CMD_OK)
+      results[i] = 0;
+    cmds[i] = NULL;
+  }
+
+  return 0;
+}
+
+/**
+ * imap_append_fcc - Append one email to several mailboxes
+ * @param paths    IMAP paths of the mailboxes
+ * @param results  Result for each mailbox: 0 saved, 1 not saved
+ * @param num      Number of mailboxes
+ * @param fp       Email, with LF line endings
+ * @param post     If true, the email is a draft, otherwise it has been read
+ * @param received Time to give the server as the INTERNALDATE
+ * @retval num Number of mailboxes that have the email
+ *
+ * The mailboxes are grouped by account, and the APPENDs to each server are
+ * pipelined on one connection, without checking first that the mailboxes
+ * exist.  With LITERAL+ (RFC7888) NeoMutt only waits for the server once, at
+ * the end; otherwise it waits for each continuation, but not for the APPEND
+ * before it to complete.
+ *
+ * A mailbox that refuses the email, e.g. because it doesn't exist, is left
+ * as 1 for the caller to save the usual way, which asks to create it and
+ * reports any other error.
+ */
+int imap_append_fcc(char **paths, int *results, int num, FILE *fp, bool post, time_t received)
+{
+  struct ImapMbox *mxs = mutt_mem_calloc(num, sizeof(struct ImapMbox));
+  struct ImapCommand **cmds = mutt_mem_calloc(num, sizeof(struct ImapCommand *));
+  bool *todo = mutt_mem_calloc(num, sizeof(bool));
+  char buf[LONG_STRING * 2];
+  char mbox[LONG_STRING];
+  char mailbox[LONG_STRING];
+  char internaldate[IMAP_DATELEN];
+  size_t len = append_length(fp);
+  int saved = 0;
+
+  mutt_date_make_imap(internaldate, sizeof(internaldate), received);
+
+  for (int i = 0; i < num; i++)
+  {
+    results[i] = 1;
+    todo[i] = (imap_parse_path(paths[i], &mxs[i]) == 0);
+  }
+
+  for (int i = 0; i < num; i++)
+  {
+    if (!todo[i])
+      continue;
+
+    struct ImapData *idata = imap_conn_find(&mxs[i].account, 0);
+    if (!idata)
+    {
+      for (int j = i; j < num; j++)
+        if (todo[j] && mutt_account_match(&mxs[i].account, &mxs[j].account))
+          todo[j] = false;
+      continue;
+    }
+
+    /* don't let our batches get mixed up with commands already queued */
+    if (idata->cmdbuf->dptr != idata->cmdbuf->data)
+      imap_exec(idata, NULL, IMAP_CMD_FAIL_OK);
+
+    const bool literalplus = mutt_bit_isset(idata->capabilities, LITERALPLUS);
+    const int depth = MAX(idata->pipeline, 1);
+    int inflight = 0;
+
+    for (int j = i; j < num; j++)
+    {
+      if (!todo[j] || !mutt_account_match(&mxs[i].account, &mxs[j].account))
+        continue;
+      todo[j] = false;
+
+      /* no more than the pipeline holds, so the commands keep their slots */
+      if (inflight == depth)
+      {
+        if (append_fcc_finish(idata, cmds, results, num) < 0)
+          goto done;
+        inflight = 0;
+      }
+
+      imap_fix_path(idata, mxs[j].mbox, mailbox, sizeof(mailbox));
+      if (!*mailbox)
+        mutt_str_strfcpy(mailbox, "INBOX", sizeof(mailbox));
+      imap_munge_mbox_name(idata, mbox, sizeof(mbox), mailbox);
+
+      snprintf(buf, sizeof(buf), "APPEND %s (%s) \"%s\" {%lu%s}", mbox,
+               post ? "\\Draft" : "\\Seen", internaldate, (unsigned long) len,
+               literalplus ? "+" : "");
+      mutt_debug(2, "Fcc: appending to %s\n", paths[j]);
+
+      if (imap_cmd_start(idata, buf) < 0)
+        goto done;
+      cmds[j] = &idata->cmds[(idata->nextcmd + idata->cmdslots - 1) % idata->cmdslots];
+      inflight++;
+
+      if (!literalplus)
+      {
+        int rc;
+
+        do
+          rc = imap_cmd_step(idata);
+        while ((rc == IMAP_CMD_CONTINUE) && (cmds[j]->state == IMAP_CMD_NEW));
+
+        if (idata->status == IMAP_FATAL)
+          goto done;
+        /* refused without asking for the email */
+        if ((rc != IMAP_CMD_RESPOND) || (cmds[j]->state != IMAP_CMD_NEW))
+          continue;
+      }
+
+      append_send(idata, fp, NULL);
+    }
+
+    if (append_fcc_finish(idata, cmds, results, num) < 0)
+      goto done;
+  }
+
+done:
+  for (int i = 0; i < num; i++)
+  {
+    if (results[i] == 0)
+      saved++;
+    FREE(&mxs[i].mbox);
+  }
+  FREE(&mxs);
+  FREE(&cmds);
+  FREE(&todo);
+  return saved;
+}
+
 /**
  * imap_copy_messages - Server COPY messages to another folder
  * @param ctx    Context
@@ -1405,11 +2599,14 @@ int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int de
   char prompt[LONG_STRING];
   int rc;
   struct ImapMbox mx;
-  int err_continue = MUTT_NO;
   int triedcreate = 0;
+  unsigned char reopen;
 
   idata = ctx->data;
 
+  /* RFC6851: copy and expunge in one go */
+  bool move = delete && mutt_bit_isset(idata->capabilities, MOVE);
+
   if (imap_parse_path(dest, &mx))
   {
     mutt_debug(1, "bad destination %s\n", dest);
@@ -1456,19 +2653,16 @@ int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int de
           mutt_debug(3, "#2 Message contains attachments to be deleted\n");
           return 1;
         }
+      }
 
-        if (ctx->hdrs[i]->active && ctx->hdrs[i]->changed)
-        {
-          rc = imap_sync_message_for_copy(idata, ctx->hdrs[i], &sync_cmd, &err_continue);
-          if (rc < 0)
-          {
-            mutt_debug(1, "#1 could not sync\n");
-            goto out;
-          }
-        }
+      rc = imap_sync_flags(idata, true);
+      if (rc < 0)
+      {
+        mutt_debug(1, "#1 could not sync\n");
+        goto out;
       }
 
-      rc = imap_exec_msgset(idata, "UID COPY", mmbox, MUTT_TAG, 0, 0);
+      rc = imap_exec_msgset(idata, move ? "UID MOVE" : "UID COPY", mmbox, MUTT_TAG, 0, 0);
       if (!rc)
       {
         mutt_debug(1, "No messages tagged\n");
@@ -1480,17 +2674,23 @@ int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int de
         mutt_debug(1, "#1 could not queue copy\n");
         goto out;
       }
+      else if (move)
+        mutt_message(_("Moving %d messages to %s..."), rc, mbox);
       else
         mutt_message(_("Copying %d messages to %s..."), rc, mbox);
     }
     else
     {
-      mutt_message(_("Copying message %d to %s..."), h->index + 1, mbox);
-      mutt_buffer_printf(&cmd, "UID COPY %u %s", HEADER_DATA(h)->uid, mmbox);
+      if (move)
+        mutt_message(_("Moving message %d to %s..."), h->index + 1, mbox);
+      else
+        mutt_message(_("Copying message %d to %s..."), h->index + 1, mbox);
+      mutt_buffer_printf(&cmd, "UID %s %u %s", move ? "MOVE" : "COPY",
+                         HEADER_DATA(h)->uid, mmbox);
 
       if (h->active && h->changed)
       {
-        rc = imap_sync_message_for_copy(idata, h, &sync_cmd, &err_continue);
+        rc = imap_sync_message_for_copy(idata, h, &sync_cmd);
         if (rc < 0)
         {
           mutt_debug(1, "#2 could not sync\n");
@@ -1505,8 +2705,13 @@ int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int de
       }
     }
 
-    /* let's get it on */
+    /* let's get it on.  The moved messages must outlive the EXPUNGEs, until
+     * the COPYUID has been used. */
+    idata->copyuid.count = 0;
+    reopen = idata->reopen & IMAP_REOPEN_ALLOW;
+    idata->reopen &= ~IMAP_REOPEN_ALLOW;
     rc = imap_exec(idata, NULL, IMAP_CMD_FAIL_OK);
+    idata->reopen |= reopen;
     if (rc == -2)
     {
       if (triedcreate)
@@ -1536,8 +2741,12 @@ int imap_copy_messages(struct Context *ctx, struct Header *h, char *dest, int de
     goto out;
   }
 
-  /* cleanup */
-  if (delete)
+#ifdef USE_HCACHE
+  imap_hcache_copyuid(idata, mbox);
+#endif
+
+  /* cleanup.  The server has already expunged moved messages. */
+  if (delete && !move)
   {
     if (!h)
     {
@@ -1661,7 +2870,7 @@ char *imap_set_flags(struct ImapData *idata, struct Header *h, char *s, int *ser
     return NULL;
 
   /* Update tags system */
-  driver_tags_replace(&h->tags, mutt_str_strdup(hd->flags_remote));
+  driver_tags_replace(&h->tags, hd->flags_remote);
 
   /* YAUH (yet another ugly hack): temporarily set context to
    * read-write even if it's read-only, so *server* updates of
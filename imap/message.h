@@ -43,9 +43,11 @@ struct ImapHeaderData
   bool changed : 1;
 
   bool parsed : 1;
+  bool partial : 1; /**< Only $imap_index_headers have been read */
 
   unsigned int uid; /**< 32-bit Message UID */
-  unsigned int msn; /**< Message Sequence Number */
+  unsigned int msn;  /**< Message Sequence Number, as read from the server */
+  unsigned int slot; /**< Position in the MSN index, 0 once expunged */
 
   char *flags_system;
   char *flags_remote;
@@ -0,0 +1,280 @@
+/**
+ * @file
+ * IMAP Message Sequence Number index
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page imap_msn IMAP Message Sequence Number index
+ *
+ * Map MSNs to Headers and back, in logarithmic time.
+ *
+ * Every MSN the mailbox has had gets a slot in idata->msn_index, in order.
+ * An EXPUNGE doesn't move the later slots, it only takes its slot out of a
+ * Fenwick tree, which counts the slots still in use.  The MSN of a slot is
+ * the number of used slots up to it, and the slot of an MSN is found by
+ * walking down the tree.
+ *
+ * The tree's size is a power of two, so growing it only means copying the
+ * total to the new root: the new slots are all unused.
+ *
+ * | Function           | Description
+ * | :----------------- | :-------------------------------------------------
+ * | imap_msn_compact() | Drop the slots of expunged messages
+ * | imap_msn_free()    | Empty the MSN index
+ * | imap_msn_get()     | Find the Header of an MSN
+ * | imap_msn_of()      | Find the MSN of a Header
+ * | imap_msn_remove()  | Remove an MSN, as for an EXPUNGE
+ * | imap_msn_set()     | Put a Header at an MSN
+ */
+
+#include "config.h"
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include "imap_private.h"
+#include "mutt/mutt.h"
+#include "header.h"
+#include "message.h"
+#include "protos.h"
+
+/**
+ * msn_count - Count the slots in use up to a slot
+ * @param idata Server data
+ * @param slot  Slot, counting from 1
+ * @retval num Number of slots in use, i.e. the slot's MSN if it's in use
+ */
+static unsigned int msn_count(struct ImapData *idata, size_t slot)
+{
+  unsigned int count = 0;
+
+  for (; slot > 0; slot &= slot - 1)
+    count += idata->msn_tree[slot];
+
+  return count;
+}
+
+/**
+ * msn_update - Take a slot in or out of use
+ * @param idata Server data
+ * @param slot  Slot, counting from 1
+ * @param delta +1 or -1
+ */
+static void msn_update(struct ImapData *idata, size_t slot, int delta)
+{
+  for (; slot <= idata->msn_index_size; slot += slot & -slot)
+    idata->msn_tree[slot] += delta;
+}
+
+/**
+ * msn_slot - Find the slot of an MSN
+ * @param idata Server data
+ * @param msn   Message Sequence Number, 1 to max_msn
+ * @retval num Slot, counting from 1
+ */
+static size_t msn_slot(struct ImapData *idata, unsigned int msn)
+{
+  size_t slot = 0;
+
+  for (size_t step = idata->msn_index_size; step > 0; step >>= 1)
+  {
+    if ((slot + step <= idata->msn_index_size) && (idata->msn_tree[slot + step] < msn))
+    {
+      slot += step;
+      msn -= idata->msn_tree[slot];
+    }
+  }
+
+  return slot + 1;
+}
+
+/**
+ * msn_grow - Make room for more slots
+ * @param idata Server data
+ * @param slots Number of slots needed
+ */
+static void msn_grow(struct ImapData *idata, size_t slots)
+{
+  size_t size = idata->msn_index_size;
+
+  if (slots <= size)
+    return;
+
+  /* This is a conservative check to protect against a malicious imap
+   * server.  Most likely size_t is bigger than an unsigned int, but
+   * if slots is this big, we have a serious problem. */
+  if (slots >= (UINT_MAX / sizeof(struct Header *)))
+  {
+    mutt_error(_("Integer overflow -- can't allocate memory."));
+    sleep(1);
+    mutt_exit(1);
+  }
+
+  size_t new_size = size ? size : 256;
+  while (new_size < slots)
+    new_size *= 2;
+
+  /* Slot 0 is unused */
+  mutt_mem_realloc(&idata->msn_index, (new_size + 1) * sizeof(struct Header *));
+  mutt_mem_realloc(&idata->msn_tree, (new_size + 1) * sizeof(unsigned int));
+  memset(idata->msn_index + size + 1, 0, (new_size - size) * sizeof(struct Header *));
+  memset(idata->msn_tree + size + 1, 0, (new_size - size) * sizeof(unsigned int));
+
+  /* Each doubling adds a root that covers everything */
+  for (size_t s = size ? size * 2 : new_size; size && (s <= new_size); s *= 2)
+    idata->msn_tree[s] = idata->msn_tree[size];
+
+  idata->msn_index_size = new_size;
+}
+
+/**
+ * imap_msn_get - Find the Header of an MSN
+ * @param idata Server data
+ * @param msn   Message Sequence Number
+ * @retval ptr  Header
+ * @retval NULL The MSN doesn't exist, or its header hasn't been read yet
+ */
+struct Header *imap_msn_get(struct ImapData *idata, unsigned int msn)
+{
+  if ((msn < 1) || (msn > idata->max_msn))
+    return NULL;
+
+  return idata->msn_index[msn_slot(idata, msn)];
+}
+
+/**
+ * imap_msn_of - Find the MSN of a Header
+ * @param idata Server data
+ * @param h     Header
+ * @retval num Message Sequence Number
+ * @retval 0   The message has been expunged
+ */
+unsigned int imap_msn_of(struct ImapData *idata, struct Header *h)
+{
+  if (!h || !h->data || !HEADER_DATA(h)->slot)
+    return 0;
+
+  return msn_count(idata, HEADER_DATA(h)->slot);
+}
+
+/**
+ * imap_msn_set - Put a Header at an MSN
+ * @param idata Server data
+ * @param msn   Message Sequence Number
+ * @param h     Header, which must have its ImapHeaderData
+ *
+ * If msn is beyond max_msn, the MSNs in between are created, without headers.
+ */
+void imap_msn_set(struct ImapData *idata, unsigned int msn, struct Header *h)
+{
+  size_t slot;
+
+  if (msn < 1)
+    return;
+
+  if (msn <= idata->max_msn)
+    slot = msn_slot(idata, msn);
+  else
+  {
+    size_t first = idata->msn_slots + 1;
+
+    idata->msn_slots += msn - idata->max_msn;
+    msn_grow(idata, idata->msn_slots);
+    for (size_t s = first; s <= idata->msn_slots; s++)
+      msn_update(idata, s, 1);
+    idata->max_msn = msn;
+    slot = idata->msn_slots;
+  }
+
+  idata->msn_index[slot] = h;
+  if (h)
+    HEADER_DATA(h)->slot = slot;
+}
+
+/**
+ * imap_msn_remove - Remove an MSN, as for an EXPUNGE
+ * @param idata Server data
+ * @param msn   Message Sequence Number
+ *
+ * The later messages move down by one.  The Header, if any, is left alone
+ * apart from forgetting its slot.
+ */
+void imap_msn_remove(struct ImapData *idata, unsigned int msn)
+{
+  if ((msn < 1) || (msn > idata->max_msn))
+    return;
+
+  size_t slot = msn_slot(idata, msn);
+  struct Header *h = idata->msn_index[slot];
+  if (h && h->data)
+    HEADER_DATA(h)->slot = 0;
+
+  idata->msn_index[slot] = NULL;
+  msn_update(idata, slot, -1);
+  idata->max_msn--;
+}
+
+/**
+ * imap_msn_compact - Drop the slots of expunged messages
+ * @param idata Server data
+ *
+ * This walks every slot, so it's done once a batch of EXPUNGEs has been
+ * handled, rather than for each one.
+ */
+void imap_msn_compact(struct ImapData *idata)
+{
+  size_t count = idata->max_msn;
+
+  if (idata->msn_slots == count)
+    return;
+
+  for (size_t msn = 1, slot = 1; msn <= count; msn++)
+  {
+    while (msn_count(idata, slot) - msn_count(idata, slot - 1) == 0)
+      slot++;
+    idata->msn_index[msn] = idata->msn_index[slot];
+    if (idata->msn_index[msn])
+      HEADER_DATA(idata->msn_index[msn])->slot = msn;
+    slot++;
+  }
+  memset(idata->msn_index + count + 1, 0,
+         (idata->msn_index_size - count) * sizeof(struct Header *));
+
+  /* Rebuild the tree with the first count slots in use */
+  memset(idata->msn_tree, 0, (idata->msn_index_size + 1) * sizeof(unsigned int));
+  for (size_t slot = 1; slot <= idata->msn_index_size; slot++)
+  {
+    idata->msn_tree[slot] += (slot <= count);
+    size_t parent = slot + (slot & -slot);
+    if (parent <= idata->msn_index_size)
+      idata->msn_tree[parent] += idata->msn_tree[slot];
+  }
+
+  idata->msn_slots = count;
+}
+
+/**
+ * imap_msn_free - Empty the MSN index
+ * @param idata Server data
+ */
+void imap_msn_free(struct ImapData *idata)
+{
+  FREE(&idata->msn_index);
+  FREE(&idata->msn_tree);
+  idata->msn_index_size = 0;
+  idata->msn_slots = 0;
+  idata->max_msn = 0;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file
+ * IMAP UID to Header lookup
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page imap_uid_hash IMAP UID to Header lookup
+ *
+ * An open-addressing hash table from UID to Header, with linear probing.
+ *
+ * The UIDs and Headers are kept in two flat arrays, so adding a message
+ * doesn't allocate anything, and a lookup usually reads one cache line.  UID 0
+ * is invalid in IMAP, so it marks an empty bucket.  Deleting shifts the rest of
+ * the run back, so there are no tombstones.
+ *
+ * The table is sized from the number of messages in the mailbox and only
+ * grows if new mail takes it past half full.
+ *
+ * | Function               | Description
+ * | :--------------------- | :------------------------------------------
+ * | imap_uid_hash_delete() | Remove a message from the table
+ * | imap_uid_hash_find()   | Find a message by its UID
+ * | imap_uid_hash_free()   | Free a UID table
+ * | imap_uid_hash_insert() | Add a message to the table
+ * | imap_uid_hash_new()    | Create a UID table
+ */
+
+#include "config.h"
+#include <stddef.h>
+#include "imap_private.h"
+#include "mutt/mutt.h"
+
+/**
+ * uid_bucket - Find the first bucket for a UID
+ * @param table UID table
+ * @param uid   UID
+ * @retval num Bucket
+ *
+ * UIDs are mostly consecutive, so they're scattered with a multiplicative
+ * hash (Knuth), then reduced to the table's power-of-two size.
+ */
+static size_t uid_bucket(const struct ImapUidHash *table, unsigned int uid)
+{
+  return (uid * 2654435761U) & (table->size - 1);
+}
+
+/**
+ * uid_hash_resize - Move the entries to a table of a new size
+ * @param table UID table
+ * @param size  New size, a power of two
+ */
+static void uid_hash_resize(struct ImapUidHash *table, size_t size)
+{
+  unsigned int *uids = table->uids;
+  struct Header **hdrs = table->hdrs;
+  size_t old_size = table->size;
+
+  table->uids = mutt_mem_calloc(size, sizeof(unsigned int));
+  table->hdrs = mutt_mem_calloc(size, sizeof(struct Header *));
+  table->size = size;
+  table->count = 0;
+
+  for (size_t i = 0; i < old_size; i++)
+    if (uids[i])
+      imap_uid_hash_insert(table, uids[i], hdrs[i]);
+
+  FREE(&uids);
+  FREE(&hdrs);
+}
+
+/**
+ * imap_uid_hash_new - Create a UID table
+ * @param count Number of messages expected, e.g. from EXISTS
+ * @retval ptr New UID table
+ */
+struct ImapUidHash *imap_uid_hash_new(size_t count)
+{
+  struct ImapUidHash *table = mutt_mem_calloc(1, sizeof(struct ImapUidHash));
+  size_t size = 64;
+
+  /* Keep it at most half full */
+  while (size < 2 * count)
+    size *= 2;
+
+  table->uids = mutt_mem_calloc(size, sizeof(unsigned int));
+  table->hdrs = mutt_mem_calloc(size, sizeof(struct Header *));
+  table->size = size;
+  return table;
+}
+
+/**
+ * imap_uid_hash_free - Free a UID table
+ * @param table UID table to free
+ *
+ * The Headers belong to the Context and are left alone.
+ */
+void imap_uid_hash_free(struct ImapUidHash **table)
+{
+  if (!table || !*table)
+    return;
+
+  FREE(&(*table)->uids);
+  FREE(&(*table)->hdrs);
+  FREE(table);
+}
+
+/**
+ * imap_uid_hash_find - Find a message by its UID
+ * @param table UID table
+ * @param uid   UID
+ * @retval ptr  Header
+ * @retval NULL Not found
+ */
+struct Header *imap_uid_hash_find(const struct ImapUidHash *table, unsigned int uid)
+{
+  if (!table || !uid)
+    return NULL;
+
+  for (size_t i = uid_bucket(table, uid); table->uids[i]; i = (i + 1) & (table->size - 1))
+    if (table->uids[i] == uid)
+      return table->hdrs[i];
+
+  return NULL;
+}
+
+/**
+ * imap_uid_hash_insert - Add a message to the table
+ * @param table UID table
+ * @param uid   UID
+ * @param h     Header
+ *
+ * If the UID is already there, the table is left alone.
+ */
+void imap_uid_hash_insert(struct ImapUidHash *table, unsigned int uid, struct Header *h)
+{
+  if (!table || !uid)
+    return;
+
+  if (2 * (table->count + 1) > table->size)
+    uid_hash_resize(table, 2 * table->size);
+
+  size_t i = uid_bucket(table, uid);
+  while (table->uids[i] && (table->uids[i] != uid))
+    i = (i + 1) & (table->size - 1);
+
+  if (table->uids[i])
+    return;
+
+  table->uids[i] = uid;
+  table->hdrs[i] = h;
+  table->count++;
+}
+
+/**
+ * imap_uid_hash_delete - Remove a message from the table
+ * @param table UID table
+ * @param uid   UID
+ * @param h     Header; the entry is only removed if it still points here
+ */
+void imap_uid_hash_delete(struct ImapUidHash *table, unsigned int uid, struct Header *h)
+{
+  if (!table || !uid)
+    return;
+
+  size_t mask = table->size - 1;
+  size_t i = uid_bucket(table, uid);
+  while (table->uids[i] && (table->uids[i] != uid))
+    i = (i + 1) & mask;
+
+  if (!table->uids[i] || (table->hdrs[i] != h))
+    return;
+
+  /* Shift back the entries that probed past this bucket */
+  for (size_t j = (i + 1) & mask; table->uids[j]; j = (j + 1) & mask)
+  {
+    size_t home = uid_bucket(table, table->uids[j]);
+    /* Could the entry at j live at i?  Only if i lies between home and j */
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      table->uids[i] = table->uids[j];
+      table->hdrs[i] = table->hdrs[j];
+      i = j;
+    }
+  }
+
+  table->uids[i] = 0;
+  table->hdrs[i] = NULL;
+  table->count--;
+}
@@ -27,45 +27,54 @@
  *
  * IMAP helper functions
  *
- * | Function                 | Description
- * | :----------------------- | :-------------------------------------------------
- * | imap_account_match()     | Compare two Accounts
- * | imap_allow_reopen()      | Allow re-opening a folder upon expunge
- * | imap_cachepath()         | Generate a cache path for a mailbox
- * | imap_clean_path()        | Cleans an IMAP path using imap_fix_path
- * | imap_continue()          | display a message and ask the user if they want to go on
- * | imap_disallow_reopen()   | Disallow re-opening a folder upon expunge
- * | imap_error()             | show an error and abort
- * | imap_expand_path()       | Canonicalise an IMAP path
- * | imap_fix_path()          | Fix up the imap path
- * | imap_free_idata()        | Release and clear storage in an ImapData structure
- * | imap_get_literal_count() | write number of bytes in an IMAP literal into bytes
- * | imap_get_parent()        | Get an IMAP folder's parent
- * | imap_get_parent_path()   | Get the path of the parent folder
- * | imap_get_qualifier()     | Get the qualifier from a tagged response
- * | imap_hcache_close()      | Close the header cache
- * | imap_hcache_del()        | Delete an item from the header cache
- * | imap_hcache_get()        | Get a header cache entry by its UID
- * | imap_hcache_namer()      | Generate a filename for the header cache
- * | imap_hcache_open()       | Open a header cache
- * | imap_hcache_put()        | Add an entry to the header cache
- * | imap_keepalive()         | poll the current folder to keep the connection alive
- * | imap_munge_mbox_name()   | Quote awkward characters in a mailbox name
- * | imap_mxcmp()             | Compare mailbox names, giving priority to INBOX
- * | imap_new_idata()         | Allocate and initialise a new ImapData structure
- * | imap_next_word()         | Find where the next IMAP word begins
- * | imap_parse_path()        | Parse an IMAP mailbox name into name,host,port
- * | imap_pretty_mailbox()    | Prettify an IMAP mailbox name
- * | imap_qualify_path()      | Make an absolute IMAP folder target
- * | imap_quote_string()      | quote string according to IMAP rules
- * | imap_unmunge_mbox_name() | Remove quoting from a mailbox name
- * | imap_unquote_string()    | equally stupid unquoting routine
- * | imap_wait_keepalive()    | Wait for a process to change state
+ * | Function                       | Description
+ * | :----------------------------- | :-------------------------------------------------
+ * | imap_account_match()           | Compare two Accounts
+ * | imap_allow_reopen()            | Allow re-opening a folder upon expunge
+ * | imap_cachepath()               | Generate a cache path for a mailbox
+ * | imap_clean_path()              | Cleans an IMAP path using imap_fix_path
+ * | imap_continue()                | display a message and ask the user if they want to go on
+ * | imap_disallow_reopen()         | Disallow re-opening a folder upon expunge
+ * | imap_error()                   | show an error and abort
+ * | imap_expand_path()             | Canonicalise an IMAP path
+ * | imap_fix_path()                | Fix up the imap path
+ * | imap_free_idata()              | Release and clear storage in an ImapData structure
+ * | imap_get_literal_count()       | write number of bytes in an IMAP literal into bytes
+ * | imap_get_parent()              | Get an IMAP folder's parent
+ * | imap_get_parent_path()         | Get the path of the parent folder
+ * | imap_get_qualifier()           | Get the qualifier from a tagged response
+ * | imap_hcache_close()            | Close the header cache
+ * | imap_hcache_copyuid()          | Add copied messages to another mailbox's header cache
+ * | imap_hcache_del()              | Delete an item from the header cache
+ * | imap_hcache_get()              | Get a header cache entry by its UID
+ * | imap_hcache_namer()            | Generate a filename for the header cache
+ * | imap_hcache_folder()           | Get the name of a mailbox's header cache
+ * | imap_hcache_open()             | Open a header cache
+ * | imap_hcache_prefetch()         | Start reading the selected mailbox's header cache
+ * | imap_hcache_prune()            | Drop the records of expunged messages
+ * | imap_hcache_put()              | Add an entry to the header cache
+ * | imap_hcache_put_many()         | Add several entries to the header cache
+ * | imap_hcache_store_uid_seqset() | Record which messages are in the mailbox
+ * | imap_keepalive()               | poll the current folder to keep the connection alive
+ * | imap_munge_mbox_name()         | Quote awkward characters in a mailbox name
+ * | imap_mxcmp()                   | Compare mailbox names, giving priority to INBOX
+ * | imap_new_idata()               | Allocate and initialise a new ImapData structure
+ * | imap_next_word()               | Find where the next IMAP word begins
+ * | imap_parse_path()              | Parse an IMAP mailbox name into name,host,port
+ * | imap_pretty_mailbox()          | Prettify an IMAP mailbox name
+ * | imap_qualify_path()            | Make an absolute IMAP folder target
+ * | imap_quote_string()            | quote string according to IMAP rules
+ * | imap_seqset_next()             | Get the next range from a UID sequence set
+ * | imap_unmunge_mbox_name()       | Remove quoting from a mailbox name
+ * | imap_unquote_string()          | equally stupid unquoting routine
+ * | imap_wait_idle()               | Wait for a key press or for news from an IDLE server
+ * | imap_wait_keepalive()          | Wait for a process to change state
  */
 
 #include "config.h"
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <signal.h>
@@ -256,17 +265,19 @@ static int imap_hcache_namer(const char *path, char *dest, size_t dlen)
 }
 
 /**
- * imap_hcache_open - Open a header cache
- * @param idata Server data
- * @param path  Path to the header cache
- * @retval ptr HeaderCache
- * @retval NULL Failure
+ * imap_hcache_folder - Get the name of a mailbox's header cache
+ * @param idata  Server data
+ * @param path   Mailbox, or NULL for the selected one
+ * @param buf    Buffer for the result
+ * @param buflen Length of buffer
+ * @retval  0 Success
+ * @retval -1 Failure
  */
-header_cache_t *imap_hcache_open(struct ImapData *idata, const char *path)
+static int imap_hcache_folder(struct ImapData *idata, const char *path,
+                              char *buf, size_t buflen)
 {
   struct ImapMbox mx;
   struct Url url;
-  char cachepath[LONG_STRING];
   char mbox[LONG_STRING];
 
   if (path)
@@ -274,7 +285,7 @@ header_cache_t *imap_hcache_open(struct ImapData *idata, const char *path)
   else
   {
     if (!idata->ctx || imap_parse_path(idata->ctx->path, &mx) < 0)
-      return NULL;
+      return -1;
 
     imap_cachepath(idata, mx.mbox, mbox, sizeof(mbox));
     FREE(&mx.mbox);
@@ -282,11 +293,42 @@ header_cache_t *imap_hcache_open(struct ImapData *idata, const char *path)
 
   mutt_account_tourl(&idata->conn->account, &url);
   url.path = mbox;
-  url_tostring(&url, cachepath, sizeof(cachepath), U_PATH);
+  url_tostring(&url, buf, buflen, U_PATH);
+
+  return 0;
+}
+
+/**
+ * imap_hcache_open - Open a header cache
+ * @param idata Server data
+ * @param path  Path to the header cache
+ * @retval ptr HeaderCache
+ * @retval NULL Failure
+ */
+header_cache_t *imap_hcache_open(struct ImapData *idata, const char *path)
+{
+  char cachepath[LONG_STRING];
+
+  if (imap_hcache_folder(idata, path, cachepath, sizeof(cachepath)) < 0)
+    return NULL;
 
   return mutt_hcache_open(HeaderCache, cachepath, imap_hcache_namer);
 }
 
+/**
+ * imap_hcache_prefetch - Start reading the selected mailbox's header cache
+ * @param idata Server data
+ *
+ * This doesn't block, so the file is read while the mailbox is being selected.
+ */
+void imap_hcache_prefetch(struct ImapData *idata)
+{
+  char cachepath[LONG_STRING];
+
+  if (imap_hcache_folder(idata, NULL, cachepath, sizeof(cachepath)) == 0)
+    mutt_hcache_prefetch(HeaderCache, cachepath, imap_hcache_namer);
+}
+
 /**
  * imap_hcache_close - Close the header cache
  * @param idata Server data
@@ -341,13 +383,51 @@ int imap_hcache_put(struct ImapData *idata, struct Header *h)
 {
   char key[16];
 
-  if (!idata->hcache)
+  /* Only complete headers are cached */
+  if (!idata->hcache || HEADER_DATA(h)->partial)
     return -1;
 
   sprintf(key, "/%u", HEADER_DATA(h)->uid);
   return mutt_hcache_store(idata->hcache, key, imap_hcache_keylen(key), h, idata->uid_validity);
 }
 
+/**
+ * imap_hcache_put_many - Add several entries to the header cache
+ * @param idata Server data
+ * @param hdrs  Email Headers
+ * @param count Number of Headers
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+int imap_hcache_put_many(struct ImapData *idata, struct Header **hdrs, size_t count)
+{
+  if (!idata->hcache || !count)
+    return -1;
+
+  struct Header **complete = mutt_mem_malloc(count * sizeof(struct Header *));
+  const char **keys = mutt_mem_malloc(count * sizeof(char *));
+  char *keybuf = mutt_mem_malloc(count * 16);
+  size_t n = 0;
+
+  /* Only complete headers are cached */
+  for (size_t i = 0; i < count; i++)
+  {
+    if (HEADER_DATA(hdrs[i])->partial)
+      continue;
+    char *key = keybuf + n * 16;
+    sprintf(key, "/%u", HEADER_DATA(hdrs[i])->uid);
+    keys[n] = key;
+    complete[n++] = hdrs[i];
+  }
+
+  int rc = n ? mutt_hcache_store_many(idata->hcache, keys, n, complete, idata->uid_validity) : 0;
+
+  FREE(&keybuf);
+  FREE(&keys);
+  FREE(&complete);
+  return rc;
+}
+
 /**
  * imap_hcache_del - Delete an item from the header cache
  * @param idata Server data
@@ -365,8 +445,262 @@ int imap_hcache_del(struct ImapData *idata, unsigned int uid)
   sprintf(key, "/%u", uid);
   return mutt_hcache_delete(idata->hcache, key, imap_hcache_keylen(key));
 }
+
+/**
+ * imap_hcache_keep - Is a cached record still wanted? - Implements ::hcache_keep_t
+ *
+ * Records of messages that are no longer in the mailbox are dropped.
+ * Everything else, e.g. "/UIDVALIDITY", is kept.
+ */
+static bool imap_hcache_keep(const char *key, size_t keylen, void *data)
+{
+  struct Hash *uids = data;
+  unsigned int uid = 0;
+
+  if ((key[0] != '/') || (mutt_str_atoui(key + 1, &uid) != 0) || (uid == 0))
+    return true;
+
+  return mutt_hash_int_find(uids, uid) != NULL;
+}
+
+/**
+ * imap_hcache_prune - Drop the records of expunged messages
+ * @param idata Server data
+ * @retval num Number of records deleted
+ * @retval -1  Error
+ *
+ * This must only be called once all the mailbox's headers have been read.
+ */
+int imap_hcache_prune(struct ImapData *idata)
+{
+  struct Context *ctx = idata->ctx;
+
+  if (!idata->hcache || !ctx)
+    return -1;
+
+  struct Hash *uids = mutt_hash_int_create(MAX(6 * ctx->msgcount / 5, 30), 0);
+  for (int i = 0; i < ctx->msgcount; i++)
+    if (ctx->hdrs[i] && ctx->hdrs[i]->data)
+      mutt_hash_int_insert(uids, HEADER_DATA(ctx->hdrs[i])->uid, ctx->hdrs[i]);
+
+  int rc = mutt_hcache_prune(idata->hcache, imap_hcache_keep, uids);
+  mutt_hash_destroy(&uids);
+  return rc;
+}
+
+/**
+ * imap_hcache_store_uid_seqset - Record which messages are in the mailbox
+ * @param idata Server data
+ * @retval  0 Success
+ * @retval -1 Failure
+ *
+ * Store the UIDs of the messages, in MSN order, as "/UIDSEQSET", and the
+ * keywords and other system flags of the messages that have any, as "/FLAGS".
+ * The header of each message is cached separately.  Together, they let a
+ * QRESYNC reopen rebuild the mailbox without fetching the flags of every
+ * message.
+ */
+int imap_hcache_store_uid_seqset(struct ImapData *idata)
+{
+  unsigned int first = 0, last = 0;
+
+  if (!idata->hcache)
+    return -1;
+
+  struct Buffer *seqset = mutt_buffer_new();
+  struct Buffer *flags = mutt_buffer_new();
+
+  for (unsigned int msn = 1; msn <= idata->max_msn + 1; msn++)
+  {
+    struct Header *h = NULL;
+    unsigned int uid = 0;
+
+    if (msn <= idata->max_msn)
+    {
+      h = imap_msn_get(idata, msn);
+      if (!h || !h->data)
+      {
+        /* A hole: the MSNs of the cached messages are unknown */
+        mutt_buffer_free(&seqset);
+        mutt_buffer_free(&flags);
+        mutt_hcache_delete(idata->hcache, "/UIDSEQSET", 10);
+        return -1;
+      }
+      uid = HEADER_DATA(h)->uid;
+      if (last && (uid == last + 1))
+      {
+        last = uid;
+        uid = 0;
+      }
+    }
+
+    if ((uid || (msn > idata->max_msn)) && first)
+    {
+      if (seqset->dptr != seqset->data)
+        mutt_buffer_addch(seqset, ',');
+      if (first == last)
+        mutt_buffer_printf(seqset, "%u", first);
+      else
+        mutt_buffer_printf(seqset, "%u:%u", first, last);
+      first = 0;
+    }
+    if (uid)
+      first = last = uid;
+
+    if (h && (HEADER_DATA(h)->flags_system || HEADER_DATA(h)->flags_remote))
+    {
+      const char *sys = HEADER_DATA(h)->flags_system;
+      const char *remote = HEADER_DATA(h)->flags_remote;
+      mutt_buffer_printf(flags, "%u %s%s%s\n", HEADER_DATA(h)->uid, NONULL(sys),
+                         (sys && remote) ? " " : "", NONULL(remote));
+    }
+  }
+
+  int rc = mutt_hcache_store_raw(idata->hcache, "/UIDSEQSET", 10, NONULL(seqset->data),
+                                 mutt_str_strlen(seqset->data) + 1);
+  if (rc == 0)
+    rc = mutt_hcache_store_raw(idata->hcache, "/FLAGS", 6, NONULL(flags->data),
+                               mutt_str_strlen(flags->data) + 1);
+
+  mutt_buffer_free(&seqset);
+  mutt_buffer_free(&flags);
+  return rc;
+}
+
+/**
+ * imap_hcache_copyuid - Add copied messages to another mailbox's header cache
+ * @param idata Server data
+ * @param mbox  Destination mailbox
+ * @retval num Number of headers seeded
+ * @retval  -1 The cache can't be seeded
+ *
+ * After a COPY or MOVE, idata->copyuid says what UIDs the messages got in the
+ * destination.  If they directly follow what the destination's cache already
+ * knows, store the headers under their new UIDs and advance "/UIDNEXT" (and
+ * "/UIDSEQSET"), so the next open doesn't download them again.
+ *
+ * The flags are still fetched from the server when the mailbox is opened.
+ */
+int imap_hcache_copyuid(struct ImapData *idata, const char *mbox)
+{
+  struct ImapCopyUid *cu = &idata->copyuid;
+  unsigned int first, uidnext = 0;
+  bool seeded = false;
+
+  if (!cu->count || !idata->uid_hash || (imap_mxcmp(mbox, idata->mailbox) == 0))
+    return -1;
+
+  first = cu->uids[1];
+  for (size_t i = 0; i < cu->count; i++)
+    if (cu->uids[2 * i + 1] != first + i)
+      return -1;
+
+  header_cache_t *hc = imap_hcache_open(idata, mbox);
+  if (!hc)
+    return -1;
+
+  void *uv = mutt_hcache_fetch_raw(hc, "/UIDVALIDITY", 12);
+  void *un = mutt_hcache_fetch_raw(hc, "/UIDNEXT", 8);
+  if (uv && un && (*(unsigned int *) uv == cu->uidvalidity))
+    uidnext = *(unsigned int *) un;
+  mutt_hcache_free(hc, &uv);
+  mutt_hcache_free(hc, &un);
+
+  if (uidnext == first)
+  {
+    struct Header **hdrs = mutt_mem_malloc(cu->count * sizeof(struct Header *));
+    const char **keys = mutt_mem_malloc(cu->count * sizeof(char *));
+    char *keybuf = mutt_mem_malloc(cu->count * 16);
+    size_t n;
+
+    for (n = 0; n < cu->count; n++)
+    {
+      hdrs[n] = imap_uid_hash_find(idata->uid_hash, cu->uids[2 * n]);
+      if (!hdrs[n] || HEADER_DATA(hdrs[n])->partial)
+        break;
+      keys[n] = keybuf + n * 16;
+      sprintf(keybuf + n * 16, "/%u", cu->uids[2 * n + 1]);
+    }
+
+    if ((n == cu->count) &&
+        (mutt_hcache_store_many(hc, keys, n, hdrs, cu->uidvalidity) == 0))
+    {
+      uidnext = first + n;
+      mutt_hcache_store_raw(hc, "/UIDNEXT", 8, &uidnext, sizeof(uidnext));
+
+      char *seqset = mutt_hcache_fetch_raw(hc, "/UIDSEQSET", 10);
+      if (seqset)
+      {
+        struct Buffer *b = mutt_buffer_new();
+        mutt_buffer_addstr(b, seqset);
+        if (b->dptr != b->data)
+          mutt_buffer_addch(b, ',');
+        mutt_buffer_printf(b, "%u:%u", first, uidnext - 1);
+        mutt_hcache_store_raw(hc, "/UIDSEQSET", 10, b->data, mutt_str_strlen(b->data) + 1);
+        mutt_buffer_free(&b);
+        mutt_hcache_free(hc, (void **) &seqset);
+      }
+      seeded = true;
+    }
+
+    FREE(&keybuf);
+    FREE(&keys);
+    FREE(&hdrs);
+  }
+
+  mutt_hcache_close(hc);
+
+  mutt_debug(2, "%s %zu headers for %s\n", seeded ? "seeded" : "didn't seed",
+             cu->count, mbox);
+  return seeded ? (int) cu->count : -1;
+}
 #endif
 
+/**
+ * imap_seqset_next - Get the next range from a UID sequence set
+ * @param[in,out] s     Sequence set, e.g. "1:5,7"; advanced past the range
+ * @param[out]    first First UID of the range
+ * @param[out]    last  Last UID of the range
+ * @retval  0 Success
+ * @retval  1 No more ranges
+ * @retval -1 Syntax error
+ *
+ * The range is returned in ascending order, even if it was written backwards.
+ */
+int imap_seqset_next(const char **s, unsigned int *first, unsigned int *last)
+{
+  const char *p = *s;
+  char *end = NULL;
+  unsigned long lo, hi;
+
+  if (!p || !*p || ISSPACE(*p))
+    return 1;
+
+  if (!isdigit((unsigned char) *p))
+    return -1;
+  lo = hi = strtoul(p, &end, 10);
+  p = end;
+  if (*p == ':')
+  {
+    p++;
+    if (!isdigit((unsigned char) *p))
+      return -1;
+    hi = strtoul(p, &end, 10);
+    p = end;
+  }
+  if ((lo == 0) || (hi == 0) || (lo > UINT_MAX) || (hi > UINT_MAX))
+    return -1;
+  if (*p == ',')
+    p++;
+  else if (*p && !ISSPACE(*p))
+    return -1;
+
+  *first = MIN(lo, hi);
+  *last = MAX(lo, hi);
+  *s = p;
+  return 0;
+}
+
 /**
  * imap_parse_path - Parse an IMAP mailbox name into name,host,port
  * @param path Mailbox path to parse
@@ -615,14 +949,16 @@ void imap_error(const char *where, const char *msg)
  */
 struct ImapData *imap_new_idata(void)
 {
-  struct ImapData *idata = mutt_mem_calloc(1, sizeof(struct ImapData));
+  struct ImapData *idata = mutt_mem_tag_calloc(MEM_IMAP, 1, sizeof(struct ImapData));
 
   idata->cmdbuf = mutt_buffer_new();
   if (!idata->cmdbuf)
-    FREE(&idata);
+    mutt_mem_tag_free(MEM_IMAP, &idata, sizeof(struct ImapData));
 
-  idata->cmdslots = ImapPipelineDepth + 2;
-  idata->cmds = mutt_mem_calloc(idata->cmdslots, sizeof(*idata->cmds));
+  /* room for the pipeline to grow, unless it's disabled */
+  idata->pipeline = MAX(ImapPipelineDepth, 0);
+  idata->cmdslots = (idata->pipeline ? MAX(idata->pipeline, IMAP_PIPELINE_MAX) : 0) + 2;
+  idata->cmds = mutt_mem_tag_calloc(MEM_IMAP, idata->cmdslots, sizeof(*idata->cmds));
 
   STAILQ_INIT(&idata->flags);
   STAILQ_INIT(&idata->mboxcache);
@@ -640,13 +976,15 @@ void imap_free_idata(struct ImapData **idata)
     return;
 
   FREE(&(*idata)->capstr);
+  FREE(&(*idata)->notify);
+  FREE(&(*idata)->copyuid.uids);
   mutt_list_free(&(*idata)->flags);
   imap_mboxcache_free(*idata);
   mutt_buffer_free(&(*idata)->cmdbuf);
-  FREE(&(*idata)->buf);
+  mutt_mem_tag_free(MEM_IMAP, &(*idata)->buf, (*idata)->blen);
   mutt_bcache_close(&(*idata)->bcache);
-  FREE(&(*idata)->cmds);
-  FREE(idata);
+  mutt_mem_tag_free(MEM_IMAP, &(*idata)->cmds, (*idata)->cmdslots * sizeof(*(*idata)->cmds));
+  mutt_mem_tag_free(MEM_IMAP, idata, sizeof(struct ImapData));
 }
 
 /**
@@ -965,6 +1303,34 @@ void imap_keepalive(void)
   }
 }
 
+/**
+ * imap_wait_idle - Wait for a key press or for news from an IDLE server
+ * @param ctx  Mailbox
+ * @param secs Longest time to wait, in seconds
+ * @retval  1 The server has something to say, or the time is up
+ * @retval  0 There is keyboard input
+ * @retval -1 The mailbox isn't IDLE
+ *
+ * The caller is expected to check the mailbox as soon as this returns 1, or
+ * we'd be woken up again straight away.
+ */
+int imap_wait_idle(struct Context *ctx, int secs)
+{
+  if (!ctx || (ctx->magic != MUTT_IMAP) || !ctx->data)
+    return -1;
+
+  struct ImapData *idata = ctx->data;
+  struct Connection *conn = idata->conn;
+  if ((idata->state != IMAP_IDLE) || (conn->fd < 0))
+    return -1;
+
+  /* a signal, e.g. SIGWINCH, counts as a timeout */
+  if (mutt_socket_wait(&conn, 1, true, secs) == SOCKET_WAIT_KEYBOARD)
+    return 0;
+
+  return 1;
+}
+
 /**
  * imap_wait_keepalive - Wait for a process to change state
  * @param pid Process ID to listen to
@@ -202,6 +202,8 @@ int query_quadoption(int opt, const char *prompt)
 
     default:
       opt = mutt_yesorno(prompt, (opt == MUTT_ASKYES));
+      if (OPT_NO_CURSES)
+        return opt;
       mutt_window_clearline(MuttMessageWindow, 0);
       return opt;
   }
@@ -209,6 +211,37 @@ int query_quadoption(int opt, const char *prompt)
   /* not reached */
 }
 
+static struct Hash *OptionNames = NULL;  /**< Names of MuttVars */
+static struct Hash *CommandNames = NULL; /**< Names of Commands */
+
+/**
+ * init_name_tables - Hash the names of the variables and commands
+ *
+ * Every config line, hook and $variable looks up a name, so the tables are
+ * hashed once rather than searched each time.
+ */
+static void init_name_tables(void)
+{
+  int n = 0;
+
+  if (OptionNames)
+    return;
+
+  for (n = 0; MuttVars[n].name; n++)
+    ;
+  OptionNames = mutt_hash_create(n * 2, 0);
+  for (int i = 0; i < n; i++)
+    if (!mutt_hash_find(OptionNames, MuttVars[i].name))
+      mutt_hash_insert(OptionNames, MuttVars[i].name, &MuttVars[i]);
+
+  for (n = 0; Commands[n].name; n++)
+    ;
+  CommandNames = mutt_hash_create(n * 2, 0);
+  for (int i = 0; i < n; i++)
+    if (!mutt_hash_find(CommandNames, Commands[i].name))
+      mutt_hash_insert(CommandNames, Commands[i].name, (void *) &Commands[i]);
+}
+
 /**
  * mutt_option_index - Find the index (in rc_vars) of a variable name
  * @param s Variable name to search for
@@ -217,12 +250,33 @@ int query_quadoption(int opt, const char *prompt)
  */
 int mutt_option_index(const char *s)
 {
-  for (int i = 0; MuttVars[i].name; i++)
-    if (mutt_str_strcmp(s, MuttVars[i].name) == 0)
-      return (MuttVars[i].type == DT_SYNONYM ?
-                  mutt_option_index((char *) MuttVars[i].var) :
-                  i);
-  return -1;
+  if (!s)
+    return -1;
+
+  init_name_tables();
+
+  const struct Option *opt = mutt_hash_find(OptionNames, s);
+  if (!opt)
+    return -1;
+
+  if (opt->type == DT_SYNONYM)
+    return mutt_option_index((char *) opt->var);
+  return opt - MuttVars;
+}
+
+/**
+ * command_lookup - Find a config command by name
+ * @param s Name of the command
+ * @retval ptr  Command
+ * @retval NULL No such command
+ */
+static const struct Command *command_lookup(const char *s)
+{
+  if (!s)
+    return NULL;
+
+  init_name_tables();
+  return mutt_hash_find(CommandNames, s);
 }
 
 #ifdef USE_LUA
@@ -716,6 +770,7 @@ void mutt_free_opts(void)
   for (int i = 0; MuttVars[i].name; i++)
     free_opt(MuttVars + i);
 
+  mutt_alternates_reset();
   mutt_regexlist_free(&Alternates);
   mutt_regexlist_free(&UnAlternates);
   mutt_regexlist_free(&MailLists);
@@ -825,16 +880,7 @@ static int parse_ifdef(struct Buffer *tmp, struct Buffer *s, unsigned long data,
 
   /* or a command? */
   if (!res)
-  {
-    for (int i = 0; Commands[i].name; i++)
-    {
-      if (mutt_str_strcmp(tmp->data, Commands[i].name) == 0)
-      {
-        res = true;
-        break;
-      }
-    }
-  }
+    res = (command_lookup(tmp->data) != NULL);
 
   /* or a my_ var? */
   if (!res)
@@ -950,6 +996,7 @@ static int parse_unstailq(struct Buffer *buf, struct Buffer *s,
 
 static void alternates_clean(void)
 {
+  mutt_alternates_reset();
   if (!Context)
     return;
 
@@ -1700,8 +1747,8 @@ static int parse_unalias(struct Buffer *buf, struct Buffer *s,
 static int parse_alias(struct Buffer *buf, struct Buffer *s, unsigned long data,
                        struct Buffer *err)
 {
-  struct Alias *tmp = Aliases;
-  struct Alias *last = NULL;
+  struct Alias *tmp = NULL;
+  bool new = false;
   char *estr = NULL;
   struct GroupContext *gc = NULL;
 
@@ -1717,18 +1764,14 @@ static int parse_alias(struct Buffer *buf, struct Buffer *s, unsigned long data,
     return -1;
 
   /* check to see if an alias with this name already exists */
-  for (; tmp; tmp = tmp->next)
-  {
-    if (mutt_str_strcasecmp(tmp->name, buf->data) == 0)
-      break;
-    last = tmp;
-  }
+  tmp = mutt_hash_find(AliasNames, buf->data);
 
   if (!tmp)
   {
     /* create a new alias */
     tmp = mutt_mem_calloc(1, sizeof(struct Alias));
     tmp->name = mutt_str_strdup(buf->data);
+    new = true;
     /* give the main addressbook code a chance */
     if (CurrentMenu == MENU_ALIAS)
       OPT_MENU_CALLER = true;
@@ -1747,10 +1790,8 @@ static int parse_alias(struct Buffer *buf, struct Buffer *s, unsigned long data,
 
   tmp->addr = mutt_addr_parse_list2(tmp->addr, buf->data);
 
-  if (last)
-    last->next = tmp;
-  else
-    Aliases = tmp;
+  if (new)
+    mutt_alias_append(tmp);
   if (mutt_addrlist_to_intl(tmp->addr, &estr))
   {
     snprintf(err->data, err->dsize, _("Warning: Bad IDN '%s' in alias '%s'.\n"),
@@ -3066,7 +3107,8 @@ static int parse_source(struct Buffer *tmp, struct Buffer *token,
  */
 int mutt_parse_rc_line(/* const */ char *line, struct Buffer *token, struct Buffer *err)
 {
-  int i, r = 0;
+  int r = 0;
+  const struct Command *cmd = NULL;
   struct Buffer expn;
 
   if (!line || !*line)
@@ -3089,24 +3131,19 @@ int mutt_parse_rc_line(/* const */ char *line, struct Buffer *token, struct Buff
       continue;
     }
     mutt_extract_token(token, &expn, 0);
-    for (i = 0; Commands[i].name; i++)
-    {
-      if (mutt_str_strcmp(token->data, Commands[i].name) == 0)
-      {
-        r = Commands[i].func(token, &expn, Commands[i].data, err);
-        if (r != 0)
-        {              /* -1 Error, +1 Finish */
-          goto finish; /* Propagate return code */
-        }
-        break; /* Continue with next command */
-      }
-    }
-    if (!Commands[i].name)
+    cmd = command_lookup(token->data);
+    if (!cmd)
     {
       snprintf(err->data, err->dsize, _("%s: unknown command"), NONULL(token->data));
       r = -1;
       break; /* Ignore the rest of the line */
     }
+
+    r = cmd->func(token, &expn, cmd->data, err);
+    if (r != 0)
+    {              /* -1 Error, +1 Finish */
+      goto finish; /* Propagate return code */
+    }
   }
 finish:
   if (expn.destroy)
@@ -3176,10 +3213,7 @@ static void candidate(char *dest, char *try, const char *src, size_t len)
 #ifdef USE_LUA
 const struct Command *mutt_command_get(const char *s)
 {
-  for (int i = 0; Commands[i].name; i++)
-    if (mutt_str_strcmp(s, Commands[i].name) == 0)
-      return &Commands[i];
-  return NULL;
+  return command_lookup(s);
 }
 #endif
 
@@ -3817,6 +3851,7 @@ void mutt_init(int skip_sys_rc, struct ListHead *commands)
   /* reverse alias keys need to be strdup'ed because of idna conversions */
   ReverseAliases = mutt_hash_create(
       1031, MUTT_HASH_STRCASECMP | MUTT_HASH_STRDUP_KEYS | MUTT_HASH_ALLOW_DUPS);
+  AliasNames = mutt_hash_create(1031, MUTT_HASH_STRCASECMP);
   TagTransforms = mutt_hash_create(64, MUTT_HASH_STRCASECMP);
   TagFormats = mutt_hash_create(64, 0);
 
@@ -4244,6 +4279,7 @@ static int parse_tag_transforms(struct Buffer *b, struct Buffer *s,
     }
 
     mutt_hash_insert(TagTransforms, tag, transform);
+    driver_tags_transforms_changed();
   }
   return 0;
 }
@@ -4396,6 +4432,33 @@ static int parse_unsubscribe_from(struct Buffer *b, struct Buffer *s,
 }
 #endif
 
+#ifdef USE_HCACHE
+/**
+ * parse_hcache_stats - 'hcache-stats' command: Show the header cache counters
+ * @param b    Buffer space shared by all command handlers
+ * @param s    Current line of the config file
+ * @param data Data field from init.h:struct Command
+ * @param err  Buffer for any error message
+ * @retval  0 Success
+ * @retval -1 Failed
+ */
+static int parse_hcache_stats(struct Buffer *b, struct Buffer *s,
+                              unsigned long data, struct Buffer *err)
+{
+  char buf[STRING];
+
+  if (MoreArgs(s))
+  {
+    mutt_buffer_addstr(err, _("Too many arguments"));
+    return -1;
+  }
+
+  mutt_hcache_stats(buf, sizeof(buf));
+  mutt_message("%s", buf);
+  return 0;
+}
+#endif
+
 const char *myvar_get(const char *var)
 {
   struct MyVar *cur = NULL;
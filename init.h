@@ -39,6 +39,7 @@
 #include "mutt/mutt.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "sort.h"
 #include "conn/conn.h"
@@ -369,6 +370,17 @@ struct Option MuttVars[] = {
   ** follow these menus.  The option is \fIunset\fP by default because many
   ** visual terminals don't permit making the cursor invisible.
   */
+  { "browser_stat_threads", DT_NUMBER, R_NONE, UL &BrowserStatThreads, 8 },
+  /*
+  ** .pp
+  ** When the file browser lists a directory, it must stat(2) every entry to
+  ** show its size, date and permissions.  This many threads, from the pool of
+  ** $$threads, share the work, which hides the latency of slow file systems,
+  ** e.g. NFS.
+  ** .pp
+  ** A value of 0 or 1 stats the entries one at a time.  This option has no
+  ** effect if NeoMutt was built without POSIX threads.
+  */
 #ifdef USE_NNTP
   { "catchup_newsgroup", DT_QUAD, R_NONE, UL &CatchupNewsgroup, MUTT_ASKYES },
   /*
@@ -473,6 +485,19 @@ struct Option MuttVars[] = {
   ** See the text describing the $$status_format option for more
   ** information on how to set $$compose_format.
   */
+#ifdef USE_COMPRESSED
+  { "compress_cache",   DT_NUMBER, R_NONE, UL &CompressCache, 0 },
+  /*
+  ** .pp
+  ** The number of compressed mailboxes (see ``$open-hook'') whose
+  ** decompressed copies are kept after they're closed.  Reopening one of
+  ** them doesn't run the ``$open-hook'' command again, unless the compressed
+  ** file has changed since.  The copies are kept in $$tmpdir until NeoMutt
+  ** exits.
+  ** .pp
+  ** The default, 0, deletes each copy when its mailbox is closed.
+  */
+#endif
   { "config_charset",   DT_STRING,  R_NONE, UL &ConfigCharset, UL 0 },
   /*
   ** .pp
@@ -1116,8 +1141,8 @@ struct Option MuttVars[] = {
   ** be a single global header cache. By default it is \fIunset\fP so no header
   ** caching will be used.
   ** .pp
-  ** Header caching can greatly improve speed when opening POP, IMAP
-  ** MH or Maildir folders, see ``$caching'' for details.
+  ** Header caching can greatly improve speed when opening POP, IMAP,
+  ** MH, Maildir, mbox or Notmuch folders, see ``$caching'' for details.
   */
   { "header_cache_backend", DT_HCACHE, R_NONE, UL &HeaderCacheBackend, UL 0 },
   /*
@@ -1147,6 +1172,14 @@ struct Option MuttVars[] = {
   ** or less optimal for most use cases.
   */
 #endif /* HAVE_GDBM || HAVE_BDB */
+  { "header_cache_prefetch", DT_NUMBER, R_NONE, UL &HeaderCachePrefetch, 0 },
+  /*
+  ** .pp
+  ** When opening a folder whose header cache file is at least this many
+  ** megabytes, NeoMutt asks the operating system to start reading the whole
+  ** file into memory in the background.  On a cold start this avoids taking
+  ** one disk seek per cached message.  A value of 0 disables the prefetch.
+  */
 #endif /* USE_HCACHE */
   { "header_color_partial", DT_BOOL, R_PAGER_FLOW, UL &HeaderColorPartial, 0 },
   /*
@@ -1334,6 +1367,16 @@ struct Option MuttVars[] = {
    ** it polls for new mail just as if you had issued individual ``$mailboxes''
    ** commands.
    */
+#ifdef USE_ZLIB
+  { "imap_deflate",             DT_BOOL, R_NONE, UL &ImapDeflate, 1 },
+  /*
+  ** .pp
+  ** When \fIset\fP, NeoMutt will use the COMPRESS=DEFLATE extension (RFC4978)
+  ** if the IMAP server supports it.  All the traffic after logging in is
+  ** then compressed, making the headers and messages much quicker to
+  ** download over a slow link.
+  */
+#endif
   { "imap_delim_chars",         DT_STRING, R_NONE, UL &ImapDelimChars, UL "/." },
   /*
   ** .pp
@@ -1341,6 +1384,34 @@ struct Option MuttVars[] = {
   ** as folder separators for displaying IMAP paths. In particular it
   ** helps in using the ``='' shortcut for your \fIfolder\fP variable.
   */
+  { "imap_fetch_connections", DT_NUMBER, R_NONE, UL &ImapFetchConnections, 1 },
+  /*
+  ** .pp
+  ** The number of connections NeoMutt may use at once to download the headers
+  ** of a large IMAP mailbox, when they aren't in the header cache.  Each
+  ** connection is given a share of the messages, but at least 1000 of them.
+  ** On a link with a high latency, this can make opening the mailbox much
+  ** faster.  The extra connections stay open afterwards, so they can be
+  ** reused.
+  ** .pp
+  ** The default, 1, only uses the mailbox's own connection.  At most 8
+  ** connections are used.
+  */
+  { "imap_fetch_window", DT_NUMBER, R_NONE, UL &ImapFetchWindow, 0 },
+  /*
+  ** .pp
+  ** When this is set to a positive number, opening an IMAP mailbox only reads
+  ** the headers of its most recent $$imap_fetch_window messages, when they
+  ** aren't in the header cache.  Older headers are read, this many at a time,
+  ** as the index scrolls towards them.  This makes huge archive folders quick
+  ** to open.
+  ** .pp
+  ** Limiting, searching, tagging by pattern and threading need every message,
+  ** so they read all the remaining headers first.  The window isn't used when
+  ** $$sort is ``threads''.
+  ** .pp
+  ** The default, 0, reads all the headers when the mailbox is opened.
+  */
   { "imap_headers",     DT_STRING, R_INDEX, UL &ImapHeaders, UL 0 },
   /*
   ** .pp
@@ -1364,6 +1435,22 @@ struct Option MuttVars[] = {
   ** to NeoMutt's implementation. If your connection seems to freeze
   ** up periodically, try unsetting this.
   */
+  { "imap_index_headers", DT_STRING, R_NONE, UL &ImapIndexHeaders, UL 0 },
+  /*
+  ** .pp
+  ** If set, NeoMutt first asks the IMAP server for just these header fields
+  ** when it opens a mailbox, e.g. ``DATE FROM SUBJECT'', instead of the
+  ** default headers and $$imap_headers.  It should name everything that
+  ** $$index_format shows.  The index can then be drawn sooner.
+  ** .pp
+  ** The full set of headers is read afterwards, while the index waits for a
+  ** key, a batch at a time.  A pattern that looks at a field that hasn't
+  ** been read yet reads the rest first, and so does sorting by threads.
+  ** Headers aren't put in the $$header_cache until they are complete.
+  ** .pp
+  ** The list is space separated, like $$imap_headers.  It isn't used when
+  ** $$sort is ``threads''.
+  */
   { "imap_keepalive",           DT_NUMBER,  R_NONE, UL &ImapKeepalive, 300 },
   /*
   ** .pp
@@ -1417,7 +1504,7 @@ struct Option MuttVars[] = {
   ** but can make closing an IMAP folder somewhat slower. This option
   ** exists to appease speed freaks.
   */
-  { "imap_pipeline_depth", DT_NUMBER,  R_NONE, UL &ImapPipelineDepth, 15 },
+  { "imap_pipeline_depth", DT_NUMBER,  R_NONE, UL &ImapPipelineDepth, 30 },
   /*
   ** .pp
   ** Controls the number of IMAP commands that may be queued up before they
@@ -1426,6 +1513,11 @@ struct Option MuttVars[] = {
   ** more responsive. But not all servers correctly handle pipelined commands,
   ** so if you have problems you might want to try setting this variable to 0.
   ** .pp
+  ** This is only the starting depth.  When NeoMutt has to wait for a full
+  ** pipeline, it measures the round trip to the server and makes the pipeline
+  ** deeper, up to 128 commands.  If the server rejects a command, the pipeline
+  ** is made shallower again.  Setting this variable to 0 turns that off too.
+  ** .pp
   ** \fBNote:\fP Changes to this variable have no effect on open connections.
   */
   { "imap_poll_timeout", DT_NUMBER,  R_NONE, UL &ImapPollTimeout, 15 },
@@ -1436,6 +1528,35 @@ struct Option MuttVars[] = {
   ** for new mail, before timing out and closing the connection.  Set
   ** to 0 to disable timing out.
   */
+  { "imap_prefetch",    DT_NUMBER,  R_NONE, UL &ImapPrefetch, 0 },
+  /*
+  ** .pp
+  ** While you read a message from an IMAP mailbox, NeoMutt can download the
+  ** next $$imap_prefetch messages of the index into the message cache (see
+  ** $$message_cachedir), so that they display at once.  The downloads are
+  ** pipelined, and stop as soon as you press a key.  Messages larger than
+  ** $$imap_prefetch_size are left out.
+  ** .pp
+  ** The default, 0, doesn't download anything ahead.  At most 32 messages are
+  ** downloaded.  This has no effect if $$message_cachedir is unset.
+  */
+  { "imap_prefetch_size", DT_NUMBER, R_NONE, UL &ImapPrefetchSize, 256 },
+  /*
+  ** .pp
+  ** The largest message, in kilobytes, that $$imap_prefetch will download
+  ** ahead of time.
+  */
+  { "imap_qresync",             DT_BOOL, R_NONE, UL &ImapQresync, 0 },
+  /*
+  ** .pp
+  ** When \fIset\fP, NeoMutt will use the CONDSTORE and QRESYNC extensions
+  ** (RFC7162), if the server supports them, to resynchronise a mailbox
+  ** whose headers are in the $$header_cache.  Then, reopening a mailbox
+  ** only downloads the flags that changed and the UIDs of the messages
+  ** that were expunged, rather than the flags of every message.
+  ** .pp
+  ** \fBNote:\fP Changes to this variable have no effect on open connections.
+  */
   { "imap_servernoise",         DT_BOOL, R_NONE, UL &ImapServernoise, 1 },
   /*
   ** .pp
@@ -1679,6 +1800,17 @@ struct Option MuttVars[] = {
   ** folders).
   */
 #endif
+  { "maildir_read_threads", DT_NUMBER, R_NONE, UL &MaildirReadThreads, 8 },
+  /*
+  ** .pp
+  ** When NeoMutt opens a Maildir or MH folder, it must read the header of
+  ** every message that isn't in the $$header_cache.  This many threads, from
+  ** the pool of $$threads, open and read the message files ahead of NeoMutt
+  ** parsing them, which hides the latency of slow file systems, e.g. NFS.
+  ** .pp
+  ** A value of 0 or 1 reads the files one at a time.  This option has no
+  ** effect if NeoMutt was built without POSIX threads.
+  */
   { "maildir_trash", DT_BOOL, R_NONE, UL &MaildirTrash, 0 },
   /*
   ** .pp
@@ -1736,6 +1868,23 @@ struct Option MuttVars[] = {
   ** .pp
   ** Also see the $$move variable.
   */
+  { "mbox_sync_in_place", DT_BOOL, R_NONE, UL &MboxSyncInPlace, 0 },
+  /*
+  ** .pp
+  ** When \fIset\fP, NeoMutt syncs an mbox folder by moving the messages that
+  ** haven't changed within the file, instead of copying everything after the
+  ** first change to a temporary file and back.  Only the messages that have
+  ** changed are written out again.  For a large folder with a deletion near
+  ** the start, this halves the amount of data that's read and written.
+  ** .pp
+  ** While the folder is being rewritten, a journal is kept next to it, as
+  ** ``.\fIname\fP.journal''.  If NeoMutt is interrupted, the sync is finished
+  ** when the folder is next opened.  If the folder's directory isn't writable,
+  ** or a changed message has grown too much to fit, the folder is synced the
+  ** usual way.
+  ** .pp
+  ** MMDF folders are always synced the usual way.
+  */
   { "mbox_type",        DT_MAGIC,R_NONE, UL &MboxType, MUTT_MBOX },
   /*
   ** .pp
@@ -1773,6 +1922,40 @@ struct Option MuttVars[] = {
   ** every once in a while, since it can be a little slow
   ** (especially for large folders).
   */
+#endif
+#if defined(USE_IMAP) || defined(USE_POP) || defined(USE_NNTP)
+#ifdef USE_ZLIB
+  { "message_cache_compress", DT_BOOL, R_NONE, UL &MessageCacheCompress, 0 },
+  /*
+  ** .pp
+  ** If \fIset\fP, messages are compressed as they're moved into the pack
+  ** of a message cache (see $$message_cache_pack).  They're decompressed
+  ** again each time they're read.  Messages that are already in the pack
+  ** are left as they are.
+  */
+#endif
+  { "message_cache_limit", DT_NUMBER, R_NONE, UL &MessageCacheLimit, 0 },
+  /*
+  ** .pp
+  ** The largest size, in megabytes, of the message cache of a mailbox kept in
+  ** a pack (see $$message_cache_pack).  When a mailbox is closed, the messages
+  ** that haven't been read for the longest time are deleted until the cache
+  ** fits.
+  ** .pp
+  ** The default, 0, doesn't limit the size of the cache.
+  */
+  { "message_cache_pack", DT_BOOL, R_NONE, UL &MessageCachePack, 0 },
+  /*
+  ** .pp
+  ** If \fIset\fP, NeoMutt keeps the cached messages of each mailbox in one
+  ** file, with an index, instead of one file per message.  This saves a
+  ** lot of files and directory scans when thousands of messages are cached.
+  ** Messages are cached as separate files while the mailbox is open, and
+  ** moved into the pack when it's closed.  The pack is compacted once more
+  ** than half of it is taken by deleted messages.
+  ** .pp
+  ** Also see the $$message_cache_limit and $$message_cache_compress variables.
+  */
   { "message_cachedir", DT_PATH,        R_NONE, UL &MessageCachedir, 0 },
   /*
   ** .pp
@@ -2018,6 +2201,16 @@ struct Option MuttVars[] = {
   ** number, oldest articles will be ignored.  Also controls how many
   ** articles headers will be saved in cache when you quit newsgroup.
   */
+#ifdef USE_ZLIB
+  { "nntp_deflate",     DT_BOOL, R_NONE, UL &NntpDeflate, 1 },
+  /*
+  ** .pp
+  ** When \fIset\fP, NeoMutt will use the COMPRESS DEFLATE extension (RFC8054)
+  ** if the news server supports it.  All the traffic after logging in is
+  ** then compressed, making the overview of a large newsgroup much quicker
+  ** to download over a slow link.
+  */
+#endif
   { "nntp_listgroup",   DT_BOOL, R_NONE, UL &NntpListgroup, 1 },
   /*
   ** .pp
@@ -2051,6 +2244,25 @@ struct Option MuttVars[] = {
   ** recheck newsgroup on each operation in index (stepping, read article,
   ** etc.).
   */
+  { "nntp_prefetch",    DT_NUMBER, R_NONE, UL &NntpPrefetch, 0 },
+  /*
+  ** .pp
+  ** While you read an article, NeoMutt can download the next $$nntp_prefetch
+  ** articles of the index into the message cache (see $$message_cachedir),
+  ** so that they display at once.  The downloads are pipelined, and stop as
+  ** soon as you press a key.  Articles larger than $$nntp_prefetch_size are
+  ** left out.
+  ** .pp
+  ** The default, 0, doesn't download anything ahead.  At most 32 articles are
+  ** downloaded.  This has no effect if $$message_cachedir is unset, or the
+  ** newsgroup isn't in your newsrc file.
+  */
+  { "nntp_prefetch_size", DT_NUMBER, R_NONE, UL &NntpPrefetchSize, 256 },
+  /*
+  ** .pp
+  ** The largest article, in kilobytes, that $$nntp_prefetch will download
+  ** ahead of time.
+  */
 #endif
 #ifdef USE_NOTMUCH
   { "nm_open_timeout", DT_NUMBER, R_NONE, UL &NmOpenTimeout, 5 },
@@ -2832,6 +3044,18 @@ struct Option MuttVars[] = {
   ** .pp
   ** Match detection may be overridden by the $$smileys regular expression.
   */
+  { "read_batch",       DT_NUMBER,  R_NONE, UL &ReadBatch, 1000 },
+  /*
+  ** .pp
+  ** When the index opens a large mbox folder, it's shown as soon as this many
+  ** messages have been read.  The rest are read in batches of the same size
+  ** while NeoMutt is waiting for a key, and you can move around the messages
+  ** that are already there.  They're listed in the order they were read, and
+  ** sorted according to $$sort once the whole folder has been read.  Any
+  ** command other than moving around reads the rest of the folder first.
+  ** .pp
+  ** When set to 0, the whole folder is read before the index is shown.
+  */
   { "read_inc",         DT_NUMBER,  R_NONE, UL &ReadInc, 10 },
   /*
   ** .pp
@@ -3121,6 +3345,33 @@ struct Option MuttVars[] = {
   ** For the pager, this variable specifies the number of lines shown
   ** before search results. By default, search results will be top-aligned.
   */
+#ifdef USE_HCACHE
+  { "search_index",     DT_BOOL, R_NONE, UL &SearchIndex, 0 },
+  /*
+  ** .pp
+  ** When \fIset\fP, each message of a local folder that has its body
+  ** searched (``~b'' or ``~B'') gets a small signature of the words in it,
+  ** stored in the $$header_cache.  Later searches skip the messages whose
+  ** signature shows that they can't contain the text being looked for, without
+  ** reading them from the disk.
+  ** .pp
+  ** Only searches with $$thorough_search set use the signatures.  Messages
+  ** that are encrypted are never given one.
+  */
+#endif
+  { "search_read_threads", DT_NUMBER, R_NONE, UL &SearchReadThreads, 4 },
+  /*
+  ** .pp
+  ** When a search, limit or tag pattern has to look at the header or body of
+  ** the messages in a local folder (e.g. ``~b'' or ``~h''), this many threads,
+  ** from the pool of $$threads, read the messages ahead of NeoMutt matching
+  ** them.  The matching itself is
+  ** done one message at a time, but it finds the messages already read from
+  ** the disk.
+  ** .pp
+  ** A value of 0 or 1 reads the messages as they're matched.  This option
+  ** has no effect if NeoMutt was built without POSIX threads.
+  */
   { "send_charset",     DT_STRING,  R_NONE, UL &SendCharset, UL "us-ascii:iso-8859-1:utf-8" },
   /*
   ** .pp
@@ -3135,6 +3386,31 @@ struct Option MuttVars[] = {
   ** In case the text cannot be converted into one of these exactly,
   ** NeoMutt uses $$charset as a fallback.
   */
+  { "send_queue",       DT_PATH,    R_NONE, UL &SendQueue, 0 },
+  /*
+  ** .pp
+  ** When set, NeoMutt doesn't wait for $$smtp_url or $$sendmail to accept
+  ** a message.  The message is written to this directory instead, and a
+  ** background process delivers it, so the next message can be composed
+  ** straight away.  The process carries on after NeoMutt has exited.
+  ** .pp
+  ** If delivery fails, it's tried again after $$send_queue_retry seconds,
+  ** then after twice as long each time, up to an hour.  After ten attempts
+  ** the message is left in the queue with a name ending in ``,failed'' and
+  ** NeoMutt mentions it at startup.  The errors are logged to the ``.log''
+  ** file in the queue.  Messages left over from an earlier session are
+  ** sent when NeoMutt starts.
+  ** .pp
+  ** Nobody can be asked for a password or to accept a certificate in the
+  ** background, so both must be available without a prompt, e.g. by setting
+  ** $$smtp_pass and $$certificate_file.
+  */
+  { "send_queue_retry", DT_NUMBER,  R_NONE, UL &SendQueueRetry, 60 },
+  /*
+  ** .pp
+  ** The number of seconds to wait before trying a message in the
+  ** $$send_queue again, after its first failed delivery.
+  */
   { "sendmail",         DT_PATH, R_NONE, UL &Sendmail, UL SENDMAIL " -oem -oi" },
   /*
   ** .pp
@@ -3664,6 +3940,20 @@ struct Option MuttVars[] = {
   ** set smtp_authenticators="digest-md5:cram-md5"
   ** .te
   */
+  { "smtp_keepalive",   DT_NUMBER, R_NONE, UL &SmtpKeepalive, 0 },
+  /*
+  ** .pp
+  ** If set to a positive number, NeoMutt keeps the connection to the SMTP
+  ** server open after sending a message, and uses it for the next message
+  ** sent within that many seconds.  This saves connecting, negotiating TLS
+  ** and authenticating again for each message.  The connection is checked
+  ** with \fCRSET\fP before it's reused; if the server has closed it, NeoMutt
+  ** reconnects.
+  ** .pp
+  ** Many servers close idle connections after a few minutes, so there's
+  ** little point in a value larger than 300.  When \fIunset\fP (0, the
+  ** default), the connection is closed after each message.
+  */
   { "smtp_pass",        DT_STRING,  R_NONE|F_SENSITIVE, UL &SmtpPass, UL 0 },
   /*
   ** .pp
@@ -4081,6 +4371,17 @@ struct Option MuttVars[] = {
   ** When \fIset\fP, NeoMutt uses the date received rather than the date sent
   ** to thread messages by subject.
   */
+  { "threads",          DT_NUMBER,  R_NONE, UL &Threads, 8 },
+  /*
+  ** .pp
+  ** NeoMutt keeps a pool of up to this many threads for work that can be done
+  ** in parallel, such as reading message files ahead of parsing them.  The
+  ** threads are shared: the settings for each job, e.g. $$maildir_read_threads,
+  ** say how many of them it may use.
+  ** .pp
+  ** A value of 0 does all the work in the main thread.  This option has no
+  ** effect if NeoMutt was built without POSIX threads.
+  */
   { "tilde",            DT_BOOL, R_PAGER, UL &Tilde, 0 },
   /*
   ** .pp
@@ -4498,6 +4799,9 @@ static int parse_alias           (struct Buffer *buf, struct Buffer *s, unsigned
 static int parse_alternates      (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 static int parse_attachments     (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 static int parse_group           (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
+#ifdef USE_HCACHE
+static int parse_hcache_stats    (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
+#endif
 static int parse_ifdef           (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 static int parse_ignore          (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 static int parse_lists           (struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
@@ -4561,6 +4865,9 @@ const struct Command Commands[] = {
   { "finish",              finish_source,          0 },
   { "folder-hook",         mutt_parse_hook,        MUTT_FOLDERHOOK },
   { "group",               parse_group,            MUTT_GROUP },
+#ifdef USE_HCACHE
+  { "hcache-stats",        parse_hcache_stats,     0 },
+#endif
   { "hdr_order",           parse_stailq,           UL &HeaderOrderList },
   { "iconv-hook",          mutt_parse_hook,        MUTT_ICONVHOOK },
   { "ifdef",               parse_ifdef,            0 },
@@ -4583,6 +4890,8 @@ const struct Command Commands[] = {
 #ifdef USE_COMPRESSED
   { "open-hook",           mutt_parse_hook,        MUTT_OPENHOOK },
 #endif
+  { "pattern-explain",     mutt_parse_pattern_explain, 0 },
+  { "perf",                mutt_parse_perf,        0 },
   { "pgp-hook",            mutt_parse_hook,        MUTT_CRYPTHOOK },
   { "push",                mutt_parse_push,        0 },
   { "reply-hook",          mutt_parse_hook,        MUTT_REPLYHOOK },
@@ -23,6 +23,7 @@
 #include "config.h"
 #include <ctype.h>
 #include <limits.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -131,6 +132,47 @@ int LastKey;
 
 struct Keymap *Keymaps[MENU_MAX];
 
+/* Keys below this (ASCII and the curses KEY_* codes) are looked up directly */
+#define KEY_INDEX_MAX 512
+
+/* For each menu, the first binding starting with each key, built when needed */
+static struct Keymap **KeyIndex[MENU_MAX];
+
+/**
+ * km_first_key - Find the first binding that starts with a key
+ * @param menu Menu ID, e.g. #MENU_MAIN
+ * @param key  Key pressed
+ * @retval ptr  First binding starting with the key
+ * @retval NULL The key isn't bound
+ *
+ * The bindings of a menu are kept sorted, so all the sequences that start with
+ * the same key follow this one.
+ */
+static struct Keymap *km_first_key(int menu, int key)
+{
+  struct Keymap *map = NULL;
+
+  if ((key < 0) || (key >= KEY_INDEX_MAX))
+  {
+    for (map = Keymaps[menu]; map && (map->keys[0] < key); map = map->next)
+      ;
+    return (map && (map->keys[0] == key)) ? map : NULL;
+  }
+
+  if (!KeyIndex[menu])
+  {
+    KeyIndex[menu] = mutt_mem_calloc(KEY_INDEX_MAX, sizeof(struct Keymap *));
+    for (map = Keymaps[menu]; map; map = map->next)
+    {
+      int k = map->keys[0];
+      if ((k >= 0) && (k < KEY_INDEX_MAX) && !KeyIndex[menu][k])
+        KeyIndex[menu][k] = map;
+    }
+  }
+
+  return KeyIndex[menu][key];
+}
+
 static struct Keymap *alloc_keys(size_t len, keycode_t *keys)
 {
   struct Keymap *p = NULL;
@@ -257,6 +299,7 @@ int km_bind_err(char *s, int menu, int op, char *macro, char *descr, struct Buff
   map->macro = mutt_str_strdup(macro);
   map->descr = mutt_str_strdup(descr);
 
+  FREE(&KeyIndex[menu]);
   tmp = Keymaps[menu];
 
   while (tmp)
@@ -466,6 +509,69 @@ static int retry_generic(int menu, keycode_t *keys, int keyslen, int lastkey)
   return OP_NULL;
 }
 
+#ifdef HAVE_PTHREAD_CREATE
+/**
+ * km_wait_workers - Wait for a keypress or for a worker thread's job
+ * @param secs Longest time to wait, in seconds
+ * @retval true  Some jobs were delivered, or the time is up
+ * @retval false There is keyboard input
+ */
+static bool km_wait_workers(int secs)
+{
+  struct pollfd pfds[2] = {
+    { .fd = 0, .events = POLLIN },
+    { .fd = mutt_worker_fd(), .events = POLLIN },
+  };
+
+  /* a signal, e.g. SIGWINCH, counts as a timeout */
+  if ((poll(pfds, 2, secs * 1000) > 0) && (pfds[0].revents != 0))
+    return false;
+
+  mutt_worker_complete();
+  return true;
+}
+#endif
+
+/**
+ * km_getch - Wait for a keypress
+ * @param menu Menu ID, e.g. #MENU_MAIN
+ * @param secs Timeout in seconds
+ * @retval obj Event, ch is -2 for a timeout
+ *
+ * The index and pager check the mailbox after a timeout, so if the server of
+ * an IDLE mailbox has something to say, they're woken up straight away.  The
+ * same goes for a job of the worker threads finishing.
+ */
+static struct Event km_getch(int menu, int secs)
+{
+  struct Event tmp;
+
+#ifdef HAVE_PTHREAD_CREATE
+  if ((mutt_worker_pending() > 0) && !mutt_getch_pending() && km_wait_workers(secs))
+  {
+    tmp.ch = -2;
+    tmp.op = OP_NULL;
+    return tmp;
+  }
+#endif
+
+#ifdef USE_IMAP
+  if (((menu == MENU_MAIN) || (menu == MENU_PAGER)) && !OPT_ATTACH_MSG &&
+      !mutt_getch_pending() && (imap_wait_idle(Context, secs) > 0))
+  {
+    tmp.ch = -2;
+    tmp.op = OP_NULL;
+    return tmp;
+  }
+#endif
+
+  timeout(secs * 1000);
+  tmp = mutt_getch();
+  timeout(-1);
+
+  return tmp;
+}
+
 /**
  * km_dokey - Determine what a keypress should do
  * @param menu Menu ID, e.g. #MENU_EDITOR
@@ -498,9 +604,7 @@ int km_dokey(int menu)
       {
         while (ImapKeepalive && ImapKeepalive < i)
         {
-          timeout(ImapKeepalive * 1000);
-          tmp = mutt_getch();
-          timeout(-1);
+          tmp = km_getch(menu, ImapKeepalive);
           /* If a timeout was not received, or the window was resized, exit the
            * loop now.  Otherwise, continue to loop until reaching a total of
            * $timeout seconds.
@@ -514,9 +618,7 @@ int km_dokey(int menu)
     }
 #endif
 
-    timeout(i * 1000);
-    tmp = mutt_getch();
-    timeout(-1);
+    tmp = km_getch(menu, i);
 
 #ifdef USE_IMAP
   gotkey:
@@ -574,6 +676,13 @@ int km_dokey(int menu)
     }
 
     /* Nope. Business as usual */
+    if (pos == 0)
+    {
+      map = km_first_key(menu, LastKey);
+      if (!map)
+        return (retry_generic(menu, NULL, 0, LastKey));
+    }
+
     while (LastKey > map->keys[pos])
     {
       if (pos > map->eq || !map->next)
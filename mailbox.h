@@ -41,6 +41,7 @@ struct Context;
 #define MUTT_PEEK      (1 << 5) /**< revert atime back after taking a look (if applicable) */
 #define MUTT_APPENDNEW (1 << 6) /**< set in mx_open_mailbox_append if the mailbox doesn't
                                  * exist. used by maildir/mh to create the mailbox. */
+#define MUTT_PROGRESSIVE (1 << 7) /**< return after the first batch of messages, see mx_open_more() */
 
 /* mx_open_new_message() */
 #define MUTT_ADD_FROM  (1 << 0) /**< add a From_ line */
@@ -77,6 +78,7 @@ struct Message
 };
 
 struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pctx);
+int mx_open_more(struct Context *ctx, bool all);
 
 struct Message *mx_open_message(struct Context *ctx, int msgno);
 struct Message *mx_open_new_message(struct Context *dest, struct Header *hdr, int flags);
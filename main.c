@@ -39,18 +39,22 @@
 #include "mutt.h"
 #include "address.h"
 #include "alias.h"
+#include "batch.h"
 #include "body.h"
 #include "buffy.h"
 #include "envelope.h"
 #include "globals.h"
 #include "header.h"
+#include "history.h"
 #include "keymap.h"
 #include "mailbox.h"
 #include "mutt_curses.h"
 #include "mutt_menu.h"
 #include "ncrypt/ncrypt.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
+#include "sendqueue.h"
 #include "url.h"
 #include "version.h"
 #ifdef ENABLE_NLS
@@ -65,12 +69,24 @@
 #ifdef USE_NNTP
 #include "nntp.h"
 #endif
+#ifdef USE_NOTMUCH
+#include "mutt_notmuch.h"
+#endif
+#ifdef USE_INOTIFY
+#include "monitor.h"
+#endif
+#ifdef USE_COMPRESSED
+#include "compress.h"
+#endif
 
 char **envlist = NULL;
 
 void mutt_exit(int code)
 {
   mutt_endwin(NULL);
+#ifdef USE_COMPRESSED
+  mutt_comp_cleanup();
+#endif
   exit(code);
 }
 
@@ -86,6 +102,7 @@ static void usage(void)
          "       neomutt [<options>] -A <alias> [...]\n"
          "       neomutt [<options>] -Q <query> [...]\n"
          "       neomutt [<options>] -B\n"
+         "       neomutt [<options>] -X <script>\n"
          "       neomutt [<options>] -D [-S]\n"
          "       neomutt -v[v]\n"));
 
@@ -115,7 +132,9 @@ static void usage(void)
   puts(_("  -Q <variable> query a configuration variable\n"
          "  -R            open mailbox in read-only mode\n"
          "  -s <subj>     specify a subject (must be in quotes if it has spaces)\n"
+         "  -T <file>     write a timeline of busy operations to a file\n"
          "  -v            show version and compile-time definitions\n"
+         "  -X <script>   run a script of mailbox commands, without the ncurses UI\n"
          "  -x            simulate the mailx send mode\n"
          "  -y            select a mailbox specified in your `mailboxes' list\n"
          "  -z            exit immediately if there are no messages in the mailbox\n"
@@ -201,10 +220,14 @@ int main(int argc, char **argv, char **env)
   bool dump_variables = false;
   bool hide_sensitive = false;
   bool batch_mode = false;
+  char *batch_script = NULL;
   bool edit_infile = false;
   extern char *optarg;
   extern int optind;
   int double_dash = argc, nargc = 1;
+  struct PerfTimer perf;
+
+  mutt_perf_arm(PERF_STARTUP);
 
   /* sanity check against stupid administrators */
 
@@ -268,7 +291,7 @@ int main(int argc, char **argv, char **env)
     }
 
     /* USE_NNTP 'g:G' */
-    i = getopt(argc, argv, "+A:a:Bb:F:f:c:Dd:l:Ee:g:GH:s:i:hm:npQ:RSvxyzZ");
+    i = getopt(argc, argv, "+A:a:Bb:F:f:c:Dd:l:Ee:g:GH:s:i:hm:npQ:RST:vX:xyzZ");
     if (i != EOF)
     {
       switch (i)
@@ -369,10 +392,24 @@ int main(int argc, char **argv, char **env)
           subject = optarg;
           break;
 
+        case 'T':
+          if (mutt_trace_open(optarg) != 0)
+          {
+            fprintf(stderr, _("Error: can't write the trace to %s: %s\n"),
+                    optarg, strerror(errno));
+            return 1;
+          }
+          break;
+
         case 'v':
           version++;
           break;
 
+        case 'X':
+          batch_script = optarg;
+          batch_mode = true;
+          break;
+
         case 'x': /* mailx compatible send mode */
           sendflags |= SENDMAILX;
           break;
@@ -444,17 +481,21 @@ int main(int argc, char **argv, char **env)
      before calling the init_pair() function to set the color scheme.  */
   if (!OPT_NO_CURSES)
   {
+    mutt_perf_start(&perf, PERF_STARTUP_CURSES);
     start_curses();
+    mutt_perf_stop(&perf);
 
     /* check whether terminal status is supported (must follow curses init) */
     TSSupported = mutt_ts_capability();
   }
 
   /* set defaults and read init files */
+  mutt_perf_start(&perf, PERF_STARTUP_CONFIG);
   mutt_init(flags & MUTT_NOSYSRC, &commands);
   mutt_list_free(&commands);
+  mutt_perf_stop(&perf);
 
-  /* Initialize crypto backends.  */
+  /* Choose the crypto backends; they're started when first used */
   crypt_init();
 
   if (new_magic)
@@ -531,6 +572,19 @@ int main(int argc, char **argv, char **env)
     }
   }
 
+  /* Deliver anything left in the send queue by an earlier session. */
+  if (!OPT_NO_CURSES)
+    mutt_queue_flush();
+
+  if (batch_script)
+  {
+    int rc = mutt_batch_run(batch_script);
+    mutt_perf_dump();
+#ifdef USE_IMAP
+    imap_logout_all();
+#endif
+    exit(rc);
+  }
   if (batch_mode)
     exit(0);
 
@@ -828,6 +882,9 @@ int main(int argc, char **argv, char **env)
       FREE(&tempfile);
     }
 
+#ifdef USE_SMTP
+    mutt_smtp_logout();
+#endif
     mutt_free_windows();
     if (!OPT_NO_CURSES)
       mutt_endwin(NULL);
@@ -916,7 +973,7 @@ int main(int argc, char **argv, char **env)
     mutt_startup_shutdown_hook(MUTT_STARTUPHOOK);
 
     Context = mx_open_mailbox(
-        folder, ((flags & MUTT_RO) || ReadOnly) ? MUTT_READONLY : 0, NULL);
+        folder, MUTT_PROGRESSIVE | (((flags & MUTT_RO) || ReadOnly) ? MUTT_READONLY : 0), NULL);
     if (Context || !explicit_folder)
     {
 #ifdef USE_SIDEBAR
@@ -926,13 +983,31 @@ int main(int argc, char **argv, char **env)
       if (Context)
         FREE(&Context);
     }
+    mutt_perf_dump();
+    mutt_hist_compact();
 #ifdef USE_IMAP
     imap_logout_all();
 #endif
+#ifdef USE_SMTP
+    mutt_smtp_logout();
+#endif
 #ifdef USE_SASL
     mutt_sasl_done();
+#endif
+#ifdef USE_INOTIFY
+    mutt_monitor_cleanup();
+#endif
+#ifdef USE_NOTMUCH
+    nm_nonctx_cleanup();
+#endif
+#ifdef USE_COMPRESSED
+    mutt_comp_cleanup();
+#endif
+#ifdef HAVE_PTHREAD_CREATE
+    mutt_worker_shutdown();
 #endif
     mutt_free_opts();
+    mutt_ch_cache_cleanup();
     mutt_free_windows();
     mutt_endwin(ErrorBuf);
   }
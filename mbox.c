@@ -23,11 +23,18 @@
 /* This file contains code to parse ``mbox'' and ``mmdf'' style mailboxes */
 
 #include "config.h"
+#include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -46,9 +53,16 @@
 #include "mutt_curses.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "sort.h"
 #include "thread.h"
+#ifdef USE_COMPRESSED
+#include "compress.h"
+#endif
+#ifdef USE_HCACHE
+#include "hcache/hcache.h"
+#endif
 
 /**
  * struct MUpdate - Store of new offsets, used by mutt_sync_mailbox()
@@ -242,6 +256,536 @@ static int mmdf_parse_mailbox(struct Context *ctx)
   return 0;
 }
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+/**
+ * mbox_count_lines - Count the newlines in a block of memory
+ * @param s   Start of the block
+ * @param len Length of the block
+ * @retval num Number of newlines
+ *
+ * The loop is branch-free so the compiler can vectorise it.
+ */
+static int mbox_count_lines(const char *s, size_t len)
+{
+  int lines = 0;
+
+  for (size_t i = 0; i < len; i++)
+    lines += (s[i] == '\n');
+
+  return lines;
+}
+
+/**
+ * mbox_find_from - Find the next message separator in a mapped mailbox
+ * @param[in]  map     Mailbox in memory
+ * @param[in]  size    Size of the mailbox
+ * @param[in]  pos     Offset to start at, at the beginning of a line
+ * @param[out] lines   Incremented by the number of lines skipped
+ * @param[out] path    Buffer for the return path of the "From " line
+ * @param[in]  pathlen Length of the buffer
+ * @param[out] tp      Time of the "From " line
+ * @retval num Offset of the "From " line, or size if there isn't one
+ *
+ * Only lines beginning "From " are given to is_from(), so the body of a
+ * message is skipped by memmem() rather than read a line at a time.
+ */
+static LOFF_T mbox_find_from(const char *map, LOFF_T size, LOFF_T pos, int *lines,
+                             char *path, size_t pathlen, time_t *tp)
+{
+  char buf[HUGE_STRING];
+
+  while (pos < size)
+  {
+    LOFF_T from = size;
+
+    if ((size - pos >= 5) && (memcmp(map + pos, "From ", 5) == 0))
+      from = pos;
+    else
+    {
+      const char *p = memmem(map + pos, size - pos, "\nFrom ", 6);
+      if (p)
+        from = p - map + 1;
+    }
+
+    *lines += mbox_count_lines(map + pos, from - pos);
+    if (from == size)
+    {
+      /* A last line without a newline still counts */
+      if (map[size - 1] != '\n')
+        (*lines)++;
+      break;
+    }
+
+    const char *nl = memchr(map + from, '\n', size - from);
+    size_t len = nl ? (nl - (map + from) + 1) : (size - from);
+    size_t n = MIN(len, sizeof(buf) - 1);
+    memcpy(buf, map + from, n);
+    buf[n] = '\0';
+
+    if (is_from(buf, path, pathlen, tp))
+      return from;
+
+    /* Just a line of the body */
+    (*lines)++;
+    pos = from + len;
+  }
+
+  return size;
+}
+
+#ifdef USE_HCACHE
+/* Key of the record listing the cached messages of the mailbox */
+#define MBOX_INDEX_KEY "/MBOXINDEX"
+/* Key of the record identifying the compressed file the index was made from */
+#define MBOX_SOURCE_KEY "/MBOXSOURCE"
+
+/**
+ * mbox_hcache_hash - Fingerprint the header of a message
+ * @param map    Mailbox in memory
+ * @param offset Offset of the message's "From " line
+ * @param length Length of the message, up to the next "From " line
+ * @param hash   Buffer for the fingerprint, at least 33 bytes
+ *
+ * The "From " line and the header, up to the blank line, are hashed.  Syncing
+ * the mailbox rewrites the Status and Content-Length headers, so this notices
+ * a message that has changed, even if its length hasn't.
+ */
+static void mbox_hcache_hash(const char *map, LOFF_T offset, LOFF_T length, char *hash)
+{
+  unsigned char digest[16];
+  const char *end = memmem(map + offset, length, "\n\n", 2);
+  size_t len = end ? (end - (map + offset) + 2) : length;
+
+  mutt_md5_bytes(map + offset, len, digest);
+  mutt_md5_toascii(digest, hash);
+}
+
+/**
+ * mbox_hcache_keep - Is a cached record still wanted? - Implements ::hcache_keep_t
+ */
+static bool mbox_hcache_keep(const char *key, size_t keylen, void *data)
+{
+  /* The index */
+  if (*key == '/')
+    return true;
+
+  return mutt_hash_find(data, key) != NULL;
+}
+
+/**
+ * mbox_hcache_read - Restore the unchanged messages from the header cache
+ * @param[in]  ctx      Mailbox, with no messages yet
+ * @param[in]  hc       Header cache
+ * @param[in]  map      Mailbox in memory
+ * @param[in]  size     Size of the mailbox
+ * @param[in]  progress Progress bar, unless ctx->quiet
+ * @param[out] loc      Offset of the first message that still needs parsing
+ * @param[in]  source   Identity of the compressed file, "" if unknown, or NULL
+ * @param[out] indexed  Number of messages in the cached index
+ * @param[out] trusted  true if the index was made from the same source
+ * @retval num Number of messages restored
+ *
+ * The index lists the offset, length and header fingerprint of each message,
+ * in order.  As long as the file still matches, the messages are taken from
+ * the cache.  The first one that doesn't match, and everything after it, is
+ * left to be parsed, so a mailbox that has only been appended to only has its
+ * new messages parsed.
+ *
+ * A compressed mailbox is decompressed into a new file every time, but if the
+ * compressed file is the one the index was made from, so are the contents, and
+ * the fingerprints needn't be checked.
+ */
+static int mbox_hcache_read(struct Context *ctx, header_cache_t *hc, const char *map,
+                            LOFF_T size, struct Progress *progress, LOFF_T *loc,
+                            const char *source, int *indexed, bool *trusted)
+{
+  char return_path[STRING], hash[33], key[32];
+  time_t t;
+  int lines = 0, n = 0, max = 0, count = 0;
+  LOFF_T *offsets = NULL;
+  LOFF_T pos = mbox_find_from(map, size, 0, &lines, return_path, sizeof(return_path), &t);
+  bool valid = true;
+
+  *indexed = 0;
+  *trusted = false;
+  if (source && *source)
+  {
+    char *src = mutt_hcache_fetch_raw(hc, MBOX_SOURCE_KEY, sizeof(MBOX_SOURCE_KEY) - 1);
+    *trusted = src && (mutt_str_strcmp(src, source) == 0);
+    mutt_hcache_free(hc, (void **) &src);
+  }
+
+  char *data = mutt_hcache_fetch_raw(hc, MBOX_INDEX_KEY, sizeof(MBOX_INDEX_KEY) - 1);
+  if (!data)
+    return 0;
+
+  /* Each line is "offset length fingerprint" */
+  for (const char *p = data; *p;)
+  {
+    char *end = NULL;
+    LOFF_T offset = strtoll(p, &end, 10);
+    LOFF_T length = strtoll(end, &end, 10);
+    const char *nl = strchr(end, '\n');
+    if (!nl || (*end != ' ') || (nl - end - 1 != 32))
+    {
+      mutt_debug(1, "damaged index for %s\n", ctx->path);
+      break;
+    }
+    (*indexed)++;
+    p = nl + 1;
+
+    if (!valid)
+      continue;
+
+    if ((offset != pos) || (length <= 0) || (length > size - offset))
+      valid = false;
+    else if (!*trusted)
+    {
+      mbox_hcache_hash(map, offset, length, hash);
+      valid = (memcmp(hash, end + 1, 32) == 0);
+    }
+    if (!valid)
+      continue;
+
+    if (n == max)
+    {
+      max += 1024;
+      mutt_mem_realloc(&offsets, max * sizeof(LOFF_T));
+    }
+    offsets[n++] = offset;
+    pos = offset + length;
+  }
+  mutt_hcache_free(hc, (void **) &data);
+
+  /* Anything appended must start with a message.  If it doesn't, it belongs
+   * to the last cached message, which will have to be parsed again. */
+  if ((n > 0) && (pos < size) &&
+      (mbox_find_from(map, size, pos, &lines, return_path, sizeof(return_path), &t) != pos))
+  {
+    n--;
+    pos = offsets[n];
+  }
+
+  for (; count < n; count++)
+  {
+    snprintf(key, sizeof(key), OFF_T_FMT, offsets[count]);
+    void *hdata = mutt_hcache_fetch(hc, key, strlen(key));
+    if (!hdata)
+      break;
+
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory(ctx);
+
+    struct Header *h = mutt_hcache_restore((unsigned char *) hdata);
+    mutt_hcache_free(hc, &hdata);
+    h->index = ctx->msgcount;
+    ctx->hdrs[ctx->msgcount++] = h;
+
+    if (!ctx->quiet)
+      mutt_progress_update(progress, count + 1, (int) (offsets[count] / (ctx->size / 100 + 1)));
+  }
+
+  *loc = (count < n) ? offsets[count] : pos;
+  FREE(&offsets);
+
+  mutt_debug(2, "%s: %d of %d messages from the header cache\n", ctx->path,
+             count, *indexed);
+  return count;
+}
+
+/**
+ * mbox_hcache_write - Save the messages and the index to the header cache
+ * @param ctx     Mailbox, with all its messages read
+ * @param hc      Header cache
+ * @param map     Mailbox in memory
+ * @param size    Size of the mailbox
+ * @param first   Number of messages that came from the cache
+ * @param indexed Number of messages in the old index
+ * @param source  Identity of the compressed file, "" if unknown, or NULL
+ * @param trusted true if the index was made from the same source
+ *
+ * The messages that were parsed are stored under their offset.  If any
+ * messages of the old index weren't used, their records are pruned.
+ */
+static void mbox_hcache_write(struct Context *ctx, header_cache_t *hc, const char *map,
+                              LOFF_T size, int first, int indexed,
+                              const char *source, bool trusted)
+{
+  char hash[33];
+  int count = ctx->msgcount;
+
+  /* An empty source never matches, so the fingerprints will be checked */
+  if (source && !trusted)
+  {
+    mutt_hcache_store_raw(hc, MBOX_SOURCE_KEY, sizeof(MBOX_SOURCE_KEY) - 1,
+                          (void *) source, strlen(source) + 1);
+  }
+
+  if ((first == count) && (indexed == count))
+    return;
+
+  char *keybuf = mutt_mem_malloc(count * 32);
+  const char **keys = mutt_mem_calloc(count, sizeof(char *));
+  struct Buffer *index = mutt_buffer_alloc(count * 64 + 1);
+
+  for (int i = 0; i < count; i++)
+  {
+    LOFF_T offset = ctx->hdrs[i]->offset;
+    LOFF_T next = (i + 1 < count) ? ctx->hdrs[i + 1]->offset : size;
+
+    keys[i] = keybuf + i * 32;
+    snprintf(keybuf + i * 32, 32, OFF_T_FMT, offset);
+    mbox_hcache_hash(map, offset, next - offset, hash);
+    mutt_buffer_printf(index, OFF_T_FMT " " OFF_T_FMT " %s\n", offset, next - offset, hash);
+  }
+
+  mutt_hcache_store_many(hc, keys + first, count - first, ctx->hdrs + first, 0);
+  mutt_hcache_store_raw(hc, MBOX_INDEX_KEY, sizeof(MBOX_INDEX_KEY) - 1,
+                        index->data, index->dptr - index->data + 1);
+
+  if (first < indexed)
+  {
+    struct Hash *hash_keys = mutt_hash_create(MAX(6 * count / 5, 30), 0);
+    for (int i = 0; i < count; i++)
+      mutt_hash_insert(hash_keys, keys[i], ctx->hdrs[i]);
+    mutt_hcache_prune(hc, mbox_hcache_keep, hash_keys);
+    mutt_hash_destroy(&hash_keys);
+  }
+
+  mutt_buffer_free(&index);
+  FREE(&keys);
+  FREE(&keybuf);
+}
+#endif
+
+/**
+ * struct MboxLoad - A mapped mailbox being read
+ *
+ * A mailbox opened with #MUTT_PROGRESSIVE is read in batches of $read_batch
+ * messages, see mbox_open_more().  This is kept in ctx->data in between.
+ */
+struct MboxLoad
+{
+  char *map;                /**< Mailbox in memory */
+  LOFF_T size;              /**< Size of the mapping */
+  LOFF_T loc;               /**< Offset of the next message */
+  int count;                /**< Messages read so far, for the progress bar */
+  struct Progress progress; /**< Progress bar, unless ctx->quiet */
+#ifdef USE_HCACHE
+  header_cache_t *hc;       /**< Header cache, if the mailbox is read from the start */
+  int cached;               /**< Number of messages restored from the cache */
+  int indexed;              /**< Number of messages in the cached index */
+  bool trusted;             /**< The cached index was made from the same source */
+  char source[STRING];      /**< Identity of the compressed file */
+  const char *src;          /**< source, or NULL for a plain mbox */
+#endif
+};
+
+/**
+ * mbox_load_begin - Start reading the messages of a mapped mailbox
+ * @param ctx  Mailbox
+ * @param load Mapped mailbox, with ctx->fp positioned where to start
+ *
+ * If the whole mailbox is being read, as many messages as possible are taken
+ * from the header cache.
+ */
+static void mbox_load_begin(struct Context *ctx, struct MboxLoad *load)
+{
+  load->loc = ftello(ctx->fp);
+  if (load->loc < 0)
+    load->loc = load->size;
+
+#ifdef USE_HCACHE
+  const char *cache_path = ctx->path;
+
+#ifdef USE_COMPRESSED
+  /* The decompressed copy is temporary, so cache by the compressed file */
+  if (ctx->compress_info)
+  {
+    cache_path = ctx->realpath;
+    if (!mutt_comp_source(ctx, load->source, sizeof(load->source)))
+      load->source[0] = '\0';
+    load->src = load->source;
+  }
+#endif
+
+  /* The cache describes the whole file, so it's only used for the first read */
+  if ((load->loc == 0) && (ctx->msgcount == 0))
+  {
+    load->hc = mutt_hcache_open(HeaderCache, cache_path, NULL);
+    if (load->hc)
+    {
+      load->count = load->cached =
+          mbox_hcache_read(ctx, load->hc, load->map, load->size, &load->progress,
+                           &load->loc, load->src, &load->indexed, &load->trusted);
+    }
+  }
+#endif
+}
+
+/**
+ * mbox_load_step - Read the next messages of a mapped mailbox
+ * @param ctx   Mailbox
+ * @param load  Mapped mailbox
+ * @param limit Maximum number of messages to read, 0 for no limit
+ * @retval num Number of messages read
+ *
+ * This does the same as the loop in mbox_parse_mailbox(), but only the
+ * headers are read from ctx->fp.  The message separators are found in memory.
+ * Reading stops at a message separator, so load->loc is where to carry on.
+ */
+static int mbox_load_step(struct Context *ctx, struct MboxLoad *load, int limit)
+{
+  const char *map = load->map;
+  const LOFF_T size = load->size;
+  char return_path[STRING];
+  struct Header *curhdr = NULL;
+  time_t t;
+  int count = 0, lines = 0;
+  LOFF_T loc;
+
+  loc = mbox_find_from(map, size, load->loc, &lines, return_path, sizeof(return_path), &t);
+  while ((loc < size) && (SigInt != 1) && ((limit <= 0) || (count < limit)))
+  {
+    /* Save the Content-Length of the previous message */
+    if (curhdr)
+    {
+      if (curhdr->content->length < 0)
+      {
+        curhdr->content->length = loc - curhdr->content->offset - 1;
+        if (curhdr->content->length < 0)
+          curhdr->content->length = 0;
+      }
+      if (!curhdr->lines)
+        curhdr->lines = lines ? lines - 1 : 0;
+    }
+
+    count++;
+    load->count++;
+
+    const char *nl = memchr(map + loc, '\n', size - loc);
+    LOFF_T hdr = nl ? (nl - map + 1) : size;
+
+    if (!ctx->quiet)
+      mutt_progress_update(&load->progress, load->count, (int) (hdr / (ctx->size / 100 + 1)));
+
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory(ctx);
+
+    curhdr = ctx->hdrs[ctx->msgcount] = mutt_new_header();
+    curhdr->received = t - mutt_date_local_tz(t);
+    curhdr->offset = loc;
+    curhdr->index = ctx->msgcount;
+
+    if (fseeko(ctx->fp, hdr, SEEK_SET) != 0)
+      mutt_debug(1, "#1 fseek() failed\n");
+    curhdr->env = mutt_read_rfc822_header(ctx->fp, curhdr, 0, 0);
+    loc = ftello(ctx->fp);
+    if (loc < 0)
+      loc = size;
+
+    /* Check that the content-length leads to a message separator.  If it
+     * does, count the lines in the body if we don't know how many there are.
+     * The first test avoids an integer overflow if the content-length is huge
+     * (thus necessarily invalid).
+     */
+    if (curhdr->content->length > 0)
+    {
+      LOFF_T end = (curhdr->content->length < size) ?
+                       (loc + curhdr->content->length + 1) :
+                       -1;
+
+      if ((end == size) ||
+          ((end > 0) && (size - end >= 5) && (memcmp(map + end, "From ", 5) == 0)))
+      {
+        if (curhdr->lines == 0)
+          curhdr->lines = mbox_count_lines(map + loc, curhdr->content->length);
+        loc = end;
+      }
+      else
+      {
+        mutt_debug(1, "bad content-length in message %d (cl=" OFF_T_FMT ")\n",
+                   curhdr->index, curhdr->content->length);
+        curhdr->content->length = -1;
+      }
+    }
+
+    ctx->msgcount++;
+
+    if (!curhdr->env->return_path && return_path[0])
+      curhdr->env->return_path =
+          mutt_addr_parse_list(curhdr->env->return_path, return_path);
+
+    if (!curhdr->env->from)
+      curhdr->env->from = mutt_addr_copy_list(curhdr->env->return_path, false);
+
+    lines = 0;
+    loc = mbox_find_from(map, size, loc, &lines, return_path, sizeof(return_path), &t);
+  }
+
+  /* See the comment at the end of mbox_parse_mailbox() */
+  if (curhdr)
+  {
+    if (curhdr->content->length < 0)
+    {
+      curhdr->content->length = loc - curhdr->content->offset - 1;
+      if (curhdr->content->length < 0)
+        curhdr->content->length = 0;
+    }
+
+    if (!curhdr->lines)
+      curhdr->lines = lines ? lines - 1 : 0;
+  }
+
+  load->loc = loc;
+  if (fseeko(ctx->fp, loc, SEEK_SET) != 0)
+    mutt_debug(1, "#2 fseek() failed\n");
+
+  return count;
+}
+
+/**
+ * mbox_load_end - Finish reading a mapped mailbox
+ * @param ctx  Mailbox
+ * @param load Mapped mailbox
+ *
+ * If the whole mailbox was read, the header cache is brought up to date.
+ */
+static void mbox_load_end(struct Context *ctx, struct MboxLoad *load)
+{
+#ifdef USE_HCACHE
+  if (load->hc)
+  {
+    if ((load->loc == load->size) && (SigInt != 1))
+    {
+      mbox_hcache_write(ctx, load->hc, load->map, load->size, load->cached,
+                        load->indexed, load->src, load->trusted);
+    }
+    mutt_hcache_close(load->hc);
+    load->hc = NULL;
+  }
+#endif
+}
+
+/**
+ * mbox_load_free - Forget a mailbox that was being read in batches
+ * @param ctx Mailbox
+ */
+static void mbox_load_free(struct Context *ctx)
+{
+  struct MboxLoad *load = ctx->data;
+  if (!load)
+    return;
+
+#ifdef USE_HCACHE
+  if (load->hc)
+    mutt_hcache_close(load->hc);
+#endif
+  munmap(load->map, load->size);
+  FREE(&ctx->data);
+}
+#endif
+
 /**
  * mbox_parse_mailbox - Read a mailbox from disk
  *
@@ -259,7 +803,7 @@ static int mbox_parse_mailbox(struct Context *ctx)
   time_t t;
   int count = 0, lines = 0;
   LOFF_T loc;
-  struct Progress progress;
+  struct Progress progress = { 0 };
   char msgbuf[STRING];
 
   /* Save information about the folder at the time we opened it. */
@@ -282,6 +826,47 @@ static int mbox_parse_mailbox(struct Context *ctx)
     mutt_progress_init(&progress, msgbuf, MUTT_PROGRESS_MSG, ReadInc, 0);
   }
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  /* Search for the message separators in memory, if the file can be mapped */
+  if ((sb.st_size > 0) && ((uintmax_t) sb.st_size <= SIZE_MAX))
+  {
+    void *map = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fileno(ctx->fp), 0);
+    if (map != MAP_FAILED)
+    {
+#ifdef MADV_SEQUENTIAL
+      madvise(map, sb.st_size, MADV_SEQUENTIAL);
+#endif
+      struct MboxLoad *load = mutt_mem_calloc(1, sizeof(struct MboxLoad));
+      int oldmsgcount = ctx->msgcount;
+
+      load->map = map;
+      load->size = sb.st_size;
+      load->progress = progress;
+      mbox_load_begin(ctx, load);
+
+      /* The index shows the first batch, mbox_open_more() reads the rest */
+      mbox_load_step(ctx, load, ctx->loading ? ReadBatch : 0);
+      if (ctx->msgcount > oldmsgcount)
+        mx_update_context(ctx, ctx->msgcount - oldmsgcount);
+
+      if (ctx->loading && (load->loc < load->size) && (SigInt != 1))
+        ctx->data = load;
+      else
+      {
+        ctx->loading = false;
+        mbox_load_end(ctx, load);
+        munmap(map, sb.st_size);
+        FREE(&load);
+      }
+      goto done;
+    }
+    mutt_debug(1, "mmap() failed: %s (errno %d)\n", strerror(errno), errno);
+  }
+#endif
+
+  /* Only a mapped mailbox can be read in batches */
+  ctx->loading = false;
+
   loc = ftello(ctx->fp);
   while ((fgets(buf, sizeof(buf), ctx->fp) != NULL) && (SigInt != 1))
   {
@@ -404,35 +989,338 @@ static int mbox_parse_mailbox(struct Context *ctx)
     loc = ftello(ctx->fp);
   }
 
-  /*
-   * Only set the content-length of the previous message if we have read more
-   * than one message during _this_ invocation.  If this routine is called
-   * when new mail is received, we need to make sure not to clobber what
-   * previously was the last message since the headers may be sorted.
-   */
-  if (count > 0)
+  /*
+   * Only set the content-length of the previous message if we have read more
+   * than one message during _this_ invocation.  If this routine is called
+   * when new mail is received, we need to make sure not to clobber what
+   * previously was the last message since the headers may be sorted.
+   */
+  if (count > 0)
+  {
+    struct Header *h = ctx->hdrs[ctx->msgcount - 1];
+    if (h->content->length < 0)
+    {
+      h->content->length = ftello(ctx->fp) - h->content->offset - 1;
+      if (h->content->length < 0)
+        h->content->length = 0;
+    }
+
+    if (!h->lines)
+      h->lines = lines ? lines - 1 : 0;
+
+    mx_update_context(ctx, count);
+  }
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+done:
+#endif
+  if (SigInt == 1)
+  {
+    SigInt = 0;
+    return -2; /* action aborted */
+  }
+
+  return 0;
+}
+
+/* Start of the journal of an in-place sync */
+#define MBOX_JOURNAL_MAGIC "NMJRNL1"
+
+/**
+ * struct MboxJournal - Header of the journal of an in-place sync
+ *
+ * The journal is written next to the mailbox before any of it is overwritten,
+ * and removed once the sync is complete.  After the header come the
+ * rewritten messages, then the list of moves that make up the sync.
+ */
+struct MboxJournal
+{
+  char magic[8];       /**< MBOX_JOURNAL_MAGIC */
+  int64_t ino;         /**< Inode of the mailbox */
+  int64_t size;        /**< Size of the mailbox before the sync */
+  int64_t new_size;    /**< Size of the mailbox after the sync */
+  int64_t move_offset; /**< Offset of the moves in the journal */
+  uint32_t moves;      /**< Number of moves */
+  uint32_t done;       /**< Number of moves finished */
+  int64_t done_bytes;  /**< Bytes of the current move finished */
+};
+
+/**
+ * struct MboxMove - One step of an in-place sync
+ */
+struct MboxMove
+{
+  int64_t src; /**< Offset in the mailbox, or -1 - offset in the journal */
+  int64_t dst; /**< Offset in the mailbox */
+  int64_t len; /**< Number of bytes */
+};
+
+/**
+ * mbox_journal_path - Get the path of a mailbox's sync journal
+ * @param path   Path of the mailbox
+ * @param buf    Buffer for the path of the journal
+ * @param buflen Length of the buffer
+ *
+ * The journal lives next to the mailbox, as a hidden file, so that it's
+ * found again if NeoMutt dies during the sync.
+ */
+static void mbox_journal_path(const char *path, char *buf, size_t buflen)
+{
+  const char *name = strrchr(path, '/');
+
+  if (name)
+    snprintf(buf, buflen, "%.*s/.%s.journal", (int) (name - path), path, name + 1);
+  else
+    snprintf(buf, buflen, ".%s.journal", path);
+}
+
+/**
+ * mbox_copy_range - Copy bytes to an earlier part of the mailbox
+ * @param fd  Mailbox file
+ * @param src Offset to copy from
+ * @param dst Offset to copy to
+ * @param len Number of bytes, no more than src - dst
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int mbox_copy_range(int fd, LOFF_T src, LOFF_T dst, LOFF_T len)
+{
+#ifdef HAVE_COPY_FILE_RANGE
+  /* Let the kernel copy it, without going through user space */
+  while (len > 0)
+  {
+    loff_t in = src, out = dst;
+    ssize_t n = copy_file_range(fd, &in, fd, &out, len, 0);
+    if (n > 0)
+    {
+      src += n;
+      dst += n;
+      len -= n;
+    }
+    else if ((n < 0) && (errno == EINTR))
+      continue;
+    else if ((n < 0) && ((errno == EXDEV) || (errno == EINVAL) ||
+                         (errno == ENOSYS) || (errno == EOPNOTSUPP)))
+      break; /* not here, copy it by hand */
+    else
+      return -1;
+  }
+#endif
+
+  char buf[65536];
+
+  while (len > 0)
+  {
+    ssize_t n = pread(fd, buf, MIN(len, (LOFF_T) sizeof(buf)), src);
+    if ((n <= 0) || (pwrite(fd, buf, n, dst) != n))
+      return -1;
+    src += n;
+    dst += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+/**
+ * mbox_journal_run - Carry out the moves of an in-place sync
+ * @param fd    Mailbox file, locked
+ * @param jfd   Journal file
+ * @param jh    Journal header, recording the progress
+ * @param moves Moves to make
+ * @retval  0 Success, the mailbox has its new size
+ * @retval -1 Error
+ *
+ * A copy within the mailbox is made in steps no bigger than the distance
+ * it's moving, so a step never overwrites its own source.  The progress is
+ * recorded in the journal after each step, so if NeoMutt dies, the sync can
+ * carry on from the last step recorded: its source is still intact.
+ */
+static int mbox_journal_run(int fd, int jfd, struct MboxJournal *jh,
+                            const struct MboxMove *moves)
+{
+  char buf[65536];
+
+  while (jh->done < jh->moves)
+  {
+    const struct MboxMove *m = &moves[jh->done];
+
+    if (m->src >= 0)
+    {
+      if (m->src < m->dst)
+        return -1;
+
+      while ((m->src != m->dst) && (jh->done_bytes < m->len))
+      {
+        LOFF_T step = MIN(m->len - jh->done_bytes, m->src - m->dst);
+        step = MIN(step, 16 * 1024 * 1024);
+        if (mbox_copy_range(fd, m->src + jh->done_bytes, m->dst + jh->done_bytes, step) != 0)
+          return -1;
+        jh->done_bytes += step;
+        if (pwrite(jfd, jh, sizeof(*jh), 0) != sizeof(*jh))
+          return -1;
+      }
+    }
+    else
+    {
+      /* A rewritten message.  Its source is the journal, so the whole move
+       * can be repeated. */
+      for (LOFF_T pos = 0; pos < m->len;)
+      {
+        ssize_t n = pread(jfd, buf, MIN(m->len - pos, (LOFF_T) sizeof(buf)), -1 - m->src + pos);
+        if ((n <= 0) || (pwrite(fd, buf, n, m->dst + pos) != n))
+          return -1;
+        pos += n;
+      }
+    }
+
+    jh->done++;
+    jh->done_bytes = 0;
+    if (pwrite(jfd, jh, sizeof(*jh), 0) != sizeof(*jh))
+      return -1;
+  }
+
+  if ((ftruncate(fd, jh->new_size) != 0) || (fsync(fd) != 0))
+    return -1;
+
+  return 0;
+}
+
+/**
+ * mbox_journal_adopt - Add mail delivered since a sync was interrupted
+ * @param jfd   Journal file
+ * @param jh    Journal header
+ * @param moves Moves of the sync, with room for one more
+ * @param end   Size of the mailbox now
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * The new mail follows the old end of the mailbox.  One more move takes it to
+ * the new end, so that finishing the sync doesn't cut it off.
+ */
+static int mbox_journal_adopt(int jfd, struct MboxJournal *jh,
+                              struct MboxMove *moves, LOFF_T end)
+{
+  struct MboxMove *m = &moves[jh->moves];
+
+  m->src = jh->size;
+  m->dst = jh->new_size;
+  m->len = end - jh->size;
+
+  /* The move is on disk before the header that counts it */
+  if ((pwrite(jfd, m, sizeof(*m), jh->move_offset + jh->moves * sizeof(*m)) != sizeof(*m)) ||
+      (fsync(jfd) != 0))
+  {
+    return -1;
+  }
+
+  jh->moves++;
+  jh->size = end;
+  jh->new_size += m->len;
+  if ((pwrite(jfd, jh, sizeof(*jh), 0) != sizeof(*jh)) || (fsync(jfd) != 0))
+    return -1;
+
+  return 0;
+}
+
+/**
+ * mbox_journal_recover - Finish a sync that was interrupted
+ * @param ctx Mailbox, not open yet
+ * @retval  0 Success, or there was nothing to do
+ * @retval -1 The mailbox mustn't be used until the journal is dealt with
+ *
+ * If NeoMutt died during an in-place sync, its journal is still next to the
+ * mailbox.  Carry on from where the sync got to, before reading the mailbox.
+ *
+ * The mailbox is locked during a sync, so any mail delivered to it since
+ * came after the crash, and follows the old end of the mailbox.  The
+ * mailbox is only truncated once every move is done, so until then, the
+ * new mail can be told apart.
+ */
+static int mbox_journal_recover(struct Context *ctx)
+{
+  char journal[_POSIX_PATH_MAX];
+  struct MboxJournal jh;
+  struct MboxMove *moves = NULL;
+  struct stat st;
+  int rc = -1;
+
+  mbox_journal_path(ctx->path, journal, sizeof(journal));
+  int jfd = open(journal, O_RDWR);
+  if (jfd == -1)
+    return 0;
+
+  int fd = open(ctx->path, O_RDWR);
+  if ((fd == -1) || (mutt_file_lock(fd, 1, 1) != 0))
+  {
+    mutt_error(_("Can't finish the interrupted sync of %s"), ctx->path);
+    if (fd != -1)
+      close(fd);
+    close(jfd);
+    return -1;
+  }
+
+  /* The magic is written last, so without it, the mailbox wasn't touched */
+  if ((read(jfd, &jh, sizeof(jh)) != sizeof(jh)) ||
+      (memcmp(jh.magic, MBOX_JOURNAL_MAGIC, sizeof(jh.magic)) != 0))
+  {
+    mutt_debug(1, "removing the unfinished journal %s\n", journal);
+    unlink(journal);
+    rc = 0;
+    goto done;
+  }
+
+  if ((fstat(fd, &st) != 0) || (st.st_ino != (ino_t) jh.ino) || (jh.done > jh.moves))
+  {
+    mutt_error(_("%s doesn't belong to %s, ignoring it"), journal, ctx->path);
+    rc = 0;
+    goto done;
+  }
+
+  if ((jh.done == jh.moves) && (st.st_size == jh.new_size))
+  {
+    /* Only the journal was left to remove */
+    unlink(journal);
+    rc = 0;
+    goto done;
+  }
+
+  if ((st.st_size < jh.size) ||
+      ((st.st_size > jh.size) && ((jh.done == jh.moves) || (jh.new_size > jh.size))))
   {
-    struct Header *h = ctx->hdrs[ctx->msgcount - 1];
-    if (h->content->length < 0)
-    {
-      h->content->length = ftello(ctx->fp) - h->content->offset - 1;
-      if (h->content->length < 0)
-        h->content->length = 0;
-    }
-
-    if (!h->lines)
-      h->lines = lines ? lines - 1 : 0;
+    mutt_debug(1, "%s is %lld bytes, the journal expects %lld\n", ctx->path,
+               (long long) st.st_size, (long long) jh.size);
+    mutt_error(_("%s has changed since its sync was interrupted, see %s"),
+               ctx->path, journal);
+    goto done;
+  }
 
-    mx_update_context(ctx, count);
+  moves = mutt_mem_calloc(jh.moves + 1, sizeof(struct MboxMove));
+  ssize_t len = jh.moves * sizeof(struct MboxMove);
+  if (pread(jfd, moves, len, jh.move_offset) != len)
+  {
+    mutt_error(_("%s doesn't belong to %s, ignoring it"), journal, ctx->path);
+    rc = 0;
+    goto done;
   }
 
-  if (SigInt == 1)
+  if (((st.st_size > jh.size) && (mbox_journal_adopt(jfd, &jh, moves, st.st_size) != 0)) ||
+      (mbox_journal_run(fd, jfd, &jh, moves) != 0))
   {
-    SigInt = 0;
-    return -2; /* action aborted */
+    mutt_perror(ctx->path);
+    goto done;
   }
 
-  return 0;
+  unlink(journal);
+  mutt_message(_("Finished the interrupted sync of %s"), ctx->path);
+  rc = 0;
+
+done:
+  FREE(&moves);
+  mutt_file_unlock(fd);
+  close(fd);
+  close(jfd);
+  return rc;
 }
 
 /**
@@ -440,8 +1328,12 @@ static int mbox_parse_mailbox(struct Context *ctx)
  */
 static int mbox_open_mailbox(struct Context *ctx)
 {
+  struct PerfTimer perf;
   int rc;
 
+  if ((ctx->magic == MUTT_MBOX) && (mbox_journal_recover(ctx) != 0))
+    return -1;
+
   ctx->fp = fopen(ctx->path, "r");
   if (!ctx->fp)
   {
@@ -455,12 +1347,14 @@ static int mbox_open_mailbox(struct Context *ctx)
     return -1;
   }
 
+  mutt_perf_start(&perf, PERF_PARSE);
   if (ctx->magic == MUTT_MBOX)
     rc = mbox_parse_mailbox(ctx);
   else if (ctx->magic == MUTT_MMDF)
     rc = mmdf_parse_mailbox(ctx);
   else
     rc = -1;
+  mutt_perf_stop(&perf);
   mutt_file_touch_atime(fileno(ctx->fp));
 
   mbox_unlock_mailbox(ctx);
@@ -468,8 +1362,116 @@ static int mbox_open_mailbox(struct Context *ctx)
   return rc;
 }
 
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+static int reopen_mailbox(struct Context *ctx, int *index_hint);
+
+/**
+ * mbox_load_changed - Has the mailbox changed while it was being read?
+ * @param ctx Mailbox, locked
+ * @retval true The mailbox has changed, other than by new mail
+ *
+ * The mailbox is unlocked between batches.  New mail is picked up once the
+ * mailbox has been read, but any other change invalidates the mapping.
+ */
+static bool mbox_load_changed(struct Context *ctx)
+{
+  struct stat st, fst;
+  char buf[LONG_STRING];
+
+  if ((stat(ctx->path, &st) != 0) || (fstat(fileno(ctx->fp), &fst) != 0) ||
+      (st.st_ino != fst.st_ino) || (st.st_dev != fst.st_dev))
+  {
+    return true;
+  }
+
+  if ((st.st_mtime == ctx->mtime) && (st.st_size == ctx->size))
+    return false;
+
+  if (st.st_size <= ctx->size)
+    return true;
+
+  /* New mail starts exactly where the mailbox used to end */
+  if ((fseeko(ctx->fp, ctx->size, SEEK_SET) != 0) || !fgets(buf, sizeof(buf), ctx->fp))
+    return true;
+  if (ctx->magic == MUTT_MBOX)
+    return (mutt_str_strncmp("From ", buf, 5) != 0);
+  return (mutt_str_strcmp(MMDF_SEP, buf) != 0);
+}
+#endif
+
+/**
+ * mbox_open_more - Read the next batch of messages - Implements MxOps::open_more()
+ * @retval #MUTT_REOPENED The mailbox changed, so it has been read again
+ */
+static int mbox_open_more(struct Context *ctx)
+{
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  struct MboxLoad *load = ctx->data;
+  struct PerfTimer perf;
+  int oldmsgcount = ctx->msgcount;
+
+  if (!load)
+  {
+    ctx->loading = false;
+    return 0;
+  }
+
+  mutt_sig_block();
+  if (mbox_lock_mailbox(ctx, 0, 1) == -1)
+  {
+    mutt_sig_unblock();
+    return -1;
+  }
+
+  if (mbox_load_changed(ctx))
+  {
+    mutt_debug(1, "%s changed while it was being read\n", ctx->path);
+    mbox_load_free(ctx);
+    ctx->loading = false;
+    int rc = reopen_mailbox(ctx, NULL);
+    mbox_unlock_mailbox(ctx);
+    mutt_sig_unblock();
+    return (rc == -1) ? -1 : MUTT_REOPENED;
+  }
+
+  if (fseeko(ctx->fp, load->loc, SEEK_SET) != 0)
+    mutt_debug(1, "fseek() failed\n");
+  mutt_perf_start(&perf, PERF_PARSE);
+  mbox_load_step(ctx, load, ReadBatch);
+  mutt_perf_stop(&perf);
+
+  mbox_unlock_mailbox(ctx);
+  mutt_sig_unblock();
+
+  if (ctx->msgcount > oldmsgcount)
+    mx_update_context(ctx, ctx->msgcount - oldmsgcount);
+
+  if (SigInt == 1)
+  {
+    SigInt = 0;
+    return -2;
+  }
+
+  if (load->loc >= load->size)
+  {
+    mbox_load_end(ctx, load);
+    mbox_load_free(ctx);
+    ctx->loading = false;
+  }
+#else
+  ctx->loading = false;
+#endif
+  return 0;
+}
+
 static int mbox_open_mailbox_append(struct Context *ctx, int flags)
 {
+  if ((ctx->magic == MUTT_MBOX) && !(flags & MUTT_NEWFOLDER) &&
+      (mbox_journal_recover(ctx) != 0))
+  {
+    return -1;
+  }
+
   ctx->fp = mutt_file_fopen(ctx->path, flags & MUTT_NEWFOLDER ? "w" : "a");
   if (!ctx->fp)
   {
@@ -491,6 +1493,11 @@ static int mbox_open_mailbox_append(struct Context *ctx, int flags)
 
 static int mbox_close_mailbox(struct Context *ctx)
 {
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  mbox_load_free(ctx);
+#endif
+  ctx->loading = false;
+
   if (!ctx->fp)
   {
     return 0;
@@ -592,6 +1599,22 @@ int mbox_strict_cmp_headers(const struct Header *h1, const struct Header *h2)
   }
 }
 
+/**
+ * reopen_key - Build the key used to match a message after a reopen
+ * @param h      Header
+ * @param buf    Buffer for the key
+ * @param buflen Length of the buffer
+ *
+ * The key is made of fields that mbox_strict_cmp_headers() compares, so
+ * headers that compare equal always have the same key.
+ */
+static void reopen_key(const struct Header *h, char *buf, size_t buflen)
+{
+  snprintf(buf, buflen, "%ld " OFF_T_FMT " %d %s %s", (long) h->received,
+           h->content->length, h->lines, NONULL(h->env->message_id),
+           NONULL(h->env->subject));
+}
+
 static int reopen_mailbox(struct Context *ctx, int *index_hint)
 {
   int (*cmp_headers)(const struct Header *, const struct Header *) = NULL;
@@ -694,41 +1717,44 @@ static int reopen_mailbox(struct Context *ctx, int *index_hint)
 
   if (!ctx->readonly)
   {
+    char key[LONG_STRING];
+
+    /* Only headers with the same key can match, so look them up in a hash
+     * instead of comparing every pair */
+    struct Hash *old_hash = mutt_hash_create(MAX(6 * old_msgcount / 5, 30),
+                                             MUTT_HASH_STRDUP_KEYS | MUTT_HASH_ALLOW_DUPS);
+    for (j = 0; j < old_msgcount; j++)
+    {
+      reopen_key(old_hdrs[j], key, sizeof(key));
+      mutt_hash_insert(old_hash, key, &old_hdrs[j]);
+    }
+
     for (i = 0; i < ctx->msgcount; i++)
     {
-      bool found = false;
+      int found = -1;
 
       /* some messages have been deleted, and new  messages have been
        * appended at the end; the heuristic is that old messages have then
-       * "advanced" towards the beginning of the folder, so we begin the
-       * search at index "i"
+       * "advanced" towards the beginning of the folder, so the first match
+       * at index "i" or later is preferred
        */
-      for (j = i; j < old_msgcount; j++)
+      reopen_key(ctx->hdrs[i], key, sizeof(key));
+      for (struct HashElem *he = mutt_hash_find_bucket(old_hash, key); he; he = he->next)
       {
-        if (!old_hdrs[j])
+        struct Header **slot = he->data;
+        j = slot - old_hdrs;
+        if (!*slot || (mutt_str_strcmp(key, he->key.strkey) != 0))
           continue;
-        if (cmp_headers(ctx->hdrs[i], old_hdrs[j]))
-        {
-          found = true;
-          break;
-        }
-      }
-      if (!found)
-      {
-        for (j = 0; j < i && j < old_msgcount; j++)
-        {
-          if (!old_hdrs[j])
-            continue;
-          if (cmp_headers(ctx->hdrs[i], old_hdrs[j]))
-          {
-            found = true;
-            break;
-          }
-        }
+        /* Is this a better candidate than the one found so far? */
+        if ((found >= 0) && (((j >= i) == (found >= i)) ? (j > found) : (j < i)))
+          continue;
+        if (cmp_headers(ctx->hdrs[i], *slot))
+          found = j;
       }
 
-      if (found)
+      if (found >= 0)
       {
+        j = found;
         /* this is best done here */
         if (!index_hint_set && *index_hint == j)
           *index_hint = i;
@@ -748,10 +1774,16 @@ static int reopen_mailbox(struct Context *ctx, int *index_hint)
         mutt_set_flag(ctx, ctx->hdrs[i], MUTT_PURGE, old_hdrs[j]->purge);
         mutt_set_flag(ctx, ctx->hdrs[i], MUTT_TAG, old_hdrs[j]->tagged);
 
+        /* the same message keeps its limit verdict */
+        ctx->hdrs[i]->limited = old_hdrs[j]->limited;
+        ctx->hdrs[i]->limit_valid = old_hdrs[j]->limit_valid;
+        ctx->hdrs[i]->limit_flags = old_hdrs[j]->limit_flags;
+
         /* we don't need this header any more */
         mutt_free_header(&(old_hdrs[j]));
       }
     }
+    mutt_hash_destroy(&old_hash);
 
     /* free the remaining old headers */
     for (j = 0; j < old_msgcount; j++)
@@ -770,6 +1802,42 @@ static int reopen_mailbox(struct Context *ctx, int *index_hint)
   return ((ctx->changed || msg_mod) ? MUTT_REOPENED : MUTT_NEW_MAIL);
 }
 
+/**
+ * mbox_offsets_valid - Do the messages still start where they did?
+ * @param ctx Mailbox
+ * @retval true Every message still starts with a "From " line
+ *
+ * Before only the appended messages are parsed, make sure the rest of the
+ * file hasn't been rewritten.  Without mmap() this can't be done cheaply, so
+ * the check passes.
+ */
+static bool mbox_offsets_valid(struct Context *ctx)
+{
+  bool valid = true;
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H)
+  if ((ctx->size <= 0) || ((uintmax_t) ctx->size > SIZE_MAX))
+    return true;
+
+  void *map = mmap(NULL, ctx->size, PROT_READ, MAP_PRIVATE, fileno(ctx->fp), 0);
+  if (map == MAP_FAILED)
+    return true;
+
+  for (int i = 0; valid && (i < ctx->msgcount); i++)
+  {
+    LOFF_T offset = ctx->hdrs[i]->offset;
+    valid = (offset >= 0) && (ctx->size - offset >= 5) &&
+            (memcmp((char *) map + offset, "From ", 5) == 0);
+  }
+  munmap(map, ctx->size);
+
+  if (!valid)
+    mutt_debug(1, "%s has been rewritten\n", ctx->path);
+#endif
+
+  return valid;
+}
+
 /**
  * mbox_check_mailbox - Has mailbox changed on disk
  * @param[in]  ctx        Context
@@ -827,7 +1895,8 @@ static int mbox_check_mailbox(struct Context *ctx, int *index_hint)
         mutt_debug(1, "#1 fseek() failed\n");
       if (fgets(buffer, sizeof(buffer), ctx->fp) != NULL)
       {
-        if ((ctx->magic == MUTT_MBOX && (mutt_str_strncmp("From ", buffer, 5) == 0)) ||
+        if ((ctx->magic == MUTT_MBOX && (mutt_str_strncmp("From ", buffer, 5) == 0) &&
+             mbox_offsets_valid(ctx)) ||
             (ctx->magic == MUTT_MMDF && (mutt_str_strcmp(MMDF_SEP, buffer) == 0)))
         {
           if (fseeko(ctx->fp, ctx->size, SEEK_SET) != 0)
@@ -932,6 +2001,217 @@ void mbox_reset_atime(struct Context *ctx, struct stat *st)
   utime(ctx->path, &utimebuf);
 }
 
+/**
+ * mbox_sync_in_place - Rewrite the changed part of a mailbox in place
+ * @param ctx        Mailbox, locked for writing
+ * @param first      Index of the first changed message
+ * @param new_offset Filled in with the new offsets of the messages
+ * @param old_offset Old offsets of the messages
+ * @param progress   Progress bar, unless ctx->quiet
+ * @retval  0 Success
+ * @retval  1 Not possible, nothing has been changed
+ * @retval -1 Error, the journal will finish the sync when the mailbox is opened
+ *
+ * Usually, every message after the first change is copied to a temporary
+ * file and back.  Here, the messages that haven't changed are moved within
+ * the mailbox instead, and only the changed ones are written out, to the
+ * journal.  The moves all go towards the start of the file, so nothing is
+ * overwritten before it has been moved.  If a changed message grows too much
+ * for that, the usual rewrite has to be used.
+ */
+static int mbox_sync_in_place(struct Context *ctx, int first, struct MUpdate *new_offset,
+                              const struct MUpdate *old_offset, struct Progress *progress)
+{
+  char journal[_POSIX_PATH_MAX];
+  struct MboxJournal jh = { { 0 } };
+  struct MboxMove *moves = NULL;
+  size_t nmoves = 0, maxmoves = 0;
+  LOFF_T size = ctx->size, vsize = ctx->vsize;
+  LOFF_T dst = ctx->hdrs[first]->offset;
+  struct stat st;
+  FILE *jfp = NULL;
+  int fd = fileno(ctx->fp);
+  int rc = 1;
+
+  /* mutt_copy_message_ctx() clears these, so keep them in case the usual
+   * rewrite is needed after all */
+  bool *attach_del = mutt_mem_calloc(ctx->msgcount - first, sizeof(bool));
+  bool *xlabel_changed = mutt_mem_calloc(ctx->msgcount - first, sizeof(bool));
+
+  mbox_journal_path(ctx->path, journal, sizeof(journal));
+  int jfd = open(journal, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if ((jfd == -1) || (fstat(fd, &st) != 0) || !(jfp = fdopen(jfd, "w+")))
+  {
+    mutt_debug(1, "can't create %s: %s\n", journal, strerror(errno));
+    if (jfd != -1)
+    {
+      close(jfd);
+      unlink(journal);
+    }
+    goto done;
+  }
+  jh.ino = st.st_ino;
+
+  /* Leave room for the header, which is written last */
+  if (fwrite(&jh, sizeof(jh), 1, jfp) != 1)
+    goto restore;
+
+  for (int i = first; i < ctx->msgcount; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+    LOFF_T src = h->offset;
+    LOFF_T end = (i + 1 < ctx->msgcount) ? ctx->hdrs[i + 1]->offset : ctx->size;
+    struct MboxMove m = { src, dst, end - src };
+
+    if (!ctx->quiet)
+      mutt_progress_update(progress, i, (int) (src / (ctx->size / 100 + 1)));
+
+    if (h->deleted)
+      continue;
+
+    if (!h->changed && !h->attach_del)
+    {
+      /* The message can be moved as it is */
+      new_offset[i - first].hdr = dst;
+      new_offset[i - first].body = h->content->offset - src + dst;
+      dst += m.len;
+
+      struct MboxMove *prev = nmoves ? &moves[nmoves - 1] : NULL;
+      if (prev && (prev->src >= 0) && (prev->src + prev->len == src) &&
+          (prev->dst + prev->len == m.dst))
+      {
+        prev->len += m.len;
+        continue;
+      }
+    }
+    else
+    {
+      LOFF_T start = ftello(jfp);
+
+      attach_del[i - first] = h->attach_del;
+      xlabel_changed[i - first] = h->xlabel_changed;
+      if ((mutt_copy_message_ctx(jfp, ctx, h, MUTT_CM_UPDATE,
+                                 CH_FROM | CH_UPDATE | CH_UPDATE_LEN) != 0) ||
+          (fputs("\n", jfp) == EOF))
+      {
+        mutt_perror(journal);
+        goto restore;
+      }
+
+      m.src = -1 - start;
+      m.len = ftello(jfp) - start;
+      new_offset[i - first].hdr = dst;
+      new_offset[i - first].body = dst + m.len - 1 - h->content->length;
+      dst += m.len;
+
+      /* It mustn't overwrite the next message before that has been moved, nor
+       * grow the mailbox: anything past the old end is new mail */
+      if (dst > end)
+      {
+        mutt_debug(1, "message %d has grown too much to sync in place\n", i);
+        goto restore;
+      }
+    }
+
+    if (nmoves == maxmoves)
+    {
+      maxmoves += 64;
+      mutt_mem_realloc(&moves, maxmoves * sizeof(struct MboxMove));
+    }
+    moves[nmoves++] = m;
+  }
+
+  jh.size = ctx->size;
+  jh.new_size = dst;
+  jh.move_offset = ftello(jfp);
+  jh.moves = nmoves;
+  if ((fwrite(moves, sizeof(struct MboxMove), nmoves, jfp) != nmoves) ||
+      (fflush(jfp) != 0) || (fsync(jfd) != 0))
+  {
+    mutt_perror(journal);
+    goto restore;
+  }
+
+  /* Only a journal with its magic is used to recover, so write that once the
+   * rest is safely on disk */
+  memcpy(jh.magic, MBOX_JOURNAL_MAGIC, sizeof(jh.magic));
+  if ((fseeko(jfp, 0, SEEK_SET) != 0) || (fwrite(&jh, sizeof(jh), 1, jfp) != 1) ||
+      (fflush(jfp) != 0) || (fsync(jfd) != 0))
+  {
+    mutt_perror(journal);
+    goto restore;
+  }
+
+  /* From here on, the mailbox is being overwritten */
+  if (!ctx->quiet)
+    mutt_message(_("Committing changes..."));
+  if (mbox_journal_run(fd, jfd, &jh, moves) != 0)
+  {
+    mutt_perror(ctx->path);
+    rc = -1;
+    goto done;
+  }
+
+  mutt_debug(2, "%s: synced in place with %zu moves\n", ctx->path, nmoves);
+  ctx->size = jh.new_size;
+  /* The offsets of the parts are out of date, so they'll be parsed again */
+  for (int i = first; i < ctx->msgcount; i++)
+    mutt_free_body(&ctx->hdrs[i]->content->parts);
+  mutt_file_fclose(&jfp);
+  unlink(journal);
+  rc = 0;
+  goto done;
+
+restore:
+  /* Undo what mutt_copy_message_ctx() changed */
+  for (int i = first; i < ctx->msgcount; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+    if (h->deleted || (!h->changed && !attach_del[i - first]))
+      continue;
+    h->attach_del = attach_del[i - first];
+    h->xlabel_changed = xlabel_changed[i - first];
+    h->lines = old_offset[i - first].lines;
+    h->content->offset = old_offset[i - first].body;
+    h->content->length = old_offset[i - first].length;
+  }
+  ctx->size = size;
+  ctx->vsize = vsize;
+  mutt_file_fclose(&jfp);
+  unlink(journal);
+
+done:
+  mutt_file_fclose(&jfp);
+  FREE(&moves);
+  FREE(&attach_del);
+  FREE(&xlabel_changed);
+  return rc;
+}
+
+/**
+ * mbox_at_message - Check that a message starts where it should
+ * @param ctx    Mailbox
+ * @param offset Offset of the message, including any MMDF_SEP
+ * @retval true The mailbox looks ok
+ */
+static bool mbox_at_message(struct Context *ctx, LOFF_T offset)
+{
+  char buf[32] = "";
+
+  if (fseeko(ctx->fp, offset, SEEK_SET) != 0 || /* seek the append location */
+      /* do a sanity check to make sure the mailbox looks ok */
+      fgets(buf, sizeof(buf), ctx->fp) == NULL ||
+      (ctx->magic == MUTT_MBOX && (mutt_str_strncmp("From ", buf, 5) != 0)) ||
+      (ctx->magic == MUTT_MMDF && (mutt_str_strcmp(MMDF_SEP, buf) != 0)))
+  {
+    mutt_debug(1, "message not in expected position.\n");
+    mutt_debug(1, "\tLINE: %s\n", buf);
+    return false;
+  }
+
+  return true;
+}
+
 /**
  * mbox_sync_mailbox - Sync a mailbox to disk
  * @retval  0 Success
@@ -939,8 +2219,7 @@ void mbox_reset_atime(struct Context *ctx, struct stat *st)
  */
 static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
 {
-  char tempfile[_POSIX_PATH_MAX];
-  char buf[32];
+  char tempfile[_POSIX_PATH_MAX] = "";
   int i, j, save_sort = SORT_ORDER;
   int rc = -1;
   int need_sort = 0; /* flag to resort mailbox if new mail arrives */
@@ -999,21 +2278,6 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
     return -1;
   }
 
-  /* Create a temporary file to write the new version of the mailbox in. */
-  mutt_mktemp(tempfile, sizeof(tempfile));
-  i = open(tempfile, O_WRONLY | O_EXCL | O_CREAT, 0600);
-  if ((i == -1) || (fp = fdopen(i, "w")) == NULL)
-  {
-    if (-1 != i)
-    {
-      close(i);
-      unlink(tempfile);
-    }
-    mutt_error(_("Could not create temporary file!"));
-    mutt_sleep(5);
-    goto bail;
-  }
-
   /* find the first deleted/changed message.  we save a lot of time by only
    * rewriting the mailbox from the point where it has actually changed.
    */
@@ -1031,7 +2295,6 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
         _("sync: mbox modified, but no modified messages! (report this bug)"));
     mutt_sleep(5); /* the mutt_error /will/ get cleared! */
     mutt_debug(1, "no modified messages.\n");
-    unlink(tempfile);
     goto bail;
   }
 
@@ -1056,20 +2319,69 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
     mutt_progress_init(&progress, msgbuf, MUTT_PROGRESS_MSG, WriteInc, ctx->msgcount);
   }
 
-  for (i = first, j = 0; i < ctx->msgcount; i++)
+  /* back up some information which is needed to restore offsets when
+   * something fails.
+   */
+  for (i = first; i < ctx->msgcount; i++)
   {
-    if (!ctx->quiet)
-      mutt_progress_update(&progress, i, (int) (ftello(ctx->fp) / (ctx->size / 100 + 1)));
-    /*
-     * back up some information which is needed to restore offsets when
-     * something fails.
-     */
-
     old_offset[i - first].valid = 1;
     old_offset[i - first].hdr = ctx->hdrs[i]->offset;
     old_offset[i - first].body = ctx->hdrs[i]->content->offset;
     old_offset[i - first].lines = ctx->hdrs[i]->lines;
     old_offset[i - first].length = ctx->hdrs[i]->content->length;
+  }
+
+  /* If the first message isn't where it should be, the usual rewrite will
+   * notice, and keep a copy of the new mailbox */
+  if (MboxSyncInPlace && (ctx->magic == MUTT_MBOX) && mbox_at_message(ctx, offset))
+  {
+    if (stat(ctx->path, &statbuf) == -1)
+    {
+      mutt_perror(ctx->path);
+      mutt_sleep(5);
+      goto bail;
+    }
+
+    i = mbox_sync_in_place(ctx, first, new_offset, old_offset, &progress);
+    if (i == 0)
+    {
+      mbox_unlock_mailbox(ctx);
+      mutt_file_fclose(&ctx->fp);
+      goto written;
+    }
+    else if (i < 0)
+    {
+      mbox_unlock_mailbox(ctx);
+      mutt_sig_unblock();
+      mx_fastclose_mailbox(ctx);
+      mutt_error(_("Write failed!  The mailbox will be repaired when it's next opened"));
+      mutt_sleep(5);
+      FREE(&new_offset);
+      FREE(&old_offset);
+      return -1;
+    }
+    /* otherwise, rewrite it the usual way */
+  }
+
+  /* Create a temporary file to write the new version of the mailbox in. */
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  i = open(tempfile, O_WRONLY | O_EXCL | O_CREAT, 0600);
+  if ((i == -1) || (fp = fdopen(i, "w")) == NULL)
+  {
+    if (-1 != i)
+    {
+      close(i);
+      unlink(tempfile);
+    }
+    mutt_error(_("Could not create temporary file!"));
+    mutt_sleep(5);
+    goto bail;
+  }
+
+  for (i = first, j = 0; i < ctx->msgcount; i++)
+  {
+    if (!ctx->quiet)
+      mutt_progress_update(&progress, i, (int) (ftello(ctx->fp) / (ctx->size / 100 + 1)));
 
     if (!ctx->hdrs[i]->deleted)
     {
@@ -1166,16 +2478,8 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
     return -1;
   }
 
-  if (fseeko(ctx->fp, offset, SEEK_SET) != 0 || /* seek the append location */
-      /* do a sanity check to make sure the mailbox looks ok */
-      fgets(buf, sizeof(buf), ctx->fp) == NULL ||
-      (ctx->magic == MUTT_MBOX && (mutt_str_strncmp("From ", buf, 5) != 0)) ||
-      (ctx->magic == MUTT_MMDF && (mutt_str_strcmp(MMDF_SEP, buf) != 0)))
-  {
-    mutt_debug(1, "message not in expected position.\n");
-    mutt_debug(1, "\tLINE: %s\n", buf);
+  if (!mbox_at_message(ctx, offset))
     i = -1;
-  }
   else
   {
     if (fseeko(ctx->fp, offset, SEEK_SET) != 0) /* return to proper offset */
@@ -1231,6 +2535,7 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
     return -1;
   }
 
+written:
   /* Restore the previous access/modification times */
   mbox_reset_atime(ctx, &statbuf);
 
@@ -1238,7 +2543,8 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
   ctx->fp = fopen(ctx->path, "r");
   if (!ctx->fp)
   {
-    unlink(tempfile);
+    if (*tempfile)
+      unlink(tempfile);
     mutt_sig_unblock();
     mx_fastclose_mailbox(ctx);
     mutt_error(_("Fatal error!  Could not reopen mailbox!"));
@@ -1260,7 +2566,8 @@ static int mbox_sync_mailbox(struct Context *ctx, int *index_hint)
   }
   FREE(&new_offset);
   FREE(&old_offset);
-  unlink(tempfile); /* remove partial copy of the mailbox */
+  if (*tempfile)
+    unlink(tempfile); /* remove partial copy of the mailbox */
   mutt_sig_unblock();
 
   if (CheckMboxSize)
@@ -1314,6 +2621,7 @@ bail: /* Come here in case of disaster */
 
 struct MxOps mx_mbox_ops = {
   .open = mbox_open_mailbox,
+  .open_more = mbox_open_more,
   .open_append = mbox_open_mailbox_append,
   .close = mbox_close_mailbox,
   .open_msg = mbox_open_message,
@@ -1328,6 +2636,7 @@ struct MxOps mx_mbox_ops = {
 
 struct MxOps mx_mmdf_ops = {
   .open = mbox_open_mailbox,
+  .open_more = NULL,
   .open_append = mbox_open_mailbox_append,
   .close = mbox_close_mailbox,
   .open_msg = mbox_open_message,
@@ -37,6 +37,7 @@
 #include "opcodes.h"
 #include "options.h"
 #include "pattern.h"
+#include "perf.h"
 #include "protos.h"
 #include "tags.h"
 #ifdef USE_SIDEBAR
@@ -301,6 +302,7 @@ static void menu_pad_string(struct Menu *menu, char *buf, size_t buflen)
 
 void menu_redraw_full(struct Menu *menu)
 {
+  mutt_trace_begin("menu_redraw_full");
   mutt_reflow_windows();
   NORMAL_COLOR;
   /* clear() doesn't optimize screen redraws */
@@ -323,6 +325,7 @@ void menu_redraw_full(struct Menu *menu)
 #ifdef USE_SIDEBAR
   menu->redraw |= REDRAW_SIDEBAR;
 #endif
+  mutt_trace_end("menu_redraw_full");
 }
 
 void menu_redraw_status(struct Menu *menu)
@@ -351,6 +354,7 @@ void menu_redraw_index(struct Menu *menu)
   bool do_color;
   int attr;
 
+  mutt_trace_begin("menu_redraw_index");
   for (int i = menu->top; i < menu->top + menu->pagelen; i++)
   {
     if (i < menu->max)
@@ -389,6 +393,7 @@ void menu_redraw_index(struct Menu *menu)
   }
   NORMAL_COLOR;
   menu->redraw = 0;
+  mutt_trace_end("menu_redraw_index");
 }
 
 void menu_redraw_motion(struct Menu *menu)
@@ -402,6 +407,8 @@ void menu_redraw_motion(struct Menu *menu)
     return;
   }
 
+  mutt_trace_begin("menu_redraw_motion");
+
   /* Note: menu->color() for the index can end up retrieving a message
    * over imap (if matching against ~h for instance).  This can
    * generate status messages.  So we want to call it *before* we
@@ -444,11 +451,14 @@ void menu_redraw_motion(struct Menu *menu)
   }
   menu->redraw &= REDRAW_STATUS;
   NORMAL_COLOR;
+  mutt_trace_end("menu_redraw_motion");
 }
 
 void menu_redraw_current(struct Menu *menu)
 {
   char buf[LONG_STRING];
+
+  mutt_trace_begin("menu_redraw_current");
   int attr = menu->color(menu->current);
 
   mutt_window_move(menu->indexwin, menu->current + menu->offset - menu->top, 0);
@@ -468,6 +478,7 @@ void menu_redraw_current(struct Menu *menu)
     print_enriched_string(menu->current, attr, (unsigned char *) buf, 0);
   menu->redraw &= REDRAW_STATUS;
   NORMAL_COLOR;
+  mutt_trace_end("menu_redraw_current");
 }
 
 static void menu_redraw_prompt(struct Menu *menu)
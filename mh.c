@@ -43,6 +43,9 @@
 #include <time.h>
 #include <unistd.h>
 #include <utime.h>
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#endif
 #include "mutt/mutt.h"
 #include "mutt.h"
 #include "body.h"
@@ -56,6 +59,7 @@
 #include "mutt_curses.h"
 #include "mx.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "sort.h"
 #include "thread.h"
@@ -80,15 +84,6 @@ struct Maildir
   struct Maildir *next;
 };
 
-/**
- * struct MhSequences - Set of MH sequence numbers
- */
-struct MhSequences
-{
-  int max;
-  short *flags;
-};
-
 /**
  * struct MhData - MH-specific mailbox data
  */
@@ -103,47 +98,204 @@ struct MhData
 #define MH_SEQ_UNSEEN (1 << 0)
 #define MH_SEQ_REPLIED (1 << 1)
 #define MH_SEQ_FLAGGED (1 << 2)
+#define MH_SEQ_COUNT 3
+
+/**
+ * struct MhSeqRange - A run of consecutive message numbers
+ */
+struct MhSeqRange
+{
+  int first;
+  int last;
+};
+
+/**
+ * struct MhSequences - Set of MH sequence numbers
+ *
+ * Each sequence is a list of runs, so its size depends on how fragmented it is,
+ * not on the highest message number.  The runs are kept sorted and merged,
+ * except after adding one out of order, when they're tidied on the next lookup.
+ */
+struct MhSequences
+{
+  struct MhSeqRange *runs[MH_SEQ_COUNT]; /**< Runs of each sequence, by bit of MH_SEQ_* */
+  size_t count[MH_SEQ_COUNT];            /**< Number of runs */
+  size_t size[MH_SEQ_COUNT];             /**< Number of runs allocated */
+  bool unsorted[MH_SEQ_COUNT];           /**< Some runs are out of order */
+};
 
 static inline struct MhData *mh_data(struct Context *ctx)
 {
   return (struct MhData *) ctx->data;
 }
 
-static void mhs_alloc(struct MhSequences *mhs, int i)
+/**
+ * mhs_add - Add a run of messages to some sequences
+ * @param mhs   Sequences
+ * @param f     Sequences to add to, e.g. #MH_SEQ_UNSEEN
+ * @param first First message number
+ * @param last  Last message number
+ */
+static void mhs_add(struct MhSequences *mhs, short f, int first, int last)
 {
-  int j;
-  int newmax;
+  if (last < first)
+    return;
 
-  if (i > mhs->max || !mhs->flags)
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
   {
-    newmax = i + 128;
-    j = mhs->flags ? mhs->max + 1 : 0;
-    mutt_mem_realloc(&mhs->flags, sizeof(mhs->flags[0]) * (newmax + 1));
-    while (j <= newmax)
-      mhs->flags[j++] = 0;
+    if (!(f & (1 << s)))
+      continue;
 
-    mhs->max = newmax;
+    /* Usually, messages come in order, extending the last run */
+    if (mhs->count[s])
+    {
+      struct MhSeqRange *r = &mhs->runs[s][mhs->count[s] - 1];
+      if ((first >= r->first) && ((long) first <= (long) r->last + 1))
+      {
+        if (last > r->last)
+          r->last = last;
+        continue;
+      }
+      if (first < r->first)
+        mhs->unsorted[s] = true;
+    }
+
+    if (mhs->count[s] == mhs->size[s])
+    {
+      mhs->size[s] = mhs->size[s] ? 2 * mhs->size[s] : 16;
+      mutt_mem_realloc(&mhs->runs[s], mhs->size[s] * sizeof(struct MhSeqRange));
+    }
+    mhs->runs[s][mhs->count[s]].first = first;
+    mhs->runs[s][mhs->count[s]].last = last;
+    mhs->count[s]++;
   }
 }
 
+/**
+ * mhs_cmp_range - Compare two runs by their first message - Implements ::sort_t
+ */
+static int mhs_cmp_range(const void *a, const void *b)
+{
+  const struct MhSeqRange *ra = a;
+  const struct MhSeqRange *rb = b;
+
+  return (ra->first > rb->first) - (ra->first < rb->first);
+}
+
+/**
+ * mhs_sort - Sort a sequence's runs and merge the overlapping ones
+ * @param mhs Sequences
+ * @param s   Sequence, the bit number of an MH_SEQ_* flag
+ */
+static void mhs_sort(struct MhSequences *mhs, int s)
+{
+  if (!mhs->unsorted[s])
+    return;
+
+  struct MhSeqRange *runs = mhs->runs[s];
+  size_t n = 0;
+
+  qsort(runs, mhs->count[s], sizeof(struct MhSeqRange), mhs_cmp_range);
+  for (size_t i = 1; i < mhs->count[s]; i++)
+  {
+    if ((long) runs[i].first <= (long) runs[n].last + 1)
+    {
+      if (runs[i].last > runs[n].last)
+        runs[n].last = runs[i].last;
+    }
+    else
+      runs[++n] = runs[i];
+  }
+
+  mhs->count[s] = n + 1;
+  mhs->unsorted[s] = false;
+}
+
 static void mhs_free_sequences(struct MhSequences *mhs)
 {
-  FREE(&mhs->flags);
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
+    FREE(&mhs->runs[s]);
+  memset(mhs, 0, sizeof(*mhs));
 }
 
+/**
+ * mhs_check - Find the sequences a message is in
+ * @param mhs Sequences
+ * @param i   Message number
+ * @retval num Flags, e.g. #MH_SEQ_UNSEEN
+ */
 static short mhs_check(struct MhSequences *mhs, int i)
 {
-  if (!mhs->flags || i > mhs->max)
-    return 0;
-  else
-    return mhs->flags[i];
+  short f = 0;
+
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
+  {
+    mhs_sort(mhs, s);
+
+    /* Find the last run starting at or before i */
+    size_t lo = 0, hi = mhs->count[s];
+    while (lo < hi)
+    {
+      size_t mid = lo + (hi - lo) / 2;
+      if (mhs->runs[s][mid].first <= i)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo && (i <= mhs->runs[s][lo - 1].last))
+      f |= (1 << s);
+  }
+
+  return f;
+}
+
+/**
+ * mhs_count - Count the messages in a sequence
+ * @param mhs Sequences
+ * @param f   Sequence, e.g. #MH_SEQ_UNSEEN
+ * @retval num Number of messages
+ */
+static int mhs_count(struct MhSequences *mhs, short f)
+{
+  int count = 0;
+
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
+  {
+    if (!(f & (1 << s)))
+      continue;
+    mhs_sort(mhs, s);
+    for (size_t i = 0; i < mhs->count[s]; i++)
+      count += mhs->runs[s][i].last - mhs->runs[s][i].first + 1;
+  }
+
+  return count;
 }
 
-static short mhs_set(struct MhSequences *mhs, int i, short f)
+/**
+ * mhs_last - Find the highest message in a sequence
+ * @param mhs Sequences
+ * @param f   Sequence, e.g. #MH_SEQ_UNSEEN
+ * @retval num Message number
+ * @retval 0   The sequence is empty
+ */
+static int mhs_last(struct MhSequences *mhs, short f)
 {
-  mhs_alloc(mhs, i);
-  mhs->flags[i] |= f;
-  return mhs->flags[i];
+  int last = 0;
+
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
+  {
+    if (!(f & (1 << s)) || !mhs->count[s])
+      continue;
+    mhs_sort(mhs, s);
+    last = MAX(last, mhs->runs[s][mhs->count[s] - 1].last);
+  }
+
+  return last;
+}
+
+static void mhs_set(struct MhSequences *mhs, int i, short f)
+{
+  mhs_add(mhs, f, i, i);
 }
 
 static int mh_read_token(char *t, int *first, int *last)
@@ -206,8 +358,7 @@ static int mh_read_sequences(struct MhSequences *mhs, const char *path)
         rc = -1;
         goto out;
       }
-      for (; first <= last; first++)
-        mhs_set(mhs, first, f);
+      mhs_add(mhs, f, first, last);
     }
   }
 
@@ -329,35 +480,17 @@ bool mh_buffy(struct Buffy *mailbox, bool check_stats)
   if (check_stats)
   {
     mailbox->msg_count = 0;
-    mailbox->msg_unread = 0;
-    mailbox->msg_flagged = 0;
+    mailbox->msg_unread = mhs_count(&mhs, MH_SEQ_UNSEEN);
+    mailbox->msg_flagged = mhs_count(&mhs, MH_SEQ_FLAGGED);
   }
 
-  for (int i = mhs.max; i > 0; i--)
+  /* Only the highest unseen message matters: if it was in the mailbox during
+   * the last visit, don't notify about it */
+  int i = mhs_last(&mhs, MH_SEQ_UNSEEN);
+  if (check_new && (i > 0) && (!MailCheckRecent || mh_already_notified(mailbox, i) == 0))
   {
-    if (check_stats && (mhs_check(&mhs, i) & MH_SEQ_FLAGGED))
-      mailbox->msg_flagged++;
-    if (mhs_check(&mhs, i) & MH_SEQ_UNSEEN)
-    {
-      if (check_stats)
-        mailbox->msg_unread++;
-      if (check_new)
-      {
-        /* if the first unseen message we encounter was in the mailbox during the
-           last visit, don't notify about it */
-        if (!MailCheckRecent || mh_already_notified(mailbox, i) == 0)
-        {
-          mailbox->new = true;
-          rc = true;
-        }
-        /* Because we are traversing from high to low, we can stop
-         * checking for new mail after the first unseen message.
-         * Whether it resulted in "new mail" or not. */
-        check_new = false;
-        if (!check_stats)
-          break;
-      }
-    }
+    mailbox->new = true;
+    rc = true;
   }
   mhs_free_sequences(&mhs);
 
@@ -423,41 +556,24 @@ static int mh_mkstemp(struct Context *dest, FILE **fp, char **tgt)
 
 static void mhs_write_one_sequence(FILE *fp, struct MhSequences *mhs, short f, const char *tag)
 {
-  int first, last;
   fprintf(fp, "%s:", tag);
 
-  first = -1;
-  last = -1;
-
-  for (int i = 0; i <= mhs->max; i++)
+  for (int s = 0; s < MH_SEQ_COUNT; s++)
   {
-    if ((mhs_check(mhs, i) & f))
-    {
-      if (first < 0)
-        first = i;
-      else
-        last = i;
-    }
-    else if (first >= 0)
+    if (!(f & (1 << s)))
+      continue;
+
+    mhs_sort(mhs, s);
+    for (size_t i = 0; i < mhs->count[s]; i++)
     {
-      if (last < 0)
-        fprintf(fp, " %d", first);
+      const struct MhSeqRange *r = &mhs->runs[s][i];
+      if (r->first == r->last)
+        fprintf(fp, " %d", r->first);
       else
-        fprintf(fp, " %d-%d", first, last);
-
-      first = -1;
-      last = -1;
+        fprintf(fp, " %d-%d", r->first, r->last);
     }
   }
 
-  if (first >= 0)
-  {
-    if (last < 0)
-      fprintf(fp, " %d", first);
-    else
-      fprintf(fp, " %d-%d", first, last);
-  }
-
   fputc('\n', fp);
 }
 
@@ -841,6 +957,184 @@ struct Header *maildir_parse_message(int magic, const char *fname, bool is_old,
   return NULL;
 }
 
+/**
+ * maildir_queue - Add a message file to the list to be read
+ * @param ctx      Mailbox
+ * @param last     End of the list
+ * @param subdir   Subdirectory, or NULL for MH
+ * @param name     File name
+ * @param inode    Inode of the file
+ * @param is_old   Mark the message as old
+ * @param count    Counter of the messages, may be NULL
+ * @param progress Progress bar, may be NULL
+ */
+static void maildir_queue(struct Context *ctx, struct Maildir ***last,
+                          const char *subdir, const char *name, ino_t inode,
+                          bool is_old, int *count, struct Progress *progress)
+{
+  struct Maildir *entry = NULL;
+  struct Header *h = NULL;
+
+  /* FOO - really ignore the return value? */
+  mutt_debug(2, "queueing %s\n", name);
+
+  h = mutt_new_header();
+  h->old = is_old;
+  if (ctx->magic == MUTT_MAILDIR)
+    maildir_parse_flags(h, name);
+
+  if (count)
+  {
+    (*count)++;
+    if (!ctx->quiet && progress)
+      mutt_progress_update(progress, *count, -1);
+  }
+
+  if (subdir)
+  {
+    char tmp[LONG_STRING];
+    snprintf(tmp, sizeof(tmp), "%s/%s", subdir, name);
+    h->path = mutt_str_strdup(tmp);
+  }
+  else
+    h->path = mutt_str_strdup(name);
+
+  entry = mutt_mem_calloc(1, sizeof(struct Maildir));
+  entry->h = h;
+  entry->inode = inode;
+  **last = entry;
+  *last = &entry->next;
+}
+
+#ifdef USE_HCACHE
+/**
+ * maildir_manifest_key - Get the header cache key of a directory's manifest
+ * @param subdir Subdirectory, "cur" or "new"
+ * @param buf    Buffer for the key
+ * @param buflen Length of the buffer
+ * @retval num Length of the key
+ *
+ * The key starts with a '/', so it can't be a message's file name.
+ */
+static size_t maildir_manifest_key(const char *subdir, char *buf, size_t buflen)
+{
+  return snprintf(buf, buflen, "/MANIFEST/%s", subdir);
+}
+
+/**
+ * maildir_manifest_read - Queue the messages of a directory from its manifest
+ * @param ctx      Mailbox
+ * @param hc       Header cache
+ * @param subdir   Subdirectory, "cur" or "new"
+ * @param st       stat() of the directory
+ * @param last     End of the list
+ * @param is_old   Mark the messages as old
+ * @param count    Counter of the messages, may be NULL
+ * @param progress Progress bar, may be NULL
+ * @retval true  The manifest was up to date, and its messages have been queued
+ * @retval false There's no usable manifest: the directory must be read
+ *
+ * The manifest is "mtime inode written" of the directory, then "inode name" of
+ * each message.  It's only trusted if the directory's mtime is the same and
+ * is older than the manifest: a change in the second the directory was read
+ * wouldn't change its mtime.
+ */
+static bool maildir_manifest_read(struct Context *ctx, header_cache_t *hc,
+                                  const char *subdir, const struct stat *st,
+                                  struct Maildir ***last, bool is_old, int *count,
+                                  struct Progress *progress)
+{
+  char key[32];
+  size_t keylen = maildir_manifest_key(subdir, key, sizeof(key));
+  char *data = mutt_hcache_fetch_raw(hc, key, keylen);
+  if (!data)
+    return false;
+
+  bool ok = false;
+  char *p = data;
+  long long mtime = strtoll(p, &p, 10);
+  unsigned long long dir_ino = strtoull(p, &p, 10);
+  long long written = strtoll(p, &p, 10);
+  if ((*p != '\n') || (mtime != (long long) st->st_mtime) ||
+      (dir_ino != (unsigned long long) st->st_ino) || (mtime >= written))
+  {
+    goto out;
+  }
+
+  mutt_debug(2, "maildir: %s/%s is unchanged, using its manifest\n", ctx->path, subdir);
+  /* Queued separately, in case the manifest turns out to be damaged */
+  struct Maildir *list = NULL, **tail = &list;
+  int old_count = count ? *count : 0;
+
+  /* The data belongs to the backend, so the names are copied out */
+  for (p++; *p;)
+  {
+    char name[_POSIX_PATH_MAX];
+    unsigned long long ino = strtoull(p, &p, 10);
+    char *nl = strchr(p, '\n');
+    if ((*p != ' ') || !nl || ((size_t)(nl - p) > sizeof(name)))
+    {
+      mutt_debug(1, "maildir: damaged manifest for %s/%s\n", ctx->path, subdir);
+      maildir_free_maildir(&list);
+      if (count)
+        *count = old_count;
+      goto out;
+    }
+    mutt_str_strfcpy(name, p + 1, nl - p);
+    maildir_queue(ctx, &tail, subdir, name, (ino_t) ino, is_old, count, progress);
+    p = nl + 1;
+  }
+
+  **last = list;
+  if (list)
+    *last = tail;
+  ok = true;
+
+out:
+  mutt_hcache_free(hc, (void **) &data);
+  return ok;
+}
+
+/**
+ * maildir_manifest_write - Store the list of a directory's messages
+ * @param hc     Header cache
+ * @param subdir Subdirectory, "cur" or "new"
+ * @param st     stat() of the directory, taken before reading it
+ * @param when   Time the directory was read, taken before the stat()
+ * @param first  First message read from the directory
+ *
+ * If the directory may have changed in the second it was read, nothing is
+ * stored, and any previous manifest won't match anyway.
+ */
+static void maildir_manifest_write(header_cache_t *hc, const char *subdir,
+                                   const struct stat *st, time_t when,
+                                   struct Maildir *first)
+{
+  if (st->st_mtime >= when)
+    return;
+
+  struct Buffer *buf = mutt_buffer_new();
+  mutt_buffer_printf(buf, "%lld %llu %lld\n", (long long) st->st_mtime,
+                     (unsigned long long) st->st_ino, (long long) when);
+  for (struct Maildir *md = first; md; md = md->next)
+  {
+    const char *name = md->h->path + strlen(subdir) + 1;
+    /* A name the manifest can't hold */
+    if (strchr(name, '\n'))
+    {
+      mutt_buffer_free(&buf);
+      return;
+    }
+    mutt_buffer_printf(buf, "%llu %s\n", (unsigned long long) md->inode, name);
+  }
+
+  char key[32];
+  size_t keylen = maildir_manifest_key(subdir, key, sizeof(key));
+  mutt_hcache_store_raw(hc, key, keylen, buf->data, mutt_str_strlen(buf->data) + 1);
+  mutt_buffer_free(&buf);
+}
+#endif
+
 static int maildir_parse_dir(struct Context *ctx, struct Maildir ***last,
                              const char *subdir, int *count, struct Progress *progress)
 {
@@ -848,8 +1142,13 @@ static int maildir_parse_dir(struct Context *ctx, struct Maildir ***last,
   struct dirent *de = NULL;
   char buf[_POSIX_PATH_MAX];
   int is_old = 0;
-  struct Maildir *entry = NULL;
-  struct Header *h = NULL;
+  int rc = 0;
+#ifdef USE_HCACHE
+  header_cache_t *hc = NULL;
+  struct Maildir **first = *last;
+  struct stat st;
+  time_t when = time(NULL);
+#endif
 
   if (subdir)
   {
@@ -859,9 +1158,23 @@ static int maildir_parse_dir(struct Context *ctx, struct Maildir ***last,
   else
     mutt_str_strfcpy(buf, ctx->path, sizeof(buf));
 
+#ifdef USE_HCACHE
+  /* An unchanged maildir directory needn't be read */
+  if (subdir && (ctx->magic == MUTT_MAILDIR) && (stat(buf, &st) == 0))
+    hc = mutt_hcache_open(HeaderCache, ctx->path, NULL);
+  if (hc && maildir_manifest_read(ctx, hc, subdir, &st, last, is_old, count, progress))
+  {
+    mutt_hcache_close(hc);
+    return 0;
+  }
+#endif
+
   dirp = opendir(buf);
   if (!dirp)
-    return -1;
+  {
+    rc = -1;
+    goto out;
+  }
 
   while (((de = readdir(dirp)) != NULL) && (SigInt != 1))
   {
@@ -871,35 +1184,13 @@ static int maildir_parse_dir(struct Context *ctx, struct Maildir ***last,
       continue;
     }
 
-    /* FOO - really ignore the return value? */
-    mutt_debug(2, "queueing %s\n", de->d_name);
-
-    h = mutt_new_header();
-    h->old = is_old;
-    if (ctx->magic == MUTT_MAILDIR)
-      maildir_parse_flags(h, de->d_name);
-
-    if (count)
-    {
-      (*count)++;
-      if (!ctx->quiet && progress)
-        mutt_progress_update(progress, *count, -1);
-    }
-
-    if (subdir)
-    {
-      char tmp[LONG_STRING];
-      snprintf(tmp, sizeof(tmp), "%s/%s", subdir, de->d_name);
-      h->path = mutt_str_strdup(tmp);
-    }
-    else
-      h->path = mutt_str_strdup(de->d_name);
+#ifdef DT_DIR
+    /* The type is in the entry, so sub-directories are skipped without a stat() */
+    if (de->d_type == DT_DIR)
+      continue;
+#endif
 
-    entry = mutt_mem_calloc(1, sizeof(struct Maildir));
-    entry->h = h;
-    entry->inode = de->d_ino;
-    **last = entry;
-    *last = &entry->next;
+    maildir_queue(ctx, last, subdir, de->d_name, de->d_ino, is_old, count, progress);
   }
 
   closedir(dirp);
@@ -907,10 +1198,20 @@ static int maildir_parse_dir(struct Context *ctx, struct Maildir ***last,
   if (SigInt == 1)
   {
     SigInt = 0;
-    return -2; /* action aborted */
+    rc = -2; /* action aborted */
+    goto out;
   }
 
-  return 0;
+#ifdef USE_HCACHE
+  if (hc)
+    maildir_manifest_write(hc, subdir, &st, when, *first);
+#endif
+
+out:
+#ifdef USE_HCACHE
+  mutt_hcache_close(hc);
+#endif
+  return rc;
 }
 
 static bool maildir_add_to_context(struct Context *ctx, struct Maildir *md)
@@ -964,18 +1265,13 @@ static size_t maildir_hcache_keylen(const char *fn)
 }
 #endif
 
-static int md_cmp_inode(struct Maildir *a, struct Maildir *b)
-{
-  return a->inode - b->inode;
-}
-
 static int md_cmp_path(struct Maildir *a, struct Maildir *b)
 {
   return strcmp(a->h->path, b->h->path);
 }
 
 /**
- * maildir_merge_lists - Merge two maildir lists according to the inode numbers
+ * maildir_merge_lists - Merge two sorted maildir lists
  */
 static struct Maildir *maildir_merge_lists(struct Maildir *left, struct Maildir *right,
                                            int (*cmp)(struct Maildir *, struct Maildir *))
@@ -1062,7 +1358,7 @@ static struct Maildir *maildir_ins_sort(struct Maildir *list,
 }
 
 /**
- * maildir_sort - Sort maildir list according to inode
+ * maildir_sort - Sort a maildir list
  */
 static struct Maildir *maildir_sort(struct Maildir *list, size_t len,
                                     int (*cmp)(struct Maildir *, struct Maildir *))
@@ -1109,36 +1405,251 @@ static void mh_sort_natural(struct Context *ctx, struct Maildir **md)
   *md = maildir_sort(*md, (size_t) -1, md_cmp_path);
 }
 
-static struct Maildir *skip_duplicates(struct Maildir *p, struct Maildir **last)
+/**
+ * struct MaildirRead - A message file whose header is to be parsed
+ */
+struct MaildirRead
 {
-  /*
-   * Skip ahead to the next non-duplicate message.
-   *
-   * p should never reach NULL, because we couldn't have reached this point unless
-   * there was a message that needed to be parsed.
-   *
-   * the check for p->header_parsed is likely unnecessary since the dupes will most
-   * likely be at the head of the list.  but it is present for consistency with
-   * the check at the top of the for() loop in maildir_delayed_parsing().
-   */
-  while (!p->h || p->header_parsed)
+  struct Maildir *md; /**< Message */
+  char *path;         /**< Full path of the file */
+  int pos;            /**< Position in the folder, for the progress bar */
+  int fd;             /**< File opened by a reader thread, or -1 */
+  bool done;          /**< A reader thread has finished with the file */
+};
+
+/**
+ * maildir_parse_read - Parse the header of a message file
+ * @param ctx  Mailbox
+ * @param r    Message file
+ *
+ * On failure, the message is dropped.
+ */
+static void maildir_parse_read(struct Context *ctx, struct MaildirRead *r)
+{
+  struct Maildir *p = r->md;
+  FILE *f = NULL;
+
+  if (r->fd >= 0)
   {
-    *last = p;
-    p = p->next;
+    f = fdopen(r->fd, "r");
+    if (!f)
+      close(r->fd);
+    r->fd = -1;
   }
-  return p;
+  /* If a reader thread couldn't open it, neither can we */
+  else if (!r->done)
+    f = fopen(r->path, "r");
+
+  if (f && maildir_parse_stream(ctx->magic, f, r->path, p->h->old, p->h))
+    p->header_parsed = 1;
+  else
+    mutt_free_header(&p->h);
+  mutt_file_fclose(&f);
+}
+
+#ifdef HAVE_PTHREAD_CREATE
+/* Files the reader threads may get ahead of the parser, each one an open
+ * file descriptor */
+#define MAILDIR_READ_AHEAD 64
+
+/**
+ * struct MaildirReadPool - Threads reading message files ahead of the parser
+ */
+struct MaildirReadPool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;       /**< Signalled when a file is read or parsed */
+  struct MaildirRead *reads; /**< Message files */
+  size_t count;              /**< Number of message files */
+  size_t next;               /**< Next file for a reader thread */
+  size_t parsed;             /**< Files parsed so far */
+};
+
+/**
+ * maildir_read_thread - Open message files and read their headers
+ * @param arg Pool of threads
+ * @retval NULL Always
+ *
+ * Only the file system is touched here: the header parser uses global state,
+ * so it runs in the main thread, finding the data in the page cache.
+ */
+static void *maildir_read_thread(void *arg)
+{
+  struct MaildirReadPool *pool = arg;
+  char buf[4096];
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->next < pool->count)
+  {
+    if (pool->next >= pool->parsed + MAILDIR_READ_AHEAD)
+    {
+      pthread_cond_wait(&pool->cond, &pool->lock);
+      continue;
+    }
+    struct MaildirRead *r = &pool->reads[pool->next++];
+    pthread_mutex_unlock(&pool->lock);
+
+    r->fd = open(r->path, O_RDONLY);
+    if (r->fd >= 0)
+    {
+      ssize_t len;
+      char prev = '\0';
+
+      /* up to the blank line which ends the header */
+      while ((len = read(r->fd, buf, sizeof(buf))) > 0)
+      {
+        if (((prev == '\n') && (buf[0] == '\n')) || memmem(buf, len, "\n\n", 2))
+          break;
+        prev = buf[len - 1];
+      }
+      lseek(r->fd, 0, SEEK_SET);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    r->done = true;
+    pthread_cond_broadcast(&pool->cond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return NULL;
+}
+#endif
+
+/**
+ * maildir_read_messages - Parse the headers of message files
+ * @param ctx      Mailbox
+ * @param reads    Message files
+ * @param count    Number of message files
+ * @param progress Progress bar, may be NULL
+ *
+ * With $maildir_read_threads, the files are opened and read by threads from
+ * the shared pool, ahead of the parser.
+ */
+static void maildir_read_messages(struct Context *ctx, struct MaildirRead *reads,
+                                  size_t count, struct Progress *progress)
+{
+  int nthreads = 0;
+
+#ifdef HAVE_PTHREAD_CREATE
+  struct MaildirReadPool pool;
+  struct WorkerGroup group;
+
+  if ((MaildirReadThreads > 1) && (count > 1))
+  {
+    memset(&pool, 0, sizeof(pool));
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+    pool.reads = reads;
+    pool.count = count;
+
+    nthreads = mutt_worker_group_start(&group, MaildirReadThreads, maildir_read_thread, &pool);
+    mutt_debug(2, "maildir: reading %zu files with %d threads\n", count, nthreads);
+    if (!nthreads)
+    {
+      pthread_cond_destroy(&pool.cond);
+      pthread_mutex_destroy(&pool.lock);
+    }
+  }
+#endif
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!ctx->quiet && progress)
+      mutt_progress_update(progress, reads[i].pos, -1);
+
+#ifdef HAVE_PTHREAD_CREATE
+    if (nthreads)
+    {
+      pthread_mutex_lock(&pool.lock);
+      while (!reads[i].done)
+        pthread_cond_wait(&pool.cond, &pool.lock);
+      pthread_mutex_unlock(&pool.lock);
+    }
+#endif
+
+    maildir_parse_read(ctx, &reads[i]);
+
+#ifdef HAVE_PTHREAD_CREATE
+    if (nthreads)
+    {
+      pthread_mutex_lock(&pool.lock);
+      pool.parsed = i + 1;
+      pthread_cond_broadcast(&pool.cond);
+      pthread_mutex_unlock(&pool.lock);
+    }
+#endif
+  }
+
+#ifdef HAVE_PTHREAD_CREATE
+  if (nthreads)
+  {
+    mutt_worker_group_wait(&group);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+  }
+#endif
+}
+
+/**
+ * maildir_sort_reads - Sort message files by inode
+ * @param reads Message files
+ * @param count Number of message files
+ *
+ * Opening files in inode order is much faster on many file systems.  This is
+ * a radix sort, a byte at a time, skipping the bytes that all the inodes share
+ * (usually most of them).
+ */
+static void maildir_sort_reads(struct MaildirRead *reads, size_t count)
+{
+  if (count < 2)
+    return;
+
+  struct MaildirRead *tmp = mutt_mem_malloc(count * sizeof(struct MaildirRead));
+  struct MaildirRead *src = reads, *dst = tmp;
+
+  for (size_t shift = 0; shift < 8 * sizeof(ino_t); shift += 8)
+  {
+    size_t offsets[256] = { 0 };
+
+    for (size_t i = 0; i < count; i++)
+      offsets[((unsigned long long) src[i].md->inode >> shift) & 0xff]++;
+    if (offsets[((unsigned long long) src[0].md->inode >> shift) & 0xff] == count)
+      continue;
+
+    for (size_t b = 0, sum = 0; b < 256; b++)
+    {
+      size_t n = offsets[b];
+      offsets[b] = sum;
+      sum += n;
+    }
+    for (size_t i = 0; i < count; i++)
+      dst[offsets[((unsigned long long) src[i].md->inode >> shift) & 0xff]++] = src[i];
+
+    struct MaildirRead *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != reads)
+    memcpy(reads, src, count * sizeof(struct MaildirRead));
+  FREE(&tmp);
 }
 
 /**
  * maildir_delayed_parsing - This function does the second parsing pass
+ *
+ * The headers are looked up in the header cache in the order of the folder.
+ * Only the files that miss it are sorted by inode and read.
  */
 static void maildir_delayed_parsing(struct Context *ctx, struct Maildir **md,
                                     struct Progress *progress)
 {
-  struct Maildir *p, *last = NULL;
+  struct Maildir *p = NULL;
   char fn[_POSIX_PATH_MAX];
   int count;
-  int sort = 0;
+  /* messages that missed the header cache */
+  struct MaildirRead *reads = NULL;
+  size_t nreads = 0, maxreads = 0;
 #ifdef USE_HCACHE
   header_cache_t *hc = NULL;
   void *data = NULL;
@@ -1147,8 +1658,13 @@ static void maildir_delayed_parsing(struct Context *ctx, struct Maildir **md,
   struct timeval *when = NULL;
   struct stat lastchanged;
   int ret;
+  /* newly parsed headers, stored in one batch at the end */
+  const char **hc_keys = NULL;
+  struct Header **hc_hdrs = NULL;
+  size_t hc_count = 0, hc_max = 0;
 #endif
 
+  mutt_trace_begin("maildir_delayed_parsing");
 #ifdef USE_HCACHE
   hc = mutt_hcache_open(HeaderCache, ctx->path, NULL);
 #endif
@@ -1156,40 +1672,15 @@ static void maildir_delayed_parsing(struct Context *ctx, struct Maildir **md,
   for (p = *md, count = 0; p; p = p->next, count++)
   {
     if (!(p && p->h && !p->header_parsed))
-    {
-      last = p;
       continue;
-    }
 
+    /* the files still to be read come after these */
     if (!ctx->quiet && progress)
-      mutt_progress_update(progress, count, -1);
-
-    if (!sort)
-    {
-      mutt_debug(4, "maildir: need to sort %s by inode\n", ctx->path);
-      p = maildir_sort(p, (size_t) -1, md_cmp_inode);
-      if (!last)
-        *md = p;
-      else
-        last->next = p;
-      sort = 1;
-      p = skip_duplicates(p, &last);
-      snprintf(fn, sizeof(fn), "%s/%s", ctx->path, p->h->path);
-    }
+      mutt_progress_update(progress, count - (int) nreads, -1);
 
     snprintf(fn, sizeof(fn), "%s/%s", ctx->path, p->h->path);
 
 #ifdef USE_HCACHE
-    if (MaildirHeaderCacheVerify)
-    {
-      ret = stat(fn, &lastchanged);
-    }
-    else
-    {
-      lastchanged.st_mtime = 0;
-      ret = 0;
-    }
-
     if (ctx->magic == MUTT_MH)
     {
       key = p->h->path;
@@ -1203,6 +1694,15 @@ static void maildir_delayed_parsing(struct Context *ctx, struct Maildir **md,
     data = mutt_hcache_fetch(hc, key, keylen);
     when = (struct timeval *) data;
 
+    /* Only a cached message needs its mtime checking */
+    if (data && MaildirHeaderCacheVerify)
+      ret = stat(fn, &lastchanged);
+    else
+    {
+      lastchanged.st_mtime = 0;
+      ret = 0;
+    }
+
     if (data != NULL && !ret && lastchanged.st_mtime <= when->tv_sec)
     {
       struct Header *h = mutt_hcache_restore((unsigned char *) data);
@@ -1217,36 +1717,61 @@ static void maildir_delayed_parsing(struct Context *ctx, struct Maildir **md,
     {
 #endif /* USE_HCACHE */
 
-      if (maildir_parse_message(ctx->magic, fn, p->h->old, p->h))
+      /* parsed below, after the files have been read ahead */
+      if (nreads == maxreads)
       {
-        p->header_parsed = 1;
-#ifdef USE_HCACHE
-        if (ctx->magic == MUTT_MH)
-        {
-          key = p->h->path;
-          keylen = strlen(key);
-        }
-        else
-        {
-          key = p->h->path + 3;
-          keylen = maildir_hcache_keylen(key);
-        }
-        mutt_hcache_store(hc, key, keylen, p->h, 0);
-#endif
+        maxreads += 256;
+        mutt_mem_realloc(&reads, maxreads * sizeof(struct MaildirRead));
       }
-      else
-        mutt_free_header(&p->h);
+      reads[nreads].md = p;
+      reads[nreads].path = mutt_str_strdup(fn);
+      reads[nreads].fd = -1;
+      reads[nreads].done = false;
+      nreads++;
 #ifdef USE_HCACHE
     }
     mutt_hcache_free(hc, &data);
 #endif
-    last = p;
   }
+
+  if (nreads)
+    mutt_debug(4, "maildir: reading %zu files of %s by inode\n", nreads, ctx->path);
+  maildir_sort_reads(reads, nreads);
+  for (size_t i = 0; i < nreads; i++)
+    reads[i].pos = count - (int) (nreads - i);
+
+  maildir_read_messages(ctx, reads, nreads, progress);
+
+  for (size_t i = 0; i < nreads; i++)
+  {
+    p = reads[i].md;
+    FREE(&reads[i].path);
 #ifdef USE_HCACHE
+    if (!p->header_parsed)
+      continue;
+    if (hc_count == hc_max)
+    {
+      hc_max += 256;
+      mutt_mem_realloc(&hc_keys, hc_max * sizeof(char *));
+      mutt_mem_realloc(&hc_hdrs, hc_max * sizeof(struct Header *));
+    }
+    hc_keys[hc_count] = (ctx->magic == MUTT_MH) ? p->h->path : p->h->path + 3;
+    hc_hdrs[hc_count] = p->h;
+    hc_count++;
+#endif
+  }
+  FREE(&reads);
+
+#ifdef USE_HCACHE
+  if (hc_count)
+    mutt_hcache_store_many(hc, hc_keys, hc_count, hc_hdrs, 0);
+  FREE(&hc_keys);
+  FREE(&hc_hdrs);
   mutt_hcache_close(hc);
 #endif
 
   mh_sort_natural(ctx, md);
+  mutt_trace_end("maildir_delayed_parsing");
 }
 
 static int mh_close_mailbox(struct Context *ctx)
@@ -1319,16 +1844,71 @@ static int mh_read_dir(struct Context *ctx, const char *subdir)
   return 0;
 }
 
+#ifdef USE_HCACHE
+/**
+ * mh_hcache_keep - Is a cached record still wanted? - Implements ::hcache_keep_t
+ *
+ * Only the records of the files that are in the mailbox are kept.
+ */
+static bool mh_hcache_keep(const char *key, size_t keylen, void *data)
+{
+  /* The directories' manifests */
+  if (*key == '/')
+    return true;
+
+  return mutt_hash_find(data, key) != NULL;
+}
+
+/**
+ * mh_hcache_prune - Drop the records of files that have gone
+ * @param ctx Mailbox, with all its messages read
+ *
+ * Maildir records are keyed by filename, including the flags, so every flag
+ * change or deletion behind our back leaves a stale record behind.
+ */
+static void mh_hcache_prune(struct Context *ctx)
+{
+  header_cache_t *hc = mutt_hcache_open(HeaderCache, ctx->path, NULL);
+  if (!hc)
+    return;
+
+  struct Hash *keys = mutt_hash_create(MAX(6 * ctx->msgcount / 5, 30), 0);
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    const char *path = ctx->hdrs[i]->path;
+    if (ctx->magic == MUTT_MAILDIR)
+      path += 3;
+    mutt_hash_insert(keys, path, ctx->hdrs[i]);
+  }
+
+  mutt_hcache_prune(hc, mh_hcache_keep, keys);
+  mutt_hash_destroy(&keys);
+  mutt_hcache_close(hc);
+}
+#endif
+
 /**
  * maildir_read_dir - read a maildir style mailbox
  */
 static int maildir_read_dir(struct Context *ctx)
 {
+  struct PerfTimer perf;
+
   /* maildir looks sort of like MH, except that there are two subdirectories
    * of the main folder path from which to read messages
    */
+#ifdef USE_HCACHE
+  mutt_hcache_prefetch(HeaderCache, ctx->path, NULL);
+#endif
+
+  mutt_perf_start(&perf, PERF_PARSE);
   if (mh_read_dir(ctx, "new") == -1 || mh_read_dir(ctx, "cur") == -1)
     return -1;
+  mutt_perf_stop(&perf);
+
+#ifdef USE_HCACHE
+  mh_hcache_prune(ctx);
+#endif
 
   return 0;
 }
@@ -1386,7 +1966,22 @@ static int maildir_open_mailbox_append(struct Context *ctx, int flags)
 
 static int mh_open_mailbox(struct Context *ctx)
 {
-  return mh_read_dir(ctx, NULL);
+  struct PerfTimer perf;
+
+#ifdef USE_HCACHE
+  mutt_hcache_prefetch(HeaderCache, ctx->path, NULL);
+#endif
+
+  mutt_perf_start(&perf, PERF_PARSE);
+  if (mh_read_dir(ctx, NULL) == -1)
+    return -1;
+  mutt_perf_stop(&perf);
+
+#ifdef USE_HCACHE
+  mh_hcache_prune(ctx);
+#endif
+
+  return 0;
 }
 
 static int mh_open_mailbox_append(struct Context *ctx, int flags)
@@ -2315,6 +2910,36 @@ static int mh_check_mailbox(struct Context *ctx, int *index_hint)
   return 0;
 }
 
+/**
+ * mh_sync_dirs - Flush a mailbox's renames and deletions to disk
+ * @param ctx Mailbox
+ *
+ * This is done once, after all the messages have been synced, rather than
+ * after each rename.
+ */
+static void mh_sync_dirs(struct Context *ctx)
+{
+  static const char *const subdirs[] = { "cur", "new" };
+  char path[_POSIX_PATH_MAX];
+  int count = (ctx->magic == MUTT_MAILDIR) ? 2 : 1;
+
+  for (int i = 0; i < count; i++)
+  {
+    if (ctx->magic == MUTT_MAILDIR)
+      snprintf(path, sizeof(path), "%s/%s", ctx->path, subdirs[i]);
+    else
+      mutt_str_strfcpy(path, ctx->path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+      continue;
+    /* Not every file system can sync a directory; that's harmless */
+    if (fsync(fd) != 0)
+      mutt_debug(1, "fsync %s: %s\n", path, strerror(errno));
+    close(fd);
+  }
+}
+
 static int mh_sync_mailbox(struct Context *ctx, int *index_hint)
 {
   int i, j;
@@ -2323,6 +2948,8 @@ static int mh_sync_mailbox(struct Context *ctx, int *index_hint)
 #endif /* USE_HCACHE */
   char msgbuf[STRING];
   struct Progress progress;
+  struct timeval start, end;
+  int written = 0;
 
   if (ctx->magic == MUTT_MH)
     i = mh_check_mailbox(ctx, index_hint);
@@ -2343,11 +2970,15 @@ static int mh_sync_mailbox(struct Context *ctx, int *index_hint)
     mutt_progress_init(&progress, msgbuf, MUTT_PROGRESS_MSG, WriteInc, ctx->msgcount);
   }
 
+  gettimeofday(&start, NULL);
   for (i = 0; i < ctx->msgcount; i++)
   {
     if (!ctx->quiet)
       mutt_progress_update(&progress, i, -1);
 
+    if (ctx->hdrs[i]->changed || ctx->hdrs[i]->deleted)
+      written++;
+
 #ifdef USE_HCACHE
     if (mh_sync_mailbox_message(ctx, i, hc) == -1)
       goto err;
@@ -2362,6 +2993,14 @@ static int mh_sync_mailbox(struct Context *ctx, int *index_hint)
     mutt_hcache_close(hc);
 #endif /* USE_HCACHE */
 
+  if (written)
+    mh_sync_dirs(ctx);
+
+  gettimeofday(&end, NULL);
+  long ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+  mutt_debug(2, "%s: wrote %d of %d messages in %ld ms (%ld/s)\n", ctx->path,
+             written, ctx->msgcount, ms, ms ? written * 1000L / ms : (long) written);
+
   if (ctx->magic == MUTT_MH)
     mh_update_sequences(ctx);
 
@@ -0,0 +1,259 @@
+/**
+ * @file
+ * Watch local mailboxes for changes
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page monitor Watch local mailboxes for changes
+ *
+ * Scanning a maildir means reading every entry of new/ and cur/.  With many
+ * mailboxes, doing that on every $mail_check is a waste, because most of them
+ * haven't changed.
+ *
+ * Each maildir in the mailboxes list gets an inotify watch on new/ and cur/.
+ * Any message that arrives, leaves or has its flags changed, generates an
+ * event.  A mailbox without events since its last scan keeps its results.
+ *
+ * | Function               | Description
+ * | :--------------------- | :-------------------------------------------
+ * | mutt_monitor_check()   | Does a mailbox need scanning?
+ * | mutt_monitor_cleanup() | Stop watching all the mailboxes
+ * | mutt_monitor_poll()    | Read the pending events
+ * | mutt_monitor_remove()  | Stop watching a mailbox
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+#include "mutt/mutt.h"
+#include "monitor.h"
+#include "buffy.h"
+
+/* A message arrived, left or was renamed; or the directory itself went */
+#define MONITOR_EVENTS                                                          \
+  (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB |           \
+   IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+/**
+ * struct Monitor - A watched mailbox
+ */
+struct Monitor
+{
+  struct Buffy *buffy;
+  int wd[2];           /**< Watches on new/ and cur/, or -1 */
+  bool changed;        /**< There have been events since the last scan */
+  bool stats;          /**< The last scan counted the messages */
+  time_t last_visited; /**< Buffy's last_visited at the last scan */
+  struct Monitor *next;
+};
+
+static int MonitorFd = -1;
+static struct Monitor *Monitors = NULL;
+
+/**
+ * monitor_find - Find the Monitor of a mailbox
+ * @param b Mailbox
+ * @retval ptr  Monitor
+ * @retval NULL The mailbox isn't watched
+ */
+static struct Monitor *monitor_find(struct Buffy *b)
+{
+  for (struct Monitor *m = Monitors; m; m = m->next)
+    if (m->buffy == b)
+      return m;
+
+  return NULL;
+}
+
+/**
+ * monitor_unwatch - Remove a mailbox's watches
+ * @param m Monitor
+ *
+ * Two mailboxes with the same directory share its watch, so it's only removed
+ * when it's the last one.
+ */
+static void monitor_unwatch(struct Monitor *m)
+{
+  for (int i = 0; i < 2; i++)
+  {
+    if (m->wd[i] < 0)
+      continue;
+
+    bool shared = false;
+    for (struct Monitor *o = Monitors; o; o = o->next)
+      if ((o != m) && ((o->wd[0] == m->wd[i]) || (o->wd[1] == m->wd[i])))
+        shared = true;
+
+    if (!shared)
+      inotify_rm_watch(MonitorFd, m->wd[i]);
+    m->wd[i] = -1;
+  }
+}
+
+/**
+ * mutt_monitor_poll - Read the pending events
+ * @param force If true, rescan every mailbox, e.g. for an explicit check
+ *
+ * This doesn't block.
+ */
+void mutt_monitor_poll(bool force)
+{
+  union {
+    struct inotify_event ev;
+    char buf[4096];
+  } u;
+  ssize_t len;
+
+  if (force)
+    for (struct Monitor *m = Monitors; m; m = m->next)
+      m->changed = true;
+
+  if (MonitorFd < 0)
+    return;
+
+  while ((len = read(MonitorFd, u.buf, sizeof(u.buf))) > 0)
+  {
+    const struct inotify_event *ev = NULL;
+    for (char *p = u.buf; p < u.buf + len; p += sizeof(struct inotify_event) + ev->len)
+    {
+      ev = (const struct inotify_event *) p;
+
+      /* Events have been lost, so anything might have changed */
+      if (ev->mask & IN_Q_OVERFLOW)
+      {
+        mutt_debug(1, "inotify queue overflowed\n");
+        for (struct Monitor *m = Monitors; m; m = m->next)
+          m->changed = true;
+        continue;
+      }
+
+      for (struct Monitor *m = Monitors; m; m = m->next)
+      {
+        for (int i = 0; i < 2; i++)
+        {
+          if (m->wd[i] != ev->wd)
+            continue;
+          m->changed = true;
+          /* The directory has gone, and the kernel has dropped the watch */
+          if (ev->mask & IN_IGNORED)
+            m->wd[i] = -1;
+        }
+      }
+    }
+  }
+}
+
+/**
+ * mutt_monitor_check - Does a mailbox need scanning?
+ * @param b           Maildir mailbox
+ * @param check_stats If true, the scan must count the messages
+ * @retval true  Scan the mailbox.  It's now watched and counted as scanned
+ * @retval false Nothing has changed since the last scan
+ *
+ * The caller must have called mutt_monitor_poll() first.  A mailbox is
+ * rescanned after its last_visited changes, because that decides which
+ * messages are new.  If it can't be watched, e.g. the limit of watches has
+ * been reached, it's scanned every time.
+ */
+bool mutt_monitor_check(struct Buffy *b, bool check_stats)
+{
+  struct Monitor *m = monitor_find(b);
+
+  if (m && (m->wd[0] >= 0) && (m->wd[1] >= 0) && !m->changed &&
+      (m->stats || !check_stats) && (m->last_visited == b->last_visited))
+  {
+    return false;
+  }
+
+  if (!m)
+  {
+    m = mutt_mem_calloc(1, sizeof(struct Monitor));
+    m->buffy = b;
+    m->wd[0] = -1;
+    m->wd[1] = -1;
+    m->next = Monitors;
+    Monitors = m;
+  }
+
+  if (MonitorFd < 0)
+  {
+    MonitorFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (MonitorFd < 0)
+      mutt_debug(1, "inotify_init1 failed: %s\n", strerror(errno));
+  }
+
+  /* Watch before scanning, so no change can be missed */
+  static const char *const dirs[2] = { "new", "cur" };
+  for (int i = 0; (i < 2) && (MonitorFd >= 0); i++)
+  {
+    if (m->wd[i] >= 0)
+      continue;
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", b->path, dirs[i]);
+    m->wd[i] = inotify_add_watch(MonitorFd, path, MONITOR_EVENTS);
+    if (m->wd[i] < 0)
+      mutt_debug(1, "can't watch %s: %s\n", path, strerror(errno));
+  }
+
+  m->changed = false;
+  m->stats = check_stats;
+  m->last_visited = b->last_visited;
+  return true;
+}
+
+/**
+ * mutt_monitor_remove - Stop watching a mailbox
+ * @param b Mailbox, e.g. one being removed by 'unmailboxes'
+ */
+void mutt_monitor_remove(struct Buffy *b)
+{
+  for (struct Monitor **mp = &Monitors; *mp; mp = &(*mp)->next)
+  {
+    struct Monitor *m = *mp;
+    if (m->buffy != b)
+      continue;
+
+    monitor_unwatch(m);
+    *mp = m->next;
+    FREE(&m);
+    return;
+  }
+}
+
+/**
+ * mutt_monitor_cleanup - Stop watching all the mailboxes
+ */
+void mutt_monitor_cleanup(void)
+{
+  while (Monitors)
+  {
+    struct Monitor *m = Monitors;
+    Monitors = m->next;
+    FREE(&m);
+  }
+
+  if (MonitorFd >= 0)
+    close(MonitorFd);
+  MonitorFd = -1;
+}
@@ -0,0 +1,32 @@
+/**
+ * @file
+ * Watch local mailboxes for changes
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_MONITOR_H
+#define _MUTT_MONITOR_H
+
+#include <stdbool.h>
+
+struct Buffy;
+
+bool mutt_monitor_check(struct Buffy *b, bool check_stats);
+void mutt_monitor_cleanup(void);
+void mutt_monitor_poll(bool force);
+void mutt_monitor_remove(struct Buffy *b);
+
+#endif /* _MUTT_MONITOR_H */
@@ -261,8 +261,9 @@ bool mutt_matches_ignore(const char *s);
 
 void mutt_init(int skip_sys_rc, struct ListHead *commands);
 
-/* flag to mutt_pattern_comp() */
-#define MUTT_FULL_MSG (1 << 0) /* enable body and header matching */
+/* flags to mutt_pattern_comp() */
+#define MUTT_FULL_MSG      (1 << 0) /* enable body and header matching */
+#define MUTT_PATTERN_STATS (1 << 1) /* profile each part of the pattern */
 
 /**
  * struct AttachMatch - An attachment matching a regex
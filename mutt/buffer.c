@@ -115,6 +115,30 @@ struct Buffer *mutt_buffer_from(char *seed)
   return b;
 }
 
+/**
+ * buffer_grow - Make room in a Buffer
+ * @param buf Buffer to grow
+ * @param len Bytes needed after the current position
+ *
+ * The Buffer at least doubles in size, by a minimum of 128 bytes, so a string
+ * built up a piece at a time is only copied a few times.
+ */
+static void buffer_grow(struct Buffer *buf, size_t len)
+{
+  size_t offset = buf->dptr ? buf->dptr - buf->data : 0;
+
+  if (offset + len <= buf->dsize)
+    return;
+
+  size_t size = buf->dsize + MAX(buf->dsize, 128);
+  if (size < offset + len)
+    size = offset + len;
+
+  mutt_mem_realloc(&buf->data, size);
+  buf->dsize = size;
+  buf->dptr = buf->data + offset;
+}
+
 /**
  * mutt_buffer_add - Add a string to a Buffer, expanding it if necessary
  * @param buf Buffer to add to
@@ -122,7 +146,7 @@ struct Buffer *mutt_buffer_from(char *seed)
  * @param len Length of the string
  * @retval num Bytes written to Buffer
  *
- * Dynamically grow a Buffer to accommodate s, in increments of 128 bytes.
+ * Dynamically grow a Buffer to accommodate s, see buffer_grow().
  * Always one byte bigger than necessary for the null terminator, and the
  * buffer is always NUL-terminated
  */
@@ -132,12 +156,7 @@ size_t mutt_buffer_add(struct Buffer *buf, const char *s, size_t len)
     return 0;
 
   if ((buf->dptr + len + 1) > (buf->data + buf->dsize))
-  {
-    size_t offset = buf->dptr - buf->data;
-    buf->dsize += (len < 128) ? 128 : len + 1;
-    mutt_mem_realloc(&buf->data, buf->dsize);
-    buf->dptr = buf->data + offset;
-  }
+    buffer_grow(buf, len + 1);
   if (!buf->dptr)
     return 0;
   memcpy(buf->dptr, s, len);
@@ -186,20 +205,13 @@ int mutt_buffer_printf(struct Buffer *buf, const char *fmt, ...)
   /* solaris 9 vsnprintf barfs when blen is 0 */
   if (!blen)
   {
-    blen = 128;
-    buf->dsize += blen;
-    mutt_mem_realloc(&buf->data, buf->dsize);
-    buf->dptr = buf->data + doff;
+    buffer_grow(buf, 1);
+    blen = buf->dsize - doff;
   }
   len = vsnprintf(buf->dptr, blen, fmt, ap);
   if (len >= blen)
   {
-    blen = ++len - blen;
-    if (blen < 128)
-      blen = 128;
-    buf->dsize += blen;
-    mutt_mem_realloc(&buf->data, buf->dsize);
-    buf->dptr = buf->data + doff;
+    buffer_grow(buf, ++len);
     len = vsnprintf(buf->dptr, len, fmt, ap_retry);
   }
   if (len > 0)
@@ -35,6 +35,7 @@
  *
  * | Function                       | Description
  * | :----------------------------- | :---------------------------------------------------------
+ * | mutt_ch_cache_cleanup()          | Free the cached charset names and iconv descriptors
  * | mutt_ch_canonical_charset()      | Canonicalise the charset of a string
  * | mutt_ch_charset_lookup()         | Look for a replacement character set
  * | mutt_ch_check_charset()          | Does iconv understand a character set?
@@ -48,6 +49,7 @@
  * | mutt_ch_fgetconvs()              | Convert a file's charset into a string buffer
  * | mutt_ch_get_default_charset()    | Get the default character set
  * | mutt_ch_iconv()                  | Change the encoding of a string
+ * | mutt_ch_iconv_close()            | Finish with an iconv handle
  * | mutt_ch_iconv_lookup()           | Look for a replacement character set
  * | mutt_ch_iconv_open()             | Set up iconv for conversions
  * | mutt_ch_lookup_add()             | Add a new character set lookup
@@ -105,6 +107,44 @@ struct Lookup
 };
 static TAILQ_HEAD(LookupHead, Lookup) Lookups = TAILQ_HEAD_INITIALIZER(Lookups);
 
+#define CANONICAL_CACHE_SIZE 16
+#define ICONV_CACHE_SIZE 16
+
+/**
+ * struct CanonicalCache - A remembered canonical charset name
+ */
+struct CanonicalCache
+{
+  char *name;      /**< Charset name, as given */
+  char *canonical; /**< Result of mutt_ch_canonical_charset() */
+};
+
+/**
+ * CanonicalCache - Charset names that have been canonicalised recently
+ */
+static struct CanonicalCache CanonicalCache[CANONICAL_CACHE_SIZE];
+static int CanonicalCacheNext; /**< Next entry of CanonicalCache to replace */
+
+/**
+ * struct IconvCache - An iconv descriptor that can be reused
+ */
+struct IconvCache
+{
+  char *tocode;   /**< Target charset, as passed to iconv_open() */
+  char *fromcode; /**< Source charset, as passed to iconv_open() */
+  iconv_t cd;     /**< Descriptor */
+  bool in_use;    /**< Returned by mutt_ch_iconv_open(), not closed yet */
+};
+
+/**
+ * IconvCache - iconv descriptors, kept open between conversions
+ *
+ * Opening a descriptor is slow compared to converting an encoded word, and a
+ * mailbox only uses a handful of conversions.
+ */
+static struct IconvCache IconvCache[ICONV_CACHE_SIZE];
+static int IconvCacheCount; /**< Number of entries in IconvCache */
+
 // clang-format off
 /**
  * PreferredMIMENames - Lookup table of preferred charsets
@@ -336,12 +376,24 @@ int mutt_ch_convert_nonmime_string(char **ps)
  *
  * This first ties off any charset extension such as "//TRANSLIT",
  * canonicalizes the charset and re-adds the extension
+ *
+ * The last few names are remembered, because the same ones are
+ * canonicalised for every encoded word.
  */
 void mutt_ch_canonical_charset(char *buf, size_t buflen, const char *name)
 {
   char *p = NULL, *ext = NULL;
   char in[LONG_STRING], scratch[LONG_STRING];
 
+  for (int i = 0; i < CANONICAL_CACHE_SIZE; i++)
+  {
+    if (CanonicalCache[i].name && (mutt_str_strcmp(CanonicalCache[i].name, name) == 0))
+    {
+      mutt_str_strfcpy(buf, CanonicalCache[i].canonical, buflen);
+      return;
+    }
+  }
+
   mutt_str_strfcpy(in, name, sizeof(in));
   ext = strchr(in, '/');
   if (ext)
@@ -388,6 +440,11 @@ out:
     mutt_str_strcat(buf, buflen, "/");
     mutt_str_strcat(buf, buflen, ext);
   }
+
+  struct CanonicalCache *cc = &CanonicalCache[CanonicalCacheNext];
+  CanonicalCacheNext = (CanonicalCacheNext + 1) % CANONICAL_CACHE_SIZE;
+  mutt_str_replace(&cc->name, name);
+  mutt_str_replace(&cc->canonical, buf);
 }
 
 /**
@@ -548,6 +605,9 @@ const char *mutt_ch_charset_lookup(const char *chs)
  * in some setups. Note: By design charset-hooks should never be, and are never,
  * applied to tocode. Highlight note: The top-well-named MUTT_ICONV_HOOK_FROM
  * acts on charset-hooks, not at all on iconv-hooks.
+ *
+ * The handle must be released with mutt_ch_iconv_close(), which keeps it for
+ * the next caller that wants the same conversion.
  */
 iconv_t mutt_ch_iconv_open(const char *tocode, const char *fromcode, int flags)
 {
@@ -578,12 +638,95 @@ iconv_t mutt_ch_iconv_open(const char *tocode, const char *fromcode, int flags)
   fromcode2 = mutt_ch_iconv_lookup(fromcode1);
   fromcode2 = (fromcode2) ? fromcode2 : fromcode1;
 
+  /* reuse an idle descriptor for the same conversion */
+  struct IconvCache *ic = NULL;
+  for (int i = 0; i < IconvCacheCount; i++)
+  {
+    ic = &IconvCache[i];
+    if (!ic->in_use && (mutt_str_strcmp(ic->tocode, tocode2) == 0) &&
+        (mutt_str_strcmp(ic->fromcode, fromcode2) == 0))
+    {
+      ic->in_use = true;
+      return ic->cd;
+    }
+  }
+
   /* call system iconv with names it appreciates */
   cd = iconv_open(tocode2, fromcode2);
-  if (cd != (iconv_t) -1)
-    return cd;
+  if (cd == (iconv_t) -1)
+    return (iconv_t) -1;
+
+  /* remember it, making room by dropping an idle descriptor */
+  ic = NULL;
+  if (IconvCacheCount < ICONV_CACHE_SIZE)
+    ic = &IconvCache[IconvCacheCount++];
+  else
+  {
+    for (int i = 0; i < ICONV_CACHE_SIZE; i++)
+    {
+      if (!IconvCache[i].in_use)
+      {
+        ic = &IconvCache[i];
+        iconv_close(ic->cd);
+        break;
+      }
+    }
+  }
 
-  return (iconv_t) -1;
+  if (ic)
+  {
+    mutt_str_replace(&ic->tocode, tocode2);
+    mutt_str_replace(&ic->fromcode, fromcode2);
+    ic->cd = cd;
+    ic->in_use = true;
+  }
+
+  return cd;
+}
+
+/**
+ * mutt_ch_iconv_close - Finish with an iconv handle
+ * @param cd iconv handle from mutt_ch_iconv_open()
+ *
+ * The handle's conversion state is reset and it's kept for reuse.
+ */
+void mutt_ch_iconv_close(iconv_t cd)
+{
+  if (cd == (iconv_t) -1)
+    return;
+
+  for (int i = 0; i < IconvCacheCount; i++)
+  {
+    if (IconvCache[i].in_use && (IconvCache[i].cd == cd))
+    {
+      iconv(cd, NULL, NULL, NULL, NULL);
+      IconvCache[i].in_use = false;
+      return;
+    }
+  }
+
+  iconv_close(cd);
+}
+
+/**
+ * mutt_ch_cache_cleanup - Free the cached charset names and iconv descriptors
+ */
+void mutt_ch_cache_cleanup(void)
+{
+  for (int i = 0; i < CANONICAL_CACHE_SIZE; i++)
+  {
+    FREE(&CanonicalCache[i].name);
+    FREE(&CanonicalCache[i].canonical);
+  }
+  CanonicalCacheNext = 0;
+
+  for (int i = 0; i < IconvCacheCount; i++)
+  {
+    iconv_close(IconvCache[i].cd);
+    FREE(&IconvCache[i].tocode);
+    FREE(&IconvCache[i].fromcode);
+  }
+  IconvCacheCount = 0;
 }
 
 /**
@@ -729,7 +872,7 @@ int mutt_ch_convert_string(char **ps, const char *from, const char *to, int flag
     ob = buf = mutt_mem_malloc(obl + 1);
 
     mutt_ch_iconv(cd, &ib, &ibl, &ob, &obl, inrepls, outrepl);
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
 
     *ob = '\0';
 
@@ -776,7 +919,7 @@ bool mutt_ch_check_charset(const char *cs, bool strict)
   cd = mutt_ch_iconv_open(cs, cs, 0);
   if (cd != (iconv_t)(-1))
   {
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
     return true;
   }
 
@@ -823,8 +966,7 @@ struct FgetConv *mutt_ch_fgetconv_open(FILE *file, const char *from, const char
  */
 void mutt_ch_fgetconv_close(struct FgetConv **fc)
 {
-  if ((*fc)->cd != (iconv_t) -1)
-    iconv_close((*fc)->cd);
+  mutt_ch_iconv_close((*fc)->cd);
   FREE(fc);
 }
 
@@ -843,7 +985,11 @@ int mutt_ch_fgetconv(struct FgetConv *fc)
   if (!fc)
     return EOF;
   if (fc->cd == (iconv_t) -1)
+#ifdef HAVE_FGETC_UNLOCKED
+    return fgetc_unlocked(fc->file);
+#else
     return fgetc(fc->file);
+#endif
   if (!fc->p)
     return EOF;
   if (fc->p < fc->ob)
@@ -37,6 +37,7 @@
  * | mutt_file_concat_path()       | Join a directory name and a filename
  * | mutt_file_concatn_path()      | Concatenate directory and filename
  * | mutt_file_copy_bytes()        | Copy some content from one file to another
+ * | mutt_file_copy_range()        | Append part of one file to another
  * | mutt_file_copy_stream()       | Copy the contents of one file into another
  * | mutt_file_decrease_mtime()    | Decrease a file's modification time by 1 second
  * | mutt_file_dirname()           | Return a path up to, but not including, the final '/'
@@ -292,6 +293,71 @@ int mutt_file_copy_bytes(FILE *in, FILE *out, size_t size)
   return 0;
 }
 
+/**
+ * mutt_file_copy_range - Append part of one file to another
+ * @param in     Source file
+ * @param offset Offset in the source to copy from
+ * @param out    Destination file
+ * @param size   Number of bytes to copy
+ * @retval  0 Success
+ * @retval -1 Error, see errno
+ *
+ * Where the kernel can, it copies the data itself (or shares the blocks)
+ * without it passing through NeoMutt.  The position of `in` is undefined
+ * afterwards; `out` is left at its end.
+ */
+int mutt_file_copy_range(FILE *in, off_t offset, FILE *out, size_t size)
+{
+  if (fflush(out) != 0)
+    return -1;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  const int fd = fileno(out);
+  const int fl = fcntl(fd, F_GETFL);
+
+  /* copy_file_range() refuses an O_APPEND file; the caller's lock keeps
+   * everyone else away from the end of it meanwhile */
+  if ((fl != -1) && (fl & O_APPEND))
+    fcntl(fd, F_SETFL, fl & ~O_APPEND);
+  lseek(fd, 0, SEEK_END);
+
+  while (size > 0)
+  {
+    loff_t from = offset;
+    ssize_t n = copy_file_range(fileno(in), &from, fd, NULL, size, 0);
+    if (n > 0)
+    {
+      offset += n;
+      size -= n;
+    }
+    else if ((n < 0) && (errno == EINTR))
+      continue;
+    else if ((n == 0) || (errno == EXDEV) || (errno == EINVAL) ||
+             (errno == ENOSYS) || (errno == EOPNOTSUPP) || (errno == EBADF))
+      break; /* not here, copy it by hand */
+    else
+    {
+      int err = errno;
+      if ((fl != -1) && (fl & O_APPEND))
+        fcntl(fd, F_SETFL, fl);
+      errno = err;
+      return -1;
+    }
+  }
+
+  if ((fl != -1) && (fl & O_APPEND))
+    fcntl(fd, F_SETFL, fl);
+  if (fseeko(out, 0, SEEK_END) != 0)
+    return -1;
+  if (size == 0)
+    return 0;
+#endif
+
+  if (fseeko(in, offset, SEEK_SET) != 0)
+    return -1;
+  return mutt_file_copy_bytes(in, out, size);
+}
+
 /**
  * mutt_file_copy_stream - Copy the contents of one file into another
  * @param fin  Source file
@@ -43,6 +43,7 @@ int         mutt_file_chmod_rm_stat(const char *path, mode_t mode, struct stat *
 char *      mutt_file_concatn_path(char *dst, size_t dstlen, const char *dir, size_t dirlen, const char *fname, size_t fnamelen);
 char *      mutt_file_concat_path(char *d, const char *dir, const char *fname, size_t l);
 int         mutt_file_copy_bytes(FILE *in, FILE *out, size_t size);
+int         mutt_file_copy_range(FILE *in, off_t offset, FILE *out, size_t size);
 int         mutt_file_copy_stream(FILE *fin, FILE *fout);
 time_t      mutt_file_decrease_mtime(const char *f, struct stat *st);
 const char *mutt_file_dirname(const char *p);
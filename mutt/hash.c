@@ -143,24 +143,64 @@ static int cmp_int_key(union HashKey a, union HashKey b)
   return 1;
 }
 
+/* The table grows once it has this many elements per bucket */
+#define HASH_MAX_LOAD 2
+
 /**
  * new_hash - Create a new Hash table
  * @param nelem Number of elements it should contain
  * @retval ptr New Hash table
  *
  * The Hash table can contain more elements than nelem, but they will be
- * chained together.
+ * chained together.  If the chains get too long, the table grows.
  */
 static struct Hash *new_hash(int nelem)
 {
-  struct Hash *table = mutt_mem_calloc(1, sizeof(struct Hash));
+  struct Hash *table = mutt_mem_tag_calloc(MEM_HASH, 1, sizeof(struct Hash));
   if (nelem == 0)
     nelem = 2;
   table->nelem = nelem;
-  table->table = mutt_mem_calloc(nelem, sizeof(struct HashElem *));
+  table->table = mutt_mem_tag_calloc(MEM_HASH, nelem, sizeof(struct HashElem *));
   return table;
 }
 
+/**
+ * hash_grow - Move the elements to twice as many buckets
+ * @param table Hash table to grow
+ *
+ * The HashElems themselves don't move, so pointers to them stay valid.  The
+ * elements of each new bucket keep the order they had, so sorted chains stay
+ * sorted and duplicates are still found newest first.
+ */
+static void hash_grow(struct Hash *table)
+{
+  int nelem = 2 * table->nelem;
+  struct HashElem **buckets = mutt_mem_tag_calloc(MEM_HASH, nelem, sizeof(struct HashElem *));
+  struct HashElem **tails = mutt_mem_calloc(nelem, sizeof(struct HashElem *));
+
+  for (int i = 0; i < table->nelem; i++)
+  {
+    struct HashElem *ptr = table->table[i], *next = NULL;
+    for (; ptr; ptr = next)
+    {
+      next = ptr->next;
+      ptr->next = NULL;
+
+      unsigned int h = table->gen_hash(ptr->key, nelem);
+      if (tails[h])
+        tails[h]->next = ptr;
+      else
+        buckets[h] = ptr;
+      tails[h] = ptr;
+    }
+  }
+
+  FREE(&tails);
+  mutt_mem_tag_free(MEM_HASH, &table->table, table->nelem * sizeof(struct HashElem *));
+  table->table = buckets;
+  table->nelem = nelem;
+}
+
 /**
  * union_hash_insert - Insert into a hash table using a union as a key
  * @param table Hash table to update
@@ -175,7 +215,7 @@ static struct HashElem *union_hash_insert(struct Hash *table, union HashKey key,
   struct HashElem *ptr = NULL;
   unsigned int h;
 
-  ptr = mutt_mem_malloc(sizeof(struct HashElem));
+  ptr = mutt_mem_tag_calloc(MEM_HASH, 1, sizeof(struct HashElem));
   h = table->gen_hash(key, table->nelem);
   ptr->key = key;
   ptr->data = data;
@@ -196,7 +236,7 @@ static struct HashElem *union_hash_insert(struct Hash *table, union HashKey key,
       r = table->cmp_key(tmp->key, key);
       if (r == 0)
       {
-        FREE(&ptr);
+        mutt_mem_tag_free(MEM_HASH, &ptr, sizeof(struct HashElem));
         return NULL;
       }
       if (r > 0)
@@ -208,6 +248,11 @@ static struct HashElem *union_hash_insert(struct Hash *table, union HashKey key,
       table->table[h] = ptr;
     ptr->next = tmp;
   }
+
+  table->count++;
+  if (table->count > HASH_MAX_LOAD * table->nelem)
+    hash_grow(table);
+
   return ptr;
 }
 
@@ -273,11 +318,12 @@ static void union_hash_delete(struct Hash *table, union HashKey key, const void
     if ((data == ptr->data || !data) && table->cmp_key(ptr->key, key) == 0)
     {
       *last = ptr->next;
+      table->count--;
       if (table->destroy)
         table->destroy(ptr->type, ptr->data, table->dest_data);
       if (table->strdup_keys)
         FREE(&ptr->key.strkey);
-      FREE(&ptr);
+      mutt_mem_tag_free(MEM_HASH, &ptr, sizeof(struct HashElem));
 
       ptr = *last;
     }
@@ -494,11 +540,11 @@ void mutt_hash_destroy(struct Hash **ptr)
         pptr->destroy(tmp->type, tmp->data, pptr->dest_data);
       if (pptr->strdup_keys)
         FREE(&tmp->key.strkey);
-      FREE(&tmp);
+      mutt_mem_tag_free(MEM_HASH, &tmp, sizeof(struct HashElem));
     }
   }
-  FREE(&pptr->table);
-  FREE(ptr);
+  mutt_mem_tag_free(MEM_HASH, &pptr->table, pptr->nelem * sizeof(struct HashElem *));
+  mutt_mem_tag_free(MEM_HASH, ptr, sizeof(struct Hash));
 }
 
 /**
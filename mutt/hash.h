@@ -53,7 +53,8 @@ typedef void (*hash_destructor)(int type, void *obj, intptr_t data);
  */
 struct Hash
 {
-  int nelem;
+  int nelem;            /**< Number of buckets */
+  int count;            /**< Number of elements */
   bool strdup_keys : 1; /**< if set, the key->strkey is strdup'ed */
   bool allow_dups  : 1; /**< if set, duplicate keys are allowed */
   struct HashElem **table;
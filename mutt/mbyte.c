@@ -27,6 +27,7 @@
  *
  * | Function                             | Description
  * | :----------------------------------- | :---------------------------------------------------------
+ * | mutt_mb_ascii_run()                  | Count the printable ASCII characters at the start of a string
  * | mutt_mb_charlen()                    | Count the bytes in a (multibyte) character
  * | mutt_mb_filter_unprintable()         | Replace unprintable characters
  * | mutt_mb_get_initials()               | Turn a name into initials
@@ -46,6 +47,7 @@
 #include <ctype.h>
 #include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
@@ -57,6 +59,38 @@
 
 bool OPT_LOCALES; /**< (pseudo) set if user has valid locale definition */
 
+#define ONES (UINT64_MAX / 0xff) /* 0x0101010101010101 */
+#define HIGHS (ONES * 0x80)
+
+/**
+ * mutt_mb_ascii_run - Count the printable ASCII characters at the start of a string
+ * @param s String to examine
+ * @param n Maximum number of bytes to examine
+ * @retval num Number of leading bytes in the range 0x20-0x7e
+ *
+ * In the initial shift state, each of these is a one-column character in any
+ * locale, so they can be measured and copied without mbrtowc().  The string is
+ * checked eight bytes at a time.
+ */
+size_t mutt_mb_ascii_run(const char *s, size_t n)
+{
+  size_t i = 0;
+
+  for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t))
+  {
+    uint64_t x;
+    memcpy(&x, s + i, sizeof(x));
+    /* a byte below 0x20, or one at or above 0x7f */
+    if (((x - ONES * 0x20) & ~x & HIGHS) || ((x | (x + ONES)) & HIGHS))
+      break;
+  }
+
+  for (; (i < n) && ((unsigned char) s[i] >= 0x20) && ((unsigned char) s[i] < 0x7f); i++)
+    ;
+
+  return i;
+}
+
 /**
  * mutt_mb_charlen - Count the bytes in a (multibyte) character
  * @param[in]  s     String to be examined
@@ -158,26 +192,37 @@ int mutt_mb_width(const char *str, int col, bool display)
 
   while (p && *p)
   {
-    if (mbtowc(&wc, p, MB_CUR_MAX) >= 0)
+    if ((unsigned char) *p < 0x80)
+    {
+      /* ASCII is the same in every locale, and one column wide */
+      wc = *p;
+      l = 1;
+    }
+    else if (mbtowc(&wc, p, MB_CUR_MAX) >= 0)
     {
       l = wcwidth(wc);
       if (l < 0)
         l = 1;
-      /* correctly calc tab stop, even for sending as the
-       * line should look pretty on the receiving end */
-      if (wc == L'\t' || (nl && wc == L' '))
-      {
-        nl = 0;
-        l = 8 - (col % 8);
-      }
-      /* track newlines for display-case: if we have a space
-       * after a newline, assume 8 spaces as for display we
-       * always tab-fold */
-      else if (display && (wc == '\n'))
-        nl = 1;
     }
     else
+    {
+      wc = 0;
       l = 1;
+    }
+
+    /* correctly calc tab stop, even for sending as the
+     * line should look pretty on the receiving end */
+    if (wc == L'\t' || (nl && wc == L' '))
+    {
+      nl = 0;
+      l = 8 - (col % 8);
+    }
+    /* track newlines for display-case: if we have a space
+     * after a newline, assume 8 spaces as for display we
+     * always tab-fold */
+    else if (display && (wc == '\n'))
+      nl = 1;
+
     w += l;
     p++;
   }
@@ -41,6 +41,7 @@ extern bool OPT_LOCALES;
 #define IsWPrint(wc) (iswprint(wc) || (OPT_LOCALES ? 0 : (wc >= 0xa0)))
 #endif
 
+size_t mutt_mb_ascii_run(const char *s, size_t n);
 int    mutt_mb_charlen(const char *s, int *width);
 bool   mutt_mb_get_initials(const char *name, char *buf, int buflen);
 bool   mutt_mb_is_lower(const char *s);
@@ -28,12 +28,23 @@
  * @note If any of the allocators fail, the user is notified and the program is
  *       stopped immediately.
  *
- * | Function           | Description
- * | :----------------- | :-----------------------------------
- * | mutt_mem_calloc()  | Allocate zeroed memory on the heap
- * | mutt_mem_free()    | Release memory allocated on the heap
- * | mutt_mem_malloc()  | Allocate memory on the heap
- * | mutt_mem_realloc() | Resize a block of memory on the heap
+ * The big consumers of memory, e.g. headers, hash tables and the pager, can
+ * use the tagged allocators, which keep the number of bytes and blocks each
+ * subsystem holds, and the peak.  The caller passes the size back when freeing,
+ * so there's no per-block overhead.  Memory allocated by other means can be
+ * counted with mutt_mem_account().  The counters aren't locked: only the main
+ * thread may use them.
+ *
+ * | Function               | Description
+ * | :--------------------- | :-----------------------------------
+ * | mutt_mem_account()     | Count memory held by a subsystem
+ * | mutt_mem_calloc()      | Allocate zeroed memory on the heap
+ * | mutt_mem_free()        | Release memory allocated on the heap
+ * | mutt_mem_malloc()      | Allocate memory on the heap
+ * | mutt_mem_realloc()     | Resize a block of memory on the heap
+ * | mutt_mem_tag_calloc()  | Allocate zeroed memory for a subsystem
+ * | mutt_mem_tag_free()    | Release memory of a subsystem
+ * | mutt_mem_tag_realloc() | Resize a block of memory of a subsystem
  */
 
 #include "config.h"
@@ -44,6 +55,8 @@
 #include "exit.h"
 #include "message.h"
 
+struct MemTagStats MemTagStats[MEM_TAG_MAX]; /**< Memory held by each subsystem */
+
 /**
  * mutt_mem_calloc - Allocate zeroed memory on the heap
  * @param nmemb Number of blocks
@@ -156,3 +169,74 @@ void mutt_mem_realloc(void *ptr, size_t size)
 
   *p = r;
 }
+
+/**
+ * mutt_mem_account - Count memory held by a subsystem
+ * @param tag   Subsystem, e.g. #MEM_HASH
+ * @param bytes Bytes allocated, or negative if freed
+ */
+void mutt_mem_account(enum MemTag tag, long long bytes)
+{
+  struct MemTagStats *ms = &MemTagStats[tag];
+
+  ms->current += bytes;
+  if (ms->current > ms->peak)
+    ms->peak = ms->current;
+}
+
+/**
+ * mutt_mem_tag_calloc - Allocate zeroed memory for a subsystem
+ * @param tag   Subsystem, e.g. #MEM_HEADER
+ * @param nmemb Number of blocks
+ * @param size  Size of blocks
+ * @retval ptr Memory on the heap
+ *
+ * Release the memory with mutt_mem_tag_free(), giving the same size.
+ */
+void *mutt_mem_tag_calloc(enum MemTag tag, size_t nmemb, size_t size)
+{
+  void *p = mutt_mem_calloc(nmemb, size);
+
+  if (p)
+  {
+    MemTagStats[tag].blocks++;
+    mutt_mem_account(tag, nmemb * size);
+  }
+  return p;
+}
+
+/**
+ * mutt_mem_tag_free - Release memory of a subsystem
+ * @param tag  Subsystem, e.g. #MEM_HEADER
+ * @param ptr  Memory to release
+ * @param size Size it was allocated with
+ */
+void mutt_mem_tag_free(enum MemTag tag, void *ptr, size_t size)
+{
+  void **p = (void **) ptr;
+
+  if (!p || !*p)
+    return;
+
+  MemTagStats[tag].blocks--;
+  mutt_mem_account(tag, -(long long) size);
+  mutt_mem_free(ptr);
+}
+
+/**
+ * mutt_mem_tag_realloc - Resize a block of memory of a subsystem
+ * @param tag     Subsystem, e.g. #MEM_PAGER
+ * @param ptr     Memory block to resize
+ * @param oldsize Current size, zero if the block hasn't been allocated
+ * @param size    New size, zero to free the block
+ */
+void mutt_mem_tag_realloc(enum MemTag tag, void *ptr, size_t oldsize, size_t size)
+{
+  mutt_mem_realloc(ptr, size);
+
+  if ((oldsize == 0) && (size != 0))
+    MemTagStats[tag].blocks++;
+  else if ((oldsize != 0) && (size == 0))
+    MemTagStats[tag].blocks--;
+  mutt_mem_account(tag, (long long) size - (long long) oldsize);
+}
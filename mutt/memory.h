@@ -32,11 +32,44 @@
 
 #define mutt_array_size(x) (sizeof(x) / sizeof((x)[0]))
 
+/**
+ * enum MemTag - Subsystems whose memory is accounted for
+ */
+enum MemTag
+{
+  MEM_HEADER = 0, /**< Email headers, struct Header */
+  MEM_ENVELOPE,   /**< Envelopes, struct Envelope */
+  MEM_BODY,       /**< MIME parts, struct Body */
+  MEM_HASH,       /**< Hash tables and their elements */
+  MEM_HCACHE,     /**< Header cache records waiting to be written, and batches */
+  MEM_PAGER,      /**< Line info of the pager */
+  MEM_BCACHE,     /**< Index of the body cache pack */
+  MEM_IMAP,       /**< IMAP response buffers and command queues */
+  MEM_TAG_MAX,
+};
+
+/**
+ * struct MemTagStats - Memory held by a subsystem
+ */
+struct MemTagStats
+{
+  long blocks;       /**< Number of blocks held now */
+  long long current; /**< Bytes held now */
+  long long peak;    /**< Most bytes ever held */
+};
+
+extern struct MemTagStats MemTagStats[MEM_TAG_MAX];
+
 void *mutt_mem_calloc(size_t nmemb, size_t size);
 void  mutt_mem_free(void *ptr);
 void *mutt_mem_malloc(size_t size);
 void  mutt_mem_realloc(void *ptr, size_t size);
 
+void  mutt_mem_account(enum MemTag tag, long long bytes);
+void *mutt_mem_tag_calloc(enum MemTag tag, size_t nmemb, size_t size);
+void  mutt_mem_tag_free(enum MemTag tag, void *ptr, size_t size);
+void  mutt_mem_tag_realloc(enum MemTag tag, void *ptr, size_t oldsize, size_t size);
+
 #define FREE(x) mutt_mem_free(x)
 
 #endif /* _MUTT_MEMORY_H */
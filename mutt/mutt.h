@@ -49,6 +49,7 @@
  * | mutt/sha1.c      | @subpage sha1      |
  * | mutt/signal.c    | @subpage signal    |
  * | mutt/string.c    | @subpage string    |
+ * | mutt/worker.c    | @subpage worker    |
  *
  * @note The library is self-contained -- some files may depend on others in
  *       the library, but none depends on source from outside.
@@ -79,5 +80,6 @@
 #include "sha1.h"
 #include "signal2.h"
 #include "string2.h"
+#include "worker.h"
 
 #endif /* _MUTT_MUTT_H */
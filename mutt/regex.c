@@ -30,6 +30,7 @@
  * | mutt_regex_compile()      | Create an Regex from a string
  * | mutt_regex_create()       | Create an Regex from a string
  * | mutt_regex_free()         | Free a Regex object
+ * | mutt_regex_literal()      | Find the text that every match must contain
  * | mutt_regexlist_add()      | Compile a regex string and add it to a list
  * | mutt_regexlist_free()     | Free a RegexList object
  * | mutt_regexlist_match()    | Does a string match any Regex in the list?
@@ -58,6 +59,206 @@
 #include "regex3.h"
 #include "string2.h"
 
+/**
+ * skip_bracket - Skip a bracket expression
+ * @param s Regex, at the '['
+ * @retval ptr The closing ']'
+ * @retval NULL The expression isn't closed
+ */
+static const char *skip_bracket(const char *s)
+{
+  s++;
+  if (*s == '^')
+    s++;
+  if (*s == ']')
+    s++;
+
+  while (*s && (*s != ']'))
+  {
+    /* [:class:], [.coll.] and [=equiv=] may contain a ']' */
+    if ((s[0] == '[') && ((s[1] == ':') || (s[1] == '.') || (s[1] == '=')))
+    {
+      const char end = s[1];
+      for (s += 2; *s && !((s[0] == end) && (s[1] == ']')); s++)
+        ;
+      if (!*s)
+        return NULL;
+      s += 2;
+      continue;
+    }
+    s++;
+  }
+
+  return *s ? s : NULL;
+}
+
+/**
+ * skip_group - Skip a parenthesised group
+ * @param s Regex, at the '('
+ * @retval ptr The matching ')'
+ * @retval NULL The group isn't closed
+ */
+static const char *skip_group(const char *s)
+{
+  int depth = 0;
+
+  for (; *s; s++)
+  {
+    if (*s == '\\')
+    {
+      if (!*++s)
+        return NULL;
+    }
+    else if (*s == '[')
+    {
+      s = skip_bracket(s);
+      if (!s)
+        return NULL;
+    }
+    else if (*s == '(')
+      depth++;
+    else if ((*s == ')') && (--depth == 0))
+      return s;
+  }
+
+  return NULL;
+}
+
+/**
+ * mutt_regex_literal - Find the text that every match must contain
+ * @param[in]  str   Extended regular expression
+ * @param[out] exact Set to true if the regex matches only that text
+ * @retval ptr Longest text that any match must contain, must be freed
+ * @retval NULL Nothing useful could be found
+ *
+ * A string without the text can't match, which strstr() finds out much more
+ * quickly than regexec().  The search is conservative: anything unusual, or a
+ * top-level alternation, gives up.  Only ASCII text is returned, so that
+ * strcasestr() agrees with REG_ICASE.
+ */
+char *mutt_regex_literal(const char *str, bool *exact)
+{
+  if (exact)
+    *exact = false;
+  if (!str || !*str)
+    return NULL;
+
+  size_t len = strlen(str);
+  char *run = mutt_mem_malloc(len + 1);
+  char *best = mutt_mem_malloc(len + 1);
+  size_t rlen = 0, blen = 0;
+  bool whole = true;
+
+  for (const char *p = str;; p++)
+  {
+    char c = *p;
+    bool end = false;
+
+    switch (c)
+    {
+      case '\0':
+        end = true;
+        break;
+      case '\\':
+        /* an escaped punctuation character is itself, except for the anchors
+         * \< \> \` \' */
+        if (((unsigned char) p[1] < 0x80) && ispunct((unsigned char) p[1]) &&
+            !strchr("<>`'", p[1]))
+        {
+          run[rlen++] = *++p;
+          continue;
+        }
+        whole = false;
+        end = true;
+        if (p[1])
+          p++;
+        break;
+      case '.':
+      case '^':
+      case '$':
+        whole = false;
+        end = true;
+        break;
+      case '[':
+      case '(':
+        whole = false;
+        end = true;
+        p = (c == '[') ? skip_bracket(p) : skip_group(p);
+        if (!p)
+          goto fail;
+        break;
+      case '*':
+      case '?':
+      case '{':
+        /* the previous character may not be there at all */
+        if (rlen > 0)
+          rlen--;
+        whole = false;
+        end = true;
+        if ((c == '{') && !(p = strchr(p, '}')))
+          goto fail;
+        break;
+      case '+':
+        whole = false;
+        end = true;
+        break;
+      case '|':
+      case ')':
+        goto fail;
+      default:
+        if ((unsigned char) c >= 0x80)
+        {
+          whole = false;
+          end = true;
+          break;
+        }
+        run[rlen++] = c;
+        continue;
+    }
+
+    if (end)
+    {
+      if (rlen > blen)
+      {
+        memcpy(best, run, rlen);
+        blen = rlen;
+      }
+      rlen = 0;
+    }
+    if (c == '\0')
+      break;
+  }
+
+  FREE(&run);
+  if (blen == 0)
+  {
+    FREE(&best);
+    return NULL;
+  }
+  best[blen] = '\0';
+  if (exact)
+    *exact = whole;
+  return best;
+
+fail:
+  FREE(&run);
+  FREE(&best);
+  return NULL;
+}
+
+/**
+ * regex_may_match - Could a string match a Regex?
+ * @param r   Regex
+ * @param str String to test
+ * @retval true The string contains the Regex's literal, if it has one
+ */
+static bool regex_may_match(const struct Regex *r, const char *str)
+{
+  if (!r->literal)
+    return true;
+  return r->icase ? strcasestr(str, r->literal) : strstr(str, r->literal);
+}
+
 /**
  * mutt_regex_compile - Create an Regex from a string
  * @param str   Regular expression
@@ -72,6 +273,11 @@ struct Regex *mutt_regex_compile(const char *str, int flags)
   r->regex = mutt_mem_calloc(1, sizeof(regex_t));
   if (REGCOMP(r->regex, NONULL(str), flags) != 0)
     mutt_regex_free(&r);
+  else
+  {
+    r->literal = mutt_regex_literal(str, NULL);
+    r->icase = (flags & REG_ICASE);
+  }
 
   return r;
 }
@@ -114,6 +320,9 @@ struct Regex *mutt_regex_create(const char *str, int flags, struct Buffer *err)
     return NULL;
   }
 
+  reg->literal = mutt_regex_literal(str, NULL);
+  reg->icase = (rflags & REG_ICASE);
+
   return reg;
 }
 
@@ -127,6 +336,7 @@ void mutt_regex_free(struct Regex **r)
     return;
 
   FREE(&(*r)->pattern);
+  FREE(&(*r)->literal);
   if ((*r)->regex)
     regfree((*r)->regex);
   FREE(&(*r)->regex);
@@ -217,7 +427,7 @@ bool mutt_regexlist_match(struct RegexList *rl, const char *str)
 
   for (; rl; rl = rl->next)
   {
-    if (!rl->regex || !rl->regex->regex)
+    if (!rl->regex || !rl->regex->regex || !regex_may_match(rl->regex, str))
       continue;
     if (regexec(rl->regex->regex, str, (size_t) 0, (regmatch_t *) 0, (int) 0) == 0)
     {
@@ -424,7 +634,8 @@ char *mutt_replacelist_apply(struct ReplaceList *rl, char *buf, size_t buflen, c
       nmatch = l->nmatch;
     }
 
-    if (regexec(l->regex->regex, src, l->nmatch, pmatch, 0) == 0)
+    if (regex_may_match(l->regex, src) &&
+        (regexec(l->regex->regex, src, l->nmatch, pmatch, 0) == 0))
     {
       tlen = 0;
       switcher ^= 1;
@@ -536,7 +747,8 @@ bool mutt_replacelist_match(struct ReplaceList *rl, char *buf, size_t buflen, co
     }
 
     /* Does this pattern match? */
-    if (regexec(rl->regex->regex, str, (size_t) rl->nmatch,
+    if (regex_may_match(rl->regex, str) &&
+        regexec(rl->regex->regex, str, (size_t) rl->nmatch,
                 (regmatch_t *) pmatch, (int) 0) == 0)
     {
       mutt_debug(5, "%s matches %s\n", str, rl->regex->pattern);
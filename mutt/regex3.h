@@ -64,6 +64,8 @@ struct Regex
   char *pattern;  /**< printable version */
   regex_t *regex; /**< compiled expression */
   bool not;       /**< do not match */
+  char *literal;  /**< text every match contains, see mutt_regex_literal() */
+  bool icase;     /**< the expression ignores case */
 };
 
 /**
@@ -89,6 +91,7 @@ struct ReplaceList
 struct Regex *      mutt_regex_compile(const char *str, int flags);
 struct Regex *      mutt_regex_create(const char *str, int flags, struct Buffer *err);
 void                mutt_regex_free(struct Regex **r);
+char *              mutt_regex_literal(const char *str, bool *exact);
 
 int                 mutt_regexlist_add(struct RegexList **rl, const char *str, int flags, struct Buffer *err);
 void                mutt_regexlist_free(struct RegexList **rl);
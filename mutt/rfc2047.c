@@ -222,11 +222,11 @@ static size_t try_block(const char *d, size_t dlen, const char *fromcode,
         iconv(cd, NULL, NULL, &ob, &obl) == (size_t)(-1))
     {
       assert(errno == E2BIG);
-      iconv_close(cd);
+      mutt_ch_iconv_close(cd);
       assert(ib > d);
       return (ib - d == dlen) ? dlen : ib - d + 1;
     }
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
   }
   else
   {
@@ -302,7 +302,7 @@ static size_t encode_block(char *str, char *buf, size_t buflen, const char *from
     n1 = iconv(cd, (ICONV_CONST char **) &ib, &ibl, &ob, &obl);
     n2 = iconv(cd, NULL, NULL, &ob, &obl);
     assert(n1 != (size_t)(-1) && n2 != (size_t)(-1));
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
     return (*encoder)(str, tmp, ob - tmp, tocode);
   }
   else
@@ -661,6 +661,19 @@ void mutt_rfc2047_decode(char **pd)
   if (!pd || !*pd)
     return;
 
+  /* Most headers have no encoded words, and they'd be copied unchanged */
+  if (!strstr(*pd, "=?"))
+  {
+    if (!AssumedCharset || !*AssumedCharset)
+      return;
+
+    const unsigned char *p = (const unsigned char *) *pd;
+    while (*p && (*p < 0x80))
+      p++;
+    if (!*p)
+      return;
+  }
+
   struct Buffer buf = { 0 }; /* Output buffer                          */
   char *s = *pd;             /* Read pointer                           */
   char *beg;                 /* Begin of encoded word                  */
@@ -34,6 +34,7 @@
  * | mutt_str_atos()               | Convert ASCII string to a short
  * | mutt_str_atoui()              | Convert ASCII string to an unsigned integer
  * | mutt_str_atoul()              | Convert ASCII string to an unsigned long
+ * | mutt_str_atoull()             | Convert ASCII string to an unsigned long long
  * | mutt_str_dequote_comment()    | Un-escape characters in an email address comment
  * | mutt_str_find_word()          | Find the next word (non-space)
  * | mutt_str_getenv()             | Get an environment variable
@@ -314,6 +315,41 @@ int mutt_str_atoul(const char *str, unsigned long *dst)
     return 1;
   return 0;
 }
+
+/**
+ * mutt_str_atoull - Convert ASCII string to an unsigned long long
+ * @param[in]  str String to read
+ * @param[out] dst Store the result
+ * @retval  1 Successful conversion, with trailing characters
+ * @retval  0 Successful conversion
+ * @retval -1 Invalid input
+ *
+ * @note
+ * This function's return value differs from the other functions.
+ * They return -1 if there is input beyond the number.
+ */
+int mutt_str_atoull(const char *str, unsigned long long *dst)
+{
+  unsigned long long r = 0;
+  unsigned long long *res = dst ? dst : &r;
+  char *e = NULL;
+
+  /* no input: 0 */
+  if (!str || !*str)
+  {
+    *res = 0;
+    return 0;
+  }
+
+  errno = 0;
+  *res = strtoull(str, &e, 10);
+  if ((*res == ULLONG_MAX) && (errno == ERANGE))
+    return -1;
+  if (e && (*e != '\0'))
+    return 1;
+  return 0;
+}
+
 /**
  * mutt_str_strdup - Copy a string, safely
  * @param s String to copy
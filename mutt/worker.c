@@ -0,0 +1,541 @@
+/**
+ * @file
+ * Worker threads
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page worker Worker threads
+ *
+ * One pool of threads, of up to $threads, is shared by everything that works
+ * in parallel.  The threads are started when there's work for them and are
+ * kept for the next job.
+ *
+ * Most of NeoMutt uses global state, so the jobs must only do work which
+ * doesn't touch it, e.g. reading files into the page cache.  The signals are
+ * left to the main thread.
+ *
+ * A single job is submitted with mutt_worker_submit().  Its result is
+ * delivered in the main thread, by mutt_worker_complete(), which the keyboard
+ * wait calls when mutt_worker_fd() becomes readable.  A group of jobs sharing
+ * some work, e.g. a list of files, is started with mutt_worker_group_start()
+ * and waited for with mutt_worker_group_wait().
+ *
+ * Jobs must not wait for each other: when the pool is busy, a job is queued
+ * until a thread is free.
+ *
+ * | Function                  | Description
+ * | :------------------------ | :-----------------------------------------------
+ * | mutt_worker_cancel()      | Cancel a job
+ * | mutt_worker_cancelled()   | Has the running job been cancelled?
+ * | mutt_worker_complete()    | Deliver the results of the finished jobs
+ * | mutt_worker_fd()          | Get a file descriptor which is readable when a job finishes
+ * | mutt_worker_group_start() | Start a group of jobs
+ * | mutt_worker_group_wait()  | Wait for a group of jobs to finish
+ * | mutt_worker_pending()     | Count the jobs whose results haven't been delivered
+ * | mutt_worker_shutdown()    | Stop the pool
+ * | mutt_worker_submit()      | Queue a job
+ */
+
+#include "config.h"
+#include <stdbool.h>
+#include "worker.h"
+
+short Threads; /**< Config: Size of the pool of worker threads */
+
+#ifdef HAVE_PTHREAD_CREATE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include "memory.h"
+#include "queue.h"
+
+/* Most threads the pool will start, whatever $threads says */
+#define WORKER_MAX_THREADS 64
+
+/**
+ * enum WorkerJobState - Where a job is
+ */
+enum WorkerJobState
+{
+  JOB_QUEUED = 0, /**< Waiting for a thread */
+  JOB_RUNNING,    /**< Being run by a thread */
+  JOB_FINISHED,   /**< Waiting for mutt_worker_complete() */
+};
+
+/**
+ * struct WorkerJob - A job for the pool
+ */
+struct WorkerJob
+{
+  worker_t fn;               /**< Body of the job */
+  worker_done_t done;        /**< Delivers the result, may be NULL */
+  void *arg;                 /**< Private data */
+  void *result;              /**< Result of fn */
+  struct WorkerGroup *group; /**< Group of the job, NULL for a single job */
+  enum WorkerJobState state; /**< Where the job is */
+  bool cancelled;            /**< The job was cancelled */
+  TAILQ_ENTRY(WorkerJob) entries;
+};
+TAILQ_HEAD(WorkerJobList, WorkerJob);
+
+/**
+ * struct WorkerPool - The threads and their jobs
+ *
+ * Everything but pending and wake[0] is protected by the lock.
+ */
+static struct WorkerPool
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;           /**< Signalled when a job is queued or the pool shrinks */
+  pthread_cond_t exited;         /**< Signalled when a thread leaves the pool */
+  struct WorkerJobList queued;   /**< Jobs waiting for a thread */
+  struct WorkerJobList running;  /**< Single jobs being run */
+  struct WorkerJobList finished; /**< Single jobs waiting to be delivered */
+  int size;                      /**< Threads wanted, from $threads */
+  int nthreads;                  /**< Threads running */
+  int busy;                      /**< Threads running a job */
+  int nqueued;                   /**< Jobs waiting for a thread */
+  int pending;                   /**< Single jobs not delivered, main thread only */
+  int wake[2];                   /**< Pipe, written when a job finishes */
+  pthread_key_t current;         /**< Job being run by this thread */
+  pthread_once_t once;           /**< Creates current */
+} Pool = {
+  .lock = PTHREAD_MUTEX_INITIALIZER,
+  .cond = PTHREAD_COND_INITIALIZER,
+  .exited = PTHREAD_COND_INITIALIZER,
+  .queued = TAILQ_HEAD_INITIALIZER(Pool.queued),
+  .running = TAILQ_HEAD_INITIALIZER(Pool.running),
+  .finished = TAILQ_HEAD_INITIALIZER(Pool.finished),
+  .wake = { -1, -1 },
+  .once = PTHREAD_ONCE_INIT,
+};
+
+/**
+ * pool_key_create - Create the key for the running job
+ */
+static void pool_key_create(void)
+{
+  pthread_key_create(&Pool.current, NULL);
+}
+
+/**
+ * pool_finish - Move a single job to the finished list
+ * @param job    Job
+ * @param result Result of the job
+ *
+ * The lock must be held.  The pipe is only written when the list was empty,
+ * so mutt_worker_complete() never has much to read.
+ */
+static void pool_finish(struct WorkerJob *job, void *result)
+{
+  bool wake = TAILQ_EMPTY(&Pool.finished);
+
+  job->result = result;
+  job->state = JOB_FINISHED;
+  TAILQ_INSERT_TAIL(&Pool.finished, job, entries);
+
+  if (wake && (Pool.wake[1] >= 0))
+  {
+    while ((write(Pool.wake[1], "", 1) < 0) && (errno == EINTR))
+      ;
+  }
+}
+
+/**
+ * pool_thread - Run jobs until the pool shrinks
+ * @param arg Not used
+ * @retval NULL Always
+ */
+static void *pool_thread(void *arg)
+{
+  pthread_mutex_lock(&Pool.lock);
+  /* If the pool is emptied, the last thread finishes the queue */
+  while ((Pool.nthreads <= Pool.size) ||
+         ((Pool.nthreads == 1) && !TAILQ_EMPTY(&Pool.queued)))
+  {
+    struct WorkerJob *job = TAILQ_FIRST(&Pool.queued);
+    if (!job)
+    {
+      pthread_cond_wait(&Pool.cond, &Pool.lock);
+      continue;
+    }
+
+    TAILQ_REMOVE(&Pool.queued, job, entries);
+    Pool.nqueued--;
+    Pool.busy++;
+    job->state = JOB_RUNNING;
+    if (!job->group)
+      TAILQ_INSERT_TAIL(&Pool.running, job, entries);
+    pthread_mutex_unlock(&Pool.lock);
+
+    pthread_setspecific(Pool.current, job);
+    void *result = job->fn(job->arg);
+    pthread_setspecific(Pool.current, NULL);
+
+    pthread_mutex_lock(&Pool.lock);
+    Pool.busy--;
+    if (job->group)
+    {
+      if (--job->group->pending == 0)
+        pthread_cond_broadcast(&job->group->cond);
+      FREE(&job);
+    }
+    else
+    {
+      TAILQ_REMOVE(&Pool.running, job, entries);
+      pool_finish(job, result);
+    }
+  }
+  Pool.nthreads--;
+  pthread_cond_broadcast(&Pool.exited);
+  pthread_mutex_unlock(&Pool.lock);
+
+  return NULL;
+}
+
+/**
+ * pool_resize - Size the pool from $threads
+ *
+ * Spare threads leave the pool when they're next idle.
+ */
+static void pool_resize(void)
+{
+  int size = (Threads < 0) ? 0 : MIN(Threads, WORKER_MAX_THREADS);
+
+  pthread_mutex_lock(&Pool.lock);
+  if (size < Pool.size)
+    pthread_cond_broadcast(&Pool.cond);
+  Pool.size = size;
+  pthread_mutex_unlock(&Pool.lock);
+}
+
+/**
+ * pool_grow - Start enough threads for the queued jobs
+ *
+ * The lock must be held.  The threads are started with all signals blocked.
+ */
+static void pool_grow(void)
+{
+  sigset_t all, old;
+  pthread_attr_t attr;
+  pthread_t thread;
+
+  if ((Pool.nthreads >= Pool.size) || (Pool.nthreads - Pool.busy >= Pool.nqueued))
+    return;
+
+  pthread_once(&Pool.once, pool_key_create);
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+
+  /* Idle threads, and those still starting, will take some of the jobs */
+  while ((Pool.nthreads < Pool.size) && (Pool.nthreads - Pool.busy < Pool.nqueued))
+  {
+    if (pthread_create(&thread, &attr, pool_thread, NULL) != 0)
+      break;
+    Pool.nthreads++;
+  }
+
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  pthread_attr_destroy(&attr);
+}
+
+/**
+ * wake_open - Create the pipe for the finished jobs
+ * @retval true Success
+ */
+static bool wake_open(void)
+{
+  if (Pool.wake[0] >= 0)
+    return true;
+
+  int fds[2];
+  if (pipe(fds) < 0)
+    return false;
+
+  for (int i = 0; i < 2; i++)
+  {
+    fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+  }
+
+  pthread_mutex_lock(&Pool.lock);
+  Pool.wake[0] = fds[0];
+  Pool.wake[1] = fds[1];
+  pthread_mutex_unlock(&Pool.lock);
+  return true;
+}
+
+/**
+ * mutt_worker_submit - Queue a job
+ * @param fn   Body of the job
+ * @param done Delivers the result in the main thread, may be NULL
+ * @param arg  Private data, passed to both
+ * @retval ptr  Job
+ * @retval NULL The pool has no threads, the caller should do the work itself
+ *
+ * The job is valid until its result has been delivered by
+ * mutt_worker_complete().
+ */
+struct WorkerJob *mutt_worker_submit(worker_t fn, worker_done_t done, void *arg)
+{
+  pool_resize();
+  if ((Pool.size == 0) || !wake_open())
+    return NULL;
+
+  struct WorkerJob *job = mutt_mem_calloc(1, sizeof(struct WorkerJob));
+  job->fn = fn;
+  job->done = done;
+  job->arg = arg;
+
+  pthread_mutex_lock(&Pool.lock);
+  TAILQ_INSERT_TAIL(&Pool.queued, job, entries);
+  Pool.nqueued++;
+  pool_grow();
+  if (Pool.nthreads == 0)
+  {
+    TAILQ_REMOVE(&Pool.queued, job, entries);
+    Pool.nqueued--;
+    pthread_mutex_unlock(&Pool.lock);
+    FREE(&job);
+    return NULL;
+  }
+  pthread_cond_signal(&Pool.cond);
+  pthread_mutex_unlock(&Pool.lock);
+
+  Pool.pending++;
+  return job;
+}
+
+/**
+ * mutt_worker_cancel - Cancel a job
+ * @param job Job, from mutt_worker_submit()
+ *
+ * A queued job won't be run.  A running job can notice, with
+ * mutt_worker_cancelled(), and give up early.  Either way, the result is
+ * still delivered, flagged as cancelled.
+ */
+void mutt_worker_cancel(struct WorkerJob *job)
+{
+  if (!job)
+    return;
+
+  pthread_mutex_lock(&Pool.lock);
+  job->cancelled = true;
+  if (job->state == JOB_QUEUED)
+  {
+    TAILQ_REMOVE(&Pool.queued, job, entries);
+    Pool.nqueued--;
+    pool_finish(job, NULL);
+  }
+  pthread_mutex_unlock(&Pool.lock);
+}
+
+/**
+ * mutt_worker_cancelled - Has the running job been cancelled?
+ * @retval true The job should give up
+ *
+ * This is called from inside a job.  Jobs in a group are never cancelled.
+ */
+bool mutt_worker_cancelled(void)
+{
+  pthread_once(&Pool.once, pool_key_create);
+  struct WorkerJob *job = pthread_getspecific(Pool.current);
+  if (!job)
+    return false;
+
+  pthread_mutex_lock(&Pool.lock);
+  bool cancelled = job->cancelled;
+  pthread_mutex_unlock(&Pool.lock);
+  return cancelled;
+}
+
+/**
+ * mutt_worker_complete - Deliver the results of the finished jobs
+ * @retval num Number of jobs delivered
+ *
+ * This must be called from the main thread.  It doesn't wait.
+ */
+int mutt_worker_complete(void)
+{
+  struct WorkerJobList done = TAILQ_HEAD_INITIALIZER(done);
+  char buf[64];
+  ssize_t len;
+  int n = 0;
+
+  if (Pool.pending == 0)
+    return 0;
+
+  /* empty the pipe before the list, so no finished job is missed */
+  while (((len = read(Pool.wake[0], buf, sizeof(buf))) > 0) || ((len < 0) && (errno == EINTR)))
+    ;
+
+  pthread_mutex_lock(&Pool.lock);
+  TAILQ_CONCAT(&done, &Pool.finished, entries);
+  pthread_mutex_unlock(&Pool.lock);
+
+  struct WorkerJob *job = NULL, *tmp = NULL;
+  TAILQ_FOREACH_SAFE(job, &done, entries, tmp)
+  {
+    Pool.pending--;
+    n++;
+    if (job->done)
+      job->done(job->arg, job->result, job->cancelled);
+    FREE(&job);
+  }
+
+  return n;
+}
+
+/**
+ * mutt_worker_fd - Get a file descriptor which is readable when a job finishes
+ * @retval >=0 File descriptor, for poll(2)
+ * @retval -1  No job has been submitted
+ *
+ * Don't read from it, call mutt_worker_complete() instead.
+ */
+int mutt_worker_fd(void)
+{
+  return Pool.wake[0];
+}
+
+/**
+ * mutt_worker_pending - Count the jobs whose results haven't been delivered
+ * @retval num Number of single jobs, queued, running or finished
+ */
+int mutt_worker_pending(void)
+{
+  return Pool.pending;
+}
+
+/**
+ * mutt_worker_group_start - Start a group of jobs
+ * @param group Group, uninitialised
+ * @param want  Number of jobs
+ * @param fn    Body of each job
+ * @param arg   Private data, passed to every job
+ * @retval num Number of jobs queued, may be fewer than @a want
+ *
+ * The jobs are expected to share some work, taking it from @a arg, so it
+ * doesn't matter how many of them run at once.  If this returns 0, the caller
+ * should do the work itself.  Otherwise, wait with mutt_worker_group_wait().
+ */
+int mutt_worker_group_start(struct WorkerGroup *group, int want, worker_t fn, void *arg)
+{
+  pool_resize();
+  want = MIN(want, Pool.size);
+  if (want < 1)
+    return 0;
+
+  pthread_cond_init(&group->cond, NULL);
+  group->pending = 0;
+
+  pthread_mutex_lock(&Pool.lock);
+  for (int i = 0; i < want; i++)
+  {
+    struct WorkerJob *job = mutt_mem_calloc(1, sizeof(struct WorkerJob));
+    job->fn = fn;
+    job->arg = arg;
+    job->group = group;
+    TAILQ_INSERT_TAIL(&Pool.queued, job, entries);
+    Pool.nqueued++;
+    group->pending++;
+  }
+  pool_grow();
+  if (Pool.nthreads == 0)
+  {
+    /* No thread could be started, so take the jobs back */
+    struct WorkerJob *job = NULL, *tmp = NULL;
+    TAILQ_FOREACH_SAFE(job, &Pool.queued, entries, tmp)
+    {
+      if (job->group != group)
+        continue;
+      TAILQ_REMOVE(&Pool.queued, job, entries);
+      Pool.nqueued--;
+      FREE(&job);
+    }
+    group->pending = 0;
+    pthread_mutex_unlock(&Pool.lock);
+    pthread_cond_destroy(&group->cond);
+    return 0;
+  }
+  pthread_cond_broadcast(&Pool.cond);
+  pthread_mutex_unlock(&Pool.lock);
+
+  return want;
+}
+
+/**
+ * mutt_worker_group_wait - Wait for a group of jobs to finish
+ * @param group Group
+ *
+ * To stop the jobs early, take away the work they share first.
+ */
+void mutt_worker_group_wait(struct WorkerGroup *group)
+{
+  pthread_mutex_lock(&Pool.lock);
+  while (group->pending > 0)
+    pthread_cond_wait(&group->cond, &Pool.lock);
+  pthread_mutex_unlock(&Pool.lock);
+
+  pthread_cond_destroy(&group->cond);
+}
+
+/**
+ * mutt_worker_shutdown - Stop the pool
+ *
+ * Queued jobs are cancelled and running ones are asked to stop.  Once the
+ * threads have gone, the results are delivered.  A later job will start the
+ * pool again.
+ */
+void mutt_worker_shutdown(void)
+{
+  struct WorkerJob *job = NULL;
+
+  pthread_mutex_lock(&Pool.lock);
+  while ((job = TAILQ_FIRST(&Pool.queued)))
+  {
+    TAILQ_REMOVE(&Pool.queued, job, entries);
+    Pool.nqueued--;
+    job->cancelled = true;
+    pool_finish(job, NULL);
+  }
+  TAILQ_FOREACH(job, &Pool.running, entries)
+  {
+    job->cancelled = true;
+  }
+
+  Pool.size = 0;
+  pthread_cond_broadcast(&Pool.cond);
+  while (Pool.nthreads > 0)
+    pthread_cond_wait(&Pool.exited, &Pool.lock);
+  pthread_mutex_unlock(&Pool.lock);
+
+  mutt_worker_complete();
+
+  if (Pool.wake[0] >= 0)
+  {
+    close(Pool.wake[0]);
+    close(Pool.wake[1]);
+    Pool.wake[0] = -1;
+    Pool.wake[1] = -1;
+  }
+}
+#endif
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * Worker threads
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_WORKER_H
+#define _MUTT_WORKER_H
+
+extern short Threads;
+
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#include <stdbool.h>
+
+struct WorkerJob;
+
+/**
+ * typedef worker_t - Body of a job
+ * @param arg Private data
+ * @retval ptr Result, passed to the job's worker_done_t
+ */
+typedef void *(*worker_t)(void *arg);
+
+/**
+ * typedef worker_done_t - Deliver the result of a job, in the main thread
+ * @param arg       Private data
+ * @param result    Result of the job, NULL if it never ran
+ * @param cancelled true if the job was cancelled
+ */
+typedef void (*worker_done_t)(void *arg, void *result, bool cancelled);
+
+/**
+ * struct WorkerGroup - Several jobs sharing some work
+ */
+struct WorkerGroup
+{
+  pthread_cond_t cond; /**< Signalled when a job of the group finishes */
+  int pending;         /**< Jobs still queued or running */
+};
+
+void              mutt_worker_cancel(struct WorkerJob *job);
+bool              mutt_worker_cancelled(void);
+int               mutt_worker_complete(void);
+int               mutt_worker_fd(void);
+int               mutt_worker_group_start(struct WorkerGroup *group, int want, worker_t fn, void *arg);
+void              mutt_worker_group_wait(struct WorkerGroup *group);
+int               mutt_worker_pending(void);
+void              mutt_worker_shutdown(void);
+struct WorkerJob *mutt_worker_submit(worker_t fn, worker_done_t done, void *arg);
+#endif
+
+#endif /* _MUTT_WORKER_H */
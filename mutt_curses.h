@@ -113,6 +113,8 @@ struct Event
 };
 
 struct Event mutt_getch(void);
+bool mutt_getch_pending(void);
+bool mutt_key_pending(void);
 
 void mutt_endwin(const char *msg);
 void mutt_flushinp(void);
@@ -33,13 +33,21 @@
 #include "mutt.h"
 #include "mutt_lua.h"
 #include "address.h"
+#include "body.h"
+#include "context.h"
+#include "envelope.h"
 #include "globals.h"
+#include "header.h"
+#include "keymap.h"
 #include "mailbox.h"
 #include "mbtable.h"
 #include "mutt_commands.h"
+#include "mutt_menu.h"
 #include "mutt_options.h"
 #include "options.h"
+#include "pattern.h"
 #include "protos.h"
+#include "sort.h"
 
 static int handle_panic(lua_State *l)
 {
@@ -326,11 +334,348 @@ static void lua_expose_command(void *p, const struct Command *cmd)
   (void) luaL_dostring(l, buf);
 }
 
+/* Messages ----------------------------------------------------------------- */
+
+#define LUA_MESSAGE "mutt.Message"
+#define LUA_MESSAGE_ITER "mutt.MessageIter"
+
+/**
+ * struct LuaMessage - A message of the open mailbox, as seen from Lua
+ *
+ * The header isn't copied, so reading a field costs no more than in C.  The
+ * message may have gone by the time it's used, so it's checked each time.
+ */
+struct LuaMessage
+{
+  struct Context *ctx; /**< Mailbox */
+  struct Header *hdr;  /**< Email */
+  int msgno;           /**< Index into ctx->hdrs */
+};
+
+/**
+ * struct LuaMessageIter - State of a mutt.messages() loop
+ */
+struct LuaMessageIter
+{
+  struct Pattern *pat; /**< Only return matching messages, may be NULL */
+  int next;            /**< Next visible message to look at */
+};
+
+/**
+ * enum LuaMessageField - Fields of a mutt.Message
+ */
+enum LuaMessageField
+{
+  LMF_INDEX = 1,
+  LMF_SUBJECT,
+  LMF_FROM,
+  LMF_TO,
+  LMF_CC,
+  LMF_MESSAGE_ID,
+  LMF_X_LABEL,
+  LMF_DATE,
+  LMF_RECEIVED,
+  LMF_SIZE,
+  LMF_LINES,
+  LMF_SCORE,
+  LMF_READ,
+  LMF_OLD,
+  LMF_FLAGGED,
+  LMF_REPLIED,
+  LMF_DELETED,
+  LMF_TAGGED,
+};
+
+static const struct Mapping LuaMessageFields[] = {
+  { "index", LMF_INDEX },
+  { "subject", LMF_SUBJECT },
+  { "from", LMF_FROM },
+  { "to", LMF_TO },
+  { "cc", LMF_CC },
+  { "message_id", LMF_MESSAGE_ID },
+  { "x_label", LMF_X_LABEL },
+  { "date", LMF_DATE },
+  { "received", LMF_RECEIVED },
+  { "size", LMF_SIZE },
+  { "lines", LMF_LINES },
+  { "score", LMF_SCORE },
+  { "read", LMF_READ },
+  { "old", LMF_OLD },
+  { "flagged", LMF_FLAGGED },
+  { "replied", LMF_REPLIED },
+  { "deleted", LMF_DELETED },
+  { "tagged", LMF_TAGGED },
+  { NULL, 0 },
+};
+
+static bool LuaChanged = false; /**< Messages were changed by the script */
+static bool LuaRescored = false; /**< Scores were changed by the script */
+
+/**
+ * lua_check_message - Get a message argument that's still in the mailbox
+ * @param l   Lua state
+ * @param arg Stack index of the argument
+ * @retval ptr Message
+ */
+static struct LuaMessage *lua_check_message(lua_State *l, int arg)
+{
+  struct LuaMessage *m = luaL_checkudata(l, arg, LUA_MESSAGE);
+
+  if ((m->ctx != Context) || (m->msgno >= m->ctx->msgcount) ||
+      (m->ctx->hdrs[m->msgno] != m->hdr))
+  {
+    luaL_error(l, "Message is no longer in the mailbox");
+  }
+  return m;
+}
+
+/**
+ * lua_push_address - Push an address list as a string
+ * @param l Lua state
+ * @param a Address list
+ */
+static void lua_push_address(lua_State *l, struct Address *a)
+{
+  char buf[LONG_STRING] = "";
+  mutt_addr_write(buf, sizeof(buf), a, false);
+  lua_pushstring(l, buf);
+}
+
+/**
+ * lua_message_index - Read a field of a message: m.subject
+ * @param l Lua state
+ * @retval 1 The value
+ */
+static int lua_message_index(lua_State *l)
+{
+  struct LuaMessage *m = lua_check_message(l, 1);
+  struct Header *h = m->hdr;
+  struct Envelope *e = h->env;
+
+  switch (mutt_map_get_value(luaL_checkstring(l, 2), LuaMessageFields))
+  {
+    case LMF_INDEX:
+      lua_pushinteger(l, m->msgno + 1);
+      break;
+    case LMF_SUBJECT:
+      lua_pushstring(l, e ? e->subject : NULL);
+      break;
+    case LMF_FROM:
+      lua_push_address(l, e ? e->from : NULL);
+      break;
+    case LMF_TO:
+      lua_push_address(l, e ? e->to : NULL);
+      break;
+    case LMF_CC:
+      lua_push_address(l, e ? e->cc : NULL);
+      break;
+    case LMF_MESSAGE_ID:
+      lua_pushstring(l, e ? e->message_id : NULL);
+      break;
+    case LMF_X_LABEL:
+      lua_pushstring(l, e ? e->x_label : NULL);
+      break;
+    case LMF_DATE:
+      lua_pushinteger(l, h->date_sent);
+      break;
+    case LMF_RECEIVED:
+      lua_pushinteger(l, h->received);
+      break;
+    case LMF_SIZE:
+      lua_pushinteger(l, h->content ? h->content->length : 0);
+      break;
+    case LMF_LINES:
+      lua_pushinteger(l, h->lines);
+      break;
+    case LMF_SCORE:
+      lua_pushinteger(l, h->score);
+      break;
+    case LMF_READ:
+      lua_pushboolean(l, h->read);
+      break;
+    case LMF_OLD:
+      lua_pushboolean(l, h->old);
+      break;
+    case LMF_FLAGGED:
+      lua_pushboolean(l, h->flagged);
+      break;
+    case LMF_REPLIED:
+      lua_pushboolean(l, h->replied);
+      break;
+    case LMF_DELETED:
+      lua_pushboolean(l, h->deleted);
+      break;
+    case LMF_TAGGED:
+      lua_pushboolean(l, h->tagged);
+      break;
+    default:
+      lua_pushnil(l);
+      break;
+  }
+  return 1;
+}
+
+/**
+ * lua_message_newindex - Change a flag or the score of a message: m.tagged = true
+ * @param l Lua state
+ * @retval 0 Always
+ *
+ * The mailbox's counts are kept up to date, but the redraw, and a re-sort
+ * for a new score, wait until the script has finished.
+ */
+static int lua_message_newindex(lua_State *l)
+{
+  struct LuaMessage *m = lua_check_message(l, 1);
+  const char *name = luaL_checkstring(l, 2);
+  int flag;
+
+  switch (mutt_map_get_value(name, LuaMessageFields))
+  {
+    case LMF_READ:
+      flag = MUTT_READ;
+      break;
+    case LMF_OLD:
+      flag = MUTT_OLD;
+      break;
+    case LMF_FLAGGED:
+      flag = MUTT_FLAG;
+      break;
+    case LMF_REPLIED:
+      flag = MUTT_REPLIED;
+      break;
+    case LMF_DELETED:
+      flag = MUTT_DELETE;
+      break;
+    case LMF_TAGGED:
+      flag = MUTT_TAG;
+      break;
+    case LMF_SCORE:
+      mutt_score_set(m->ctx, m->hdr, (int) luaL_checkinteger(l, 3), 1);
+      LuaChanged = true;
+      LuaRescored = true;
+      return 0;
+    default:
+      return luaL_error(l, "Message field %s can't be changed", name);
+  }
+
+  mutt_set_flag(m->ctx, m->hdr, flag, lua_toboolean(l, 3));
+  LuaChanged = true;
+  return 0;
+}
+
+/**
+ * lua_message_iter_gc - Free the state of a mutt.messages() loop
+ * @param l Lua state
+ * @retval 0 Always
+ */
+static int lua_message_iter_gc(lua_State *l)
+{
+  struct LuaMessageIter *it = luaL_checkudata(l, 1, LUA_MESSAGE_ITER);
+  mutt_pattern_free(&it->pat);
+  return 0;
+}
+
+/**
+ * lua_message_iter_next - Get the next message of a mutt.messages() loop
+ * @param l Lua state
+ * @retval 1 The message, or nil at the end
+ */
+static int lua_message_iter_next(lua_State *l)
+{
+  struct LuaMessageIter *it = lua_touserdata(l, lua_upvalueindex(1));
+  struct PatternCache cache;
+
+  while (Context && (it->next < Context->vcount))
+  {
+    int msgno = Context->v2r[it->next++];
+    struct Header *h = Context->hdrs[msgno];
+
+    memset(&cache, 0, sizeof(cache));
+    if (it->pat && (mutt_pattern_exec(it->pat, MUTT_MATCH_FULL_ADDRESS, Context, h, &cache) <= 0))
+      continue;
+
+    struct LuaMessage *m = lua_newuserdata(l, sizeof(struct LuaMessage));
+    m->ctx = Context;
+    m->hdr = h;
+    m->msgno = msgno;
+    luaL_setmetatable(l, LUA_MESSAGE);
+    return 1;
+  }
+
+  lua_pushnil(l);
+  return 1;
+}
+
+/**
+ * lua_mutt_messages - Loop over the visible messages: mutt.messages([pattern])
+ * @param l Lua state
+ * @retval 1 Iterator function
+ *
+ * The messages are returned in the order of the index.  The pattern is
+ * compiled once, for the whole loop.
+ */
+static int lua_mutt_messages(lua_State *l)
+{
+  const char *pattern = luaL_optstring(l, 1, NULL);
+  struct LuaMessageIter *it = lua_newuserdata(l, sizeof(struct LuaMessageIter));
+
+  memset(it, 0, sizeof(*it));
+  luaL_setmetatable(l, LUA_MESSAGE_ITER);
+
+  if (pattern)
+  {
+    char buf[LONG_STRING];
+    char errbuf[STRING];
+    struct Buffer err;
+
+    mutt_buffer_init(&err);
+    err.data = errbuf;
+    err.dsize = sizeof(errbuf);
+    mutt_str_strfcpy(buf, pattern, sizeof(buf));
+    mutt_check_simple(buf, sizeof(buf), NONULL(SimpleSearch));
+    it->pat = mutt_pattern_comp(buf, MUTT_FULL_MSG, &err);
+    if (!it->pat)
+      return luaL_error(l, "%s", errbuf);
+  }
+
+  lua_pushcclosure(l, lua_message_iter_next, 1);
+  return 1;
+}
+
+/**
+ * lua_flush_changes - Catch up with the changes a script made to messages
+ *
+ * Done once, when the script finishes, rather than for each message.
+ */
+static void lua_flush_changes(void)
+{
+  if (LuaRescored && (((Sort & SORT_MASK) == SORT_SCORE) || ((SortAux & SORT_MASK) == SORT_SCORE)))
+  {
+    OPT_NEED_RESORT = true;
+    if ((Sort & SORT_MASK) == SORT_THREADS)
+      OPT_SORT_SUBTHREADS = true;
+  }
+  if (LuaChanged)
+  {
+    mutt_set_menu_redraw_full(MENU_MAIN);
+    mutt_set_menu_redraw_full(MENU_PAGER);
+  }
+  LuaChanged = false;
+  LuaRescored = false;
+}
+
+static const luaL_Reg luaMessageMeta[] = {
+  { "__index", lua_message_index },
+  { "__newindex", lua_message_newindex },
+  { NULL, NULL },
+};
+
 static const luaL_Reg luaMuttDecl[] = {
   { "set", lua_mutt_set },       { "get", lua_mutt_get },
   { "call", lua_mutt_call },     { "enter", lua_mutt_enter },
   { "print", lua_mutt_message }, { "message", lua_mutt_message },
-  { "error", lua_mutt_error },   { NULL, NULL },
+  { "error", lua_mutt_error },   { "messages", lua_mutt_messages },
+  { NULL, NULL },
 };
 
 #define lua_add_lib_member(LUA, TABLE, KEY, VALUE, DATATYPE_HANDLER)           \
@@ -341,6 +686,15 @@ static const luaL_Reg luaMuttDecl[] = {
 static int luaopen_mutt_decl(lua_State *l)
 {
   mutt_debug(2, " * luaopen_mutt()\n");
+
+  luaL_newmetatable(l, LUA_MESSAGE);
+  luaL_setfuncs(l, luaMessageMeta, 0);
+  lua_pop(l, 1);
+  luaL_newmetatable(l, LUA_MESSAGE_ITER);
+  lua_pushcfunction(l, lua_message_iter_gc);
+  lua_setfield(l, -2, "__gc");
+  lua_pop(l, 1);
+
   luaL_newlib(l, luaMuttDecl);
   int lib_idx = lua_gettop(l);
   /*                  table_idx, key        value,               value's type */
@@ -391,7 +745,9 @@ int mutt_lua_parse(struct Buffer *tmp, struct Buffer *s, unsigned long data, str
   lua_init(&Lua);
   mutt_debug(2, " * mutt_lua_parse(%s)\n", tmp->data);
 
-  if (luaL_dostring(Lua, s->dptr))
+  bool failed = luaL_dostring(Lua, s->dptr);
+  lua_flush_changes();
+  if (failed)
   {
     mutt_debug(2, " * %s -> failure\n", s->dptr);
     snprintf(err->data, err->dsize, _("%s: %s"), s->dptr, lua_tostring(Lua, -1));
@@ -425,7 +781,9 @@ int mutt_lua_source_file(struct Buffer *tmp, struct Buffer *s,
   mutt_str_strfcpy(path, tmp->data, sizeof(path));
   mutt_expand_path(path, sizeof(path));
 
-  if (luaL_dofile(Lua, path))
+  bool failed = luaL_dofile(Lua, path);
+  lua_flush_changes();
+  if (failed)
   {
     mutt_error("Couldn't source lua source: %s", lua_tostring(Lua, -1));
     lua_pop(Lua, 1);
@@ -44,6 +44,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
 #include <unistd.h>
@@ -59,10 +60,14 @@
 #include "mailbox.h"
 #include "mutt_curses.h"
 #include "mx.h"
+#include "options.h"
 #include "protos.h"
 #include "tags.h"
 #include "thread.h"
 #include "url.h"
+#ifdef USE_HCACHE
+#include "hcache/hcache.h"
+#endif
 
 #ifdef LIBNOTMUCH_CHECK_VERSION
 #undef LIBNOTMUCH_CHECK_VERSION
@@ -123,6 +128,12 @@ struct NmCtxData
   int oldmsgcount;
   int ignmsgcount; /**< Ignored messages */
 
+#ifdef USE_HCACHE
+  header_cache_t *hc;     /**< Header cache, while the mailbox is being read */
+#endif
+  unsigned long revision; /**< Database revision the mailbox is up to date with */
+  char *uuid;             /**< UUID of the database, for the revision */
+
   bool noprogress : 1;     /**< Don't show the progress bar */
   bool longrun : 1;        /**< A long-lived action is in progress */
   bool trans : 1;          /**< Atomic transaction in progress */
@@ -175,6 +186,7 @@ static void free_ctxdata(struct NmCtxData *data)
   url_free(&data->db_url);
   FREE(&data->db_url_holder);
   FREE(&data->db_query);
+  FREE(&data->uuid);
   FREE(&data);
 }
 
@@ -688,6 +700,25 @@ err:
   return NULL;
 }
 
+/**
+ * save_revision - Remember the revision of the database
+ * @param data Notmuch data, with the database open
+ *
+ * Messages changed after this revision will be picked up by check_changed().
+ */
+static void save_revision(struct NmCtxData *data)
+{
+#if LIBNOTMUCH_CHECK_VERSION(4, 3, 0)
+  const char *uuid = NULL;
+
+  if (!data->db)
+    return;
+
+  data->revision = notmuch_database_get_revision(data->db, &uuid);
+  mutt_str_replace(&data->uuid, uuid);
+#endif
+}
+
 static int update_header_tags(struct Header *h, notmuch_message_t *msg)
 {
   struct NmHdrData *data = h->data;
@@ -939,6 +970,54 @@ static struct Header *get_mutt_header(struct Context *ctx, notmuch_message_t *ms
   return h;
 }
 
+#ifdef USE_HCACHE
+/**
+ * hcache_keylen - Get the length of a message's header cache key
+ * @param path Path of the message file
+ * @retval num Length of the path, without the maildir flags
+ */
+static size_t hcache_keylen(const char *path)
+{
+  const char *p = strrchr(path, ':');
+  const char *slash = strrchr(path, '/');
+  return (p && (p > slash)) ? (size_t)(p - path) : mutt_str_strlen(path);
+}
+
+/**
+ * hcache_get_header - Get a message's header from the header cache
+ * @param data Notmuch data
+ * @param path Path of the message file
+ * @retval ptr  Header
+ * @retval NULL Not cached, or the file has changed since
+ *
+ * As for a maildir mailbox, the flags are taken from the file name.
+ */
+static struct Header *hcache_get_header(struct NmCtxData *data, const char *path)
+{
+  struct Header *h = NULL;
+  struct stat st;
+  void *hdata = NULL;
+
+  if (!data->hc)
+    return NULL;
+
+  hdata = mutt_hcache_fetch(data->hc, path, hcache_keylen(path));
+  if (!hdata)
+    return NULL;
+
+  /* Only a cached message needs its mtime checking */
+  const struct timeval *when = hdata;
+  if (!MaildirHeaderCacheVerify || ((stat(path, &st) == 0) && (st.st_mtime <= when->tv_sec)))
+  {
+    h = mutt_hcache_restore(hdata);
+    h->old = false;
+    maildir_parse_flags(h, path);
+  }
+  mutt_hcache_free(data->hc, &hdata);
+  return h;
+}
+#endif
+
 static void append_message(struct Context *ctx, notmuch_query_t *q,
                            notmuch_message_t *msg, bool dedup)
 {
@@ -972,8 +1051,19 @@ static void append_message(struct Context *ctx, notmuch_query_t *q,
     mutt_debug(2, "nm: allocate mx memory\n");
     mx_alloc_memory(ctx);
   }
-  if (access(path, F_OK) == 0)
+#ifdef USE_HCACHE
+  h = hcache_get_header(data, path);
+#endif
+  if (h)
+    mutt_debug(2, "nm: header from cache: %s\n", path);
+  else if (access(path, F_OK) == 0)
+  {
     h = maildir_parse_message(MUTT_MAILDIR, path, false, NULL);
+#ifdef USE_HCACHE
+    if (h && data->hc)
+      mutt_hcache_store(data->hc, path, hcache_keylen(path), h, 0);
+#endif
+  }
   else
   {
     /* maybe moved try find it... */
@@ -1472,6 +1562,81 @@ done:
   return rc;
 }
 
+/**
+ * struct NmCountDb - A read-only database kept open for counting
+ */
+static struct NmCountDb
+{
+  char *filename;         /**< Path of the database */
+  notmuch_database_t *db; /**< Database handle */
+  time_t mtime;           /**< Modification time of the database when it was opened */
+  time_t opened;          /**< When the handle was opened */
+  struct Hash *counts;    /**< Counts of each mailbox, see struct NmCount */
+} CountDb;
+
+/**
+ * struct NmCount - The counts of a virtual mailbox
+ */
+struct NmCount
+{
+  int all; /**< Number of messages */
+  int new; /**< Number of unread messages */
+};
+
+/**
+ * count_free - Free a NmCount - Implements ::hash_destructor
+ */
+static void count_free(int type, void *obj, intptr_t data)
+{
+  FREE(&obj);
+}
+
+/**
+ * get_count_db - Get a read-only database for counting messages
+ * @param filename Path of the database
+ * @retval ptr  Database handle
+ * @retval NULL Error
+ *
+ * The sidebar and buffy count every virtual mailbox, often.  Rather than
+ * opening the database for each count, keep it open until it changes.  The
+ * counts made with it stay valid for as long, see CountDb.counts.
+ */
+static notmuch_database_t *get_count_db(const char *filename)
+{
+  char path[_POSIX_PATH_MAX];
+  struct stat st;
+  time_t mtime = 0;
+
+  if (!filename)
+    return NULL;
+
+  snprintf(path, sizeof(path), "%s/.notmuch/xapian", filename);
+  if (stat(path, &st) == 0)
+    mtime = st.st_mtime;
+
+  /* a change in the same second as the open could have been missed */
+  if (CountDb.db && mtime && (mtime == CountDb.mtime) && (mtime < CountDb.opened) &&
+      (mutt_str_strcmp(CountDb.filename, filename) == 0))
+  {
+    return CountDb.db;
+  }
+
+  nm_nonctx_cleanup();
+
+  /* don't be verbose about connection, as we're called from
+   * sidebar/buffy very often */
+  CountDb.db = do_database_open(filename, false, false);
+  if (!CountDb.db)
+    return NULL;
+
+  CountDb.filename = mutt_str_strdup(filename);
+  CountDb.mtime = mtime;
+  CountDb.opened = time(NULL);
+  CountDb.counts = mutt_hash_create(32, MUTT_HASH_STRDUP_KEYS);
+  mutt_hash_set_destructor(CountDb.counts, count_free, 0);
+  return CountDb.db;
+}
+
 static unsigned int count_query(notmuch_database_t *db, const char *qstr)
 {
   unsigned int res = 0;
@@ -1500,6 +1665,15 @@ char *nm_header_get_folder(struct Header *h)
   return (h && h->data) ? ((struct NmHdrData *) h->data)->folder : NULL;
 }
 
+/**
+ * nm_longrun_init - Start a long-running action, e.g. tagging many messages
+ * @param ctx      Mailbox
+ * @param writable Open the database read-write
+ *
+ * The database is kept open until nm_longrun_done().  If it's writable, the
+ * changes are made in one atomic transaction, so Xapian commits them once,
+ * rather than once per message.
+ */
 void nm_longrun_init(struct Context *ctx, bool writable)
 {
   struct NmCtxData *data = get_ctxdata(ctx);
@@ -1507,15 +1681,28 @@ void nm_longrun_init(struct Context *ctx, bool writable)
   if (data && get_db(data, writable))
   {
     data->longrun = true;
+    if (writable)
+      db_trans_begin(data);
     mutt_debug(2, "nm: long run initialized\n");
   }
 }
 
+/**
+ * nm_longrun_done - Finish a long-running action
+ * @param ctx Mailbox
+ *
+ * Commit the changes and close the database.
+ */
 void nm_longrun_done(struct Context *ctx)
 {
   struct NmCtxData *data = get_ctxdata(ctx);
 
-  if (data && (release_db(data) == 0))
+  if (!data)
+    return;
+
+  if (db_trans_end(data) != 0)
+    mutt_error(_("Unable to commit the notmuch changes"));
+  if (release_db(data) == 0)
     mutt_debug(2, "nm: long run deinitialized\n");
 }
 
@@ -1866,7 +2053,9 @@ int nm_nonctx_get_count(char *path, int *all, int *new)
   struct Url url;
   char *url_holder = mutt_str_strdup(path);
   char *db_filename = NULL, *db_query = NULL;
+  char *key = NULL;
   notmuch_database_t *db = NULL;
+  struct NmCount *count = NULL;
   int rc = -1;
   mutt_debug(1, "nm: count\n");
 
@@ -1904,37 +2093,38 @@ int nm_nonctx_get_count(char *path, int *all, int *new)
       db_filename = Folder;
   }
 
-  /* don't be verbose about connection, as we're called from
-   * sidebar/buffy very often */
-  db = do_database_open(db_filename, false, false);
+  db = get_count_db(db_filename);
   if (!db)
     goto done;
 
-  /* all emails */
-  if (all)
-    *all = count_query(db, db_query);
-
-  /* new messages */
-  if (new)
+  /* the database hasn't changed since this mailbox was last counted */
+  safe_asprintf(&key, "%s\n%s\n%s", path, NONULL(NmUnreadTag), NONULL(NmExcludeTags));
+  count = mutt_hash_find(CountDb.counts, key);
+  if (!count)
   {
     char *qstr = NULL;
 
+    count = mutt_mem_malloc(sizeof(struct NmCount));
+
+    /* all emails */
+    count->all = count_query(db, db_query);
+
+    /* new messages */
     safe_asprintf(&qstr, "( %s ) tag:%s", db_query, NmUnreadTag);
-    *new = count_query(db, qstr);
+    count->new = count_query(db, qstr);
     FREE(&qstr);
+
+    mutt_hash_insert(CountDb.counts, key, count);
   }
 
+  if (all)
+    *all = count->all;
+  if (new)
+    *new = count->new;
+
   rc = 0;
 done:
-  if (db)
-  {
-#ifdef NOTMUCH_API_3
-    notmuch_database_destroy(db);
-#else
-    notmuch_database_close(db);
-#endif
-    mutt_debug(1, "nm: count close DB\n");
-  }
+  FREE(&key);
   url_free(&url);
   FREE(&url_holder);
 
@@ -1942,6 +2132,25 @@ done:
   return rc;
 }
 
+/**
+ * nm_nonctx_cleanup - Close the database kept open for counting
+ */
+void nm_nonctx_cleanup(void)
+{
+  if (CountDb.db)
+  {
+    mutt_debug(1, "nm: count close DB\n");
+#ifdef NOTMUCH_API_3
+    notmuch_database_destroy(CountDb.db);
+#else
+    notmuch_database_close(CountDb.db);
+#endif
+    CountDb.db = NULL;
+  }
+  FREE(&CountDb.filename);
+  mutt_hash_destroy(&CountDb.counts);
+}
+
 char *nm_get_description(struct Context *ctx)
 {
   for (struct Buffy *b = Incoming; b; b = b->next)
@@ -2095,6 +2304,10 @@ static int nm_open_mailbox(struct Context *ctx)
   if (q)
   {
     rc = 0;
+    save_revision(data);
+#ifdef USE_HCACHE
+    data->hc = mutt_hcache_open(HeaderCache, get_db_filename(data), NULL);
+#endif
     switch (data->query_type)
     {
       case NM_QUERY_TYPE_MESGS:
@@ -2107,6 +2320,10 @@ static int nm_open_mailbox(struct Context *ctx)
         break;
     }
     notmuch_query_destroy(q);
+#ifdef USE_HCACHE
+    mutt_hcache_close(data->hc);
+    data->hc = NULL;
+#endif
   }
 
   if (!is_longrun(data))
@@ -2148,6 +2365,206 @@ static int nm_close_mailbox(struct Context *ctx)
   return 0;
 }
 
+/**
+ * merge_message - Update a header from its message in the database
+ * @param ctx Mailbox
+ * @param h   Header
+ * @param m   Notmuch message
+ * @retval true The tags have changed
+ */
+static bool merge_message(struct Context *ctx, struct Header *h, notmuch_message_t *m)
+{
+  char old[_POSIX_PATH_MAX];
+  const char *new = NULL;
+
+  /* Check to see if the message has moved to a different subdirectory.
+   * If so, update the associated filename.
+   */
+  new = get_message_last_filename(m);
+  header_get_fullpath(h, old, sizeof(old));
+
+  if (mutt_str_strcmp(old, new) != 0)
+    update_message_path(h, new);
+
+  if (!h->changed)
+  {
+    /* if the user hasn't modified the flags on
+     * this message, update the flags we just
+     * detected.
+     */
+    struct Header tmp;
+    memset(&tmp, 0, sizeof(tmp));
+    maildir_parse_flags(&tmp, new);
+    maildir_update_flags(ctx, h, &tmp);
+  }
+
+  return update_header_tags(h, m) == 0;
+}
+
+#if LIBNOTMUCH_CHECK_VERSION(4, 3, 0)
+/**
+ * search_changed - Find the messages changed since the saved revision
+ * @param data     Notmuch data, with the database open
+ * @param query    Query to narrow the search, or NULL for all messages
+ * @param revision Current revision of the database
+ * @retval ptr  Query, to be destroyed by the caller
+ * @retval NULL Error
+ */
+static notmuch_query_t *search_changed(struct NmCtxData *data, const char *query,
+                                       unsigned long revision)
+{
+  char *qstr = NULL;
+  notmuch_query_t *q = NULL;
+
+  if (query)
+  {
+    safe_asprintf(&qstr, "( %s ) and lastmod:%lu..%lu", query, data->revision + 1, revision);
+    q = notmuch_query_create(data->db, qstr);
+    if (q)
+      apply_exclude_tags(q);
+  }
+  else
+  {
+    safe_asprintf(&qstr, "lastmod:%lu..%lu", data->revision + 1, revision);
+    q = notmuch_query_create(data->db, qstr);
+  }
+
+  mutt_debug(2, "nm: changes '%s'\n", qstr);
+  FREE(&qstr);
+  return q;
+}
+
+/**
+ * search_messages - Run a query for messages
+ * @param q Query
+ * @retval ptr  Messages
+ * @retval NULL Error
+ */
+static notmuch_messages_t *search_messages(notmuch_query_t *q)
+{
+  notmuch_messages_t *msgs = NULL;
+
+#if LIBNOTMUCH_CHECK_VERSION(5, 0, 0)
+  if (notmuch_query_search_messages(q, &msgs) != NOTMUCH_STATUS_SUCCESS)
+    return NULL;
+#else
+  if (notmuch_query_search_messages_st(q, &msgs) != NOTMUCH_STATUS_SUCCESS)
+    return NULL;
+#endif
+  return msgs;
+}
+
+/**
+ * check_changed - Check only the messages changed since the last check
+ * @param ctx  Mailbox
+ * @param data Notmuch data
+ * @retval -2 The whole query has to be checked again
+ * @retval  * Same as nm_check_mailbox()
+ *
+ * Every message changed since the saved revision is looked up.  Those that
+ * are in the mailbox, but no longer match the query, have gone.  The changed
+ * messages that do match are merged, or added if they're new.
+ *
+ * Mailboxes of threads, or with a limit, need the whole query to be run.
+ */
+static int check_changed(struct Context *ctx, struct NmCtxData *data)
+{
+  notmuch_query_t *q = NULL;
+  notmuch_messages_t *msgs = NULL;
+  const char *uuid = NULL;
+  const char *str = NULL;
+  unsigned long revision;
+  int new_flags = 0;
+  bool occult = false;
+  int rc = -2;
+
+  if (!data->uuid || (data->query_type != NM_QUERY_TYPE_MESGS) || (get_limit(data) != 0))
+    return -2;
+
+  str = get_query_string(data, false);
+  if (!str || !get_db(data, false))
+    return -2;
+
+  revision = notmuch_database_get_revision(data->db, &uuid);
+  if (mutt_str_strcmp(uuid, data->uuid) != 0)
+    goto done;
+
+  mutt_debug(1, "nm: checking changes since revision %lu (now %lu)\n", data->revision, revision);
+  data->oldmsgcount = ctx->msgcount;
+  data->noprogress = true;
+
+  for (int i = 0; i < ctx->msgcount; i++)
+    ctx->hdrs[i]->active = true;
+
+  if (revision > data->revision)
+  {
+    /* changed messages, matching or not */
+    q = search_changed(data, NULL, revision);
+    if (!q || !(msgs = search_messages(q)))
+      goto done;
+    for (; notmuch_messages_valid(msgs); notmuch_messages_move_to_next(msgs))
+    {
+      notmuch_message_t *m = notmuch_messages_get(msgs);
+      struct Header *h = get_mutt_header(ctx, m);
+      if (h)
+        h->active = false;
+      notmuch_message_destroy(m);
+    }
+    notmuch_query_destroy(q);
+
+    /* changed messages that match */
+    q = search_changed(data, str, revision);
+    if (!q || !(msgs = search_messages(q)))
+      goto done;
+    for (; notmuch_messages_valid(msgs); notmuch_messages_move_to_next(msgs))
+    {
+      notmuch_message_t *m = notmuch_messages_get(msgs);
+      struct Header *h = get_mutt_header(ctx, m);
+
+      if (!h)
+        append_message(ctx, NULL, m, 0);
+      else
+      {
+        h->active = true;
+        if (merge_message(ctx, h, m))
+          new_flags++;
+      }
+      notmuch_message_destroy(m);
+    }
+  }
+
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    if (!ctx->hdrs[i]->active)
+    {
+      occult = true;
+      break;
+    }
+  }
+
+  if (ctx->msgcount > data->oldmsgcount)
+    mx_update_context(ctx, ctx->msgcount - data->oldmsgcount);
+
+  data->revision = revision;
+  ctx->mtime = time(NULL);
+
+  mutt_debug(1, "nm: ... changes checked [count=%d, new_flags=%d, occult=%d]\n",
+             ctx->msgcount, new_flags, occult);
+
+  rc = occult ? MUTT_REOPENED :
+                (ctx->msgcount > data->oldmsgcount) ? MUTT_NEW_MAIL :
+                                                      new_flags ? MUTT_FLAGS : 0;
+done:
+  if (q)
+    notmuch_query_destroy(q);
+
+  if (!is_longrun(data))
+    release_db(data);
+
+  return rc;
+}
+#endif
+
 /**
  * nm_check_mailbox - Check a notmuch mailbox for new mail
  * @param ctx         A mailbox CONTEXT
@@ -2178,6 +2595,12 @@ static int nm_check_mailbox(struct Context *ctx, int *index_hint)
 
   mutt_debug(1, "nm: checking (db=%lu ctx=%lu)\n", mtime, ctx->mtime);
 
+#if LIBNOTMUCH_CHECK_VERSION(4, 3, 0)
+  int rc = check_changed(ctx, data);
+  if (rc != -2)
+    return rc;
+#endif
+
   q = get_query(data, false);
   if (!q)
     goto done;
@@ -2204,9 +2627,6 @@ static int nm_check_mailbox(struct Context *ctx, int *index_hint)
   for (int i = 0; notmuch_messages_valid(msgs) && ((limit == 0) || (i < limit));
        notmuch_messages_move_to_next(msgs), i++)
   {
-    char old[_POSIX_PATH_MAX];
-    const char *new = NULL;
-
     notmuch_message_t *m = notmuch_messages_get(msgs);
     struct Header *h = get_mutt_header(ctx, m);
 
@@ -2220,29 +2640,7 @@ static int nm_check_mailbox(struct Context *ctx, int *index_hint)
 
     /* message already exists, merge flags */
     h->active = true;
-
-    /* Check to see if the message has moved to a different subdirectory.
-     * If so, update the associated filename.
-     */
-    new = get_message_last_filename(m);
-    header_get_fullpath(h, old, sizeof(old));
-
-    if (mutt_str_strcmp(old, new) != 0)
-      update_message_path(h, new);
-
-    if (!h->changed)
-    {
-      /* if the user hasn't modified the flags on
-       * this message, update the flags we just
-       * detected.
-       */
-      struct Header tmp;
-      memset(&tmp, 0, sizeof(tmp));
-      maildir_parse_flags(&tmp, new);
-      maildir_update_flags(ctx, h, &tmp);
-    }
-
-    if (update_header_tags(h, m) == 0)
+    if (merge_message(ctx, h, m))
       new_flags++;
 
     notmuch_message_destroy(m);
@@ -2259,6 +2657,7 @@ static int nm_check_mailbox(struct Context *ctx, int *index_hint)
 
   if (ctx->msgcount > data->oldmsgcount)
     mx_update_context(ctx, ctx->msgcount - data->oldmsgcount);
+  save_revision(data);
 done:
   if (q)
     notmuch_query_destroy(q);
@@ -2289,12 +2688,17 @@ static int nm_sync_mailbox(struct Context *ctx, int *index_hint)
   struct Progress progress;
   char *uri = ctx->path;
   bool changed = false;
+  int trans = 0;
 
   if (!data)
     return -1;
 
   mutt_debug(1, "nm: sync start ...\n");
 
+  /* One transaction for the whole mailbox, rather than one per message */
+  if (get_db(data, true))
+    trans = db_trans_begin(data);
+
   if (!ctx->quiet)
   {
     /* all is in this function so we don't use data->progress here */
@@ -2352,6 +2756,8 @@ static int nm_sync_mailbox(struct Context *ctx, int *index_hint)
   ctx->path = uri;
   ctx->magic = MUTT_NOTMUCH;
 
+  if (trans == 1)
+    db_trans_end(data);
   if (!is_longrun(data))
     release_db(data);
   if (changed)
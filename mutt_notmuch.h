@@ -56,6 +56,7 @@ int nm_get_all_tags(struct Context *ctx, char **tag_list, int *tag_count);
  * functions usable outside notmuch Context
  */
 int nm_nonctx_get_count(char *path, int *all, int *new);
+void nm_nonctx_cleanup(void);
 
 extern struct MxOps mx_notmuch_ops;
 
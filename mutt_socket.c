@@ -49,6 +49,8 @@ void mutt_socket_free(struct Connection *conn)
     if (np == conn)
     {
       TAILQ_REMOVE(&Connections, np, entries);
+      FREE(&np->inbuf);
+      mutt_buffer_free(&np->outbuf);
       FREE(&np);
       return;
     }
@@ -1380,6 +1380,9 @@ int mutt_save_confirm(const char *s, struct stat *st)
 
 void mutt_sleep(short s)
 {
+  /* Without a screen, there's no message to give the user time to read */
+  if (OPT_NO_CURSES)
+    return;
   if (SleepTime > s)
     sleep(SleepTime);
   else if (s)
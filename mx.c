@@ -24,6 +24,7 @@
 #include "config.h"
 #include <errno.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -34,6 +35,8 @@
 #include "mutt.h"
 #include "mx.h"
 #include "address.h"
+#include "address_index.h"
+#include "attach.h"
 #include "body.h"
 #include "buffy.h"
 #include "context.h"
@@ -47,7 +50,9 @@
 #include "opcodes.h"
 #include "options.h"
 #include "pattern.h"
+#include "perf.h"
 #include "protos.h"
+#include "search_index.h"
 #include "sort.h"
 #include "thread.h"
 #include "url.h"
@@ -389,6 +394,24 @@ static int mx_open_mailbox_append(struct Context *ctx, int flags)
   return ctx->mx_ops->open_append(ctx, flags);
 }
 
+/**
+ * mx_debug_memory - Log how much memory the message headers use
+ * @param ctx Mailbox
+ *
+ * Only the Header structs and the index arrays are counted, not the
+ * envelopes and bodies hanging off them.
+ */
+static void mx_debug_memory(struct Context *ctx)
+{
+  size_t hdrs = ctx->msgcount * sizeof(struct Header);
+  size_t arrays = ctx->hdrmax * (sizeof(struct Header *) + sizeof(int));
+
+  mutt_debug(2, "%s: %d messages, %zu bytes of headers (%zu each, %zu scanned "
+                "when sorting), %zu bytes of index arrays\n",
+             ctx->path, ctx->msgcount, hdrs, sizeof(struct Header),
+             offsetof(struct Header, recipient), arrays);
+}
+
 /**
  * mx_open_mailbox - Open a mailbox and parse it
  * @param path  Path to the mailbox
@@ -401,10 +424,12 @@ static int mx_open_mailbox_append(struct Context *ctx, int flags)
  * * #MUTT_READONLY open mailbox in read-only mode
  * * #MUTT_QUIET    only print error messages
  * * #MUTT_PEEK     revert atime where applicable
+ * * #MUTT_PROGRESSIVE read the first $read_batch messages, see mx_open_more()
  */
 struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pctx)
 {
   struct Context *ctx = pctx;
+  struct PerfTimer perf;
   int rc;
 
   if (!path || !path[0])
@@ -450,6 +475,11 @@ struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pct
     return ctx;
   }
 
+  mutt_perf_start(&perf, PERF_OPEN);
+  /* the index will be drawn once the first batch has been read */
+  if (flags & MUTT_PROGRESSIVE)
+    mutt_perf_arm(PERF_FIRST_DRAW);
+
   ctx->magic = mx_get_magic(path);
   ctx->mx_ops = mx_get_ops(ctx->magic);
 
@@ -460,6 +490,7 @@ struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pct
     else if (ctx->magic == 0 || !ctx->mx_ops)
       mutt_error(_("%s is not a mailbox."), path);
 
+    mutt_perf_stop(&perf);
     mx_fastclose_mailbox(ctx);
     if (!pctx)
       FREE(&ctx);
@@ -478,11 +509,15 @@ struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pct
   if (!ctx->quiet)
     mutt_message(_("Reading %s..."), ctx->path);
 
+  if ((flags & MUTT_PROGRESSIVE) && (ReadBatch > 0) && ctx->mx_ops->open_more)
+    ctx->loading = true;
+
   rc = ctx->mx_ops->open(ctx);
 
   if ((rc == 0) || (rc == -2))
   {
-    if ((flags & MUTT_NOSORT) == 0)
+    /* Until the rest has been read, the messages stay in the order they came */
+    if (((flags & MUTT_NOSORT) == 0) && !ctx->loading)
     {
       /* avoid unnecessary work since the mailbox is completely unthreaded
          to begin with */
@@ -490,6 +525,8 @@ struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pct
       OPT_NEED_RESCORE = false;
       mutt_sort_headers(ctx, 1);
     }
+    if (!ctx->loading)
+      mx_debug_memory(ctx);
     if (!ctx->quiet)
       mutt_clear_error();
     if (rc == -2)
@@ -503,9 +540,54 @@ struct Context *mx_open_mailbox(const char *path, int flags, struct Context *pct
   }
 
   OPT_FORCE_REFRESH = false;
+  mutt_perf_stop(&perf);
   return ctx;
 }
 
+/**
+ * mx_open_more - Read more of a mailbox opened with #MUTT_PROGRESSIVE
+ * @param ctx Mailbox
+ * @param all If true, read the rest of it; otherwise just the next batch
+ * @retval  0 Success, or the mailbox has already been read
+ * @retval -1 Failure
+ * @retval -2 Interrupted
+ * @retval #MUTT_REOPENED The mailbox changed while it was being read, so it
+ *                        has been read again
+ *
+ * Once the last batch has been read, the mailbox is sorted.  If reading fails,
+ * the mailbox is left read-only with the messages read so far, as syncing it
+ * would lose the rest.
+ */
+int mx_open_more(struct Context *ctx, bool all)
+{
+  int rc = 0;
+
+  if (!ctx || !ctx->loading)
+    return 0;
+
+  do
+  {
+    rc = ctx->mx_ops->open_more(ctx);
+  } while ((rc == 0) && all && ctx->loading);
+
+  if (rc == -1)
+  {
+    mutt_error(_("Reading from %s interrupted..."), ctx->path);
+    ctx->readonly = true;
+    ctx->loading = false;
+  }
+
+  if (!ctx->loading)
+  {
+    OPT_SORT_SUBTHREADS = false;
+    OPT_NEED_RESCORE = false;
+    mutt_sort_headers(ctx, 1);
+    mx_debug_memory(ctx);
+  }
+
+  return rc;
+}
+
 /**
  * mx_fastclose_mailbox - free up memory associated with the mailbox context
  */
@@ -516,6 +598,8 @@ void mx_fastclose_mailbox(struct Context *ctx)
   if (!ctx)
     return;
 
+  mutt_attach_cache_forget(ctx, NULL);
+
   /* fix up the times so buffy won't get confused */
   if (ctx->peekonly && ctx->path && (ctx->mtime > ctx->atime))
   {
@@ -529,6 +613,10 @@ void mx_fastclose_mailbox(struct Context *ctx)
   if (!ctx->peekonly)
     mutt_buffy_setnotified(ctx->path);
 
+#ifdef USE_HCACHE
+  mutt_search_index_close(ctx);
+#endif
+
   if (ctx->mx_ops)
     ctx->mx_ops->close(ctx);
 
@@ -542,6 +630,12 @@ void mx_fastclose_mailbox(struct Context *ctx)
     mutt_free_header(&ctx->hdrs[i]);
   FREE(&ctx->hdrs);
   FREE(&ctx->v2r);
+  FREE(&ctx->cols.hdr);
+  FREE(&ctx->cols.date_sent);
+  FREE(&ctx->cols.received);
+  FREE(&ctx->cols.size);
+  FREE(&ctx->cols.score);
+  mutt_addr_index_free(&ctx->addr_index);
   FREE(&ctx->path);
   FREE(&ctx->realpath);
   FREE(&ctx->pattern);
@@ -559,6 +653,9 @@ static int sync_mailbox(struct Context *ctx, int *index_hint)
   if (!ctx->mx_ops || !ctx->mx_ops->sync)
     return -1;
 
+  /* the mailbox's files may be rewritten */
+  mutt_attach_cache_forget(ctx, NULL);
+
   if (!ctx->quiet)
     mutt_message(_("Writing %s..."), ctx->path);
 
@@ -646,12 +743,17 @@ int mx_close_mailbox(struct Context *ctx, int *index_hint)
   int check;
   int is_spool = 0;
   struct Context f;
+  struct PerfTimer perf;
   char mbox[_POSIX_PATH_MAX];
   char buf[SHORT_STRING];
 
   if (!ctx)
     return 0;
 
+  /* Messages that haven't been read can't be moved, purged or kept */
+  if (ctx->loading && !ctx->readonly && !ctx->dontwrite && (mx_open_more(ctx, true) < 0))
+    return -1;
+
   ctx->closing = true;
 
   if (ctx->readonly || ctx->dontwrite || ctx->append)
@@ -839,7 +941,9 @@ int mx_close_mailbox(struct Context *ctx, int *index_hint)
   /* allow IMAP to preserve the deleted flag across sessions */
   if (ctx->magic == MUTT_IMAP)
   {
+    mutt_perf_start(&perf, PERF_SYNC);
     check = imap_sync_mailbox(ctx, purge);
+    mutt_perf_stop(&perf);
     if (check != 0)
     {
       ctx->closing = false;
@@ -861,7 +965,9 @@ int mx_close_mailbox(struct Context *ctx, int *index_hint)
 
     if (ctx->changed || ctx->deleted)
     {
+      mutt_perf_start(&perf, PERF_SYNC);
       check = sync_mailbox(ctx, index_hint);
+      mutt_perf_stop(&perf);
       if (check != 0)
       {
         ctx->closing = false;
@@ -990,6 +1096,83 @@ void mx_update_tables(struct Context *ctx, bool committing)
     }
   }
   ctx->msgcount = j;
+
+  mx_update_columns(ctx, 0);
+  mutt_addr_index_free(&ctx->addr_index);
+}
+
+/**
+ * mx_save_order - Remember the sorted order of a mailbox
+ * @param ctx Mailbox
+ * @retval num Number of messages, to pass to mx_restore_order()
+ * @retval 0   The order can't be kept, e.g. the mailbox is threaded
+ *
+ * Call this before purging messages.  Afterwards the rest don't need sorting
+ * again, they only need to be put back in the same order.
+ */
+int mx_save_order(struct Context *ctx)
+{
+  if (!ctx || ((Sort & SORT_MASK) == SORT_THREADS))
+    return 0;
+
+  for (int i = 0; i < ctx->msgcount; i++)
+    ctx->hdrs[i]->sort_pos = i + 1;
+
+  return ctx->msgcount;
+}
+
+/**
+ * mx_restore_order - Put the messages back in their sorted order
+ * @param ctx      Mailbox, after mx_update_tables()
+ * @param oldcount Return value of mx_save_order()
+ * @retval true  The messages are sorted
+ * @retval false The mailbox needs sorting with mutt_sort_headers()
+ *
+ * This is a linear pass, instead of a full sort.  It fails if the sort
+ * settings have changed, or there's a message that wasn't there when the
+ * order was saved.
+ */
+bool mx_restore_order(struct Context *ctx, int oldcount)
+{
+  if (!ctx || (oldcount == 0) || (ctx->msgcount > oldcount) ||
+      ((Sort & SORT_MASK) == SORT_THREADS) || OPT_NEED_RESORT ||
+      OPT_RESORT_INIT || OPT_NEED_RESCORE)
+  {
+    return false;
+  }
+
+  struct Header **sorted = mutt_mem_calloc(oldcount, sizeof(struct Header *));
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    const int pos = ctx->hdrs[i]->sort_pos - 1;
+    if ((pos < 0) || (pos >= oldcount) || sorted[pos])
+    {
+      FREE(&sorted);
+      return false;
+    }
+    sorted[pos] = ctx->hdrs[i];
+  }
+
+  ctx->vcount = 0;
+  for (int pos = 0, i = 0; pos < oldcount; pos++)
+  {
+    struct Header *h = sorted[pos];
+    if (!h)
+      continue;
+
+    ctx->hdrs[i] = h;
+    h->msgno = i;
+    if (h->virtual != -1)
+    {
+      h->virtual = ctx->vcount;
+      ctx->v2r[ctx->vcount++] = i;
+    }
+    i++;
+  }
+  FREE(&sorted);
+
+  mx_update_columns(ctx, 0);
+  return true;
 }
 
 /**
@@ -1001,9 +1184,10 @@ void mx_update_tables(struct Context *ctx, bool committing)
  */
 int mx_sync_mailbox(struct Context *ctx, int *index_hint)
 {
+  struct PerfTimer perf;
   int rc;
   int purge = 1;
-  int msgcount, deleted;
+  int msgcount, deleted, sorted = 0;
 
   if (ctx->dontwrite)
   {
@@ -1022,6 +1206,9 @@ int mx_sync_mailbox(struct Context *ctx, int *index_hint)
     return -1;
   }
 
+  if (ctx->loading && (mx_open_more(ctx, true) < 0))
+    return -1;
+
   if (!ctx->changed && !ctx->deleted)
   {
     if (!ctx->quiet)
@@ -1070,12 +1257,18 @@ int mx_sync_mailbox(struct Context *ctx, int *index_hint)
       return -1;
   }
 
+  /* the driver may reorder the messages, see below */
+  if (purge && ctx->deleted && (ctx->magic != MUTT_IMAP))
+    sorted = mx_save_order(ctx);
+
+  mutt_perf_start(&perf, PERF_SYNC);
 #ifdef USE_IMAP
   if (ctx->magic == MUTT_IMAP)
     rc = imap_sync_mailbox(ctx, purge);
   else
 #endif
     rc = sync_mailbox(ctx, index_hint);
+  mutt_perf_stop(&perf);
   if (rc == 0)
   {
 #ifdef USE_IMAP
@@ -1114,9 +1307,14 @@ int mx_sync_mailbox(struct Context *ctx, int *index_hint)
       if (ctx->magic != MUTT_IMAP)
       {
         mx_update_tables(ctx, true);
-        mutt_sort_headers(ctx, 1); /* rethread from scratch */
+        /* purging doesn't change the order of the rest, unless they're threaded */
+        if (!mx_restore_order(ctx, sorted))
+          mutt_sort_headers(ctx, 1); /* rethread from scratch */
       }
     }
+
+    /* rewriting a message (e.g. deleting attachments) changes its size */
+    mx_update_columns(ctx, 0);
   }
 
   return rc;
@@ -1194,7 +1392,14 @@ int mx_check_mailbox(struct Context *ctx, int *index_hint)
     return -1;
   }
 
-  return ctx->mx_ops->check(ctx, index_hint);
+  /* The changes will be noticed once the mailbox has been read */
+  if (ctx->loading)
+    return 0;
+
+  int rc = ctx->mx_ops->check(ctx, index_hint);
+  if (rc == MUTT_REOPENED)
+    mutt_attach_cache_forget(ctx, NULL);
+  return rc;
 }
 
 /**
@@ -1286,6 +1491,43 @@ void mx_alloc_memory(struct Context *ctx)
   }
 }
 
+/**
+ * mx_update_columns - Copy the scalar fields of the messages into columns
+ * @param ctx   Mailbox
+ * @param first First row to copy, whatever its state
+ *
+ * Before @a first, only the rows that don't belong to their Header any more
+ * (e.g. the mailbox was re-sorted) are copied.
+ */
+void mx_update_columns(struct Context *ctx, int first)
+{
+  struct MsgColumns *cols = &ctx->cols;
+
+  if (cols->max < ctx->msgcount)
+  {
+    cols->max = ctx->hdrmax;
+    mutt_mem_realloc(&cols->hdr, cols->max * sizeof(struct Header *));
+    mutt_mem_realloc(&cols->date_sent, cols->max * sizeof(time_t));
+    mutt_mem_realloc(&cols->received, cols->max * sizeof(time_t));
+    mutt_mem_realloc(&cols->size, cols->max * sizeof(LOFF_T));
+    mutt_mem_realloc(&cols->score, cols->max * sizeof(int));
+    memset(cols->hdr, 0, cols->max * sizeof(struct Header *));
+  }
+
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    struct Header *h = ctx->hdrs[i];
+    if ((i < first) && (cols->hdr[i] == h))
+      continue;
+
+    cols->hdr[i] = h;
+    cols->date_sent[i] = h->date_sent;
+    cols->received[i] = h->received;
+    cols->size[i] = h->content->length;
+    cols->score[i] = h->score;
+  }
+}
+
 /**
  * mx_update_context - Update the Context's message counts
  *
@@ -1353,6 +1595,10 @@ void mx_update_context(struct Context *ctx, int new_messages)
         ctx->new ++;
     }
   }
+
+  mx_update_columns(ctx, ctx->msgcount - new_messages);
+  /* a new Header may reuse the memory of one the index remembers */
+  mutt_addr_index_free(&ctx->addr_index);
 }
 
 /**
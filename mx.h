@@ -51,10 +51,12 @@ struct stat;
  *
  * Optional operations
  *  - open_new_msg
+ *  - open_more
  */
 struct MxOps
 {
   int (*open)(struct Context *ctx);
+  int (*open_more)(struct Context *ctx);
   int (*open_append)(struct Context *ctx, int flags);
   int (*close)(struct Context *ctx);
   int (*check)(struct Context *ctx, int *index_hint);
@@ -116,8 +118,11 @@ FILE *maildir_open_find_message(const char *folder, const char *msg, char **newn
 int mbox_strict_cmp_headers(const struct Header *h1, const struct Header *h2);
 
 void mx_alloc_memory(struct Context *ctx);
+void mx_update_columns(struct Context *ctx, int first);
 void mx_update_context(struct Context *ctx, int new_messages);
 void mx_update_tables(struct Context *ctx, bool committing);
+int mx_save_order(struct Context *ctx);
+bool mx_restore_order(struct Context *ctx, int oldcount);
 
 struct MxOps *mx_get_ops(int magic);
 extern struct MxOps mx_maildir_ops;
@@ -30,16 +30,20 @@
 #include <locale.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include "mutt/mutt.h"
 #include "mutt.h"
 #include "address.h"
 #include "alias.h"
+#include "attach.h"
 #include "body.h"
 #include "content.h"
 #include "context.h"
 #include "copy.h"
+#include "crypt.h"
 #include "cryptglue.h"
 #include "envelope.h"
 #include "globals.h"
@@ -86,6 +90,9 @@ void crypt_forget_passphrase(void)
   if ((WithCrypto & APPLICATION_SMIME))
     crypt_smime_void_passphrase();
 
+  /* don't keep showing what was decrypted with them */
+  mutt_attach_cache_forget(NULL, NULL);
+
   if (WithCrypto)
     mutt_message(_("Passphrase(s) forgotten."));
 }
@@ -929,6 +936,101 @@ void crypt_opportunistic_encrypt(struct Header *msg)
   }
 }
 
+/* A key may expire, or be revoked without the keyring files changing, so a
+ * verification is only remembered for a while */
+#define SIG_VERIFIED_TTL 600
+
+/**
+ * verify_one - Verify a signature, or show the remembered result
+ * @param sigbdy   Signature
+ * @param s        State of the display
+ * @param tempfile File containing the signed data
+ * @param smime    If true, it's an S/MIME signature
+ * @retval  0 The signature is good
+ * @retval -1 Error, or the signature is bad
+ *
+ * Displaying a signed message again, e.g. when paging back, doesn't run the
+ * verification again.  The result is kept with the signature's Body, so it's
+ * only used for the same part of the same message, and only while the
+ * message's file, the keyring and the time allow.  Classic S/MIME doesn't
+ * use the GnuPG keyring, so its results aren't remembered.
+ */
+static int verify_one(struct Body *sigbdy, struct State *s, const char *tempfile, bool smime)
+{
+  char tmpout[_POSIX_PATH_MAX];
+  unsigned int stamp;
+  struct stat st;
+  struct SigVerified *v = sigbdy->verified;
+  const time_t now = time(NULL);
+  int rc;
+
+  if (s->prefix || (smime && !CryptUseGpgme) || !crypt_keyring_stamp(false, &stamp) ||
+      (fstat(fileno(s->fpin), &st) != 0))
+  {
+    return smime ? crypt_smime_verify_one(sigbdy, s, tempfile) :
+                   crypt_pgp_verify_one(sigbdy, s, tempfile);
+  }
+
+  if (v && (v->stamp == stamp) && (v->dev == st.st_dev) && (v->ino == st.st_ino) &&
+      (v->size == st.st_size) && (v->mtime == st.st_mtime) && (now >= v->when) &&
+      (now - v->when < SIG_VERIFIED_TTL))
+  {
+    mutt_debug(2, "using the remembered verification\n");
+    fwrite(v->output, 1, v->outlen, s->fpout);
+    return v->rc;
+  }
+
+  if (v)
+    FREE(&v->output);
+  FREE(&sigbdy->verified);
+
+  /* Catch the output, to remember it */
+  mutt_mktemp(tmpout, sizeof(tmpout));
+  struct State tmp = *s;
+  tmp.fpout = mutt_file_fopen(tmpout, "w+");
+  if (!tmp.fpout)
+  {
+    mutt_perror(tmpout);
+    return smime ? crypt_smime_verify_one(sigbdy, s, tempfile) :
+                   crypt_pgp_verify_one(sigbdy, s, tempfile);
+  }
+  unlink(tmpout);
+
+  rc = smime ? crypt_smime_verify_one(sigbdy, &tmp, tempfile) :
+               crypt_pgp_verify_one(sigbdy, &tmp, tempfile);
+
+  fflush(tmp.fpout);
+  LOFF_T len = ftello(tmp.fpout);
+  if (len >= 0)
+  {
+    v = mutt_mem_calloc(1, sizeof(struct SigVerified));
+    v->output = mutt_mem_malloc(len + 1);
+    rewind(tmp.fpout);
+    if (fread(v->output, 1, len, tmp.fpout) == (size_t) len)
+    {
+      fwrite(v->output, 1, len, s->fpout);
+      v->dev = st.st_dev;
+      v->ino = st.st_ino;
+      v->size = st.st_size;
+      v->mtime = st.st_mtime;
+      v->when = now;
+      v->stamp = stamp;
+      v->rc = rc;
+      v->outlen = len;
+      sigbdy->verified = v;
+    }
+    else
+    {
+      FREE(&v->output);
+      FREE(&v);
+      rc = -1;
+    }
+  }
+  mutt_file_fclose(&tmp.fpout);
+
+  return rc;
+}
+
 static void crypt_fetch_signatures(struct Body ***signatures, struct Body *a, int *n)
 {
   if (!WithCrypto)
@@ -1031,7 +1133,7 @@ int mutt_signed_handler(struct Body *a, struct State *s)
           if ((WithCrypto & APPLICATION_PGP) && signatures[i]->type == TYPEAPPLICATION &&
               (mutt_str_strcasecmp(signatures[i]->subtype, "pgp-signature") == 0))
           {
-            if (crypt_pgp_verify_one(signatures[i], s, tempfile) != 0)
+            if (verify_one(signatures[i], s, tempfile, false) != 0)
               goodsig = false;
 
             continue;
@@ -1043,7 +1145,7 @@ int mutt_signed_handler(struct Body *a, struct State *s)
                (mutt_str_strcasecmp(signatures[i]->subtype,
                                     "pkcs7-signature") == 0)))
           {
-            if (crypt_smime_verify_one(signatures[i], s, tempfile) != 0)
+            if (verify_one(signatures[i], s, tempfile, true) != 0)
               goodsig = false;
 
             continue;
@@ -1189,3 +1291,53 @@ bool crypt_is_numerical_keyid(const char *s)
 
   return true;
 }
+
+/**
+ * crypt_keyring_stamp - Fingerprint the files of a GnuPG keyring
+ * @param[in]  secret If true, include the secret key files
+ * @param[out] stamp  Hash of the files' inodes, sizes and mtimes
+ * @retval true  Success
+ * @retval false None of the files exist, so changes can't be seen
+ *
+ * A cached key listing is valid while the stamp is unchanged.  The trust
+ * databases are included, because they change the keys' validity.
+ */
+bool crypt_keyring_stamp(bool secret, unsigned int *stamp)
+{
+  static const char *const files[] = {
+    "pubring.kbx", "pubring.gpg", "trustdb.gpg", "trustlist.txt",
+    /* secret keys */
+    "secring.gpg", "private-keys-v1.d",
+  };
+  const size_t num_public = 4;
+  const char *home = getenv("GNUPGHOME");
+  char homebuf[_POSIX_PATH_MAX];
+  char path[PATH_MAX];
+  struct stat sb;
+  bool found = false;
+  unsigned int h = 2166136261U; /* FNV-1a */
+
+  if (!home)
+  {
+    snprintf(homebuf, sizeof(homebuf), "%s/.gnupg", NONULL(HomeDir));
+    home = homebuf;
+  }
+
+  for (size_t i = 0; i < mutt_array_size(files); i++)
+  {
+    if (!secret && (i >= num_public))
+      break;
+
+    snprintf(path, sizeof(path), "%s/%s", home, files[i]);
+    if (stat(path, &sb) != 0)
+      continue;
+
+    found = true;
+    const unsigned long vals[] = { i, sb.st_ino, sb.st_size, sb.st_mtime };
+    for (size_t j = 0; j < mutt_array_size(vals); j++)
+      h = (h ^ (unsigned int) vals[j]) * 16777619U;
+  }
+
+  *stamp = h;
+  return found;
+}
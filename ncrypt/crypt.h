@@ -34,5 +34,6 @@ int crypt_write_signed(struct Body *a, struct State *s, const char *tempfile);
 const char *crypt_get_fingerprint_or_id(char *p, const char **pphint,
                                         const char **ppl, const char **pps);
 bool crypt_is_numerical_keyid(const char *s);
+bool crypt_keyring_stamp(bool secret, unsigned int *stamp);
 
 #endif /* _NCRYPT_CRYPT_H */
@@ -3993,33 +3993,220 @@ static char *list_to_pattern(struct ListHead *list)
   return pattern;
 }
 
+/**
+ * struct CryptKeyCache - Every key of a keyring, as listed at some point
+ */
+struct CryptKeyCache
+{
+  gpgme_key_t *keys;  /**< Referenced keys, in the order they were listed */
+  size_t num;         /**< Number of keys */
+  unsigned int stamp; /**< Fingerprint of the keyring files, see crypt_keyring_stamp() */
+  bool valid;         /**< The keyring has been listed */
+};
+
+/* Indexed by [is S/MIME][is secret] */
+static struct CryptKeyCache KeyCache[2][2];
+static gpgme_ctx_t ListContext[2];
+
+/**
+ * list_context - Get the context used for listing keys
+ * @param smime If true, list X.509 certificates
+ * @retval ptr GPGME context
+ *
+ * The context is kept for the session.  Listings don't change its settings,
+ * so it can be shared by all of them.
+ */
+static gpgme_ctx_t list_context(bool smime)
+{
+  if (!ListContext[smime])
+    ListContext[smime] = create_gpgme_context(smime);
+  return ListContext[smime];
+}
+
+/**
+ * key_cache_free - Empty a key cache
+ * @param cache Cache to empty
+ */
+static void key_cache_free(struct CryptKeyCache *cache)
+{
+  for (size_t i = 0; i < cache->num; i++)
+    gpgme_key_unref(cache->keys[i]);
+  FREE(&cache->keys);
+  cache->num = 0;
+  cache->valid = false;
+}
+
+/**
+ * key_cache_get - Get every key of a keyring
+ * @param smime  If true, list X.509 certificates
+ * @param secret If true, list secret keys
+ * @retval ptr  Cached keys
+ * @retval NULL The keyring can't be cached, or listing it failed
+ *
+ * The keyring is listed again when its files change.
+ */
+static struct CryptKeyCache *key_cache_get(bool smime, bool secret)
+{
+  struct CryptKeyCache *cache = &KeyCache[smime][secret];
+  unsigned int stamp;
+  size_t max = 0;
+  gpgme_key_t key;
+  gpgme_error_t err;
+
+  if (!crypt_keyring_stamp(secret, &stamp))
+    return NULL;
+
+  if (cache->valid && (cache->stamp == stamp))
+    return cache;
+
+  key_cache_free(cache);
+
+  gpgme_ctx_t ctx = list_context(smime);
+  err = gpgme_op_keylist_start(ctx, NULL, secret);
+  if (err)
+  {
+    mutt_error(_("gpgme_op_keylist_start failed: %s"), gpgme_strerror(err));
+    return NULL;
+  }
+
+  while (!(err = gpgme_op_keylist_next(ctx, &key)))
+  {
+    if (cache->num == max)
+    {
+      max += 64;
+      mutt_mem_realloc(&cache->keys, max * sizeof(gpgme_key_t));
+    }
+    cache->keys[cache->num++] = key;
+  }
+  gpgme_op_keylist_end(ctx);
+
+  if (gpg_err_code(err) != GPG_ERR_EOF)
+  {
+    mutt_error(_("gpgme_op_keylist_next failed: %s"), gpgme_strerror(err));
+    key_cache_free(cache);
+    return NULL;
+  }
+
+  cache->stamp = stamp;
+  cache->valid = true;
+  return cache;
+}
+
+/**
+ * key_matches_hints - Would a keylist with the hints have found a key?
+ * @param key   Key
+ * @param hints Strings to match
+ * @retval true The key matches a hint, or there are no hints
+ *
+ * A hint matches a substring of a user id, case-insensitively, or the end of
+ * the key id or fingerprint of one of the subkeys.
+ */
+static bool key_matches_hints(gpgme_key_t key, struct ListHead *hints)
+{
+  bool empty = true;
+
+  struct ListNode *np;
+  STAILQ_FOREACH(np, hints, entries)
+  {
+    const char *hint = np->data;
+    if (!hint || !*hint)
+      continue;
+
+    empty = false;
+    if (mutt_str_strncasecmp(hint, "0x", 2) == 0)
+      hint += 2;
+    size_t hlen = mutt_str_strlen(hint);
+
+    for (gpgme_user_id_t uid = key->uids; uid; uid = uid->next)
+      if (mutt_str_stristr(uid->uid, hint))
+        return true;
+
+    for (gpgme_subkey_t sub = key->subkeys; sub; sub = sub->next)
+    {
+      const char *ids[] = { sub->keyid, sub->fpr };
+      for (size_t i = 0; i < mutt_array_size(ids); i++)
+      {
+        size_t idlen = mutt_str_strlen(ids[i]);
+        if (hlen && (idlen >= hlen) &&
+            (mutt_str_strcasecmp(ids[i] + idlen - hlen, hint) == 0))
+        {
+          return true;
+        }
+      }
+    }
+  }
+
+  return empty;
+}
+
+/**
+ * add_candidate - Add a key's user ids to a list of candidates
+ * @param[out] kend  End of the list
+ * @param[in]  key   Key to add
+ * @param[in]  smime If true, the key is an X.509 certificate
+ * @retval ptr New end of the list
+ */
+static struct CryptKeyInfo **add_candidate(struct CryptKeyInfo **kend,
+                                           gpgme_key_t key, bool smime)
+{
+  unsigned int flags = smime ? KEYFLAG_ISX509 : 0;
+  gpgme_user_id_t uid = NULL;
+  int idx;
+
+  if (key_check_cap(key, KEY_CAP_CAN_ENCRYPT))
+    flags |= KEYFLAG_CANENCRYPT;
+  if (key_check_cap(key, KEY_CAP_CAN_SIGN))
+    flags |= KEYFLAG_CANSIGN;
+
+  if (!smime)
+  {
+    if (key->revoked)
+      flags |= KEYFLAG_REVOKED;
+    if (key->expired)
+      flags |= KEYFLAG_EXPIRED;
+    if (key->disabled)
+      flags |= KEYFLAG_DISABLED;
+  }
+
+  for (idx = 0, uid = key->uids; uid; idx++, uid = uid->next)
+  {
+    struct CryptKeyInfo *k = mutt_mem_calloc(1, sizeof(*k));
+    k->kobj = key;
+    gpgme_key_ref(k->kobj);
+    k->idx = idx;
+    k->uid = uid->uid;
+    k->flags = flags;
+    if (!smime && uid->revoked)
+      k->flags |= KEYFLAG_REVOKED;
+    k->validity = uid->validity;
+    *kend = k;
+    kend = &k->next;
+  }
+
+  return kend;
+}
+
 /**
  * get_candidates - Get a list of keys which are candidates for the selection
  *
  * Select by looking at the HINTS list.
+ *
+ * The keyrings are listed once and cached, see key_cache_get().  Only if a
+ * keyring can't be cached are the keys listed by pattern.
  */
 static struct CryptKeyInfo *get_candidates(struct ListHead *hints, unsigned int app, int secret)
 {
-  struct CryptKeyInfo *db = NULL, *k = NULL, **kend = NULL;
+  struct CryptKeyInfo *db = NULL, **kend = NULL;
+  struct CryptKeyCache *cache = NULL;
   char *pattern = NULL;
   gpgme_error_t err;
   gpgme_ctx_t ctx;
   gpgme_key_t key;
-  int idx;
-  gpgme_user_id_t uid = NULL;
 
   pattern = list_to_pattern(hints);
   if (!pattern)
     return NULL;
 
-  err = gpgme_new(&ctx);
-  if (err)
-  {
-    mutt_error(_("gpgme_new failed: %s"), gpgme_strerror(err));
-    FREE(&pattern);
-    return NULL;
-  }
-
   db = NULL;
   kend = &db;
 
@@ -4039,6 +4226,15 @@ static struct CryptKeyInfo *get_candidates(struct ListHead *hints, unsigned int
     if (!n)
       goto no_pgphints;
 
+    cache = key_cache_get(false, secret);
+    if (cache)
+    {
+      for (size_t i = 0; i < cache->num; i++)
+        if (key_matches_hints(cache->keys[i], hints))
+          kend = add_candidate(kend, cache->keys[i], false);
+      goto no_pgphints;
+    }
+
     char **patarr = mutt_mem_calloc(n + 1, sizeof(*patarr));
     n = 0;
     STAILQ_FOREACH(np, hints, entries)
@@ -4047,6 +4243,7 @@ static struct CryptKeyInfo *get_candidates(struct ListHead *hints, unsigned int
         patarr[n++] = mutt_str_strdup(np->data);
     }
     patarr[n] = NULL;
+    ctx = list_context(false);
     err = gpgme_op_keylist_ext_start(ctx, (const char **) patarr, secret, 0);
     for (n = 0; patarr[n]; n++)
       FREE(&patarr[n]);
@@ -4054,41 +4251,14 @@ static struct CryptKeyInfo *get_candidates(struct ListHead *hints, unsigned int
     if (err)
     {
       mutt_error(_("gpgme_op_keylist_start failed: %s"), gpgme_strerror(err));
-      gpgme_release(ctx);
+      crypt_free_key(&db);
       FREE(&pattern);
       return NULL;
     }
 
     while (!(err = gpgme_op_keylist_next(ctx, &key)))
     {
-      unsigned int flags = 0;
-
-      if (key_check_cap(key, KEY_CAP_CAN_ENCRYPT))
-        flags |= KEYFLAG_CANENCRYPT;
-      if (key_check_cap(key, KEY_CAP_CAN_SIGN))
-        flags |= KEYFLAG_CANSIGN;
-
-      if (key->revoked)
-        flags |= KEYFLAG_REVOKED;
-      if (key->expired)
-        flags |= KEYFLAG_EXPIRED;
-      if (key->disabled)
-        flags |= KEYFLAG_DISABLED;
-
-      for (idx = 0, uid = key->uids; uid; idx++, uid = uid->next)
-      {
-        k = mutt_mem_calloc(1, sizeof(*k));
-        k->kobj = key;
-        gpgme_key_ref(k->kobj);
-        k->idx = idx;
-        k->uid = uid->uid;
-        k->flags = flags;
-        if (uid->revoked)
-          k->flags |= KEYFLAG_REVOKED;
-        k->validity = uid->validity;
-        *kend = k;
-        kend = &k->next;
-      }
+      kend = add_candidate(kend, key, false);
       gpgme_key_unref(key);
     }
     if (gpg_err_code(err) != GPG_ERR_EOF)
@@ -4100,45 +4270,36 @@ static struct CryptKeyInfo *get_candidates(struct ListHead *hints, unsigned int
   if ((app & APPLICATION_SMIME))
   {
     /* and now look for x509 certificates */
-    gpgme_set_protocol(ctx, GPGME_PROTOCOL_CMS);
-    err = gpgme_op_keylist_start(ctx, pattern, 0);
-    if (err)
+    cache = key_cache_get(true, false);
+    if (cache)
     {
-      mutt_error(_("gpgme_op_keylist_start failed: %s"), gpgme_strerror(err));
-      gpgme_release(ctx);
-      FREE(&pattern);
-      return NULL;
+      for (size_t i = 0; i < cache->num; i++)
+        if (key_matches_hints(cache->keys[i], hints))
+          kend = add_candidate(kend, cache->keys[i], true);
     }
-
-    while (!(err = gpgme_op_keylist_next(ctx, &key)))
+    else
     {
-      unsigned int flags = KEYFLAG_ISX509;
-
-      if (key_check_cap(key, KEY_CAP_CAN_ENCRYPT))
-        flags |= KEYFLAG_CANENCRYPT;
-      if (key_check_cap(key, KEY_CAP_CAN_SIGN))
-        flags |= KEYFLAG_CANSIGN;
+      ctx = list_context(true);
+      err = gpgme_op_keylist_start(ctx, pattern, 0);
+      if (err)
+      {
+        mutt_error(_("gpgme_op_keylist_start failed: %s"), gpgme_strerror(err));
+        crypt_free_key(&db);
+        FREE(&pattern);
+        return NULL;
+      }
 
-      for (idx = 0, uid = key->uids; uid; idx++, uid = uid->next)
+      while (!(err = gpgme_op_keylist_next(ctx, &key)))
       {
-        k = mutt_mem_calloc(1, sizeof(*k));
-        k->kobj = key;
-        gpgme_key_ref(k->kobj);
-        k->idx = idx;
-        k->uid = uid->uid;
-        k->flags = flags;
-        k->validity = uid->validity;
-        *kend = k;
-        kend = &k->next;
+        kend = add_candidate(kend, key, true);
+        gpgme_key_unref(key);
       }
-      gpgme_key_unref(key);
+      if (gpg_err_code(err) != GPG_ERR_EOF)
+        mutt_error(_("gpgme_op_keylist_next failed: %s"), gpgme_strerror(err));
+      gpgme_op_keylist_end(ctx);
     }
-    if (gpg_err_code(err) != GPG_ERR_EOF)
-      mutt_error(_("gpgme_op_keylist_next failed: %s"), gpgme_strerror(err));
-    gpgme_op_keylist_end(ctx);
   }
 
-  gpgme_release(ctx);
   FREE(&pattern);
   return db;
 }
@@ -21,9 +21,11 @@
  */
 
 #include "config.h"
+#include <stdbool.h>
 #include "mutt/mutt.h"
 #include "mutt/queue.h"
 #include "crypt_mod.h"
+#include "perf.h"
 
 /**
  * struct CryptModule - A crypto plugin module
@@ -33,6 +35,7 @@
 struct CryptModule
 {
   struct CryptModuleSpecs *specs;
+  bool initialised; /**< The module's init function has been run */
   STAILQ_ENTRY(CryptModule) entries;
 };
 STAILQ_HEAD(CryptModules, CryptModule)
@@ -53,6 +56,9 @@ void crypto_module_register(struct CryptModuleSpecs *specs)
  *
  * Return the crypto module specs for IDENTIFIER.
  * This function is usually used via the CRYPT_MOD_CALL[_CHECK] macros.
+ *
+ * The module is initialised the first time it's looked up, not at startup.
+ * GPGME's init runs gpg to check its version, which most sessions never need.
  */
 struct CryptModuleSpecs *crypto_module_lookup(int identifier)
 {
@@ -61,6 +67,17 @@ struct CryptModuleSpecs *crypto_module_lookup(int identifier)
   {
     if (module->specs->identifier == identifier)
     {
+      if (!module->initialised)
+      {
+        module->initialised = true;
+        if (module->specs->functions.init)
+        {
+          struct PerfTimer perf;
+          mutt_perf_start(&perf, PERF_CRYPT_INIT);
+          module->specs->functions.init();
+          mutt_perf_stop(&perf);
+        }
+      }
       return module->specs;
     }
   }
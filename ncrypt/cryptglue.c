@@ -103,14 +103,7 @@ void crypt_init(void)
 #endif
   }
 
-#if defined(CRYPT_BACKEND_CLASSIC_PGP) ||                                      \
-    defined(CRYPT_BACKEND_CLASSIC_SMIME) || defined(CRYPT_BACKEND_GPGME)
-  if (CRYPT_MOD_CALL_CHECK(PGP, init))
-    (CRYPT_MOD_CALL(PGP, init))();
-
-  if (CRYPT_MOD_CALL_CHECK(SMIME, init))
-    (CRYPT_MOD_CALL(SMIME, init))();
-#endif
+  /* The modules are initialised by crypto_module_lookup(), when first used */
 }
 
 /**
@@ -40,6 +40,7 @@
 #include <unistd.h>
 #include "mutt/mutt.h"
 #include "mutt.h"
+#include "crypt.h"
 #include "filter.h"
 #include "globals.h"
 #include "ncrypt.h"
@@ -70,6 +71,19 @@
 
 static char *chs = NULL;
 
+/**
+ * struct PgpKeyCache - Every key of a keyring, as listed at some point
+ */
+struct PgpKeyCache
+{
+  struct PgpKeyInfo *keys; /**< Keys, in the order they were listed */
+  unsigned int stamp;      /**< Fingerprint of the keyring files, see crypt_keyring_stamp() */
+  char *command;           /**< List command that was used */
+  char *charset;           /**< $charset the uids were converted to */
+};
+
+static struct PgpKeyCache KeyCache[2]; /**< Indexed by enum PgpRing */
+
 static void fix_uid(char *uid)
 {
   char *s = NULL, *d = NULL;
@@ -113,7 +127,7 @@ static void fix_uid(char *uid)
         memcpy(uid, buf, n);
     }
     FREE(&buf);
-    iconv_close(cd);
+    mutt_ch_iconv_close(cd);
   }
 }
 
@@ -382,7 +396,13 @@ bail:
   return NULL;
 }
 
-struct PgpKeyInfo *pgp_get_candidates(enum PgpRing keyring, struct ListHead *hints)
+/**
+ * read_candidates - List keys with the external program
+ * @param keyring Keyring to list
+ * @param hints   Strings the keys must match, or empty for every key
+ * @retval ptr List of keys
+ */
+static struct PgpKeyInfo *read_candidates(enum PgpRing keyring, struct ListHead *hints)
 {
   FILE *fp = NULL;
   pid_t thepid;
@@ -444,3 +464,128 @@ struct PgpKeyInfo *pgp_get_candidates(enum PgpRing keyring, struct ListHead *hin
 
   return db;
 }
+
+/**
+ * key_matches_hints - Would the list command have listed a key?
+ * @param k     Primary key, followed by its subkeys
+ * @param hints Strings to match
+ * @retval true The key matches a hint, or there are no hints
+ *
+ * Like gpg, a hint matches a substring of a user id, case-insensitively, or
+ * the end of the key id or fingerprint of the key or one of its subkeys.
+ */
+static bool key_matches_hints(struct PgpKeyInfo *k, struct ListHead *hints)
+{
+  if (STAILQ_EMPTY(hints))
+    return true;
+
+  struct ListNode *np;
+  STAILQ_FOREACH(np, hints, entries)
+  {
+    const char *hint = np->data;
+    if (mutt_str_strncasecmp(hint, "0x", 2) == 0)
+      hint += 2;
+    size_t hlen = mutt_str_strlen(hint);
+
+    for (struct PgpUid *u = k->address; u; u = u->next)
+      if (mutt_str_stristr(u->addr, hint))
+        return true;
+
+    for (struct PgpKeyInfo *p = k; p && ((p == k) || (p->parent == k)); p = p->next)
+    {
+      const char *ids[] = { p->keyid, p->fingerprint };
+      for (size_t i = 0; i < mutt_array_size(ids); i++)
+      {
+        size_t idlen = mutt_str_strlen(ids[i]);
+        if (hlen && (idlen >= hlen) &&
+            (mutt_str_strcasecmp(ids[i] + idlen - hlen, hint) == 0))
+        {
+          return true;
+        }
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * copy_candidates - Copy the cached keys that match the hints
+ * @param keys  Cached keys
+ * @param hints Strings the keys must match
+ * @retval ptr List of keys, which the caller must free
+ *
+ * A primary key is copied together with all its subkeys.
+ */
+static struct PgpKeyInfo *copy_candidates(struct PgpKeyInfo *keys, struct ListHead *hints)
+{
+  struct PgpKeyInfo *db = NULL, **kend = &db, *mainkey = NULL;
+
+  for (struct PgpKeyInfo *k = keys; k;)
+  {
+    struct PgpKeyInfo *next = k->next;
+    while (next && (next->parent == k))
+      next = next->next;
+
+    if (key_matches_hints(k, hints))
+    {
+      for (struct PgpKeyInfo *p = k; p != next; p = p->next)
+      {
+        struct PgpKeyInfo *c = pgp_new_keyinfo();
+        c->keyid = mutt_str_strdup(p->keyid);
+        c->fingerprint = mutt_str_strdup(p->fingerprint);
+        c->flags = p->flags;
+        c->keylen = p->keylen;
+        c->gen_time = p->gen_time;
+        c->numalg = p->numalg;
+        c->algorithm = p->algorithm;
+        if (p == k)
+          mainkey = c;
+        else
+          c->parent = mainkey;
+        c->address = pgp_copy_uids(p->address, c);
+        *kend = c;
+        kend = &c->next;
+      }
+    }
+
+    k = next;
+  }
+
+  return db;
+}
+
+/**
+ * pgp_get_candidates - Find the keys matching some strings
+ * @param keyring Keyring to search
+ * @param hints   Strings the keys must match
+ * @retval ptr List of keys, which the caller must free
+ *
+ * The whole keyring is listed once and kept, until its files change or the
+ * list command or $charset is changed.  Without keyring files to watch, the
+ * external program is run for every lookup.
+ */
+struct PgpKeyInfo *pgp_get_candidates(enum PgpRing keyring, struct ListHead *hints)
+{
+  struct PgpKeyCache *cache = &KeyCache[keyring];
+  const char *command = (keyring == PGP_SECRING) ? PgpListSecringCommand : PgpListPubringCommand;
+  unsigned int stamp;
+
+  if (!crypt_keyring_stamp(keyring == PGP_SECRING, &stamp))
+    return read_candidates(keyring, hints);
+
+  if (!cache->keys || (cache->stamp != stamp) ||
+      (mutt_str_strcmp(cache->command, command) != 0) ||
+      (mutt_str_strcmp(cache->charset, Charset) != 0))
+  {
+    struct ListHead all = STAILQ_HEAD_INITIALIZER(all);
+
+    pgp_free_key(&cache->keys);
+    cache->keys = read_candidates(keyring, &all);
+    cache->stamp = stamp;
+    mutt_str_replace(&cache->command, command);
+    mutt_str_replace(&cache->charset, Charset);
+  }
+
+  return copy_candidates(cache->keys, hints);
+}
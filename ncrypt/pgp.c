@@ -819,8 +819,18 @@ void pgp_extract_keys_from_attachment_list(FILE *fp, int tag, struct Body *top)
   OPT_DONT_HANDLE_PGP_KEYS = false;
 }
 
-static struct Body *pgp_decrypt_part(struct Body *a, struct State *s,
-                                     FILE *fpout, struct Body *p)
+/**
+ * pgp_decrypt_part - Decrypt part of a PGP message
+ * @param a      Body of the encrypted part
+ * @param s      State of the display
+ * @param fpout  File for the decrypted result
+ * @param p      Body to receive the signature status
+ * @param infile File holding exactly the encrypted part, or NULL to copy it from s->fpin
+ * @retval ptr Body of the decrypted part
+ * @retval NULL Error
+ */
+static struct Body *pgp_decrypt_part(struct Body *a, struct State *s, FILE *fpout,
+                                     struct Body *p, const char *infile)
 {
   if (!a || !s || !fpout || !p)
     return NULL;
@@ -844,28 +854,34 @@ static struct Body *pgp_decrypt_part(struct Body *a, struct State *s,
   }
   unlink(pgperrfile);
 
-  mutt_mktemp(pgptmpfile, sizeof(pgptmpfile));
-  pgptmp = mutt_file_fopen(pgptmpfile, "w");
-  if (!pgptmp)
+  if (infile)
+    mutt_str_strfcpy(pgptmpfile, infile, sizeof(pgptmpfile));
+  else
   {
-    mutt_perror(pgptmpfile);
-    mutt_file_fclose(&pgperr);
-    return NULL;
-  }
+    mutt_mktemp(pgptmpfile, sizeof(pgptmpfile));
+    pgptmp = mutt_file_fopen(pgptmpfile, "w");
+    if (!pgptmp)
+    {
+      mutt_perror(pgptmpfile);
+      mutt_file_fclose(&pgperr);
+      return NULL;
+    }
 
-  /* Position the stream at the beginning of the body, and send the data to
-   * the temporary file.
-   */
+    /* Position the stream at the beginning of the body, and send the data to
+     * the temporary file.
+     */
 
-  fseeko(s->fpin, a->offset, SEEK_SET);
-  mutt_file_copy_bytes(s->fpin, pgptmp, a->length);
-  mutt_file_fclose(&pgptmp);
+    fseeko(s->fpin, a->offset, SEEK_SET);
+    mutt_file_copy_bytes(s->fpin, pgptmp, a->length);
+    mutt_file_fclose(&pgptmp);
+  }
 
   thepid = pgp_invoke_decrypt(&pgpin, &pgpout, NULL, -1, -1, fileno(pgperr), pgptmpfile);
   if (thepid == -1)
   {
     mutt_file_fclose(&pgperr);
-    unlink(pgptmpfile);
+    if (!infile)
+      unlink(pgptmpfile);
     if (s->flags & MUTT_DISPLAY)
       state_attach_puts(
           _("[-- Error: could not create a PGP subprocess! --]\n\n"), s);
@@ -893,7 +909,8 @@ static struct Body *pgp_decrypt_part(struct Body *a, struct State *s,
 
   mutt_file_fclose(&pgpout);
   rv = mutt_wait_filter(thepid);
-  mutt_file_unlink(pgptmpfile);
+  if (!infile)
+    mutt_file_unlink(pgptmpfile);
 
   fflush(pgperr);
   rewind(pgperr);
@@ -951,6 +968,7 @@ static struct Body *pgp_decrypt_part(struct Body *a, struct State *s,
 int pgp_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **cur)
 {
   char tempfile[_POSIX_PATH_MAX];
+  char decoded[_POSIX_PATH_MAX] = { 0 };
   struct State s;
   struct Body *p = b;
   bool need_decode = false;
@@ -979,14 +997,13 @@ int pgp_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **cur
     saved_offset = b->offset;
     saved_length = b->length;
 
-    mutt_mktemp(tempfile, sizeof(tempfile));
-    decoded_fp = mutt_file_fopen(tempfile, "w+");
+    mutt_mktemp(decoded, sizeof(decoded));
+    decoded_fp = mutt_file_fopen(decoded, "w+");
     if (!decoded_fp)
     {
-      mutt_perror(tempfile);
+      mutt_perror(decoded);
       return -1;
     }
-    unlink(tempfile);
 
     fseeko(s.fpin, b->offset, SEEK_SET);
     s.fpout = decoded_fp;
@@ -1011,7 +1028,8 @@ int pgp_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **cur
   }
   unlink(tempfile);
 
-  *cur = pgp_decrypt_part(b, &s, *fpout, p);
+  /* PGP can read the decoded part where it is */
+  *cur = pgp_decrypt_part(b, &s, *fpout, p, need_decode ? decoded : NULL);
   if (!*cur)
     rc = -1;
   rewind(*fpout);
@@ -1023,6 +1041,7 @@ bail:
     b->length = saved_length;
     b->offset = saved_offset;
     mutt_file_fclose(&decoded_fp);
+    mutt_file_unlink(decoded);
   }
 
   return rc;
@@ -1053,7 +1072,7 @@ int pgp_encrypted_handler(struct Body *a, struct State *s)
   if (s->flags & MUTT_DISPLAY)
     crypt_current_time(s, "PGP");
 
-  tattach = pgp_decrypt_part(a, s, fpout, a);
+  tattach = pgp_decrypt_part(a, s, fpout, a, NULL);
   if (tattach)
   {
     if (s->flags & MUTT_DISPLAY)
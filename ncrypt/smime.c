@@ -1752,15 +1752,24 @@ int smime_verify_one(struct Body *sigbdy, struct State *s, const char *tempfile)
 
 /**
  * smime_handle_entity - Handle type application/pkcs7-mime
+ * @param m        Body of the entity
+ * @param s        State of the display
+ * @param out_file File for the result, or NULL to use a temporary file
+ * @param infile   File holding exactly the entity, or NULL to copy it from s->fpin
+ * @retval ptr Body of the result
+ * @retval NULL Error
  *
  * This can either be a signed or an encrypted message.
+ *
+ * OpenSSL's output is read through a pipe, straight into the result file.
  */
-static struct Body *smime_handle_entity(struct Body *m, struct State *s, FILE *out_file)
+static struct Body *smime_handle_entity(struct Body *m, struct State *s,
+                                        FILE *out_file, const char *infile)
 {
   size_t len = 0;
   int c;
   char buf[HUGE_STRING];
-  char outfile[_POSIX_PATH_MAX], errfile[_POSIX_PATH_MAX];
+  char errfile[_POSIX_PATH_MAX];
   char tmpfname[_POSIX_PATH_MAX];
   char tmptmpfname[_POSIX_PATH_MAX];
   FILE *smimeout = NULL, *smimein = NULL, *smimeerr = NULL;
@@ -1773,62 +1782,73 @@ static struct Body *smime_handle_entity(struct Body *m, struct State *s, FILE *o
   if (!(type & APPLICATION_SMIME))
     return NULL;
 
-  mutt_mktemp(outfile, sizeof(outfile));
-  smimeout = mutt_file_fopen(outfile, "w+");
-  if (!smimeout)
-  {
-    mutt_perror(outfile);
-    return NULL;
-  }
-
   mutt_mktemp(errfile, sizeof(errfile));
   smimeerr = mutt_file_fopen(errfile, "w+");
   if (!smimeerr)
   {
     mutt_perror(errfile);
-    mutt_file_fclose(&smimeout);
     return NULL;
   }
   mutt_file_unlink(errfile);
 
-  mutt_mktemp(tmpfname, sizeof(tmpfname));
-  tmpfp = mutt_file_fopen(tmpfname, "w+");
-  if (!tmpfp)
+  if (out_file)
+    fpout = out_file;
+  else
   {
-    mutt_perror(tmpfname);
-    mutt_file_fclose(&smimeout);
-    mutt_file_fclose(&smimeerr);
-    return NULL;
+    mutt_mktemp(tmptmpfname, sizeof(tmptmpfname));
+    fpout = mutt_file_fopen(tmptmpfname, "w+");
+    if (!fpout)
+    {
+      mutt_perror(tmptmpfname);
+      mutt_file_fclose(&smimeerr);
+      return NULL;
+    }
+    mutt_file_unlink(tmptmpfname);
   }
 
-  fseeko(s->fpin, m->offset, SEEK_SET);
+  if (infile)
+    mutt_str_strfcpy(tmpfname, infile, sizeof(tmpfname));
+  else
+  {
+    mutt_mktemp(tmpfname, sizeof(tmpfname));
+    tmpfp = mutt_file_fopen(tmpfname, "w+");
+    if (!tmpfp)
+    {
+      mutt_perror(tmpfname);
+      if (!out_file)
+        mutt_file_fclose(&fpout);
+      mutt_file_fclose(&smimeerr);
+      return NULL;
+    }
+
+    fseeko(s->fpin, m->offset, SEEK_SET);
 
-  mutt_file_copy_bytes(s->fpin, tmpfp, m->length);
+    mutt_file_copy_bytes(s->fpin, tmpfp, m->length);
 
-  fflush(tmpfp);
-  mutt_file_fclose(&tmpfp);
+    fflush(tmpfp);
+    mutt_file_fclose(&tmpfp);
+  }
 
-  if ((type & ENCRYPT) &&
-      (thepid = smime_invoke_decrypt(&smimein, NULL, NULL, -1, fileno(smimeout),
-                                     fileno(smimeerr), tmpfname)) == -1)
+  if (type & ENCRYPT)
   {
-    mutt_file_fclose(&smimeout);
-    mutt_file_unlink(tmpfname);
-    if (s->flags & MUTT_DISPLAY)
-      state_attach_puts(
-          _("[-- Error: unable to create OpenSSL subprocess! --]\n"), s);
-    mutt_file_fclose(&smimeerr);
-    return NULL;
+    thepid = smime_invoke_decrypt(&smimein, &smimeout, NULL, -1, -1,
+                                  fileno(smimeerr), tmpfname);
   }
-  else if ((type & SIGNOPAQUE) &&
-           (thepid = smime_invoke_verify(&smimein, NULL, NULL, -1, fileno(smimeout),
-                                         fileno(smimeerr), NULL, tmpfname, SIGNOPAQUE)) == -1)
+  else if (type & SIGNOPAQUE)
   {
-    mutt_file_fclose(&smimeout);
-    mutt_file_unlink(tmpfname);
+    thepid = smime_invoke_verify(&smimein, &smimeout, NULL, -1, -1,
+                                 fileno(smimeerr), NULL, tmpfname, SIGNOPAQUE);
+  }
+
+  if (thepid == -1)
+  {
+    if (!infile)
+      mutt_file_unlink(tmpfname);
     if (s->flags & MUTT_DISPLAY)
       state_attach_puts(
           _("[-- Error: unable to create OpenSSL subprocess! --]\n"), s);
+    if (!out_file)
+      mutt_file_fclose(&fpout);
     mutt_file_fclose(&smimeerr);
     return NULL;
   }
@@ -1843,8 +1863,23 @@ static struct Body *smime_handle_entity(struct Body *m, struct State *s, FILE *o
 
   mutt_file_fclose(&smimein);
 
+  /* Convert CRLF to LF as the output arrives, otherwise
+   * mutt_read_mime_header() has a hard time parsing the message. */
+  while (fgets(buf, sizeof(buf) - 1, smimeout) != NULL)
+  {
+    len = mutt_str_strlen(buf);
+    if (len > 1 && buf[len - 2] == '\r')
+    {
+      buf[len - 2] = '\n';
+      buf[len - 1] = '\0';
+    }
+    fputs(buf, fpout);
+  }
+  mutt_file_fclose(&smimeout);
+
   mutt_wait_filter(thepid);
-  mutt_file_unlink(tmpfname);
+  if (!infile)
+    mutt_file_unlink(tmpfname);
 
   if (s->flags & MUTT_DISPLAY)
   {
@@ -1869,66 +1904,30 @@ static struct Body *smime_handle_entity(struct Body *m, struct State *s, FILE *o
       state_attach_puts(_("[-- The following data is S/MIME signed --]\n"), s);
   }
 
-  if (smimeout)
-  {
-    fflush(smimeout);
-    rewind(smimeout);
-
-    if (out_file)
-      fpout = out_file;
-    else
-    {
-      mutt_mktemp(tmptmpfname, sizeof(tmptmpfname));
-      fpout = mutt_file_fopen(tmptmpfname, "w+");
-      if (!fpout)
-      {
-        mutt_perror(tmptmpfname);
-        mutt_file_fclose(&smimeout);
-        mutt_file_fclose(&smimeerr);
-        return NULL;
-      }
-    }
-    while (fgets(buf, sizeof(buf) - 1, smimeout) != NULL)
-    {
-      len = mutt_str_strlen(buf);
-      if (len > 1 && buf[len - 2] == '\r')
-      {
-        buf[len - 2] = '\n';
-        buf[len - 1] = '\0';
-      }
-      fputs(buf, fpout);
-    }
-    fflush(fpout);
-    rewind(fpout);
-
-    p = mutt_read_mime_header(fpout, 0);
-    if (p)
-    {
-      fstat(fileno(fpout), &info);
-      p->length = info.st_size - p->offset;
+  fflush(fpout);
+  rewind(fpout);
 
-      mutt_parse_part(fpout, p);
-      if (s->fpout)
-      {
-        rewind(fpout);
-        tmpfp_buffer = s->fpin;
-        s->fpin = fpout;
-        mutt_body_handler(p, s);
-        s->fpin = tmpfp_buffer;
-      }
-    }
-    mutt_file_fclose(&smimeout);
-    smimeout = NULL;
-    mutt_file_unlink(outfile);
+  p = mutt_read_mime_header(fpout, 0);
+  if (p)
+  {
+    fstat(fileno(fpout), &info);
+    p->length = info.st_size - p->offset;
 
-    if (!out_file)
+    mutt_parse_part(fpout, p);
+    if (s->fpout)
     {
-      mutt_file_fclose(&fpout);
-      mutt_file_unlink(tmptmpfname);
+      rewind(fpout);
+      tmpfp_buffer = s->fpin;
+      s->fpin = fpout;
+      mutt_body_handler(p, s);
+      s->fpin = tmpfp_buffer;
     }
-    fpout = NULL;
   }
 
+  if (!out_file)
+    mutt_file_fclose(&fpout);
+  fpout = NULL;
+
   if (s->flags & MUTT_DISPLAY)
   {
     if (type & ENCRYPT)
@@ -1963,6 +1962,7 @@ static struct Body *smime_handle_entity(struct Body *m, struct State *s, FILE *o
 int smime_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **cur)
 {
   char tempfile[_POSIX_PATH_MAX];
+  char decoded[_POSIX_PATH_MAX];
   struct State s;
   LOFF_T tmpoffset = b->offset;
   size_t tmplength = b->length;
@@ -1980,15 +1980,14 @@ int smime_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **c
   s.fpin = fpin;
   fseeko(s.fpin, b->offset, SEEK_SET);
 
-  mutt_mktemp(tempfile, sizeof(tempfile));
-  tmpfp = mutt_file_fopen(tempfile, "w+");
+  mutt_mktemp(decoded, sizeof(decoded));
+  tmpfp = mutt_file_fopen(decoded, "w+");
   if (!tmpfp)
   {
-    mutt_perror(tempfile);
+    mutt_perror(decoded);
     return -1;
   }
 
-  mutt_file_unlink(tempfile);
   s.fpout = tmpfp;
   mutt_decode_attachment(b, &s);
   fflush(tmpfp);
@@ -2008,7 +2007,8 @@ int smime_decrypt_mime(FILE *fpin, FILE **fpout, struct Body *b, struct Body **c
   }
   mutt_file_unlink(tempfile);
 
-  *cur = smime_handle_entity(b, &s, *fpout);
+  /* OpenSSL can read the decoded entity where it is */
+  *cur = smime_handle_entity(b, &s, *fpout, decoded);
   if (!*cur)
   {
     rc = -1;
@@ -2023,6 +2023,7 @@ bail:
   b->length = tmplength;
   b->offset = tmpoffset;
   mutt_file_fclose(&tmpfp);
+  mutt_file_unlink(decoded);
   if (*fpout)
     rewind(*fpout);
 
@@ -2031,7 +2032,7 @@ bail:
 
 int smime_application_smime_handler(struct Body *m, struct State *s)
 {
-  return smime_handle_entity(m, s, NULL) ? 0 : -1;
+  return smime_handle_entity(m, s, NULL, NULL) ? 0 : -1;
 }
 
 int smime_send_menu(struct Header *msg)
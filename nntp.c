@@ -45,6 +45,7 @@
 #include "mx.h"
 #include "ncrypt/ncrypt.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "thread.h"
 #include "url.h"
@@ -84,6 +85,7 @@ static int nntp_capabilities(struct NntpServer *nserv)
   nserv->hasLISTGROUP = false;
   nserv->hasLISTGROUPrange = false;
   nserv->hasOVER = false;
+  nserv->hasCOMPRESS = false;
   FREE(&nserv->authenticators);
 
   if (mutt_socket_write(conn, "CAPABILITIES\r\n") < 0 ||
@@ -128,6 +130,16 @@ static int nntp_capabilities(struct NntpServer *nserv)
 #endif
     else if (mutt_str_strcmp("OVER", buf) == 0)
       nserv->hasOVER = true;
+    else if (mutt_str_strncmp("COMPRESS ", buf, 9) == 0)
+    {
+      char *p = strstr(buf, " DEFLATE");
+      if (p)
+      {
+        p += 8;
+        if (*p == '\0' || *p == ' ')
+          nserv->hasCOMPRESS = true;
+      }
+    }
     else if (mutt_str_strncmp("LIST ", buf, 5) == 0)
     {
       char *p = strstr(buf, " NEWSGROUPS");
@@ -299,9 +311,8 @@ static int nntp_attempt_features(struct NntpServer *nserv)
             off = colon + 1 - nserv->overview_fmt;
           if (strcasecmp(nserv->overview_fmt + b, "Bytes:") == 0)
           {
-            size_t len = strlen(nserv->overview_fmt + b);
-            mutt_str_strfcpy(nserv->overview_fmt + b, "Content-Length:", len + 1);
-            off = b + len;
+            mutt_str_strfcpy(nserv->overview_fmt + b, "Content-Length:", buflen - b);
+            off = b + strlen(nserv->overview_fmt + b);
           }
           nserv->overview_fmt[off++] = '\0';
           b = off;
@@ -753,6 +764,26 @@ int nntp_open_connection(struct NntpServer *nserv)
     }
   }
 
+#ifdef USE_ZLIB
+  /* RFC8054: everything after the 206 response is compressed */
+  if (NntpDeflate && nserv->hasCOMPRESS)
+  {
+    if (mutt_socket_write(conn, "COMPRESS DEFLATE\r\n") < 0 ||
+        mutt_socket_readln(buf, sizeof(buf), conn) < 0)
+    {
+      return nntp_connect_error(nserv);
+    }
+    if (mutt_str_strncmp("206", buf, 3) == 0)
+    {
+      mutt_debug(2, "NNTP compression is enabled on connection to %s\n",
+                 conn->account.host);
+      mutt_zstrm_wrap_conn(conn);
+    }
+    else
+      mutt_debug(1, "COMPRESS DEFLATE failed: %s\n", buf);
+  }
+#endif
+
   /* attempt features */
   if (nntp_attempt_features(nserv) < 0)
     return -1;
@@ -1042,6 +1073,7 @@ struct FetchCtx
   int restore;
   unsigned char *messages;
   struct Progress progress;
+  FILE *fp; /**< Scratch file for converting overview lines */
 #ifdef USE_HCACHE
   header_cache_t *hc;
 #endif
@@ -1065,6 +1097,50 @@ static int fetch_numbers(char *line, void *data)
   return 0;
 }
 
+/**
+ * nntp_parse_overview - Parse the fields of an overview line
+ * @param fp     Scratch file
+ * @param fmt    Overview format, header names separated by '\0', e.g. #OverviewFmt
+ * @param fields Tab-separated fields, after the article number, may be NULL
+ * @retval ptr  New Header
+ * @retval NULL Error writing the scratch file
+ *
+ * The fields are written to the file as a header, then parsed.  The header is
+ * terminated by a blank line, so anything left over from a longer previous
+ * line is never read.  The fields are modified.
+ */
+struct Header *nntp_parse_overview(FILE *fp, const char *fmt, char *fields)
+{
+  const char *header = fmt;
+  char *field = fields;
+
+  rewind(fp);
+  while (field)
+  {
+    char *b = field;
+
+    if (*header)
+    {
+      if (strstr(header, ":full") == NULL && fputs(header, fp) == EOF)
+        return NULL;
+      header = strchr(header, '\0') + 1;
+    }
+
+    field = strchr(field, '\t');
+    if (field)
+      *field++ = '\0';
+    if (fputs(b, fp) == EOF || fputc('\n', fp) == EOF)
+      return NULL;
+  }
+  if (fputc('\n', fp) == EOF)
+    return NULL;
+  rewind(fp);
+
+  struct Header *hdr = mutt_new_header();
+  hdr->env = mutt_read_rfc822_header(fp, hdr, 0, 0);
+  return hdr;
+}
+
 /**
  * parse_overview_line - Parse overview line
  */
@@ -1074,9 +1150,8 @@ static int parse_overview_line(char *line, void *data)
   struct Context *ctx = fc->ctx;
   struct NntpData *nntp_data = ctx->data;
   struct Header *hdr = NULL;
-  FILE *fp = NULL;
   char tempfile[_POSIX_PATH_MAX];
-  char *header = NULL, *field = NULL;
+  char *field = NULL;
   bool save = true;
   anum_t anum;
 
@@ -1104,51 +1179,27 @@ static int parse_overview_line(char *line, void *data)
     return 0;
   }
 
-  /* convert overview line to header */
-  mutt_mktemp(tempfile, sizeof(tempfile));
-  fp = mutt_file_fopen(tempfile, "w+");
-  if (!fp)
-    return -1;
-
-  header = nntp_data->nserv->overview_fmt;
-  while (field)
+  /* reuse one scratch file for the whole fetch */
+  if (!fc->fp)
   {
-    char *b = field;
-
-    if (*header)
-    {
-      if (strstr(header, ":full") == NULL && fputs(header, fp) == EOF)
-      {
-        mutt_file_fclose(&fp);
-        unlink(tempfile);
-        return -1;
-      }
-      header = strchr(header, '\0') + 1;
-    }
-
-    field = strchr(field, '\t');
-    if (field)
-      *field++ = '\0';
-    if (fputs(b, fp) == EOF || fputc('\n', fp) == EOF)
-    {
-      mutt_file_fclose(&fp);
-      unlink(tempfile);
+    mutt_mktemp(tempfile, sizeof(tempfile));
+    fc->fp = mutt_file_fopen(tempfile, "w+");
+    if (!fc->fp)
       return -1;
-    }
+    unlink(tempfile);
   }
-  rewind(fp);
 
   /* allocate memory for headers */
   if (ctx->msgcount >= ctx->hdrmax)
     mx_alloc_memory(ctx);
 
   /* parse header */
-  hdr = ctx->hdrs[ctx->msgcount] = mutt_new_header();
-  hdr->env = mutt_read_rfc822_header(fp, hdr, 0, 0);
+  hdr = nntp_parse_overview(fc->fp, nntp_data->nserv->overview_fmt, field);
+  if (!hdr)
+    return -1;
+  ctx->hdrs[ctx->msgcount] = hdr;
   hdr->env->newsgroups = mutt_str_strdup(nntp_data->group);
   hdr->received = hdr->date_sent;
-  mutt_file_fclose(&fp);
-  unlink(tempfile);
 
 #ifdef USE_HCACHE
   if (fc->hc)
@@ -1246,6 +1297,7 @@ static int nntp_fetch_headers(struct Context *ctx, void *hc, anum_t first,
   fc.last = last;
   fc.restore = restore;
   fc.messages = mutt_mem_calloc(last - first + 1, sizeof(unsigned char));
+  fc.fp = NULL;
 #ifdef USE_HCACHE
   fc.hc = hc;
 #endif
@@ -1319,15 +1371,15 @@ static int nntp_fetch_headers(struct Context *ctx, void *hc, anum_t first,
     hdata = mutt_hcache_fetch(fc.hc, buf, strlen(buf));
     if (hdata)
     {
+      struct Header hsum;
+
       mutt_debug(2, "mutt_hcache_fetch %s\n", buf);
-      ctx->hdrs[ctx->msgcount] = hdr = mutt_hcache_restore(hdata);
-      mutt_hcache_free(fc.hc, &hdata);
-      hdr->data = 0;
 
-      /* skip header marked as deleted in cache */
-      if (hdr->deleted && !restore)
+      /* skip header marked as deleted in cache, without restoring it */
+      mutt_hcache_restore_summary(hdata, &hsum);
+      if (hsum.deleted && !restore)
       {
-        mutt_free_header(&hdr);
+        mutt_hcache_free(fc.hc, &hdata);
         if (nntp_data->bcache)
         {
           mutt_debug(2, "#2 mutt_bcache_del %s\n", buf);
@@ -1336,6 +1388,9 @@ static int nntp_fetch_headers(struct Context *ctx, void *hc, anum_t first,
         continue;
       }
 
+      ctx->hdrs[ctx->msgcount] = hdr = mutt_hcache_restore(hdata);
+      mutt_hcache_free(fc.hc, &hdata);
+      hdr->data = 0;
       hdr->read = false;
       hdr->old = false;
     }
@@ -1445,6 +1500,7 @@ static int nntp_fetch_headers(struct Context *ctx, void *hc, anum_t first,
   if (ctx->msgcount > oldmsgcount)
     mx_update_context(ctx, ctx->msgcount - oldmsgcount);
 
+  mutt_file_fclose(&fc.fp);
   FREE(&fc.messages);
   if (rc != 0)
     return -1;
@@ -1465,6 +1521,7 @@ static int nntp_open_mailbox(struct Context *ctx)
   int rc;
   void *hc = NULL;
   anum_t first, last, count = 0;
+  struct PerfTimer perf;
   struct Url url;
 
   mutt_str_strfcpy(buf, ctx->path, sizeof(buf));
@@ -1480,7 +1537,9 @@ static int nntp_open_mailbox(struct Context *ctx)
   group = url.path;
   url.path = strchr(url.path, '\0');
   url_tostring(&url, server, sizeof(server), 0);
+  mutt_perf_start(&perf, PERF_CONNECT);
   nserv = nntp_select_server(server, true);
+  mutt_perf_stop(&perf);
   url_free(&url);
   if (!nserv)
     return -1;
@@ -1579,7 +1638,9 @@ static int nntp_open_mailbox(struct Context *ctx)
     mutt_bit_unset(ctx->rights, MUTT_ACL_DELETE);
   }
   nntp_newsrc_close(nserv);
+  mutt_perf_start(&perf, PERF_FETCH_HEADERS);
   rc = nntp_fetch_headers(ctx, hc, first, nntp_data->last_message, 0);
+  mutt_perf_stop(&perf);
 #ifdef USE_HCACHE
   mutt_hcache_close(hc);
 #endif
@@ -1722,6 +1783,138 @@ static int nntp_close_message(struct Context *ctx, struct Message *msg)
   return mutt_file_fclose(&msg->fp);
 }
 
+/**
+ * prefetch_article - Read a pipelined ARTICLE into the body cache
+ * @param nntp_data NNTP data
+ * @param hdr       Article that was asked for
+ * @retval  0 Success, or the article doesn't exist
+ * @retval -1 Connection lost
+ */
+static int prefetch_article(struct NntpData *nntp_data, struct Header *hdr)
+{
+  struct Connection *conn = nntp_data->nserv->conn;
+  char buf[LONG_STRING];
+  char article[16];
+  bool cont = false;
+  FILE *fp = NULL;
+
+  if (mutt_socket_readln(buf, sizeof(buf), conn) < 0)
+  {
+    nntp_data->nserv->status = NNTP_NONE;
+    return -1;
+  }
+  if (buf[0] != '2')
+    return 0;
+
+  snprintf(article, sizeof(article), "%d", NHDR(hdr)->article_num);
+  fp = mutt_bcache_put(nntp_data->bcache, article);
+
+  while (true)
+  {
+    char *p = buf;
+    int chunk = mutt_socket_readln_d(buf, sizeof(buf), conn, MUTT_SOCK_LOG_HDR);
+    if (chunk < 0)
+    {
+      nntp_data->nserv->status = NNTP_NONE;
+      break;
+    }
+
+    if (!cont && (buf[0] == '.'))
+    {
+      if (buf[1] == '\0')
+        break;
+      if (buf[1] == '.')
+        p++;
+    }
+
+    /* a line longer than buf arrives in pieces */
+    cont = (chunk >= sizeof(buf));
+    if (fp && ((fputs(p, fp) == EOF) || (!cont && (fputc('\n', fp) == EOF))))
+    {
+      mutt_file_fclose(&fp);
+      snprintf(buf, sizeof(buf), "%s.tmp", article);
+      mutt_bcache_del(nntp_data->bcache, buf);
+    }
+  }
+
+  if (!fp)
+    return (nntp_data->nserv->status == NNTP_OK) ? 0 : -1;
+
+  if ((mutt_file_fclose(&fp) == 0) && (nntp_data->nserv->status == NNTP_OK))
+    mutt_bcache_commit(nntp_data->bcache, article);
+  else
+  {
+    snprintf(buf, sizeof(buf), "%s.tmp", article);
+    mutt_bcache_del(nntp_data->bcache, buf);
+  }
+  return (nntp_data->nserv->status == NNTP_OK) ? 0 : -1;
+}
+
+/**
+ * nntp_prefetch - Download the articles that are likely to be read next
+ * @param ctx Newsgroup
+ * @param cur Article being displayed
+ *
+ * Pipeline ARTICLE commands for the articles that follow cur in the index, in
+ * the current sort order, and store them in the body cache.  Two commands are
+ * kept in flight, so that a key press stops the downloads quickly.
+ */
+void nntp_prefetch(struct Context *ctx, struct Header *cur)
+{
+  struct Header *hdrs[32];
+  char buf[LONG_STRING];
+  int count = 0, sent = 0, done = 0;
+
+  if ((NntpPrefetch <= 0) || !ctx || (ctx->magic != MUTT_NNTP) || !cur || (cur->virtual < 0))
+    return;
+
+  struct NntpData *nntp_data = ctx->data;
+  if (!nntp_data->bcache || nntp_data->deleted || (nntp_data->nserv->status != NNTP_OK))
+    return;
+
+  int last = MIN(cur->virtual + MIN(NntpPrefetch, (int) mutt_array_size(hdrs)), ctx->vcount - 1);
+  for (int v = cur->virtual + 1; v <= last; v++)
+  {
+    struct Header *hdr = ctx->hdrs[ctx->v2r[v]];
+    if (!hdr->data || !NHDR(hdr)->article_num ||
+        (hdr->content->length > NntpPrefetchSize * 1024L))
+    {
+      continue;
+    }
+
+    snprintf(buf, sizeof(buf), "%d", NHDR(hdr)->article_num);
+    if (mutt_bcache_exists(nntp_data->bcache, buf) == 0)
+      continue;
+
+    hdrs[count++] = hdr;
+  }
+
+  if (count)
+    mutt_debug(2, "prefetching %d articles\n", count);
+
+  while (done < count)
+  {
+    /* keep the pipeline busy, but don't start anything new on a key press */
+    while ((sent < count) && (sent - done < 2) && !mutt_key_pending())
+    {
+      snprintf(buf, sizeof(buf), "ARTICLE %d\r\n", NHDR(hdrs[sent])->article_num);
+      if (mutt_socket_write(nntp_data->nserv->conn, buf) < 0)
+      {
+        nntp_data->nserv->status = NNTP_NONE;
+        return;
+      }
+      sent++;
+    }
+
+    if (sent == done)
+      break;
+
+    if (prefetch_article(nntp_data, hdrs[done]) < 0)
+      return;
+    done++;
+  }
+}
+
 /**
  * nntp_post - Post article
  */
@@ -1765,6 +1958,8 @@ int nntp_post(const char *msg)
     return -1;
   }
 
+  /* send the article in large blocks, not a line at a time */
+  mutt_socket_cork(nntp_data->nserv->conn);
   buf[0] = '.';
   buf[1] = '\0';
   while (fgets(buf + 1, sizeof(buf) - 2, fp))
@@ -1789,6 +1984,7 @@ int nntp_post(const char *msg)
   if ((buf[strlen(buf) - 1] != '\n' &&
        mutt_socket_write_d(nntp_data->nserv->conn, "\r\n", -1, MUTT_SOCK_LOG_HDR) < 0) ||
       mutt_socket_write_d(nntp_data->nserv->conn, ".\r\n", -1, MUTT_SOCK_LOG_HDR) < 0 ||
+      mutt_socket_uncork(nntp_data->nserv->conn) < 0 ||
       mutt_socket_readln(buf, sizeof(buf), nntp_data->nserv->conn) < 0)
     return nntp_connect_error(nntp_data->nserv);
   if (buf[0] != '2')
@@ -1800,19 +1996,17 @@ int nntp_post(const char *msg)
 }
 
 /**
- * nntp_group_poll - Check newsgroup for new articles
- * @retval  1 New articles found
- * @retval  0 No change
- * @retval -1 Lost connection
+ * group_status - Update newsgroup from the answer to a GROUP command
+ * @param nntp_data   NNTP data
+ * @param buf         Answer from the server
+ * @param update_stat If true, update the unread count too
+ * @retval 1 New articles found
+ * @retval 0 No change
  */
-static int nntp_group_poll(struct NntpData *nntp_data, int update_stat)
+static int group_status(struct NntpData *nntp_data, const char *buf, int update_stat)
 {
-  char buf[LONG_STRING] = "";
   anum_t count, first, last;
 
-  /* use GROUP command to poll newsgroup */
-  if (nntp_query(nntp_data, buf, sizeof(buf)) < 0)
-    return -1;
   if (sscanf(buf, "211 " ANUM " " ANUM " " ANUM, &count, &first, &last) != 3)
     return 0;
   if (first == nntp_data->first_message && last == nntp_data->last_message)
@@ -1843,6 +2037,105 @@ static int nntp_group_poll(struct NntpData *nntp_data, int update_stat)
   return 1;
 }
 
+/**
+ * nntp_group_poll - Check newsgroup for new articles
+ * @retval  1 New articles found
+ * @retval  0 No change
+ * @retval -1 Lost connection
+ */
+static int nntp_group_poll(struct NntpData *nntp_data, int update_stat)
+{
+  char buf[LONG_STRING] = "";
+
+  /* use GROUP command to poll newsgroup */
+  if (nntp_query(nntp_data, buf, sizeof(buf)) < 0)
+    return -1;
+  return group_status(nntp_data, buf, update_stat);
+}
+
+/**
+ * poll_subscribed - Check all subscribed newsgroups for new articles
+ * @param nserv NNTP server
+ * @retval  1 New articles found
+ * @retval  0 No change
+ * @retval -1 Lost connection
+ *
+ * The GROUP commands are sent in batches of #NNTP_POLL_BATCH, so that a
+ * long list of newsgroups doesn't cost a round trip each.  The answers come
+ * back in the same order.
+ */
+static int poll_subscribed(struct NntpServer *nserv)
+{
+  struct NntpData *batch[NNTP_POLL_BATCH];
+  struct Buffer *cmds = mutt_buffer_new();
+  char buf[LONG_STRING];
+  unsigned int i = 0;
+  int rc = 0;
+
+  while (i < nserv->groups_num)
+  {
+    int count = 0;
+
+    /* a lost connection is recovered by nntp_query() */
+    if (nserv->status != NNTP_OK)
+    {
+      for (; i < nserv->groups_num; i++)
+      {
+        struct NntpData *data = nserv->groups_list[i];
+
+        if (!data || !data->subscribed)
+          continue;
+        int poll = nntp_group_poll(data, 1);
+        if (poll < 0)
+        {
+          rc = -1;
+          break;
+        }
+        if (poll > 0)
+          rc = 1;
+      }
+      break;
+    }
+
+    unsigned int start = i;
+    mutt_buffer_reset(cmds);
+    for (; (i < nserv->groups_num) && (count < NNTP_POLL_BATCH); i++)
+    {
+      struct NntpData *data = nserv->groups_list[i];
+
+      if (!data || !data->subscribed)
+        continue;
+      snprintf(buf, sizeof(buf), "GROUP %s\r\n", data->group);
+      mutt_buffer_addstr(cmds, buf);
+      batch[count++] = data;
+    }
+    if (!count)
+      break;
+
+    /* on error, poll this batch again, one group at a time */
+    if (mutt_socket_write(nserv->conn, cmds->data) < 0)
+    {
+      nserv->status = NNTP_NONE;
+      i = start;
+      continue;
+    }
+    for (int j = 0; j < count; j++)
+    {
+      if (mutt_socket_readln(buf, sizeof(buf), nserv->conn) < 0)
+      {
+        nserv->status = NNTP_NONE;
+        i = start;
+        break;
+      }
+      if (group_status(batch[j], buf, 1) > 0)
+        rc = 1;
+    }
+  }
+
+  mutt_buffer_free(&cmds);
+  return rc;
+}
+
 /**
  * check_mailbox - Check current newsgroup for new articles
  * @retval #MUTT_REOPENED Articles have been renumbered or removed from server
@@ -1930,18 +2223,16 @@ static int check_mailbox(struct Context *ctx)
         hdata = mutt_hcache_fetch(hc, buf, strlen(buf));
         if (hdata)
         {
-          bool deleted;
+          struct Header hsum;
 
           mutt_debug(2, "#1 mutt_hcache_fetch %s\n", buf);
-          hdr = mutt_hcache_restore(hdata);
+          /* only the flags are needed */
+          mutt_hcache_restore_summary(hdata, &hsum);
           mutt_hcache_free(hc, &hdata);
-          hdr->data = 0;
-          deleted = hdr->deleted;
-          flagged = hdr->flagged;
-          mutt_free_header(&hdr);
+          flagged = hsum.flagged;
 
           /* header marked as deleted, removing from context */
-          if (deleted)
+          if (hsum.deleted)
           {
             mutt_set_flag(ctx, ctx->hdrs[i], MUTT_TAG, 0);
             mutt_free_header(&ctx->hdrs[i]);
@@ -1976,16 +2267,13 @@ static int check_mailbox(struct Context *ctx)
       hdata = mutt_hcache_fetch(hc, buf, strlen(buf));
       if (hdata)
       {
-        mutt_debug(2, "#2 mutt_hcache_fetch %s\n", buf);
-        if (ctx->msgcount >= ctx->hdrmax)
-          mx_alloc_memory(ctx);
+        struct Header hsum;
 
-        ctx->hdrs[ctx->msgcount] = hdr = mutt_hcache_restore(hdata);
-        mutt_hcache_free(hc, &hdata);
-        hdr->data = 0;
-        if (hdr->deleted)
+        mutt_debug(2, "#2 mutt_hcache_fetch %s\n", buf);
+        mutt_hcache_restore_summary(hdata, &hsum);
+        if (hsum.deleted)
         {
-          mutt_free_header(&hdr);
+          mutt_hcache_free(hc, &hdata);
           if (nntp_data->bcache)
           {
             mutt_debug(2, "mutt_bcache_del %s\n", buf);
@@ -1994,6 +2282,13 @@ static int check_mailbox(struct Context *ctx)
           continue;
         }
 
+        if (ctx->msgcount >= ctx->hdrmax)
+          mx_alloc_memory(ctx);
+
+        ctx->hdrs[ctx->msgcount] = hdr = mutt_hcache_restore(hdata);
+        mutt_hcache_free(hc, &hdata);
+        hdr->data = 0;
+
         ctx->msgcount++;
         hdr->read = false;
         hdr->old = false;
@@ -2283,19 +2578,11 @@ int nntp_check_new_groups(struct NntpServer *nserv)
   if (ShowNewNews)
   {
     mutt_message(_("Checking for new messages..."));
-    for (i = 0; i < nserv->groups_num; i++)
-    {
-      struct NntpData *data = nserv->groups_list[i];
-
-      if (data && data->subscribed)
-      {
-        rc = nntp_group_poll(data, 1);
-        if (rc < 0)
-          return -1;
-        if (rc > 0)
-          update_active = true;
-      }
-    }
+    rc = poll_subscribed(nserv);
+    if (rc < 0)
+      return -1;
+    if (rc > 0)
+      update_active = true;
     /* select current newsgroup */
     if (Context && Context->magic == MUTT_NNTP)
     {
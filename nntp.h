@@ -46,6 +46,9 @@ struct Context;
 /* number of entries in article cache */
 #define NNTP_ACACHE_LEN 10
 
+/* number of GROUP commands sent at once */
+#define NNTP_POLL_BATCH 50
+
 /* article number type and format */
 #define anum_t uint32_t
 #define ANUM "%u"
@@ -74,6 +77,7 @@ struct NntpServer
   bool hasLISTGROUPrange : 1;
   bool hasOVER : 1;
   bool hasXOVER : 1;
+  bool hasCOMPRESS : 1;
   unsigned int use_tls : 3;
   unsigned int status : 3;
   bool cacheable : 1;
@@ -153,6 +157,7 @@ int nntp_open_connection(struct NntpServer *nserv);
 void nntp_newsrc_gen_entries(struct Context *ctx);
 void nntp_bcache_update(struct NntpData *nntp_data);
 void nntp_article_status(struct Context *ctx, struct Header *hdr, char *group, anum_t anum);
+struct Header *nntp_parse_overview(FILE *fp, const char *fmt, char *fields);
 void nntp_group_unread_stat(struct NntpData *nntp_data);
 void nntp_data_free(void *data);
 void nntp_acache_free(struct NntpData *nntp_data);
@@ -172,6 +177,7 @@ int nntp_check_children(struct Context *ctx, const char *msgid);
 int nntp_newsrc_parse(struct NntpServer *nserv);
 void nntp_newsrc_close(struct NntpServer *nserv);
 void nntp_buffy(char *buf, size_t len);
+void nntp_prefetch(struct Context *ctx, struct Header *cur);
 void nntp_expand_path(char *line, size_t len, struct Account *acct);
 void nntp_clear_cache(struct NntpServer *nserv);
 const char *nntp_format_str(char *dest, size_t destlen, size_t col, int cols,
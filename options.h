@@ -119,10 +119,14 @@ WHERE bool HonorDisposition;
 WHERE bool IgnoreListReplyTo;
 #ifdef USE_IMAP
 WHERE bool ImapCheckSubscribed;
+#ifdef USE_ZLIB
+WHERE bool ImapDeflate;
+#endif
 WHERE bool ImapIdle;
 WHERE bool ImapListSubscribed;
 WHERE bool ImapPassive;
 WHERE bool ImapPeek;
+WHERE bool ImapQresync;
 WHERE bool ImapServernoise;
 #endif
 #ifdef USE_SSL
@@ -151,11 +155,18 @@ WHERE bool MaildirTrash;
 WHERE bool MaildirCheckCur;
 WHERE bool Markers;
 WHERE bool MarkOld;
+WHERE bool MboxSyncInPlace;
 WHERE bool MenuScroll;  /**< scroll menu instead of implicit next-page */
 WHERE bool MenuMoveOff; /**< allow menu to scroll past last entry */
 #if defined(USE_IMAP) || defined(USE_POP)
 WHERE bool MessageCacheClean;
 #endif
+#if defined(USE_IMAP) || defined(USE_POP) || defined(USE_NNTP)
+#ifdef USE_ZLIB
+WHERE bool MessageCacheCompress;
+#endif
+WHERE bool MessageCachePack;
+#endif
 WHERE bool MetaKey; /**< interpret ALT-x as ESC-x */
 WHERE bool Metoo;
 WHERE bool MhPurge;
@@ -192,6 +203,9 @@ WHERE bool SaveAddress;
 WHERE bool SaveEmpty;
 WHERE bool SaveName;
 WHERE bool Score;
+#ifdef USE_HCACHE
+WHERE bool SearchIndex;
+#endif
 #ifdef USE_SIDEBAR
 WHERE bool SidebarVisible;
 WHERE bool SidebarFolderIndent;
@@ -264,6 +278,9 @@ WHERE bool PgpReplyinline;
 WHERE bool ShowNewNews;
 WHERE bool ShowOnlyUnread;
 WHERE bool SaveUnsubscribed;
+#ifdef USE_ZLIB
+WHERE bool NntpDeflate;
+#endif
 WHERE bool NntpListgroup;
 WHERE bool NntpLoadDescription;
 WHERE bool XCommentTo;
@@ -51,11 +51,16 @@
 #include "ncrypt/ncrypt.h"
 #include "opcodes.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
+#include "rfc3676.h"
 #include "sort.h"
 #ifdef USE_SIDEBAR
 #include "sidebar.h"
 #endif
+#ifdef USE_IMAP
+#include "imap/imap.h"
+#endif
 #ifdef USE_NNTP
 #include "nntp.h"
 #endif
@@ -747,9 +752,10 @@ static int check_attachment_marker(char *p)
 
 static void resolve_types(char *buf, char *raw, struct Line *line_info, int n,
                           int last, struct QClass **quote_list, int *q_level,
-                          int *force_redraw, int q_classify)
+                          int *force_redraw, int q_classify, struct FlowedLines *flowed)
 {
   struct ColorLine *color_line = NULL;
+  struct FlowedLine *fl = NULL;
   regmatch_t pmatch[1], smatch[1];
   bool found;
   bool null_rx;
@@ -839,6 +845,18 @@ static void resolve_types(char *buf, char *raw, struct Line *line_info, int n,
   }
   else if (check_sig(buf, line_info, n - 1) == 0)
     line_info[n].type = MT_COLOR_SIGNATURE;
+  else if ((fl = rfc3676_lines_find(flowed, line_info[n].offset)))
+  {
+    /* the format=flowed handler has already said how it's quoted */
+    if (fl->quote > 0)
+    {
+      if (q_classify && line_info[n].quote == NULL)
+        line_info[n].quote = classify_quote(quote_list, buf, fl->quote, force_redraw, q_level);
+      line_info[n].type = MT_COLOR_QUOTED;
+    }
+    else
+      line_info[n].type = MT_COLOR_NORMAL;
+  }
   else if (QuoteRegex && QuoteRegex->regex && regexec(QuoteRegex->regex, buf, 1, pmatch, 0) == 0)
   {
     if (Smileys && Smileys->regex && (regexec(Smileys->regex, buf, 1, smatch, 0) == 0))
@@ -1237,24 +1255,35 @@ static int format_line(struct Line **line_info, int n, unsigned char *buf, int f
     if (ch >= cnt)
       break;
 
-    k = mbrtowc(&wc, (char *) buf + ch, cnt - ch, &mbstate);
-    if (k == (size_t)(-2) || k == (size_t)(-1))
+    /* Printable ASCII needs no conversion and can't begin an overstrike */
+    bool ascii = mbsinit(&mbstate) && mutt_mb_ascii_run((char *) buf + ch, 1) &&
+                 ((cnt - ch < 2) || (buf[ch + 1] != '\b'));
+    if (ascii)
     {
-      if (k == (size_t)(-1))
-        memset(&mbstate, 0, sizeof(mbstate));
-      mutt_debug(1, "mbrtowc returned %lu; errno = %d.\n", k, errno);
-      if (col + 4 > wrap_cols)
-        break;
-      col += 4;
-      if (pa)
-        printw("\\%03o", buf[ch]);
+      wc = buf[ch];
       k = 1;
-      continue;
     }
-    if (k == 0)
-      k = 1;
+    else
+    {
+      k = mbrtowc(&wc, (char *) buf + ch, cnt - ch, &mbstate);
+      if (k == (size_t)(-2) || k == (size_t)(-1))
+      {
+        if (k == (size_t)(-1))
+          memset(&mbstate, 0, sizeof(mbstate));
+        mutt_debug(1, "mbrtowc returned %lu; errno = %d.\n", k, errno);
+        if (col + 4 > wrap_cols)
+          break;
+        col += 4;
+        if (pa)
+          printw("\\%03o", buf[ch]);
+        k = 1;
+        continue;
+      }
+      if (k == 0)
+        k = 1;
+    }
 
-    if (Charset_is_utf8)
+    if (Charset_is_utf8 && !ascii)
     {
       /* zero width space, zero width no-break space */
       if (wc == 0x200B || wc == 0xFEFF)
@@ -1271,7 +1300,7 @@ static int format_line(struct Line **line_info, int n, unsigned char *buf, int f
 
     /* Handle backspace */
     special = 0;
-    if (IsWPrint(wc))
+    if (!ascii && IsWPrint(wc))
     {
       wchar_t wc1;
       mbstate_t mbstate1;
@@ -1329,7 +1358,7 @@ static int format_line(struct Line **line_info, int n, unsigned char *buf, int f
          * attempt to wrap at this character. */
         wc = ' ';
       }
-      t = wcwidth(wc);
+      t = ascii ? 1 : wcwidth(wc);
       if (col + t > wrap_cols)
         break;
       col += t;
@@ -1412,7 +1441,8 @@ static int format_line(struct Line **line_info, int n, unsigned char *buf, int f
 static int display_line(FILE *f, LOFF_T *last_pos, struct Line **line_info,
                         int n, int *last, int *max, int flags,
                         struct QClass **quote_list, int *q_level, int *force_redraw,
-                        regex_t *search_re, struct MuttWindow *pager_window)
+                        regex_t *search_re, struct MuttWindow *pager_window,
+                        struct FlowedLines *flowed)
 {
   unsigned char *buf = NULL, *fmt = NULL;
   size_t buflen = 0;
@@ -1436,7 +1466,10 @@ static int display_line(FILE *f, LOFF_T *last_pos, struct Line **line_info,
 
   if (*last == *max)
   {
-    mutt_mem_realloc(line_info, sizeof(struct Line) * (*max += LINES));
+    mutt_mem_tag_realloc(MEM_PAGER, line_info, sizeof(struct Line) * *max,
+                         sizeof(struct Line) * (*max + LINES));
+    mutt_mem_account(MEM_PAGER, sizeof(struct Syntax) * LINES);
+    *max += LINES;
     for (ch = *last; ch < *max; ch++)
     {
       memset(&((*line_info)[ch]), 0, sizeof(struct Line));
@@ -1460,8 +1493,8 @@ static int display_line(FILE *f, LOFF_T *last_pos, struct Line **line_info,
         goto out;
       }
 
-      resolve_types((char *) fmt, (char *) buf, *line_info, n, *last,
-                    quote_list, q_level, force_redraw, flags & MUTT_SHOWCOLOR);
+      resolve_types((char *) fmt, (char *) buf, *line_info, n, *last, quote_list,
+                    q_level, force_redraw, flags & MUTT_SHOWCOLOR, flowed);
 
       /* avoid race condition for continuation lines when scrolling up */
       for (m = n + 1; m < *last && (*line_info)[m].offset && (*line_info)[m].continuation; m++)
@@ -1488,7 +1521,14 @@ static int display_line(FILE *f, LOFF_T *last_pos, struct Line **line_info,
         (*last)--;
       goto out;
     }
-    if (QuoteRegex && QuoteRegex->regex && regexec(QuoteRegex->regex, (char *) fmt, 1, pmatch, 0) == 0)
+    struct FlowedLine *fl = rfc3676_lines_find(flowed, (*line_info)[n].offset);
+    if (fl && (fl->quote > 0))
+    {
+      (*line_info)[n].quote =
+          classify_quote(quote_list, (char *) fmt, fl->quote, force_redraw, q_level);
+    }
+    else if (!fl && QuoteRegex && QuoteRegex->regex &&
+             regexec(QuoteRegex->regex, (char *) fmt, 1, pmatch, 0) == 0)
     {
       (*line_info)[n].quote =
           classify_quote(quote_list, (char *) fmt + pmatch[0].rm_so,
@@ -1732,6 +1772,7 @@ struct PagerRedrawData
   char *helpstr;
   char *searchbuf;
   struct Line *line_info;
+  struct FlowedLines *flowed;
   FILE *fp;
   struct stat sb;
 };
@@ -1895,7 +1936,7 @@ static void pager_menu_redraw(struct Menu *pager_menu)
     while (display_line(rd->fp, &rd->last_pos, &rd->line_info, ++i, &rd->last_line,
                         &rd->max_line, rd->has_types | rd->search_flag | (rd->flags & MUTT_PAGER_NOWRAP),
                         &rd->quote_list, &rd->q_level, &rd->force_redraw,
-                        &rd->search_re, rd->pager_window) == 0)
+                        &rd->search_re, rd->pager_window, rd->flowed) == 0)
     {
       if (!rd->line_info[i].continuation && ++j == rd->lines)
       {
@@ -1930,7 +1971,7 @@ static void pager_menu_redraw(struct Menu *pager_menu)
                          (rd->flags & MUTT_DISPLAYFLAGS) | rd->hide_quoted |
                              rd->search_flag | (rd->flags & MUTT_PAGER_NOWRAP),
                          &rd->quote_list, &rd->q_level, &rd->force_redraw,
-                         &rd->search_re, rd->pager_window) > 0)
+                         &rd->search_re, rd->pager_window, rd->flowed) > 0)
           rd->lines++;
         rd->curline++;
         mutt_window_move(rd->pager_window, rd->lines, 0);
@@ -2037,6 +2078,9 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
   int err, first = 1;
   int r = -1, searchctx = 0;
   bool wrapped = false;
+#if defined(USE_IMAP) || defined(USE_NNTP)
+  bool prefetched = false;
+#endif
 
   struct Menu *pager_menu = NULL;
   int old_PagerIndexLines; /* some people want to resize it
@@ -2058,6 +2102,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
   rd.banner = banner;
   rd.flags = flags;
   rd.extra = extra;
+  rd.flowed = extra ? extra->flowed : NULL;
   rd.indexlen = PagerIndexLines;
   rd.indicator = rd.indexlen / 3;
   rd.helpstr = helpstr;
@@ -2088,7 +2133,8 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
   }
 
   rd.max_line = LINES; /* number of lines on screen, from curses */
-  rd.line_info = mutt_mem_calloc(rd.max_line, sizeof(struct Line));
+  rd.line_info = mutt_mem_tag_calloc(MEM_PAGER, rd.max_line, sizeof(struct Line));
+  mutt_mem_account(MEM_PAGER, sizeof(struct Syntax) * rd.max_line);
   for (i = 0; i < rd.max_line; i++)
   {
     rd.line_info[i].type = -1;
@@ -2130,6 +2176,8 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
     mutt_curs_set(0);
 
     pager_menu_redraw(pager_menu);
+    if (flags & MUTT_PAGER_MESSAGE)
+      mutt_perf_fire(PERF_PAGER_OPEN);
 
     if (BrailleFriendly)
     {
@@ -2156,6 +2204,20 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
     else
       OldHdr = NULL;
 
+#if defined(USE_IMAP) || defined(USE_NNTP)
+    /* use the time spent reading this message to download the next ones */
+    if (IsHeader(extra) && !prefetched && !OPT_ATTACH_MSG)
+    {
+      prefetched = true;
+#ifdef USE_IMAP
+      imap_prefetch(Context, extra->hdr);
+#endif
+#ifdef USE_NNTP
+      nntp_prefetch(Context, extra->hdr);
+#endif
+    }
+#endif
+
     ch = km_dokey(MENU_PAGER);
     if (ch >= 0)
     {
@@ -2524,7 +2586,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
           while (display_line(rd.fp, &rd.last_pos, &rd.line_info, i, &rd.last_line, &rd.max_line,
                               MUTT_SEARCH | (flags & MUTT_PAGER_NSKIP) | (flags & MUTT_PAGER_NOWRAP),
                               &rd.quote_list, &rd.q_level, &rd.force_redraw,
-                              &rd.search_re, rd.pager_window) == 0)
+                              &rd.search_re, rd.pager_window, rd.flowed) == 0)
             i++;
 
           if (!rd.search_back)
@@ -2635,7 +2697,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
                                rd.fp, &rd.last_pos, &rd.line_info, new_topline, &rd.last_line,
                                &rd.max_line, MUTT_TYPES | (flags & MUTT_PAGER_NOWRAP),
                                &rd.quote_list, &rd.q_level, &rd.force_redraw,
-                               &rd.search_re, rd.pager_window)))) &&
+                               &rd.search_re, rd.pager_window, rd.flowed)))) &&
                    ISHEADER(rd.line_info[new_topline].type))
             {
               new_topline++;
@@ -2649,7 +2711,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
                              rd.fp, &rd.last_pos, &rd.line_info, new_topline, &rd.last_line,
                              &rd.max_line, MUTT_TYPES | (flags & MUTT_PAGER_NOWRAP),
                              &rd.quote_list, &rd.q_level, &rd.force_redraw,
-                             &rd.search_re, rd.pager_window)))) &&
+                             &rd.search_re, rd.pager_window, rd.flowed)))) &&
                  rd.line_info[new_topline + SkipQuotedOffset].type != MT_COLOR_QUOTED)
             new_topline++;
 
@@ -2664,7 +2726,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
                              rd.fp, &rd.last_pos, &rd.line_info, new_topline, &rd.last_line,
                              &rd.max_line, MUTT_TYPES | (flags & MUTT_PAGER_NOWRAP),
                              &rd.quote_list, &rd.q_level, &rd.force_redraw,
-                             &rd.search_re, rd.pager_window)))) &&
+                             &rd.search_re, rd.pager_window, rd.flowed)))) &&
                  rd.line_info[new_topline + SkipQuotedOffset].type == MT_COLOR_QUOTED)
             new_topline++;
 
@@ -2685,7 +2747,7 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
           while (display_line(rd.fp, &rd.last_pos, &rd.line_info, i, &rd.last_line,
                               &rd.max_line, rd.has_types | (flags & MUTT_PAGER_NOWRAP),
                               &rd.quote_list, &rd.q_level, &rd.force_redraw,
-                              &rd.search_re, rd.pager_window) == 0)
+                              &rd.search_re, rd.pager_window, rd.flowed) == 0)
             i++;
           rd.topline = up_n_lines(rd.pager_window->rows, rd.line_info,
                                   rd.last_line, rd.hide_quoted);
@@ -3252,7 +3314,8 @@ int mutt_pager(const char *banner, const char *fname, int flags, struct Pager *e
     regfree(&rd.search_re);
     rd.search_compiled = 0;
   }
-  FREE(&rd.line_info);
+  mutt_mem_account(MEM_PAGER, -(long long) (sizeof(struct Syntax) * rd.max_line));
+  mutt_mem_tag_free(MEM_PAGER, &rd.line_info, sizeof(struct Line) * rd.max_line);
   mutt_pop_current_menu(pager_menu);
   mutt_menu_destroy(&pager_menu);
   if (rd.index)
@@ -26,6 +26,7 @@
 #include <stdio.h>
 
 struct Context;
+struct FlowedLines;
 struct Menu;
 
 /* dynamic internal flags */
@@ -51,11 +52,12 @@ struct Menu;
  */
 struct Pager
 {
-  struct Context *ctx;    /**< current mailbox */
-  struct Header *hdr;     /**< current message */
-  struct Body *bdy;       /**< current attachment */
-  FILE *fp;               /**< source stream */
-  struct AttachCtx *actx; /**< attachment information */
+  struct Context *ctx;        /**< current mailbox */
+  struct Header *hdr;         /**< current message */
+  struct Body *bdy;           /**< current attachment */
+  FILE *fp;                   /**< source stream */
+  struct AttachCtx *actx;     /**< attachment information */
+  struct FlowedLines *flowed; /**< lines written by the format=flowed handler */
 };
 
 int mutt_do_pager(const char *banner, const char *tempfile, int do_color, struct Pager *info);
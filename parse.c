@@ -46,13 +46,29 @@
 struct Context;
 
 /**
- * mutt_read_rfc822_line - Read a header line from a file
+ * add_pos - Advance a stream position kept by hand
+ * @param pos Position, -1 if unknown
+ * @param n   Number of bytes read
+ */
+static void add_pos(LOFF_T *pos, size_t n)
+{
+  if (pos && (*pos >= 0))
+    *pos += n;
+}
+
+/**
+ * read_rfc822_line - Read a header line from a file
+ * @param f       File to read from
+ * @param line    Buffer for the line
+ * @param linelen Size of the buffer
+ * @param pos     If not NULL, advanced by the number of bytes read
+ * @retval ptr The line, possibly reallocated
  *
- * Reads an arbitrarily long header field, and looks ahead for continuation
- * lines.  ``line'' must point to a dynamically allocated string; it is
- * increased if more space is required to fit the whole line.
+ * ftello() costs a system call, which adds up when it's called for every
+ * header line of a large mailbox.  If a NUL in the line makes the count
+ * uncertain, *pos is set to -1.
  */
-char *mutt_read_rfc822_line(FILE *f, char *line, size_t *linelen)
+static char *read_rfc822_line(FILE *f, char *line, size_t *linelen, LOFF_T *pos)
 {
   char *buf = line;
   int ch;
@@ -61,14 +77,24 @@ char *mutt_read_rfc822_line(FILE *f, char *line, size_t *linelen)
 
   while (true)
   {
-    if (fgets(buf, *linelen - offset, f) == NULL || /* end of file or */
-        (ISSPACE(*line) && !offset))                /* end of headers */
+    if (fgets(buf, *linelen - offset, f) == NULL) /* end of file */
     {
       *line = 0;
       return line;
     }
 
     len = mutt_str_strlen(buf);
+    /* A short line without a newline hides bytes behind a NUL */
+    if (pos && (len + 1 < *linelen - offset) && (!len || (buf[len - 1] != '\n')) && !feof(f))
+      *pos = -1;
+    add_pos(pos, len);
+
+    if (ISSPACE(*line) && !offset) /* end of headers */
+    {
+      *line = 0;
+      return line;
+    }
+
     if (!len)
       return line;
 
@@ -87,10 +113,11 @@ char *mutt_read_rfc822_line(FILE *f, char *line, size_t *linelen)
         ungetc(ch, f);
         return line; /* next line is a separate header field or EOH */
       }
+      add_pos(pos, 1);
 
       /* eat tabs and spaces from the beginning of the continuation line */
       while ((ch = fgetc(f)) == ' ' || ch == '\t')
-        ;
+        add_pos(pos, 1);
       ungetc(ch, f);
       *++buf = ' '; /* string is still terminated because we removed
                        at least one whitespace char above */
@@ -109,6 +136,18 @@ char *mutt_read_rfc822_line(FILE *f, char *line, size_t *linelen)
   /* not reached */
 }
 
+/**
+ * mutt_read_rfc822_line - Read a header line from a file
+ *
+ * Reads an arbitrarily long header field, and looks ahead for continuation
+ * lines.  ``line'' must point to a dynamically allocated string; it is
+ * increased if more space is required to fit the whole line.
+ */
+char *mutt_read_rfc822_line(FILE *f, char *line, size_t *linelen)
+{
+  return read_rfc822_line(f, line, linelen, NULL);
+}
+
 static void parse_references(struct ListHead *head, char *s)
 {
   char *m = NULL;
@@ -1159,7 +1198,7 @@ struct Envelope *mutt_read_rfc822_header(FILE *f, struct Header *hdr,
   struct Envelope *e = mutt_env_new();
   char *line = mutt_mem_malloc(LONG_STRING);
   char *p = NULL;
-  LOFF_T loc;
+  LOFF_T loc, pos = -1;
   size_t linelen = LONG_STRING;
   char buf[LONG_STRING + 1];
 
@@ -1180,9 +1219,11 @@ struct Envelope *mutt_read_rfc822_header(FILE *f, struct Header *hdr,
     }
   }
 
-  while ((loc = ftello(f)) != -1)
+  /* The position is counted, rather than asked for on every line */
+  while ((loc = (pos >= 0) ? pos : ftello(f)) != -1)
   {
-    line = mutt_read_rfc822_line(f, line, &linelen);
+    pos = loc;
+    line = read_rfc822_line(f, line, &linelen, &pos);
     if (*line == '\0')
       break;
     p = strpbrk(line, ": \t");
@@ -1453,6 +1494,7 @@ int mutt_count_body_parts(struct Context *ctx, struct Header *hdr)
     hdr->attach_total = 0;
 
   hdr->attach_valid = true;
+  hdr->attach_new = true;
 
   if (!keep_parts)
     mutt_free_body(&hdr->content->parts);
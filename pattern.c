@@ -23,6 +23,7 @@
 #include "config.h"
 #include <stddef.h>
 #include <ctype.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <regex.h>
 #include <stdarg.h>
@@ -31,13 +32,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <time.h>
 #include <unistd.h>
+#ifdef HAVE_PTHREAD_CREATE
+#include <pthread.h>
+#endif
 #include "mutt/mutt.h"
 #include "conn/conn.h"
 #include "mutt.h"
 #include "pattern.h"
 #include "address.h"
+#include "address_index.h"
 #include "body.h"
 #include "context.h"
 #include "copy.h"
@@ -52,7 +58,10 @@
 #include "ncrypt/ncrypt.h"
 #include "opcodes.h"
 #include "options.h"
+#include "pager.h"
+#include "perf.h"
 #include "protos.h"
+#include "search_index.h"
 #include "state.h"
 #include "tags.h"
 #include "thread.h"
@@ -117,6 +126,11 @@ static bool eat_regex(struct Pattern *pat, struct Buffer *s, struct Buffer *err)
       FREE(&pat->p.regex);
       return false;
     }
+    /* Text that every match contains is quicker to find than the regex */
+    bool exact = false;
+    pat->literal = mutt_regex_literal(buf.data, &exact);
+    pat->literal_only = exact;
+    pat->ign_case = (flags != 0);
     FREE(&buf.data);
   }
 
@@ -886,10 +900,201 @@ static int patmatch(const struct Pattern *pat, const char *buf)
     return pat->ign_case ? !strcasestr(buf, pat->p.str) : !strstr(buf, pat->p.str);
   else if (pat->groupmatch)
     return !mutt_group_match(pat->p.g, buf);
+  else if (pat->literal &&
+           !(pat->ign_case ? strcasestr(buf, pat->literal) : strstr(buf, pat->literal)))
+    return REG_NOMATCH;
+  else if (pat->literal_only)
+    return 0;
   else
     return regexec(pat->p.regex, buf, 0, NULL, 0);
 }
 
+#ifdef HAVE_FOPENCOOKIE
+/* Longest line matched at once, as read by msg_search() */
+#define SEARCH_LINE (STRING - 2)
+
+/**
+ * struct SearchStream - Match a pattern against text as it's written
+ */
+struct SearchStream
+{
+  const struct Pattern *pat;
+  char line[SEARCH_LINE + 1]; /**< Current line, so far */
+  size_t len;                 /**< Length of the current line */
+  bool match;                 /**< A line has matched */
+  bool skip;                  /**< Don't match this text */
+#ifdef USE_HCACHE
+  struct SearchSig *sig;      /**< Signature being built from all the text */
+#endif
+};
+
+/**
+ * search_stream_write - Match the lines written to a SearchStream
+ * @param cookie SearchStream
+ * @param data   Text written
+ * @param size   Length of the text
+ * @retval num Bytes consumed, always size
+ *
+ * Once a line has matched, the rest is thrown away.
+ */
+static ssize_t search_stream_write(void *cookie, const char *data, size_t size)
+{
+  struct SearchStream *ss = cookie;
+
+#ifdef USE_HCACHE
+  if (ss->sig)
+    mutt_search_sig_feed(ss->sig, data, size);
+#endif
+  if (ss->pat->stats)
+    ss->pat->stats->bytes += size;
+  if (ss->skip)
+    return size;
+
+  for (size_t left = size; (left > 0) && !ss->match;)
+  {
+    size_t n = MIN(left, SEARCH_LINE - ss->len);
+    const char *nl = memchr(data, '\n', n);
+    if (nl)
+      n = nl - data + 1;
+
+    memcpy(ss->line + ss->len, data, n);
+    ss->len += n;
+    data += n;
+    left -= n;
+
+    if (nl || (ss->len == SEARCH_LINE))
+    {
+      ss->line[ss->len] = '\0';
+      ss->match = (patmatch(ss->pat, ss->line) == 0);
+      ss->len = 0;
+    }
+  }
+
+  return size;
+}
+
+/**
+ * msg_search_stream - Match a decoded message without storing it
+ * @param ctx Mailbox
+ * @param pat Pattern, MUTT_BODY or MUTT_WHOLE_MSG
+ * @param h   Email Header
+ * @param msg Open message
+ * @retval  1 Match
+ * @retval  0 No match
+ * @retval -1 Error, try the old way
+ *
+ * The decoded text goes straight to the matcher, a line at a time, instead of
+ * into a temporary file.  If the header matches, the body isn't decoded,
+ * unless the message is being given a search signature.
+ */
+static int msg_search_stream(struct Context *ctx, struct Pattern *pat,
+                             struct Header *h, struct Message *msg)
+{
+  cookie_io_functions_t io = { NULL, search_stream_write, NULL, NULL };
+  struct SearchStream ss;
+  struct State s;
+
+  memset(&ss, 0, sizeof(ss));
+  ss.pat = pat;
+  memset(&s, 0, sizeof(s));
+  s.fpin = msg->fp;
+  s.flags = MUTT_CHARCONV;
+  s.fpout = fopencookie(&ss, "w", io);
+  if (!s.fpout)
+    return -1;
+
+#ifdef USE_HCACHE
+  /* The signature covers the header, too, so it serves ~b and ~B */
+  struct SearchIndex *si = mutt_search_index_get(ctx);
+  if (si && !mutt_search_index_has(si, h))
+    ss.sig = mutt_search_sig_new();
+#endif
+
+  if ((pat->op != MUTT_BODY)
+#ifdef USE_HCACHE
+      || ss.sig
+#endif
+  )
+  {
+    ss.skip = (pat->op == MUTT_BODY);
+    mutt_copy_header(msg->fp, h, s.fpout, CH_FROM | CH_DECODE, NULL);
+    fflush(s.fpout);
+    ss.skip = false;
+  }
+
+  if (!ss.match
+#ifdef USE_HCACHE
+      || ss.sig
+#endif
+  )
+  {
+    mutt_parse_mime_message(ctx, h);
+
+    if (WithCrypto && (h->security & ENCRYPT))
+    {
+#ifdef USE_HCACHE
+      /* Never keep any trace of the text of an encrypted message */
+      mutt_search_sig_free(&ss.sig);
+#endif
+      if (!ss.match && !crypt_valid_passphrase(h->security))
+      {
+        fclose(s.fpout);
+        return 0;
+      }
+    }
+
+    /* An encrypted message whose header matched isn't decrypted */
+    if (!ss.match || !(WithCrypto && (h->security & ENCRYPT)))
+    {
+      fseeko(msg->fp, h->offset, SEEK_SET);
+      mutt_body_handler(h->content, &s);
+    }
+  }
+
+  fclose(s.fpout);
+
+  /* the last line may not end in a newline */
+  if (!ss.match && (ss.len > 0))
+  {
+    ss.line[ss.len] = '\0';
+    ss.match = (patmatch(pat, ss.line) == 0);
+  }
+
+#ifdef USE_HCACHE
+  if (ss.sig)
+    mutt_search_index_add(si, h, &ss.sig);
+#endif
+
+  return ss.match;
+}
+#endif
+
+#ifdef USE_HCACHE
+/**
+ * search_index_text - Get the text every match of a pattern contains
+ * @param pat Pattern
+ * @retval ptr  Text to look up in the search index
+ * @retval NULL The index can't help
+ *
+ * The index folds only ASCII letters, so a search ignoring case has to be for
+ * ASCII text.
+ */
+static const char *search_index_text(const struct Pattern *pat)
+{
+  const char *text = pat->stringmatch ? pat->p.str : pat->literal;
+
+  if (!text || pat->groupmatch || (mutt_str_strlen(text) < 3))
+    return NULL;
+
+  if (pat->ign_case)
+    for (const char *p = text; *p; p++)
+      if ((unsigned char) *p & 0x80)
+        return NULL;
+
+  return text;
+}
+#endif
+
 static int msg_search(struct Context *ctx, struct Pattern *pat, int msgno)
 {
   struct Message *msg = NULL;
@@ -908,9 +1113,32 @@ static int msg_search(struct Context *ctx, struct Pattern *pat, int msgno)
   struct stat st;
 #endif
 
+#ifdef USE_HCACHE
+  if ((pat->op == MUTT_BODY) || (pat->op == MUTT_WHOLE_MSG))
+  {
+    struct SearchIndex *si = mutt_search_index_get(ctx);
+    if (si && mutt_search_index_excludes(si, h, search_index_text(pat)))
+    {
+      if (pat->stats)
+        pat->stats->indexed++;
+      return 0;
+    }
+  }
+#endif
+
   msg = mx_open_message(ctx, msgno);
   if (msg)
   {
+#ifdef HAVE_FOPENCOOKIE
+    if (ThoroughSearch && (pat->op != MUTT_HEADER) &&
+        ((match = msg_search_stream(ctx, pat, h, msg)) >= 0))
+    {
+      mx_close_message(ctx, &msg);
+      return match;
+    }
+    match = 0;
+#endif
+
     if (ThoroughSearch)
     {
       /* decode the header / body */
@@ -1021,6 +1249,8 @@ static int msg_search(struct Context *ctx, struct Pattern *pat, int msgno)
       }
       else if (fgets(buf, blen - 1, fp) == NULL)
         break; /* don't loop forever */
+      if (pat->stats)
+        pat->stats->bytes += mutt_str_strlen(buf);
       if (patmatch(pat, buf) == 0)
       {
         match = 1;
@@ -1093,141 +1323,575 @@ void mutt_pattern_free(struct Pattern **pat)
       FREE(&tmp->p.regex);
     }
 
+    FREE(&tmp->literal);
+
     if (tmp->child)
       mutt_pattern_free(&tmp->child);
+    mutt_hash_destroy(&tmp->imap_matches);
+    FREE(&tmp->thread_cache);
+    if (tmp->stats)
+      FREE(&tmp->stats->source);
+    FREE(&tmp->stats);
     FREE(&tmp);
   }
 }
 
-struct Pattern *mutt_pattern_comp(/* const */ char *s, int flags, struct Buffer *err)
+/**
+ * pattern_cost - Estimate how expensive a pattern is to match
+ * @param pat Pattern
+ * @retval num Relative cost, lowest first
+ *
+ * Flags and numbers are in the Header, addresses and strings are in the
+ * Envelope, but the full header or the body have to be read from the mailbox.
+ */
+static int pattern_cost(const struct Pattern *pat)
 {
-  struct Pattern *curlist = NULL;
-  struct Pattern *tmp = NULL, *tmp2 = NULL;
-  struct Pattern *last = NULL;
-  bool not = false;
-  bool alladdr = false;
-  bool or = false;
-  bool implicit = true; /* used to detect logical AND operator */
-  bool isalias = false;
-  short thread_op;
-  const struct PatternFlags *entry = NULL;
-  char *p = NULL;
-  char *buf = NULL;
-  struct Buffer ps;
+  int cost = 0;
 
-  mutt_buffer_init(&ps);
-  ps.dptr = s;
-  ps.dsize = mutt_str_strlen(s);
+  switch (pat->op)
+  {
+    case MUTT_AND:
+    case MUTT_OR:
+      /* as expensive as the most expensive child */
+      for (const struct Pattern *c = pat->child; c; c = c->next)
+        cost = MAX(cost, pattern_cost(c));
+      return cost;
+    case MUTT_THREAD:
+    case MUTT_PARENT:
+    case MUTT_CHILDREN:
+      /* matched against other messages in the thread */
+      return MAX(3, pattern_cost(pat->child));
+    case MUTT_LIST:
+    case MUTT_SUBSCRIBED_LIST:
+    case MUTT_PERSONAL_RECIP:
+    case MUTT_PERSONAL_FROM:
+      return 1;
+    case MUTT_SENDER:
+    case MUTT_FROM:
+    case MUTT_TO:
+    case MUTT_CC:
+    case MUTT_SUBJECT:
+    case MUTT_ID:
+    case MUTT_REFERENCE:
+    case MUTT_ADDRESS:
+    case MUTT_RECIPIENT:
+    case MUTT_XLABEL:
+    case MUTT_DRIVER_TAGS:
+    case MUTT_HORMEL:
+#ifdef USE_NNTP
+    case MUTT_NEWSGROUPS:
+#endif
+      return 2;
+    case MUTT_HEADER:
+      return 3;
+    case MUTT_BODY:
+    case MUTT_WHOLE_MSG:
+    case MUTT_MIMEATTACH:
+    case MUTT_SERVERSEARCH:
+      return 4;
+    default:
+      return 0;
+  }
+}
 
-  while (*ps.dptr)
+/**
+ * mutt_pattern_deps - What can change the verdict of a pattern?
+ * @param pat Pattern
+ * @retval num Flags, e.g. #MUTT_PAT_DEP_FLAGS
+ *
+ * Without any of these, a message keeps its verdict for as long as its
+ * contents stay the same.
+ */
+int mutt_pattern_deps(const struct Pattern *pat)
+{
+  int deps = 0;
+
+  for (; pat; pat = pat->next)
   {
-    SKIPWS(ps.dptr);
-    switch (*ps.dptr)
+    /* %group lists can be changed by the config */
+    if (pat->groupmatch)
+      deps |= MUTT_PAT_DEP_OTHER;
+
+    switch (pat->op)
     {
-      case '^':
-        ps.dptr++;
-        alladdr = !alladdr;
+      case MUTT_AND:
+      case MUTT_OR:
+        deps |= mutt_pattern_deps(pat->child);
         break;
-      case '!':
-        ps.dptr++;
-        not = !not;
+      case MUTT_THREAD:
+      case MUTT_PARENT:
+      case MUTT_CHILDREN:
+        deps |= MUTT_PAT_DEP_THREAD | mutt_pattern_deps(pat->child);
         break;
-      case '@':
-        ps.dptr++;
-        isalias = !isalias;
+      case MUTT_DUPLICATED:
+      case MUTT_UNREFERENCED:
+      case MUTT_BROKEN:
+        deps |= MUTT_PAT_DEP_THREAD;
         break;
-      case '|':
-        if (! or)
-        {
-          if (!curlist)
-          {
-            snprintf(err->data, err->dsize, _("error in pattern at: %s"), ps.dptr);
-            return NULL;
-          }
-          if (curlist->next)
-          {
-            /* A & B | C == (A & B) | C */
-            tmp = new_pattern();
-            tmp->op = MUTT_AND;
-            tmp->child = curlist;
-
-            curlist = tmp;
-            last = curlist;
-          }
-
-          or = true;
-        }
-        ps.dptr++;
-        implicit = false;
-        not = false;
-        alladdr = false;
-        isalias = false;
+      case MUTT_NEW:
+      case MUTT_OLD:
+      case MUTT_REPLIED:
+      case MUTT_READ:
+      case MUTT_UNREAD:
+      case MUTT_DELETED:
+      case MUTT_FLAG:
+      case MUTT_TAG:
+      case MUTT_EXPIRED:
+      case MUTT_SUPERSEDED:
+      case MUTT_CRYPT_SIGN:
+      case MUTT_CRYPT_VERIFIED:
+      case MUTT_CRYPT_ENCRYPT:
+      case MUTT_PGP_KEY:
+        deps |= MUTT_PAT_DEP_FLAGS;
         break;
-      case '%':
-      case '=':
-      case '~':
-        if (!*(ps.dptr + 1))
-        {
-          snprintf(err->data, err->dsize, _("missing pattern: %s"), ps.dptr);
-          mutt_pattern_free(&curlist);
-          return NULL;
-        }
-        thread_op = 0;
-        if (*(ps.dptr + 1) == '(')
-          thread_op = MUTT_THREAD;
-        else if ((*(ps.dptr + 1) == '<') && (*(ps.dptr + 2) == '('))
-          thread_op = MUTT_PARENT;
-        else if ((*(ps.dptr + 1) == '>') && (*(ps.dptr + 2) == '('))
-          thread_op = MUTT_CHILDREN;
-        if (thread_op)
-        {
-          ps.dptr++; /* skip ~ */
-          if (thread_op == MUTT_PARENT || thread_op == MUTT_CHILDREN)
-            ps.dptr++;
-          p = find_matching_paren(ps.dptr + 1);
-          if (*p != ')')
-          {
-            snprintf(err->data, err->dsize, _("mismatched brackets: %s"), ps.dptr);
-            mutt_pattern_free(&curlist);
-            return NULL;
-          }
-          tmp = new_pattern();
-          tmp->op = thread_op;
-          if (last)
-            last->next = tmp;
-          else
-            curlist = tmp;
-          last = tmp;
-          tmp->not ^= not;
-          tmp->alladdr |= alladdr;
-          tmp->isalias |= isalias;
-          not = false;
-          alladdr = false;
-          isalias = false;
-          /* compile the sub-expression */
-          buf = mutt_str_substr_dup(ps.dptr + 1, p);
-          tmp2 = mutt_pattern_comp(buf, flags, err);
-          if (!tmp2)
-          {
-            FREE(&buf);
-            mutt_pattern_free(&curlist);
-            return NULL;
-          }
-          FREE(&buf);
-          tmp->child = tmp2;
-          ps.dptr = p + 1; /* restore location */
-          break;
-        }
-        if (implicit && or)
-        {
-          /* A | B & C == (A | B) & C */
-          tmp = new_pattern();
-          tmp->op = MUTT_OR;
-          tmp->child = curlist;
-          curlist = tmp;
-          last = tmp;
-          or = false;
-        }
+      case MUTT_ALL:
+      case MUTT_SUBJECT:
+      case MUTT_FROM:
+      case MUTT_TO:
+      case MUTT_CC:
+      case MUTT_SENDER:
+      case MUTT_DATE:
+      case MUTT_DATE_RECEIVED:
+      case MUTT_ID:
+      case MUTT_BODY:
+      case MUTT_HEADER:
+      case MUTT_HORMEL:
+      case MUTT_WHOLE_MSG:
+      case MUTT_SIZE:
+      case MUTT_REFERENCE:
+      case MUTT_RECIPIENT:
+      case MUTT_ADDRESS:
+#ifdef USE_NNTP
+      case MUTT_NEWSGROUPS:
+#endif
+        break;
+      default:
+        /* e.g. score, label, message number, and anything that reads the
+         * config: lists, alternates, $attach_... */
+        deps |= MUTT_PAT_DEP_OTHER;
+        break;
+    }
+  }
+
+  return deps;
+}
+
+/**
+ * pattern_addr_fields - Which address fields does a pattern look at?
+ * @param pat Pattern
+ * @retval num Fields, e.g. #MUTT_AI_FROM
+ * @retval 0   The pattern can't be answered by the address index
+ *
+ * The index finds the messages with at least one matching address, so ^~f
+ * ("all" the addresses) and aliases (~f @alias) are left to
+ * mutt_pattern_exec().
+ */
+static int pattern_addr_fields(const struct Pattern *pat)
+{
+  if (pat->alladdr || pat->isalias)
+    return 0;
+
+  switch (pat->op)
+  {
+    case MUTT_FROM:
+      return MUTT_AI_FROM;
+    case MUTT_SENDER:
+      return MUTT_AI_SENDER;
+    case MUTT_TO:
+      return MUTT_AI_TO;
+    case MUTT_CC:
+      return MUTT_AI_CC;
+    case MUTT_RECIPIENT:
+      return MUTT_AI_TO | MUTT_AI_CC;
+    case MUTT_ADDRESS:
+      return MUTT_AI_FROM | MUTT_AI_SENDER | MUTT_AI_TO | MUTT_AI_CC;
+    default:
+      return 0;
+  }
+}
+
+/**
+ * pattern_is_scannable - Can a pattern be matched without reading each Header?
+ * @param pat   Pattern
+ * @param addrs The address index may be used
+ * @retval true Only dates, sizes, scores (and addresses) are tested
+ */
+static bool pattern_is_scannable(const struct Pattern *pat, bool addrs)
+{
+  switch (pat->op)
+  {
+    case MUTT_AND:
+    case MUTT_OR:
+      for (const struct Pattern *c = pat->child; c; c = c->next)
+        if (!pattern_is_scannable(c, addrs))
+          return false;
+      return true;
+    case MUTT_ALL:
+    case MUTT_DATE:
+    case MUTT_DATE_RECEIVED:
+    case MUTT_SIZE:
+    case MUTT_SCORE:
+      return true;
+    default:
+      return addrs && pattern_addr_fields(pat);
+  }
+}
+
+/**
+ * pattern_needs_addrs - Does a pattern test any addresses?
+ * @param pat Pattern
+ * @retval true The pattern would use the address index
+ */
+static bool pattern_needs_addrs(const struct Pattern *pat)
+{
+  if ((pat->op == MUTT_AND) || (pat->op == MUTT_OR))
+  {
+    for (const struct Pattern *c = pat->child; c; c = c->next)
+      if (pattern_needs_addrs(c))
+        return true;
+    return false;
+  }
+
+  return pattern_addr_fields(pat) != 0;
+}
+
+/**
+ * addr_index_patmatch - Match an address string - Implements ::addr_index_match_t
+ */
+static bool addr_index_patmatch(const char *str, void *data)
+{
+  return patmatch(data, str) == 0;
+}
+
+/**
+ * pattern_scan - Match a pattern against every message at once
+ * @param[in]  ctx   Mailbox, with its columns up to date
+ * @param[in]  ai    Address index, may be NULL if no addresses are tested
+ * @param[in]  pat   Pattern, see pattern_is_scannable()
+ * @param[out] match One byte per message, 1 if it matches, 0 if not
+ *
+ * Each scalar test is a plain loop over one column, without branches, which
+ * the compiler can vectorise.  Each distinct address is matched once.  The
+ * results are the same as mutt_pattern_exec().
+ */
+static void pattern_scan(struct Context *ctx, struct AddressIndex *ai,
+                         struct Pattern *pat, unsigned char *match)
+{
+  const struct MsgColumns *cols = &ctx->cols;
+  const int n = ctx->msgcount;
+
+  switch (pat->op)
+  {
+    case MUTT_AND:
+    case MUTT_OR:
+    {
+      unsigned char *tmp = mutt_mem_malloc(n);
+      pattern_scan(ctx, ai, pat->child, match);
+      for (struct Pattern *c = pat->child->next; c; c = c->next)
+      {
+        pattern_scan(ctx, ai, c, tmp);
+        if (pat->op == MUTT_AND)
+          for (int i = 0; i < n; i++)
+            match[i] &= tmp[i];
+        else
+          for (int i = 0; i < n; i++)
+            match[i] |= tmp[i];
+      }
+      FREE(&tmp);
+      break;
+    }
+    case MUTT_ALL:
+      memset(match, 1, n);
+      break;
+    case MUTT_DATE:
+    case MUTT_DATE_RECEIVED:
+    {
+      const time_t *col = (pat->op == MUTT_DATE) ? cols->date_sent : cols->received;
+      const time_t min = pat->min, max = pat->max;
+      for (int i = 0; i < n; i++)
+        match[i] = (col[i] >= min) & (col[i] <= max);
+      break;
+    }
+    case MUTT_SIZE:
+    {
+      const LOFF_T min = pat->min, max = pat->max;
+      const unsigned char open = (pat->max == MUTT_MAXRANGE);
+      for (int i = 0; i < n; i++)
+        match[i] = (cols->size[i] >= min) & (open | (cols->size[i] <= max));
+      break;
+    }
+    case MUTT_SCORE:
+    {
+      const int min = pat->min, max = pat->max;
+      const unsigned char open = (pat->max == MUTT_MAXRANGE);
+      for (int i = 0; i < n; i++)
+        match[i] = (cols->score[i] >= min) & (open | (cols->score[i] <= max));
+      break;
+    }
+    default:
+      mutt_addr_index_match(ai, pattern_addr_fields(pat), addr_index_patmatch, pat, match);
+      break;
+  }
+
+  if (pat->not)
+    for (int i = 0; i < n; i++)
+      match[i] ^= 1;
+}
+
+/**
+ * mutt_pattern_prefilter - Rule out messages without reading each Header
+ * @param[in]  ctx   Mailbox
+ * @param[in]  pat   Pattern
+ * @param[out] exact Set if the result is the verdict of the whole pattern
+ * @retval ptr  One byte per message in ctx->hdrs, 0 if it can't match
+ * @retval NULL The pattern has to be tested message by message
+ *
+ * A pattern of dates, sizes, scores and addresses is matched in full, from
+ * the message columns and the address index.  For an AND, those arguments
+ * rule out messages before the others are tested.  The fields of local
+ * messages don't change once they're read, which isn't true of a server's,
+ * so only local mailboxes are scanned.
+ */
+unsigned char *mutt_pattern_prefilter(struct Context *ctx, struct Pattern *pat, bool *exact)
+{
+  *exact = false;
+  if (!ctx || (ctx->msgcount == 0) ||
+      ((ctx->magic != MUTT_MBOX) && (ctx->magic != MUTT_MMDF) &&
+       (ctx->magic != MUTT_MH) && (ctx->magic != MUTT_MAILDIR)))
+  {
+    return NULL;
+  }
+
+  const int n = ctx->msgcount;
+  struct AddressIndex *ai = pattern_needs_addrs(pat) ? mutt_addr_index_get(ctx) : NULL;
+  unsigned char *match = NULL;
+
+  if (pattern_is_scannable(pat, ai))
+  {
+    mx_update_columns(ctx, n);
+    match = mutt_mem_malloc(n);
+    pattern_scan(ctx, ai, pat, match);
+    *exact = true;
+    return match;
+  }
+
+  if ((pat->op != MUTT_AND) || pat->not)
+    return NULL;
+
+  unsigned char *tmp = NULL;
+  for (struct Pattern *c = pat->child; c; c = c->next)
+  {
+    if (!pattern_is_scannable(c, ai))
+      continue;
+    if (!match)
+    {
+      mx_update_columns(ctx, n);
+      match = mutt_mem_malloc(n);
+      tmp = mutt_mem_malloc(n);
+      pattern_scan(ctx, ai, c, match);
+      continue;
+    }
+    pattern_scan(ctx, ai, c, tmp);
+    for (int i = 0; i < n; i++)
+      match[i] &= tmp[i];
+  }
+
+  FREE(&tmp);
+  return match;
+}
+
+/**
+ * pattern_exec_filtered - Match a message, unless the prefilter decides
+ * @param pat    Pattern
+ * @param ctx    Mailbox
+ * @param msgno  Index into ctx->hdrs
+ * @param filter Result of mutt_pattern_prefilter(), may be NULL
+ * @param exact  The filter is the whole verdict
+ * @retval num As mutt_pattern_exec()
+ */
+static int pattern_exec_filtered(struct Pattern *pat, struct Context *ctx, int msgno,
+                                 const unsigned char *filter, bool exact)
+{
+  if (filter && (!filter[msgno] || exact))
+    return filter[msgno];
+
+  return mutt_pattern_exec(pat, MUTT_MATCH_FULL_ADDRESS, ctx, ctx->hdrs[msgno], NULL);
+}
+
+/**
+ * pattern_sort_children - Put the cheapest arguments of an AND or OR first
+ * @param pat Pattern, MUTT_AND or MUTT_OR
+ *
+ * AND and OR stop at the first argument that decides the result, so testing
+ * the cheap ones first saves reading the messages whenever a flag or a header
+ * field is enough.  Arguments of the same cost keep their order.
+ */
+static void pattern_sort_children(struct Pattern *pat)
+{
+  struct Pattern *sorted = NULL;
+
+  while (pat->child)
+  {
+    struct Pattern *c = pat->child;
+    struct Pattern **pp = &sorted;
+    int cost = pattern_cost(c);
+
+    pat->child = c->next;
+    while (*pp && (pattern_cost(*pp) <= cost))
+      pp = &(*pp)->next;
+    c->next = *pp;
+    *pp = c;
+  }
+  pat->child = sorted;
+}
+
+/**
+ * pattern_stats_add - Give every part of a pattern a profile
+ * @param pat Pattern
+ *
+ * The simple patterns already have one, with their text.
+ */
+static void pattern_stats_add(struct Pattern *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    if (!pat->stats)
+      pat->stats = mutt_mem_calloc(1, sizeof(struct PatternStats));
+    pattern_stats_add(pat->child);
+  }
+}
+
+struct Pattern *mutt_pattern_comp(/* const */ char *s, int flags, struct Buffer *err)
+{
+  struct Pattern *curlist = NULL;
+  struct Pattern *tmp = NULL, *tmp2 = NULL;
+  struct Pattern *last = NULL;
+  bool not = false;
+  bool alladdr = false;
+  bool or = false;
+  bool implicit = true; /* used to detect logical AND operator */
+  bool isalias = false;
+  short thread_op;
+  const struct PatternFlags *entry = NULL;
+  char *p = NULL;
+  char *buf = NULL;
+  char *start = NULL;
+  struct Buffer ps;
+
+  mutt_buffer_init(&ps);
+  ps.dptr = s;
+  ps.dsize = mutt_str_strlen(s);
+
+  while (*ps.dptr)
+  {
+    SKIPWS(ps.dptr);
+    switch (*ps.dptr)
+    {
+      case '^':
+        ps.dptr++;
+        alladdr = !alladdr;
+        break;
+      case '!':
+        ps.dptr++;
+        not = !not;
+        break;
+      case '@':
+        ps.dptr++;
+        isalias = !isalias;
+        break;
+      case '|':
+        if (! or)
+        {
+          if (!curlist)
+          {
+            snprintf(err->data, err->dsize, _("error in pattern at: %s"), ps.dptr);
+            return NULL;
+          }
+          if (curlist->next)
+          {
+            /* A & B | C == (A & B) | C */
+            tmp = new_pattern();
+            tmp->op = MUTT_AND;
+            tmp->child = curlist;
+            pattern_sort_children(tmp);
+
+            curlist = tmp;
+            last = curlist;
+          }
+
+          or = true;
+        }
+        ps.dptr++;
+        implicit = false;
+        not = false;
+        alladdr = false;
+        isalias = false;
+        break;
+      case '%':
+      case '=':
+      case '~':
+        if (!*(ps.dptr + 1))
+        {
+          snprintf(err->data, err->dsize, _("missing pattern: %s"), ps.dptr);
+          mutt_pattern_free(&curlist);
+          return NULL;
+        }
+        thread_op = 0;
+        if (*(ps.dptr + 1) == '(')
+          thread_op = MUTT_THREAD;
+        else if ((*(ps.dptr + 1) == '<') && (*(ps.dptr + 2) == '('))
+          thread_op = MUTT_PARENT;
+        else if ((*(ps.dptr + 1) == '>') && (*(ps.dptr + 2) == '('))
+          thread_op = MUTT_CHILDREN;
+        if (thread_op)
+        {
+          ps.dptr++; /* skip ~ */
+          if (thread_op == MUTT_PARENT || thread_op == MUTT_CHILDREN)
+            ps.dptr++;
+          p = find_matching_paren(ps.dptr + 1);
+          if (*p != ')')
+          {
+            snprintf(err->data, err->dsize, _("mismatched brackets: %s"), ps.dptr);
+            mutt_pattern_free(&curlist);
+            return NULL;
+          }
+          tmp = new_pattern();
+          tmp->op = thread_op;
+          if (last)
+            last->next = tmp;
+          else
+            curlist = tmp;
+          last = tmp;
+          tmp->not ^= not;
+          tmp->alladdr |= alladdr;
+          tmp->isalias |= isalias;
+          not = false;
+          alladdr = false;
+          isalias = false;
+          /* compile the sub-expression */
+          buf = mutt_str_substr_dup(ps.dptr + 1, p);
+          tmp2 = mutt_pattern_comp(buf, flags, err);
+          if (!tmp2)
+          {
+            FREE(&buf);
+            mutt_pattern_free(&curlist);
+            return NULL;
+          }
+          FREE(&buf);
+          tmp->child = tmp2;
+          ps.dptr = p + 1; /* restore location */
+          break;
+        }
+        if (implicit && or)
+        {
+          /* A | B & C == (A | B) & C */
+          tmp = new_pattern();
+          tmp->op = MUTT_OR;
+          tmp->child = curlist;
+          curlist = tmp;
+          last = tmp;
+          or = false;
+        }
 
         tmp = new_pattern();
         tmp->not = not;
@@ -1245,6 +1909,7 @@ struct Pattern *mutt_pattern_comp(/* const */ char *s, int flags, struct Buffer
           curlist = tmp;
         last = tmp;
 
+        start = ps.dptr;
         ps.dptr++; /* move past the ~ */
         entry = lookup_tag(*ps.dptr);
         if (!entry)
@@ -1278,6 +1943,14 @@ struct Pattern *mutt_pattern_comp(/* const */ char *s, int flags, struct Buffer
             return NULL;
           }
         }
+        if (flags & MUTT_PATTERN_STATS)
+        {
+          tmp->stats = mutt_mem_calloc(1, sizeof(struct PatternStats));
+          p = ps.dptr;
+          while ((p > start) && ISSPACE(*(p - 1)))
+            p--;
+          tmp->stats->source = mutt_str_substr_dup(start, p);
+        }
         implicit = true;
         break;
       case '(':
@@ -1327,8 +2000,11 @@ struct Pattern *mutt_pattern_comp(/* const */ char *s, int flags, struct Buffer
     tmp = new_pattern();
     tmp->op = or ? MUTT_OR : MUTT_AND;
     tmp->child = curlist;
+    pattern_sort_children(tmp);
     curlist = tmp;
   }
+  if (flags & MUTT_PATTERN_STATS)
+    pattern_stats_add(curlist);
   return curlist;
 }
 
@@ -1456,13 +2132,105 @@ static int match_threadcomplete(struct Pattern *pat, enum PatternExecFlag flags,
   return 0;
 }
 
+/* Bits of a Pattern.thread_cache entry */
+#define THREAD_ARG_KNOWN  (1 << 0) /**< The argument has been matched against the message */
+#define THREAD_ARG_MATCH  (1 << 1) /**< The argument matches the message */
+#define THREAD_TREE_KNOWN (1 << 2) /**< The thread of the message has been searched */
+#define THREAD_TREE_MATCH (1 << 3) /**< The argument matches a message of the thread */
+
+/**
+ * match_thread_arg - Match the argument of a thread pattern against a message
+ * @param pat   Pattern, e.g. #MUTT_PARENT
+ * @param flags Flags, e.g. #MUTT_MATCH_FULL_ADDRESS
+ * @param ctx   Mailbox
+ * @param h     Message
+ * @retval 1 The argument matches
+ * @retval 0 It doesn't
+ *
+ * With a thread cache, each message is only matched once, however many of its
+ * relatives ask.
+ */
+static int match_thread_arg(struct Pattern *pat, enum PatternExecFlag flags,
+                            struct Context *ctx, struct Header *h)
+{
+  if (!pat->thread_cache)
+    return mutt_pattern_exec(pat->child, flags, ctx, h, NULL);
+
+  unsigned char *c = &pat->thread_cache[h->msgno];
+  if (!(*c & THREAD_ARG_KNOWN))
+  {
+    *c |= THREAD_ARG_KNOWN;
+    if (mutt_pattern_exec(pat->child, flags, ctx, h, NULL))
+      *c |= THREAD_ARG_MATCH;
+  }
+  return (*c & THREAD_ARG_MATCH) != 0;
+}
+
+/**
+ * thread_walk_next - Step through a subtree of threads, depth first
+ * @param t   Current thread
+ * @param top Root of the subtree
+ * @retval ptr  Next thread
+ * @retval NULL The whole subtree has been seen
+ */
+static struct MuttThread *thread_walk_next(struct MuttThread *t, struct MuttThread *top)
+{
+  if (t->child)
+    return t->child;
+
+  while ((t != top) && !t->next)
+    t = t->parent;
+
+  return (t == top) ? NULL : t->next;
+}
+
+/**
+ * match_threadtree - Does any message of a thread match? (cached)
+ * @param pat   Pattern, #MUTT_THREAD
+ * @param flags Flags, e.g. #MUTT_MATCH_FULL_ADDRESS
+ * @param ctx   Mailbox
+ * @param h     Message
+ * @retval 1 A message of the thread matches the argument
+ * @retval 0 None does
+ *
+ * The same as match_threadcomplete(), but the whole thread is searched once
+ * and its verdict is left in the cache of all its messages.
+ */
+static int match_threadtree(struct Pattern *pat, enum PatternExecFlag flags,
+                            struct Context *ctx, struct Header *h)
+{
+  unsigned char *cache = pat->thread_cache;
+
+  if (!(cache[h->msgno] & THREAD_TREE_KNOWN))
+  {
+    struct MuttThread *top = h->thread;
+    bool match = false;
+
+    if (!top)
+      return 0;
+
+    while (top->parent)
+      top = top->parent;
+
+    for (struct MuttThread *t = top; t && !match; t = thread_walk_next(t, top))
+      if (t->message && match_thread_arg(pat, flags, ctx, t->message))
+        match = true;
+
+    for (struct MuttThread *t = top; t; t = thread_walk_next(t, top))
+      if (t->message)
+        cache[t->message->msgno] |= THREAD_TREE_KNOWN | (match ? THREAD_TREE_MATCH : 0);
+  }
+
+  return (cache[h->msgno] & THREAD_TREE_MATCH) != 0;
+}
+
 static int match_threadparent(struct Pattern *pat, enum PatternExecFlag flags,
                               struct Context *ctx, struct MuttThread *t)
 {
   if (!t || !t->parent || !t->parent->message)
     return 0;
 
-  return mutt_pattern_exec(pat, flags, ctx, t->parent->message, NULL);
+  return match_thread_arg(pat, flags, ctx, t->parent->message);
 }
 
 static int match_threadchildren(struct Pattern *pat, enum PatternExecFlag flags,
@@ -1472,12 +2240,52 @@ static int match_threadchildren(struct Pattern *pat, enum PatternExecFlag flags,
     return 0;
 
   for (t = t->child; t; t = t->next)
-    if (t->message && mutt_pattern_exec(pat, flags, ctx, t->message, NULL))
+    if (t->message && match_thread_arg(pat, flags, ctx, t->message))
       return 1;
 
   return 0;
 }
 
+/**
+ * pattern_thread_cache_start - Remember the verdicts of thread patterns
+ * @param pat   Pattern
+ * @param ctx   Mailbox
+ * @param flags The flags of the messages may change while matching
+ *
+ * ~(), ~<() and ~>() match their argument against the other messages of a
+ * thread, so without a cache, each message is matched once for every
+ * relative.  If the flags of the messages may change, an argument that tests
+ * them isn't cached, e.g. tagging ~(~T).
+ */
+static void pattern_thread_cache_start(struct Pattern *pat, struct Context *ctx, bool flags)
+{
+  for (; pat; pat = pat->next)
+  {
+    if (((pat->op == MUTT_THREAD) || (pat->op == MUTT_PARENT) ||
+         (pat->op == MUTT_CHILDREN)) &&
+        (!flags || !(mutt_pattern_deps(pat->child) & MUTT_PAT_DEP_FLAGS)))
+    {
+      pat->thread_cache = mutt_mem_calloc(MAX(ctx->msgcount, 1), 1);
+    }
+    pattern_thread_cache_start(pat->child, ctx, flags);
+  }
+}
+
+/**
+ * pattern_thread_cache_stop - Forget the verdicts of thread patterns
+ * @param pat Pattern
+ *
+ * The verdicts are only good while the messages don't change.
+ */
+static void pattern_thread_cache_stop(struct Pattern *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    FREE(&pat->thread_cache);
+    pattern_thread_cache_stop(pat->child);
+  }
+}
+
 /**
  * set_pattern_cache_value - Sets a value in the PatternCache cache entry
  *
@@ -1504,18 +2312,22 @@ static int is_pattern_cache_set(int cache_entry)
 }
 
 /**
- * mutt_pattern_exec - Match a pattern against an email header
+ * pattern_exec - Match a pattern against an email header
  *
- * flags: MUTT_MATCH_FULL_ADDRESS - match both personal and machine address
- * cache: For repeated matches against the same Header, passing in non-NULL will
- *        store some of the cacheable pattern matches in this structure.
+ * See mutt_pattern_exec()
  */
-int mutt_pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
-                      struct Context *ctx, struct Header *h, struct PatternCache *cache)
+static int pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
+                        struct Context *ctx, struct Header *h, struct PatternCache *cache)
 {
   int result;
   int *cache_entry = NULL;
 
+#ifdef USE_IMAP
+  /* imap_search() has already evaluated this subtree on the server */
+  if (pat->imap_matches && ctx && (ctx->magic == MUTT_IMAP))
+    return imap_search_matched(pat, h);
+#endif
+
   switch (pat->op)
   {
     case MUTT_AND:
@@ -1523,12 +2335,14 @@ int mutt_pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
     case MUTT_OR:
       return (pat->not ^ (perform_or(pat->child, flags, ctx, h, cache) > 0));
     case MUTT_THREAD:
+      if (pat->thread_cache)
+        return (pat->not ^ match_threadtree(pat, flags, ctx, h));
       return (pat->not ^
               match_threadcomplete(pat->child, flags, ctx, h->thread, 1, 1, 1, 1));
     case MUTT_PARENT:
-      return (pat->not ^ match_threadparent(pat->child, flags, ctx, h->thread));
+      return (pat->not ^ match_threadparent(pat, flags, ctx, h->thread));
     case MUTT_CHILDREN:
-      return (pat->not ^ match_threadchildren(pat->child, flags, ctx, h->thread));
+      return (pat->not ^ match_threadchildren(pat, flags, ctx, h->thread));
     case MUTT_ALL:
       return !pat->not;
     case MUTT_EXPIRED:
@@ -1567,22 +2381,13 @@ int mutt_pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
        */
       if (!ctx)
         return 0;
-#ifdef USE_IMAP
-      /* IMAP search sets h->matched at search compile time */
-      if (ctx->magic == MUTT_IMAP && pat->stringmatch)
-        return h->matched;
-#endif
       return (pat->not ^ msg_search(ctx, pat, h->msgno));
     case MUTT_SERVERSEARCH:
 #ifdef USE_IMAP
       if (!ctx)
         return 0;
       if (ctx->magic == MUTT_IMAP)
-      {
-        if (pat->stringmatch)
-          return (h->matched);
         return 0;
-      }
       mutt_error(_("error: server custom search only supported with IMAP."));
       return 0;
 #else
@@ -1754,6 +2559,32 @@ int mutt_pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
   return -1;
 }
 
+/**
+ * mutt_pattern_exec - Match a pattern against an email header
+ *
+ * flags: MUTT_MATCH_FULL_ADDRESS - match both personal and machine address
+ * cache: For repeated matches against the same Header, passing in non-NULL will
+ *        store some of the cacheable pattern matches in this structure.
+ */
+int mutt_pattern_exec(struct Pattern *pat, enum PatternExecFlag flags,
+                      struct Context *ctx, struct Header *h, struct PatternCache *cache)
+{
+  struct timeval start, end;
+
+  if (!pat->stats)
+    return pattern_exec(pat, flags, ctx, h, cache);
+
+  gettimeofday(&start, NULL);
+  int rc = pattern_exec(pat, flags, ctx, h, cache);
+  gettimeofday(&end, NULL);
+
+  pat->stats->evals++;
+  if (rc > 0)
+    pat->stats->matches++;
+  pat->stats->secs += (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+  return rc;
+}
+
 static void quote_simple(char *tmp, size_t len, const char *p)
 {
   int i = 0;
@@ -1870,6 +2701,7 @@ bool mutt_limit_current_thread(struct Header *h)
   {
     Context->hdrs[i]->virtual = -1;
     Context->hdrs[i]->limited = false;
+    Context->hdrs[i]->limit_valid = false;
     Context->hdrs[i]->collapsed = false;
     Context->hdrs[i]->num_hidden = 0;
 
@@ -1887,19 +2719,355 @@ bool mutt_limit_current_thread(struct Header *h)
   return true;
 }
 
+/**
+ * limit_flags - Summarise the flags of a message that patterns can test
+ * @param h Email Header
+ * @retval num Flags, as bits
+ */
+static unsigned int limit_flags(const struct Header *h)
+{
+  return (h->deleted << 0) | (h->tagged << 1) | (h->flagged << 2) |
+         (h->replied << 3) | (h->read << 4) | (h->old << 5) |
+         (h->expired << 6) | (h->superseded << 7) | ((unsigned int) h->security << 8);
+}
+
+/**
+ * mutt_limit_match - Does a message belong in the limited view?
+ * @param ctx Mailbox, with a limit pattern
+ * @param h   Email Header
+ * @retval true The message matches the limit pattern
+ *
+ * The verdict is remembered in the Header.  It's reused until something the
+ * limit pattern looks at changes, so re-applying the limit after a mailbox
+ * is reopened only matches the new or changed messages.
+ */
+bool mutt_limit_match(struct Context *ctx, struct Header *h)
+{
+  const unsigned int flags = limit_flags(h);
+
+  if (h->limit_valid && !(ctx->limit_deps & (MUTT_PAT_DEP_THREAD | MUTT_PAT_DEP_OTHER)) &&
+      (!(ctx->limit_deps & MUTT_PAT_DEP_FLAGS) || (h->limit_flags == flags)))
+  {
+    return h->limited;
+  }
+
+  h->limited = mutt_pattern_exec(ctx->limit_pattern, MUTT_MATCH_FULL_ADDRESS, ctx, h, NULL);
+  h->limit_valid = true;
+  h->limit_flags = flags;
+  return h->limited;
+}
+
+#ifdef USE_IMAP
+/**
+ * pattern_needs_headers - Does a pattern need headers that haven't been read?
+ * @param ctx Mailbox
+ * @param pat Pattern
+ * @retval true Some header fields must be read first, see $imap_index_headers
+ */
+static bool pattern_needs_headers(struct Context *ctx, const struct Pattern *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    const char *field = NULL;
+
+    switch (pat->op)
+    {
+      case MUTT_AND:
+      case MUTT_OR:
+        if (pattern_needs_headers(ctx, pat->child))
+          return true;
+        continue;
+
+      /* flags, sizes and the server's searches */
+      case MUTT_ALL:
+      case MUTT_DELETED:
+      case MUTT_EXPIRED:
+      case MUTT_FLAG:
+      case MUTT_NEW:
+      case MUTT_OLD:
+      case MUTT_READ:
+      case MUTT_REPLIED:
+      case MUTT_SUPERSEDED:
+      case MUTT_TAG:
+      case MUTT_UNREAD:
+      case MUTT_COLLAPSED:
+      case MUTT_DATE_RECEIVED:
+      case MUTT_MESSAGE:
+      case MUTT_SIZE:
+      case MUTT_SCORE:
+      case MUTT_BODY:
+      case MUTT_HEADER:
+      case MUTT_WHOLE_MSG:
+      case MUTT_SERVERSEARCH:
+      case MUTT_DRIVER_TAGS:
+        continue;
+
+      case MUTT_SUBJECT:
+        field = "SUBJECT";
+        break;
+      case MUTT_FROM:
+        field = "FROM";
+        break;
+      case MUTT_DATE:
+        field = "DATE";
+        break;
+      case MUTT_TO:
+        field = "TO";
+        break;
+      case MUTT_CC:
+        field = "CC";
+        break;
+      case MUTT_ID:
+        field = "MESSAGE-ID";
+        break;
+      case MUTT_XLABEL:
+        field = "X-LABEL";
+        break;
+    }
+
+    /* anything else may look at several fields */
+    if (imap_headers_missing(ctx, field))
+      return true;
+  }
+
+  return false;
+}
+#endif
+
+/**
+ * pattern_reads_message - Does a pattern read the messages from the mailbox?
+ * @param pat Pattern
+ * @retval true The full header or the body is matched
+ */
+static bool pattern_reads_message(const struct Pattern *pat)
+{
+  for (; pat; pat = pat->next)
+  {
+    switch (pat->op)
+    {
+      case MUTT_HEADER:
+      case MUTT_BODY:
+      case MUTT_WHOLE_MSG:
+      case MUTT_MIMEATTACH:
+        return true;
+      default:
+        if (pattern_reads_message(pat->child))
+          return true;
+    }
+  }
+  return false;
+}
+
+#ifdef HAVE_PTHREAD_CREATE
+/* Messages the reader threads may get ahead of the matching */
+#define PATTERN_READ_AHEAD 64
+
+/**
+ * struct PatternRead - A message to be read ahead of the matching
+ */
+struct PatternRead
+{
+  char *path;    /**< File of the message, NULL for the mailbox itself */
+  LOFF_T offset; /**< Start of the message */
+  LOFF_T length; /**< Length of the message, 0 to skip it */
+};
+
+/**
+ * struct PatternReadAhead - Threads reading messages ahead of the matching
+ */
+struct PatternReadAhead
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;       /**< Signalled when a message is matched */
+  struct PatternRead *reads; /**< Messages, in the order they're matched */
+  size_t count;              /**< Number of messages */
+  size_t next;               /**< Next message for a reader thread */
+  size_t matched;            /**< Messages matched so far */
+  int fd;                    /**< Mailbox file, for mbox and mmdf */
+  struct WorkerGroup group;  /**< Jobs reading the messages */
+  int nthreads;
+};
+
+/**
+ * pattern_read_thread - Read messages into the page cache
+ * @param arg Read-ahead threads
+ * @retval NULL Always
+ *
+ * The matching uses global state, so it stays in the main thread.  Here, the
+ * messages are only read, so the main thread finds them in the page cache.
+ */
+static void *pattern_read_thread(void *arg)
+{
+  struct PatternReadAhead *ra = arg;
+  char buf[65536];
+
+  pthread_mutex_lock(&ra->lock);
+  while (ra->next < ra->count)
+  {
+    if (ra->next >= ra->matched + PATTERN_READ_AHEAD)
+    {
+      pthread_cond_wait(&ra->cond, &ra->lock);
+      continue;
+    }
+    struct PatternRead *r = &ra->reads[ra->next++];
+    pthread_mutex_unlock(&ra->lock);
+
+    int fd = r->path ? open(r->path, O_RDONLY) : ra->fd;
+    if ((fd >= 0) && (r->length > 0))
+    {
+      for (LOFF_T pos = 0; pos < r->length;)
+      {
+        ssize_t n = pread(fd, buf, MIN(r->length - pos, (LOFF_T) sizeof(buf)),
+                          r->offset + pos);
+        if (n <= 0)
+          break;
+        pos += n;
+      }
+    }
+    if (r->path && (fd >= 0))
+      close(fd);
+
+    pthread_mutex_lock(&ra->lock);
+  }
+  pthread_mutex_unlock(&ra->lock);
+
+  return NULL;
+}
+
+/**
+ * pattern_read_ahead_start - Start reading messages ahead of the matching
+ * @param ra    Read-ahead threads
+ * @param ctx   Mailbox
+ * @param pat   Pattern
+ * @param order Messages (index into ctx->hdrs), NULL for all of them
+ * @param count Number of messages
+ * @param first Position in order of the first message to be matched
+ * @param incr  1 to match forwards through order, -1 backwards
+ *
+ * Only local mailboxes are read ahead, and only if the pattern needs the
+ * messages themselves.  Call pattern_read_ahead_step() as each message is
+ * matched, and finish with pattern_read_ahead_stop().
+ */
+static void pattern_read_ahead_start(struct PatternReadAhead *ra, struct Context *ctx,
+                                     const struct Pattern *pat, const int *order,
+                                     int count, int first, int incr)
+{
+  char path[_POSIX_PATH_MAX];
+
+  memset(ra, 0, sizeof(*ra));
+  ra->fd = -1;
+
+  if ((SearchReadThreads < 2) || (count < 2) || !pattern_reads_message(pat))
+    return;
+
+  bool folder = (ctx->magic == MUTT_MAILDIR) || (ctx->magic == MUTT_MH);
+  if (!folder && (ctx->magic != MUTT_MBOX) && (ctx->magic != MUTT_MMDF))
+    return;
+
+  if (!folder && ((ra->fd = open(ctx->path, O_RDONLY)) < 0))
+    return;
+
+  ra->reads = mutt_mem_calloc(count, sizeof(struct PatternRead));
+  ra->count = count;
+  for (int i = 0, j = first; i < count; i++, j = (j + incr + count) % count)
+  {
+    struct Header *h = ctx->hdrs[order ? order[j] : j];
+
+    ra->reads[i].offset = h->offset;
+    ra->reads[i].length = h->content->offset + h->content->length - h->offset;
+    if (folder)
+    {
+      snprintf(path, sizeof(path), "%s/%s", ctx->path, h->path);
+      ra->reads[i].path = mutt_str_strdup(path);
+    }
+  }
+
+  pthread_mutex_init(&ra->lock, NULL);
+  pthread_cond_init(&ra->cond, NULL);
+
+  ra->nthreads = mutt_worker_group_start(&ra->group, SearchReadThreads, pattern_read_thread, ra);
+  mutt_debug(2, "reading %d messages ahead with %d threads\n", count, ra->nthreads);
+}
+
+/**
+ * pattern_read_ahead_step - Let the reader threads move on
+ * @param ra      Read-ahead threads
+ * @param matched Number of messages matched so far
+ */
+static void pattern_read_ahead_step(struct PatternReadAhead *ra, size_t matched)
+{
+  if (!ra->nthreads)
+    return;
+
+  pthread_mutex_lock(&ra->lock);
+  ra->matched = matched;
+  pthread_cond_broadcast(&ra->cond);
+  pthread_mutex_unlock(&ra->lock);
+}
+
+/**
+ * pattern_read_ahead_stop - Stop the reader threads
+ * @param ra Read-ahead threads
+ */
+static void pattern_read_ahead_stop(struct PatternReadAhead *ra)
+{
+  if (ra->nthreads)
+  {
+    pthread_mutex_lock(&ra->lock);
+    ra->next = ra->count;
+    pthread_cond_broadcast(&ra->cond);
+    pthread_mutex_unlock(&ra->lock);
+
+    mutt_worker_group_wait(&ra->group);
+  }
+  if (ra->reads)
+  {
+    pthread_cond_destroy(&ra->cond);
+    pthread_mutex_destroy(&ra->lock);
+    for (size_t i = 0; i < ra->count; i++)
+      FREE(&ra->reads[i].path);
+    FREE(&ra->reads);
+  }
+  if (ra->fd >= 0)
+    close(ra->fd);
+  ra->nthreads = 0;
+}
+#endif
+
 int mutt_pattern_func(int op, char *prompt)
 {
-  struct Pattern *pat = NULL;
-  char buf[LONG_STRING] = "", *simple = NULL;
-  struct Buffer err;
-  int rc = -1;
-  struct Progress progress;
+  char buf[LONG_STRING] = "";
 
   mutt_str_strfcpy(buf, NONULL(Context->pattern), sizeof(buf));
   if (prompt || op != MUTT_LIMIT)
     if (mutt_get_field(prompt, buf, sizeof(buf), MUTT_PATTERN | MUTT_CLEAR) != 0 || !buf[0])
       return -1;
 
+  return mutt_pattern_apply(op, buf);
+}
+
+/**
+ * mutt_pattern_apply - Limit, tag or delete the messages matching a pattern
+ * @param op      Operation, e.g. #MUTT_LIMIT, #MUTT_TAG
+ * @param pattern Pattern, which may be a simple search
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * Tagging and deleting only affect the visible messages of #Context.
+ */
+int mutt_pattern_apply(int op, const char *pattern)
+{
+  struct Pattern *pat = NULL;
+  char buf[LONG_STRING], *simple = NULL;
+  struct Buffer err;
+  int rc = -1;
+  struct Progress progress;
+  struct PerfTimer perf;
+  unsigned char *filter = NULL;
+  bool exact = false;
+
+  mutt_str_strfcpy(buf, pattern, sizeof(buf));
+  mutt_perf_start(&perf, PERF_LIMIT);
   mutt_message(_("Compiling search pattern..."));
 
   simple = mutt_str_strdup(buf);
@@ -1916,7 +3084,11 @@ int mutt_pattern_func(int op, char *prompt)
   }
 
 #ifdef USE_IMAP
-  if (Context->magic == MUTT_IMAP && imap_search(Context, pat) < 0)
+  /* the pattern must see every message, not just the ones read so far */
+  if (Context->magic == MUTT_IMAP &&
+      ((imap_window_grow(Context, true) < 0) ||
+       (pattern_needs_headers(Context, pat) && (imap_headers_upgrade(Context, true) < 0)) ||
+       (imap_search(Context, pat) < 0)))
     goto bail;
 #endif
 
@@ -1924,6 +3096,17 @@ int mutt_pattern_func(int op, char *prompt)
                      MUTT_PROGRESS_MSG, ReadInc,
                      (op == MUTT_LIMIT) ? Context->msgcount : Context->vcount);
 
+  filter = mutt_pattern_prefilter(Context, pat, &exact);
+  pattern_thread_cache_start(pat, Context, (op != MUTT_LIMIT));
+
+#ifdef HAVE_PTHREAD_CREATE
+  struct PatternReadAhead ra;
+  if (op == MUTT_LIMIT)
+    pattern_read_ahead_start(&ra, Context, pat, NULL, Context->msgcount, 0, 1);
+  else
+    pattern_read_ahead_start(&ra, Context, pat, Context->v2r, Context->vcount, 0, 1);
+#endif
+
   if (op == MUTT_LIMIT)
   {
     Context->vcount = 0;
@@ -1933,12 +3116,18 @@ int mutt_pattern_func(int op, char *prompt)
     for (int i = 0; i < Context->msgcount; i++)
     {
       mutt_progress_update(&progress, i, -1);
+#ifdef HAVE_PTHREAD_CREATE
+      pattern_read_ahead_step(&ra, i);
+#endif
       /* new limit pattern implicitly uncollapses all threads */
       Context->hdrs[i]->virtual = -1;
       Context->hdrs[i]->limited = false;
       Context->hdrs[i]->collapsed = false;
       Context->hdrs[i]->num_hidden = 0;
-      if (mutt_pattern_exec(pat, MUTT_MATCH_FULL_ADDRESS, Context, Context->hdrs[i], NULL))
+      /* pat is about to become the limit pattern */
+      Context->hdrs[i]->limit_valid = true;
+      Context->hdrs[i]->limit_flags = limit_flags(Context->hdrs[i]);
+      if (pattern_exec_filtered(pat, Context, i, filter, exact))
       {
         Context->hdrs[i]->virtual = Context->vcount;
         Context->hdrs[i]->limited = true;
@@ -1954,8 +3143,10 @@ int mutt_pattern_func(int op, char *prompt)
     for (int i = 0; i < Context->vcount; i++)
     {
       mutt_progress_update(&progress, i, -1);
-      if (mutt_pattern_exec(pat, MUTT_MATCH_FULL_ADDRESS, Context,
-                            Context->hdrs[Context->v2r[i]], NULL))
+#ifdef HAVE_PTHREAD_CREATE
+      pattern_read_ahead_step(&ra, i);
+#endif
+      if (pattern_exec_filtered(pat, Context, Context->v2r[i], filter, exact))
       {
         switch (op)
         {
@@ -1976,6 +3167,10 @@ int mutt_pattern_func(int op, char *prompt)
     }
   }
 
+#ifdef HAVE_PTHREAD_CREATE
+  pattern_read_ahead_stop(&ra);
+#endif
+
   mutt_clear_error();
 
   if (op == MUTT_LIMIT)
@@ -1994,12 +3189,15 @@ int mutt_pattern_func(int op, char *prompt)
       Context->pattern = simple;
       simple = NULL; /* don't clobber it */
       Context->limit_pattern = mutt_pattern_comp(buf, MUTT_FULL_MSG, &err);
+      Context->limit_deps = mutt_pattern_deps(Context->limit_pattern);
     }
   }
 
+  mutt_perf_stop(&perf);
   rc = 0;
 
 bail:
+  FREE(&filter);
   FREE(&simple);
   mutt_pattern_free(&pat);
   FREE(&err.data);
@@ -2014,7 +3212,9 @@ int mutt_search_command(int cur, int op)
   int incr;
   struct Header *h = NULL;
   struct Progress progress;
+  struct PerfTimer perf;
   const char *msg = NULL;
+  int rc = -1;
 
   if (!*LastSearch || (op != OP_SEARCH_NEXT && op != OP_SEARCH_OPPOSITE))
   {
@@ -2059,8 +3259,23 @@ int mutt_search_command(int cur, int op)
     }
   }
 
+  mutt_perf_start(&perf, PERF_SEARCH);
   if (OPT_SEARCH_INVALID)
   {
+#ifdef USE_IMAP
+    if (Context->magic == MUTT_IMAP)
+    {
+      /* read any headers left out by $imap_fetch_window, keeping our place */
+      h = ((cur >= 0) && (cur < Context->vcount)) ? Context->hdrs[Context->v2r[cur]] : NULL;
+      if (imap_window_grow(Context, true) < 0)
+        return -1;
+      if (pattern_needs_headers(Context, SearchPattern) &&
+          (imap_headers_upgrade(Context, true) < 0))
+        return -1;
+      if (h && (h->virtual >= 0))
+        cur = h->virtual;
+    }
+#endif
     for (int i = 0; i < Context->msgcount; i++)
       Context->hdrs[i]->searched = false;
 #ifdef USE_IMAP
@@ -2077,9 +3292,21 @@ int mutt_search_command(int cur, int op)
   mutt_progress_init(&progress, _("Searching..."), MUTT_PROGRESS_MSG, ReadInc,
                      Context->vcount);
 
+  pattern_thread_cache_start(SearchPattern, Context, false);
+
+#ifdef HAVE_PTHREAD_CREATE
+  struct PatternReadAhead ra;
+  pattern_read_ahead_start(&ra, Context, SearchPattern, Context->v2r, Context->vcount,
+                           Context->vcount ? (cur + incr + Context->vcount) % Context->vcount : 0,
+                           incr);
+#endif
+
   for (int i = cur + incr, j = 0; j != Context->vcount; j++)
   {
     mutt_progress_update(&progress, j, -1);
+#ifdef HAVE_PTHREAD_CREATE
+    pattern_read_ahead_step(&ra, j);
+#endif
     if (i > Context->vcount - 1)
     {
       i = 0;
@@ -2088,7 +3315,7 @@ int mutt_search_command(int cur, int op)
       else
       {
         mutt_message(_("Search hit bottom without finding match"));
-        return -1;
+        goto done;
       }
     }
     else if (i < 0)
@@ -2099,7 +3326,7 @@ int mutt_search_command(int cur, int op)
       else
       {
         mutt_message(_("Search hit top without finding match"));
-        return -1;
+        goto done;
       }
     }
 
@@ -2112,7 +3339,8 @@ int mutt_search_command(int cur, int op)
         mutt_clear_error();
         if (msg && *msg)
           mutt_message(msg);
-        return i;
+        rc = i;
+        goto done;
       }
     }
     else
@@ -2126,7 +3354,8 @@ int mutt_search_command(int cur, int op)
         mutt_clear_error();
         if (msg && *msg)
           mutt_message(msg);
-        return i;
+        rc = i;
+        goto done;
       }
     }
 
@@ -2134,12 +3363,189 @@ int mutt_search_command(int cur, int op)
     {
       mutt_error(_("Search interrupted."));
       SigInt = 0;
-      return -1;
+      goto done;
     }
 
     i += incr;
   }
 
   mutt_error(_("Not found."));
-  return -1;
+
+done:
+#ifdef HAVE_PTHREAD_CREATE
+  pattern_read_ahead_stop(&ra);
+#endif
+  pattern_thread_cache_stop(SearchPattern);
+  mutt_perf_stop(&perf);
+  return rc;
+}
+
+/**
+ * pattern_explain_tree - Write the profile of each part of a pattern
+ * @param fp    File to write to
+ * @param pat   Pattern, compiled with #MUTT_PATTERN_STATS
+ * @param depth Nesting of the pattern
+ */
+static void pattern_explain_tree(FILE *fp, const struct Pattern *pat, int depth)
+{
+  char label[STRING];
+  char size[SHORT_STRING];
+
+  for (; pat; pat = pat->next)
+  {
+    const struct PatternStats *st = pat->stats;
+    const char *what = NULL;
+
+    switch (pat->op)
+    {
+      case MUTT_AND:
+        what = "and";
+        break;
+      case MUTT_OR:
+        what = "or";
+        break;
+      case MUTT_THREAD:
+        what = "~(...)";
+        break;
+      case MUTT_PARENT:
+        what = "~<(...)";
+        break;
+      case MUTT_CHILDREN:
+        what = "~>(...)";
+        break;
+      default:
+        what = NONULL(st->source);
+        break;
+    }
+
+    snprintf(label, sizeof(label), "%*s%s%s%s%s", 2 * depth, "",
+             pat->not ? "!" : "", pat->alladdr ? "^" : "", pat->isalias ? "@" : "", what);
+    if (st->bytes)
+      mutt_str_pretty_size(size, sizeof(size), st->bytes);
+    else
+      mutt_str_strfcpy(size, "-", sizeof(size));
+
+    fprintf(fp, "%-40s %8ld %8ld %8ld %9.3f %7s\n", label, st->evals,
+            st->matches, st->indexed, st->secs, size);
+    pattern_explain_tree(fp, pat->child, depth + 1);
+  }
+}
+
+/**
+ * mutt_parse_pattern_explain - 'pattern-explain' command: Profile a limit
+ * @param buf  Temporary Buffer space
+ * @param s    Buffer containing string to be parsed
+ * @param data Flags associated with the command
+ * @param err  Buffer for error messages
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * The pattern is matched against every message, as <limit> would, but the
+ * view is left alone.  The pager shows, for each part of the pattern, how
+ * many messages it was tested against and matched, how many the search index
+ * ruled out, the time taken and the text read.
+ */
+int mutt_parse_pattern_explain(struct Buffer *buf, struct Buffer *s,
+                               unsigned long data, struct Buffer *err)
+{
+  char expn[LONG_STRING];
+  char tempfile[_POSIX_PATH_MAX];
+  struct Pattern *pat = NULL;
+  struct Progress progress;
+  struct timeval start, end;
+  unsigned char *filter = NULL;
+  bool exact = false;
+  int matched = 0, ruled_out = 0;
+  int rc = -1;
+  FILE *fp = NULL;
+
+  if (!Context)
+  {
+    mutt_buffer_addstr(err, _("No mailbox is open."));
+    return -1;
+  }
+
+  /* the rest of the line is the pattern, as typed at the <limit> prompt */
+  SKIPWS(s->dptr);
+  if (!*s->dptr)
+  {
+    mutt_buffer_addstr(err, _("too few arguments"));
+    return -1;
+  }
+  mutt_str_strfcpy(expn, s->dptr, sizeof(expn));
+  s->dptr += mutt_str_strlen(s->dptr);
+
+  mutt_check_simple(expn, sizeof(expn), NONULL(SimpleSearch));
+  pat = mutt_pattern_comp(expn, MUTT_FULL_MSG | MUTT_PATTERN_STATS, err);
+  if (!pat)
+    return -1;
+
+#ifdef USE_IMAP
+  if (Context->magic == MUTT_IMAP &&
+      ((imap_window_grow(Context, true) < 0) ||
+       (pattern_needs_headers(Context, pat) && (imap_headers_upgrade(Context, true) < 0)) ||
+       (imap_search(Context, pat) < 0)))
+    goto bail;
+#endif
+
+  mutt_progress_init(&progress, _("Profiling the pattern..."), MUTT_PROGRESS_MSG,
+                     ReadInc, Context->msgcount);
+
+  gettimeofday(&start, NULL);
+  filter = mutt_pattern_prefilter(Context, pat, &exact);
+  pattern_thread_cache_start(pat, Context, false);
+
+#ifdef HAVE_PTHREAD_CREATE
+  struct PatternReadAhead ra;
+  pattern_read_ahead_start(&ra, Context, pat, NULL, Context->msgcount, 0, 1);
+#endif
+
+  for (int i = 0; i < Context->msgcount; i++)
+  {
+    mutt_progress_update(&progress, i, -1);
+#ifdef HAVE_PTHREAD_CREATE
+    pattern_read_ahead_step(&ra, i);
+#endif
+    if (filter && !filter[i])
+      ruled_out++;
+    if (pattern_exec_filtered(pat, Context, i, filter, exact) > 0)
+      matched++;
+  }
+
+#ifdef HAVE_PTHREAD_CREATE
+  pattern_read_ahead_stop(&ra);
+#endif
+  pattern_thread_cache_stop(pat);
+  gettimeofday(&end, NULL);
+  mutt_clear_error();
+
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  fp = mutt_file_fopen(tempfile, "w");
+  if (!fp)
+  {
+    mutt_perror(tempfile);
+    goto bail;
+  }
+
+  fprintf(fp, _("Pattern: %s\n"), expn);
+  fprintf(fp, _("%d of %d messages matched in %.3f seconds\n"), matched,
+          Context->msgcount,
+          (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6);
+  if (filter && exact)
+    fputs(_("Decided by scanning the message columns, without testing messages\n"), fp);
+  else if (filter)
+    fprintf(fp, _("%d messages ruled out by scanning the message columns\n"), ruled_out);
+  fputc('\n', fp);
+  fprintf(fp, "%-40s %8s %8s %8s %9s %7s\n", _("Pattern"), _("Tested"),
+          _("Matched"), _("Indexed"), _("Seconds"), _("Read"));
+  pattern_explain_tree(fp, pat, 0);
+  mutt_file_fclose(&fp);
+
+  mutt_do_pager(_("Pattern profile"), tempfile, MUTT_PAGER_NOWRAP, NULL);
+  rc = 0;
+
+bail:
+  FREE(&filter);
+  mutt_pattern_free(&pat);
+  return rc;
 }
@@ -32,6 +32,19 @@ struct Address;
 struct Header;
 struct Context;
 
+/**
+ * struct PatternStats - How often a part of a pattern was matched, and the cost
+ */
+struct PatternStats
+{
+  char *source;  /**< Text of a simple pattern, e.g. "~b foo" */
+  long evals;    /**< Number of messages it was matched against */
+  long matches;  /**< Number of those it matched */
+  long indexed;  /**< Number ruled out by the search index, without reading */
+  double secs;   /**< Time taken, including the arguments */
+  size_t bytes;  /**< Message text read or decoded to match it */
+};
+
 /**
  * struct Pattern - A simple (non-regex) pattern
  */
@@ -42,8 +55,9 @@ struct Pattern
   bool alladdr : 1;
   bool stringmatch : 1;
   bool groupmatch : 1;
-  bool ign_case : 1; /**< ignore case for local stringmatch searches */
+  bool ign_case : 1; /**< ignore case for local stringmatch searches, and the literal */
   bool isalias : 1;
+  bool literal_only : 1; /**< the regex matches only its literal */
   int min;
   int max;
   struct Pattern *next;
@@ -53,6 +67,10 @@ struct Pattern
     struct Group *g;
     char *str;
   } p;
+  char *literal;             /**< Text every match of the regex contains */
+  struct Hash *imap_matches; /**< UIDs matched by an IMAP SEARCH of this subtree */
+  unsigned char *thread_cache; /**< Verdicts of the argument of ~(), ~<() or ~>(), one per message */
+  struct PatternStats *stats;  /**< Profile, if compiled with #MUTT_PATTERN_STATS */
 };
 
 /**
@@ -63,6 +81,11 @@ enum PatternExecFlag
   MUTT_MATCH_FULL_ADDRESS = 1
 };
 
+/* What the verdict of a pattern depends on, besides the message's contents */
+#define MUTT_PAT_DEP_FLAGS  (1 << 0) /**< The flags of the message, e.g. ~N */
+#define MUTT_PAT_DEP_THREAD (1 << 1) /**< The other messages in the thread, e.g. ~( */
+#define MUTT_PAT_DEP_OTHER  (1 << 2) /**< Anything else that can change, e.g. ~n */
+
 /**
  * struct PatternCache - Cache commonly-used patterns
  *
@@ -98,8 +121,12 @@ int mutt_which_case(const char *s);
 int mutt_is_list_recipient(int alladdr, struct Address *a1, struct Address *a2);
 int mutt_is_list_cc(int alladdr, struct Address *a1, struct Address *a2);
 int mutt_pattern_func(int op, char *prompt);
+int mutt_pattern_apply(int op, const char *pattern);
 int mutt_search_command(int cur, int op);
 
 bool mutt_limit_current_thread(struct Header *h);
+bool mutt_limit_match(struct Context *ctx, struct Header *h);
+int mutt_pattern_deps(const struct Pattern *pat);
+unsigned char *mutt_pattern_prefilter(struct Context *ctx, struct Pattern *pat, bool *exact);
 
 #endif /* _MUTT_PATTERN_H */
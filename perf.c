@@ -0,0 +1,551 @@
+/**
+ * @file
+ * Time the operations users wait for
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page perf Time the operations users wait for
+ *
+ * When somebody reports that NeoMutt is slow, the first question is which part
+ * of it.  The operations a user waits for, e.g. opening a mailbox, sorting it
+ * or checking for new mail, are timed as they happen.  The `perf` command
+ * shows the totals in the pager, and they're written to $debug_file on exit.
+ *
+ * Each counter keeps the number of times, the total and the longest time, and
+ * a histogram from which the percentiles are estimated.  A histogram bucket
+ * covers an eighth of a power of two, so the estimates are within 12.5%.
+ *
+ * Most operations are timed with a PerfTimer on the stack.  Those that end
+ * somewhere else, e.g. drawing the index of a mailbox that has just been
+ * opened, are armed at the start and fired at the end.
+ *
+ * With `neomutt -T file`, the timed operations, and a few other busy
+ * functions marked with mutt_trace_begin() and mutt_trace_end(), are also
+ * written to a trace in Chrome's JSON format, which chrome://tracing and
+ * Perfetto show on a timeline.  The events are collected in a buffer, which is
+ * written out when it's full (as a "trace flush" event) and on exit.  Only
+ * the main thread may be traced.
+ *
+ * The report ends with the traffic of each open connection: bytes, round
+ * trips, the time spent waiting for the server, and how long each kind of
+ * command took to complete.  Waiting that dominates the open time points at
+ * the server or the network, rather than at NeoMutt.
+ *
+ * Last comes the memory held by the subsystems that use the tagged
+ * allocators, e.g. headers and hash tables, now and at its peak.
+ *
+ * | Function           | Description
+ * | :----------------- | :----------------------------------------
+ * | mutt_parse_perf()  | 'perf' command: Show the timings
+ * | mutt_perf_arm()    | Start timing an operation that ends elsewhere
+ * | mutt_perf_dump()   | Write the timings to the debug file
+ * | mutt_perf_fire()   | Finish timing an armed operation
+ * | mutt_perf_report() | Write a table of the timings
+ * | mutt_perf_reset()  | Forget all the timings
+ * | mutt_perf_start()  | Start timing an operation
+ * | mutt_perf_stop()   | Finish timing an operation
+ * | mutt_trace_close() | Finish the trace
+ * | mutt_trace_event() | Add an event to the trace
+ * | mutt_trace_open()  | Start tracing to a file
+ */
+
+#include "config.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "mutt/mutt.h"
+#include "conn/conn.h"
+#include "mutt.h"
+#include "perf.h"
+#include "mutt_socket.h"
+#include "pager.h"
+#include "protos.h"
+
+/* Buckets of the histogram: 8 for each power of two, up to several hours */
+#define PERF_SUB_BITS 3
+#define PERF_BUCKETS (33 << PERF_SUB_BITS)
+
+/**
+ * struct PerfStats - Timings of one operation
+ */
+struct PerfStats
+{
+  unsigned long count;               /**< Number of times it was timed */
+  unsigned long long total;          /**< Total time, in microseconds */
+  unsigned long max;                 /**< Longest time, in microseconds */
+  unsigned int hist[PERF_BUCKETS];   /**< Histogram of the times */
+};
+
+/* Events buffered before the trace is written out */
+#define TRACE_EVENTS 4096
+
+/**
+ * struct TraceEvent - One event of the trace
+ */
+struct TraceEvent
+{
+  const char *name; /**< What happened, a static string */
+  long ts;          /**< When, in microseconds since the trace started */
+  char phase;       /**< 'B'egin, 'E'nd or 'i'nstant */
+};
+
+static struct PerfStats Stats[PERF_MAX];
+static struct timeval Armed[PERF_MAX]; /**< Start of armed operations */
+
+bool TraceActive = false;                   /**< Is a trace being written? */
+static FILE *TraceFp = NULL;               /**< Trace file */
+static struct TraceEvent *TraceBuf = NULL; /**< Events not yet written */
+static size_t TraceUsed = 0;               /**< Number of events in TraceBuf */
+static unsigned long TraceWritten = 0;     /**< Number of events written */
+static struct timeval TraceStart;          /**< When the trace started */
+
+/* Indented operations are timed within the one above */
+static const char *const PerfNames[PERF_MAX] = {
+  N_("mailbox open"), N_("  connect"),    N_("  fetch headers"),
+  N_("  hcache restore"), N_("  parse"),  N_("open to first draw"),
+  N_("sort"),         N_("  thread"),     N_("mailbox sync"),
+  N_("mail check"),   N_("pager open"),   N_("search"),
+  N_("limit"),        N_("startup"),      N_("  curses"),
+  N_("  config"),     N_("crypto init"),
+};
+
+/* Names of the subsystems, in the order of enum MemTag */
+static const char *const MemTagNames[MEM_TAG_MAX] = {
+  N_("headers"),      N_("envelopes"),  N_("MIME parts"),
+  N_("hash tables"),  N_("header cache"), N_("pager"),
+  N_("body cache"),   N_("IMAP buffers"),
+};
+
+/**
+ * perf_name - Get the name of a counter for the trace
+ * @param counter Operation
+ * @retval ptr Name, without the indentation
+ */
+static const char *perf_name(enum PerfCounter counter)
+{
+  const char *name = PerfNames[counter];
+  return name + strspn(name, " ");
+}
+
+/**
+ * trace_flush - Write the buffered events to the trace file
+ */
+static void trace_flush(void)
+{
+  for (size_t i = 0; i < TraceUsed; i++, TraceWritten++)
+  {
+    const struct TraceEvent *e = &TraceBuf[i];
+    fprintf(TraceFp, "%s{\"name\":\"%s\",\"cat\":\"neomutt\",\"ph\":\"%c\",\"ts\":%ld,\"pid\":%d,\"tid\":1%s}\n",
+            TraceWritten ? "," : "", e->name, e->phase, e->ts, (int) getpid(),
+            (e->phase == 'i') ? ",\"s\":\"t\"" : "");
+  }
+  TraceUsed = 0;
+}
+
+/**
+ * trace_add - Add an event to the trace
+ * @param name  What happened, a static string
+ * @param phase 'B'egin, 'E'nd or 'i'nstant
+ * @param when  When it happened
+ */
+static void trace_add(const char *name, char phase, const struct timeval *when)
+{
+  if (TraceUsed == TRACE_EVENTS)
+  {
+    /* writing the trace out takes time too, so show it */
+    struct timeval start, end;
+    gettimeofday(&start, NULL);
+    trace_flush();
+    gettimeofday(&end, NULL);
+    trace_add("trace flush", 'B', &start);
+    trace_add("trace flush", 'E', &end);
+  }
+
+  struct TraceEvent *e = &TraceBuf[TraceUsed++];
+  e->name = name;
+  e->phase = phase;
+  e->ts = (when->tv_sec - TraceStart.tv_sec) * 1000000L + (when->tv_usec - TraceStart.tv_usec);
+}
+
+/**
+ * bucket_of - Find the histogram bucket of a time
+ * @param usec Time, in microseconds
+ * @retval num Bucket
+ */
+static int bucket_of(unsigned long usec)
+{
+  if (usec < (1UL << PERF_SUB_BITS))
+    return usec;
+
+  int bits = 0;
+  while ((usec >> bits) >= (2UL << PERF_SUB_BITS))
+    bits++;
+
+  int b = ((bits + 1) << PERF_SUB_BITS) + (usec >> bits) - (1 << PERF_SUB_BITS);
+  return (b < PERF_BUCKETS) ? b : PERF_BUCKETS - 1;
+}
+
+/**
+ * bucket_top - Find the longest time in a histogram bucket
+ * @param b Bucket
+ * @retval num Time, in microseconds
+ */
+static unsigned long bucket_top(int b)
+{
+  if (b < (1 << PERF_SUB_BITS))
+    return b;
+
+  int bits = (b >> PERF_SUB_BITS) - 1;
+  unsigned long base = (1UL << PERF_SUB_BITS) + (b & ((1 << PERF_SUB_BITS) - 1));
+  return ((base + 1) << bits) - 1;
+}
+
+/**
+ * perf_add - Add a time to a counter
+ * @param counter Operation
+ * @param start   When it started
+ * @param end     When it finished
+ * @retval num Time it took, in microseconds
+ */
+static long perf_add(enum PerfCounter counter, const struct timeval *start,
+                     const struct timeval *end)
+{
+  long usec = (end->tv_sec - start->tv_sec) * 1000000L + (end->tv_usec - start->tv_usec);
+  if (usec < 0) /* the clock was set back */
+    usec = 0;
+
+  struct PerfStats *ps = &Stats[counter];
+  ps->count++;
+  ps->total += usec;
+  if ((unsigned long) usec > ps->max)
+    ps->max = usec;
+  ps->hist[bucket_of(usec)]++;
+  return usec;
+}
+
+/**
+ * percentile - Estimate a percentile of the times
+ * @param ps  Timings
+ * @param pct Percentile, 1-100
+ * @retval num Time, in microseconds
+ */
+static unsigned long percentile(const struct PerfStats *ps, int pct)
+{
+  unsigned long rank = (ps->count * pct + 99) / 100;
+  unsigned long seen = 0;
+
+  for (int b = 0; b < PERF_BUCKETS; b++)
+  {
+    seen += ps->hist[b];
+    if (seen >= rank)
+    {
+      unsigned long top = bucket_top(b);
+      return (top < ps->max) ? top : ps->max;
+    }
+  }
+  return ps->max;
+}
+
+/**
+ * format_usecs - Format a time for people
+ * @param buf    Buffer for the result
+ * @param buflen Length of buffer
+ * @param usec   Time, in microseconds
+ */
+static void format_usecs(char *buf, size_t buflen, unsigned long long usec)
+{
+  if (usec < 1000)
+    snprintf(buf, buflen, "%lluus", usec);
+  else if (usec < 1000000)
+    snprintf(buf, buflen, "%.1fms", usec / 1e3);
+  else
+    snprintf(buf, buflen, "%.2fs", usec / 1e6);
+}
+
+/**
+ * mutt_perf_start - Start timing an operation
+ * @param t       Timer
+ * @param counter Operation
+ */
+void mutt_perf_start(struct PerfTimer *t, enum PerfCounter counter)
+{
+  t->counter = counter;
+  gettimeofday(&t->start, NULL);
+  if (TraceActive)
+    trace_add(perf_name(counter), 'B', &t->start);
+}
+
+/**
+ * mutt_perf_stop - Finish timing an operation
+ * @param t Timer
+ * @retval num Time it took, in microseconds
+ */
+long mutt_perf_stop(struct PerfTimer *t)
+{
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  if (TraceActive)
+    trace_add(perf_name(t->counter), 'E', &end);
+  return perf_add(t->counter, &t->start, &end);
+}
+
+/**
+ * mutt_perf_arm - Start timing an operation that ends elsewhere
+ * @param counter Operation
+ *
+ * If it's already armed, the clock starts again.
+ */
+void mutt_perf_arm(enum PerfCounter counter)
+{
+  gettimeofday(&Armed[counter], NULL);
+}
+
+/**
+ * mutt_perf_fire - Finish timing an armed operation
+ * @param counter Operation
+ *
+ * If it isn't armed, nothing happens.
+ */
+void mutt_perf_fire(enum PerfCounter counter)
+{
+  if (Armed[counter].tv_sec == 0)
+    return;
+
+  struct timeval end;
+  gettimeofday(&end, NULL);
+  if (TraceActive)
+    trace_add(perf_name(counter), 'i', &end);
+  perf_add(counter, &Armed[counter], &end);
+  memset(&Armed[counter], 0, sizeof(Armed[counter]));
+}
+
+/**
+ * mutt_perf_reset - Forget all the timings
+ */
+void mutt_perf_reset(void)
+{
+  struct Connection *conn = NULL;
+
+  memset(Stats, 0, sizeof(Stats));
+  TAILQ_FOREACH(conn, mutt_socket_head(), entries)
+  {
+    memset(&conn->stats, 0, sizeof(conn->stats));
+  }
+}
+
+/**
+ * perf_report_conn - Write the traffic of a connection
+ * @param fp   File to write to
+ * @param conn Connection to a server
+ */
+static void perf_report_conn(FILE *fp, const struct Connection *conn)
+{
+  const struct ConnStats *st = &conn->stats;
+  char wait[SHORT_STRING], tls[SHORT_STRING];
+  char mean[SHORT_STRING], max[SHORT_STRING];
+
+  format_usecs(wait, sizeof(wait), st->wait_usecs);
+  format_usecs(tls, sizeof(tls), st->handshake_usecs);
+  fprintf(fp, "\n%s:%d\n", conn->account.host, conn->account.port);
+  fprintf(fp, _("  %llu bytes in, %llu bytes out, %lu round trips\n"),
+          st->bytes_in, st->bytes_out, st->round_trips);
+  fprintf(fp, _("  %s waiting for the server, %s in the TLS handshake\n"), wait, tls);
+
+  if (st->commands == 0)
+    return;
+
+  fprintf(fp, "  %-18s %7s %9s %9s\n", _("Command"), _("Count"), _("Mean"), _("Max"));
+  for (int i = 0; (i < CONN_STATS_CMDS) && st->cmds[i].name[0]; i++)
+  {
+    const struct ConnCmdStats *cs = &st->cmds[i];
+    format_usecs(mean, sizeof(mean), cs->usecs / cs->count);
+    format_usecs(max, sizeof(max), cs->max);
+    fprintf(fp, "  %-18s %7lu %9s %9s\n", cs->name, cs->count, mean, max);
+  }
+}
+
+/**
+ * mutt_perf_report - Write a table of the timings
+ * @param fp File to write to
+ *
+ * Operations that haven't happened are left out.
+ */
+void mutt_perf_report(FILE *fp)
+{
+  fprintf(fp, "%-20s %7s %9s %9s %9s %9s %9s %9s\n", _("Operation"), _("Count"),
+          _("Total"), _("Mean"), _("p50"), _("p90"), _("p99"), _("Max"));
+
+  for (int i = 0; i < PERF_MAX; i++)
+  {
+    const struct PerfStats *ps = &Stats[i];
+    char total[SHORT_STRING], mean[SHORT_STRING], max[SHORT_STRING];
+    char p50[SHORT_STRING], p90[SHORT_STRING], p99[SHORT_STRING];
+
+    if (ps->count == 0)
+      continue;
+
+    format_usecs(total, sizeof(total), ps->total);
+    format_usecs(mean, sizeof(mean), ps->total / ps->count);
+    format_usecs(p50, sizeof(p50), percentile(ps, 50));
+    format_usecs(p90, sizeof(p90), percentile(ps, 90));
+    format_usecs(p99, sizeof(p99), percentile(ps, 99));
+    format_usecs(max, sizeof(max), ps->max);
+    fprintf(fp, "%-20s %7lu %9s %9s %9s %9s %9s %9s\n", _(PerfNames[i]),
+            ps->count, total, mean, p50, p90, p99, max);
+  }
+
+  struct Connection *conn = NULL;
+  TAILQ_FOREACH(conn, mutt_socket_head(), entries)
+  {
+    if (conn->fd >= 0)
+      perf_report_conn(fp, conn);
+  }
+
+  fprintf(fp, "\n%-20s %9s %9s %9s\n", _("Memory"), _("Blocks"), _("Current"), _("Peak"));
+  for (int i = 0; i < MEM_TAG_MAX; i++)
+  {
+    const struct MemTagStats *ms = &MemTagStats[i];
+    char current[SHORT_STRING], peak[SHORT_STRING];
+
+    if (ms->peak == 0)
+      continue;
+
+    mutt_str_pretty_size(current, sizeof(current), ms->current);
+    mutt_str_pretty_size(peak, sizeof(peak), ms->peak);
+    fprintf(fp, "%-20s %9ld %9s %9s\n", _(MemTagNames[i]), ms->blocks, current, peak);
+  }
+}
+
+/**
+ * mutt_perf_dump - Write the timings to the debug file
+ */
+void mutt_perf_dump(void)
+{
+  if (!debugfile)
+    return;
+
+  fputs("Timings:\n", debugfile);
+  mutt_perf_report(debugfile);
+}
+
+/**
+ * mutt_trace_event - Add an event to the trace
+ * @param name  What happened, a static string
+ * @param phase 'B'egin, 'E'nd or 'i'nstant
+ *
+ * Use mutt_trace_begin() and mutt_trace_end(), which cost nothing unless
+ * a trace is being written.
+ */
+void mutt_trace_event(const char *name, char phase)
+{
+  struct timeval now;
+
+  if (!TraceActive)
+    return;
+
+  gettimeofday(&now, NULL);
+  trace_add(name, phase, &now);
+}
+
+/**
+ * mutt_trace_open - Start tracing to a file
+ * @param file Trace file
+ * @retval  0 Success
+ * @retval -1 Error, see errno
+ *
+ * The trace is finished when NeoMutt exits.
+ */
+int mutt_trace_open(const char *file)
+{
+  if (TraceActive)
+    return 0;
+
+  TraceFp = mutt_file_fopen(file, "w");
+  if (!TraceFp)
+    return -1;
+
+  TraceBuf = mutt_mem_calloc(TRACE_EVENTS, sizeof(struct TraceEvent));
+  TraceUsed = 0;
+  TraceWritten = 0;
+  gettimeofday(&TraceStart, NULL);
+  fputs("[\n", TraceFp);
+  TraceActive = true;
+  atexit(mutt_trace_close);
+  return 0;
+}
+
+/**
+ * mutt_trace_close - Finish the trace
+ */
+void mutt_trace_close(void)
+{
+  if (!TraceActive)
+    return;
+
+  TraceActive = false;
+  trace_flush();
+  fputs("]\n", TraceFp);
+  mutt_file_fclose(&TraceFp);
+  FREE(&TraceBuf);
+}
+
+/**
+ * mutt_parse_perf - 'perf' command: Show the timings
+ * @param buf  Temporary Buffer space
+ * @param s    Buffer containing string to be parsed
+ * @param data Flags associated with the command
+ * @param err  Buffer for error messages
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * `perf reset` forgets the timings so far, e.g. before repeating a slow
+ * operation.
+ */
+int mutt_parse_perf(struct Buffer *buf, struct Buffer *s, unsigned long data,
+                    struct Buffer *err)
+{
+  char tempfile[_POSIX_PATH_MAX];
+
+  if (MoreArgs(s))
+  {
+    mutt_extract_token(buf, s, 0);
+    if ((mutt_str_strcmp(buf->data, "reset") != 0) || MoreArgs(s))
+    {
+      mutt_buffer_printf(err, _("%s: unknown argument"), "perf");
+      return -1;
+    }
+    mutt_perf_reset();
+    return 0;
+  }
+
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  FILE *fp = mutt_file_fopen(tempfile, "w");
+  if (!fp)
+  {
+    mutt_perror(tempfile);
+    return -1;
+  }
+  mutt_perf_report(fp);
+  mutt_file_fclose(&fp);
+
+  mutt_do_pager(_("Timings"), tempfile, MUTT_PAGER_NOWRAP, NULL);
+  return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file
+ * Time the operations users wait for
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_PERF_H
+#define _MUTT_PERF_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+struct Buffer;
+
+/**
+ * enum PerfCounter - Operations that are timed
+ */
+enum PerfCounter
+{
+  PERF_OPEN = 0,       /**< Opening a mailbox, all of it */
+  PERF_CONNECT,        /**< Connecting to a server */
+  PERF_FETCH_HEADERS,  /**< Fetching the headers from a server */
+  PERF_HCACHE_RESTORE, /**< Restoring one header from the header cache */
+  PERF_PARSE,          /**< Reading the headers of a local mailbox */
+  PERF_FIRST_DRAW,     /**< From opening a mailbox to drawing its index */
+  PERF_SORT,           /**< Sorting a mailbox, including threading it */
+  PERF_THREAD,         /**< Threading a mailbox */
+  PERF_SYNC,           /**< Writing the changes to a mailbox */
+  PERF_BUFFY_CHECK,    /**< Checking the mailboxes for new mail */
+  PERF_PAGER_OPEN,     /**< From asking for a message to drawing it */
+  PERF_SEARCH,         /**< Searching for the next match */
+  PERF_LIMIT,          /**< Limiting, tagging or deleting by pattern */
+  PERF_STARTUP,        /**< From starting NeoMutt to drawing the index */
+  PERF_STARTUP_CURSES, /**< Starting curses */
+  PERF_STARTUP_CONFIG, /**< Reading the config files */
+  PERF_CRYPT_INIT,     /**< Starting a crypto backend, when it's first used */
+  PERF_MAX,
+};
+
+/**
+ * struct PerfTimer - A running timer
+ */
+struct PerfTimer
+{
+  enum PerfCounter counter; /**< What is being timed */
+  struct timeval start;     /**< When it started */
+};
+
+void mutt_perf_start(struct PerfTimer *t, enum PerfCounter counter);
+long mutt_perf_stop(struct PerfTimer *t);
+void mutt_perf_arm(enum PerfCounter counter);
+void mutt_perf_fire(enum PerfCounter counter);
+void mutt_perf_reset(void);
+void mutt_perf_report(FILE *fp);
+void mutt_perf_dump(void);
+
+int mutt_parse_perf(struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
+
+extern bool TraceActive;
+
+void mutt_trace_close(void);
+void mutt_trace_event(const char *name, char phase);
+int mutt_trace_open(const char *file);
+
+#define mutt_trace_begin(name)                                                 \
+  do                                                                           \
+  {                                                                            \
+    if (TraceActive)                                                           \
+      mutt_trace_event(name, 'B');                                             \
+  } while (0)
+
+#define mutt_trace_end(name)                                                   \
+  do                                                                           \
+  {                                                                            \
+    if (TraceActive)                                                           \
+      mutt_trace_event(name, 'E');                                             \
+  } while (0)
+
+#endif /* _MUTT_PERF_H */
@@ -45,6 +45,7 @@
 #include "mx.h"
 #include "ncrypt/ncrypt.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "url.h"
 #ifdef USE_HCACHE
@@ -70,20 +71,54 @@ static int fetch_message(char *line, void *file)
   return 0;
 }
 
+/**
+ * fetch_discard - ignore line
+ */
+static int fetch_discard(char *line, void *data)
+{
+  return 0;
+}
+
+/**
+ * struct FetchBody - A message being downloaded
+ */
+struct FetchBody
+{
+  FILE *fp;   /**< File the message is written to */
+  bool body;  /**< The header has been written */
+  int lines;  /**< Number of lines in the body */
+};
+
+/**
+ * fetch_body - write line to file, counting the lines of the body
+ */
+static int fetch_body(char *line, void *data)
+{
+  struct FetchBody *fb = (struct FetchBody *) data;
+
+  if (fb->body)
+    fb->lines++;
+  else if (!*line)
+    fb->body = true;
+
+  return fetch_message(line, fb->fp);
+}
+
 /**
  * pop_read_header - Read header
- * @param pop_data POP data
- * @param h        Email header
+ * @param pop_data  POP data
+ * @param h         Email header
+ * @param pipelined The LIST and TOP commands have already been sent
  * @retval  0 Success
  * @retval -1 Connection lost
  * @retval -2 Invalid command or execution error
  * @retval -3 Error writing to tempfile
  */
-static int pop_read_header(struct PopData *pop_data, struct Header *h)
+static int pop_read_header(struct PopData *pop_data, struct Header *h, bool pipelined)
 {
   FILE *f = NULL;
   int rc, index;
-  size_t length;
+  size_t length = 0;
   char buf[LONG_STRING];
   char tempfile[_POSIX_PATH_MAX];
 
@@ -95,31 +130,49 @@ static int pop_read_header(struct PopData *pop_data, struct Header *h)
     return -3;
   }
 
-  snprintf(buf, sizeof(buf), "LIST %d\r\n", h->refno);
-  rc = pop_query(pop_data, buf, sizeof(buf));
-  if (rc == 0)
+  if (pipelined)
   {
-    sscanf(buf, "+OK %d %zu", &index, &length);
+    /* both answers have to be read, whatever they are */
+    rc = pop_read_status(pop_data, "LIST", buf, sizeof(buf));
+    if (rc == 0)
+      sscanf(buf, "+OK %d %zu", &index, &length);
+    if (rc != -1)
+    {
+      int rc2 = pop_read_status(pop_data, "TOP", buf, sizeof(buf));
+      if (rc2 == 0)
+        rc2 = pop_read_data(pop_data, NULL, fetch_message, f);
+      if ((rc == 0) || (rc2 == -1))
+        rc = rc2;
+    }
+  }
+  else
+  {
+    snprintf(buf, sizeof(buf), "LIST %d\r\n", h->refno);
+    rc = pop_query(pop_data, buf, sizeof(buf));
+    if (rc == 0)
+    {
+      sscanf(buf, "+OK %d %zu", &index, &length);
 
-    snprintf(buf, sizeof(buf), "TOP %d 0\r\n", h->refno);
-    rc = pop_fetch_data(pop_data, buf, NULL, fetch_message, f);
+      snprintf(buf, sizeof(buf), "TOP %d 0\r\n", h->refno);
+      rc = pop_fetch_data(pop_data, buf, NULL, fetch_message, f);
 
-    if (pop_data->cmd_top == 2)
-    {
-      if (rc == 0)
+      if (pop_data->cmd_top == 2)
       {
-        pop_data->cmd_top = 1;
+        if (rc == 0)
+        {
+          pop_data->cmd_top = 1;
 
-        mutt_debug(1, "set TOP capability\n");
-      }
+          mutt_debug(1, "set TOP capability\n");
+        }
 
-      if (rc == -2)
-      {
-        pop_data->cmd_top = 0;
+        if (rc == -2)
+        {
+          pop_data->cmd_top = 0;
 
-        mutt_debug(1, "unset TOP capability\n");
-        snprintf(pop_data->err_msg, sizeof(pop_data->err_msg), "%s",
-                 _("Command TOP is not supported by server."));
+          mutt_debug(1, "unset TOP capability\n");
+          snprintf(pop_data->err_msg, sizeof(pop_data->err_msg), "%s",
+                   _("Command TOP is not supported by server."));
+        }
       }
     }
   }
@@ -156,14 +209,40 @@ static int pop_read_header(struct PopData *pop_data, struct Header *h)
   return rc;
 }
 
+/**
+ * pop_send_header_cmds - Ask for the header of a message, without waiting
+ * @param pop_data POP data
+ * @param h        Email header
+ * @retval  0 Success
+ * @retval -1 Connection lost
+ */
+static int pop_send_header_cmds(struct PopData *pop_data, struct Header *h)
+{
+  char buf[SHORT_STRING];
+
+  snprintf(buf, sizeof(buf), "LIST %d\r\nTOP %d 0\r\n", h->refno, h->refno);
+  return pop_send(pop_data, buf);
+}
+
+/**
+ * struct FetchUidl - The messages of a mailbox, while the UIDL list is read
+ */
+struct FetchUidl
+{
+  struct Context *ctx;
+  struct Hash *hash; /**< UIDL -> Header */
+};
+
 /**
  * fetch_uidl - parse UIDL
  */
 static int fetch_uidl(char *line, void *data)
 {
-  int i, index;
-  struct Context *ctx = (struct Context *) data;
+  int index;
+  struct FetchUidl *fu = (struct FetchUidl *) data;
+  struct Context *ctx = fu->ctx;
   struct PopData *pop_data = (struct PopData *) ctx->data;
+  struct Header *h = NULL;
   char *endp = NULL;
 
   errno = 0;
@@ -174,41 +253,39 @@ static int fetch_uidl(char *line, void *data)
     endp++;
   memmove(line, endp, strlen(endp) + 1);
 
-  for (i = 0; i < ctx->msgcount; i++)
-    if (mutt_str_strcmp(line, ctx->hdrs[i]->data) == 0)
-      break;
-
-  if (i == ctx->msgcount)
+  h = mutt_hash_find(fu->hash, line);
+  if (!h)
   {
     mutt_debug(1, "new header %d %s\n", index, line);
 
-    if (i >= ctx->hdrmax)
+    if (ctx->msgcount >= ctx->hdrmax)
       mx_alloc_memory(ctx);
 
-    ctx->msgcount++;
-    ctx->hdrs[i] = mutt_new_header();
-    ctx->hdrs[i]->data = mutt_str_strdup(line);
+    h = mutt_new_header();
+    h->data = mutt_str_strdup(line);
+    ctx->hdrs[ctx->msgcount++] = h;
+    mutt_hash_insert(fu->hash, h->data, h);
   }
-  else if (ctx->hdrs[i]->index != index - 1)
+  else if (h->index != index - 1)
     pop_data->clear_cache = true;
 
-  ctx->hdrs[i]->refno = index;
-  ctx->hdrs[i]->index = index - 1;
+  h->refno = index;
+  h->index = index - 1;
 
   return 0;
 }
 
+/**
+ * msg_cache_check - Check whether a cached message is still on the server
+ * @param id     Cache id
+ * @param bcache Body cache
+ * @param data   Hash table, UIDL -> Header
+ * @retval  0 Success
+ * @retval -1 Error
+ */
 static int msg_cache_check(const char *id, struct BodyCache *bcache, void *data)
 {
-  struct Context *ctx = NULL;
-  struct PopData *pop_data = NULL;
-
-  ctx = (struct Context *) data;
-  if (!ctx)
-    return -1;
-  pop_data = (struct PopData *) ctx->data;
-  if (!pop_data)
-    return -1;
+  struct Hash *hash = (struct Hash *) data;
 
 #ifdef USE_HCACHE
   /* keep hcache file if hcache == bcache */
@@ -216,12 +293,9 @@ static int msg_cache_check(const char *id, struct BodyCache *bcache, void *data)
     return 0;
 #endif
 
-  for (int i = 0; i < ctx->msgcount; i++)
-  {
-    /* if the id we get is known for a header: done (i.e. keep in cache) */
-    if (ctx->hdrs[i]->data && (mutt_str_strcmp(ctx->hdrs[i]->data, id) == 0))
-      return 0;
-  }
+  /* if the id we get is known for a header: done (i.e. keep in cache) */
+  if (mutt_hash_find(hash, id))
+    return 0;
 
   /* message not found in context -> remove it from cache
    * return the result of bcache, so we stop upon its first error
@@ -260,10 +334,12 @@ static header_cache_t *pop_hcache_open(struct PopData *pop_data, const char *pat
  */
 static int pop_fetch_headers(struct Context *ctx)
 {
-  int i, ret, old_count, new_count, deleted;
-  bool hcached = false, bcached;
+  int i, ret, old_count, new_count, deleted, sent, queued = 0;
+  bool bcached, pipelined;
+  bool *cached = NULL;
   struct PopData *pop_data = (struct PopData *) ctx->data;
   struct Progress progress;
+  struct FetchUidl fu;
 
 #ifdef USE_HCACHE
   header_cache_t *hc = NULL;
@@ -279,7 +355,10 @@ static int pop_fetch_headers(struct Context *ctx)
     ctx->hdrs[i]->refno = -1;
 
   old_count = ctx->msgcount;
-  ret = pop_fetch_data(pop_data, "UIDL\r\n", NULL, fetch_uidl, ctx);
+  fu.ctx = ctx;
+  fu.hash = pop_uidl_hash(ctx);
+  ret = pop_fetch_data(pop_data, "UIDL\r\n", NULL, fetch_uidl, &fu);
+  mutt_hash_destroy(&fu.hash);
   new_count = ctx->msgcount;
   ctx->msgcount = old_count;
 
@@ -322,11 +401,10 @@ static int pop_fetch_headers(struct Context *ctx)
       mutt_sleep(2);
     }
 
+    cached = mutt_mem_calloc(MAX(new_count - old_count, 1), sizeof(bool));
+#ifdef USE_HCACHE
     for (i = old_count; i < new_count; i++)
     {
-      if (!ctx->quiet)
-        mutt_progress_update(&progress, i + 1 - old_count, -1);
-#ifdef USE_HCACHE
       data = mutt_hcache_fetch(hc, ctx->hdrs[i]->data, strlen(ctx->hdrs[i]->data));
       if (data)
       {
@@ -349,37 +427,67 @@ static int pop_fetch_headers(struct Context *ctx)
         ctx->hdrs[i]->refno = refno;
         ctx->hdrs[i]->index = index;
         ctx->hdrs[i]->data = uidl;
-        ret = 0;
-        hcached = true;
+        cached[i - old_count] = true;
       }
-      else
+    }
 #endif
-          if ((ret = pop_read_header(pop_data, ctx->hdrs[i])) < 0)
-        break;
-#ifdef USE_HCACHE
-      else
+
+    /* if the server allows it, keep the commands for the next few uncached
+     * headers in flight, so we don't wait for each one in turn */
+    pipelined = pop_data->pipelining && (pop_data->cmd_top == 1);
+    sent = old_count;
+
+    for (i = old_count; i < new_count; i++)
+    {
+      if (!ctx->quiet)
+        mutt_progress_update(&progress, i + 1 - old_count, -1);
+
+      if (!cached[i - old_count])
       {
+        if (pipelined)
+        {
+          if (sent <= i)
+          {
+            sent = i;
+            queued = 0;
+          }
+          for (; (ret == 0) && (sent < new_count) && (queued < POP_PIPELINE); sent++)
+          {
+            if (cached[sent - old_count])
+              continue;
+            ret = pop_send_header_cmds(pop_data, ctx->hdrs[sent]);
+            queued++;
+          }
+          if (ret < 0)
+            break;
+          queued--;
+        }
+
+        ret = pop_read_header(pop_data, ctx->hdrs[i], pipelined);
+        if (ret < 0)
+          break;
+#ifdef USE_HCACHE
         mutt_hcache_store(hc, ctx->hdrs[i]->data, strlen(ctx->hdrs[i]->data),
                           ctx->hdrs[i], 0);
-      }
 #endif
+      }
 
       /*
        * faked support for flags works like this:
-       * - if 'hcached' is true, we have the message in our hcache:
+       * - if 'cached' is true, we have the message in our hcache:
        *        - if we also have a body: read
        *        - if we don't have a body: old
        *          (if $mark_old is set which is maybe wrong as
        *          $mark_old should be considered for syncing the
        *          folder and not when opening it XXX)
-       * - if 'hcached' is false, we don't have the message in our hcache:
+       * - if 'cached' is false, we don't have the message in our hcache:
        *        - if we also have a body: read
        *        - if we don't have a body: new
        */
       bcached = (mutt_bcache_exists(pop_data->bcache, ctx->hdrs[i]->data) == 0);
       ctx->hdrs[i]->old = false;
       ctx->hdrs[i]->read = false;
-      if (hcached)
+      if (cached[i - old_count])
       {
         if (bcached)
           ctx->hdrs[i]->read = true;
@@ -395,6 +503,14 @@ static int pop_fetch_headers(struct Context *ctx)
       ctx->msgcount++;
     }
 
+    /* answers are still on their way, so the connection can't be reused */
+    if (pipelined && (ret < 0) && (pop_data->status == POP_CONNECTED))
+    {
+      mutt_socket_close(pop_data->conn);
+      pop_data->status = POP_DISCONNECTED;
+    }
+    FREE(&cached);
+
     if (i > old_count)
       mx_update_context(ctx, i - old_count);
   }
@@ -415,7 +531,11 @@ static int pop_fetch_headers(struct Context *ctx)
    * the availability of our cache
    */
   if (MessageCacheClean)
-    mutt_bcache_list(pop_data->bcache, msg_cache_check, (void *) ctx);
+  {
+    struct Hash *hash = pop_uidl_hash(ctx);
+    mutt_bcache_list(pop_data->bcache, msg_cache_check, hash);
+    mutt_hash_destroy(&hash);
+  }
 
   mutt_clear_error();
   return (new_count - old_count);
@@ -431,6 +551,7 @@ static int pop_open_mailbox(struct Context *ctx)
   struct Connection *conn = NULL;
   struct Account acct;
   struct PopData *pop_data = NULL;
+  struct PerfTimer perf;
   struct Url url;
 
   if (pop_parse_path(ctx->path, &acct))
@@ -456,8 +577,10 @@ static int pop_open_mailbox(struct Context *ctx)
   pop_data->conn = conn;
   ctx->data = pop_data;
 
+  mutt_perf_start(&perf, PERF_CONNECT);
   if (pop_open_connection(pop_data) < 0)
     return -1;
+  mutt_perf_stop(&perf);
 
   conn->data = pop_data;
   pop_data->bcache = mutt_bcache_open(&acct, NULL);
@@ -481,7 +604,9 @@ static int pop_open_mailbox(struct Context *ctx)
 
     mutt_message(_("Fetching list of messages..."));
 
+    mutt_perf_start(&perf, PERF_FETCH_HEADERS);
     ret = pop_fetch_headers(ctx);
+    mutt_perf_stop(&perf);
 
     if (ret >= 0)
       return 0;
@@ -555,6 +680,8 @@ static int pop_fetch_message(struct Context *ctx, struct Message *msg, int msgno
   struct PopData *pop_data = (struct PopData *) ctx->data;
   struct PopCache *cache = NULL;
   struct Header *h = ctx->hdrs[msgno];
+  struct FetchBody fb;
+  LOFF_T size;
   unsigned short bcache = 1;
 
   /* see if we already have the message in body cache */
@@ -624,7 +751,10 @@ static int pop_fetch_message(struct Context *ctx, struct Message *msg, int msgno
 
     snprintf(buf, sizeof(buf), "RETR %d\r\n", h->refno);
 
-    ret = pop_fetch_data(pop_data, buf, &progressbar, fetch_message, msg->fp);
+    fb.fp = msg->fp;
+    fb.body = false;
+    fb.lines = 0;
+    ret = pop_fetch_data(pop_data, buf, &progressbar, fetch_body, &fb);
     if (ret == 0)
       break;
 
@@ -654,6 +784,7 @@ static int pop_fetch_message(struct Context *ctx, struct Message *msg, int msgno
   /* Update the header information.  Previously, we only downloaded a
    * portion of the headers, those required for the main display.
    */
+  size = ftello(msg->fp);
   if (bcache)
     mutt_bcache_commit(pop_data->bcache, h->data);
   else
@@ -675,15 +806,9 @@ static int pop_fetch_message(struct Context *ctx, struct Message *msg, int msgno
   mutt_label_hash_add(ctx, h);
 
   h->data = uidl;
-  h->lines = 0;
-  fgets(buf, sizeof(buf), msg->fp);
-  while (!feof(msg->fp))
-  {
-    ctx->hdrs[msgno]->lines++;
-    fgets(buf, sizeof(buf), msg->fp);
-  }
-
-  h->content->length = ftello(msg->fp) - h->content->offset;
+  /* the body was counted as it arrived, so it needn't be read again */
+  h->lines = fb.lines;
+  h->content->length = size - h->content->offset;
 
   /* This needs to be done in case this is a multipart message */
   if (!WithCrypto)
@@ -700,12 +825,55 @@ static int pop_close_message(struct Context *ctx, struct Message *msg)
   return mutt_file_fclose(&msg->fp);
 }
 
+/**
+ * pop_read_dele - Read the answers to pipelined DELE commands
+ * @param ctx     Context
+ * @param pending Messages that DELE was sent for, index into Context.hdrs
+ * @param count   Number of messages
+ * @param hc      Header cache
+ * @retval  0 Success
+ * @retval -1 Connection lost
+ * @retval -2 Invalid command or execution error
+ *
+ * Every answer is read, even after an error.
+ */
+#ifdef USE_HCACHE
+static int pop_read_dele(struct Context *ctx, int *pending, int count, header_cache_t *hc)
+#else
+static int pop_read_dele(struct Context *ctx, int *pending, int count)
+#endif
+{
+  struct PopData *pop_data = (struct PopData *) ctx->data;
+  char buf[LONG_STRING];
+  int ret = 0;
+
+  for (int k = 0; k < count; k++)
+  {
+    struct Header *h = ctx->hdrs[pending[k]];
+    int rc = pop_read_status(pop_data, "DELE", buf, sizeof(buf));
+    if (rc == -1)
+      return -1;
+    if (rc == 0)
+    {
+      mutt_bcache_del(pop_data->bcache, h->data);
+#ifdef USE_HCACHE
+      mutt_hcache_delete(hc, h->data, strlen(h->data));
+#endif
+    }
+    else if (ret == 0)
+      ret = rc;
+  }
+
+  return ret;
+}
+
 /**
  * pop_sync_mailbox - update POP mailbox, delete messages from server
  */
 static int pop_sync_mailbox(struct Context *ctx, int *index_hint)
 {
-  int i, j, ret = 0;
+  int i, j, count, ret = 0;
+  int pending[POP_PIPELINE];
   char buf[LONG_STRING];
   struct PopData *pop_data = (struct PopData *) ctx->data;
   struct Progress progress;
@@ -727,7 +895,7 @@ static int pop_sync_mailbox(struct Context *ctx, int *index_hint)
     hc = pop_hcache_open(pop_data, ctx->path);
 #endif
 
-    for (i = 0, j = 0, ret = 0; ret == 0 && i < ctx->msgcount; i++)
+    for (i = 0, j = 0, count = 0, ret = 0; ret == 0 && i < ctx->msgcount; i++)
     {
       if (ctx->hdrs[i]->deleted && ctx->hdrs[i]->refno != -1)
       {
@@ -735,8 +903,21 @@ static int pop_sync_mailbox(struct Context *ctx, int *index_hint)
         if (!ctx->quiet)
           mutt_progress_update(&progress, j, -1);
         snprintf(buf, sizeof(buf), "DELE %d\r\n", ctx->hdrs[i]->refno);
-        ret = pop_query(pop_data, buf, sizeof(buf));
-        if (ret == 0)
+        if (pop_data->pipelining)
+        {
+          ret = pop_send(pop_data, buf);
+          pending[count++] = i;
+          if ((ret == 0) && (count == POP_PIPELINE))
+          {
+#ifdef USE_HCACHE
+            ret = pop_read_dele(ctx, pending, count, hc);
+#else
+            ret = pop_read_dele(ctx, pending, count);
+#endif
+            count = 0;
+          }
+        }
+        else if ((ret = pop_query(pop_data, buf, sizeof(buf))) == 0)
         {
           mutt_bcache_del(pop_data->bcache, ctx->hdrs[i]->data);
 #ifdef USE_HCACHE
@@ -754,6 +935,15 @@ static int pop_sync_mailbox(struct Context *ctx, int *index_hint)
 #endif
     }
 
+    if ((ret == 0) && (count > 0))
+    {
+#ifdef USE_HCACHE
+      ret = pop_read_dele(ctx, pending, count, hc);
+#else
+      ret = pop_read_dele(ctx, pending, count);
+#endif
+    }
+
 #ifdef USE_HCACHE
     mutt_hcache_close(hc);
 #endif
@@ -824,6 +1014,8 @@ void pop_fetch_mail(void)
   char msgbuf[SHORT_STRING];
   char *url = NULL, *p = NULL;
   int delanswer, last = 0, msgs, bytes, rset = 0, ret;
+  int sent, next, saved;
+  bool pipelined;
   struct Connection *conn = NULL;
   struct Context ctx;
   struct Message *msg = NULL;
@@ -908,15 +1100,44 @@ void pop_fetch_mail(void)
   snprintf(msgbuf, sizeof(msgbuf), _("Reading new messages (%d bytes)..."), bytes);
   mutt_message("%s", msgbuf);
 
+  /* if the server allows it, keep the next few RETR commands in flight and
+   * delete the messages at the end: the server doesn't delete anything until
+   * QUIT, anyway */
+  pipelined = pop_data->pipelining;
+  sent = last + 1;
+  next = last + 1;
+  saved = last;
+
   for (int i = last + 1; i <= msgs; i++)
   {
-    msg = mx_open_new_message(&ctx, NULL, MUTT_ADD_FROM);
+    for (ret = 0; pipelined && (sent <= msgs) && (sent < i + POP_PIPELINE); sent++)
+    {
+      snprintf(buffer, sizeof(buffer), "RETR %d\r\n", sent);
+      ret = pop_send(pop_data, buffer);
+      if (ret < 0)
+        break;
+    }
+
+    msg = (ret == 0) ? mx_open_new_message(&ctx, NULL, MUTT_ADD_FROM) : NULL;
     if (!msg)
-      ret = -3;
+    {
+      if (ret == 0)
+        ret = -3;
+    }
     else
     {
-      snprintf(buffer, sizeof(buffer), "RETR %d\r\n", i);
-      ret = pop_fetch_data(pop_data, buffer, NULL, fetch_message, msg->fp);
+      if (pipelined)
+      {
+        ret = pop_read_status(pop_data, "RETR", buffer, sizeof(buffer));
+        if (ret == 0)
+          ret = pop_read_data(pop_data, NULL, fetch_message, msg->fp);
+        next = i + 1;
+      }
+      else
+      {
+        snprintf(buffer, sizeof(buffer), "RETR %d\r\n", i);
+        ret = pop_fetch_data(pop_data, buffer, NULL, fetch_message, msg->fp);
+      }
       if (ret == -3)
         rset = 1;
 
@@ -931,9 +1152,14 @@ void pop_fetch_mail(void)
 
     if (ret == 0 && delanswer == MUTT_YES)
     {
-      /* delete the message on the server */
-      snprintf(buffer, sizeof(buffer), "DELE %d\r\n", i);
-      ret = pop_query(pop_data, buffer, sizeof(buffer));
+      if (pipelined)
+        saved = i;
+      else
+      {
+        /* delete the message on the server */
+        snprintf(buffer, sizeof(buffer), "DELE %d\r\n", i);
+        ret = pop_query(pop_data, buffer, sizeof(buffer));
+      }
     }
 
     if (ret == -1)
@@ -955,6 +1181,44 @@ void pop_fetch_mail(void)
     mutt_message(_("%s [%d of %d messages read]"), msgbuf, i - last, msgs - last);
   }
 
+  /* skip the messages that were sent after an error */
+  for (; next < sent; next++)
+  {
+    if ((pop_read_status(pop_data, "RETR", buffer, sizeof(buffer)) == -1) ||
+        (pop_read_data(pop_data, NULL, fetch_discard, NULL) == -1))
+    {
+      mx_close_mailbox(&ctx, NULL);
+      goto fail;
+    }
+  }
+
+  /* delete the messages on the server */
+  for (int i = last + 1; !rset && (i <= saved); i += POP_PIPELINE)
+  {
+    int n = MIN(POP_PIPELINE, saved - i + 1);
+
+    for (int j = 0; j < n; j++)
+    {
+      snprintf(buffer, sizeof(buffer), "DELE %d\r\n", i + j);
+      if (pop_send(pop_data, buffer) < 0)
+      {
+        mx_close_mailbox(&ctx, NULL);
+        goto fail;
+      }
+    }
+    for (int j = 0; j < n; j++)
+    {
+      ret = pop_read_status(pop_data, "DELE", buffer, sizeof(buffer));
+      if (ret == -1)
+      {
+        mx_close_mailbox(&ctx, NULL);
+        goto fail;
+      }
+      if (ret == -2)
+        mutt_error("%s", pop_data->err_msg);
+    }
+  }
+
   mx_close_mailbox(&ctx, NULL);
 
   if (rset)
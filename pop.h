@@ -29,6 +29,7 @@
 
 struct Account;
 struct Context;
+struct Hash;
 struct Progress;
 
 #define POP_PORT 110
@@ -40,6 +41,9 @@ struct Progress;
 /* maximal length of the server response (RFC1939) */
 #define POP_CMD_RESPONSE 512
 
+/* number of messages whose commands are sent ahead, if the server pipelines */
+#define POP_PIPELINE 32
+
 /**
  * enum PopStatus - POP server responses
  */
@@ -86,6 +90,7 @@ struct PopData
   unsigned int cmd_uidl : 2; /**< optional command UIDL */
   unsigned int cmd_top : 2;  /**< optional command TOP */
   bool resp_codes : 1;       /**< server supports extended response codes */
+  bool pipelining : 1;       /**< server supports PIPELINING */
   bool expire : 1;           /**< expire is greater than 0 */
   bool clear_cache : 1;
   size_t size;
@@ -119,10 +124,15 @@ void pop_apop_timestamp(struct PopData *pop_data, char *buf);
 int pop_parse_path(const char *path, struct Account *acct);
 int pop_connect(struct PopData *pop_data);
 int pop_open_connection(struct PopData *pop_data);
+int pop_send(struct PopData *pop_data, const char *cmd);
+int pop_read_status(struct PopData *pop_data, const char *cmd, char *buf, size_t buflen);
 int pop_query_d(struct PopData *pop_data, char *buf, size_t buflen, char *msg);
+int pop_read_data(struct PopData *pop_data, struct Progress *progressbar,
+                  int (*funct)(char *, void *), void *data);
 int pop_fetch_data(struct PopData *pop_data, char *query, struct Progress *progressbar,
                    int (*funct)(char *, void *), void *data);
 int pop_reconnect(struct Context *ctx);
+struct Hash *pop_uidl_hash(struct Context *ctx);
 void pop_logout(struct Context *ctx);
 
 /* pop.c */
@@ -147,6 +147,9 @@ static int fetch_capa(char *line, void *data)
   else if (mutt_str_strncasecmp(line, "TOP", 3) == 0)
     pop_data->cmd_top = 1;
 
+  else if (mutt_str_strncasecmp(line, "PIPELINING", 10) == 0)
+    pop_data->pipelining = true;
+
   return 0;
 }
 
@@ -200,6 +203,7 @@ static int pop_capabilities(struct PopData *pop_data, int mode)
     pop_data->cmd_uidl = 0;
     pop_data->cmd_top = 0;
     pop_data->resp_codes = false;
+    pop_data->pipelining = false;
     pop_data->expire = true;
     pop_data->login_delay = 0;
     FREE(&pop_data->auth_list);
@@ -451,6 +455,60 @@ void pop_logout(struct Context *ctx)
   return;
 }
 
+/**
+ * pop_send - Send a command without waiting for the answer
+ * @param pop_data POP data
+ * @param cmd      Command, ending in CRLF
+ * @retval  0 Successful
+ * @retval -1 Connection lost
+ *
+ * If the server supports PIPELINING, several commands may be sent before their
+ * answers are read with pop_read_status().  They're held back until then, so
+ * that they go out together.
+ */
+int pop_send(struct PopData *pop_data, const char *cmd)
+{
+  if (pop_data->status != POP_CONNECTED)
+    return -1;
+
+  mutt_socket_cork(pop_data->conn);
+  if (mutt_socket_write(pop_data->conn, cmd) < 0)
+  {
+    pop_data->status = POP_DISCONNECTED;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * pop_read_status - Read the status line of the answer to a command
+ * @param pop_data POP data
+ * @param cmd      Command the answer is for, used in the error message
+ * @param buf      Buffer for the status line
+ * @param buflen   Buffer length
+ * @retval  0 Successful
+ * @retval -1 Connection lost
+ * @retval -2 Invalid command or execution error
+ */
+int pop_read_status(struct PopData *pop_data, const char *cmd, char *buf, size_t buflen)
+{
+  snprintf(pop_data->err_msg, sizeof(pop_data->err_msg), "%.*s: ",
+           (int) strcspn(cmd, " \r\n"), cmd);
+
+  if ((mutt_socket_uncork(pop_data->conn) < 0) ||
+      (mutt_socket_readln(buf, buflen, pop_data->conn) < 0))
+  {
+    pop_data->status = POP_DISCONNECTED;
+    return -1;
+  }
+  if (mutt_str_strncmp(buf, "+OK", 3) == 0)
+    return 0;
+
+  pop_error(pop_data, buf);
+  return -2;
+}
+
 /**
  * pop_query_d - Send data from buffer and receive answer to the same buffer
  * @param pop_data POP data
@@ -464,7 +522,6 @@ void pop_logout(struct Context *ctx)
 int pop_query_d(struct PopData *pop_data, char *buf, size_t buflen, char *msg)
 {
   int dbg = MUTT_SOCK_LOG_CMD;
-  char *c = NULL;
 
   if (pop_data->status != POP_CONNECTED)
     return -1;
@@ -478,48 +535,32 @@ int pop_query_d(struct PopData *pop_data, char *buf, size_t buflen, char *msg)
 
   mutt_socket_write_d(pop_data->conn, buf, -1, dbg);
 
-  c = strpbrk(buf, " \r\n");
-  if (c)
-    *c = '\0';
-  snprintf(pop_data->err_msg, sizeof(pop_data->err_msg), "%s: ", buf);
-
-  if (mutt_socket_readln(buf, buflen, pop_data->conn) < 0)
-  {
-    pop_data->status = POP_DISCONNECTED;
-    return -1;
-  }
-  if (mutt_str_strncmp(buf, "+OK", 3) == 0)
-    return 0;
-
-  pop_error(pop_data, buf);
-  return -2;
+  return pop_read_status(pop_data, buf, buf, buflen);
 }
 
 /**
- * pop_fetch_data - Read Headers with callback function
+ * pop_read_data - Read the lines of a multi-line answer
+ * @param pop_data    POP data
+ * @param progressbar Progress bar, may be NULL
+ * @param funct       Function called for each line
+ * @param data        Private data for @a funct
  * @retval  0 Successful
  * @retval -1 Connection lost
- * @retval -2 Invalid command or execution error
  * @retval -3 Error in funct(*line, *data)
  *
- * This function calls  funct(*line, *data)  for each received line,
- * funct(NULL, *data)  if  rewind(*data)  needs, exits when fail or done.
+ * The status line must already have been read.  The answer is read to the
+ * end, even if @a funct fails.
  */
-int pop_fetch_data(struct PopData *pop_data, char *query, struct Progress *progressbar,
-                   int (*funct)(char *, void *), void *data)
+int pop_read_data(struct PopData *pop_data, struct Progress *progressbar,
+                  int (*funct)(char *, void *), void *data)
 {
   char buf[LONG_STRING];
   char *inbuf = NULL;
   char *p = NULL;
-  int ret, chunk = 0;
+  int ret = 0, chunk = 0;
   long pos = 0;
   size_t lenbuf = 0;
 
-  mutt_str_strfcpy(buf, query, sizeof(buf));
-  ret = pop_query(pop_data, buf, sizeof(buf));
-  if (ret < 0)
-    return ret;
-
   inbuf = mutt_mem_malloc(sizeof(buf));
 
   while (true)
@@ -564,17 +605,60 @@ int pop_fetch_data(struct PopData *pop_data, char *query, struct Progress *progr
   return ret;
 }
 
+/**
+ * pop_fetch_data - Read Headers with callback function
+ * @retval  0 Successful
+ * @retval -1 Connection lost
+ * @retval -2 Invalid command or execution error
+ * @retval -3 Error in funct(*line, *data)
+ *
+ * This function calls  funct(*line, *data)  for each received line,
+ * funct(NULL, *data)  if  rewind(*data)  needs, exits when fail or done.
+ */
+int pop_fetch_data(struct PopData *pop_data, char *query, struct Progress *progressbar,
+                   int (*funct)(char *, void *), void *data)
+{
+  char buf[LONG_STRING];
+  int ret;
+
+  mutt_str_strfcpy(buf, query, sizeof(buf));
+  ret = pop_query(pop_data, buf, sizeof(buf));
+  if (ret < 0)
+    return ret;
+
+  return pop_read_data(pop_data, progressbar, funct, data);
+}
+
+/**
+ * pop_uidl_hash - Index the messages of a mailbox by their UIDL
+ * @param ctx Context
+ * @retval ptr Hash table, UIDL -> Header
+ *
+ * The keys are copied, so the table may outlive the headers, as long as the
+ * data isn't used after they're freed.  The caller must free the table.
+ */
+struct Hash *pop_uidl_hash(struct Context *ctx)
+{
+  struct Hash *hash = mutt_hash_create(MAX(ctx->msgcount, 64), MUTT_HASH_STRDUP_KEYS);
+
+  for (int i = 0; i < ctx->msgcount; i++)
+    if (ctx->hdrs[i]->data)
+      mutt_hash_insert(hash, ctx->hdrs[i]->data, ctx->hdrs[i]);
+
+  return hash;
+}
+
 /**
  * check_uidl - find message with this UIDL and set refno
  * @param line String containing UIDL
- * @param data POP data
+ * @param data Hash table, UIDL -> Header
  * @retval 0 on success
  * @retval -1 on error
  */
 static int check_uidl(char *line, void *data)
 {
   unsigned int index;
-  struct Context *ctx = (struct Context *) data;
+  struct Header *h = NULL;
   char *endp = NULL;
 
   errno = 0;
@@ -585,14 +669,9 @@ static int check_uidl(char *line, void *data)
     endp++;
   memmove(line, endp, strlen(endp) + 1);
 
-  for (int i = 0; i < ctx->msgcount; i++)
-  {
-    if (mutt_str_strcmp(ctx->hdrs[i]->data, line) == 0)
-    {
-      ctx->hdrs[i]->refno = index;
-      break;
-    }
-  }
+  h = mutt_hash_find((struct Hash *) data, line);
+  if (h)
+    h->refno = index;
 
   return 0;
 }
@@ -627,7 +706,9 @@ int pop_reconnect(struct Context *ctx)
       for (int i = 0; i < ctx->msgcount; i++)
         ctx->hdrs[i]->refno = -1;
 
-      ret = pop_fetch_data(pop_data, "UIDL\r\n", &progressbar, check_uidl, ctx);
+      struct Hash *hash = pop_uidl_hash(ctx);
+      ret = pop_fetch_data(pop_data, "UIDL\r\n", &progressbar, check_uidl, hash);
+      mutt_hash_destroy(&hash);
       if (ret == -2)
       {
         mutt_error("%s", pop_data->err_msg);
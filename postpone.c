@@ -33,6 +33,7 @@
 #include "conn/conn.h"
 #include "mutt.h"
 #include "body.h"
+#include "buffy.h"
 #include "context.h"
 #include "envelope.h"
 #include "format_flags.h"
@@ -148,6 +149,15 @@ int mutt_num_postponed(int force)
 
     if (access(Postponed, R_OK | F_OK) != 0)
       return (PostCount = 0);
+
+    /* Count local drafts without parsing them */
+    int count = mutt_buffy_count(Postponed);
+    if (count >= 0)
+    {
+      mutt_debug(3, "%d postponed messages found.\n", count);
+      return (PostCount = count);
+    }
+
 #ifdef USE_NNTP
     if (optnews)
       OPT_NEWS = false;
@@ -207,7 +207,9 @@ void mutt_query_exit(void);
 void mutt_query_menu(char *buf, size_t buflen);
 void mutt_safe_path(char *s, size_t l, struct Address *a);
 void mutt_save_path(char *d, size_t dsize, struct Address *a);
+void mutt_score_mailbox(struct Context *ctx);
 void mutt_score_message(struct Context *ctx, struct Header *hdr, int upd_ctx);
+void mutt_score_set(struct Context *ctx, struct Header *hdr, int score, int upd_ctx);
 void mutt_select_fcc(char *path, size_t pathlen, struct Header *hdr);
 void mutt_select_file(char *f, size_t flen, int flags, char ***files, int *numfiles);
 void mutt_message_hook(struct Context *ctx, struct Header *hdr, int type);
@@ -224,6 +226,7 @@ void mutt_version(void);
 void mutt_view_attachments(struct Header *hdr);
 void mutt_write_address_list(struct Address *addr, FILE *fp, int linelen, bool display);
 bool mutt_addr_is_user(struct Address *addr);
+void mutt_alternates_reset(void);
 int mutt_addwch(wchar_t wc);
 int mutt_alias_complete(char *s, size_t buflen);
 void mutt_alias_add_reverse(struct Alias *t);
@@ -298,6 +301,7 @@ int mutt_parse_mailboxes(struct Buffer *path, struct Buffer *s, unsigned long da
 int mutt_parse_unmailboxes(struct Buffer *path, struct Buffer *s, unsigned long data, struct Buffer *err);
 int mutt_parse_mono(struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 int mutt_parse_unmono(struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
+int mutt_parse_pattern_explain(struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 int mutt_parse_push(struct Buffer *buf, struct Buffer *s, unsigned long data, struct Buffer *err);
 int mutt_parse_rc_line(/* const */ char *line, struct Buffer *token, struct Buffer *err);
 int mutt_parse_rfc822_line(struct Envelope *e, struct Header *hdr, char *line, char *p,
@@ -312,9 +316,12 @@ int mutt_query_variables(struct ListHead *queries);
 int mutt_save_attachment(FILE *fp, struct Body *m, char *path, int flags, struct Header *hdr);
 int mutt_save_message_ctx(struct Header *h, int delete, int decode, int decrypt, struct Context *ctx);
 int mutt_save_message(struct Header *h, int delete, int decode, int decrypt);
+int mutt_save_message_to(struct Header *h, char *path, struct stat *st,
+                         int delete, int decode, int decrypt);
 #ifdef USE_SMTP
 int mutt_smtp_send(const struct Address *from, const struct Address *to, const struct Address *cc,
                    const struct Address *bcc, const char *msgfile, int eightbit);
+void mutt_smtp_logout(void);
 #endif
 
 size_t mutt_wstr_trunc(const char *src, size_t maxlen, size_t maxwid, size_t *width);
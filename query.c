@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
+#include <time.h>
 #include "mutt/mutt.h"
 #include "mutt.h"
 #include "address.h"
@@ -63,6 +64,22 @@ struct Entry
   struct Query *data;
 };
 
+/**
+ * struct QueryCacheEntry - Remembered results of $query_command
+ */
+struct QueryCacheEntry
+{
+  char *query;           /**< String that was queried */
+  char *command;         /**< $query_command that was used */
+  time_t when;           /**< When the query was run */
+  struct Query *results; /**< Results of the query */
+};
+
+#define QUERY_CACHE_SIZE 8
+#define QUERY_CACHE_TTL 60 /**< Seconds to reuse a result for */
+
+static struct QueryCacheEntry QueryCache[QUERY_CACHE_SIZE];
+
 static const struct Mapping QueryHelp[] = {
   { N_("Exit"), OP_EXIT },
   { N_("Mail"), OP_MAIL },
@@ -178,6 +195,76 @@ static struct Query *run_query(char *s, int quiet)
   return first;
 }
 
+/**
+ * copy_query - Copy a list of query results
+ * @param q Results to copy
+ * @retval ptr Copy of the results
+ */
+static struct Query *copy_query(const struct Query *q)
+{
+  struct Query *first = NULL;
+  struct Query **last = &first;
+
+  for (; q; q = q->next)
+  {
+    struct Query *c = mutt_mem_calloc(1, sizeof(struct Query));
+    c->num = q->num;
+    c->addr = mutt_addr_copy_list(q->addr, false);
+    c->name = mutt_str_strdup(q->name);
+    c->other = mutt_str_strdup(q->other);
+    *last = c;
+    last = &c->next;
+  }
+
+  return first;
+}
+
+/**
+ * run_query_cached - Run $query_command, reusing recent results
+ * @param s String to query
+ * @retval ptr Results, owned by the caller
+ *
+ * Completing the same prefix several times in a row, e.g. after a typo,
+ * doesn't run the external command each time.  Results are reused for
+ * QUERY_CACHE_TTL seconds, as long as $query_command hasn't changed.
+ */
+static struct Query *run_query_cached(char *s)
+{
+  struct QueryCacheEntry *e = NULL;
+  struct QueryCacheEntry *oldest = &QueryCache[0];
+  time_t now = time(NULL);
+
+  for (int i = 0; i < QUERY_CACHE_SIZE; i++)
+  {
+    e = &QueryCache[i];
+    if (e->query && (now - e->when < QUERY_CACHE_TTL) && (now >= e->when) &&
+        (mutt_str_strcmp(e->query, s) == 0) &&
+        (mutt_str_strcmp(e->command, QueryCommand) == 0))
+    {
+      mutt_debug(3, "reusing the results for '%s'\n", s);
+      e->when = now;
+      return copy_query(e->results);
+    }
+    if (!e->query || (e->when < oldest->when))
+      oldest = e;
+  }
+
+  struct Query *results = run_query(s, 1);
+  if (results)
+  {
+    e = oldest;
+    FREE(&e->query);
+    FREE(&e->command);
+    free_query(&e->results);
+    e->query = mutt_str_strdup(s);
+    e->command = mutt_str_strdup(QueryCommand);
+    e->when = now;
+    e->results = copy_query(results);
+  }
+
+  return results;
+}
+
 static int query_search(struct Menu *m, regex_t *re, int n)
 {
   struct Entry *table = (struct Entry *) m->data;
@@ -549,7 +636,7 @@ int mutt_query_complete(char *buf, size_t buflen)
     return 0;
   }
 
-  results = run_query(buf, 1);
+  results = run_query_cached(buf);
   if (results)
   {
     /* only one response? */
@@ -1144,6 +1144,45 @@ static const char *Function_not_permitted =
     break;                                                                     \
   }
 
+/**
+ * struct AttachCache - The attachments of the last email in the menu
+ *
+ * Listing the attachments can mean decrypting the email, so they're kept while
+ * the user flips between the pager and the attachment menu.
+ */
+static struct AttachCache
+{
+  struct Context *ctx;    /**< Mailbox the email is in */
+  struct Header *hdr;     /**< Email */
+  struct Message *msg;    /**< Email's open message */
+  struct AttachCtx *actx; /**< Email's attachments */
+} AttachCache;
+
+/**
+ * mutt_attach_cache_forget - Drop the cached attachments
+ * @param ctx If not NULL, only drop them if they're from this mailbox
+ * @param hdr If not NULL, only drop them if they're from this email
+ *
+ * This must be called before the mailbox or email goes away, or the mailbox's
+ * files might be rewritten.
+ */
+void mutt_attach_cache_forget(struct Context *ctx, struct Header *hdr)
+{
+  if (!AttachCache.actx)
+    return;
+  if (ctx && (ctx != AttachCache.ctx))
+    return;
+  if (hdr && (hdr != AttachCache.hdr))
+    return;
+
+  /* freeing the decrypted parts may free more emails */
+  struct AttachCache old = AttachCache;
+  memset(&AttachCache, 0, sizeof(AttachCache));
+
+  mutt_free_attach_context(&old.actx);
+  mx_close_message(old.ctx, &old.msg);
+}
+
 void mutt_view_attachments(struct Header *hdr)
 {
   char helpstr[LONG_STRING];
@@ -1153,15 +1192,25 @@ void mutt_view_attachments(struct Header *hdr)
   struct AttachCtx *actx = NULL;
   int flags = 0;
   int op = OP_NULL;
+  bool keep = true;
 
   /* make sure we have parsed this message */
   mutt_parse_mime_message(Context, hdr);
 
   mutt_message_hook(Context, hdr, MUTT_MESSAGEHOOK);
 
-  msg = mx_open_message(Context, hdr->msgno);
-  if (!msg)
-    return;
+  if (AttachCache.actx && (AttachCache.ctx == Context) && (AttachCache.hdr == hdr))
+  {
+    msg = AttachCache.msg;
+    actx = AttachCache.actx;
+    memset(&AttachCache, 0, sizeof(AttachCache));
+  }
+  else
+  {
+    msg = mx_open_message(Context, hdr->msgno);
+    if (!msg)
+      return;
+  }
 
   menu = mutt_new_menu(MENU_ATTACH);
   menu->title = _("Attachments");
@@ -1170,10 +1219,19 @@ void mutt_view_attachments(struct Header *hdr)
   menu->help = mutt_compile_help(helpstr, sizeof(helpstr), MENU_ATTACH, AttachHelp);
   mutt_push_current_menu(menu);
 
-  actx = mutt_mem_calloc(sizeof(struct AttachCtx), 1);
-  actx->hdr = hdr;
-  actx->root_fp = msg->fp;
-  mutt_update_recvattach_menu(actx, menu, 1);
+  if (actx)
+  {
+    mutt_attach_init(actx);
+    menu->data = actx;
+    mutt_update_recvattach_menu(actx, menu, 0);
+  }
+  else
+  {
+    actx = mutt_mem_calloc(sizeof(struct AttachCtx), 1);
+    actx->hdr = hdr;
+    actx->root_fp = msg->fp;
+    mutt_update_recvattach_menu(actx, menu, 1);
+  }
 
   while (true)
   {
@@ -1211,6 +1269,7 @@ void mutt_view_attachments(struct Header *hdr)
 
       case OP_FORGET_PASSPHRASE:
         crypt_forget_passphrase();
+        keep = false;
         break;
 
       case OP_EXTRACT_KEYS:
@@ -1408,8 +1467,6 @@ void mutt_view_attachments(struct Header *hdr)
         break;
 
       case OP_EXIT:
-        mx_close_message(Context, &msg);
-
         hdr->attach_del = false;
         for (int i = 0; i < actx->idxlen; i++)
         {
@@ -1422,7 +1479,19 @@ void mutt_view_attachments(struct Header *hdr)
         if (hdr->attach_del)
           hdr->changed = true;
 
-        mutt_free_attach_context(&actx);
+        mutt_attach_cache_forget(NULL, NULL);
+        if (keep)
+        {
+          AttachCache.ctx = Context;
+          AttachCache.hdr = hdr;
+          AttachCache.msg = msg;
+          AttachCache.actx = actx;
+        }
+        else
+        {
+          mutt_free_attach_context(&actx);
+          mx_close_message(Context, &msg);
+        }
 
         mutt_pop_current_menu(menu);
         mutt_menu_destroy(&menu);
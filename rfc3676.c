@@ -36,6 +36,7 @@
 #include "mutt_curses.h"
 #include "options.h"
 #include "protos.h"
+#include "rfc3676.h"
 #include "state.h"
 
 #define FLOWED_MAX 72
@@ -109,10 +110,96 @@ static bool add_quote_suffix(struct State *s, int ql)
   return true;
 }
 
+/* Where the lines being displayed are recorded, if anywhere */
+static struct FlowedLines *Recording = NULL;
+
+/**
+ * rfc3676_lines_record - Record the lines that the handler displays
+ * @param fl Where to record the lines written to fl->fp, NULL to stop
+ */
+void rfc3676_lines_record(struct FlowedLines *fl)
+{
+  Recording = fl;
+}
+
+/**
+ * rfc3676_lines_free - Free the recorded lines
+ * @param fl Lines to free
+ */
+void rfc3676_lines_free(struct FlowedLines *fl)
+{
+  if (!fl)
+    return;
+  if (Recording == fl)
+    Recording = NULL;
+  FREE(&fl->lines);
+  fl->num = 0;
+  fl->max = 0;
+}
+
+/**
+ * rfc3676_lines_find - Find the record of a line
+ * @param fl     Recorded lines
+ * @param offset Start of the line in the file
+ * @retval ptr  The line
+ * @retval NULL The handler didn't write a line there
+ */
+struct FlowedLine *rfc3676_lines_find(struct FlowedLines *fl, LOFF_T offset)
+{
+  if (!fl || (fl->num == 0))
+    return NULL;
+
+  size_t lo = 0, hi = fl->num;
+  while (lo < hi)
+  {
+    size_t mid = lo + (hi - lo) / 2;
+    if (fl->lines[mid].offset < offset)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if ((lo < fl->num) && (fl->lines[lo].offset == offset))
+    return &fl->lines[lo];
+  return NULL;
+}
+
+/**
+ * record_line - Record a line that's about to be displayed
+ * @param s  State of text being processed
+ * @param ql Quote level
+ */
+static void record_line(struct State *s, int ql)
+{
+  struct FlowedLines *fl = Recording;
+  if (!fl || (s->fpout != fl->fp) || s->prefix || !(s->flags & MUTT_DISPLAY))
+    return;
+
+  LOFF_T offset = ftello(s->fpout);
+  if ((offset < 0) || ((fl->num > 0) && (offset <= fl->lines[fl->num - 1].offset)))
+    return;
+
+  if (fl->num == fl->max)
+  {
+    fl->max = fl->max ? fl->max * 2 : 256;
+    mutt_mem_realloc(&fl->lines, fl->max * sizeof(struct FlowedLine));
+  }
+
+  struct FlowedLine *line = &fl->lines[fl->num++];
+  line->offset = offset;
+  /* like the default $quote_regex, the prefix doesn't include the last space */
+  if (ql == 0)
+    line->quote = 0;
+  else
+    line->quote = space_quotes(s) ? (ql * 2 - 1) : ql;
+}
+
 static size_t print_indent(int ql, struct State *s, int add_suffix)
 {
   size_t wid = 0;
 
+  record_line(s, ql);
+
   if (s->prefix)
   {
     /* use given prefix only for format=fixed replies to format=flowed,
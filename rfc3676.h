@@ -25,11 +25,40 @@
 #ifndef _MUTT_RFC3676_H
 #define _MUTT_RFC3676_H
 
+#include <stdio.h>
+
 struct Body;
 struct Header;
 struct State;
 
+/**
+ * struct FlowedLine - A line written by the format=flowed handler
+ */
+struct FlowedLine
+{
+  LOFF_T offset; /**< Where the line starts in the output file */
+  int quote;     /**< Length of its quote prefix, e.g. 3 for "> > text" */
+};
+
+/**
+ * struct FlowedLines - Lines written by the format=flowed handler
+ *
+ * The handler knows how deeply each line it writes is quoted.  The pager uses
+ * this rather than looking for the quotes again with $quote_regex.
+ */
+struct FlowedLines
+{
+  FILE *fp;                 /**< Only lines written to this file are kept */
+  struct FlowedLine *lines; /**< Lines, in file order */
+  size_t num;               /**< Number of lines */
+  size_t max;               /**< Size of the array */
+};
+
 int rfc3676_handler(struct Body *a, struct State *s);
 void rfc3676_space_stuff(struct Header *hdr);
 
+struct FlowedLine *rfc3676_lines_find(struct FlowedLines *fl, LOFF_T offset);
+void rfc3676_lines_free(struct FlowedLines *fl);
+void rfc3676_lines_record(struct FlowedLines *fl);
+
 #endif /* _MUTT_RFC3676_H */
@@ -46,10 +46,43 @@ struct Score
   int val;
   int exact; /**< if this rule matches, don't evaluate any more */
   struct Score *next;
+  unsigned char *filter; /**< Prefilter of the rule, during a pass over a mailbox */
+  bool filter_exact;     /**< The prefilter is the rule's whole verdict */
 };
 
 static struct Score *ScoreList = NULL;
 
+static void score_message(struct Context *ctx, struct Header *hdr, int msgno, int upd_ctx);
+
+/**
+ * mutt_score_mailbox - Score every message in a mailbox
+ * @param ctx Mailbox
+ *
+ * Each rule that looks at dates, sizes or addresses is matched against the
+ * whole mailbox at once, from the message columns and the address index, so
+ * a message only runs the rules that the prefilters can't decide.  Rules that
+ * test the score themselves (~n) are left to each message, as the scores
+ * change during the pass.
+ */
+void mutt_score_mailbox(struct Context *ctx)
+{
+  if (!ctx || !ScoreList)
+    return;
+
+  for (struct Score *tmp = ScoreList; tmp; tmp = tmp->next)
+  {
+    if (mutt_pattern_deps(tmp->pat) & MUTT_PAT_DEP_OTHER)
+      continue;
+    tmp->filter = mutt_pattern_prefilter(ctx, tmp->pat, &tmp->filter_exact);
+  }
+
+  for (int i = 0; i < ctx->msgcount; i++)
+    score_message(ctx, ctx->hdrs[i], i, 1);
+
+  for (struct Score *tmp = ScoreList; tmp; tmp = tmp->next)
+    FREE(&tmp->filter);
+}
+
 void mutt_check_rescore(struct Context *ctx)
 {
   if (OPT_NEED_RESCORE && Score)
@@ -65,11 +98,9 @@ void mutt_check_rescore(struct Context *ctx)
     mutt_set_menu_redraw_full(MENU_MAIN);
     mutt_set_menu_redraw_full(MENU_PAGER);
 
+    mutt_score_mailbox(ctx);
     for (int i = 0; ctx && i < ctx->msgcount; i++)
-    {
-      mutt_score_message(ctx, ctx->hdrs[i], 1);
       ctx->hdrs[i]->pair = 0;
-    }
   }
   OPT_NEED_RESCORE = false;
 }
@@ -80,6 +111,7 @@ int mutt_parse_score(struct Buffer *buf, struct Buffer *s, unsigned long data,
   struct Score *ptr = NULL, *last = NULL;
   char *pattern = NULL, *pc = NULL;
   struct Pattern *pat = NULL;
+  bool changed = false;
 
   mutt_extract_token(buf, s, 0);
   if (!MoreArgs(s))
@@ -117,6 +149,7 @@ int mutt_parse_score(struct Buffer *buf, struct Buffer *s, unsigned long data,
       ScoreList = ptr;
     ptr->pat = pat;
     ptr->str = pattern;
+    changed = true;
   }
   else
     /* 'buf' arg was cleared and 'pattern' holds the only reference;
@@ -127,20 +160,32 @@ int mutt_parse_score(struct Buffer *buf, struct Buffer *s, unsigned long data,
   pc = buf->data;
   if (*pc == '=')
   {
+    if (!ptr->exact)
+      changed = true;
     ptr->exact = 1;
     pc++;
   }
+  const int old_val = ptr->val;
   if (mutt_str_atoi(pc, &ptr->val) < 0)
   {
     FREE(&pattern);
     mutt_str_strfcpy(err->data, _("Error: score: invalid number"), err->dsize);
     return -1;
   }
-  OPT_NEED_RESCORE = true;
+  /* restating a rule leaves the scores as they are */
+  if (changed || (ptr->val != old_val))
+    OPT_NEED_RESCORE = true;
   return 0;
 }
 
-void mutt_score_message(struct Context *ctx, struct Header *hdr, int upd_ctx)
+/**
+ * score_message - Score a message
+ * @param ctx     Mailbox
+ * @param hdr     Email
+ * @param msgno   Index of the email into the rules' prefilters, or -1
+ * @param upd_ctx If true, update the mailbox's flag counts
+ */
+static void score_message(struct Context *ctx, struct Header *hdr, int msgno, int upd_ctx)
 {
   struct Score *tmp = NULL;
   struct PatternCache cache;
@@ -149,7 +194,13 @@ void mutt_score_message(struct Context *ctx, struct Header *hdr, int upd_ctx)
   hdr->score = 0; /* in case of re-scoring */
   for (tmp = ScoreList; tmp; tmp = tmp->next)
   {
-    if (mutt_pattern_exec(tmp->pat, MUTT_MATCH_FULL_ADDRESS, NULL, hdr, &cache) > 0)
+    int match;
+    if ((msgno >= 0) && tmp->filter && (!tmp->filter[msgno] || tmp->filter_exact))
+      match = tmp->filter[msgno];
+    else
+      match = (mutt_pattern_exec(tmp->pat, MUTT_MATCH_FULL_ADDRESS, NULL, hdr, &cache) > 0);
+
+    if (match)
     {
       if (tmp->exact || tmp->val == 9999 || tmp->val == -9999)
       {
@@ -159,8 +210,29 @@ void mutt_score_message(struct Context *ctx, struct Header *hdr, int upd_ctx)
       hdr->score += tmp->val;
     }
   }
-  if (hdr->score < 0)
-    hdr->score = 0;
+  mutt_score_set(ctx, hdr, hdr->score, upd_ctx);
+}
+
+void mutt_score_message(struct Context *ctx, struct Header *hdr, int upd_ctx)
+{
+  score_message(ctx, hdr, -1, upd_ctx);
+}
+
+/**
+ * mutt_score_set - Give a message a score
+ * @param ctx     Mailbox
+ * @param hdr     Email
+ * @param score   Score, negative scores become 0
+ * @param upd_ctx If true, update the mailbox's flag counts
+ *
+ * The $score_threshold_* variables are applied to the new score.
+ */
+void mutt_score_set(struct Context *ctx, struct Header *hdr, int score, int upd_ctx)
+{
+  hdr->score = (score < 0) ? 0 : score;
+
+  if (ctx && (hdr->msgno < ctx->cols.max) && (ctx->cols.hdr[hdr->msgno] == hdr))
+    ctx->cols.score[hdr->msgno] = hdr->score;
 
   if (hdr->score <= ScoreThresholdDelete)
     mutt_set_flag_update(ctx, hdr, MUTT_DELETE, 1, upd_ctx);
@@ -0,0 +1,533 @@
+/**
+ * @file
+ * Remember which text each message could contain
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page search_index Remember which text each message could contain
+ *
+ * A body search (~b or ~B) has to open and decode every message in the
+ * folder.  With $search_index, each message that has been searched once gets
+ * a signature: a Bloom filter of the trigrams (three character sequences) of
+ * its decoded text.  The next search can skip any message whose signature
+ * lacks one of the trigrams of the text being looked for.  The signature
+ * can't rule in a message, only rule it out, so the matching is unchanged.
+ *
+ * The signatures of a folder are kept together in its header cache, as one
+ * record.  Each is filed under a fingerprint of its message, so it survives
+ * the message moving within the folder.  Encrypted messages are never
+ * indexed, so their text doesn't leak into the cache.
+ *
+ * | Function                     | Description
+ * | :--------------------------- | :--------------------------------------------
+ * | mutt_search_index_add()      | Store the signature of a message
+ * | mutt_search_index_close()    | Save the signatures and free the index
+ * | mutt_search_index_excludes() | Can a message be skipped?
+ * | mutt_search_index_get()      | Get the index of a folder
+ * | mutt_search_index_has()      | Does a message have a signature?
+ * | mutt_search_sig_feed()       | Add text to a signature
+ * | mutt_search_sig_free()       | Free a signature
+ * | mutt_search_sig_new()        | Start the signature of a message
+ */
+
+#include "config.h"
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "mutt/mutt.h"
+#include "search_index.h"
+#include "body.h"
+#include "context.h"
+#include "envelope.h"
+#include "globals.h"
+#include "header.h"
+#include "mx.h"
+#include "options.h"
+#include "hcache/hcache.h"
+
+/* Key of the record in the header cache */
+#define SEARCH_INDEX_KEY "/SEARCHINDEX"
+/* Start of the record */
+#define SEARCH_INDEX_MAGIC "NMSIDX1"
+/* Bits of the Bloom filter per distinct trigram */
+#define SEARCH_INDEX_BITS 3
+/* Largest Bloom filter, in bytes */
+#define SEARCH_INDEX_MAX_BYTES 65536
+
+/**
+ * struct SearchIndexHeader - Start of the record in the header cache
+ */
+struct SearchIndexHeader
+{
+  char magic[8];         /**< SEARCH_INDEX_MAGIC */
+  uint64_t size;         /**< Size of the whole record */
+  char settings[40];     /**< Fingerprint of the config that shapes the text */
+};
+
+/**
+ * struct SearchSig - The signature of a message, while it's being built
+ */
+struct SearchSig
+{
+  uint32_t *set;   /**< Distinct trigrams + 1, 0 is empty */
+  size_t setmax;   /**< Size of set, a power of 2 */
+  size_t count;    /**< Number of distinct trigrams */
+  uint32_t last;   /**< Last two characters fed in */
+  size_t seen;     /**< Characters fed in */
+};
+
+/**
+ * struct SearchEntry - The signature of a message
+ */
+struct SearchEntry
+{
+  unsigned char md5[16]; /**< Fingerprint of the message */
+  uint32_t nbytes;       /**< Size of the Bloom filter */
+  unsigned char *bits;   /**< Bloom filter */
+};
+
+/**
+ * struct SearchIndex - The signatures of a folder
+ */
+struct SearchIndex
+{
+  struct Hash *entries; /**< Fingerprint (hex) -> SearchEntry */
+  bool dirty;           /**< Signatures have been added */
+};
+
+/**
+ * trigram_hash - Scatter the bits of a trigram
+ * @param t Trigram
+ * @retval num Hash
+ */
+static uint32_t trigram_hash(uint32_t t)
+{
+  t ^= t >> 16;
+  t *= 0x85ebca6b;
+  t ^= t >> 13;
+  t *= 0xc2b2ae35;
+  t ^= t >> 16;
+  return t;
+}
+
+/**
+ * ascii_lower - Fold an ASCII letter to lower case
+ * @param c Character
+ * @retval num Folded character
+ *
+ * The index outlives the locale, so it doesn't use tolower().
+ */
+static uint32_t ascii_lower(char c)
+{
+  unsigned char u = c;
+
+  return ((u >= 'A') && (u <= 'Z')) ? (u + 'a' - 'A') : u;
+}
+
+/**
+ * search_settings - Fingerprint the config that shapes the decoded text
+ * @param buf    Buffer for the fingerprint, in hex
+ * @param buflen Length of the buffer
+ *
+ * If any of these change, the text of a message would, too, and every
+ * signature has to be rebuilt.
+ */
+static void search_settings(char *buf, size_t buflen)
+{
+  struct Buffer *b = mutt_buffer_new();
+  struct ListNode *np = NULL;
+  unsigned char md5[16];
+  char hex[33];
+
+  mutt_buffer_printf(b, "%s|%d%d%d%d|", NONULL(Charset), HonorDisposition,
+                     ImplicitAutoview, IncludeOnlyfirst, ReflowText);
+  STAILQ_FOREACH(np, &AlternativeOrderList, entries)
+  {
+    mutt_buffer_addstr(b, np->data);
+    mutt_buffer_addch(b, ' ');
+  }
+  mutt_buffer_addch(b, '|');
+  STAILQ_FOREACH(np, &AutoViewList, entries)
+  {
+    mutt_buffer_addstr(b, np->data);
+    mutt_buffer_addch(b, ' ');
+  }
+
+  mutt_md5(b->data, md5);
+  mutt_md5_toascii(md5, hex);
+  mutt_str_strfcpy(buf, hex, buflen);
+  mutt_buffer_free(&b);
+}
+
+/**
+ * search_fingerprint - Identify a message, wherever it is in the folder
+ * @param[in]  h   Email Header
+ * @param[out] md5 Fingerprint
+ *
+ * The header length changes with the flags of an mbox message, so an
+ * updated Status header gets a new signature.  The flags of a Maildir
+ * message are in its filename, so they're left out.
+ */
+static void search_fingerprint(const struct Header *h, unsigned char md5[16])
+{
+  char buf[LONG_STRING];
+  const char *path = NONULL(h->path);
+  const char *flags = strchr(path, ':');
+
+  snprintf(buf, sizeof(buf), "%.*s|%s|%ld|%ld|" OFF_T_FMT "|" OFF_T_FMT "|%d",
+           flags ? (int) (flags - path) : (int) strlen(path), path,
+           NONULL(h->env ? h->env->message_id : NULL), (long) h->date_sent,
+           (long) h->received, (LOFF_T) (h->content->offset - h->offset),
+           (LOFF_T) h->content->length, h->lines);
+  mutt_md5(buf, md5);
+}
+
+/**
+ * search_entry_free - Free a SearchEntry
+ * @param type Hash type, unused
+ * @param obj  SearchEntry
+ * @param data Unused
+ */
+static void search_entry_free(int type, void *obj, intptr_t data)
+{
+  struct SearchEntry *e = obj;
+
+  FREE(&e->bits);
+  FREE(&e);
+}
+
+/**
+ * search_index_load - Read the signatures from the header cache
+ * @param si  Index
+ * @param hc  Header cache
+ */
+static void search_index_load(struct SearchIndex *si, header_cache_t *hc)
+{
+  const unsigned char *data = mutt_hcache_fetch_raw(hc, SEARCH_INDEX_KEY,
+                                                    sizeof(SEARCH_INDEX_KEY) - 1);
+  if (!data)
+    return;
+
+  struct SearchIndexHeader sh;
+  char settings[sizeof(sh.settings)];
+  memcpy(&sh, data, sizeof(sh));
+  search_settings(settings, sizeof(settings));
+  if ((memcmp(sh.magic, SEARCH_INDEX_MAGIC, sizeof(sh.magic)) != 0) ||
+      (strncmp(sh.settings, settings, sizeof(settings)) != 0))
+  {
+    /* Other decoding rules, so other text */
+    mutt_debug(2, "search index is out of date\n");
+    mutt_hcache_free(hc, (void **) &data);
+    return;
+  }
+
+  size_t count = 0;
+  for (size_t pos = sizeof(sh); pos + 20 <= sh.size;)
+  {
+    struct SearchEntry *e = mutt_mem_calloc(1, sizeof(struct SearchEntry));
+    char hex[33];
+
+    memcpy(e->md5, data + pos, 16);
+    memcpy(&e->nbytes, data + pos + 16, 4);
+    pos += 20;
+    if ((e->nbytes == 0) || (e->nbytes > SEARCH_INDEX_MAX_BYTES) ||
+        (pos + e->nbytes > sh.size))
+    {
+      FREE(&e);
+      break;
+    }
+    e->bits = mutt_mem_malloc(e->nbytes);
+    memcpy(e->bits, data + pos, e->nbytes);
+    pos += e->nbytes;
+
+    mutt_md5_toascii(e->md5, hex);
+    mutt_hash_insert(si->entries, hex, e);
+    count++;
+  }
+
+  mutt_debug(2, "%zu search signatures\n", count);
+  mutt_hcache_free(hc, (void **) &data);
+}
+
+/**
+ * mutt_search_index_get - Get the index of a folder
+ * @param ctx Mailbox
+ * @retval ptr  Index
+ * @retval NULL The folder isn't indexed
+ *
+ * The index is read from the header cache the first time it's needed.
+ */
+struct SearchIndex *mutt_search_index_get(struct Context *ctx)
+{
+  if (!SearchIndex || !ThoroughSearch || !HeaderCache || !ctx)
+    return NULL;
+  if ((ctx->magic != MUTT_MBOX) && (ctx->magic != MUTT_MMDF) &&
+      (ctx->magic != MUTT_MAILDIR) && (ctx->magic != MUTT_MH))
+  {
+    return NULL;
+  }
+  if (ctx->search_index)
+    return ctx->search_index;
+
+  struct SearchIndex *si = mutt_mem_calloc(1, sizeof(struct SearchIndex));
+  si->entries = mutt_hash_create(MAX(ctx->msgcount, 64), MUTT_HASH_STRDUP_KEYS);
+  mutt_hash_set_destructor(si->entries, search_entry_free, 0);
+
+  header_cache_t *hc = mutt_hcache_open(HeaderCache, ctx->path, NULL);
+  if (hc)
+  {
+    search_index_load(si, hc);
+    mutt_hcache_close(hc);
+  }
+  ctx->search_index = si;
+  return si;
+}
+
+/**
+ * mutt_search_index_close - Save the signatures and free the index
+ * @param ctx Mailbox, with its messages
+ *
+ * Only the signatures of messages still in the folder are saved.
+ */
+void mutt_search_index_close(struct Context *ctx)
+{
+  struct SearchIndex *si = ctx->search_index;
+  if (!si)
+    return;
+
+  header_cache_t *hc = NULL;
+  if (si->dirty && ctx->path && (hc = mutt_hcache_open(HeaderCache, ctx->path, NULL)))
+  {
+    struct Buffer *buf = mutt_buffer_new();
+    struct SearchIndexHeader sh;
+    size_t kept = 0;
+
+    memset(&sh, 0, sizeof(sh));
+    memcpy(sh.magic, SEARCH_INDEX_MAGIC, sizeof(sh.magic));
+    search_settings(sh.settings, sizeof(sh.settings));
+    mutt_buffer_add(buf, (const char *) &sh, sizeof(sh));
+
+    for (int i = 0; i < ctx->msgcount; i++)
+    {
+      unsigned char md5[16];
+      char hex[33];
+
+      search_fingerprint(ctx->hdrs[i], md5);
+      mutt_md5_toascii(md5, hex);
+      struct SearchEntry *e = mutt_hash_find(si->entries, hex);
+      if (!e)
+        continue;
+
+      mutt_buffer_add(buf, (const char *) e->md5, 16);
+      mutt_buffer_add(buf, (const char *) &e->nbytes, 4);
+      mutt_buffer_add(buf, (const char *) e->bits, e->nbytes);
+      /* a duplicate message is saved once */
+      mutt_hash_delete(si->entries, hex, e);
+      kept++;
+    }
+
+    sh.size = buf->dptr - buf->data;
+    memcpy(buf->data, &sh, sizeof(sh));
+    mutt_hcache_store_raw(hc, SEARCH_INDEX_KEY, sizeof(SEARCH_INDEX_KEY) - 1,
+                          buf->data, sh.size);
+    mutt_debug(2, "%s: saved %zu search signatures\n", ctx->path, kept);
+    mutt_buffer_free(&buf);
+    mutt_hcache_close(hc);
+  }
+
+  mutt_hash_destroy(&si->entries);
+  FREE(&ctx->search_index);
+}
+
+/**
+ * mutt_search_index_has - Does a message have a signature?
+ * @param si Index
+ * @param h  Email Header
+ * @retval true The message has a signature
+ */
+bool mutt_search_index_has(struct SearchIndex *si, const struct Header *h)
+{
+  unsigned char md5[16];
+  char hex[33];
+
+  search_fingerprint(h, md5);
+  mutt_md5_toascii(md5, hex);
+  return mutt_hash_find(si->entries, hex) != NULL;
+}
+
+/**
+ * mutt_search_index_excludes - Can a message be skipped?
+ * @param si   Index
+ * @param h    Email Header
+ * @param text Text that any match must contain, ASCII
+ * @retval true The message can't contain the text
+ * @retval false The message must be searched
+ *
+ * The comparison ignores case, so it works for any search.
+ */
+bool mutt_search_index_excludes(struct SearchIndex *si, const struct Header *h,
+                                const char *text)
+{
+  unsigned char md5[16];
+  char hex[33];
+
+  if (!text || (strlen(text) < 3))
+    return false;
+
+  search_fingerprint(h, md5);
+  mutt_md5_toascii(md5, hex);
+  const struct SearchEntry *e = mutt_hash_find(si->entries, hex);
+  if (!e)
+    return false;
+
+  const uint32_t nbits = e->nbytes * 8;
+  uint32_t t = 0;
+  for (size_t i = 0; text[i]; i++)
+  {
+    t = ((t << 8) | ascii_lower(text[i])) & 0xffffff;
+    if (i < 2)
+      continue;
+    uint32_t bit = trigram_hash(t) % nbits;
+    if (!(e->bits[bit / 8] & (1 << (bit % 8))))
+      return true;
+  }
+
+  return false;
+}
+
+/**
+ * mutt_search_sig_new - Start the signature of a message
+ * @retval ptr New signature, to be fed with mutt_search_sig_feed()
+ */
+struct SearchSig *mutt_search_sig_new(void)
+{
+  struct SearchSig *sig = mutt_mem_calloc(1, sizeof(struct SearchSig));
+
+  sig->setmax = 1024;
+  sig->set = mutt_mem_calloc(sig->setmax, sizeof(uint32_t));
+  return sig;
+}
+
+/**
+ * search_sig_insert - Remember a trigram
+ * @param sig Signature
+ * @param t   Trigram
+ */
+static void search_sig_insert(struct SearchSig *sig, uint32_t t)
+{
+  size_t mask = sig->setmax - 1;
+
+  for (size_t i = trigram_hash(t) & mask;; i = (i + 1) & mask)
+  {
+    if (sig->set[i] == t + 1)
+      return;
+    if (sig->set[i] == 0)
+    {
+      sig->set[i] = t + 1;
+      sig->count++;
+      break;
+    }
+  }
+
+  /* keep the set no more than half full */
+  if (sig->count * 2 > sig->setmax)
+  {
+    uint32_t *old = sig->set;
+    size_t oldmax = sig->setmax;
+
+    sig->setmax *= 2;
+    sig->set = mutt_mem_calloc(sig->setmax, sizeof(uint32_t));
+    sig->count = 0;
+    for (size_t i = 0; i < oldmax; i++)
+      if (old[i])
+        search_sig_insert(sig, old[i] - 1);
+    FREE(&old);
+  }
+}
+
+/**
+ * mutt_search_sig_feed - Add text to a signature
+ * @param sig  Signature
+ * @param data Text
+ * @param len  Length of the text
+ */
+void mutt_search_sig_feed(struct SearchSig *sig, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    sig->last = ((sig->last << 8) | ascii_lower(data[i])) & 0xffffff;
+    if (++sig->seen >= 3)
+      search_sig_insert(sig, sig->last);
+  }
+}
+
+/**
+ * mutt_search_sig_free - Free a signature
+ * @param sig Signature to free
+ */
+void mutt_search_sig_free(struct SearchSig **sig)
+{
+  if (!sig || !*sig)
+    return;
+
+  FREE(&(*sig)->set);
+  FREE(sig);
+}
+
+/**
+ * mutt_search_index_add - Store the signature of a message
+ * @param si  Index
+ * @param h   Email Header
+ * @param sig Signature, all the text of the message, freed
+ */
+void mutt_search_index_add(struct SearchIndex *si, const struct Header *h,
+                           struct SearchSig **sig)
+{
+  struct SearchSig *s = *sig;
+  struct SearchEntry *e = mutt_mem_calloc(1, sizeof(struct SearchEntry));
+  char hex[33];
+
+  /* A message too big for its filter gets all the bits set, which excludes
+   * nothing, but saves searching for its trigrams again */
+  size_t nbytes = (s->count * SEARCH_INDEX_BITS + 7) / 8;
+  e->nbytes = MAX(8, MIN(nbytes, SEARCH_INDEX_MAX_BYTES));
+  e->bits = mutt_mem_calloc(1, e->nbytes);
+  if (nbytes > SEARCH_INDEX_MAX_BYTES)
+    memset(e->bits, 0xff, e->nbytes);
+  else
+  {
+    const uint32_t nbits = e->nbytes * 8;
+    for (size_t i = 0; i < s->setmax; i++)
+    {
+      if (!s->set[i])
+        continue;
+      uint32_t bit = trigram_hash(s->set[i] - 1) % nbits;
+      e->bits[bit / 8] |= (1 << (bit % 8));
+    }
+  }
+
+  search_fingerprint(h, e->md5);
+  mutt_md5_toascii(e->md5, hex);
+  if (mutt_hash_find(si->entries, hex))
+    mutt_hash_delete(si->entries, hex, NULL);
+  mutt_hash_insert(si->entries, hex, e);
+  si->dirty = true;
+
+  mutt_search_sig_free(sig);
+}
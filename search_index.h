@@ -0,0 +1,41 @@
+/**
+ * @file
+ * Remember which text each message could contain
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_SEARCH_INDEX_H
+#define _MUTT_SEARCH_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+struct Context;
+struct Header;
+struct SearchIndex;
+struct SearchSig;
+
+void                mutt_search_index_add(struct SearchIndex *si, const struct Header *h, struct SearchSig **sig);
+void                mutt_search_index_close(struct Context *ctx);
+bool                mutt_search_index_excludes(struct SearchIndex *si, const struct Header *h, const char *text);
+struct SearchIndex *mutt_search_index_get(struct Context *ctx);
+bool                mutt_search_index_has(struct SearchIndex *si, const struct Header *h);
+
+void              mutt_search_sig_feed(struct SearchSig *sig, const char *data, size_t len);
+void              mutt_search_sig_free(struct SearchSig **sig);
+struct SearchSig *mutt_search_sig_new(void);
+
+#endif /* _MUTT_SEARCH_INDEX_H */
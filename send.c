@@ -50,6 +50,7 @@
 #include "protos.h"
 #include "rfc2047.h"
 #include "rfc3676.h"
+#include "sendqueue.h"
 #include "sort.h"
 #include "url.h"
 #ifdef USE_NNTP
@@ -1111,6 +1112,13 @@ static int send_message(struct Header *msg)
     return mix_send_message(&msg->chain, tempfile);
 #endif
 
+#ifdef USE_NNTP
+  if (!OPT_NEWS_SEND)
+#endif
+    if (SendQueue && *SendQueue)
+      return mutt_queue_message(msg->env->from, msg->env->to, msg->env->cc, msg->env->bcc,
+                                tempfile, (msg->content->encoding == ENC8BIT));
+
 #ifdef USE_SMTP
 #ifdef USE_NNTP
   if (!OPT_NEWS_SEND)
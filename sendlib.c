@@ -58,6 +58,9 @@
 #include "rfc2047.h"
 #include "rfc2231.h"
 #include "state.h"
+#ifdef USE_IMAP
+#include "imap/imap.h"
+#endif
 #ifdef USE_NNTP
 #include "nntp.h"
 #endif
@@ -215,6 +218,7 @@ struct B64Context
   char buffer[3];
   short size;
   short linelen;
+  char line[80]; /**< Encoded line, written out when it's full */
 };
 
 static int b64_init(struct B64Context *ctx)
@@ -226,6 +230,18 @@ static int b64_init(struct B64Context *ctx)
   return 0;
 }
 
+/**
+ * b64_write_line - Write out the encoded line
+ * @param ctx  Base64 context
+ * @param fout File to write to
+ */
+static void b64_write_line(struct B64Context *ctx, FILE *fout)
+{
+  fwrite(ctx->line, 1, ctx->linelen, fout);
+  fputc('\n', fout);
+  ctx->linelen = 0;
+}
+
 static void b64_flush(struct B64Context *ctx, FILE *fout)
 {
   /* for some reasons, mutt_b64_encode expects the
@@ -237,20 +253,14 @@ static void b64_flush(struct B64Context *ctx, FILE *fout)
     return;
 
   if (ctx->linelen >= 72)
-  {
-    fputc('\n', fout);
-    ctx->linelen = 0;
-  }
+    b64_write_line(ctx, fout);
 
   /* ret should always be equal to 4 here, because ctx->size
    * is a value between 1 and 3 (included), but let's not hardcode it
    * and prefer the return value of the function */
   ret = mutt_b64_encode(encoded, ctx->buffer, ctx->size, sizeof(encoded));
   for (size_t i = 0; i < ret; i++)
-  {
-    fputc(encoded[i], fout);
-    ctx->linelen++;
-  }
+    ctx->line[ctx->linelen++] = encoded[i];
 
   ctx->size = 0;
 }
@@ -283,7 +293,7 @@ static void encode_base64(struct FgetConv *fc, FILE *fout, int istext)
     ch1 = ch;
   }
   b64_flush(&ctx, fout);
-  fputc('\n', fout);
+  b64_write_line(&ctx, fout);
 }
 
 static void encode_8bit(struct FgetConv *fc, FILE *fout)
@@ -505,6 +515,38 @@ void mutt_generate_boundary(struct ParameterList *parm)
   mutt_param_set(parm, "boundary", rs);
 }
 
+/* Classes of byte for update_content_info(), see ContentClass */
+#define CC_OTHER 0 /**< Needs a closer look: line ends, white space */
+#define CC_ASCII 1 /**< Printable ASCII */
+#define CC_HIBIN 2 /**< 8-bit */
+#define CC_LOBIN 3 /**< Unprintable 7-bit */
+#define CC_NUL   4 /**< Null */
+
+/**
+ * ContentClass - How update_content_info() counts each byte
+ */
+static unsigned char ContentClass[256];
+
+/**
+ * content_class_init - Fill in ContentClass
+ */
+static void content_class_init(void)
+{
+  for (int i = 0; i < 256; i++)
+  {
+    if (i & 0x80)
+      ContentClass[i] = CC_HIBIN;
+    else if ((i == '\n') || (i == '\r') || (i == '\t') || (i == '\f') || (i == ' '))
+      ContentClass[i] = CC_OTHER;
+    else if (i == 0)
+      ContentClass[i] = CC_NUL;
+    else if ((i < 32) || (i == 127))
+      ContentClass[i] = CC_LOBIN;
+    else
+      ContentClass[i] = CC_ASCII;
+  }
+}
+
 /**
  * struct ContentState - Info about the body of an email
  */
@@ -536,8 +578,41 @@ static void update_content_info(struct Content *info, struct ContentState *s,
     return;
   }
 
+  if (!ContentClass['a'])
+    content_class_init();
+
   for (; dlen; d++, dlen--)
   {
+    /* Once past the start of a line, where "From " and "." are checked for,
+     * most bytes only need to be counted */
+    if ((linelen >= 4) && !was_cr)
+    {
+      long counts[5] = { 0 };
+      size_t n = 0;
+      int cc;
+
+      while ((n < dlen) && ((cc = ContentClass[(unsigned char) d[n]]) != CC_OTHER))
+      {
+        counts[cc]++;
+        n++;
+      }
+
+      if (n > 0)
+      {
+        info->ascii += counts[CC_ASCII];
+        info->hibin += counts[CC_HIBIN];
+        info->lobin += counts[CC_LOBIN] + counts[CC_NUL];
+        info->nulbin += counts[CC_NUL];
+        linelen += n;
+        dot = 0;
+        whitespace = 0;
+        d += n;
+        dlen -= n;
+        if (!dlen)
+          break;
+      }
+    }
+
     char ch = *d;
 
     if (was_cr)
@@ -673,7 +748,7 @@ static size_t convert_file_to(FILE *file, const char *fromcode, int ncodes,
                               const char **tocodes, int *tocode, struct Content *info)
 {
   iconv_t cd1, *cd = NULL;
-  char bufi[256], bufu[512], bufo[4 * sizeof(bufi)];
+  char bufi[4096], bufu[2 * sizeof(bufi)], bufo[4 * sizeof(bufi)];
   const char *ib = NULL, *ub = NULL;
   char *ob = NULL;
   size_t ibl, obl, ubl, ubl1, n, ret;
@@ -796,9 +871,9 @@ static size_t convert_file_to(FILE *file, const char *fromcode, int ncodes,
 
   for (int i = 0; i < ncodes; i++)
     if (cd[i] != (iconv_t)(-1))
-      iconv_close(cd[i]);
+      mutt_ch_iconv_close(cd[i]);
 
-  iconv_close(cd1);
+  mutt_ch_iconv_close(cd1);
   FREE(&cd);
   FREE(&infos);
   FREE(&score);
@@ -903,7 +978,7 @@ struct Content *mutt_get_content_info(const char *fname, struct Body *b)
   FILE *fp = NULL;
   char *fromcode = NULL;
   char *tocode = NULL;
-  char buffer[100];
+  char buffer[4096];
   char chsbuf[STRING];
   size_t r;
 
@@ -1493,6 +1568,9 @@ struct Body *mutt_make_file_attach(const char *path)
     run_mime_type_query(att);
   }
 
+  /* with the type known, the analysis below is the final one */
+  const bool typed = att->subtype && !mutt_param_get(&att->parameter, "charset");
+
   info = mutt_get_content_info(path, att);
   if (!info)
   {
@@ -1519,6 +1597,17 @@ struct Body *mutt_make_file_attach(const char *path)
     }
   }
 
+  /* The file has been analysed as the type it ends up with, so there's no
+   * need for mutt_update_encoding() to read it again.  Only a file which
+   * turned out to be text still needs its charset working out. */
+  if (typed || (att->type != TYPETEXT))
+  {
+    set_encoding(att, info);
+    mutt_stamp_attachment(att);
+    att->content = info;
+    return att;
+  }
+
   FREE(&info);
   mutt_update_encoding(att);
   return att;
@@ -1608,6 +1697,7 @@ struct Body *mutt_remove_multipart(struct Body *b)
 void mutt_write_address_list(struct Address *addr, FILE *fp, int linelen, bool display)
 {
   struct Address *tmp = NULL;
+  struct Buffer *out = mutt_buffer_alloc(LONG_STRING);
   char buf[LONG_STRING];
   int count = 0;
   size_t len;
@@ -1617,33 +1707,36 @@ void mutt_write_address_list(struct Address *addr, FILE *fp, int linelen, bool d
     tmp = addr->next;
     addr->next = NULL;
     buf[0] = 0;
-    mutt_addr_write(buf, sizeof(buf), addr, display);
-    len = mutt_str_strlen(buf);
+    len = mutt_addr_write(buf, sizeof(buf), addr, display);
     if (count && linelen + len > 74)
     {
-      fputs("\n\t", fp);
+      mutt_buffer_addstr(out, "\n\t");
       linelen = len + 8; /* tab is usually about 8 spaces... */
     }
     else
     {
       if (count && addr->mailbox)
       {
-        fputc(' ', fp);
+        mutt_buffer_addch(out, ' ');
         linelen++;
       }
       linelen += len;
     }
-    fputs(buf, fp);
+    mutt_buffer_add(out, buf, len);
     addr->next = tmp;
     if (!addr->group && addr->next && addr->next->mailbox)
     {
       linelen++;
-      fputc(',', fp);
+      mutt_buffer_addch(out, ',');
     }
     addr = addr->next;
     count++;
   }
-  fputc('\n', fp);
+  mutt_buffer_addch(out, '\n');
+
+  /* the whole list goes out in one write */
+  fwrite(out->data, 1, out->dptr - out->data, fp);
+  mutt_buffer_free(&out);
 }
 
 /* arbitrary number of elements to grow the array by */
@@ -1688,53 +1781,82 @@ void mutt_write_references(const struct ListHead *r, FILE *f, size_t trim)
   FREE(&ref);
 }
 
-static int print_val(FILE *fp, const char *pfx, const char *value, int flags, size_t col)
+/**
+ * print_val - Add a header value to a Buffer
+ * @param out   Buffer for the header
+ * @param pfx   Prefix for each continuation line, may be NULL
+ * @param value Header value
+ * @param len   Length of the value
+ * @param flags Flags, e.g. #CH_DISPLAY
+ * @param col   Column the value starts in
+ *
+ * The value is copied a line at a time, only the line breaks need looking at.
+ */
+static void print_val(struct Buffer *out, const char *pfx, const char *value,
+                      size_t len, int flags, size_t col)
 {
-  while (value && *value)
+  const bool display = (flags & CH_DISPLAY);
+  const char *end = value + len;
+
+  while (value < end)
   {
-    if (fputc(*value, fp) == EOF)
-      return -1;
+    const char *nl = memchr(value, '\n', end - value);
+    size_t n = nl ? (nl + 1 - value) : (end - value);
+    bool force = false;
+
     /* corner-case: break words longer than 998 chars by force,
      * mandated by RFC5322 */
-    if (!(flags & CH_DISPLAY) && ++col >= 998)
+    if (!display)
     {
-      if (fputs("\n ", fp) < 0)
-        return -1;
+      const size_t room = (col < 998) ? (998 - col) : 1;
+      if (n >= room)
+      {
+        n = room;
+        force = true;
+      }
+      col += n;
+    }
+
+    mutt_buffer_add(out, value, n);
+    value += n;
+    if (force)
+    {
+      mutt_buffer_addstr(out, "\n ");
       col = 1;
     }
-    if (*value == '\n')
+
+    if (value[-1] != '\n')
+      continue;
+    if ((value < end) && pfx && *pfx)
+      mutt_buffer_addstr(out, pfx);
+    /* for display, turn folding spaces into folding tabs */
+    if (display && (value < end) && (*value == ' ' || *value == '\t'))
     {
-      if (*(value + 1) && pfx && *pfx && fputs(pfx, fp) == EOF)
-        return -1;
-      /* for display, turn folding spaces into folding tabs */
-      if ((flags & CH_DISPLAY) && (*(value + 1) == ' ' || *(value + 1) == '\t'))
-      {
+      while ((value < end) && (*value == ' ' || *value == '\t'))
         value++;
-        while (*value && (*value == ' ' || *value == '\t'))
-          value++;
-        if (fputc('\t', fp) == EOF)
-          return -1;
-        continue;
-      }
+      mutt_buffer_addch(out, '\t');
     }
-    value++;
   }
-  return 0;
 }
 
-static int fold_one_header(FILE *fp, const char *tag, const char *value,
-                           const char *pfx, int wraplen, int flags)
+static void fold_one_header(struct Buffer *out, const char *tag, const char *value,
+                            const char *pfx, int wraplen, int flags)
 {
   const char *p = value, *next = NULL, *sp = NULL;
   char buf[HUGE_STRING] = "";
   int first = 1, enc, col = 0, w, l = 0, fold;
   bool display = (flags & CH_DISPLAY);
+  const int pfxlen = mutt_str_strlen(pfx);
 
   mutt_debug(4, "pfx=[%s], tag=[%s], flags=%d value=[%s]\n", pfx, tag, flags, NONULL(value));
 
-  if (tag && *tag && fprintf(fp, "%s%s: ", NONULL(pfx), tag) < 0)
-    return -1;
-  col = mutt_str_strlen(tag) + (tag && *tag ? 2 : 0) + mutt_str_strlen(pfx);
+  if (tag && *tag)
+  {
+    mutt_buffer_addstr(out, NONULL(pfx));
+    mutt_buffer_addstr(out, tag);
+    mutt_buffer_addstr(out, ": ");
+  }
+  col = mutt_str_strlen(tag) + (tag && *tag ? 2 : 0) + pfxlen;
 
   while (p && *p)
   {
@@ -1759,10 +1881,10 @@ static int fold_one_header(FILE *fp, const char *tag, const char *value,
      * and encoded words */
     if (!first && !enc && col && col + w >= wraplen)
     {
-      col = mutt_str_strlen(pfx);
+      col = pfxlen;
       fold = 1;
-      if (fprintf(fp, "\n%s", NONULL(pfx)) <= 0)
-        return -1;
+      mutt_buffer_addch(out, '\n');
+      mutt_buffer_addstr(out, NONULL(pfx));
     }
 
     /* print the actual word; for display, ignore leading ws for word
@@ -1775,14 +1897,12 @@ static int fold_one_header(FILE *fp, const char *tag, const char *value,
         pc++;
         col--;
       }
-      if (fputc('\t', fp) == EOF)
-        return -1;
-      if (print_val(fp, pfx, pc, flags, col) < 0)
-        return -1;
+      mutt_buffer_addch(out, '\t');
+      print_val(out, pfx, pc, l - (pc - buf), flags, col);
       col += 8;
     }
-    else if (print_val(fp, pfx, buf, flags, col) < 0)
-      return -1;
+    else
+      print_val(out, pfx, buf, l, flags, col);
     col += w;
 
     /* if the current word ends in \n, ignore all its trailing spaces
@@ -1807,10 +1927,7 @@ static int fold_one_header(FILE *fp, const char *tag, const char *value,
   /* if we have printed something but didn't \n-terminate it, do it
    * except the last word we printed ended in \n already */
   if (col && (l == 0 || buf[l - 1] != '\n'))
-    if (putc('\n', fp) == EOF)
-      return -1;
-
-  return 0;
+    mutt_buffer_addch(out, '\n');
 }
 
 static char *unfold_header(char *s)
@@ -1842,8 +1959,8 @@ static char *unfold_header(char *s)
   return s;
 }
 
-static int write_one_header(FILE *fp, int pfxw, int max, int wraplen, const char *pfx,
-                            const char *start, const char *end, int flags)
+static void write_one_header(struct Buffer *out, int pfxw, int max, int wraplen,
+                             const char *pfx, const char *start, const char *end, int flags)
 {
   char *tagbuf = NULL, *valbuf = NULL, *t = NULL;
   int is_from = ((end - start) > 5 && (mutt_str_strncasecmp(start, "from ", 5) == 0));
@@ -1852,31 +1969,17 @@ static int write_one_header(FILE *fp, int pfxw, int max, int wraplen, const char
      never wrap From_ headers on sending */
   if (!(flags & CH_DISPLAY) && (pfxw + max <= wraplen || is_from))
   {
-    valbuf = mutt_str_substr_dup(start, end);
-    mutt_debug(4, "buf[%s%s] short enough, max width = %d <= %d\n", NONULL(pfx),
-               valbuf, max, wraplen);
+    mutt_debug(4, "buf[%s%.*s] short enough, max width = %d <= %d\n", NONULL(pfx),
+               (int) (end - start), start, max, wraplen);
     if (pfx && *pfx)
-    {
-      if (fputs(pfx, fp) == EOF)
-      {
-        FREE(&valbuf);
-        return -1;
-      }
-    }
+      mutt_buffer_addstr(out, pfx);
 
-    t = strchr(valbuf, ':');
-    if (!t)
+    if (!memchr(start, ':', end - start))
     {
       mutt_debug(1, "#1 warning: header not in 'key: value' format!\n");
-      FREE(&valbuf);
-      return 0;
-    }
-    if (print_val(fp, pfx, valbuf, flags, mutt_str_strlen(pfx)) < 0)
-    {
-      FREE(&valbuf);
-      return -1;
+      return;
     }
-    FREE(&valbuf);
+    print_val(out, pfx, start, end - start, flags, mutt_str_strlen(pfx));
   }
   else
   {
@@ -1884,7 +1987,7 @@ static int write_one_header(FILE *fp, int pfxw, int max, int wraplen, const char
     if (!t || t > end)
     {
       mutt_debug(1, "#2 warning: header not in 'key: value' format!\n");
-      return 0;
+      return;
     }
     if (is_from)
     {
@@ -1907,28 +2010,23 @@ static int write_one_header(FILE *fp, int pfxw, int max, int wraplen, const char
     }
     mutt_debug(4, "buf[%s%s] too long, max width = %d > %d\n", NONULL(pfx),
                NONULL(valbuf), max, wraplen);
-    if (fold_one_header(fp, tagbuf, valbuf, pfx, wraplen, flags) < 0)
-    {
-      FREE(&valbuf);
-      FREE(&tagbuf);
-      return -1;
-    }
+    fold_one_header(out, tagbuf, valbuf, pfx, wraplen, flags);
     FREE(&tagbuf);
     FREE(&valbuf);
   }
-  return 0;
 }
 
 /**
  * mutt_write_one_header - Write one header line to a file
  *
  * split several headers into individual ones and call write_one_header
- * for each one
+ * for each one.  The header is put together in memory and written at once.
  */
 int mutt_write_one_header(FILE *fp, const char *tag, const char *value,
                           const char *pfx, int wraplen, int flags)
 {
   char *p = (char *) value, *last = NULL, *line = NULL;
+  struct Buffer *out = NULL;
   int max = 0, w, rc = -1;
   int pfxw = mutt_strwidth(pfx);
   char *v = mutt_str_strdup(value);
@@ -1948,22 +2046,20 @@ int mutt_write_one_header(FILE *fp, const char *tag, const char *value,
   else if (wraplen <= 0 || wraplen > MuttIndexWindow->cols)
     wraplen = MuttIndexWindow->cols;
 
-  if (tag)
+  /* if header is short enough, simply print it */
+  if (tag && !display && mutt_strwidth(tag) + 2 + pfxw + mutt_strwidth(v) <= wraplen)
   {
-    /* if header is short enough, simply print it */
-    if (!display && mutt_strwidth(tag) + 2 + pfxw + mutt_strwidth(v) <= wraplen)
-    {
-      mutt_debug(4, "buf[%s%s: %s] is short enough\n", NONULL(pfx), tag, v);
-      if (fprintf(fp, "%s%s: %s\n", NONULL(pfx), tag, v) <= 0)
-        goto out;
+    mutt_debug(4, "buf[%s%s: %s] is short enough\n", NONULL(pfx), tag, v);
+    if (fprintf(fp, "%s%s: %s\n", NONULL(pfx), tag, v) > 0)
       rc = 0;
-      goto out;
-    }
-    else
-    {
-      rc = fold_one_header(fp, tag, v, pfx, wraplen, flags);
-      goto out;
-    }
+    goto out;
+  }
+
+  out = mutt_buffer_alloc(mutt_str_strlen(v) + STRING);
+  if (tag)
+  {
+    fold_one_header(out, tag, v, pfx, wraplen, flags);
+    goto write;
   }
 
   p = last = line = (char *) v;
@@ -1986,20 +2082,21 @@ int mutt_write_one_header(FILE *fp, const char *tag, const char *value,
     line = ++p;
     if (*p != ' ' && *p != '\t')
     {
-      if (write_one_header(fp, pfxw, max, wraplen, pfx, last, p, flags) < 0)
-        goto out;
+      write_one_header(out, pfxw, max, wraplen, pfx, last, p, flags);
       last = p;
       max = 0;
     }
   }
 
   if (last && *last)
-    if (write_one_header(fp, pfxw, max, wraplen, pfx, last, p, flags) < 0)
-      goto out;
+    write_one_header(out, pfxw, max, wraplen, pfx, last, p ? p : strchr(last, '\0'), flags);
 
-  rc = 0;
+write:
+  if (fwrite(out->data, 1, out->dptr - out->data, fp) == (size_t)(out->dptr - out->data))
+    rc = 0;
 
 out:
+  mutt_buffer_free(&out);
   FREE(&v);
   return rc;
 }
@@ -2892,105 +2989,89 @@ static void set_noconv_flags(struct Body *b, short flag)
 }
 
 /**
- * mutt_write_multiple_fcc - Handle FCC with multiple, comma separated entries
+ * struct FccBody - A message body, written out once for all the Fcc folders
  */
-int mutt_write_multiple_fcc(const char *path, struct Header *hdr, const char *msgid,
-                            int post, char *fcc, char **finalpath)
+struct FccBody
 {
-  char fcc_tok[_POSIX_PATH_MAX];
-  char fcc_expanded[_POSIX_PATH_MAX];
-  char *tok = NULL;
-  int status;
+  char path[_POSIX_PATH_MAX]; /**< Temporary file */
+  FILE *fp;                   /**< Body, ending in a newline */
+  LOFF_T length;              /**< Length of the body */
+  int lines;                  /**< Number of lines in the body */
+};
 
-  mutt_str_strfcpy(fcc_tok, path, sizeof(fcc_tok));
+/**
+ * fcc_body_write - Write the body of an Fcc to a temporary file
+ * @param hdr  Header of the message
+ * @param body Body to fill in
+ * @retval  0 Success
+ * @retval -1 Failure, body->fp is closed
+ *
+ * The body is measured too, for mbox's Content-Length: and Lines:.
+ */
+static int fcc_body_write(struct Header *hdr, struct FccBody *body)
+{
+  char buf[LONG_STRING];
 
-  tok = strtok(fcc_tok, ",");
-  if (!tok)
+  mutt_mktemp(body->path, sizeof(body->path));
+  body->fp = mutt_file_fopen(body->path, "w+");
+  if (!body->fp)
+  {
+    mutt_perror(body->path);
     return -1;
+  }
 
-  mutt_debug(1, "Fcc: initial mailbox = '%s'\n", tok);
-  /* mutt_expand_path already called above for the first token */
-  status = mutt_write_fcc(tok, hdr, msgid, post, fcc, finalpath);
-  if (status != 0)
-    return status;
+  mutt_write_mime_body(hdr->content, body->fp);
 
-  while ((tok = strtok(NULL, ",")) != NULL)
+  /* make sure the last line ends with a newline.  Emacs doesn't ensure
+   * this will happen, and it can cause problems parsing the mailbox
+   * later.
+   */
+  fseek(body->fp, -1, SEEK_END);
+  if (fgetc(body->fp) != '\n')
   {
-    if (!*tok)
-      continue;
+    fseek(body->fp, 0, SEEK_END);
+    fputc('\n', body->fp);
+  }
 
-    /* Only call mutt_expand_path iff tok has some data */
-    mutt_debug(1, "Fcc: additional mailbox token = '%s'\n", tok);
-    mutt_str_strfcpy(fcc_expanded, tok, sizeof(fcc_expanded));
-    mutt_expand_path(fcc_expanded, sizeof(fcc_expanded));
-    mutt_debug(1, "     Additional mailbox expanded = '%s'\n", fcc_expanded);
-    status = mutt_write_fcc(fcc_expanded, hdr, msgid, post, fcc, finalpath);
-    if (status != 0)
-      return status;
+  fflush(body->fp);
+  if (ferror(body->fp))
+  {
+    mutt_debug(1, "%s: write failed.\n", body->path);
+    mutt_file_fclose(&body->fp);
+    unlink(body->path);
+    return -1;
   }
 
+  /* count the number of lines */
+  body->lines = 0;
+  rewind(body->fp);
+  while (fgets(buf, sizeof(buf), body->fp) != NULL)
+    body->lines++;
+  body->length = ftello(body->fp);
+
   return 0;
 }
 
-int mutt_write_fcc(const char *path, struct Header *hdr, const char *msgid,
-                   int post, char *fcc, char **finalpath)
+/**
+ * fcc_write_headers - Write the header of an Fcc
+ * @param fp    File to write to
+ * @param hdr   Header of the message
+ * @param msgid Message-ID of the message replied to, for postponing
+ * @param post  If true, the message is being postponed
+ * @param fcc   Fcc to remember, for postponing
+ * @param mbox  If true, the folder is an mbox, which keeps flags in Status:
+ *
+ * The blank line ending the header isn't written.
+ */
+static void fcc_write_headers(FILE *fp, struct Header *hdr, const char *msgid,
+                              int post, char *fcc, bool mbox)
 {
-  struct Context f;
-  struct Message *msg = NULL;
-  char tempfile[_POSIX_PATH_MAX];
-  FILE *tempfp = NULL;
-  int rc = -1;
-  bool need_buffy_cleanup = false;
-  struct stat st;
   char buf[SHORT_STRING];
-  int onm_flags;
-
-  if (post)
-    set_noconv_flags(hdr->content, 1);
-
-#ifdef RECORD_FOLDER_HOOK
-  mutt_folder_hook(path);
-#endif
-  if (mx_open_mailbox(path, MUTT_APPEND | MUTT_QUIET, &f) == NULL)
-  {
-    mutt_debug(1, "unable to open mailbox %s in append-mode, aborting.\n", path);
-    goto done;
-  }
-
-  /* We need to add a Content-Length field to avoid problems where a line in
-   * the message body begins with "From "
-   */
-  if (f.magic == MUTT_MMDF || f.magic == MUTT_MBOX)
-  {
-    mutt_mktemp(tempfile, sizeof(tempfile));
-    tempfp = mutt_file_fopen(tempfile, "w+");
-    if (!tempfp)
-    {
-      mutt_perror(tempfile);
-      mx_close_mailbox(&f, NULL);
-      goto done;
-    }
-    /* remember new mail status before appending message */
-    need_buffy_cleanup = true;
-    stat(path, &st);
-  }
-
-  hdr->read = !post; /* make sure to put it in the `cur' directory (maildir) */
-  onm_flags = MUTT_ADD_FROM;
-  if (post)
-    onm_flags |= MUTT_SET_DRAFT;
-  msg = mx_open_new_message(&f, hdr, onm_flags);
-  if (!msg)
-  {
-    mutt_file_fclose(&tempfp);
-    mx_close_mailbox(&f, NULL);
-    goto done;
-  }
 
   /* post == 1 => postpone message. Set mode = -1 in mutt_write_rfc822_header()
    * post == 0 => Normal mode. Set mode = 0 in mutt_write_rfc822_header()
    * */
-  mutt_write_rfc822_header(msg->fp, hdr->env, hdr->content, post ? -post : 0, 0);
+  mutt_write_rfc822_header(fp, hdr->env, hdr->content, post ? -post : 0, 0);
 
   /* (postponement) if this was a reply of some sort, <msgid> contains the
    * Message-ID: of message replied to.  Save it using a special X-Mutt-
@@ -2999,62 +3080,62 @@ int mutt_write_fcc(const char *path, struct Header *hdr, const char *msgid,
    * the same mailbox is still open.
    */
   if (post && msgid)
-    fprintf(msg->fp, "X-Mutt-References: %s\n", msgid);
+    fprintf(fp, "X-Mutt-References: %s\n", msgid);
 
   /* (postponement) save the Fcc: using a special X-Mutt- header so that
    * it can be picked up when the message is recalled
    */
   if (post && fcc)
-    fprintf(msg->fp, "X-Mutt-Fcc: %s\n", fcc);
+    fprintf(fp, "X-Mutt-Fcc: %s\n", fcc);
 
-  if (f.magic == MUTT_MMDF || f.magic == MUTT_MBOX)
-    fprintf(msg->fp, "Status: RO\n");
+  if (mbox)
+    fprintf(fp, "Status: RO\n");
 
   /* mutt_write_rfc822_header() only writes out a Date: header with
    * mode == 0, i.e. _not_ postponement; so write out one ourself */
   if (post)
-    fprintf(msg->fp, "%s", mutt_date_make_date(buf, sizeof(buf)));
+    fprintf(fp, "%s", mutt_date_make_date(buf, sizeof(buf)));
 
   /* (postponement) if the mail is to be signed or encrypted, save this info */
   if ((WithCrypto & APPLICATION_PGP) && post && (hdr->security & APPLICATION_PGP))
   {
-    fputs("X-Mutt-PGP: ", msg->fp);
+    fputs("X-Mutt-PGP: ", fp);
     if (hdr->security & ENCRYPT)
-      fputc('E', msg->fp);
+      fputc('E', fp);
     if (hdr->security & OPPENCRYPT)
-      fputc('O', msg->fp);
+      fputc('O', fp);
     if (hdr->security & SIGN)
     {
-      fputc('S', msg->fp);
+      fputc('S', fp);
       if (PgpSignAs && *PgpSignAs)
-        fprintf(msg->fp, "<%s>", PgpSignAs);
+        fprintf(fp, "<%s>", PgpSignAs);
     }
     if (hdr->security & INLINE)
-      fputc('I', msg->fp);
-    fputc('\n', msg->fp);
+      fputc('I', fp);
+    fputc('\n', fp);
   }
 
   /* (postponement) if the mail is to be signed or encrypted, save this info */
   if ((WithCrypto & APPLICATION_SMIME) && post && (hdr->security & APPLICATION_SMIME))
   {
-    fputs("X-Mutt-SMIME: ", msg->fp);
+    fputs("X-Mutt-SMIME: ", fp);
     if (hdr->security & ENCRYPT)
     {
-      fputc('E', msg->fp);
+      fputc('E', fp);
       if (SmimeEncryptWith && *SmimeEncryptWith)
-        fprintf(msg->fp, "C<%s>", SmimeEncryptWith);
+        fprintf(fp, "C<%s>", SmimeEncryptWith);
     }
     if (hdr->security & OPPENCRYPT)
-      fputc('O', msg->fp);
+      fputc('O', fp);
     if (hdr->security & SIGN)
     {
-      fputc('S', msg->fp);
+      fputc('S', fp);
       if (SmimeSignAs && *SmimeSignAs)
-        fprintf(msg->fp, "<%s>", SmimeSignAs);
+        fprintf(fp, "<%s>", SmimeSignAs);
     }
     if (hdr->security & INLINE)
-      fputc('I', msg->fp);
-    fputc('\n', msg->fp);
+      fputc('I', fp);
+    fputc('\n', fp);
   }
 
 #ifdef MIXMASTER
@@ -3064,68 +3145,116 @@ int mutt_write_fcc(const char *path, struct Header *hdr, const char *msgid,
 
   if (post && !STAILQ_EMPTY(&hdr->chain))
   {
-    fputs("X-Mutt-Mix:", msg->fp);
+    fputs("X-Mutt-Mix:", fp);
     struct ListNode *p;
     STAILQ_FOREACH(p, &hdr->chain, entries)
     {
-      fprintf(msg->fp, " %s", (char *) p->data);
+      fprintf(fp, " %s", (char *) p->data);
     }
 
-    fputc('\n', msg->fp);
+    fputc('\n', fp);
   }
 #endif
+}
 
-  if (tempfp)
+/**
+ * write_fcc - Write a message to one Fcc folder
+ * @param path      Folder
+ * @param hdr       Header of the message
+ * @param msgid     Message-ID of the message replied to, for postponing
+ * @param post      If true, the message is being postponed
+ * @param fcc       Fcc to remember, for postponing
+ * @param finalpath Set to the path of the new message, if not NULL
+ * @param body      Body already written out, or NULL to write it here
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+static int write_fcc(const char *path, struct Header *hdr, const char *msgid,
+                     int post, char *fcc, char **finalpath, struct FccBody *body)
+{
+  struct Context f;
+  struct Message *msg = NULL;
+  struct FccBody tmpbody;
+  int rc = -1;
+  bool need_buffy_cleanup = false;
+  struct stat st;
+  int onm_flags;
+
+  if (post)
+    set_noconv_flags(hdr->content, 1);
+
+#ifdef RECORD_FOLDER_HOOK
+  mutt_folder_hook(path);
+#endif
+  if (mx_open_mailbox(path, MUTT_APPEND | MUTT_QUIET, &f) == NULL)
   {
-    char sasha[LONG_STRING];
-    int lines = 0;
+    mutt_debug(1, "unable to open mailbox %s in append-mode, aborting.\n", path);
+    goto done;
+  }
 
-    mutt_write_mime_body(hdr->content, tempfp);
+  const bool mbox = (f.magic == MUTT_MMDF || f.magic == MUTT_MBOX);
 
-    /* make sure the last line ends with a newline.  Emacs doesn't ensure
-     * this will happen, and it can cause problems parsing the mailbox
-     * later.
-     */
-    fseek(tempfp, -1, SEEK_END);
-    if (fgetc(tempfp) != '\n')
+  /* We need to add a Content-Length field to avoid problems where a line in
+   * the message body begins with "From "
+   */
+  if (mbox)
+  {
+    if (!body)
     {
-      fseek(tempfp, 0, SEEK_END);
-      fputc('\n', tempfp);
+      if (fcc_body_write(hdr, &tmpbody) != 0)
+      {
+        mx_close_mailbox(&f, NULL);
+        goto done;
+      }
+      body = &tmpbody;
     }
+    /* remember new mail status before appending message */
+    need_buffy_cleanup = true;
+    stat(path, &st);
+  }
 
-    fflush(tempfp);
-    if (ferror(tempfp))
+  hdr->read = !post; /* make sure to put it in the `cur' directory (maildir) */
+  onm_flags = MUTT_ADD_FROM;
+  if (post)
+    onm_flags |= MUTT_SET_DRAFT;
+  msg = mx_open_new_message(&f, hdr, onm_flags);
+  if (!msg)
+  {
+    if (body == &tmpbody)
     {
-      mutt_debug(1, "%s: write failed.\n", tempfile);
-      mutt_file_fclose(&tempfp);
-      unlink(tempfile);
-      mx_commit_message(msg, &f); /* XXX - really? */
-      mx_close_message(&f, &msg);
-      mx_close_mailbox(&f, NULL);
-      goto done;
+      mutt_file_fclose(&tmpbody.fp);
+      unlink(tmpbody.path);
     }
+    mx_close_mailbox(&f, NULL);
+    goto done;
+  }
 
-    /* count the number of lines */
-    rewind(tempfp);
-    while (fgets(sasha, sizeof(sasha), tempfp) != NULL)
-      lines++;
-    fprintf(msg->fp, "Content-Length: " OFF_T_FMT "\n", (LOFF_T) ftello(tempfp));
-    fprintf(msg->fp, "Lines: %d\n\n", lines);
+  fcc_write_headers(msg->fp, hdr, msgid, post, fcc, mbox);
 
-    /* copy the body and clean up */
-    rewind(tempfp);
-    rc = mutt_file_copy_stream(tempfp, msg->fp);
-    if (fclose(tempfp) != 0)
-      rc = -1;
-    /* if there was an error, leave the temp version */
-    if (!rc)
-      unlink(tempfile);
+  if (mbox)
+  {
+    fprintf(msg->fp, "Content-Length: " OFF_T_FMT "\n", body->length);
+    fprintf(msg->fp, "Lines: %d\n\n", body->lines);
   }
   else
-  {
     fputc('\n', msg->fp); /* finish off the header */
-    rc = mutt_write_mime_body(hdr->content, msg->fp);
+
+  if (body)
+  {
+    /* copy the body and clean up */
+    rewind(body->fp);
+    rc = mutt_file_copy_stream(body->fp, msg->fp);
+    if (body == &tmpbody)
+    {
+      if (fclose(tmpbody.fp) != 0)
+        rc = -1;
+      /* if there was an error, leave the temp version */
+      if (!rc)
+        unlink(tmpbody.path);
+    }
   }
+  else
+    rc = mutt_write_mime_body(hdr->content, msg->fp);
 
   if (mx_commit_message(msg, &f) != 0)
     rc = -1;
@@ -3150,3 +3279,169 @@ done:
 
   return rc;
 }
+
+#if defined(USE_IMAP) && !defined(RECORD_FOLDER_HOOK)
+/**
+ * fcc_imap - Append a message to all the IMAP Fcc folders at once
+ * @param paths   Fcc folders
+ * @param saved   Set to true for each folder that has the message
+ * @param num     Number of folders
+ * @param hdr     Header of the message
+ * @param body    Body of the message, already written out
+ *
+ * The whole message is put together once, then handed to imap_append_fcc(),
+ * which pipelines the APPENDs to each server.  Any folder it couldn't save
+ * to is left for write_fcc().
+ */
+static void fcc_imap(char **paths, bool *saved, int num, struct Header *hdr,
+                     struct FccBody *body)
+{
+  char **imap_paths = mutt_mem_calloc(num, sizeof(char *));
+  int *imap_idx = mutt_mem_calloc(num, sizeof(int));
+  int *results = mutt_mem_calloc(num, sizeof(int));
+  char tempfile[_POSIX_PATH_MAX];
+  FILE *fp = NULL;
+  int nimap = 0;
+
+  for (int i = 0; i < num; i++)
+  {
+    if (!mx_is_imap(paths[i]))
+      continue;
+    imap_paths[nimap] = paths[i];
+    imap_idx[nimap++] = i;
+  }
+  if (nimap == 0)
+    goto cleanup;
+
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  fp = mutt_file_fopen(tempfile, "w+");
+  if (!fp)
+  {
+    mutt_perror(tempfile);
+    goto cleanup;
+  }
+
+  fcc_write_headers(fp, hdr, NULL, 0, NULL, false);
+  fputc('\n', fp);
+  rewind(body->fp);
+  if ((mutt_file_copy_stream(body->fp, fp) == 0) && !ferror(fp))
+  {
+    rewind(fp);
+    imap_append_fcc(imap_paths, results, nimap, fp, false,
+                    hdr->received ? hdr->received : time(NULL));
+    for (int i = 0; i < nimap; i++)
+      if (results[i] == 0)
+        saved[imap_idx[i]] = true;
+  }
+  mutt_file_fclose(&fp);
+  unlink(tempfile);
+
+cleanup:
+  FREE(&imap_paths);
+  FREE(&imap_idx);
+  FREE(&results);
+}
+#endif
+
+/**
+ * mutt_write_multiple_fcc - Handle FCC with multiple, comma separated entries
+ *
+ * The body is written out once and copied into each folder, rather than being
+ * encoded again for each one.  The IMAP folders are all sent the message
+ * first, together; see fcc_imap().
+ */
+int mutt_write_multiple_fcc(const char *path, struct Header *hdr, const char *msgid,
+                            int post, char *fcc, char **finalpath)
+{
+  char fcc_tok[_POSIX_PATH_MAX];
+  char fcc_expanded[_POSIX_PATH_MAX];
+  char **paths = NULL;
+  bool *saved = NULL;
+  struct FccBody body;
+  char *tok = NULL;
+  int num = 0;
+  int status = 0;
+
+  mutt_str_strfcpy(fcc_tok, path, sizeof(fcc_tok));
+
+  tok = strtok(fcc_tok, ",");
+  if (!tok)
+    return -1;
+
+  mutt_debug(1, "Fcc: initial mailbox = '%s'\n", tok);
+  /* mutt_expand_path already called above for the first token */
+  mutt_mem_realloc(&paths, sizeof(char *) * (num + 1));
+  paths[num++] = mutt_str_strdup(tok);
+
+  while ((tok = strtok(NULL, ",")) != NULL)
+  {
+    if (!*tok)
+      continue;
+
+    /* Only call mutt_expand_path iff tok has some data */
+    mutt_debug(1, "Fcc: additional mailbox token = '%s'\n", tok);
+    mutt_str_strfcpy(fcc_expanded, tok, sizeof(fcc_expanded));
+    mutt_expand_path(fcc_expanded, sizeof(fcc_expanded));
+    mutt_debug(1, "     Additional mailbox expanded = '%s'\n", fcc_expanded);
+    mutt_mem_realloc(&paths, sizeof(char *) * (num + 1));
+    paths[num++] = mutt_str_strdup(fcc_expanded);
+  }
+
+  if (num == 1)
+  {
+    status = mutt_write_fcc(paths[0], hdr, msgid, post, fcc, finalpath);
+    goto cleanup;
+  }
+
+  if (post)
+    set_noconv_flags(hdr->content, 1);
+  status = fcc_body_write(hdr, &body);
+  if (post)
+    set_noconv_flags(hdr->content, 0);
+  if (status != 0)
+    goto cleanup;
+
+  saved = mutt_mem_calloc(num, sizeof(bool));
+#if defined(USE_IMAP) && !defined(RECORD_FOLDER_HOOK)
+  if (!post)
+    fcc_imap(paths, saved, num, hdr, &body);
+#endif
+
+  for (int i = 0; i < num; i++)
+  {
+    if (saved[i])
+      continue;
+    /* only the first folder's path is wanted */
+    status = write_fcc(paths[i], hdr, msgid, post, fcc,
+                       (finalpath && !*finalpath) ? finalpath : NULL, &body);
+    if (status != 0)
+      break;
+  }
+
+  mutt_file_fclose(&body.fp);
+  unlink(body.path);
+
+cleanup:
+  for (int i = 0; i < num; i++)
+    FREE(&paths[i]);
+  FREE(&paths);
+  FREE(&saved);
+  return status;
+}
+
+/**
+ * mutt_write_fcc - Write a message to a folder
+ * @param path      Folder
+ * @param hdr       Header of the message
+ * @param msgid     Message-ID of the message replied to, for postponing
+ * @param post      If true, the message is being postponed
+ * @param fcc       Fcc to remember, for postponing
+ * @param finalpath Set to the path of the new message, if not NULL
+ * @retval  0 Success
+ * @retval -1 Failure
+ */
+int mutt_write_fcc(const char *path, struct Header *hdr, const char *msgid,
+                   int post, char *fcc, char **finalpath)
+{
+  return write_fcc(path, hdr, msgid, post, fcc, finalpath, NULL);
+}
@@ -0,0 +1,504 @@
+/**
+ * @file
+ * Deliver outgoing mail in the background
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * When $send_queue is set, a finished message isn't handed to the relay
+ * while the user waits.  It's written to the queue directory, together with
+ * its envelope, and a background process delivers it.  That process outlives
+ * NeoMutt, retries failed deliveries with an increasing delay and exits when
+ * the queue is empty.
+ *
+ * Each message is a file called "<time>.<pid>.<seq>,<attempts>".  The file
+ * starts with the envelope ("From:", "Rcpt:" and "8bit:" lines), then a blank
+ * line, then the message.  A message that can't be delivered after
+ * #QUEUE_ATTEMPTS tries is renamed to end in ",failed" and left alone.
+ * Errors are appended to ".log" and ".lock" keeps two workers apart.
+ */
+
+#include "config.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <utime.h>
+#include "mutt/mutt.h"
+#include "conn/conn.h"
+#include "mutt.h"
+#include "sendqueue.h"
+#include "address.h"
+#include "globals.h"
+#include "options.h"
+#include "protos.h"
+
+#define QUEUE_ATTEMPTS 10    /**< Give up on a message after this many tries */
+#define QUEUE_RETRY_MAX 3600 /**< Longest wait between two tries, in seconds */
+
+#define QUEUE_SKIP -1   /**< Not a queued message */
+#define QUEUE_FAILED -2 /**< A message which has been given up on */
+
+static unsigned int QueueSeq = 0;
+
+/**
+ * queue_attempts - How often has delivery of a queued message been tried
+ * @param name File name in the queue
+ * @retval >=0         Number of attempts
+ * @retval QUEUE_SKIP   Not a queued message
+ * @retval QUEUE_FAILED Delivery has been given up
+ */
+static int queue_attempts(const char *name)
+{
+  const char *p = strrchr(name, ',');
+  int n;
+
+  if ((name[0] == '.') || !p)
+    return QUEUE_SKIP;
+  if (mutt_str_strcmp(p + 1, "failed") == 0)
+    return QUEUE_FAILED;
+  if ((mutt_str_atoi(p + 1, &n) < 0) || (n < 0))
+    return QUEUE_SKIP;
+  return n;
+}
+
+/**
+ * queue_backoff - How long to wait before trying a message again
+ * @param attempts Number of failed attempts so far
+ * @retval num Delay in seconds
+ */
+static time_t queue_backoff(int attempts)
+{
+  time_t wait = MAX(SendQueueRetry, 1);
+
+  while ((--attempts > 0) && (wait < QUEUE_RETRY_MAX))
+    wait *= 2;
+  return MIN(wait, QUEUE_RETRY_MAX);
+}
+
+/**
+ * queue_error - Log an error from the background delivery
+ * @param fmt printf-like formatting string
+ * @param ... Arguments to format
+ *
+ * The worker's stderr is the queue's log file.
+ */
+static void queue_error(const char *fmt, ...)
+{
+  char when[SHORT_STRING];
+  const time_t now = time(NULL);
+  va_list ap;
+
+  strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", localtime(&now));
+  fprintf(stderr, "[%s] ", when);
+  va_start(ap, fmt);
+  vfprintf(stderr, fmt, ap);
+  va_end(ap);
+  fputc('\n', stderr);
+}
+
+/**
+ * queue_quiet - Discard a progress message from the background delivery
+ * @param fmt printf-like formatting string
+ * @param ... Arguments to format
+ */
+static void queue_quiet(const char *fmt, ...)
+{
+}
+
+/**
+ * queue_deliver - Hand one queued message to the relay
+ * @param path Path of the queued message
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int queue_deliver(const char *path)
+{
+  char tempfile[_POSIX_PATH_MAX];
+  struct Address *from = NULL, *rcpt = NULL;
+  struct Address **ftail = &from, **rtail = &rcpt;
+  FILE *fp = NULL, *fpout = NULL;
+  char *line = NULL;
+  size_t linelen = 0;
+  int lineno = 0;
+  int eightbit = 0;
+  int rc = -1;
+
+  fp = fopen(path, "r");
+  if (!fp)
+  {
+    mutt_perror(path);
+    return -1;
+  }
+
+  /* the envelope ends at the first blank line */
+  while ((line = mutt_file_read_line(line, &linelen, fp, &lineno, 0)) && *line)
+  {
+    struct Address ***tail = NULL;
+    const char *value = NULL;
+
+    if (mutt_str_strncmp(line, "From: ", 6) == 0)
+      tail = &ftail;
+    else if (mutt_str_strncmp(line, "Rcpt: ", 6) == 0)
+      tail = &rtail;
+    else if (mutt_str_strcmp(line, "8bit: yes") == 0)
+      eightbit = 1;
+
+    if (!tail)
+      continue;
+    value = line + 6;
+    **tail = mutt_addr_new();
+    (**tail)->mailbox = mutt_str_strdup(value);
+    *tail = &(**tail)->next;
+  }
+  FREE(&line);
+
+  if (!rcpt)
+  {
+    mutt_error(_("%s: no recipients"), path);
+    goto cleanup;
+  }
+
+  mutt_mktemp(tempfile, sizeof(tempfile));
+  fpout = mutt_file_fopen(tempfile, "w");
+  if (!fpout)
+  {
+    mutt_perror(tempfile);
+    goto cleanup;
+  }
+  if ((mutt_file_copy_stream(fp, fpout) < 0) || (mutt_file_fclose(&fpout) != 0))
+  {
+    mutt_perror(tempfile);
+    unlink(tempfile);
+    goto cleanup;
+  }
+
+#ifdef USE_SMTP
+  if (SmtpUrl)
+    rc = mutt_smtp_send(from, rcpt, NULL, NULL, tempfile, eightbit);
+  else
+#endif
+    rc = mutt_invoke_sendmail(from, rcpt, NULL, NULL, tempfile, eightbit);
+  unlink(tempfile);
+
+cleanup:
+  mutt_file_fclose(&fpout);
+  mutt_file_fclose(&fp);
+  mutt_addr_free(&from);
+  mutt_addr_free(&rcpt);
+  return (rc < 0) ? -1 : 0;
+}
+
+/**
+ * queue_retry - Record a failed delivery
+ * @param name     File name of the message in the queue
+ * @param attempts Number of failed attempts, including this one
+ * @retval true The message will be tried again
+ */
+static bool queue_retry(const char *name, int attempts)
+{
+  char src[_POSIX_PATH_MAX];
+  char dst[_POSIX_PATH_MAX];
+  const int len = strrchr(name, ',') - name;
+  const bool again = (attempts < QUEUE_ATTEMPTS);
+
+  snprintf(src, sizeof(src), "%s/%s", SendQueue, name);
+  if (again)
+  {
+    snprintf(dst, sizeof(dst), "%s/%.*s,%d", SendQueue, len, name, attempts);
+    mutt_error(_("Delivery of %.*s failed, retrying in %d seconds"), len, name,
+               (int) queue_backoff(attempts));
+  }
+  else
+  {
+    snprintf(dst, sizeof(dst), "%s/%.*s,failed", SendQueue, len, name);
+    mutt_error(_("Delivery of %.*s failed, giving up"), len, name);
+  }
+
+  /* the next attempt is timed from this one */
+  if (rename(src, dst) == 0)
+    utime(dst, NULL);
+  return again;
+}
+
+/**
+ * queue_scan - Look through the send queue
+ * @param[in]  deliver If true, try to deliver the messages which are due
+ * @param[out] next    Earliest time another attempt is due
+ * @param[out] failed  Number of messages which have been given up on
+ * @retval num Number of messages still waiting to be delivered
+ */
+static int queue_scan(bool deliver, time_t *next, int *failed)
+{
+  struct ListHead names = STAILQ_HEAD_INITIALIZER(names);
+  struct ListNode *np = NULL;
+  struct dirent *de = NULL;
+  char path[_POSIX_PATH_MAX];
+  struct stat st;
+  int waiting = 0;
+
+  *next = 0;
+  *failed = 0;
+
+  DIR *dp = opendir(SendQueue);
+  if (!dp)
+    return 0;
+  /* read the directory first, delivering renames the entries */
+  while ((de = readdir(dp)))
+    if (queue_attempts(de->d_name) != QUEUE_SKIP)
+      mutt_list_insert_tail(&names, mutt_str_strdup(de->d_name));
+  closedir(dp);
+
+  STAILQ_FOREACH(np, &names, entries)
+  {
+    int attempts = queue_attempts(np->data);
+    if (attempts == QUEUE_FAILED)
+    {
+      (*failed)++;
+      continue;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", SendQueue, np->data);
+    if (stat(path, &st) != 0)
+      continue;
+
+    time_t due = attempts ? (st.st_mtime + queue_backoff(attempts)) : 0;
+    if (deliver && (due <= time(NULL)))
+    {
+      mutt_debug(1, "delivering %s\n", np->data);
+      if (queue_deliver(path) == 0)
+      {
+        unlink(path);
+        continue;
+      }
+      if (!queue_retry(np->data, ++attempts))
+      {
+        (*failed)++;
+        continue;
+      }
+      due = time(NULL) + queue_backoff(attempts);
+    }
+
+    waiting++;
+    if ((*next == 0) || (due < *next))
+      *next = due;
+  }
+
+  mutt_list_free(&names);
+  return waiting;
+}
+
+/**
+ * queue_run - Deliver the queue until it's empty
+ *
+ * Between attempts, the worker sleeps until a retry is due, waking early if
+ * a new message is queued.
+ */
+static void queue_run(void)
+{
+  char path[_POSIX_PATH_MAX];
+  struct stat st;
+  time_t next;
+  int failed;
+
+  snprintf(path, sizeof(path), "%s/.lock", SendQueue);
+  int fd = open(path, O_RDWR | O_CREAT, 0600);
+  if (fd < 0)
+    return;
+
+  /* A message queued while we were giving up the lock may have found
+   * it still held, so look again before leaving. */
+  while ((mutt_file_lock(fd, 1, 0) == 0) && (queue_scan(false, &next, &failed) > 0))
+  {
+    while (true)
+    {
+      const time_t start = time(NULL);
+      const time_t changed = (stat(SendQueue, &st) == 0) ? st.st_mtime : 0;
+
+      if (queue_scan(true, &next, &failed) == 0)
+        break;
+
+      /* The mtime only has a resolution of a second: if the directory
+       * changed during the second the scan began, scan once more. */
+      while (time(NULL) < next)
+      {
+        sleep(1);
+        if ((stat(SendQueue, &st) == 0) && ((st.st_mtime != changed) || (changed >= start)))
+          break;
+      }
+    }
+    mutt_file_unlock(fd);
+  }
+
+  close(fd);
+}
+
+/**
+ * queue_spawn - Start a background process to deliver the queue
+ *
+ * If a worker is already running, the new one finds the queue locked and
+ * leaves at once.
+ */
+static void queue_spawn(void)
+{
+  char path[_POSIX_PATH_MAX];
+  const int keep = debugfile ? fileno(debugfile) : -1;
+
+  fflush(NULL);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    /* like sendmail, carry on after the main process exits */
+    setsid();
+    if (fork() == 0)
+    {
+      /* the worker mustn't hold on to the parent's connections or files */
+#ifdef OPEN_MAX
+      for (int fd = 0; fd < OPEN_MAX; fd++)
+#else
+      for (int fd = 0; fd < _POSIX_OPEN_MAX; fd++)
+#endif
+        if (fd != keep)
+          close(fd);
+
+      snprintf(path, sizeof(path), "%s/.log", SendQueue);
+      if ((open("/dev/null", O_RDONLY) < 0) || (open("/dev/null", O_WRONLY) < 0) ||
+          (open(path, O_WRONLY | O_APPEND | O_CREAT, 0600) < 0))
+      {
+        _exit(1);
+      }
+
+      mutt_socket_forked();
+
+      /* nobody is there to answer a question */
+      OPT_NO_CURSES = true;
+      mutt_error = queue_error;
+      mutt_message = queue_quiet;
+      SendmailWait = 0;
+
+      queue_run();
+    }
+    _exit(0);
+  }
+  else if (pid > 0)
+    waitpid(pid, NULL, 0);
+}
+
+/**
+ * mutt_queue_message - Put a message in the send queue
+ * @param from     Sender
+ * @param to       Recipients
+ * @param cc       Recipients
+ * @param bcc      Recipients
+ * @param msg      File containing the message, removed on success
+ * @param eightbit Message contains 8bit chars
+ * @retval  1 Success, the message will be delivered in the background
+ * @retval -1 Error
+ */
+int mutt_queue_message(struct Address *from, struct Address *to, struct Address *cc,
+                       struct Address *bcc, const char *msg, int eightbit)
+{
+  struct Address *rcpts[] = { to, cc, bcc };
+  char name[SHORT_STRING];
+  char tmp[_POSIX_PATH_MAX];
+  char path[_POSIX_PATH_MAX];
+  FILE *fpin = NULL, *fpout = NULL;
+  int rc = -1;
+
+  if ((mkdir(SendQueue, 0700) != 0) && (errno != EEXIST))
+  {
+    mutt_perror(SendQueue);
+    return -1;
+  }
+
+  snprintf(name, sizeof(name), "%ld.%d.%u", (long) time(NULL), (int) getpid(), QueueSeq++);
+  snprintf(tmp, sizeof(tmp), "%s/.%s", SendQueue, name);
+  snprintf(path, sizeof(path), "%s/%s,0", SendQueue, name);
+
+  fpin = fopen(msg, "r");
+  if (!fpin)
+  {
+    mutt_perror(msg);
+    return -1;
+  }
+  fpout = mutt_file_fopen(tmp, "w");
+  if (!fpout)
+  {
+    mutt_perror(tmp);
+    goto cleanup;
+  }
+
+  /* only the mailboxes are needed for the envelope */
+  for (struct Address *a = from; a; a = a->next)
+    if (a->mailbox && !a->group)
+      fprintf(fpout, "From: %s\n", a->mailbox);
+  for (size_t i = 0; i < mutt_array_size(rcpts); i++)
+    for (struct Address *a = rcpts[i]; a; a = a->next)
+      if (a->mailbox && !a->group)
+        fprintf(fpout, "Rcpt: %s\n", a->mailbox);
+  if (eightbit)
+    fputs("8bit: yes\n", fpout);
+  fputc('\n', fpout);
+
+  /* the message mustn't be lost once we've told the user it's been sent */
+  if ((mutt_file_copy_stream(fpin, fpout) < 0) || (mutt_file_fsync_close(&fpout) != 0) ||
+      (rename(tmp, path) != 0))
+  {
+    mutt_perror(tmp);
+    unlink(tmp);
+    goto cleanup;
+  }
+
+  unlink(msg);
+  queue_spawn();
+  rc = 1;
+
+cleanup:
+  mutt_file_fclose(&fpout);
+  mutt_file_fclose(&fpin);
+  return rc;
+}
+
+/**
+ * mutt_queue_flush - Resume delivery of the send queue
+ *
+ * Any messages left over from an earlier session are delivered in the
+ * background.  The user is told about messages which have been given up on.
+ */
+void mutt_queue_flush(void)
+{
+  time_t next;
+  int failed;
+
+  if (!SendQueue || !*SendQueue)
+    return;
+
+  if (queue_scan(false, &next, &failed) > 0)
+    queue_spawn();
+  if (failed)
+  {
+    mutt_error(_("%d queued messages could not be delivered, see %s/.log"), failed, SendQueue);
+    mutt_sleep(2);
+  }
+}
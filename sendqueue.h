@@ -0,0 +1,29 @@
+/**
+ * @file
+ * Deliver outgoing mail in the background
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MUTT_SENDQUEUE_H
+#define _MUTT_SENDQUEUE_H
+
+struct Address;
+
+int mutt_queue_message(struct Address *from, struct Address *to, struct Address *cc,
+                       struct Address *bcc, const char *msg, int eightbit);
+void mutt_queue_flush(void);
+
+#endif /* _MUTT_SENDQUEUE_H */
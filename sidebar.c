@@ -49,14 +49,36 @@
 /* Previous values for some sidebar config */
 static short PreviousSort = SORT_ORDER; /* sidebar_sort_method */
 
+/**
+ * struct SbEntryKey - Everything a formatted sidebar entry depends on
+ */
+struct SbEntryKey
+{
+  unsigned int settings; /**< Config used, see settings_hash() */
+  int width;             /**< Width of the entry in screen cells */
+  int msg_count;         /**< Buffy's total number of messages */
+  int msg_unread;        /**< Buffy's number of unread messages */
+  int msg_flagged;       /**< Buffy's number of flagged messages */
+  int deleted;           /**< Deleted messages, if it's the open mailbox */
+  int vcount;            /**< Visible messages, if it's the open mailbox */
+  int tagged;            /**< Tagged messages, if it's the open mailbox */
+  bool new;              /**< Buffy has new mail */
+  bool open;             /**< It's the open mailbox */
+};
+
 /**
  * struct SbEntry - Info about folders in the sidebar
  */
 struct SbEntry
 {
-  char box[STRING];    /**< formatted mailbox name */
-  struct Buffy *buffy; /**< Mailbox this represents */
-  bool is_hidden;      /**< Don't show, e.g. $sidebar_new_mail_only */
+  char box[STRING];      /**< formatted mailbox name */
+  struct Buffy *buffy;   /**< Mailbox this represents */
+  bool is_hidden;        /**< Don't show, e.g. $sidebar_new_mail_only */
+  char display[STRING];  /**< The entry as last drawn */
+  struct SbEntryKey key; /**< What display was made from */
+  int sorted_count;      /**< Buffy's msg_count when last sorted */
+  int sorted_unread;     /**< Buffy's msg_unread when last sorted */
+  int sorted_flagged;    /**< Buffy's msg_flagged when last sorted */
 };
 
 static int EntryCount = 0;
@@ -68,6 +90,9 @@ static int OpnIndex = -1; /**< Current (open) mailbox */
 static int HilIndex = -1; /**< Highlighted mailbox */
 static int BotIndex = -1; /**< Last mailbox visible in sidebar */
 
+static bool EntriesSorted = false;      /**< Entries are in $sidebar_sort_method order */
+static short SortedMethod = SORT_ORDER; /**< Method the Entries were sorted by */
+
 /**
  * enum DivType - Source of the sidebar divider character
  */
@@ -420,6 +445,33 @@ static void unsort_entries(void)
   }
 }
 
+/**
+ * entries_need_sort - Has the order of the Entries changed?
+ * @param ssm Sort method, without flags
+ * @retval true The Entries need sorting
+ *
+ * The order only depends on the mailboxes' names and the counts being sorted
+ * by, so the Entries are only sorted when one of those has changed.
+ */
+static bool entries_need_sort(short ssm)
+{
+  if (!EntriesSorted || (SortedMethod != SidebarSortMethod))
+    return true;
+
+  for (int i = 0; i < EntryCount; i++)
+  {
+    const struct SbEntry *sbe = Entries[i];
+    if (((ssm == SORT_COUNT) && (sbe->sorted_count != sbe->buffy->msg_count)) ||
+        ((ssm == SORT_UNREAD) && (sbe->sorted_unread != sbe->buffy->msg_unread)) ||
+        ((ssm == SORT_FLAGGED) && (sbe->sorted_flagged != sbe->buffy->msg_flagged)))
+    {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 /**
  * sort_entries - Sort Entries array
  *
@@ -435,9 +487,26 @@ static void sort_entries(void)
 
   /* These are the only sort methods we understand */
   if ((ssm == SORT_COUNT) || (ssm == SORT_UNREAD) || (ssm == SORT_FLAGGED) || (ssm == SORT_PATH))
+  {
+    if (!entries_need_sort(ssm))
+      return;
+
     qsort(Entries, EntryCount, sizeof(*Entries), cb_qsort_sbe);
-  else if ((ssm == SORT_ORDER) && (SidebarSortMethod != PreviousSort))
-    unsort_entries();
+    for (int i = 0; i < EntryCount; i++)
+    {
+      Entries[i]->sorted_count = Entries[i]->buffy->msg_count;
+      Entries[i]->sorted_unread = Entries[i]->buffy->msg_unread;
+      Entries[i]->sorted_flagged = Entries[i]->buffy->msg_flagged;
+    }
+    EntriesSorted = true;
+    SortedMethod = SidebarSortMethod;
+  }
+  else
+  {
+    EntriesSorted = false;
+    if ((ssm == SORT_ORDER) && (SidebarSortMethod != PreviousSort))
+      unsort_entries();
+  }
 }
 
 /**
@@ -789,6 +858,122 @@ static void fill_empty_space(int first_row, int num_rows, int div_width, int num
   }
 }
 
+/**
+ * settings_hash - Fingerprint the config used to format the entries
+ * @param width Width of the entries in screen cells
+ * @retval num Hash of the config
+ */
+static unsigned int settings_hash(int width)
+{
+  const char *strs[] = { Folder, SidebarFormat, SidebarDelimChars, SidebarIndentString };
+  const int nums[] = { width, SidebarWidth, SidebarShortPath, SidebarFolderIndent,
+                       SidebarComponentDepth };
+  unsigned int h = 2166136261U; /* FNV-1a */
+
+  for (size_t i = 0; i < mutt_array_size(strs); i++)
+  {
+    for (const char *c = NONULL(strs[i]); *c; c++)
+      h = (h ^ (unsigned char) *c) * 16777619U;
+    h = (h ^ 0xff) * 16777619U;
+  }
+
+  for (size_t i = 0; i < mutt_array_size(nums); i++)
+    h = (h ^ (unsigned int) nums[i]) * 16777619U;
+
+  return h;
+}
+
+/**
+ * format_entry - Format a sidebar entry
+ * @param entry Entry to format, the result is saved in entry->display
+ * @param width Width of the entry in screen cells
+ *
+ * The mailbox name is abbreviated and indented according to the config.
+ */
+static void format_entry(struct SbEntry *entry, int width)
+{
+  struct Buffy *b = entry->buffy;
+
+  /* compute length of Folder without trailing separator */
+  size_t maildirlen = mutt_str_strlen(Folder);
+  if (maildirlen && SidebarDelimChars && strchr(SidebarDelimChars, Folder[maildirlen - 1]))
+    maildirlen--;
+
+  /* check whether Folder is a prefix of the current folder's path */
+  bool maildir_is_prefix = false;
+  if ((mutt_str_strlen(b->path) > maildirlen) &&
+      (mutt_str_strncmp(Folder, b->path, maildirlen) == 0) &&
+      SidebarDelimChars && strchr(SidebarDelimChars, b->path[maildirlen]))
+    maildir_is_prefix = true;
+
+  /* calculate depth of current folder and generate its display name with indented spaces */
+  int sidebar_folder_depth = 0;
+  char *sidebar_folder_name = NULL;
+  if (SidebarShortPath)
+  {
+    /* disregard a trailing separator, so strlen() - 2 */
+    sidebar_folder_name = b->path;
+    for (int i = mutt_str_strlen(sidebar_folder_name) - 2; i >= 0; i--)
+    {
+      if (SidebarDelimChars && strchr(SidebarDelimChars, sidebar_folder_name[i]))
+      {
+        sidebar_folder_name += (i + 1);
+        break;
+      }
+    }
+  }
+  else if ((SidebarComponentDepth > 0) && SidebarDelimChars)
+  {
+    sidebar_folder_name = b->path + maildir_is_prefix * (maildirlen + 1);
+    for (int i = 0; i < SidebarComponentDepth; i++)
+    {
+      char *chars_after_delim = strpbrk(sidebar_folder_name, SidebarDelimChars);
+      if (!chars_after_delim)
+        break;
+      else
+        sidebar_folder_name = chars_after_delim + 1;
+    }
+  }
+  else
+    sidebar_folder_name = b->path + maildir_is_prefix * (maildirlen + 1);
+
+  if (b->desc)
+  {
+    sidebar_folder_name = b->desc;
+  }
+  else if (maildir_is_prefix && SidebarFolderIndent)
+  {
+    const char *tmp_folder_name = NULL;
+    int lastsep = 0;
+    tmp_folder_name = b->path + maildirlen + 1;
+    int tmplen = (int) mutt_str_strlen(tmp_folder_name) - 1;
+    for (int i = 0; i < tmplen; i++)
+    {
+      if (SidebarDelimChars && strchr(SidebarDelimChars, tmp_folder_name[i]))
+      {
+        sidebar_folder_depth++;
+        lastsep = i + 1;
+      }
+    }
+    if (sidebar_folder_depth > 0)
+    {
+      if (SidebarShortPath)
+        tmp_folder_name += lastsep; /* basename */
+      int sfn_len = mutt_str_strlen(tmp_folder_name) +
+                    sidebar_folder_depth * mutt_str_strlen(SidebarIndentString) + 1;
+      sidebar_folder_name = mutt_mem_malloc(sfn_len);
+      sidebar_folder_name[0] = 0;
+      for (int i = 0; i < sidebar_folder_depth; i++)
+        mutt_str_strcat(sidebar_folder_name, sfn_len, NONULL(SidebarIndentString));
+      mutt_str_strcat(sidebar_folder_name, sfn_len, tmp_folder_name);
+    }
+  }
+  make_sidebar_entry(entry->display, sizeof(entry->display), width,
+                     sidebar_folder_name, entry);
+  if (sidebar_folder_depth > 0)
+    FREE(&sidebar_folder_name);
+}
+
 /**
  * draw_sidebar - Write out a list of mailboxes, in a panel
  * @param num_rows   Height of the Sidebar
@@ -818,6 +1003,7 @@ static void draw_sidebar(int num_rows, int num_cols, int div_width)
     return;
 
   int w = MIN(num_cols, (SidebarWidth - div_width));
+  unsigned int settings = settings_hash(w);
   int row = 0;
   for (int entryidx = TopIndex; (entryidx < EntryCount) && (row < num_rows); entryidx++)
   {
@@ -872,85 +1058,30 @@ static void draw_sidebar(int num_rows, int num_cols, int div_width)
       b->msg_flagged = Context->flagged;
     }
 
-    /* compute length of Folder without trailing separator */
-    size_t maildirlen = mutt_str_strlen(Folder);
-    if (maildirlen && SidebarDelimChars && strchr(SidebarDelimChars, Folder[maildirlen - 1]))
-      maildirlen--;
-
-    /* check whether Folder is a prefix of the current folder's path */
-    bool maildir_is_prefix = false;
-    if ((mutt_str_strlen(b->path) > maildirlen) &&
-        (mutt_str_strncmp(Folder, b->path, maildirlen) == 0) &&
-        SidebarDelimChars && strchr(SidebarDelimChars, b->path[maildirlen]))
-      maildir_is_prefix = true;
-
-    /* calculate depth of current folder and generate its display name with indented spaces */
-    int sidebar_folder_depth = 0;
-    char *sidebar_folder_name = NULL;
-    if (SidebarShortPath)
+    struct SbEntryKey key;
+    memset(&key, 0, sizeof(key));
+    key.settings = settings;
+    key.width = w;
+    key.msg_count = b->msg_count;
+    key.msg_unread = b->msg_unread;
+    key.msg_flagged = b->msg_flagged;
+    key.new = b->new;
+    if (Context && Context->realpath && (mutt_str_strcmp(b->realpath, Context->realpath) == 0))
     {
-      /* disregard a trailing separator, so strlen() - 2 */
-      sidebar_folder_name = b->path;
-      for (int i = mutt_str_strlen(sidebar_folder_name) - 2; i >= 0; i--)
-      {
-        if (SidebarDelimChars && strchr(SidebarDelimChars, sidebar_folder_name[i]))
-        {
-          sidebar_folder_name += (i + 1);
-          break;
-        }
-      }
+      key.open = true;
+      key.deleted = Context->deleted;
+      key.vcount = Context->vcount;
+      key.tagged = Context->tagged;
     }
-    else if ((SidebarComponentDepth > 0) && SidebarDelimChars)
-    {
-      sidebar_folder_name = b->path + maildir_is_prefix * (maildirlen + 1);
-      for (int i = 0; i < SidebarComponentDepth; i++)
-      {
-        char *chars_after_delim = strpbrk(sidebar_folder_name, SidebarDelimChars);
-        if (!chars_after_delim)
-          break;
-        else
-          sidebar_folder_name = chars_after_delim + 1;
-      }
-    }
-    else
-      sidebar_folder_name = b->path + maildir_is_prefix * (maildirlen + 1);
 
-    if (b->desc)
+    /* Only format the entries that have changed */
+    if (memcmp(&key, &entry->key, sizeof(key)) != 0)
     {
-      sidebar_folder_name = b->desc;
+      format_entry(entry, w);
+      entry->key = key;
     }
-    else if (maildir_is_prefix && SidebarFolderIndent)
-    {
-      const char *tmp_folder_name = NULL;
-      int lastsep = 0;
-      tmp_folder_name = b->path + maildirlen + 1;
-      int tmplen = (int) mutt_str_strlen(tmp_folder_name) - 1;
-      for (int i = 0; i < tmplen; i++)
-      {
-        if (SidebarDelimChars && strchr(SidebarDelimChars, tmp_folder_name[i]))
-        {
-          sidebar_folder_depth++;
-          lastsep = i + 1;
-        }
-      }
-      if (sidebar_folder_depth > 0)
-      {
-        if (SidebarShortPath)
-          tmp_folder_name += lastsep; /* basename */
-        int sfn_len = mutt_str_strlen(tmp_folder_name) +
-                      sidebar_folder_depth * mutt_str_strlen(SidebarIndentString) + 1;
-        sidebar_folder_name = mutt_mem_malloc(sfn_len);
-        sidebar_folder_name[0] = 0;
-        for (int i = 0; i < sidebar_folder_depth; i++)
-          mutt_str_strcat(sidebar_folder_name, sfn_len, NONULL(SidebarIndentString));
-        mutt_str_strcat(sidebar_folder_name, sfn_len, tmp_folder_name);
-      }
-    }
-    char str[STRING];
-    make_sidebar_entry(str, sizeof(str), w, sidebar_folder_name, entry);
-    printw("%s", str);
-    if (sidebar_folder_depth > 0)
-      FREE(&sidebar_folder_name);
+
+    printw("%s", entry->display);
     row++;
   }
 
@@ -1093,6 +1224,25 @@ const char *mutt_sb_get_highlight(void)
   return Entries[HilIndex]->buffy->path;
 }
 
+/**
+ * mutt_sb_is_visible - Is a Buffy on screen in the sidebar?
+ * @param b Mailbox
+ * @retval true The last redraw showed it
+ */
+bool mutt_sb_is_visible(const struct Buffy *b)
+{
+  if (!SidebarVisible || (TopIndex < 0) || (BotIndex < 0))
+    return false;
+
+  for (int entry = TopIndex; (entry <= BotIndex) && (entry < EntryCount); entry++)
+  {
+    if ((Entries[entry]->buffy == b) && !Entries[entry]->is_hidden)
+      return true;
+  }
+
+  return false;
+}
+
 /**
  * mutt_sb_set_open_buffy - Set the OpnBuffy based on the global Context
  *
@@ -1136,6 +1286,8 @@ void mutt_sb_notify_mailbox(struct Buffy *b, int created)
   /* Any new/deleted mailboxes will cause a refresh.  As long as
    * they're valid, our pointers will be updated in prepare_sidebar() */
 
+  EntriesSorted = false;
+
   if (created)
   {
     if (EntryCount >= EntryLen)
@@ -25,12 +25,15 @@
 #ifndef _MUTT_SIDEBAR_H
 #define _MUTT_SIDEBAR_H
 
+#include <stdbool.h>
+
 struct Context;
 struct Buffy;
 
 void mutt_sb_change_mailbox(int op);
 void mutt_sb_draw(void);
 const char *mutt_sb_get_highlight(void);
+bool mutt_sb_is_visible(const struct Buffy *b);
 void mutt_sb_notify_mailbox(struct Buffy *b, int created);
 void mutt_sb_set_buffystats(const struct Context *ctx);
 void mutt_sb_set_open_buffy(void);
@@ -30,6 +30,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 #include "mutt/mutt.h"
 #include "conn/conn.h"
@@ -58,6 +59,9 @@
 #define SMTP_PORT 25
 #define SMTPS_PORT 465
 
+#define SMTP_PIPELINE 100      /**< Most pipelined commands awaiting an answer */
+#define SMTP_CHUNK_SIZE 65536  /**< Size of a BDAT chunk */
+
 #define SMTP_AUTH_SUCCESS 0
 #define SMTP_AUTH_UNAVAIL 1
 #define SMTP_AUTH_FAIL -1
@@ -72,6 +76,8 @@ enum SmtpCapability
   DSN,
   EIGHTBITMIME,
   SMTPUTF8,
+  PIPELINING,
+  CHUNKING,
 
   CAPMAX
 };
@@ -79,6 +85,8 @@ enum SmtpCapability
 static int Esmtp = 0;
 static char *AuthMechs = NULL;
 static unsigned char Capabilities[(CAPMAX + 7) / 8];
+static struct Connection *IdleConn = NULL; /**< Connection kept open by $smtp_keepalive */
+static time_t IdleSince = 0;               /**< When IdleConn last sent a message */
 
 static bool valid_smtp_code(char *buf, size_t len, int *n)
 {
@@ -129,6 +137,10 @@ static int smtp_get_resp(struct Connection *conn)
       mutt_bit_set(Capabilities, STARTTLS);
     else if (mutt_str_strncasecmp("SMTPUTF8", buf + 4, 8) == 0)
       mutt_bit_set(Capabilities, SMTPUTF8);
+    else if (mutt_str_strncasecmp("PIPELINING", buf + 4, 10) == 0)
+      mutt_bit_set(Capabilities, PIPELINING);
+    else if (mutt_str_strncasecmp("CHUNKING", buf + 4, 8) == 0)
+      mutt_bit_set(Capabilities, CHUNKING);
 
     if (!valid_smtp_code(buf, n, &n))
       return SMTP_ERR_CODE;
@@ -143,7 +155,51 @@ static int smtp_get_resp(struct Connection *conn)
   return -1;
 }
 
-static int smtp_rcpt_to(struct Connection *conn, const struct Address *a)
+/**
+ * smtp_get_resps - Read the responses to the pipelined commands
+ * @param conn    SMTP connection
+ * @param pending Number of commands awaiting a response, reset to 0
+ * @retval  0 Success, every command succeeded
+ * @retval <0 The first error, e.g. #SMTP_ERR_READ
+ *
+ * If a command failed, the responses after it aren't read: the caller gives up
+ * and closes the connection.
+ */
+static int smtp_get_resps(struct Connection *conn, int *pending)
+{
+  int rc = 0;
+
+  for (; (rc == 0) && (*pending > 0); (*pending)--)
+    rc = smtp_get_resp(conn);
+
+  *pending = 0;
+  return rc;
+}
+
+/**
+ * smtp_cmd - Send a command, reading the response unless pipelining
+ * @param conn    SMTP connection
+ * @param cmd     Command, ending in CRLF
+ * @param pending Number of commands awaiting a response
+ * @retval  0 Success
+ * @retval <0 Error, e.g. #SMTP_ERR_WRITE
+ *
+ * If the server offers PIPELINING (RFC2920), the responses are left until
+ * smtp_get_resps() is called, or until #SMTP_PIPELINE of them are waiting.
+ */
+static int smtp_cmd(struct Connection *conn, const char *cmd, int *pending)
+{
+  if (mutt_socket_write(conn, cmd) == -1)
+    return SMTP_ERR_WRITE;
+
+  (*pending)++;
+  if (!mutt_bit_isset(Capabilities, PIPELINING) || (*pending >= SMTP_PIPELINE))
+    return smtp_get_resps(conn, pending);
+
+  return 0;
+}
+
+static int smtp_rcpt_to(struct Connection *conn, const struct Address *a, int *pending)
 {
   char buf[1024];
   int r;
@@ -160,9 +216,7 @@ static int smtp_rcpt_to(struct Connection *conn, const struct Address *a)
       snprintf(buf, sizeof(buf), "RCPT TO:<%s> NOTIFY=%s\r\n", a->mailbox, DsnNotify);
     else
       snprintf(buf, sizeof(buf), "RCPT TO:<%s>\r\n", a->mailbox);
-    if (mutt_socket_write(conn, buf) == -1)
-      return SMTP_ERR_WRITE;
-    r = smtp_get_resp(conn);
+    r = smtp_cmd(conn, buf, pending);
     if (r != 0)
       return r;
     a = a->next;
@@ -171,7 +225,83 @@ static int smtp_rcpt_to(struct Connection *conn, const struct Address *a)
   return 0;
 }
 
-static int smtp_data(struct Connection *conn, const char *msgfile)
+/**
+ * smtp_bdat - Send the message in BDAT chunks (RFC3030)
+ * @param conn     SMTP connection
+ * @param fp       Message file
+ * @param progress Progress bar
+ * @retval  0 Success
+ * @retval <0 Error, e.g. #SMTP_ERR_WRITE
+ *
+ * The chunks are length-counted, so the message isn't dot-stuffed.  This is
+ * only used alongside PIPELINING, so all the chunks are sent before reading
+ * their responses: the server only delivers the message on BDAT LAST.
+ */
+static int smtp_bdat(struct Connection *conn, FILE *fp, struct Progress *progress)
+{
+  struct Buffer *chunk = mutt_buffer_alloc(SMTP_CHUNK_SIZE + 1024);
+  char buf[1024];
+  char cmd[SHORT_STRING];
+  size_t buflen = 0;
+  bool term = false;
+  bool eof = false;
+  int pending = 0;
+  int rc = 0;
+
+  mutt_socket_cork(conn);
+  while (!eof)
+  {
+    mutt_buffer_reset(chunk);
+    while ((chunk->dptr - chunk->data) < SMTP_CHUNK_SIZE)
+    {
+      if (!fgets(buf, sizeof(buf) - 1, fp))
+      {
+        eof = true;
+        if (!term && buflen)
+          mutt_buffer_addstr(chunk, "\r\n");
+        break;
+      }
+      buflen = mutt_str_strlen(buf);
+      term = buflen && buf[buflen - 1] == '\n';
+      if (term && (buflen == 1 || buf[buflen - 2] != '\r'))
+        snprintf(buf + buflen - 1, sizeof(buf) - buflen + 1, "\r\n");
+      mutt_buffer_addstr(chunk, buf);
+    }
+
+    size_t len = chunk->dptr - chunk->data;
+    snprintf(cmd, sizeof(cmd), "BDAT %zu%s\r\n", len, eof ? " LAST" : "");
+    if ((mutt_socket_write(conn, cmd) == -1) ||
+        (len && (mutt_socket_write_d(conn, chunk->data, len, MUTT_SOCK_LOG_FULL) == -1)))
+    {
+      rc = SMTP_ERR_WRITE;
+      break;
+    }
+    pending++;
+    mutt_progress_update(progress, ftell(fp), -1);
+  }
+  mutt_buffer_free(&chunk);
+
+  if ((rc == 0) && (mutt_socket_uncork(conn) < 0))
+    rc = SMTP_ERR_WRITE;
+  if (rc == 0)
+    rc = smtp_get_resps(conn, &pending);
+
+  return rc;
+}
+
+/**
+ * smtp_data - Send the message
+ * @param conn    SMTP connection
+ * @param msgfile Message file, it's deleted
+ * @param pending Number of pipelined envelope commands awaiting a response
+ * @retval  0 Success
+ * @retval <0 Error, e.g. #SMTP_ERR_WRITE
+ *
+ * With PIPELINING, DATA is sent along with the envelope (RFC2920 allows it to
+ * end a group of commands), and none of the message is sent until every
+ * command of the envelope has succeeded.
+ */
+static int smtp_data(struct Connection *conn, const char *msgfile, int *pending)
 {
   char buf[1024];
   FILE *fp = NULL;
@@ -191,19 +321,26 @@ static int smtp_data(struct Connection *conn, const char *msgfile)
   mutt_progress_init(&progress, _("Sending message..."), MUTT_PROGRESS_SIZE,
                      NetInc, st.st_size);
 
-  snprintf(buf, sizeof(buf), "DATA\r\n");
-  if (mutt_socket_write(conn, buf) == -1)
+  if (mutt_bit_isset(Capabilities, PIPELINING) && mutt_bit_isset(Capabilities, CHUNKING))
   {
+    r = smtp_get_resps(conn, pending);
+    if (r == 0)
+      r = smtp_bdat(conn, fp, &progress);
     mutt_file_fclose(&fp);
-    return SMTP_ERR_WRITE;
+    return r;
   }
-  r = smtp_get_resp(conn);
+
+  r = smtp_cmd(conn, "DATA\r\n", pending);
+  if (r == 0)
+    r = smtp_get_resps(conn, pending);
   if (r != 0)
   {
     mutt_file_fclose(&fp);
     return r;
   }
 
+  /* send the message in large blocks, not a line at a time */
+  mutt_socket_cork(conn);
   while (fgets(buf, sizeof(buf) - 1, fp))
   {
     buflen = mutt_str_strlen(buf);
@@ -233,7 +370,7 @@ static int smtp_data(struct Connection *conn, const char *msgfile)
   mutt_file_fclose(&fp);
 
   /* terminate the message body */
-  if (mutt_socket_write(conn, ".\r\n") == -1)
+  if ((mutt_socket_write(conn, ".\r\n") == -1) || (mutt_socket_uncork(conn) < 0))
     return SMTP_ERR_WRITE;
 
   r = smtp_get_resp(conn);
@@ -641,6 +778,65 @@ static int smtp_open(struct Connection *conn)
   return 0;
 }
 
+/**
+ * smtp_quit - Say goodbye and close the connection
+ * @param conn SMTP connection
+ */
+static void smtp_quit(struct Connection *conn)
+{
+  if (conn->fd >= 0)
+  {
+    if (mutt_socket_write(conn, "QUIT\r\n") >= 0)
+      smtp_get_resp(conn);
+    mutt_socket_close(conn);
+  }
+}
+
+/**
+ * smtp_reuse - Try to reuse the connection kept open after the last message
+ * @param conn     SMTP connection for the current account
+ * @param eightbit The message needs 8BITMIME
+ * @retval true  The connection is ready for a new message
+ * @retval false The connection needs opening
+ */
+static bool smtp_reuse(struct Connection *conn, int eightbit)
+{
+  struct Connection *idle = IdleConn;
+
+  IdleConn = NULL;
+  if (!idle)
+    return false;
+
+  /* the account has changed, or the connection is too old to trust */
+  if ((idle != conn) || (SmtpKeepalive <= 0) ||
+      (time(NULL) - IdleSince > SmtpKeepalive) || (eightbit && !Esmtp))
+  {
+    smtp_quit(idle);
+    return false;
+  }
+
+  /* check that the server hasn't timed out the connection */
+  if ((conn->fd < 0) || (mutt_socket_write(conn, "RSET\r\n") < 0) ||
+      (smtp_get_resp(conn) != 0))
+  {
+    mutt_debug(1, "SMTP connection has gone, reconnecting\n");
+    mutt_socket_close(conn);
+    return false;
+  }
+
+  return true;
+}
+
+/**
+ * mutt_smtp_logout - Close the connection kept open by $smtp_keepalive
+ */
+void mutt_smtp_logout(void)
+{
+  if (IdleConn)
+    smtp_quit(IdleConn);
+  IdleConn = NULL;
+}
+
 int mutt_smtp_send(const struct Address *from, const struct Address *to,
                    const struct Address *cc, const struct Address *bcc,
                    const char *msgfile, int eightbit)
@@ -670,15 +866,20 @@ int mutt_smtp_send(const struct Address *from, const struct Address *to,
   if (!conn)
     return -1;
 
-  Esmtp = eightbit;
+  const bool reused = smtp_reuse(conn, eightbit);
+  if (!reused)
+    Esmtp = eightbit;
 
   do
   {
     /* send our greeting */
-    rc = smtp_open(conn);
-    if (rc != 0)
-      break;
-    FREE(&AuthMechs);
+    if (!reused)
+    {
+      rc = smtp_open(conn);
+      if (rc != 0)
+        break;
+      FREE(&AuthMechs);
+    }
 
     /* send the sender's address */
     int len = snprintf(buf, sizeof(buf), "MAIL FROM:<%s>", envfrom);
@@ -696,28 +897,38 @@ int mutt_smtp_send(const struct Address *from, const struct Address *to,
       snprintf(buf + len, sizeof(buf) - len, " SMTPUTF8");
     }
     mutt_str_strncat(buf, sizeof(buf), "\r\n", 3);
-    if (mutt_socket_write(conn, buf) == -1)
-    {
-      rc = SMTP_ERR_WRITE;
-      break;
-    }
-    rc = smtp_get_resp(conn);
+
+    /* with PIPELINING, the envelope goes out in one go */
+    int pending = 0;
+    if (mutt_bit_isset(Capabilities, PIPELINING))
+      mutt_socket_cork(conn);
+
+    rc = smtp_cmd(conn, buf, &pending);
     if (rc != 0)
       break;
 
     /* send the recipient list */
-    if ((rc = smtp_rcpt_to(conn, to)) || (rc = smtp_rcpt_to(conn, cc)) ||
-        (rc = smtp_rcpt_to(conn, bcc)))
+    if ((rc = smtp_rcpt_to(conn, to, &pending)) ||
+        (rc = smtp_rcpt_to(conn, cc, &pending)) ||
+        (rc = smtp_rcpt_to(conn, bcc, &pending)))
     {
       break;
     }
 
     /* send the message data */
-    rc = smtp_data(conn, msgfile);
+    rc = smtp_data(conn, msgfile, &pending);
     if (rc != 0)
       break;
 
-    mutt_socket_write(conn, "QUIT\r\n");
+    if (SmtpKeepalive > 0)
+    {
+      /* keep the connection for the next message */
+      IdleConn = conn;
+      IdleSince = time(NULL);
+      conn = NULL;
+    }
+    else
+      mutt_socket_write(conn, "QUIT\r\n");
 
     rc = 0;
   } while (0);
@@ -33,6 +33,7 @@
 #include "globals.h"
 #include "header.h"
 #include "options.h"
+#include "perf.h"
 #include "protos.h"
 #include "thread.h"
 #ifdef USE_NNTP
@@ -45,6 +46,25 @@
 /* function to use as discriminator when normal sort method is equal */
 static sort_t *AuxSort = NULL;
 
+/**
+ * struct SortItem - A Header being sorted, with the costly parts of its key
+ *
+ * The Header comes first, so the sort functions can still treat a pointer to
+ * a SortItem as a pointer to a pointer to a Header.
+ */
+struct SortItem
+{
+  struct Header *hdr;
+  char *from;            /**< mutt_get_name() of the From address */
+  char *to;              /**< mutt_get_name() of the To address */
+  const char *spam;      /**< Spam attribute, NULL if there isn't one */
+  const char *spam_rest; /**< Text after the number in the spam attribute */
+  double spam_value;     /**< Number at the start of the spam attribute */
+};
+
+/* The sort functions are being passed SortItems, see mutt_sort_headers() */
+static bool SortItems = false;
+
 static int perform_auxsort(int retval, const void *a, const void *b)
 {
   /* If the items compared equal by the main sort
@@ -135,9 +155,15 @@ static int compare_to(const void *a, const void *b)
   const char *fb = NULL;
   int result;
 
-  mutt_str_strfcpy(fa, mutt_get_name((*ppa)->env->to), SHORT_STRING);
-  fb = mutt_get_name((*ppb)->env->to);
-  result = mutt_str_strncasecmp(fa, fb, SHORT_STRING);
+  if (SortItems)
+    result = mutt_str_strncasecmp(((const struct SortItem *) a)->to,
+                                  ((const struct SortItem *) b)->to, SHORT_STRING);
+  else
+  {
+    mutt_str_strfcpy(fa, mutt_get_name((*ppa)->env->to), SHORT_STRING);
+    fb = mutt_get_name((*ppb)->env->to);
+    result = mutt_str_strncasecmp(fa, fb, SHORT_STRING);
+  }
   result = perform_auxsort(result, a, b);
   return (SORTCODE(result));
 }
@@ -150,9 +176,15 @@ static int compare_from(const void *a, const void *b)
   const char *fb = NULL;
   int result;
 
-  mutt_str_strfcpy(fa, mutt_get_name((*ppa)->env->from), SHORT_STRING);
-  fb = mutt_get_name((*ppb)->env->from);
-  result = mutt_str_strncasecmp(fa, fb, SHORT_STRING);
+  if (SortItems)
+    result = mutt_str_strncasecmp(((const struct SortItem *) a)->from,
+                                  ((const struct SortItem *) b)->from, SHORT_STRING);
+  else
+  {
+    mutt_str_strfcpy(fa, mutt_get_name((*ppa)->env->from), SHORT_STRING);
+    fb = mutt_get_name((*ppb)->env->from);
+    result = mutt_str_strncasecmp(fa, fb, SHORT_STRING);
+  }
   result = perform_auxsort(result, a, b);
   return (SORTCODE(result));
 }
@@ -190,6 +222,7 @@ static int compare_spam(const void *a, const void *b)
 {
   struct Header **ppa = (struct Header **) a;
   struct Header **ppb = (struct Header **) b;
+  const char *adata = NULL, *bdata = NULL;
   char *aptr = NULL, *bptr = NULL;
   int ahas, bhas;
   int result = 0;
@@ -197,8 +230,18 @@ static int compare_spam(const void *a, const void *b)
 
   /* Firstly, require spam attributes for both msgs */
   /* to compare. Determine which msgs have one.     */
-  ahas = (*ppa)->env && (*ppa)->env->spam;
-  bhas = (*ppb)->env && (*ppb)->env->spam;
+  if (SortItems)
+  {
+    adata = ((const struct SortItem *) a)->spam;
+    bdata = ((const struct SortItem *) b)->spam;
+  }
+  else
+  {
+    adata = ((*ppa)->env && (*ppa)->env->spam) ? (*ppa)->env->spam->data : NULL;
+    bdata = ((*ppb)->env && (*ppb)->env->spam) ? (*ppb)->env->spam->data : NULL;
+  }
+  ahas = (adata != NULL);
+  bhas = (bdata != NULL);
 
   /* If one msg has spam attr but other does not, sort the one with first. */
   if (ahas && !bhas)
@@ -216,15 +259,22 @@ static int compare_spam(const void *a, const void *b)
   /* Both have spam attrs. */
 
   /* preliminary numeric examination */
-  difference =
-      (strtod((*ppa)->env->spam->data, &aptr) - strtod((*ppb)->env->spam->data, &bptr));
+  if (SortItems)
+  {
+    const struct SortItem *ia = a, *ib = b;
+    difference = ia->spam_value - ib->spam_value;
+    aptr = (char *) ia->spam_rest;
+    bptr = (char *) ib->spam_rest;
+  }
+  else
+    difference = (strtod(adata, &aptr) - strtod(bdata, &bptr));
 
   /* map double into comparison (-1, 0, or 1) */
   result = (difference < 0.0 ? -1 : difference > 0.0 ? 1 : 0);
 
   /* If either aptr or bptr is equal to data, there is no numeric    */
   /* value for that spam attribute. In this case, compare lexically. */
-  if ((aptr == (*ppa)->env->spam->data) || (bptr == (*ppb)->env->spam->data))
+  if ((aptr == adata) || (bptr == bdata))
     return (SORTCODE(strcmp(aptr, bptr)));
 
   /* Otherwise, we have numeric value for both attrs. If these values */
@@ -302,11 +352,86 @@ sort_t *mutt_get_sort_func(int method)
   /* not reached */
 }
 
+/**
+ * sort_needs_items - Is a sort method slow enough to work out the keys first?
+ * @param method Sort method, e.g. #SORT_FROM
+ * @retval true The sort functions should be passed SortItems
+ *
+ * Finding the display name of an address can mean a reverse alias lookup or
+ * decoding an IDN, and the spam attribute has to be parsed as a number.
+ * Doing that in each comparison costs far more than the comparison itself.
+ */
+static bool sort_needs_items(int method)
+{
+  switch (method & SORT_MASK)
+  {
+    case SORT_FROM:
+    case SORT_TO:
+    case SORT_SPAM:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * sort_by_items - Sort the messages, working out each key only once
+ * @param ctx      Mailbox
+ * @param sortfunc Sort function
+ */
+static void sort_by_items(struct Context *ctx, sort_t *sortfunc)
+{
+  char buf[SHORT_STRING];
+  struct SortItem *items = mutt_mem_calloc(ctx->msgcount, sizeof(struct SortItem));
+  bool from = ((Sort & SORT_MASK) == SORT_FROM) || ((SortAux & SORT_MASK) == SORT_FROM);
+  bool to = ((Sort & SORT_MASK) == SORT_TO) || ((SortAux & SORT_MASK) == SORT_TO);
+  bool spam = ((Sort & SORT_MASK) == SORT_SPAM) || ((SortAux & SORT_MASK) == SORT_SPAM);
+
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    struct SortItem *item = &items[i];
+    struct Header *h = ctx->hdrs[i];
+
+    item->hdr = h;
+    /* the same length as the comparison used to copy */
+    if (from)
+    {
+      mutt_str_strfcpy(buf, mutt_get_name(h->env->from), sizeof(buf));
+      item->from = mutt_str_strdup(buf);
+    }
+    if (to)
+    {
+      mutt_str_strfcpy(buf, mutt_get_name(h->env->to), sizeof(buf));
+      item->to = mutt_str_strdup(buf);
+    }
+    if (spam && h->env && h->env->spam)
+    {
+      char *rest = NULL;
+      item->spam = h->env->spam->data;
+      item->spam_value = strtod(item->spam, &rest);
+      item->spam_rest = rest;
+    }
+  }
+
+  SortItems = true;
+  qsort((void *) items, ctx->msgcount, sizeof(struct SortItem), sortfunc);
+  SortItems = false;
+
+  for (int i = 0; i < ctx->msgcount; i++)
+  {
+    ctx->hdrs[i] = items[i].hdr;
+    FREE(&items[i].from);
+    FREE(&items[i].to);
+  }
+  FREE(&items);
+}
+
 void mutt_sort_headers(struct Context *ctx, int init)
 {
   struct Header *h = NULL;
   struct MuttThread *thread = NULL, *top = NULL;
   sort_t *sortfunc = NULL;
+  struct PerfTimer perf, perf_thread;
 
   OPT_NEED_RESORT = false;
 
@@ -326,12 +451,10 @@ void mutt_sort_headers(struct Context *ctx, int init)
 
   if (!ctx->quiet)
     mutt_message(_("Sorting mailbox..."));
+  mutt_perf_start(&perf, PERF_SORT);
 
   if (OPT_NEED_RESCORE && Score)
-  {
-    for (int i = 0; i < ctx->msgcount; i++)
-      mutt_score_message(ctx, ctx->hdrs[i], 1);
-  }
+    mutt_score_mailbox(ctx);
   OPT_NEED_RESCORE = false;
 
   if (OPT_RESORT_INIT)
@@ -357,7 +480,9 @@ void mutt_sort_headers(struct Context *ctx, int init)
       Sort = i;
       OPT_SORT_SUBTHREADS = false;
     }
+    mutt_perf_start(&perf_thread, PERF_THREAD);
     mutt_sort_threads(ctx, init);
+    mutt_perf_stop(&perf_thread);
   }
   else if ((sortfunc = mutt_get_sort_func(Sort)) == NULL ||
            (AuxSort = mutt_get_sort_func(SortAux)) == NULL)
@@ -366,6 +491,8 @@ void mutt_sort_headers(struct Context *ctx, int init)
     mutt_sleep(1);
     return;
   }
+  else if (sort_needs_items(Sort) || sort_needs_items(SortAux))
+    sort_by_items(ctx, sortfunc);
   else
     qsort((void *) ctx->hdrs, ctx->msgcount, sizeof(struct Header *), sortfunc);
 
@@ -400,6 +527,7 @@ void mutt_sort_headers(struct Context *ctx, int init)
     mutt_set_virtual(ctx);
   }
 
+  mutt_perf_stop(&perf);
   if (!ctx->quiet)
     mutt_clear_error();
 }
@@ -32,14 +32,21 @@
  *
  * | Function                          | Description
  * | :-------------------------------- | :-----------------------------------------------
+ * | driver_tags_empty()               | Does an email have no tags?
  * | driver_tags_free()                | Free tags from a header
- * | driver_tags_getter()              | Get transformed tags
  * | driver_tags_get_transformed()     | Get transformed tags
  * | driver_tags_get()                 | Get tags
  * | driver_tags_get_with_hidden()     | Get tags with hiddens
  * | driver_tags_get_transformed_for() | Get transformed tag for a tag name from a header
- * | driver_tags_add()                 | Add a tag to header
+ * | driver_tags_init()                | Forget the tags of a copied header
  * | driver_tags_replace()             | Replace all tags
+ * | driver_tags_transforms_changed()  | Note that the tag-transforms have changed
+ *
+ * Each tag name is interned once, with its display name and whether it's
+ * hidden.  Each distinct list of tags is interned too, as a TagSet shared by
+ * all the emails with those tags.  The strings that the index and the
+ * patterns ask for are built once per TagSet, not once per email, or once per
+ * screen refresh.
  */
 
 #include "config.h"
@@ -52,69 +59,189 @@ char *HiddenTags;           /**< Private tags which should not be displayed */
 struct Hash *TagTransforms; /**< Lookup table of alternative tag names */
 
 /**
- * driver_tags_getter - Get transformed tags
- * @param head             List of tags
- * @param show_hidden      Show hidden tags
- * @param show_transformed Show transformed tags
- * @param filter           Match tags to this string
- * @retval ptr String list of tags
+ * struct Tag - An interned tag name
+ */
+struct Tag
+{
+  char *name;        /**< Name of the tag */
+  char *transformed; /**< Display name, from tag-transforms, may be NULL */
+  bool hidden;       /**< The tag is in $hidden_tags */
+};
+
+/**
+ * struct TagSet - An interned list of tags
+ */
+struct TagSet
+{
+  char *key;          /**< All the tags, separated by spaces */
+  struct Tag **tags;  /**< The tags, in order */
+  int count;          /**< Number of tags */
+  int refs;           /**< Number of emails with these tags */
+  bool cached;        /**< visible and transformed are up to date */
+  char *visible;      /**< Tags that aren't hidden */
+  char *transformed;  /**< Tags that aren't hidden, transformed */
+};
+
+static struct Hash *TagNames = NULL; /**< Interned Tags, by name */
+static struct Hash *TagSets = NULL;  /**< Interned TagSets, by key */
+static char *TagsHiddenSeen = NULL;  /**< $hidden_tags when the Tags were checked */
+
+/**
+ * tag_is_hidden - Is a tag in $hidden_tags?
+ * @param name Tag name
+ * @retval true The tag is hidden
+ */
+static bool tag_is_hidden(const char *name)
+{
+  if (!HiddenTags)
+    return false;
+
+  char *p = strstr(HiddenTags, name);
+  size_t xsz = p ? mutt_str_strlen(name) : 0;
+
+  return p && ((p == HiddenTags) || (*(p - 1) == ',') || (*(p - 1) == ' ')) &&
+         ((*(p + xsz) == '\0') || (*(p + xsz) == ',') || (*(p + xsz) == ' '));
+}
+
+/**
+ * tag_update - Look up the display name of a tag, and whether it's hidden
+ * @param tag Tag to update
+ */
+static void tag_update(struct Tag *tag)
+{
+  mutt_str_replace(&tag->transformed, mutt_hash_find(TagTransforms, tag->name));
+  tag->hidden = tag_is_hidden(tag->name);
+}
+
+/**
+ * tags_refresh - Apply any change to $hidden_tags or tag-transforms
+ * @param force true if the tag-transforms have changed
  *
- * Return a new allocated string containing tags separated by space
+ * The Tags and the cached strings of the TagSets are brought up to date.
  */
-static char *driver_tags_getter(struct TagHead *head, bool show_hidden,
-                                bool show_transformed, char *filter)
+static void tags_refresh(bool force)
 {
-  if (!head)
-    return NULL;
+  if (!force && (mutt_str_strcmp(HiddenTags, TagsHiddenSeen) == 0))
+    return;
 
-  char *tags = NULL;
-  struct TagNode *np;
-  STAILQ_FOREACH(np, head, entries)
+  mutt_str_replace(&TagsHiddenSeen, HiddenTags);
+
+  struct HashWalkState state;
+  struct HashElem *elem = NULL;
+
+  if (TagNames)
   {
-    if (filter && mutt_str_strcmp(np->name, filter) != 0)
-      continue;
-    if (show_hidden || !np->hidden)
-    {
-      if (show_transformed && np->transformed)
-        mutt_str_append_item(&tags, np->transformed, ' ');
-      else
-        mutt_str_append_item(&tags, np->name, ' ');
-    }
+    memset(&state, 0, sizeof(state));
+    while ((elem = mutt_hash_walk(TagNames, &state)))
+      tag_update(elem->data);
+  }
+
+  if (TagSets)
+  {
+    memset(&state, 0, sizeof(state));
+    while ((elem = mutt_hash_walk(TagSets, &state)))
+      ((struct TagSet *) elem->data)->cached = false;
   }
-  return tags;
 }
 
 /**
- * driver_tags_add - Add a tag to header
- * @param[in] head List of tags
- * @param[in] new_tag string representing the new tag
- *
- * Add a tag to the header tags
+ * tag_intern - Find or create the Tag for a name
+ * @param name Tag name
+ * @retval ptr Interned Tag
  */
-static void driver_tags_add(struct TagHead *head, char *new_tag)
+static struct Tag *tag_intern(const char *name)
 {
-  char *new_tag_transformed = mutt_hash_find(TagTransforms, new_tag);
+  if (!TagNames)
+    TagNames = mutt_hash_create(64, 0);
+
+  struct Tag *tag = mutt_hash_find(TagNames, name);
+  if (tag)
+    return tag;
+
+  tag = mutt_mem_calloc(1, sizeof(struct Tag));
+  tag->name = mutt_str_substr_dup(name, NULL); /* may be empty */
+  tag_update(tag);
+  mutt_hash_insert(TagNames, tag->name, tag);
+  return tag;
+}
+
+/**
+ * tagset_intern - Find or create the TagSet for a list of tags
+ * @param tags Tags, separated by spaces
+ * @retval ptr Interned TagSet, with a reference for the caller
+ */
+static struct TagSet *tagset_intern(const char *tags)
+{
+  if (!TagSets)
+    TagSets = mutt_hash_create(256, 0);
+
+  struct TagSet *set = mutt_hash_find(TagSets, tags);
+  if (set)
+  {
+    set->refs++;
+    return set;
+  }
+
+  set = mutt_mem_calloc(1, sizeof(struct TagSet));
+  set->key = mutt_str_substr_dup(tags, NULL); /* may be empty */
+  set->refs = 1;
 
-  struct TagNode *np = mutt_mem_calloc(1, sizeof(struct TagNode));
-  np->name = mutt_str_strdup(new_tag);
-  np->hidden = false;
-  if (new_tag_transformed)
-    np->transformed = mutt_str_strdup(new_tag_transformed);
+  char *copy = mutt_str_substr_dup(tags, NULL);
+  char *list = copy, *name = NULL;
+  while ((name = strsep(&list, " ")))
+  {
+    mutt_mem_realloc(&set->tags, (set->count + 1) * sizeof(struct Tag *));
+    set->tags[set->count++] = tag_intern(name);
+  }
+  FREE(&copy);
+
+  mutt_hash_insert(TagSets, set->key, set);
+  return set;
+}
+
+/**
+ * tagset_strings - Build the strings of a TagSet that leave out hidden tags
+ * @param set TagSet
+ */
+static void tagset_strings(struct TagSet *set)
+{
+  tags_refresh(false);
+  if (set->cached)
+    return;
 
-  /* filter out hidden tags */
-  if (HiddenTags)
+  FREE(&set->visible);
+  FREE(&set->transformed);
+  for (int i = 0; i < set->count; i++)
   {
-    char *p = strstr(HiddenTags, new_tag);
-    size_t xsz = p ? mutt_str_strlen(new_tag) : 0;
-
-    if (p && ((p == HiddenTags) || (*(p - 1) == ',') || (*(p - 1) == ' ')) &&
-        ((*(p + xsz) == '\0') || (*(p + xsz) == ',') || (*(p + xsz) == ' ')))
-    {
-      np->hidden = true;
-    }
+    struct Tag *tag = set->tags[i];
+    if (tag->hidden)
+      continue;
+    mutt_str_append_item(&set->visible, tag->name, ' ');
+    mutt_str_append_item(&set->transformed, tag->transformed ? tag->transformed : tag->name, ' ');
   }
+  set->cached = true;
+}
+
+/**
+ * driver_tags_empty - Does an email have no tags?
+ * @param head Tags of the email
+ * @retval true The email has no tags
+ */
+bool driver_tags_empty(struct TagHead *head)
+{
+  return !head || !head->set;
+}
 
-  STAILQ_INSERT_TAIL(head, np, entries);
+/**
+ * driver_tags_init - Forget the tags of a copied header
+ * @param head Tags of the email
+ *
+ * The header was copied, e.g. from the header cache, so its tags belong to
+ * another email, or to nobody.
+ */
+void driver_tags_init(struct TagHead *head)
+{
+  head->set = NULL;
 }
 
 /**
@@ -125,19 +252,20 @@ static void driver_tags_add(struct TagHead *head, char *new_tag)
  */
 void driver_tags_free(struct TagHead *head)
 {
-  if (!head)
+  if (!head || !head->set)
     return;
 
-  struct TagNode *np = STAILQ_FIRST(head), *next = NULL;
-  while (np)
-  {
-    next = STAILQ_NEXT(np, entries);
-    FREE(&np->name);
-    FREE(&np->transformed);
-    FREE(&np);
-    np = next;
-  }
-  STAILQ_INIT(head);
+  struct TagSet *set = head->set;
+  head->set = NULL;
+  if (--set->refs > 0)
+    return;
+
+  mutt_hash_delete(TagSets, set->key, set);
+  FREE(&set->key);
+  FREE(&set->tags);
+  FREE(&set->visible);
+  FREE(&set->transformed);
+  FREE(&set);
 }
 
 /**
@@ -149,7 +277,11 @@ void driver_tags_free(struct TagHead *head)
  */
 char *driver_tags_get_transformed(struct TagHead *head)
 {
-  return driver_tags_getter(head, false, true, NULL);
+  if (!head || !head->set)
+    return NULL;
+
+  tagset_strings(head->set);
+  return mutt_str_strdup(head->set->transformed);
 }
 
 /**
@@ -160,7 +292,11 @@ char *driver_tags_get_transformed(struct TagHead *head)
  */
 char *driver_tags_get(struct TagHead *head)
 {
-  return driver_tags_getter(head, false, false, NULL);
+  if (!head || !head->set)
+    return NULL;
+
+  tagset_strings(head->set);
+  return mutt_str_strdup(head->set->visible);
 }
 
 /**
@@ -172,7 +308,15 @@ char *driver_tags_get(struct TagHead *head)
  */
 char *driver_tags_get_with_hidden(struct TagHead *head)
 {
-  return driver_tags_getter(head, true, false, NULL);
+  if (!head || !head->set)
+    return NULL;
+
+  /* Not a copy of the key: built like the other strings, empty tags are
+   * joined the same way */
+  char *tags = NULL;
+  for (int i = 0; i < head->set->count; i++)
+    mutt_str_append_item(&tags, head->set->tags[i]->name, ' ');
+  return tags;
 }
 
 /**
@@ -187,7 +331,21 @@ char *driver_tags_get_with_hidden(struct TagHead *head)
  */
 char *driver_tags_get_transformed_for(char *name, struct TagHead *head)
 {
-  return driver_tags_getter(head, true, true, name);
+  if (!head || !head->set || !TagNames)
+    return NULL;
+
+  tags_refresh(false);
+
+  /* Interned, so the tags can be compared by address */
+  struct Tag *tag = mutt_hash_find(TagNames, name);
+  if (!tag)
+    return NULL;
+
+  char *tags = NULL;
+  for (int i = 0; i < head->set->count; i++)
+    if (head->set->tags[i] == tag)
+      mutt_str_append_item(&tags, tag->transformed ? tag->transformed : tag->name, ' ');
+  return tags;
 }
 
 /**
@@ -197,9 +355,10 @@ char *driver_tags_get_transformed_for(char *name, struct TagHead *head)
  * @retval false No changes are made
  * @retval true  Tags are updated
  *
- * Free current tags structures and replace it by new tags
+ * Free current tags structures and replace it by new tags.  The caller keeps
+ * ownership of the string.
  */
-bool driver_tags_replace(struct TagHead *head, char *tags)
+bool driver_tags_replace(struct TagHead *head, const char *tags)
 {
   if (!head)
     return false;
@@ -207,11 +366,14 @@ bool driver_tags_replace(struct TagHead *head, char *tags)
   driver_tags_free(head);
 
   if (tags)
-  {
-    char *tag;
-    while ((tag = strsep(&tags, " ")))
-      driver_tags_add(head, tag);
-    FREE(&tags);
-  }
+    head->set = tagset_intern(tags);
   return true;
 }
+
+/**
+ * driver_tags_transforms_changed - Note that the tag-transforms have changed
+ */
+void driver_tags_transforms_changed(void)
+{
+  tags_refresh(true);
+}
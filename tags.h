@@ -29,26 +29,26 @@
 extern char *HiddenTags;
 extern struct Hash *TagTransforms;
 
+struct TagSet;
+
 /**
- * struct TagNode - LinkedList Tag Element
+ * struct TagHead - The driver tags of an email
  *
- * Keep a linked list of header tags and their transformed values.
- * Textual tags can be transformed to symbols to save space.
+ * Emails with the same tags share one interned TagSet.
  */
-struct TagNode
+struct TagHead
 {
-    char *name;
-    char *transformed;
-    bool hidden;
-    STAILQ_ENTRY(TagNode) entries;
+  struct TagSet *set; /**< Tags of the email, NULL if none */
 };
-STAILQ_HEAD(TagHead, TagNode);
 
+bool  driver_tags_empty(struct TagHead *head);
 void  driver_tags_free(struct TagHead *head);
 char *driver_tags_get(struct TagHead *head);
 char *driver_tags_get_transformed_for(char *name, struct TagHead *head);
 char *driver_tags_get_transformed(struct TagHead *head);
 char *driver_tags_get_with_hidden(struct TagHead *head);
-bool  driver_tags_replace(struct TagHead *head, char *tags);
+void  driver_tags_init(struct TagHead *head);
+bool  driver_tags_replace(struct TagHead *head, const char *tags);
+void  driver_tags_transforms_changed(void);
 
 #endif /* _MUTT_TAG_H */
@@ -0,0 +1,637 @@
+/**
+ * @file
+ * Benchmark the hot paths of reading and displaying a mailbox
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page bench Mailbox benchmark
+ *
+ * Generate a synthetic mailbox from a fixed seed, then time parsing its
+ * headers, sorting it by every $sort method, threading it, matching common
+ * patterns against it, rendering its index lines and decoding base64 and
+ * quoted-printable bodies.
+ *
+ * Every case is run several times and the fastest run is reported, as JSON on
+ * stdout:
+ *
+ *     { "messages": 20000, "seed": 1, "runs": 3, "results": [
+ *       { "name": "parse", "items": 20000, "ms": 61.2, "per_sec": 326797, "check": 20000 },
+ *       ... ] }
+ *
+ * `check` is a count that depends on the result, e.g. the number of matches.
+ * It should only change when the corpus or the behaviour does.
+ *
+ * Usage: neomutt-bench [-n messages] [-s seed] [-r runs] [-e command]
+ */
+
+#define MAIN_C 1
+
+#include "config.h"
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mutt/mutt.h"
+#include "mutt.h"
+#include "body.h"
+#include "buffy.h"
+#include "context.h"
+#include "envelope.h"
+#include "format_flags.h"
+#include "globals.h"
+#include "header.h"
+#include "mailbox.h"
+#include "mutt_curses.h"
+#include "mx.h"
+#include "options.h"
+#include "pattern.h"
+#include "protos.h"
+#include "sort.h"
+#include "state.h"
+#include "thread.h"
+
+char **envlist = NULL;
+
+void mutt_exit(int code)
+{
+  exit(code);
+}
+
+/**
+ * quiet_message - Discard progress messages
+ */
+static void quiet_message(const char *format, ...)
+{
+}
+
+/**
+ * Patterns - Typical limits and colour rules
+ */
+static const char *const Patterns[] = {
+  "~N",
+  "~F",
+  "~f sender17",
+  "~s release",
+  "~C list@bench",
+  "~d 01/06/2017-14/06/2017",
+  "~s kernel | ~f sender3",
+  "!~s ^Re:",
+  "~x <1[0-9]@",
+  "~y urgent",
+};
+
+/**
+ * struct BenchCorpus - The synthetic mailbox
+ */
+struct BenchCorpus
+{
+  FILE *fp;         /**< Headers of all the messages */
+  LOFF_T *offsets;  /**< Where each message begins */
+  size_t count;     /**< Number of messages */
+  FILE *b64;        /**< A base64 encoded body */
+  FILE *qp;         /**< A quoted-printable encoded body */
+  LOFF_T b64_len;   /**< Length of the base64 body */
+  LOFF_T qp_len;    /**< Length of the quoted-printable body */
+};
+
+/**
+ * struct BenchResult - The fastest run of one case
+ */
+struct BenchResult
+{
+  double best;  /**< Fastest run, in microseconds */
+  size_t items; /**< Messages, or bytes, handled per run */
+  long check;   /**< Result-dependent count, to catch behaviour changes */
+};
+
+static unsigned long Seed = 1; /**< State of the corpus generator */
+
+/**
+ * bench_rand - Deterministic pseudo-random numbers
+ * @param n Upper bound, exclusive
+ * @retval num Number in [0, n)
+ *
+ * rand() differs between C libraries, so the corpus would too.
+ */
+static unsigned long bench_rand(unsigned long n)
+{
+  Seed = Seed * 6364136223846793005UL + 1442695040888963407UL;
+  return (Seed >> 33) % n;
+}
+
+/**
+ * now_usecs - Get a monotonic timestamp
+ * @retval num Microseconds
+ */
+static double now_usecs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * make_corpus - Write the synthetic messages and bodies
+ * @param c Corpus to fill
+ * @param n Number of messages
+ * @retval  0 Success
+ * @retval -1 Error
+ *
+ * About half the messages reply to a recent one, so that threading has
+ * something to do.  Some go to a long Cc list.
+ */
+static int make_corpus(struct BenchCorpus *c, size_t n)
+{
+  static const char *const words[] = {
+    "kernel", "release", "build", "meeting", "patch", "review", "question",
+    "report", "update", "invoice", "weekly", "notes", "urgent", "holiday",
+  };
+  static const char *const zones[] = { "+0000", "-0500", "+0100", "+0530", "-0800" };
+  time_t base = 1483228800; /* 2017-01-01, so the corpus doesn't depend on today */
+
+  c->fp = tmpfile();
+  c->b64 = tmpfile();
+  c->qp = tmpfile();
+  if (!c->fp || !c->b64 || !c->qp)
+    return -1;
+
+  c->count = n;
+  c->offsets = mutt_mem_calloc(n, sizeof(LOFF_T));
+  int *parent = mutt_mem_calloc(n, sizeof(int));
+  int *topic = mutt_mem_calloc(n, sizeof(int));
+
+  for (size_t i = 0; i < n; i++)
+  {
+    char date[SHORT_STRING];
+    time_t t = base + i * (365 * 24 * 3600 / n) + bench_rand(3600);
+    struct tm *tm = gmtime(&t);
+    strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S", tm);
+
+    parent[i] = ((i > 0) && bench_rand(2)) ? (int) (i - 1 - bench_rand(MIN(i, 200))) : -1;
+    topic[i] = (parent[i] >= 0) ? topic[parent[i]] : (int) i;
+
+    c->offsets[i] = ftello(c->fp);
+    fprintf(c->fp, "From sender%lu@bench.example.org %s\n", bench_rand(500), date);
+    fprintf(c->fp, "Received: from mx%lu.bench.example.org by bench.example.org;\n"
+                   "\t%s %s\n",
+            bench_rand(10), date, zones[bench_rand(5)]);
+    fprintf(c->fp, "Date: %s %s\n", date, zones[bench_rand(5)]);
+    fprintf(c->fp, "From: \"Sender %lu\" <sender%lu@bench.example.org>\n",
+            bench_rand(500), bench_rand(500));
+    fprintf(c->fp, "To: list@bench.example.org\n");
+    if (bench_rand(10) == 0)
+    {
+      fprintf(c->fp, "Cc: ");
+      for (int j = 0, cc = 2 + bench_rand(40); j < cc; j++)
+        fprintf(c->fp, "%s\"Member %d\" <member%d@bench.example.org>", j ? ",\n " : "", j, j);
+      fprintf(c->fp, "\n");
+    }
+    fprintf(c->fp, "Subject: %s%s %s %d\n", (parent[i] >= 0) ? "Re: " : "",
+            words[topic[i] % mutt_array_size(words)],
+            words[(topic[i] / 7) % mutt_array_size(words)], topic[i]);
+    fprintf(c->fp, "Message-ID: <%zu@bench.example.org>\n", i);
+    if (parent[i] >= 0)
+    {
+      fprintf(c->fp, "In-Reply-To: <%d@bench.example.org>\n", parent[i]);
+      fprintf(c->fp, "References:");
+      for (int p = parent[i], depth = 0; (p >= 0) && (depth < 10); p = parent[p], depth++)
+        fprintf(c->fp, " <%d@bench.example.org>", p);
+      fprintf(c->fp, "\n");
+    }
+    fprintf(c->fp, "MIME-Version: 1.0\n"
+                   "Content-Type: text/plain; charset=utf-8\n"
+                   "Content-Transfer-Encoding: quoted-printable\n");
+    if (bench_rand(20) == 0)
+      fprintf(c->fp, "X-Label: %s\n", words[bench_rand(mutt_array_size(words))]);
+    unsigned long status = bench_rand(4);
+    if (status != 0)
+      fprintf(c->fp, "Status: %s\n", (status == 1) ? "O" : "RO");
+    if (bench_rand(30) == 0)
+      fprintf(c->fp, "X-Status: F\n");
+    fprintf(c->fp, "Content-Length: %lu\nLines: %lu\n\n", 200 + bench_rand(20000),
+            5 + bench_rand(400));
+  }
+
+  FREE(&parent);
+  FREE(&topic);
+
+  /* A megabyte of binary data, and of accented text */
+  char raw[57];
+  char enc[128];
+  for (int i = 0; i < (1 << 20) / (int) sizeof(raw); i++)
+  {
+    for (size_t j = 0; j < sizeof(raw); j++)
+      raw[j] = bench_rand(256);
+    mutt_b64_encode(enc, raw, sizeof(raw), sizeof(enc));
+    fprintf(c->b64, "%s\n", enc);
+  }
+  for (int i = 0; i < (1 << 20) / 64; i++)
+  {
+    fprintf(c->qp, "Caf=C3=A9 cr=C3=A8me br=C3=BBl=C3=A9e %s and some plain text=\n%s\n",
+            words[bench_rand(mutt_array_size(words))], bench_rand(2) ? "na=C3=AFve" : "");
+  }
+
+  c->b64_len = ftello(c->b64);
+  c->qp_len = ftello(c->qp);
+  if ((c->b64_len <= 0) || (c->qp_len <= 0) || fflush(c->fp) || fflush(c->b64) || fflush(c->qp))
+    return -1;
+  return 0;
+}
+
+/**
+ * free_corpus - Free the synthetic mailbox
+ * @param c Corpus
+ */
+static void free_corpus(struct BenchCorpus *c)
+{
+  mutt_file_fclose(&c->fp);
+  mutt_file_fclose(&c->b64);
+  mutt_file_fclose(&c->qp);
+  FREE(&c->offsets);
+}
+
+/**
+ * parse_headers - Parse the header of every message
+ * @param c Corpus
+ * @retval ptr Array of Headers
+ */
+static struct Header **parse_headers(struct BenchCorpus *c)
+{
+  struct Header **hdrs = mutt_mem_calloc(c->count, sizeof(struct Header *));
+
+  for (size_t i = 0; i < c->count; i++)
+  {
+    if (fseeko(c->fp, c->offsets[i], SEEK_SET) != 0)
+      break;
+
+    /* skip the From_ line, as the mbox driver does */
+    char buf[LONG_STRING];
+    if (!fgets(buf, sizeof(buf), c->fp))
+      break;
+
+    struct Header *h = mutt_new_header();
+    h->offset = c->offsets[i];
+    h->index = i;
+    h->env = mutt_read_rfc822_header(c->fp, h, 0, 0);
+    hdrs[i] = h;
+  }
+
+  return hdrs;
+}
+
+/**
+ * free_headers - Free an array of Headers
+ * @param hdrs  Headers
+ * @param count Number of Headers
+ */
+static void free_headers(struct Header ***hdrs, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    mutt_free_header(&(*hdrs)[i]);
+  FREE(hdrs);
+}
+
+/**
+ * make_context - Turn the parsed Headers into a mailbox
+ * @param hdrs  Headers, taken over by the Context
+ * @param count Number of Headers
+ * @retval ptr New Context
+ */
+static struct Context *make_context(struct Header **hdrs, size_t count)
+{
+  struct Context *ctx = mutt_mem_calloc(1, sizeof(struct Context));
+
+  ctx->path = mutt_str_strdup("bench");
+  ctx->realpath = mutt_str_strdup("bench");
+  ctx->magic = MUTT_MBOX;
+  ctx->quiet = true;
+  ctx->peekonly = true;
+  mutt_make_label_hash(ctx);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    if (ctx->msgcount == ctx->hdrmax)
+      mx_alloc_memory(ctx);
+    ctx->hdrs[ctx->msgcount++] = hdrs[i];
+  }
+  mx_update_context(ctx, ctx->msgcount);
+
+  return ctx;
+}
+
+/**
+ * sort_by - Sort the mailbox
+ * @param ctx  Mailbox
+ * @param sort $sort method
+ */
+static void sort_by(struct Context *ctx, short sort)
+{
+  Sort = sort;
+  mutt_sort_headers(ctx, 1);
+}
+
+/**
+ * thread_check - Count the threads of the mailbox
+ * @param ctx Mailbox
+ * @retval num Number of top-level threads
+ */
+static long thread_check(struct Context *ctx)
+{
+  long n = 0;
+  for (struct MuttThread *t = ctx->tree; t; t = t->next)
+    n++;
+  return n;
+}
+
+/**
+ * decode - Decode a body into /dev/null
+ * @param fp       Encoded body
+ * @param len      Length of the body
+ * @param encoding Content-Transfer-Encoding, e.g. #ENCBASE64
+ * @param out      Output stream
+ * @retval num Number of bytes written
+ */
+static long decode(FILE *fp, LOFF_T len, int encoding, FILE *out)
+{
+  struct Body b;
+  struct State s;
+
+  memset(&b, 0, sizeof(b));
+  memset(&s, 0, sizeof(s));
+  b.type = TYPEAPPLICATION;
+  b.encoding = encoding;
+  b.offset = 0;
+  b.length = len;
+  s.fpin = fp;
+  s.fpout = out;
+
+  rewind(out);
+  mutt_decode_attachment(&b, &s);
+  return ftello(out);
+}
+
+/**
+ * report - Print one result as a JSON object
+ * @param first True for the first result
+ * @param name  Name of the case
+ * @param r     Result
+ */
+static void report(bool first, const char *name, const struct BenchResult *r)
+{
+  printf("%s\n    { \"name\": \"", first ? "" : ",");
+  for (const char *p = name; *p; p++)
+  {
+    if ((*p == '"') || (*p == '\\'))
+      putchar('\\');
+    putchar(*p);
+  }
+  printf("\", \"items\": %zu, \"ms\": %.3f, \"per_sec\": %.0f, \"check\": %ld }",
+         r->items, r->best / 1e3, (r->best > 0) ? r->items * 1e6 / r->best : 0, r->check);
+}
+
+/**
+ * record - Keep the fastest run
+ * @param r     Result
+ * @param usecs Time of this run
+ */
+static void record(struct BenchResult *r, double usecs)
+{
+  if ((r->best == 0) || (usecs < r->best))
+    r->best = usecs;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n messages] [-s seed] [-r runs] [-e command]\n", prog);
+  fprintf(stderr, "  -n  Number of synthetic messages (default 20000)\n");
+  fprintf(stderr, "  -s  Seed of the synthetic mailbox (default 1)\n");
+  fprintf(stderr, "  -r  Runs of each case; the fastest is reported (default 3)\n");
+  fprintf(stderr, "  -e  Config command to run first, e.g. 'set index_format=%%s'\n");
+}
+
+int main(int argc, char *argv[])
+{
+  struct ListHead commands = STAILQ_HEAD_INITIALIZER(commands);
+  struct BenchCorpus corpus;
+  struct BenchResult r;
+  struct Buffer err;
+  size_t n = 20000;
+  unsigned long seed = 1;
+  int runs = 3;
+  int opt;
+  bool first = true;
+  double t0;
+
+  while ((opt = getopt(argc, argv, "n:s:r:e:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        n = strtoul(optarg, NULL, 10);
+        break;
+      case 's':
+        seed = strtoul(optarg, NULL, 10);
+        break;
+      case 'r':
+        runs = atoi(optarg);
+        break;
+      case 'e':
+        mutt_list_insert_tail(&commands, mutt_str_strdup(optarg));
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if ((n == 0) || (runs < 1))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  /* The defaults of every variable, and nothing from the user's config */
+  OPT_NO_CURSES = true;
+  mutt_message = quiet_message;
+  mutt_list_insert_tail(&Muttrc, mutt_str_strdup("/dev/null"));
+  mutt_init(1, &commands);
+  mutt_list_free(&commands);
+
+  /* Index lines are formatted to the width of a standard terminal */
+  mutt_init_windows();
+  MuttIndexWindow->cols = 80;
+
+  Seed = seed;
+  memset(&corpus, 0, sizeof(corpus));
+  if (make_corpus(&corpus, n) != 0)
+  {
+    fprintf(stderr, "%s: can't create the synthetic mailbox\n", argv[0]);
+    free_corpus(&corpus);
+    return 1;
+  }
+
+  printf("{ \"messages\": %zu, \"seed\": %lu, \"runs\": %d, \"results\": [", n, seed, runs);
+
+  /* Header parsing */
+  struct Header **hdrs = NULL;
+  memset(&r, 0, sizeof(r));
+  for (int i = 0; i < runs; i++)
+  {
+    if (hdrs)
+      free_headers(&hdrs, n);
+    t0 = now_usecs();
+    hdrs = parse_headers(&corpus);
+    record(&r, now_usecs() - t0);
+  }
+  r.items = n;
+  for (size_t i = 0; i < n; i++)
+    r.check += hdrs[i] && hdrs[i]->env && hdrs[i]->env->message_id;
+  report(first, "parse", &r);
+  first = false;
+
+  struct Context *ctx = make_context(hdrs, n);
+  FREE(&hdrs);
+  Context = ctx;
+
+  /* Sorting, from mailbox order each time */
+  for (const struct Mapping *m = SortMethods; m->name; m++)
+  {
+    if ((m->value == SORT_THREADS) || ((m > SortMethods) && (m[-1].value == m->value)))
+      continue;
+
+    char name[STRING];
+    snprintf(name, sizeof(name), "sort/%s", m->name);
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < runs; i++)
+    {
+      sort_by(ctx, SORT_ORDER);
+      t0 = now_usecs();
+      sort_by(ctx, m->value);
+      record(&r, now_usecs() - t0);
+    }
+    r.items = n;
+    r.check = ctx->hdrs[0]->index;
+    report(first, name, &r);
+  }
+
+  /* Threading */
+  memset(&r, 0, sizeof(r));
+  for (int i = 0; i < runs; i++)
+  {
+    sort_by(ctx, SORT_ORDER);
+    t0 = now_usecs();
+    sort_by(ctx, SORT_THREADS);
+    record(&r, now_usecs() - t0);
+  }
+  r.items = n;
+  r.check = thread_check(ctx);
+  report(first, "thread", &r);
+
+  /* Patterns */
+  sort_by(ctx, SORT_DATE);
+  mutt_buffer_init(&err);
+  err.dsize = STRING;
+  err.data = mutt_mem_malloc(err.dsize);
+  for (size_t p = 0; p < mutt_array_size(Patterns); p++)
+  {
+    char buf[STRING];
+    char name[STRING];
+
+    mutt_str_strfcpy(buf, Patterns[p], sizeof(buf));
+    struct Pattern *pat = mutt_pattern_comp(buf, MUTT_FULL_MSG, &err);
+    if (!pat)
+    {
+      fprintf(stderr, "%s: %s\n", Patterns[p], err.data);
+      continue;
+    }
+
+    snprintf(name, sizeof(name), "pattern/%s", Patterns[p]);
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < runs; i++)
+    {
+      long matches = 0;
+      t0 = now_usecs();
+      for (int j = 0; j < ctx->msgcount; j++)
+        if (mutt_pattern_exec(pat, MUTT_MATCH_FULL_ADDRESS, ctx, ctx->hdrs[j], NULL) > 0)
+          matches++;
+      record(&r, now_usecs() - t0);
+      r.check = matches;
+    }
+    r.items = n;
+    report(first, name, &r);
+    mutt_pattern_free(&pat);
+  }
+  FREE(&err.data);
+
+  /* Index lines */
+  memset(&r, 0, sizeof(r));
+  for (int i = 0; i < runs; i++)
+  {
+    char buf[LONG_STRING];
+    long len = 0;
+    t0 = now_usecs();
+    for (int j = 0; j < ctx->msgcount; j++)
+    {
+      mutt_make_string_flags(buf, sizeof(buf), NONULL(IndexFormat), ctx, ctx->hdrs[j],
+                             MUTT_FORMAT_MAKEPRINT | MUTT_FORMAT_INDEX);
+      len += strlen(buf);
+    }
+    record(&r, now_usecs() - t0);
+    r.check = len;
+  }
+  r.items = n;
+  report(first, "render/index_format", &r);
+
+  /* Body decoding */
+  FILE *out = tmpfile();
+  if (out)
+  {
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < runs; i++)
+    {
+      t0 = now_usecs();
+      r.check = decode(corpus.b64, corpus.b64_len, ENCBASE64, out);
+      record(&r, now_usecs() - t0);
+    }
+    r.items = corpus.b64_len;
+    report(first, "decode/base64", &r);
+
+    memset(&r, 0, sizeof(r));
+    for (int i = 0; i < runs; i++)
+    {
+      t0 = now_usecs();
+      r.check = decode(corpus.qp, corpus.qp_len, ENCQUOTEDPRINTABLE, out);
+      record(&r, now_usecs() - t0);
+    }
+    r.items = corpus.qp_len;
+    report(first, "decode/quoted-printable", &r);
+    mutt_file_fclose(&out);
+  }
+
+  printf("\n] }\n");
+
+  Context = NULL;
+  mx_fastclose_mailbox(ctx);
+  FREE(&ctx);
+  free_corpus(&corpus);
+  mutt_free_windows();
+
+  return 0;
+}
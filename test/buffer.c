@@ -0,0 +1,44 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <string.h>
+#include "mutt/buffer.h"
+#include "mutt/memory.h"
+#include "mutt/string2.h"
+
+void test_buffer_grow(void)
+{
+  struct Buffer *buf = mutt_buffer_new();
+  int reallocs = 0;
+  size_t lastsize = 0;
+
+  for (int i = 0; i < 100000; i++)
+  {
+    mutt_buffer_addch(buf, 'a' + (i % 26));
+    if (buf->dsize != lastsize)
+    {
+      reallocs++;
+      lastsize = buf->dsize;
+    }
+  }
+
+  TEST_CHECK(mutt_str_strlen(buf->data) == 100000);
+  TEST_CHECK(buf->data[99999] == 'a' + (99999 % 26));
+  /* the size doubles, rather than growing by a fixed step */
+  if (!TEST_CHECK(reallocs < 20))
+    TEST_MSG("Reallocs: %d", reallocs);
+
+  mutt_buffer_reset(buf);
+  mutt_buffer_printf(buf, "%0300d", 7);
+  TEST_CHECK(mutt_str_strlen(buf->data) == 300);
+  mutt_buffer_printf(buf, "%s", "end");
+  TEST_CHECK(strcmp(buf->data + 300, "end") == 0);
+
+  mutt_buffer_free(&buf);
+
+  struct Buffer b;
+  mutt_buffer_init(&b);
+  mutt_buffer_printf(&b, "%0500d", 1);
+  TEST_CHECK((mutt_str_strlen(b.data) == 500) && (b.dsize > 500));
+  FREE(&b.data);
+}
@@ -0,0 +1,43 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <iconv.h>
+#include <string.h>
+#include "mutt/charset.h"
+
+void test_charset_iconv_cache(void)
+{
+  iconv_t cd1 = mutt_ch_iconv_open("utf-8", "ISO8859-1", 0);
+  if (!TEST_CHECK(cd1 != (iconv_t) -1))
+    return;
+
+  /* a descriptor in use isn't handed out twice */
+  iconv_t cd2 = mutt_ch_iconv_open("utf-8", "iso-8859-1", 0);
+  TEST_CHECK((cd2 != (iconv_t) -1) && (cd2 != cd1));
+
+  /* a closed one is reused, whatever the spelling of the charset */
+  mutt_ch_iconv_close(cd1);
+  iconv_t cd3 = mutt_ch_iconv_open("UTF8", "iso-8859-1", 0);
+  TEST_CHECK(cd3 == cd1);
+
+  char in[] = "caf\351";
+  char out[16] = { 0 };
+  char *ib = in, *ob = out;
+  size_t ibl = strlen(in), obl = sizeof(out) - 1;
+  iconv(cd3, &ib, &ibl, &ob, &obl);
+  TEST_CHECK(strcmp(out, "caf\303\251") == 0);
+
+  mutt_ch_iconv_close(cd2);
+  mutt_ch_iconv_close(cd3);
+
+  char buf[64];
+  for (int i = 0; i < 2; i++)
+  {
+    mutt_ch_canonical_charset(buf, sizeof(buf), "ISO8859-15//TRANSLIT");
+    TEST_CHECK(strcmp(buf, "iso-8859-15//TRANSLIT") == 0);
+    mutt_ch_canonical_charset(buf, sizeof(buf), "UTF8");
+    TEST_CHECK(strcmp(buf, "utf-8") == 0);
+  }
+
+  mutt_ch_cache_cleanup();
+}
@@ -0,0 +1,35 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <time.h>
+#include "mutt/date.h"
+#include "mutt/memory.h"
+
+void test_date_parse_date(void)
+{
+  static const struct
+  {
+    const char *date;
+    time_t expected;
+  } tests[] = {
+    { "Mon, 1 Jan 2018 00:00:00 +0000", 1514764800 },
+    { "Tue, 14 Oct 2003 17:51:02 -0700 (PDT)", 1066179062 },
+    { "Sun, 06 Nov 1994 08:49:37 (-0700)", 784136977 },
+    { "3 Feb 99 11:12 EST", 918058320 },
+    { "1 Jan 2018 1:02:03 GMT", 1514768523 },
+    { "1 Jan 2018 23:59:60 GMT", 1514851200 },
+    { "1 Jan 2018 24:00:00 GMT", -1 },
+    { "1 Jan 2018 99:99:99", -1 },
+  };
+
+  for (size_t i = 0; i < mutt_array_size(tests); i++)
+  {
+    time_t t = mutt_date_parse_date(tests[i].date, NULL);
+    if (!TEST_CHECK(t == tests[i].expected))
+    {
+      TEST_MSG("Date     : %s", tests[i].date);
+      TEST_MSG("Expected : %ld", (long) tests[i].expected);
+      TEST_MSG("Actual   : %ld", (long) t);
+    }
+  }
+}
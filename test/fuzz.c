@@ -0,0 +1,520 @@
+/**
+ * @file
+ * Fuzz the parsers of untrusted input and measure their throughput
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page fuzz Parser fuzzing and throughput
+ *
+ * Each target feeds one input to a parser of data that comes from the network
+ * or from other people's mail:
+ *
+ * | Target        | Parser
+ * | :------------ | :-------------------------------------------
+ * | parse         | mutt_read_rfc822_header(), a message header
+ * | rfc2047       | mutt_rfc2047_decode(), an encoded-word header
+ * | rfc2231       | mutt_parse_content_type(), a Content-Type value
+ * | date          | mutt_date_parse_date(), a Date value
+ * | imap-fetch    | imap_parse_fetch(), the data of a FETCH response
+ * | nntp-overview | nntp_parse_overview(), an OVER response line
+ *
+ * Built with -DFUZZ_LIBFUZZER, this file provides LLVMFuzzerTestOneInput()
+ * and the target is chosen with $NEOMUTT_FUZZ, e.g.
+ *
+ *     NEOMUTT_FUZZ=imap-fetch test/fuzz-libfuzzer test/corpus/imap-fetch
+ *
+ * Otherwise, it replays the corpus of each target, test/corpus/TARGET/, until
+ * at least a few megabytes have been parsed, and reports the fastest run as
+ * JSON on stdout, one target per line:
+ *
+ *     { "runs": 3, "results": [
+ *       { "target": "parse", "files": 6, "bytes": 4194304, "ms": 61.2, "mb_per_sec": 68.5 },
+ *       ... ] }
+ *
+ * Given the output of an earlier run with -b, it exits non-zero if any target
+ * has become slower by more than the threshold.
+ *
+ * Usage: neomutt-fuzz [-d corpus] [-r runs] [-m megabytes] [-b baseline] [-t percent] [target...]
+ */
+
+#define MAIN_C 1
+
+#include "config.h"
+#include <dirent.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mutt/mutt.h"
+#include "mutt.h"
+#include "body.h"
+#include "buffy.h"
+#include "envelope.h"
+#include "globals.h"
+#include "header.h"
+#include "imap/imap_private.h"
+#include "imap/message.h"
+#include "nntp.h"
+#include "options.h"
+#include "protos.h"
+
+char **envlist = NULL;
+
+extern char *OverviewFmt;
+
+void mutt_exit(int code)
+{
+  exit(code);
+}
+
+/**
+ * quiet_message - Discard messages and errors
+ */
+static void quiet_message(const char *format, ...)
+{
+}
+
+/**
+ * fuzz_parse - Parse a message header
+ */
+static void fuzz_parse(char *s, size_t len)
+{
+  if (len == 0)
+    return;
+
+  FILE *fp = fmemopen(s, len, "r");
+  if (!fp)
+    return;
+
+  struct Header *h = mutt_new_header();
+  h->env = mutt_read_rfc822_header(fp, h, 1, 0);
+  mutt_free_header(&h);
+  fclose(fp);
+}
+
+/**
+ * fuzz_rfc2047 - Decode an RFC2047 header
+ */
+static void fuzz_rfc2047(char *s, size_t len)
+{
+  char *d = mutt_str_strdup(s);
+  mutt_rfc2047_decode(&d);
+  FREE(&d);
+}
+
+/**
+ * fuzz_rfc2231 - Parse a Content-Type with RFC2231 parameters
+ */
+static void fuzz_rfc2231(char *s, size_t len)
+{
+  struct Body *b = mutt_new_body();
+  mutt_parse_content_type(s, b);
+  mutt_free_body(&b);
+}
+
+/**
+ * fuzz_date - Parse a Date header
+ */
+static void fuzz_date(char *s, size_t len)
+{
+  mutt_date_parse_date(s, NULL);
+}
+
+/**
+ * fuzz_imap_fetch - Parse the data of an IMAP FETCH response
+ */
+static void fuzz_imap_fetch(char *s, size_t len)
+{
+  struct ImapHeader h;
+
+  memset(&h, 0, sizeof(h));
+  h.data = mutt_mem_calloc(1, sizeof(struct ImapHeaderData));
+  imap_parse_fetch(&h, s);
+  imap_free_header_data(&h.data);
+}
+
+/**
+ * fuzz_nntp_overview - Parse an NNTP overview line
+ */
+static void fuzz_nntp_overview(char *s, size_t len)
+{
+  static FILE *fp = NULL;
+
+  if (!fp)
+    fp = tmpfile();
+  if (!fp)
+    return;
+
+  /* parse_overview_line() has already read the article number */
+  char *fields = strchr(s, '\t');
+  if (fields)
+    fields++;
+
+  struct Header *h = nntp_parse_overview(fp, OverviewFmt, fields);
+  mutt_free_header(&h);
+}
+
+/**
+ * struct FuzzTarget - A parser to be fuzzed
+ */
+struct FuzzTarget
+{
+  const char *name;                  /**< Name, and directory of its corpus */
+  void (*parse)(char *s, size_t len); /**< Parse one NUL-terminated input */
+};
+
+static const struct FuzzTarget Targets[] = {
+  { "parse", fuzz_parse },
+  { "rfc2047", fuzz_rfc2047 },
+  { "rfc2231", fuzz_rfc2231 },
+  { "date", fuzz_date },
+  { "imap-fetch", fuzz_imap_fetch },
+  { "nntp-overview", fuzz_nntp_overview },
+  { NULL, NULL },
+};
+
+/**
+ * find_target - Look up a target by name
+ * @param name Name of the target
+ * @retval ptr  Target
+ * @retval NULL No such target
+ */
+static const struct FuzzTarget *find_target(const char *name)
+{
+  for (const struct FuzzTarget *t = Targets; t->name; t++)
+    if (mutt_str_strcmp(t->name, name) == 0)
+      return t;
+  return NULL;
+}
+
+/**
+ * fuzz_init - Set up NeoMutt without a screen or a config file
+ */
+static void fuzz_init(void)
+{
+  struct ListHead commands = STAILQ_HEAD_INITIALIZER(commands);
+
+  OPT_NO_CURSES = true;
+  mutt_message = quiet_message;
+  mutt_error = quiet_message;
+  mutt_list_insert_tail(&Muttrc, mutt_str_strdup("/dev/null"));
+  mutt_init(1, &commands);
+}
+
+/**
+ * fuzz_one - Run a target on one input
+ * @param t    Target
+ * @param data Input, not NUL-terminated
+ * @param len  Length of the input
+ *
+ * The parsers take strings, and some modify them, so they get a copy.
+ */
+static void fuzz_one(const struct FuzzTarget *t, const uint8_t *data, size_t len)
+{
+  char *s = mutt_mem_malloc(len + 1);
+  memcpy(s, data, len);
+  s[len] = '\0';
+  t->parse(s, len);
+  FREE(&s);
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+static const struct FuzzTarget *Target = NULL;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv)
+{
+  const char *name = getenv("NEOMUTT_FUZZ");
+
+  Target = find_target(NONULL(name));
+  if (!Target)
+  {
+    fprintf(stderr, "Set $NEOMUTT_FUZZ to one of:");
+    for (const struct FuzzTarget *t = Targets; t->name; t++)
+      fprintf(stderr, " %s", t->name);
+    fprintf(stderr, "\n");
+    exit(1);
+  }
+
+  fuzz_init();
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+  fuzz_one(Target, data, size);
+  return 0;
+}
+
+#else
+
+/**
+ * struct FuzzInput - One file of a corpus
+ */
+struct FuzzInput
+{
+  uint8_t *data; /**< Contents of the file */
+  size_t len;    /**< Length of the file */
+};
+
+/**
+ * struct FuzzCorpus - All the inputs of one target
+ */
+struct FuzzCorpus
+{
+  struct FuzzInput *inputs; /**< Files of the corpus */
+  size_t count;             /**< Number of files */
+  size_t bytes;             /**< Total size of the files */
+};
+
+/**
+ * now_usecs - Get a monotonic timestamp
+ * @retval num Microseconds
+ */
+static double now_usecs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * read_corpus - Read every file of a target's corpus
+ * @param c   Corpus to fill
+ * @param dir Directory of the corpus
+ * @retval  0 Success
+ * @retval -1 Error, the directory can't be read
+ */
+static int read_corpus(struct FuzzCorpus *c, const char *dir)
+{
+  DIR *d = opendir(dir);
+  if (!d)
+    return -1;
+
+  struct dirent *de = NULL;
+  while ((de = readdir(d)))
+  {
+    if (de->d_name[0] == '.')
+      continue;
+
+    char path[PATH_MAX];
+    mutt_file_concat_path(path, dir, de->d_name, sizeof(path));
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+      continue;
+
+    struct FuzzInput in = { NULL, 0 };
+    size_t alloc = 0;
+    size_t n;
+    do
+    {
+      if (in.len == alloc)
+      {
+        alloc += 4096;
+        mutt_mem_realloc(&in.data, alloc);
+      }
+      n = fread(in.data + in.len, 1, alloc - in.len, fp);
+      in.len += n;
+    } while (n > 0);
+    fclose(fp);
+
+    mutt_mem_realloc(&c->inputs, (c->count + 1) * sizeof(struct FuzzInput));
+    c->inputs[c->count++] = in;
+    c->bytes += in.len;
+  }
+  closedir(d);
+  return 0;
+}
+
+/**
+ * free_corpus - Free the inputs of a corpus
+ * @param c Corpus
+ */
+static void free_corpus(struct FuzzCorpus *c)
+{
+  for (size_t i = 0; i < c->count; i++)
+    FREE(&c->inputs[i].data);
+  FREE(&c->inputs);
+  c->count = 0;
+  c->bytes = 0;
+}
+
+/**
+ * baseline_speed - Find a target's throughput in an earlier report
+ * @param file   Report written by an earlier run
+ * @param target Name of the target
+ * @retval num Throughput in MB/s, 0 if it isn't there
+ */
+static double baseline_speed(const char *file, const char *target)
+{
+  char line[LONG_STRING];
+  char key[STRING];
+  double speed = 0;
+
+  FILE *fp = fopen(file, "r");
+  if (!fp)
+    return 0;
+
+  snprintf(key, sizeof(key), "\"target\": \"%s\"", target);
+  while (fgets(line, sizeof(line), fp))
+  {
+    char *p = strstr(line, key);
+    if (!p)
+      continue;
+    p = strstr(p, "\"mb_per_sec\": ");
+    if (p)
+      speed = strtod(p + 14, NULL);
+    break;
+  }
+  fclose(fp);
+  return speed;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-d corpus] [-r runs] [-m megabytes] [-b baseline] "
+                  "[-t percent] [target...]\n",
+          prog);
+  fprintf(stderr, "  -d  Directory of the corpora, one per target (default test/corpus)\n");
+  fprintf(stderr, "  -r  Runs of each target; the fastest is reported (default 3)\n");
+  fprintf(stderr, "  -m  Megabytes to parse in each run (default 4)\n");
+  fprintf(stderr, "  -b  Report of an earlier run to compare against\n");
+  fprintf(stderr, "  -t  Slowdown that fails the comparison, in percent (default 10)\n");
+  fprintf(stderr, "Targets:");
+  for (const struct FuzzTarget *t = Targets; t->name; t++)
+    fprintf(stderr, " %s", t->name);
+  fprintf(stderr, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+  const char *dir = "test/corpus";
+  const char *baseline = NULL;
+  double threshold = 10;
+  size_t min_bytes = 4 << 20;
+  int runs = 3;
+  int opt;
+  int rc = 0;
+  bool first = true;
+
+  while ((opt = getopt(argc, argv, "d:r:m:b:t:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'd':
+        dir = optarg;
+        break;
+      case 'r':
+        runs = atoi(optarg);
+        break;
+      case 'm':
+        min_bytes = strtoul(optarg, NULL, 10) << 20;
+        break;
+      case 'b':
+        baseline = optarg;
+        break;
+      case 't':
+        threshold = strtod(optarg, NULL);
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if ((runs < 1) || (min_bytes == 0))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  for (int i = optind; i < argc; i++)
+  {
+    if (!find_target(argv[i]))
+    {
+      fprintf(stderr, "%s: unknown target '%s'\n", argv[0], argv[i]);
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  fuzz_init();
+
+  printf("{ \"runs\": %d, \"results\": [", runs);
+  for (const struct FuzzTarget *t = Targets; t->name; t++)
+  {
+    bool wanted = (optind == argc);
+    for (int i = optind; i < argc; i++)
+      if (mutt_str_strcmp(argv[i], t->name) == 0)
+        wanted = true;
+    if (!wanted)
+      continue;
+
+    char path[PATH_MAX];
+    struct FuzzCorpus c = { NULL, 0, 0 };
+    mutt_file_concat_path(path, dir, t->name, sizeof(path));
+    if ((read_corpus(&c, path) != 0) || (c.bytes == 0))
+    {
+      fprintf(stderr, "%s: no corpus in %s\n", argv[0], path);
+      free_corpus(&c);
+      rc = 1;
+      continue;
+    }
+
+    /* A corpus is small, so replay it until the timing means something */
+    size_t rounds = (min_bytes + c.bytes - 1) / c.bytes;
+    double best = 0;
+    for (int r = 0; r < runs; r++)
+    {
+      double t0 = now_usecs();
+      for (size_t i = 0; i < rounds; i++)
+        for (size_t j = 0; j < c.count; j++)
+          fuzz_one(t, c.inputs[j].data, c.inputs[j].len);
+      double usecs = now_usecs() - t0;
+      if ((best == 0) || (usecs < best))
+        best = usecs;
+    }
+
+    size_t bytes = rounds * c.bytes;
+    double speed = (best > 0) ? bytes / best : 0; /* bytes/us is MB/s */
+    printf("%s\n    { \"target\": \"%s\", \"files\": %zu, \"bytes\": %zu, "
+           "\"ms\": %.3f, \"mb_per_sec\": %.2f }",
+           first ? "" : ",", t->name, c.count, bytes, best / 1e3, speed);
+    first = false;
+
+    if (baseline)
+    {
+      double was = baseline_speed(baseline, t->name);
+      if ((was > 0) && (speed < was * (1 - threshold / 100)))
+      {
+        fprintf(stderr, "%s: %.2f MB/s, was %.2f MB/s (%.0f%%)\n", t->name,
+                speed, was, (speed - was) * 100 / was);
+        rc = 1;
+      }
+    }
+
+    free_corpus(&c);
+  }
+  printf("\n  ] }\n");
+
+  return rc;
+}
+
+#endif /* FUZZ_LIBFUZZER */
@@ -0,0 +1,76 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "mutt/hash.h"
+#include "mutt/memory.h"
+#include "mutt/string2.h"
+
+void test_hash_grow(void)
+{
+  static int data[5000];
+  char key[32];
+
+  struct Hash *table = mutt_hash_create(4, MUTT_HASH_STRDUP_KEYS);
+  struct HashElem *first = mutt_hash_insert(table, "key-0", &data[0]);
+  for (int i = 1; i < mutt_array_size(data); i++)
+  {
+    snprintf(key, sizeof(key), "key-%d", i);
+    mutt_hash_insert(table, key, &data[i]);
+  }
+
+  TEST_CHECK(table->count == mutt_array_size(data));
+  TEST_CHECK(table->nelem * 2 >= table->count);
+  TEST_CHECK(mutt_hash_find_elem(table, "key-0") == first);
+
+  for (int i = 0; i < mutt_array_size(data); i++)
+  {
+    snprintf(key, sizeof(key), "key-%d", i);
+    if (!TEST_CHECK(mutt_hash_find(table, key) == &data[i]))
+      TEST_MSG("Key: %s", key);
+  }
+
+  /* the chains are still sorted */
+  for (int i = 0; i < table->nelem; i++)
+    for (struct HashElem *he = table->table[i]; he && he->next; he = he->next)
+      TEST_CHECK(mutt_str_strcmp(he->key.strkey, he->next->key.strkey) < 0);
+
+  mutt_hash_delete(table, "key-42", NULL);
+  TEST_CHECK(mutt_hash_find(table, "key-42") == NULL);
+  TEST_CHECK(table->count == mutt_array_size(data) - 1);
+
+  mutt_hash_destroy(&table);
+}
+
+void test_hash_grow_dups(void)
+{
+  static int data[1000];
+
+  struct Hash *table = mutt_hash_int_create(2, MUTT_HASH_ALLOW_DUPS);
+  for (int i = 0; i < mutt_array_size(data); i++)
+    mutt_hash_int_insert(table, i % 10, &data[i]);
+
+  TEST_CHECK(table->count == mutt_array_size(data));
+
+  /* duplicates are found newest first */
+  for (int k = 0; k < 10; k++)
+  {
+    int last = mutt_array_size(data);
+    for (struct HashElem *he = table->table[k % table->nelem]; he; he = he->next)
+    {
+      if (he->key.intkey != k)
+        continue;
+      int i = (int *) he->data - data;
+      TEST_CHECK(i < last);
+      last = i;
+    }
+    TEST_CHECK(mutt_hash_int_find(table, k) == &data[990 + k]);
+  }
+
+  mutt_hash_int_delete(table, 3, NULL);
+  TEST_CHECK(mutt_hash_int_find(table, 3) == NULL);
+  TEST_CHECK(table->count == mutt_array_size(data) - 100);
+
+  mutt_hash_destroy(&table);
+}
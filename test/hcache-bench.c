@@ -0,0 +1,401 @@
+/**
+ * @file
+ * Benchmark the header cache backends
+ *
+ * @copyright
+ * This program is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation, either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * @page hcache_bench Header cache benchmark
+ *
+ * Store, fetch, restore and delete a set of synthetic headers with each of the
+ * compiled-in header cache backends, and report the throughput and latency of
+ * every operation.
+ *
+ * The output is one tab-separated line per backend and operation:
+ *
+ *     backend  op  count  total_ms  ops_per_sec  p50_us  p99_us
+ *
+ * Usage: hcache-bench [-n count] [-b backends] [-d directory]
+ */
+
+#define MAIN_C 1
+
+#include "config.h"
+#include <dirent.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mutt/mutt.h"
+#include "mutt.h"
+#include "address.h"
+#include "body.h"
+#include "buffy.h"
+#include "envelope.h"
+#include "globals.h"
+#include "hcache/hcache.h"
+#include "header.h"
+#include "options.h"
+
+char **envlist = NULL;
+
+void mutt_exit(int code)
+{
+  exit(code);
+}
+
+/**
+ * enum BenchOp - Header cache operations being measured
+ */
+enum BenchOp
+{
+  BENCH_STORE,
+  BENCH_FETCH,
+  BENCH_RESTORE,
+  BENCH_DELETE,
+  BENCH_MAX
+};
+
+static const char *const BenchOpNames[BENCH_MAX] = { "store", "fetch", "restore", "delete" };
+
+/**
+ * struct BenchTimes - Latencies of one operation
+ */
+struct BenchTimes
+{
+  double *usecs; /**< Latency of each call */
+  size_t count;  /**< Number of calls */
+  double total;  /**< Wall-clock time of the whole phase, in microseconds */
+};
+
+/**
+ * now_usecs - Get a monotonic timestamp
+ * @retval num Microseconds
+ */
+static double now_usecs(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/**
+ * cmp_double - Compare two latencies for qsort()
+ */
+static int cmp_double(const void *a, const void *b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * percentile - Pick a percentile from sorted latencies
+ * @param t   Latencies, sorted
+ * @param pct Percentile, 0-100
+ * @retval num Latency in microseconds
+ */
+static double percentile(const struct BenchTimes *t, int pct)
+{
+  if (t->count == 0)
+    return 0;
+
+  size_t i = t->count * pct / 100;
+  if (i >= t->count)
+    i = t->count - 1;
+  return t->usecs[i];
+}
+
+/**
+ * make_header - Generate a synthetic message header
+ * @param i Message number
+ * @retval ptr New Header
+ */
+static struct Header *make_header(int i)
+{
+  char buf[STRING];
+  struct Header *h = mutt_new_header();
+
+  h->env = mutt_env_new();
+  h->content = mutt_new_body();
+
+  snprintf(buf, sizeof(buf), "Re: Synthetic message number %d in the benchmark folder", i);
+  h->env->subject = mutt_str_strdup(buf);
+  snprintf(buf, sizeof(buf), "<%d.%d@bench.example.org>", i, i * 7919);
+  h->env->message_id = mutt_str_strdup(buf);
+  if (i > 0)
+  {
+    snprintf(buf, sizeof(buf), "<%d.%d@bench.example.org>", i - 1, (i - 1) * 7919);
+    mutt_list_insert_tail(&h->env->references, mutt_str_strdup(buf));
+    mutt_list_insert_tail(&h->env->in_reply_to, mutt_str_strdup(buf));
+  }
+
+  h->env->from = mutt_addr_new();
+  snprintf(buf, sizeof(buf), "Sender %d", i % 97);
+  h->env->from->personal = mutt_str_strdup(buf);
+  snprintf(buf, sizeof(buf), "sender%d@bench.example.org", i % 97);
+  h->env->from->mailbox = mutt_str_strdup(buf);
+  h->env->to = mutt_addr_new();
+  h->env->to->mailbox = mutt_str_strdup("list@bench.example.org");
+
+  h->content->type = TYPETEXT;
+  h->content->subtype = mutt_str_strdup("plain");
+  h->content->encoding = ENCQUOTEDPRINTABLE;
+  mutt_param_set(&h->content->parameter, "charset", "utf-8");
+  h->content->length = 1024 + (i % 4096);
+
+  h->date_sent = 1500000000 + i * 60;
+  h->received = h->date_sent + 5;
+  h->lines = 20 + (i % 200);
+  h->read = (i % 3) != 0;
+  h->flagged = (i % 50) == 0;
+
+  return h;
+}
+
+/**
+ * clean_dir - Remove the files the benchmark created
+ * @param dir Directory
+ */
+static void clean_dir(const char *dir)
+{
+  char path[PATH_MAX];
+  struct dirent *de = NULL;
+  DIR *dp = opendir(dir);
+  if (!dp)
+    return;
+
+  while ((de = readdir(dp)))
+  {
+    if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0))
+      continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    unlink(path);
+  }
+  closedir(dp);
+}
+
+/**
+ * bench_backend - Run all the operations against one backend
+ * @param backend Backend name
+ * @param dir     Directory for the database
+ * @param hdrs    Headers to store
+ * @param keys    Keys of the headers
+ * @param n       Number of headers
+ * @param times   Results, one per operation
+ * @retval  0 Success
+ * @retval -1 Error
+ */
+static int bench_backend(const char *backend, const char *dir, struct Header **hdrs,
+                         char **keys, size_t n, struct BenchTimes *times)
+{
+  header_cache_t *hc = NULL;
+  double start, t0, t1, t2;
+  size_t missing = 0;
+
+  HeaderCacheBackend = (char *) backend;
+
+  /* store, including the final flush to disk */
+  hc = mutt_hcache_open(dir, "bench", NULL);
+  if (!hc)
+  {
+    fprintf(stderr, "%s: can't open the header cache in %s\n", backend, dir);
+    return -1;
+  }
+  start = now_usecs();
+  for (size_t i = 0; i < n; i++)
+  {
+    t0 = now_usecs();
+    mutt_hcache_store(hc, keys[i], strlen(keys[i]), hdrs[i], 0);
+    times[BENCH_STORE].usecs[i] = now_usecs() - t0;
+  }
+  mutt_hcache_close(hc);
+  times[BENCH_STORE].total = now_usecs() - start;
+  times[BENCH_STORE].count = n;
+
+  /* fetch and restore, from a freshly opened database */
+  hc = mutt_hcache_open(dir, "bench", NULL);
+  if (!hc)
+    return -1;
+  for (size_t i = 0; i < n; i++)
+  {
+    t0 = now_usecs();
+    void *data = mutt_hcache_fetch(hc, keys[i], strlen(keys[i]));
+    t1 = now_usecs();
+    times[BENCH_FETCH].usecs[i] = t1 - t0;
+    if (!data)
+    {
+      missing++;
+      times[BENCH_RESTORE].usecs[i] = 0;
+      continue;
+    }
+
+    struct Header *h = mutt_hcache_restore(data);
+    t2 = now_usecs();
+    times[BENCH_RESTORE].usecs[i] = t2 - t1;
+    times[BENCH_FETCH].total += t1 - t0;
+    times[BENCH_RESTORE].total += t2 - t1;
+
+    mutt_hcache_free(hc, &data);
+    mutt_free_header(&h);
+  }
+  times[BENCH_FETCH].count = n;
+  times[BENCH_RESTORE].count = n;
+
+  /* delete */
+  start = now_usecs();
+  for (size_t i = 0; i < n; i++)
+  {
+    t0 = now_usecs();
+    mutt_hcache_delete(hc, keys[i], strlen(keys[i]));
+    times[BENCH_DELETE].usecs[i] = now_usecs() - t0;
+  }
+  mutt_hcache_close(hc);
+  times[BENCH_DELETE].total = now_usecs() - start;
+  times[BENCH_DELETE].count = n;
+
+  if (missing)
+  {
+    fprintf(stderr, "%s: %zu of %zu headers weren't found\n", backend, missing, n);
+    return -1;
+  }
+
+  return 0;
+}
+
+static void usage(const char *prog)
+{
+  fprintf(stderr, "Usage: %s [-n count] [-b backends] [-d directory]\n", prog);
+  fprintf(stderr, "  -n  Number of synthetic headers (default 10000)\n");
+  fprintf(stderr, "  -b  Comma-separated backends (default: all compiled in)\n");
+  fprintf(stderr, "  -d  Existing directory for the databases (default: a temporary one)\n");
+}
+
+int main(int argc, char *argv[])
+{
+  size_t n = 10000;
+  char *backends = NULL;
+  char tmpdir[PATH_MAX] = "";
+  const char *dir = NULL;
+  int opt;
+  int rc = 0;
+
+  while ((opt = getopt(argc, argv, "n:b:d:h")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n':
+        n = strtoul(optarg, NULL, 10);
+        break;
+      case 'b':
+        backends = mutt_str_strdup(optarg);
+        break;
+      case 'd':
+        dir = optarg;
+        break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+
+  if (n == 0)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+
+  Charset = mutt_str_strdup("utf-8");
+  mutt_ch_set_charset(Charset);
+
+  if (!backends)
+    backends = (char *) mutt_hcache_backend_list();
+
+  if (!dir)
+  {
+    const char *tmp = getenv("TMPDIR");
+    snprintf(tmpdir, sizeof(tmpdir), "%s/neomutt-hcache-bench-XXXXXX",
+             (tmp && *tmp) ? tmp : "/tmp");
+    if (!mkdtemp(tmpdir))
+    {
+      perror(tmpdir);
+      return 1;
+    }
+    dir = tmpdir;
+  }
+
+  struct Header **hdrs = mutt_mem_calloc(n, sizeof(struct Header *));
+  char **keys = mutt_mem_calloc(n, sizeof(char *));
+  for (size_t i = 0; i < n; i++)
+  {
+    char key[32];
+    snprintf(key, sizeof(key), "/%zu", i + 1);
+    keys[i] = mutt_str_strdup(key);
+    hdrs[i] = make_header(i);
+  }
+
+  struct BenchTimes times[BENCH_MAX];
+  for (int op = 0; op < BENCH_MAX; op++)
+    times[op].usecs = mutt_mem_calloc(n, sizeof(double));
+
+  printf("#backend\top\tcount\ttotal_ms\tops_per_sec\tp50_us\tp99_us\n");
+
+  char *saveptr = NULL;
+  for (char *b = strtok_r(backends, ", ", &saveptr); b; b = strtok_r(NULL, ", ", &saveptr))
+  {
+    for (int op = 0; op < BENCH_MAX; op++)
+    {
+      times[op].count = 0;
+      times[op].total = 0;
+    }
+
+    if (bench_backend(b, dir, hdrs, keys, n, times) != 0)
+      rc = 1;
+    clean_dir(dir);
+
+    for (int op = 0; op < BENCH_MAX; op++)
+    {
+      struct BenchTimes *t = &times[op];
+      if (t->count == 0)
+        continue;
+      qsort(t->usecs, t->count, sizeof(double), cmp_double);
+      printf("%s\t%s\t%zu\t%.3f\t%.0f\t%.2f\t%.2f\n", b, BenchOpNames[op], t->count,
+             t->total / 1e3, (t->total > 0) ? t->count * 1e6 / t->total : 0,
+             percentile(t, 50), percentile(t, 99));
+    }
+    fflush(stdout);
+  }
+
+  if (tmpdir[0])
+    rmdir(tmpdir);
+
+  for (int op = 0; op < BENCH_MAX; op++)
+    FREE(&times[op].usecs);
+  for (size_t i = 0; i < n; i++)
+  {
+    mutt_free_header(&hdrs[i]);
+    FREE(&keys[i]);
+  }
+  FREE(&hdrs);
+  FREE(&keys);
+  FREE(&backends);
+  FREE(&Charset);
+
+  return rc;
+}
@@ -7,12 +7,24 @@
   NEOMUTT_TEST_ITEM(test_base64_encode)                                        \
   NEOMUTT_TEST_ITEM(test_base64_decode)                                        \
   NEOMUTT_TEST_ITEM(test_base64_lengths)                                       \
+  NEOMUTT_TEST_ITEM(test_buffer_grow)                                          \
+  NEOMUTT_TEST_ITEM(test_charset_iconv_cache)                                  \
+  NEOMUTT_TEST_ITEM(test_date_parse_date)                                      \
+  NEOMUTT_TEST_ITEM(test_hash_grow)                                            \
+  NEOMUTT_TEST_ITEM(test_hash_grow_dups)                                       \
   NEOMUTT_TEST_ITEM(test_rfc2047)                                              \
   NEOMUTT_TEST_ITEM(test_md5)                                                  \
   NEOMUTT_TEST_ITEM(test_md5_ctx)                                              \
   NEOMUTT_TEST_ITEM(test_md5_ctx_bytes)                                        \
+  NEOMUTT_TEST_ITEM(test_mb_ascii_run)                                         \
+  NEOMUTT_TEST_ITEM(test_regex_literal)                                        \
   NEOMUTT_TEST_ITEM(test_string_strfcpy)                                       \
-  NEOMUTT_TEST_ITEM(test_string_strnfcpy)
+  NEOMUTT_TEST_ITEM(test_string_strnfcpy)                                      \
+  NEOMUTT_TEST_ITEM(test_string_atoull)                                        \
+  NEOMUTT_TEST_ITEM(test_worker_submit)                                        \
+  NEOMUTT_TEST_ITEM(test_worker_cancel)                                        \
+  NEOMUTT_TEST_ITEM(test_worker_group)                                         \
+  NEOMUTT_TEST_ITEM(test_worker_no_thread)
 
 /******************************************************************************
  * You probably don't need to touch what follows.
@@ -0,0 +1,44 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <string.h>
+#include "mutt/mbyte.h"
+#include "mutt/memory.h"
+
+void test_mb_ascii_run(void)
+{
+  static const struct
+  {
+    const char *str;
+    size_t run;
+  } tests[] = {
+    { "", 0 },
+    { "a", 1 },
+    { "Hello, world!", 13 },
+    { "exactly8", 8 },
+    { "sixteen bytes!!!", 16 },
+    { "tab\there", 3 },
+    { "0123456789abcdef\n", 16 },
+    { "0123456789abc\x7f", 13 },
+    { "~~~~~~~~~~~~~~~~~~~~", 20 },
+    { "caf\xc3\xa9 au lait", 3 },
+    { "\xff" "abcdefghij", 0 },
+    { "abcdefg\x1f" "abcdefg", 7 },
+    { "abcdefgh\x80", 8 },
+    { " !\"#$%&'()*+,-./", 16 },
+  };
+
+  for (size_t i = 0; i < mutt_array_size(tests); i++)
+  {
+    size_t run = mutt_mb_ascii_run(tests[i].str, strlen(tests[i].str));
+    if (!TEST_CHECK(run == tests[i].run))
+    {
+      TEST_MSG("String  : %s", tests[i].str);
+      TEST_MSG("Expected: %zu", tests[i].run);
+      TEST_MSG("Actual  : %zu", run);
+    }
+  }
+
+  /* the length limits the search */
+  TEST_CHECK(mutt_mb_ascii_run("abcdefghijklmnop", 11) == 11);
+}
@@ -0,0 +1,51 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include <stdbool.h>
+#include <string.h>
+#include "mutt/memory.h"
+#include "mutt/regex3.h"
+#include "mutt/string2.h"
+
+void test_regex_literal(void)
+{
+  static const struct
+  {
+    const char *regex;
+    const char *literal; /* NULL if none should be found */
+    bool exact;
+  } tests[] = {
+    { "hello", "hello", true },
+    { "foo\\.bar", "foo.bar", true },
+    { "^\\[PATCH", "[PATCH", false },
+    { "ab*cdef", "cdef", false },
+    { "abc+d", "abc", false },
+    { "colou?r", "colo", false },
+    { "x{2,3}yz", "yz", false },
+    { "a[]b]*cd", "cd", false },
+    { "[[:alpha:]]+ing", "ing", false },
+    { "pre(ab|cd)*post", "post", false },
+    { "\\<word\\>", "word", false },
+    { "foo|bar", NULL, false },
+    { "(unclosed", NULL, false },
+    { ".*", NULL, false },
+    { "caf\xc3\xa9", "caf", false },
+    { "", NULL, false },
+  };
+
+  for (size_t i = 0; i < mutt_array_size(tests); i++)
+  {
+    bool exact = !tests[i].exact;
+    char *literal = mutt_regex_literal(tests[i].regex, &exact);
+
+    if (!TEST_CHECK(mutt_str_strcmp(literal, tests[i].literal) == 0))
+    {
+      TEST_MSG("Regex   : %s", tests[i].regex);
+      TEST_MSG("Expected: %s", NONULL(tests[i].literal));
+      TEST_MSG("Actual  : %s", NONULL(literal));
+    }
+    if (tests[i].literal && !TEST_CHECK(exact == tests[i].exact))
+      TEST_MSG("Regex   : %s, exact should be %d", tests[i].regex, tests[i].exact);
+    FREE(&literal);
+  }
+}
@@ -107,3 +107,35 @@ void test_string_strnfcpy(void)
     }
   }
 }
+
+void test_string_atoull(void)
+{
+  unsigned long long val = 0;
+
+  { /* a 63-bit mod-sequence */
+    int rc = mutt_str_atoull("9223372036854775807", &val);
+    if (!TEST_CHECK((rc == 0) && (val == 9223372036854775807ULL)))
+    {
+      TEST_MSG("Expected: %d, %llu", 0, 9223372036854775807ULL);
+      TEST_MSG("Actual  : %d, %llu", rc, val);
+    }
+  }
+
+  { /* trailing characters */
+    int rc = mutt_str_atoull("715194045007)", &val);
+    if (!TEST_CHECK((rc == 1) && (val == 715194045007ULL)))
+    {
+      TEST_MSG("Expected: %d, %llu", 1, 715194045007ULL);
+      TEST_MSG("Actual  : %d, %llu", rc, val);
+    }
+  }
+
+  { /* out of range */
+    int rc = mutt_str_atoull("99999999999999999999999", &val);
+    if (!TEST_CHECK(rc == -1))
+    {
+      TEST_MSG("Expected: %d", -1);
+      TEST_MSG("Actual  : %d", rc);
+    }
+  }
+}
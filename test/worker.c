@@ -0,0 +1,204 @@
+#define TEST_NO_MAIN
+#include "acutest.h"
+
+#include "config.h"
+#include <dlfcn.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include "mutt/worker.h"
+
+#ifdef HAVE_PTHREAD_CREATE
+struct Delivered
+{
+  int count;
+  int sum;
+  int cancelled;
+};
+
+static struct Delivered Delivered;
+
+static void *double_job(void *arg)
+{
+  return (void *) (2 * (intptr_t) arg);
+}
+
+static void *wait_for_cancel_job(void *arg)
+{
+  __atomic_store_n((bool *) arg, true, __ATOMIC_SEQ_CST);
+  while (!mutt_worker_cancelled())
+    usleep(1000);
+  return arg;
+}
+
+static void count_done(void *arg, void *result, bool cancelled)
+{
+  Delivered.count++;
+  Delivered.sum += (int) (intptr_t) result;
+  if (cancelled)
+    Delivered.cancelled++;
+}
+
+/* Deliver results until no job is left, giving up after about five seconds */
+static void wait_for_jobs(void)
+{
+  for (int i = 0; (i < 5000) && (mutt_worker_pending() > 0); i++)
+  {
+    struct pollfd pfd = { .fd = mutt_worker_fd(), .events = POLLIN };
+    poll(&pfd, 1, 1);
+    mutt_worker_complete();
+  }
+}
+
+struct Shared
+{
+  pthread_mutex_t lock;
+  int next;
+  int done[1000];
+};
+
+static void *shared_job(void *arg)
+{
+  struct Shared *sh = arg;
+
+  pthread_mutex_lock(&sh->lock);
+  while (sh->next < (int) (sizeof(sh->done) / sizeof(sh->done[0])))
+  {
+    int i = sh->next++;
+    pthread_mutex_unlock(&sh->lock);
+    sh->done[i]++;
+    pthread_mutex_lock(&sh->lock);
+  }
+  pthread_mutex_unlock(&sh->lock);
+
+  return NULL;
+}
+
+static bool FailThreads = false;
+
+/* Stand in for the C library's, so the pool can be refused its threads */
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start)(void *), void *arg)
+{
+  static int (*real)(pthread_t *, const pthread_attr_t *, void *(*) (void *), void *) = NULL;
+
+  if (FailThreads)
+    return EAGAIN;
+  if (!real)
+    *(void **) &real = dlsym(RTLD_NEXT, "pthread_create");
+  return real(thread, attr, start, arg);
+}
+#endif
+
+void test_worker_submit(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+  memset(&Delivered, 0, sizeof(Delivered));
+  Threads = 4;
+
+  for (intptr_t i = 1; i <= 20; i++)
+    TEST_CHECK(mutt_worker_submit(double_job, count_done, (void *) i) != NULL);
+  TEST_CHECK(mutt_worker_fd() >= 0);
+
+  wait_for_jobs();
+  TEST_CHECK(mutt_worker_pending() == 0);
+  TEST_CHECK(Delivered.count == 20);
+  TEST_CHECK(Delivered.sum == 420);
+  TEST_CHECK(Delivered.cancelled == 0);
+
+  mutt_worker_shutdown();
+
+  /* without threads, the caller does the work */
+  Threads = 0;
+  TEST_CHECK(mutt_worker_submit(double_job, count_done, (void *) 1) == NULL);
+#endif
+}
+
+void test_worker_cancel(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+  bool running = false;
+
+  memset(&Delivered, 0, sizeof(Delivered));
+  Threads = 1;
+
+  struct WorkerJob *first = mutt_worker_submit(wait_for_cancel_job, NULL, &running);
+  struct WorkerJob *second = mutt_worker_submit(double_job, count_done, (void *) 5);
+  if (!TEST_CHECK(first && second))
+    return;
+
+  /* the only thread is busy, so the second job is still queued */
+  for (int i = 0; (i < 5000) && !__atomic_load_n(&running, __ATOMIC_SEQ_CST); i++)
+    usleep(1000);
+  mutt_worker_cancel(second);
+  wait_for_jobs();
+  TEST_CHECK(Delivered.count == 1);
+  TEST_CHECK(Delivered.sum == 0);
+  TEST_CHECK(Delivered.cancelled == 1);
+  TEST_CHECK(mutt_worker_pending() == 1);
+
+  /* the running job notices */
+  mutt_worker_cancel(first);
+  wait_for_jobs();
+  TEST_CHECK(mutt_worker_pending() == 0);
+
+  mutt_worker_shutdown();
+#endif
+}
+
+void test_worker_group(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+  static struct Shared sh;
+  struct WorkerGroup group;
+
+  memset(&sh, 0, sizeof(sh));
+  pthread_mutex_init(&sh.lock, NULL);
+  Threads = 3;
+
+  /* no more jobs than threads */
+  TEST_CHECK(mutt_worker_group_start(&group, 8, shared_job, &sh) == 3);
+  mutt_worker_group_wait(&group);
+
+  bool all = true;
+  for (size_t i = 0; i < sizeof(sh.done) / sizeof(sh.done[0]); i++)
+    all = all && (sh.done[i] == 1);
+  TEST_CHECK(all);
+
+  Threads = 0;
+  TEST_CHECK(mutt_worker_group_start(&group, 8, shared_job, &sh) == 0);
+
+  pthread_mutex_destroy(&sh.lock);
+  mutt_worker_shutdown();
+#endif
+}
+
+void test_worker_no_thread(void)
+{
+#ifdef HAVE_PTHREAD_CREATE
+  static struct Shared sh;
+  struct WorkerGroup group;
+
+  memset(&sh, 0, sizeof(sh));
+  pthread_mutex_init(&sh.lock, NULL);
+  mutt_worker_shutdown();
+  Threads = 4;
+
+  /* the jobs are taken back, for the caller to do the work */
+  FailThreads = true;
+  TEST_CHECK(mutt_worker_group_start(&group, 4, shared_job, &sh) == 0);
+  TEST_CHECK(mutt_worker_submit(double_job, count_done, (void *) 1) == NULL);
+  TEST_CHECK(mutt_worker_pending() == 0);
+  FailThreads = false;
+
+  /* nothing is left in the queue */
+  TEST_CHECK(mutt_worker_group_start(&group, 2, shared_job, &sh) == 2);
+  mutt_worker_group_wait(&group);
+  TEST_CHECK(sh.next == (int) (sizeof(sh.done) / sizeof(sh.done[0])));
+
+  pthread_mutex_destroy(&sh.lock);
+  mutt_worker_shutdown();
+#endif
+}
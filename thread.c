@@ -37,6 +37,9 @@
 #include "options.h"
 #include "protos.h"
 #include "sort.h"
+#ifdef USE_NNTP
+#include "mx.h"
+#endif
 
 static bool is_visible(struct Header *hdr, struct Context *ctx)
 {
@@ -165,7 +168,6 @@ static void calculate_visibility(struct Context *ctx, int *max_depth)
     tree->subtree_visible = 0;
     if (tree->message)
     {
-      FREE(&tree->message->tree);
       if (is_visible(tree->message, ctx))
       {
         tree->deep = true;
@@ -185,6 +187,8 @@ static void calculate_visibility(struct Context *ctx, int *max_depth)
       }
       else
       {
+        /* the tree of a visible message is redrawn by mutt_draw_tree() */
+        FREE(&tree->message->tree);
         tree->visible = false;
         tree->deep = !HideLimited;
       }
@@ -266,14 +270,17 @@ void mutt_draw_tree(struct Context *ctx)
   int depth = 0, start_depth = 0, max_depth = 0, width = NarrowTree ? 1 : 2;
   struct MuttThread *nextdisp = NULL, *pseudo = NULL, *parent = NULL, *tree = ctx->tree;
 
-  /* Do the visibility calculations and free the old thread chars.
-   * From now on we can simply ignore invisible subtrees
+  /* Do the visibility calculations and free the thread chars of the hidden
+   * messages.  From now on we can simply ignore invisible subtrees
    */
   calculate_visibility(ctx, &max_depth);
   pfx = mutt_mem_malloc(width * max_depth + 2);
   arrow = mutt_mem_malloc(width * max_depth + 2);
+  new_tree = mutt_mem_malloc(width * max_depth + 2);
   while (tree)
   {
+    if (!depth && tree->visible)
+      FREE(&tree->message->tree);
     if (depth)
     {
       myarrow = arrow + (depth - start_depth - (start_depth ? 0 : 1)) * width;
@@ -292,7 +299,6 @@ void mutt_draw_tree(struct Context *ctx)
       {
         myarrow[width] = MUTT_TREE_RARROW;
         myarrow[width + 1] = 0;
-        new_tree = mutt_mem_malloc((2 + depth * width));
         if (start_depth > 1)
         {
           strncpy(new_tree, pfx, (start_depth - 1) * width);
@@ -301,7 +307,9 @@ void mutt_draw_tree(struct Context *ctx)
         }
         else
           mutt_str_strfcpy(new_tree, arrow, 2 + depth * width);
-        tree->message->tree = new_tree;
+        /* Most of the trees are unchanged since the last time */
+        if (mutt_str_strcmp(tree->message->tree, new_tree) != 0)
+          mutt_str_replace(&tree->message->tree, new_tree);
       }
     }
     if (tree->child && depth)
@@ -367,6 +375,7 @@ void mutt_draw_tree(struct Context *ctx)
 
   FREE(&pfx);
   FREE(&arrow);
+  FREE(&new_tree);
 }
 
 /**
@@ -422,16 +431,149 @@ static void make_subject_list(struct ListHead *subjects, struct MuttThread *cur,
   }
 }
 
+/**
+ * struct SubjectCandidate - A message which a thread could be attached to
+ */
+struct SubjectCandidate
+{
+  struct MuttThread *thread; /**< The message */
+  time_t date;               /**< Date sent or received, see $thread_received */
+  int pos;                   /**< Position in the subject hash bucket */
+  int next;                  /**< Next candidate which may still match */
+};
+
+/**
+ * struct SubjectCandidates - The messages with one subject, the latest first
+ */
+struct SubjectCandidates
+{
+  struct SubjectCandidate *cand; /**< Candidates */
+  int count;                     /**< Number of candidates */
+};
+
+/**
+ * subject_candidates_free - Free a SubjectCandidates - Implements ::hash_destructor
+ */
+static void subject_candidates_free(int type, void *obj, intptr_t data)
+{
+  struct SubjectCandidates *sc = obj;
+
+  FREE(&sc->cand);
+  FREE(&sc);
+}
+
+/**
+ * compare_candidates - Sort the candidates, the latest first
+ * @param a First SubjectCandidate
+ * @param b Second SubjectCandidate
+ * @retval <0 a goes first
+ * @retval >0 b goes first
+ *
+ * Candidates with the same date are kept in the order of the hash bucket,
+ * because the first of them is the one find_subject() has always picked.
+ */
+static int compare_candidates(const void *a, const void *b)
+{
+  const struct SubjectCandidate *ca = a, *cb = b;
+
+  if (ca->date != cb->date)
+    return (ca->date > cb->date) ? -1 : 1;
+  return ca->pos - cb->pos;
+}
+
+/**
+ * get_subject_candidates - Get the messages with a subject
+ * @param ctx     Mailbox
+ * @param index   Candidates of the subjects seen so far
+ * @param subject Real subject
+ * @retval ptr Candidates, the latest first
+ */
+static struct SubjectCandidates *get_subject_candidates(struct Context *ctx,
+                                                        struct Hash *index,
+                                                        const char *subject)
+{
+  struct SubjectCandidates *sc = mutt_hash_find(index, subject);
+  if (sc)
+    return sc;
+
+  sc = mutt_mem_calloc(1, sizeof(struct SubjectCandidates));
+  int max = 0;
+  for (struct HashElem *ptr = mutt_hash_find_bucket(ctx->subj_hash, subject); ptr;
+       ptr = ptr->next)
+  {
+    struct Header *h = ptr->data;
+    if (!h->env->real_subj || (mutt_str_strcmp(subject, h->env->real_subj) != 0))
+      continue;
+
+    if (sc->count == max)
+    {
+      max = MAX(8, 2 * max);
+      mutt_mem_realloc(&sc->cand, max * sizeof(struct SubjectCandidate));
+    }
+    struct SubjectCandidate *c = &sc->cand[sc->count];
+    c->thread = h->thread;
+    c->date = ThreadReceived ? h->received : h->date_sent;
+    c->pos = sc->count++;
+  }
+
+  if (sc->count > 1)
+    qsort(sc->cand, sc->count, sizeof(struct SubjectCandidate), compare_candidates);
+  for (int i = 0; i < sc->count; i++)
+    sc->cand[i].next = i;
+
+  mutt_hash_insert(index, subject, sc);
+  return sc;
+}
+
+/**
+ * next_candidate - Skip the candidates which can no longer match
+ * @param sc Candidates
+ * @param i  Position to start from
+ * @retval num Position of the next live candidate, sc->count if there's none
+ *
+ * Once a message has been attached to a thread, or has lost its changed
+ * subject, it can't be matched again, so it's skipped for good.
+ */
+static int next_candidate(struct SubjectCandidates *sc, int i)
+{
+  int j = i;
+
+  while (j < sc->count)
+  {
+    if (sc->cand[j].next != j)
+      j = sc->cand[j].next;
+    else if (sc->cand[j].thread->fake_thread ||
+             !sc->cand[j].thread->message->subject_changed)
+      sc->cand[j].next = j + 1;
+    else
+      break;
+  }
+
+  /* Let the skipped candidates jump straight here next time */
+  while (i < j)
+  {
+    int next = sc->cand[i].next;
+    sc->cand[i].next = j;
+    i = next;
+  }
+
+  return j;
+}
+
 /**
  * find_subject - Find the best possible match for a parent based on subject
+ * @param ctx   Mailbox
+ * @param cur   Thread to attach
+ * @param index Candidates of the subjects seen so far
  *
  * If there are multiple matches, the one which was sent the latest, but before
  * the current message, is used.
  */
-static struct MuttThread *find_subject(struct Context *ctx, struct MuttThread *cur)
+static struct MuttThread *find_subject(struct Context *ctx, struct MuttThread *cur,
+                                       struct Hash *index)
 {
-  struct HashElem *ptr = NULL;
   struct MuttThread *tmp = NULL, *last = NULL;
+  time_t last_date = 0;
   struct ListHead subjects = STAILQ_HEAD_INITIALIZER(subjects);
   time_t date = 0;
 
@@ -440,20 +582,31 @@ static struct MuttThread *find_subject(struct Context *ctx, struct MuttThread *c
   struct ListNode *np;
   STAILQ_FOREACH(np, &subjects, entries)
   {
-    for (ptr = mutt_hash_find_bucket(ctx->subj_hash, np->data); ptr; ptr = ptr->next)
+    struct SubjectCandidates *sc = get_subject_candidates(ctx, index, np->data);
+
+    /* find the first candidate sent no later than cur */
+    int lo = 0, hi = sc->count;
+    while (lo < hi)
     {
-      tmp = ((struct Header *) ptr->data)->thread;
-      if (tmp != cur &&                    /* don't match the same message */
-          !tmp->fake_thread &&             /* don't match pseudo threads */
-          tmp->message->subject_changed && /* only match interesting replies */
-          !is_descendant(tmp, cur) &&      /* don't match in the same thread */
-          (date >= (ThreadReceived ? tmp->message->received : tmp->message->date_sent)) &&
-          (!last || (ThreadReceived ? (last->message->received < tmp->message->received) :
-                                      (last->message->date_sent < tmp->message->date_sent))) &&
-          tmp->message->env->real_subj &&
-          (mutt_str_strcmp(np->data, tmp->message->env->real_subj) == 0))
+      int mid = lo + (hi - lo) / 2;
+      if (sc->cand[mid].date > date)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    for (int i = next_candidate(sc, lo); i < sc->count; i = next_candidate(sc, i + 1))
+    {
+      if (last && (sc->cand[i].date <= last_date))
+        break;
+
+      tmp = sc->cand[i].thread;
+      if ((tmp != cur) &&           /* don't match the same message */
+          !is_descendant(tmp, cur)) /* don't match in the same thread */
       {
         last = tmp; /* best match so far */
+        last_date = sc->cand[i].date;
+        break;
       }
     }
   }
@@ -536,11 +689,15 @@ static void pseudo_threads(struct Context *ctx)
   if (!ctx->subj_hash)
     ctx->subj_hash = make_subj_hash(ctx);
 
+  /* Filled in as each subject is looked up */
+  struct Hash *index = mutt_hash_create(MAX(ctx->msgcount, 64), 0);
+  mutt_hash_set_destructor(index, subject_candidates_free, 0);
+
   while (tree)
   {
     cur = tree;
     tree = tree->next;
-    parent = find_subject(ctx, cur);
+    parent = find_subject(ctx, cur, index);
     if (parent)
     {
       cur->fake_thread = true;
@@ -585,6 +742,7 @@ static void pseudo_threads(struct Context *ctx)
       }
     }
   }
+  mutt_hash_destroy(&index);
   ctx->tree = top;
 }
 
@@ -622,11 +780,121 @@ static int compare_threads(const void *a, const void *b)
   }
 }
 
+/**
+ * struct ThreadKey - A sibling thread, with its sort key unpacked
+ */
+struct ThreadKey
+{
+  int64_t key;               /**< Field being sorted on, lowest first */
+  int index;                 /**< Header.index, to keep the order stable */
+  struct MuttThread *thread; /**< Thread being sorted */
+};
+
+/**
+ * thread_keyed - Can a sort method be done on the numbers in the Header?
+ * @param method Sort method, e.g. #SORT_DATE
+ * @retval true sort_siblings() can be used
+ */
+static bool thread_keyed(int method)
+{
+  switch (method & SORT_MASK)
+  {
+    case SORT_ORDER:
+#ifdef USE_NNTP
+      /* news is sorted by article number */
+      return !Context || (Context->magic != MUTT_NNTP);
+#endif
+    /* fallthrough */
+    case SORT_DATE:
+    case SORT_RECEIVED:
+    case SORT_SIZE:
+    case SORT_SCORE:
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * sort_siblings - Sort threads on a number from their sort_key
+ * @param array   Threads
+ * @param n       Number of threads
+ * @param scratch Space for 2 * n keys
+ *
+ * The same order as qsort() with compare_threads(), but the keys are copied
+ * out of the Headers once and merged without calling through the sort
+ * functions.  Ties are broken by Header.index, as perform_auxsort() does, so
+ * the order is complete.
+ */
+static void sort_siblings(struct MuttThread **array, int n, struct ThreadKey *scratch)
+{
+  struct ThreadKey *from = scratch, *to = scratch + n, *tmp = NULL;
+  int64_t sign = (Sort & SORT_REVERSE) ? -1 : 1;
+
+  for (int i = 0; i < n; i++)
+  {
+    const struct Header *h = array[i]->sort_key;
+    int64_t key;
+
+    switch (Sort & SORT_MASK)
+    {
+      case SORT_DATE:
+        key = h->date_sent;
+        break;
+      case SORT_RECEIVED:
+        key = h->received;
+        break;
+      case SORT_SIZE:
+        key = h->content->length;
+        break;
+      case SORT_SCORE:
+        key = -(int64_t) h->score; /* highest first */
+        break;
+      default:
+        key = h->index;
+        break;
+    }
+    from[i].key = sign * key;
+    from[i].index = sign * h->index;
+    from[i].thread = array[i];
+  }
+
+  for (int width = 1; width < n; width *= 2)
+  {
+    for (int lo = 0; lo < n; lo += 2 * width)
+    {
+      int mid = MIN(lo + width, n), hi = MIN(lo + 2 * width, n);
+      int i = lo, j = mid, k = lo;
+
+      while ((i < mid) && (j < hi))
+      {
+        if ((from[j].key < from[i].key) ||
+            ((from[j].key == from[i].key) && (from[j].index < from[i].index)))
+          to[k++] = from[j++];
+        else
+          to[k++] = from[i++];
+      }
+      while (i < mid)
+        to[k++] = from[i++];
+      while (j < hi)
+        to[k++] = from[j++];
+    }
+    tmp = from;
+    from = to;
+    to = tmp;
+  }
+
+  for (int i = 0; i < n; i++)
+    array[i] = from[i].thread;
+}
+
 struct MuttThread *mutt_sort_subthreads(struct MuttThread *thread, int init)
 {
   struct MuttThread **array = NULL, *sort_key = NULL, *top = NULL, *tmp = NULL;
   struct Header *oldsort_key = NULL;
+  struct ThreadKey *keys = NULL;
   int i, array_size, sort_top = 0;
+  bool keyed;
 
   /* we put things into the array backwards to save some cycles,
    * but we want to have to move less stuff around if we're
@@ -638,8 +906,11 @@ struct MuttThread *mutt_sort_subthreads(struct MuttThread *thread, int init)
     return thread;
 
   top = thread;
+  keyed = thread_keyed(Sort);
 
   array = mutt_mem_calloc((array_size = 256), sizeof(struct MuttThread *));
+  if (keyed)
+    keys = mutt_mem_malloc(2 * array_size * sizeof(struct ThreadKey));
   while (true)
   {
     if (init || !thread->sort_key)
@@ -678,12 +949,19 @@ struct MuttThread *mutt_sort_subthreads(struct MuttThread *thread, int init)
         for (i = 0; thread; i++, thread = thread->prev)
         {
           if (i >= array_size)
+          {
             mutt_mem_realloc(&array, (array_size *= 2) * sizeof(struct MuttThread *));
+            if (keyed)
+              mutt_mem_realloc(&keys, 2 * array_size * sizeof(struct ThreadKey));
+          }
 
           array[i] = thread;
         }
 
-        qsort((void *) array, i, sizeof(struct MuttThread *), *compare_threads);
+        if (keyed)
+          sort_siblings(array, i, keys);
+        else
+          qsort((void *) array, i, sizeof(struct MuttThread *), *compare_threads);
 
         /* attach them back together.  make thread the last sibling. */
         thread = array[0];
@@ -742,6 +1020,7 @@ struct MuttThread *mutt_sort_subthreads(struct MuttThread *thread, int init)
       {
         Sort ^= SORT_REVERSE;
         FREE(&array);
+        FREE(&keys);
         return top;
       }
     }
@@ -1164,9 +1443,19 @@ int mutt_parent_message(struct Context *ctx, struct Header *hdr, int find_root)
   return parent->virtual;
 }
 
+/**
+ * mutt_set_virtual - Number the visible messages
+ * @param ctx Mailbox
+ *
+ * Each visible message also learns how many messages of its thread are
+ * hidden.  That's the same for the whole thread, so it's counted once per
+ * thread, rather than once for each of its visible messages.
+ */
 void mutt_set_virtual(struct Context *ctx)
 {
   struct Header *cur = NULL;
+  struct MuttThread *top = NULL, *thread = NULL;
+  int num_hidden;
 
   ctx->vcount = 0;
   ctx->vsize = 0;
@@ -1180,11 +1469,43 @@ void mutt_set_virtual(struct Context *ctx)
       ctx->v2r[ctx->vcount] = i;
       ctx->vcount++;
       ctx->vsize += cur->content->length + cur->content->offset - cur->content->hdr_offset;
-      cur->num_hidden = mutt_get_hidden(ctx, cur);
+    }
+  }
+
+  for (top = ctx->tree; top; top = top->next)
+  {
+    for (thread = top; !thread->message; thread = thread->child)
+      ;
+    num_hidden = mutt_get_hidden(ctx, thread->message);
+
+    for (thread = top; thread;)
+    {
+      if (thread->message && (thread->message->virtual >= 0))
+        thread->message->num_hidden = num_hidden;
+
+      if (thread->child)
+        thread = thread->child;
+      else
+      {
+        while ((thread != top) && !thread->next)
+          thread = thread->parent;
+        thread = (thread == top) ? NULL : thread->next;
+      }
     }
   }
 }
 
+/**
+ * mutt_traverse_thread - Walk the thread of a message
+ * @param ctx  Mailbox
+ * @param cur  Any message in the thread
+ * @param flag What to do, e.g. #MUTT_THREAD_COLLAPSE
+ * @retval num Depends on @a flag, e.g. the virtual number of the message to
+ *             select after (un)collapsing, or the number of hidden messages
+ *
+ * Only the one thread is walked.  After a (un)collapse, the caller must
+ * renumber the messages with mutt_set_virtual().
+ */
 int mutt_traverse_thread(struct Context *ctx, struct Header *cur, int flag)
 {
   struct MuttThread *thread = NULL, *top = NULL;